@@ -0,0 +1,23 @@
+import time
+import taichi as ti
+
+
+def measure(func, repeat=20, bytes_moved=None):
+  """Times repeated calls of func after a warm-up call (which compiles the
+  kernels). Returns the median time in seconds, and the relative spread
+  between the 10th and 90th percentiles, which compare.py treats as noise."""
+  func()
+  ti.sync()
+  samples = []
+  for i in range(repeat):
+    t = time.perf_counter()
+    func()
+    ti.sync()
+    samples.append(time.perf_counter() - t)
+  samples.sort()
+  median = samples[len(samples) // 2]
+  spread = (samples[repeat * 9 // 10] - samples[repeat // 10]) / median
+  result = {'time': median, 'spread': spread}
+  if bytes_moved is not None:
+    result['GB/s'] = bytes_moved / median * 1e-9
+  return result
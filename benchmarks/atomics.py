@@ -0,0 +1,24 @@
+import taichi as ti
+from _util import measure
+
+# 4M atomic adds, into one (contended) or into 1M destinations
+n = 4 * 1024 * 1024
+
+
+def run_atomic_adds(num_dests):
+  x = ti.var(ti.f32, shape=num_dests)
+
+  @ti.kernel
+  def add():
+    for i in range(n):
+      ti.atomic_add(x[i % num_dests], 1.0)
+
+  return measure(add)
+
+
+def benchmark_contended():
+  return run_atomic_adds(1)
+
+
+def benchmark_scattered():
+  return run_atomic_adds(1024 * 1024)
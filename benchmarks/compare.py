@@ -0,0 +1,63 @@
+import argparse
+import json
+import sys
+
+# Usage: python3 compare.py baseline.json results.json [-t 0.05]
+# Flags the cases that got slower by more than the threshold, or by more than
+# twice the spread of either run if that is larger, so that noisy cases do not
+# raise false alarms, and likewise the cases whose ratio to their reference
+# (reference.py) grew. Exits with 1 if any case regressed.
+
+
+def load(fn):
+  with open(fn) as f:
+    return json.load(f)['results']
+
+
+def records(results):
+  for suite, cases in sorted(results.items()):
+    for case, archs in sorted(cases.items()):
+      for arch, rec in sorted(archs.items()):
+        yield (suite, case, arch), rec
+
+
+def main():
+  parser = argparse.ArgumentParser()
+  parser.add_argument('baseline')
+  parser.add_argument('results')
+  parser.add_argument('-t', '--threshold', type=float, default=0.05)
+  args = parser.parse_args()
+
+  baseline = dict(records(load(args.baseline)))
+  num_regressions = 0
+  for key, rec in records(load(args.results)):
+    name = '{}.{} [{}]'.format(*key)
+    if key not in baseline:
+      print(f'  new  {name:45} {rec["time"] * 1000:9.3f} ms')
+      continue
+    base = baseline[key]
+    noise = 2 * max(base.get('spread', 0), rec.get('spread', 0))
+    tolerance = max(args.threshold, noise)
+    # Cases with a reference also lose ground when only the reference got
+    # faster, e.g. on another machine
+    for figure, scale, unit in [('time', 1000, 'ms'), ('ratio', 1, 'x')]:
+      if figure not in base or figure not in rec:
+        continue
+      ratio = rec[figure] / base[figure]
+      if ratio > 1 + tolerance:
+        status = 'SLOW'
+        num_regressions += 1
+      elif ratio < 1 - tolerance:
+        status = 'fast'
+      else:
+        status = '  ok'
+      label = name if figure == 'time' else name + ' vs. reference'
+      print(f' {status} {label:45} {base[figure] * scale:9.3f} {unit} -> '
+            f'{rec[figure] * scale:9.3f} {unit} ({(ratio - 1) * 100:+6.1f}%, '
+            f'tolerance {tolerance * 100:.1f}%)')
+  print(f'{num_regressions} regression(s)')
+  return 1 if num_regressions else 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -0,0 +1,55 @@
+import time
+import taichi as ti
+
+# Time of the first launch of a kernel, almost all of which is compilation
+
+
+def run_first_launch(make_kernel):
+  kernel = make_kernel()
+  # Materializes the layout, which is not part of the kernel
+  ti.get_runtime().materialize()
+  t = time.perf_counter()
+  kernel()
+  ti.sync()
+  return time.perf_counter() - t
+
+
+def benchmark_fill():
+  x = ti.var(ti.f32, shape=1024)
+
+  def make_kernel():
+
+    @ti.kernel
+    def fill():
+      for i in x:
+        x[i] = i
+
+    return fill
+
+  return run_first_launch(make_kernel)
+
+
+def benchmark_p2g():
+  n_grid, n_particles = 128, 8192
+  x = ti.Vector(2, dt=ti.f32, shape=n_particles)
+  v = ti.Vector(2, dt=ti.f32, shape=n_particles)
+  grid_v = ti.Vector(2, dt=ti.f32, shape=(n_grid, n_grid))
+  grid_m = ti.var(dt=ti.f32, shape=(n_grid, n_grid))
+
+  def make_kernel():
+
+    @ti.kernel
+    def p2g():
+      for p in x:
+        base = (x[p] * n_grid - 0.5).cast(int)
+        fx = x[p] * n_grid - base.cast(float)
+        w = [0.5 * (1.5 - fx)**2, 0.75 - (fx - 1)**2, 0.5 * (fx - 0.5)**2]
+        for i in ti.static(range(3)):
+          for j in ti.static(range(3)):
+            weight = w[i][0] * w[j][1]
+            grid_v[base + ti.Vector([i, j])] += weight * v[p]
+            grid_m[base + ti.Vector([i, j])] += weight
+
+    return p2g
+
+  return run_first_launch(make_kernel)
@@ -0,0 +1,38 @@
+import taichi as ti
+from _util import measure
+
+# 1M appends, all into one list or spread over many
+n = 1024 * 1024
+
+
+def run_appends(num_lists):
+  x = ti.var(ti.i32)
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, num_lists).dynamic(ti.j, n // num_lists).place(x)
+
+  @ti.kernel
+  def append():
+    for i in range(n):
+      ti.append(x, i % num_lists, i)
+
+  # The lists are full after one run
+  @ti.kernel
+  def reset():
+    for i in range(num_lists):
+      ti.deactivate(x, i)
+
+  def run():
+    reset()
+    append()
+
+  return measure(run)
+
+
+def benchmark_one_list():
+  return run_appends(1)
+
+
+def benchmark_1024_lists():
+  return run_appends(1024)
@@ -0,0 +1,58 @@
+import taichi as ti
+from _util import measure
+
+# Seconds per launch of empty, tiny and medium kernels, with the cycles per
+# launch of each phase (see ti.launch_breakdown)
+n = 64 * 1024
+num_launches = 1000
+
+
+def run_launches(kernel):
+  ti.cfg.launch_breakdown = True
+  try:
+    kernel()
+    ti.sync()
+    ti.launch_breakdown(clear=True)
+
+    def launches():
+      for i in range(num_launches):
+        kernel()
+
+    result = measure(launches, repeat=10)
+    result['time'] /= num_launches
+    for phase, cycles in ti.launch_breakdown().items():
+      result['cycles:' + phase] = cycles
+    return result
+  finally:
+    ti.cfg.launch_breakdown = False
+
+
+def benchmark_empty():
+
+  @ti.kernel
+  def empty():
+    pass
+
+  return run_launches(empty)
+
+
+def benchmark_tiny():
+  x = ti.var(ti.i32, shape=16)
+
+  @ti.kernel
+  def tiny():
+    for i in range(16):
+      x[i] += 1
+
+  return run_launches(tiny)
+
+
+def benchmark_medium():
+  x = ti.var(ti.f32, shape=n)
+
+  @ti.kernel
+  def medium():
+    for i in range(n):
+      x[i] = x[i] * 0.5 + 1
+
+  return run_launches(medium)
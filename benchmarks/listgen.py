@@ -0,0 +1,64 @@
+import taichi as ti
+from _util import measure
+
+# Struct-fors over 4M cells in blocks of 64, whose list generation dominates
+# for the sparse node types
+n = 2048
+block = 8
+
+
+def run_struct_for(place_block):
+  x = ti.var(ti.i32)
+
+  @ti.layout
+  def place():
+    place_block(ti.root.dense(ti.ij, n // block)).dense(ti.ij, block).place(x)
+
+  @ti.kernel
+  def activate():
+    for i, j in ti.ndrange(n, n):
+      x[i, j] = 0
+
+  @ti.kernel
+  def inc():
+    for i, j in x:
+      x[i, j] += 1
+
+  activate()
+  return measure(inc)
+
+
+def benchmark_dense():
+  return run_struct_for(lambda s: s)
+
+
+def benchmark_pointer():
+  return run_struct_for(lambda s: s.pointer())
+
+
+def benchmark_bitmasked():
+  return run_struct_for(lambda s: s.bitmasked())
+
+
+def benchmark_dynamic():
+  x = ti.var(ti.i32)
+  num_lists = 4096
+  list_size = n * n // num_lists
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, num_lists).dynamic(ti.j, list_size).place(x)
+
+  @ti.kernel
+  def activate():
+    for i in range(num_lists):
+      for j in range(list_size):
+        ti.append(x, i, j)
+
+  @ti.kernel
+  def inc():
+    for i, j in x:
+      x[i, j] += 1
+
+  activate()
+  return measure(inc)
@@ -0,0 +1,40 @@
+import taichi as ti
+from _util import measure
+
+# One solve of a 3D Poisson problem with ti.MGPCG, on a dense grid and on a
+# sparse one with half of its blocks active, with each smoother. Besides the
+# time per solve, reports the iterations it took.
+
+n = 64
+
+
+def run_mgpcg(sparse, smoother):
+  solver = ti.MGPCG(3, n, sparse=sparse, smoother=smoother)
+
+  @ti.kernel
+  def init():
+    for i, j, k in ti.ndrange(n, n, n):
+      if ti.static(not sparse) or i < n // 2:
+        solver.b[i, j, k] = ti.sin(i * 0.1) * ti.cos(j * 0.2) + k * 0.01
+
+  iterations = []
+
+  def solve():
+    init()
+    iterations.append(solver.solve(max_iters=100, tol=1e-5))
+
+  result = measure(solve)
+  result['iterations'] = iterations[-1]
+  return result
+
+
+def benchmark_mgpcg_dense_rbgs():
+  return run_mgpcg(False, 'rbgs')
+
+
+def benchmark_mgpcg_dense_jacobi():
+  return run_mgpcg(False, 'jacobi')
+
+
+def benchmark_mgpcg_sparse_rbgs():
+  return run_mgpcg(True, 'rbgs')
@@ -0,0 +1,196 @@
+import os
+import subprocess
+import taichi as ti
+from _util import measure
+
+# The MLS-MPM and FEM programs of the SIGGRAPH Asia 2019 paper (see
+# misc/siggraphasia2019_loc), at fixed sizes, against hand-written
+# references of the same computations. Besides the time per step, reports
+# the bytes of the tensors, and with a reference, its time, memory and the
+# ratio of the Taichi time to it, which compare.py tracks like the time.
+#
+# The references are executables named <case>_ref for x86_64 and
+# <case>_ref_cuda for cuda, in $TI_REFERENCE_DIR or build/. The OpenMP ones
+# in references/ are built with -DBUILD_REFERENCE_BENCHMARKS=ON; they take
+# the problem sizes as arguments and print the median seconds per step, the
+# bytes of their arrays and a checksum of the results, which must match ours.
+
+mpm_grid = 64
+mpm_particles_per_axis = 32
+mpm_substeps = 5
+fem_n = 64
+repeat = 20
+
+
+def tensor_bytes(*tensors):
+  ret = 0
+  for t in tensors:
+    num_cells = 1
+    for s in t.loop_range().shape():
+      num_cells *= s
+    num_entries = t.n * t.m if isinstance(t, ti.Matrix) else 1
+    ret += num_cells * num_entries * 4
+  return ret
+
+
+def compare(name, result, checksum, args):
+  directory = os.environ.get(
+      'TI_REFERENCE_DIR',
+      os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'build'))
+  suffix = '_cuda' if ti.cfg.arch == ti.cuda else ''
+  executable = os.path.join(directory, name + '_ref' + suffix)
+  if not os.path.exists(executable):
+    return result
+  output = subprocess.check_output([executable] +
+                                   [str(a) for a in args + [repeat]])
+  ref = {}
+  for line in output.decode().splitlines():
+    key, value = line.split()
+    ref[key] = float(value)
+  if abs(checksum - ref['checksum']) > 1e-4 * abs(ref['checksum']):
+    print(f'Warning: {name} computes {checksum}, its reference '
+          f'{ref["checksum"]}')
+    result['mismatch'] = True
+  result['reference_time'] = ref['time']
+  result['reference_memory'] = int(ref['memory'])
+  result['ratio'] = result['time'] / ref['time']
+  return result
+
+
+def benchmark_mlsmpm():
+  n_grid, m = mpm_grid, mpm_particles_per_axis
+  n_particles = m**3
+  dx, inv_dx = 1 / n_grid, float(n_grid)
+  dt = 1e-4
+  p_vol = (dx * 0.5)**3
+  p_mass = p_vol
+  E = 400
+  bound = 3
+
+  x = ti.Vector(3, dt=ti.f32, shape=n_particles)
+  v = ti.Vector(3, dt=ti.f32, shape=n_particles)
+  C = ti.Matrix(3, 3, dt=ti.f32, shape=n_particles)
+  J = ti.var(dt=ti.f32, shape=n_particles)
+  grid_v = ti.Vector(3, dt=ti.f32, shape=(n_grid, n_grid, n_grid))
+  grid_m = ti.var(dt=ti.f32, shape=(n_grid, n_grid, n_grid))
+
+  @ti.kernel
+  def initialize():
+    for p in range(n_particles):
+      idx = ti.Vector([p // (m * m), p // m % m, p % m])
+      x[p] = 0.3 + (idx.cast(float) + 0.5) * (0.3 / m)
+      v[p] = ti.Vector.zero(ti.f32, 3)
+      C[p] = ti.Matrix.zero(ti.f32, 3, 3)
+      J[p] = 1
+
+  @ti.kernel
+  def substep():
+    for I in ti.grouped(grid_m):
+      grid_v[I] = ti.Vector.zero(ti.f32, 3)
+      grid_m[I] = 0
+    for p in range(n_particles):
+      base = (x[p] * inv_dx - 0.5).cast(int)
+      fx = x[p] * inv_dx - base.cast(float)
+      w = [
+          0.5 * ti.sqr(1.5 - fx), 0.75 - ti.sqr(fx - 1),
+          0.5 * ti.sqr(fx - 0.5)
+      ]
+      stress = -dt * p_vol * (J[p] - 1) * 4 * inv_dx * inv_dx * E
+      affine = ti.Matrix.identity(ti.f32, 3) * stress + p_mass * C[p]
+      for i in ti.static(range(3)):
+        for j in ti.static(range(3)):
+          for k in ti.static(range(3)):
+            offset = ti.Vector([i, j, k])
+            dpos = (offset.cast(float) - fx) * dx
+            weight = w[i][0] * w[j][1] * w[k][2]
+            grid_v[base + offset].atomic_add(
+                weight * (p_mass * v[p] + affine @ dpos))
+            grid_m[base + offset].atomic_add(weight * p_mass)
+    for I in ti.grouped(grid_m):
+      if grid_m[I] > 0:
+        g_v = grid_v[I] / grid_m[I]
+        g_v[1] -= dt * 9.8
+        for d in ti.static(range(3)):
+          if I[d] < bound and g_v[d] < 0:
+            g_v[d] = 0
+          if I[d] > n_grid - bound and g_v[d] > 0:
+            g_v[d] = 0
+        grid_v[I] = g_v
+    for p in range(n_particles):
+      base = (x[p] * inv_dx - 0.5).cast(int)
+      fx = x[p] * inv_dx - base.cast(float)
+      w = [
+          0.5 * ti.sqr(1.5 - fx), 0.75 - ti.sqr(fx - 1),
+          0.5 * ti.sqr(fx - 0.5)
+      ]
+      new_v = ti.Vector.zero(ti.f32, 3)
+      new_C = ti.Matrix.zero(ti.f32, 3, 3)
+      for i in ti.static(range(3)):
+        for j in ti.static(range(3)):
+          for k in ti.static(range(3)):
+            offset = ti.Vector([i, j, k])
+            dpos = offset.cast(float) - fx
+            g_v = grid_v[base + offset]
+            weight = w[i][0] * w[j][1] * w[k][2]
+            new_v += weight * g_v
+            new_C += 4 * weight * ti.outer_product(g_v, dpos) * inv_dx
+      v[p] = new_v
+      x[p] += dt * new_v
+      J[p] *= 1 + dt * new_C.trace()
+      C[p] = new_C
+
+  def step():
+    for s in range(mpm_substeps):
+      substep()
+
+  initialize()
+  result = measure(step, repeat=repeat)
+  result['memory'] = tensor_bytes(x, v, C, J, grid_v, grid_m)
+  return compare('mlsmpm', result, float(x.to_numpy().sum()),
+                 [n_grid, m, mpm_substeps])
+
+
+def benchmark_fem():
+  n = fem_n
+  K_la = ti.var(dt=ti.f32, shape=(8, 8, 3, 3))
+  K_mu = ti.var(dt=ti.f32, shape=(8, 8, 3, 3))
+  la = ti.var(dt=ti.f32, shape=(n, n, n))
+  mu = ti.var(dt=ti.f32, shape=(n, n, n))
+  p = ti.Vector(3, dt=ti.f32, shape=(n, n, n))
+  Ap = ti.Vector(3, dt=ti.f32, shape=(n, n, n))
+
+  @ti.kernel
+  def initialize():
+    for c, o, u, v in K_la:
+      e = ((c * 8 + o) * 3 + u) * 3 + v
+      K_la[c, o, u, v] = (e % 7 - 3) * 0.125
+      K_mu[c, o, u, v] = (e % 5 - 2) * 0.25
+    for i, j, k in la:
+      la[i, j, k] = 1 + (i + j + k) % 3
+      mu[i, j, k] = 1 + (i * j + k) % 2
+      for d in ti.static(range(3)):
+        p[i, j, k][d] = ((i * 7 + j * 3 + k + d) % 11) * 0.1
+
+  # Ap = K p, with the stiffness matrix assembled on the fly
+  @ti.kernel
+  def apply():
+    for i, j, k in ti.ndrange((1, n - 1), (1, n - 1), (1, n - 1)):
+      Ku = ti.Vector.zero(ti.f32, 3)
+      for cell in range(8):
+        cx = i - cell // 4
+        cy = j - cell // 2 % 2
+        cz = k - cell % 2
+        cell_la = la[cx, cy, cz]
+        cell_mu = mu[cx, cy, cz]
+        for o in range(8):
+          q = p[cx + o // 4, cy + o // 2 % 2, cz + o % 2]
+          for u in ti.static(range(3)):
+            for v in ti.static(range(3)):
+              Ku[u] += (cell_la * K_la[cell, o, u, v] +
+                        cell_mu * K_mu[cell, o, u, v]) * q[v]
+      Ap[i, j, k] = Ku
+
+  initialize()
+  result = measure(apply, repeat=repeat)
+  result['memory'] = tensor_bytes(la, mu, p, Ap)
+  return compare('fem', result, float(Ap.to_numpy().sum()), [n])
@@ -0,0 +1,27 @@
+// Timing and reporting shared by the reference benchmarks
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// Times repeated calls of step after a warm-up call, as _util.measure does,
+// and prints the median seconds per call, the bytes of the arrays and a
+// checksum of the results, which reference.py parses
+template <typename Step, typename Checksum>
+void report(int repeat, std::size_t bytes, Step step, Checksum checksum) {
+  step();
+  std::vector<double> samples;
+  for (int i = 0; i < repeat; i++) {
+    auto t = std::chrono::steady_clock::now();
+    step();
+    samples.push_back(std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - t)
+                          .count());
+  }
+  std::sort(samples.begin(), samples.end());
+  std::printf("time %.9g\n", samples[repeat / 2]);
+  std::printf("memory %zu\n", bytes);
+  std::printf("checksum %.9g\n", (double)checksum());
+}
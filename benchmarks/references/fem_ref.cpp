@@ -0,0 +1,75 @@
+// Hand-written OpenMP reference of the matrix-free 3D FEM case of
+// reference.py: one application of the linear elasticity stiffness matrix,
+// as in the conjugate gradient iterations of the solver
+//
+// Usage: fem_ref n repeat
+
+#include <cstdlib>
+#include "common.h"
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    std::fprintf(stderr, "Usage: %s n repeat\n", argv[0]);
+    return 1;
+  }
+  const int n = std::atoi(argv[1]), repeat = std::atoi(argv[2]);
+  // The element stiffness matrices of unit Lame parameters, between the
+  // corners of a cell, with the entries reference.py fills them with
+  static float K_la[8][8][3][3], K_mu[8][8][3][3];
+  for (int c = 0; c < 8; c++)
+    for (int o = 0; o < 8; o++)
+      for (int u = 0; u < 3; u++)
+        for (int v = 0; v < 3; v++) {
+          int e = ((c * 8 + o) * 3 + u) * 3 + v;
+          K_la[c][o][u][v] = (e % 7 - 3) * 0.125f;
+          K_mu[c][o][u][v] = (e % 5 - 2) * 0.25f;
+        }
+  auto nodes = (std::size_t)n * n * n;
+  auto node = [&](int i, int j, int k) {
+    return ((std::size_t)i * n + j) * n + k;
+  };
+  std::vector<float> lambda(nodes), mu(nodes), p(nodes * 3), Ap(nodes * 3);
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      for (int k = 0; k < n; k++) {
+        auto c = node(i, j, k);
+        lambda[c] = 1 + (i + j + k) % 3;
+        mu[c] = 1 + (i * j + k) % 2;
+        for (int d = 0; d < 3; d++)
+          p[c * 3 + d] = ((i * 7 + j * 3 + k + d) % 11) * 0.1f;
+      }
+
+  auto apply = [&] {
+#pragma omp parallel for
+    for (int i = 1; i < n - 1; i++)
+      for (int j = 1; j < n - 1; j++)
+        for (int k = 1; k < n - 1; k++) {
+          float Ku[3] = {0, 0, 0};
+          for (int cell = 0; cell < 8; cell++) {
+            int cx = i - cell / 4, cy = j - cell / 2 % 2, cz = k - cell % 2;
+            float la = lambda[node(cx, cy, cz)], m = mu[node(cx, cy, cz)];
+            for (int o = 0; o < 8; o++) {
+              auto q = node(cx + o / 4, cy + o / 2 % 2, cz + o % 2) * 3;
+              for (int u = 0; u < 3; u++)
+                for (int v = 0; v < 3; v++)
+                  Ku[u] += (la * K_la[cell][o][u][v] +
+                            m * K_mu[cell][o][u][v]) *
+                           p[q + v];
+            }
+          }
+          auto c = node(i, j, k) * 3;
+          for (int u = 0; u < 3; u++)
+            Ap[c + u] = Ku[u];
+        }
+  };
+
+  auto bytes = (lambda.size() + mu.size() + p.size() + Ap.size()) *
+               sizeof(float);
+  report(repeat, bytes, apply, [&] {
+    double sum = 0;
+    for (auto a : Ap)
+      sum += a;
+    return sum;
+  });
+  return 0;
+}
@@ -0,0 +1,158 @@
+// Hand-written OpenMP reference of the 3D MLS-MPM case of reference.py
+//
+// Usage: mlsmpm_ref n_grid particles_per_axis substeps repeat
+
+#include <cmath>
+#include <cstdlib>
+#include "common.h"
+
+namespace {
+
+struct Particle {
+  float x[3], v[3], C[3][3], J;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 5) {
+    std::fprintf(stderr,
+                 "Usage: %s n_grid particles_per_axis substeps repeat\n",
+                 argv[0]);
+    return 1;
+  }
+  const int n_grid = std::atoi(argv[1]), m = std::atoi(argv[2]);
+  const int substeps = std::atoi(argv[3]), repeat = std::atoi(argv[4]);
+  const int n_particles = m * m * m;
+  const float dx = 1.0f / n_grid, inv_dx = (float)n_grid, dt = 1e-4f;
+  const float p_vol = std::pow(dx * 0.5f, 3.0f), p_mass = p_vol, E = 400;
+  const int bound = 3;
+
+  std::vector<Particle> particles(n_particles);
+  for (int p = 0; p < n_particles; p++) {
+    auto &q = particles[p];
+    int idx[3] = {p / (m * m), p / m % m, p % m};
+    for (int d = 0; d < 3; d++) {
+      q.x[d] = 0.3f + (idx[d] + 0.5f) * (0.3f / m);
+      q.v[d] = 0;
+      for (int e = 0; e < 3; e++)
+        q.C[d][e] = 0;
+    }
+    q.J = 1;
+  }
+  auto cells = (std::size_t)n_grid * n_grid * n_grid;
+  // Momenta or velocities and masses
+  std::vector<float> grid_v(cells * 3), grid_m(cells);
+  auto cell = [&](int i, int j, int k) {
+    return ((std::size_t)i * n_grid + j) * n_grid + k;
+  };
+
+  auto substep = [&] {
+#pragma omp parallel for
+    for (std::size_t c = 0; c < cells; c++) {
+      grid_v[c * 3] = grid_v[c * 3 + 1] = grid_v[c * 3 + 2] = 0;
+      grid_m[c] = 0;
+    }
+#pragma omp parallel for
+    for (int p = 0; p < n_particles; p++) {
+      auto &q = particles[p];
+      int base[3];
+      float fx[3], w[3][3];
+      for (int d = 0; d < 3; d++) {
+        base[d] = (int)(q.x[d] * inv_dx - 0.5f);
+        fx[d] = q.x[d] * inv_dx - base[d];
+        w[0][d] = 0.5f * (1.5f - fx[d]) * (1.5f - fx[d]);
+        w[1][d] = 0.75f - (fx[d] - 1) * (fx[d] - 1);
+        w[2][d] = 0.5f * (fx[d] - 0.5f) * (fx[d] - 0.5f);
+      }
+      float stress = -dt * p_vol * (q.J - 1) * 4 * inv_dx * inv_dx * E;
+      float affine[3][3];
+      for (int d = 0; d < 3; d++)
+        for (int e = 0; e < 3; e++)
+          affine[d][e] = (d == e ? stress : 0) + p_mass * q.C[d][e];
+      for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+          for (int k = 0; k < 3; k++) {
+            float dpos[3] = {(i - fx[0]) * dx, (j - fx[1]) * dx,
+                             (k - fx[2]) * dx};
+            float weight = w[i][0] * w[j][1] * w[k][2];
+            auto c = cell(base[0] + i, base[1] + j, base[2] + k);
+            for (int d = 0; d < 3; d++) {
+              float momentum = p_mass * q.v[d] + affine[d][0] * dpos[0] +
+                               affine[d][1] * dpos[1] + affine[d][2] * dpos[2];
+#pragma omp atomic
+              grid_v[c * 3 + d] += weight * momentum;
+            }
+#pragma omp atomic
+            grid_m[c] += weight * p_mass;
+          }
+    }
+#pragma omp parallel for
+    for (int i = 0; i < n_grid; i++)
+      for (int j = 0; j < n_grid; j++)
+        for (int k = 0; k < n_grid; k++) {
+          auto c = cell(i, j, k);
+          if (grid_m[c] <= 0)
+            continue;
+          int I[3] = {i, j, k};
+          float inv_m = 1 / grid_m[c];
+          for (int d = 0; d < 3; d++) {
+            auto &v = grid_v[c * 3 + d];
+            v *= inv_m;
+            if (d == 1)
+              v -= dt * 9.8f;
+            if ((I[d] < bound && v < 0) || (I[d] > n_grid - bound && v > 0))
+              v = 0;
+          }
+        }
+#pragma omp parallel for
+    for (int p = 0; p < n_particles; p++) {
+      auto &q = particles[p];
+      int base[3];
+      float fx[3], w[3][3];
+      for (int d = 0; d < 3; d++) {
+        base[d] = (int)(q.x[d] * inv_dx - 0.5f);
+        fx[d] = q.x[d] * inv_dx - base[d];
+        w[0][d] = 0.5f * (1.5f - fx[d]) * (1.5f - fx[d]);
+        w[1][d] = 0.75f - (fx[d] - 1) * (fx[d] - 1);
+        w[2][d] = 0.5f * (fx[d] - 0.5f) * (fx[d] - 0.5f);
+      }
+      float new_v[3] = {0, 0, 0}, new_C[3][3] = {};
+      for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+          for (int k = 0; k < 3; k++) {
+            float dpos[3] = {i - fx[0], j - fx[1], k - fx[2]};
+            float weight = w[i][0] * w[j][1] * w[k][2];
+            auto c = cell(base[0] + i, base[1] + j, base[2] + k);
+            for (int d = 0; d < 3; d++) {
+              float g_v = grid_v[c * 3 + d];
+              new_v[d] += weight * g_v;
+              for (int e = 0; e < 3; e++)
+                new_C[d][e] += 4 * weight * g_v * dpos[e] * inv_dx;
+            }
+          }
+      for (int d = 0; d < 3; d++) {
+        q.v[d] = new_v[d];
+        q.x[d] += dt * new_v[d];
+        for (int e = 0; e < 3; e++)
+          q.C[d][e] = new_C[d][e];
+      }
+      q.J *= 1 + dt * (new_C[0][0] + new_C[1][1] + new_C[2][2]);
+    }
+  };
+
+  auto bytes = particles.size() * sizeof(Particle) +
+               (grid_v.size() + grid_m.size()) * sizeof(float);
+  report(repeat, bytes,
+         [&] {
+           for (int s = 0; s < substeps; s++)
+             substep();
+         },
+         [&] {
+           double sum = 0;
+           for (auto &q : particles)
+             sum += q.x[0] + q.x[1] + q.x[2];
+           return sum;
+         });
+  return 0;
+}
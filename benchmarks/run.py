@@ -1,34 +1,50 @@
+import argparse
+import json
 import os
 import taichi as ti
 
+# Usage: python3 run.py [-o results.json] [-a x86_64 cuda] [-s atomics ...]
+# Benchmarks return the seconds per run, or a dict with 'time', the 'spread'
+# of the samples (see _util.measure) and extra figures such as 'GB/s'.
+# Compare two result files with compare.py.
+
+all_archs = {'x86_64': ti.x86_64, 'cuda': ti.cuda}
+
+
 class Case:
   def __init__(self, name, func):
     self.name = name
     self.func = func
     self.records = {}
-    
+
   def __lt__(self, other):
     return self.name < other.name
-  
+
   def __eq__(self, other):
     return self.name == other.name
-  
+
   def pprint(self):
     print(f' * {self.name[10:]:25}', end='')
     for i, arch in enumerate(sorted(self.records.keys())):
-      ms = self.records[arch] * 1000
-      arch_name = str(arch)[5:]
-      print(f' {arch_name:8} {ms:7.3f} ms', end='')
+      rec = self.records[arch]
+      ms = rec['time'] * 1000
+      print(f' {arch:8} {ms:9.3f} ms', end='')
+      if 'GB/s' in rec:
+        print(f' {rec["GB/s"]:7.2f} GB/s', end='')
+      if 'ratio' in rec:
+        print(f' {rec["ratio"]:6.2f}x ref', end='')
       if i < len(self.records) - 1:
         print('      ', end='')
     print()
-    
+
   def run(self, arch):
     ti.reset()
-    ti.cfg.arch = arch
+    ti.cfg.arch = all_archs[arch]
     t = self.func()
+    if not isinstance(t, dict):
+      t = {'time': t}
     self.records[arch] = t
-    
+
 
 class Suite:
   def __init__(self, filename):
@@ -39,38 +55,63 @@ class Suite:
     suite = loc['suite']
     case_keys = list(sorted(filter(lambda x: x.startswith('benchmark_'), dir(suite))))
     self.cases = [Case(k, getattr(suite, k)) for k in case_keys]
-    
+    self.archs = getattr(suite, 'archs', None)
+
   def print(self):
     print(f'{self.name}:')
     for b in self.cases:
       b.pprint()
-      
+
   def run(self, arch):
+    if self.archs is not None and all_archs[arch] not in self.archs:
+      return
     print(f'{self.name}:')
     for case in sorted(self.cases):
       case.run(arch)
-      
+
+  def results(self):
+    return {case.name[10:]: case.records for case in self.cases}
+
 
 class TaichiBenchmark:
-  def __init__(self):
+  def __init__(self, suites=None):
     self.suites = []
     for f in sorted(os.listdir('.')):
-      if f != 'run.py' and f.endswith('.py') and f[0] != '_':
-        self.suites.append(Suite(f))
-        
+      if f in ['run.py', 'compare.py', 'scaling.py'] or not f.endswith('.py') or f[0] == '_':
+        continue
+      if suites and f[:-3] not in suites:
+        continue
+      self.suites.append(Suite(f))
+
   def pprint(self):
     for s in self.suites:
       s.print()
-      
+
   def run(self, arch):
     print("Running...")
     for s in self.suites:
       s.run(arch)
 
+  def save(self, fn):
+    results = {s.name: s.results() for s in self.suites}
+    with open(fn, 'w') as f:
+      json.dump({'commit': ti.core.get_commit_hash(), 'results': results}, f,
+                indent=2, sort_keys=True)
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser()
+  parser.add_argument('-o', '--output', default='results.json')
+  parser.add_argument('-a', '--archs', nargs='+', default=['x86_64', 'cuda'])
+  parser.add_argument('-s', '--suites', nargs='+')
+  args = parser.parse_args()
+  args.output = os.path.abspath(args.output)
+  os.chdir(os.path.dirname(os.path.abspath(__file__)))
 
-b = TaichiBenchmark()
-b.pprint()
-b.run(ti.x86_64)
-b.run(ti.cuda)
-print()
-b.pprint()
+  b = TaichiBenchmark(args.suites)
+  for arch in args.archs:
+    b.run(arch)
+  print()
+  b.pprint()
+  b.save(args.output)
+  print(f'Results saved to {args.output}')
@@ -0,0 +1,232 @@
+import argparse
+import json
+import math
+import os
+import taichi as ti
+from _util import measure
+
+# Usage: python3 scaling.py [-c fill jacobi mpm] [-t 1 2 4 8 16] [-s 1048576]
+#                           [--weak] [--sizes 65536 262144 ...] [-a cuda]
+#                           [-o scaling.json] [--plot scaling.png]
+# Strong scaling runs every case at a fixed size over the thread counts
+# (ti.cfg.cpu_max_num_threads), weak scaling with the size growing with the
+# threads, and --sizes sweeps the problem size at the largest thread count (or
+# on the GPU). The results are in the format of run.py, so that compare.py
+# flags scalability regressions between two runs.
+
+
+# Dense struct-for over size cells
+def case_fill(size):
+  x = ti.var(ti.f32, shape=size)
+
+  @ti.kernel
+  def fill():
+    for i in x:
+      x[i] = 2.0
+
+  return measure(fill)
+
+
+# Jacobi iterations of the 2D Poisson equation on about size cells
+def case_jacobi(size):
+  n = max(4, int(math.sqrt(size)))
+  x = ti.var(ti.f32, shape=(n, n))
+  y = ti.var(ti.f32, shape=(n, n))
+  b = ti.var(ti.f32, shape=(n, n))
+
+  @ti.kernel
+  def smooth():
+    for i, j in ti.ndrange((1, n - 1), (1, n - 1)):
+      y[i, j] = (b[i, j] + x[i - 1, j] + x[i + 1, j] + x[i, j - 1] +
+                 x[i, j + 1]) * 0.25
+    for i, j in ti.ndrange((1, n - 1), (1, n - 1)):
+      x[i, j] = (b[i, j] + y[i - 1, j] + y[i + 1, j] + y[i, j - 1] +
+                 y[i, j + 1]) * 0.25
+
+  return measure(smooth)
+
+
+# A fluid MLS-MPM step of size particles, with 4 particles per grid cell
+def case_mpm(size):
+  n_particles = size
+  n_grid = max(16, int(math.sqrt(size / 4)))
+  dx, inv_dx = 1 / n_grid, float(n_grid)
+  dt = 1e-4
+  p_mass = (dx * 0.5)**2
+  x = ti.Vector(2, dt=ti.f32, shape=n_particles)
+  v = ti.Vector(2, dt=ti.f32, shape=n_particles)
+  C = ti.Matrix(2, 2, dt=ti.f32, shape=n_particles)
+  J = ti.var(dt=ti.f32, shape=n_particles)
+  grid_v = ti.Vector(2, dt=ti.f32, shape=(n_grid, n_grid))
+  grid_m = ti.var(dt=ti.f32, shape=(n_grid, n_grid))
+
+  @ti.kernel
+  def init():
+    for p in x:
+      x[p] = [ti.random() * 0.4 + 0.3, ti.random() * 0.4 + 0.3]
+      J[p] = 1
+
+  @ti.kernel
+  def substep():
+    for i, j in grid_m:
+      grid_v[i, j] = [0, 0]
+      grid_m[i, j] = 0
+    for p in x:
+      base = (x[p] * inv_dx - 0.5).cast(int)
+      fx = x[p] * inv_dx - base.cast(float)
+      w = [
+          0.5 * ti.sqr(1.5 - fx), 0.75 - ti.sqr(fx - 1),
+          0.5 * ti.sqr(fx - 0.5)
+      ]
+      stress = -dt * p_mass * 4 * inv_dx * inv_dx * 400 * (J[p] - 1)
+      affine = ti.Matrix([[stress, 0], [0, stress]]) + p_mass * C[p]
+      for i, j in ti.static(ti.ndrange(3, 3)):
+        offset = ti.Vector([i, j])
+        dpos = (offset.cast(float) - fx) * dx
+        weight = w[i][0] * w[j][1]
+        grid_v[base + offset] += weight * (p_mass * v[p] + affine @ dpos)
+        grid_m[base + offset] += weight * p_mass
+    for i, j in grid_m:
+      if grid_m[i, j] > 0:
+        grid_v[i, j] = (1 / grid_m[i, j]) * grid_v[i, j]
+        grid_v[i, j][1] -= dt * 50
+    for p in x:
+      base = (x[p] * inv_dx - 0.5).cast(int)
+      fx = x[p] * inv_dx - base.cast(float)
+      w = [
+          0.5 * ti.sqr(1.5 - fx), 0.75 - ti.sqr(fx - 1),
+          0.5 * ti.sqr(fx - 0.5)
+      ]
+      new_v = ti.Vector.zero(ti.f32, 2)
+      new_C = ti.Matrix.zero(ti.f32, 2, 2)
+      for i, j in ti.static(ti.ndrange(3, 3)):
+        dpos = ti.Vector([i, j]).cast(float) - fx
+        g_v = grid_v[base + ti.Vector([i, j])]
+        weight = w[i][0] * w[j][1]
+        new_v += weight * g_v
+        new_C += 4 * inv_dx * weight * ti.outer_product(g_v, dpos)
+      v[p], C[p] = new_v, new_C
+      J[p] *= 1 + dt * (new_C[0, 0] + new_C[1, 1])
+
+  init()
+  return measure(substep)
+
+
+cases = {'fill': case_fill, 'jacobi': case_jacobi, 'mpm': case_mpm}
+all_archs = {'x86_64': ti.x86_64, 'cuda': ti.cuda}
+
+
+def run(case, arch, num_threads, size):
+  ti.reset()
+  ti.cfg.arch = all_archs[arch]
+  ti.cfg.cpu_max_num_threads = num_threads
+  try:
+    return cases[case](size)
+  finally:
+    ti.cfg.cpu_max_num_threads = 0
+
+
+def sweep_threads(case, arch, threads, size, weak):
+  print(f'{case} ({"weak" if weak else "strong"} scaling, '
+        f'{size} elements{" per thread" if weak else ""}):')
+  print(f'  {"threads":>7} {"size":>10} {"time":>12} {"speedup":>8} '
+        f'{"efficiency":>10}')
+  records = {}
+  t1 = None
+  for n in threads:
+    rec = run(case, arch, n, size * n if weak else size)
+    if t1 is None:
+      # Relative to the smallest thread count
+      t1, n1 = rec['time'], n
+    if weak:
+      rec['efficiency'] = t1 / rec['time']
+      rec['speedup'] = rec['efficiency'] * n / n1
+    else:
+      rec['speedup'] = t1 / rec['time']
+      rec['efficiency'] = rec['speedup'] * n1 / n
+    print(f'  {n:7} {size * n if weak else size:10} '
+          f'{rec["time"] * 1000:9.3f} ms {rec["speedup"]:8.2f} '
+          f'{rec["efficiency"] * 100:9.1f}%')
+    records[f't{n}'] = rec
+  return records
+
+
+def sweep_sizes(case, arch, num_threads, sizes):
+  print(f'{case} (problem sizes):')
+  print(f'  {"size":>10} {"time":>12} {"elements/s":>12}')
+  records = {}
+  for size in sizes:
+    rec = run(case, arch, num_threads, size)
+    rec['elements/s'] = size / rec['time']
+    print(f'  {size:10} {rec["time"] * 1000:9.3f} ms '
+          f'{rec["elements/s"]:12.4g}')
+    records[f's{size}'] = rec
+  return records
+
+
+def plot(results, fn):
+  import matplotlib
+  matplotlib.use('Agg')
+  import matplotlib.pyplot as plt
+  fig, ax = plt.subplots()
+  max_threads = 1
+  for name, recs in sorted(results.items()):
+    points = sorted((int(k[1:]), r['speedup']) for k, r in recs.items()
+                    if k.startswith('t'))
+    if points:
+      ax.plot(*zip(*points), marker='o', label=name)
+      max_threads = max(max_threads, points[-1][0])
+  ax.plot([1, max_threads], [1, max_threads], 'k--', label='ideal')
+  ax.set_xlabel('threads')
+  ax.set_ylabel('speedup')
+  ax.legend()
+  fig.savefig(fn)
+  print(f'Speedup curves saved to {fn}')
+
+
+def main():
+  max_threads = os.cpu_count()
+  default_threads = [1 << i for i in range(max_threads.bit_length())]
+  if default_threads[-1] != max_threads:
+    default_threads.append(max_threads)
+  parser = argparse.ArgumentParser()
+  parser.add_argument('-c', '--cases', nargs='+', default=sorted(cases))
+  parser.add_argument('-a', '--arch', default='x86_64')
+  parser.add_argument('-t', '--threads', nargs='+', type=int,
+                      default=default_threads)
+  parser.add_argument('-s', '--size', type=int, default=1 << 20)
+  parser.add_argument('--weak', action='store_true')
+  parser.add_argument('--sizes', nargs='+', type=int)
+  parser.add_argument('-o', '--output', default='scaling.json')
+  parser.add_argument('--plot')
+  args = parser.parse_args()
+
+  if not args.sizes and args.arch != 'x86_64':
+    print('GPU runs do not depend on the thread count: use --sizes')
+    return 1
+  results = {}
+  for case in args.cases:
+    if args.sizes:
+      recs = sweep_sizes(case, args.arch, max(args.threads), args.sizes)
+      results[case + '_sizes'] = recs
+    else:
+      recs = sweep_threads(case, args.arch, args.threads, args.size,
+                           args.weak)
+      results[case + ('_weak' if args.weak else '_strong')] = recs
+  with open(args.output, 'w') as f:
+    # Cases as suites and sweep points as cases, as compare.py expects
+    json.dump({
+        'commit': ti.core.get_commit_hash(),
+        'results': {
+            name: {k: {args.arch: r} for k, r in recs.items()}
+            for name, recs in results.items()
+        }
+    }, f, indent=2, sort_keys=True)
+  print(f'Results saved to {args.output}')
+  if args.plot:
+    plot(results, args.plot)
+  return 0
+
+
+if __name__ == '__main__':
+  exit(main())
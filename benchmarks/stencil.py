@@ -0,0 +1,19 @@
+import taichi as ti
+from _util import measure
+
+n = 2048
+
+
+def benchmark_laplace_2d():
+  x = ti.var(ti.f32, shape=(n, n))
+  y = ti.var(ti.f32, shape=(n, n))
+
+  @ti.kernel
+  def laplace():
+    for i, j in ti.ndrange((1, n - 1), (1, n - 1)):
+      y[i, j] = 4 * x[i, j] - x[i - 1, j] - x[i + 1, j] - x[i, j - 1] - x[
+          i, j + 1]
+
+  # Every cell of x read once (from the caches after that) and one of y
+  # written
+  return measure(laplace, bytes_moved=2 * 4 * n * n)
@@ -0,0 +1,61 @@
+import taichi as ti
+from _util import measure
+
+# CompileConfig::cpu_streaming_stores and cpu_block_prefetch, each against
+# the default
+archs = [ti.x86_64]
+
+n = 4096
+
+
+def fill(streaming_stores):
+  ti.cfg.cpu_streaming_stores = streaming_stores
+  x = ti.var(ti.f32, shape=(n, n))
+
+  @ti.kernel
+  def fill():
+    for i, j in x:
+      x[i, j] = 2.0
+
+  return measure(fill, bytes_moved=4 * n * n)
+
+
+def benchmark_fill():
+  return fill(False)
+
+
+def benchmark_fill_streaming_stores():
+  return fill(True)
+
+
+def sparse_sum(block_prefetch):
+  ti.cfg.cpu_block_prefetch = block_prefetch
+  x = ti.var(ti.f32)
+  s = ti.var(ti.f32, shape=())
+  m = n * n // 4
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, m // 64).pointer().dense(ti.i, 64).place(x)
+
+  @ti.kernel
+  def activate():
+    # Every other block, allocated in a scattered order
+    for i in range(m // 128):
+      x[(i * 7919 % (m // 128)) * 128] = 1
+
+  @ti.kernel
+  def total():
+    for i in x:
+      s[None] += x[i]
+
+  activate()
+  return measure(total, bytes_moved=4 * m // 2)
+
+
+def benchmark_sparse_sum():
+  return sparse_sum(False)
+
+
+def benchmark_sparse_sum_block_prefetch():
+  return sparse_sum(True)
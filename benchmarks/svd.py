@@ -0,0 +1,66 @@
+import time
+import numpy as np
+import taichi as ti
+from _util import measure
+
+# 3x3 SVDs and polar decompositions of n deformation gradients, with each
+# method of ti.svd and ti.polar_decompose. Besides the time per run, reports
+# the time of the first launch ('compile_time'), almost all of which is
+# compilation.
+
+n = 1024 * 64
+
+
+def run_decomposition(decompose):
+  A = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+  B = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+
+  @ti.kernel
+  def run():
+    for i in range(n):
+      B[i] = decompose(A[i])
+
+  a = np.eye(3) + (np.random.rand(n, 3, 3) - 0.5) * 0.5
+  A.from_numpy(a.astype(np.float32))
+  ti.get_runtime().materialize()
+  t = time.perf_counter()
+  run()
+  ti.sync()
+  compile_time = time.perf_counter() - t
+  result = measure(run)
+  result['compile_time'] = compile_time
+  return result
+
+
+def svd_with(method):
+
+  def decompose(A):
+    U, sig, V = ti.svd(A, ti.f32, method=method)
+    return U @ sig
+
+  return decompose
+
+
+def polar_with(method):
+
+  def decompose(A):
+    R, S = ti.polar_decompose(A, ti.f32, method=method)
+    return R
+
+  return decompose
+
+
+def benchmark_svd_jacobi():
+  return run_decomposition(svd_with('jacobi'))
+
+
+def benchmark_svd_eig():
+  return run_decomposition(svd_with('eig'))
+
+
+def benchmark_polar_svd():
+  return run_decomposition(polar_with('svd'))
+
+
+def benchmark_polar_newton():
+  return run_decomposition(polar_with('newton'))
@@ -0,0 +1,12 @@
+import taichi as ti
+from taichi.core import tc_core
+from taichi.misc.util import config_from_dict
+
+# Not a kernel: runs once, on the host
+archs = [ti.x86_64]
+
+
+def benchmark_launch_latency():
+  b = tc_core.create_benchmark('thread_pool_launch')
+  b.initialize(config_from_dict({'workload': 1024, 'warm_up_iterations': 4}))
+  return b.run(16)
@@ -0,0 +1,16 @@
+import taichi as ti
+import numpy as np
+from _util import measure
+
+n = 4 * 1024 * 1024
+
+
+def benchmark_to_numpy():
+  x = ti.var(ti.f32, shape=n)
+  return measure(lambda: x.to_numpy(), bytes_moved=4 * n)
+
+
+def benchmark_from_numpy():
+  x = ti.var(ti.f32, shape=n)
+  arr = np.ones(n, dtype=np.float32)
+  return measure(lambda: x.from_numpy(arr), bytes_moved=4 * n)
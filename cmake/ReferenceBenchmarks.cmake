@@ -0,0 +1,19 @@
+# Hand-written references of benchmarks/reference.py, and a target running
+# it against them into build/reference_results.json
+
+option(BUILD_REFERENCE_BENCHMARKS "Build the reference benchmark programs" OFF)
+
+if (BUILD_REFERENCE_BENCHMARKS)
+    find_package(OpenMP REQUIRED)
+    foreach(name mlsmpm fem)
+        add_executable(${name}_ref benchmarks/references/${name}_ref.cpp)
+        set_target_properties(${name}_ref PROPERTIES COMPILE_FLAGS
+                "-O3 -march=native ${OpenMP_CXX_FLAGS}"
+                LINK_FLAGS "${OpenMP_CXX_FLAGS}")
+    endforeach()
+    add_custom_target(reference_benchmarks
+            COMMAND python3 run.py -s reference
+                    -o ${CMAKE_CURRENT_SOURCE_DIR}/build/reference_results.json
+            WORKING_DIRECTORY ${CMAKE_CURRENT_SOURCE_DIR}/benchmarks
+            DEPENDS mlsmpm_ref fem_ref)
+endif()
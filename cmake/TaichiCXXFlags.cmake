@@ -1,6 +1,10 @@
 message("Using C++ compiler: " ${CMAKE_CXX_COMPILER})
 
-set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -DTC_ISE_NONE")
+option(TC_SIMD_LINALG "SSE/NEON for 3D/4D float32 vectors and matrices" OFF)
+
+if (NOT TC_SIMD_LINALG)
+    set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -DTC_ISE_NONE")
+endif()
 
 option(BUILD_WITH_ADDRESS_SANITIZER "Build with clang address sanitizer" OFF)
 
@@ -65,6 +65,7 @@ llvm_map_components_to_libnames(llvm_libs
         TransformUtils
         BitReader
         BitWriter
+        DebugInfoDWARF
         Object
         ScalarOpts
         Support
@@ -18,6 +18,14 @@ grid_v = ti.Vector(2, dt=ti.f32, shape=(n_grid, n_grid)) # grid node momemtum/ve
 grid_m = ti.var(dt=ti.f32, shape=(n_grid, n_grid)) # grid node mass
 ti.cfg.arch = ti.cuda # Try to run on GPU
 
+@ti.func
+def particle_cell(p):
+  base = (x[p] * inv_dx).cast(int)
+  return max(min(base[0], n_grid - 1), 0) * n_grid + max(min(base[1], n_grid - 1), 0)
+
+# Keeps the particles of a cell together in memory, for coherent P2G and G2P
+sorter = ti.ParticleSorter([x, v, C, F, material, Jp], n_particles, particle_cell, n_grid ** 2)
+
 @ti.kernel
 def substep():
   for i, j in ti.ndrange(n_grid, n_grid):
@@ -92,6 +100,8 @@ for i in range(n_particles):
 import numpy as np
 gui = ti.GUI("Taichi MLS-MPM-99", res=512, background_color=0x112F41)
 for frame in range(20000):
+  if frame % 10 == 0:
+    sorter.sort()
   for s in range(int(2e-3 // dt)):
     substep()
   colors = np.array([0x068587, 0xED553B, 0xEEEEF0], dtype=np.uint32)
@@ -2,6 +2,22 @@ from .impl import *
 from .matrix import Matrix
 from .transformer import TaichiSyntaxError
 from .ndrange import ndrange, GroupedNDRange
+from . import quant
+from .layout_tuner import tune_layout, tune_parameters
+from .sort import ParticleSorter
+from .primitives import ParallelPrimitives
+from .distributed import DomainDecomposition
+from .mgpcg import MGPCG
+from .transfer import ParticleGridTransfer
+from .neighbors import NeighborSearch
+from .sparse_matrix import SparseMatrix
+from .ray_march import SparseGridMarcher
+from .bvh import BVH
+from .sparse_conv import SparseConvRules, SparseConv
+from .alias_table import AliasTable
+from .frame_writer import FrameWriter
+from .ensemble import Ensemble
+from .input_channel import InputChannel
 
 core = taichi_lang_core
 runtime = get_runtime()
@@ -28,6 +44,134 @@ profiler_print = lambda: core.get_current_program().profiler_print()
 profiler_clear = lambda: core.get_current_program().profiler_clear()
 
 
+# The number of runs and the total time (ms) of each task profiled with
+# ti.cfg.enable_profiler, by task name ('<kernel>_<task id>_<task type>')
+def profiler_records():
+  return core.get_current_program().get_profiler_records()
+
+
+save_timeline = core.save_timeline
+clear_timeline = core.clear_timeline
+
+
+# Average cycles per launch of each phase of the kernel launches so far,
+# recorded when ti.cfg.launch_breakdown is on
+def launch_breakdown(clear=False):
+  prog = core.get_current_program()
+  breakdown = prog.get_launch_breakdown()
+  if clear:
+    prog.clear_launch_breakdown()
+  return breakdown
+
+
+print_launch_breakdown = lambda: core.get_current_program(
+).print_launch_breakdown()
+
+
+# Samples per 'file:line' of the CPU kernels, and 'total' including those
+# outside kernels, when ti.cfg.profile_source_lines is on
+def source_profile(clear=False):
+  prog = core.get_current_program()
+  profile = prog.get_source_profile()
+  if clear:
+    prog.clear_source_profile()
+  return profile
+
+
+print_source_profile = lambda: core.get_current_program(
+).print_source_profile()
+
+
+# Always-on counters of the runtime, see Program::get_runtime_counters
+def runtime_counters():
+  return core.get_current_program().get_runtime_counters()
+
+
+class Readback:
+  """The values of some tensors at the time of a ti.read_async call, copied
+  to the host while the device runs on."""
+
+  def __init__(self, tensors):
+    self.snodes = [t.snode() for t in tensors]
+    self.future = core.ReadbackFuture([t.ptr.snode() for t in tensors])
+
+  def done(self):
+    """Whether the values have arrived, without waiting"""
+    return self.future.done()
+
+  def result(self):
+    """Waits for the values: a scalar for 0-D tensors, a numpy array of the
+    shape of the tensor otherwise, and a tuple of those for several tensors"""
+    import numpy as np
+    ret = []
+    for i, snode in enumerate(self.snodes):
+      if snode.data_type() in [f32, f64]:
+        values = self.future.read_float(i)
+      else:
+        values = self.future.read_int(i)
+      shape = tuple(snode.get_shape(k) for k in range(snode.dim()))
+      if shape:
+        ret.append(np.array(values).reshape(shape))
+      else:
+        ret.append(values[0])
+    return ret[0] if len(ret) == 1 else tuple(ret)
+
+
+def read_async(*tensors):
+  """Starts copying the tensors (dense, and small, such as a 0-D loss) to the
+  host after the kernels launched so far, without waiting for them. Returns a
+  Readback, whose result() waits only if the copy has not arrived yet."""
+  return Readback(tensors)
+
+
+runtime_counter_help = {
+    'kernel_launches': 'Kernels launched',
+    'compile_cache_hits': 'Kernels compiled from a cache',
+    'compile_cache_misses': 'Kernels compiled from scratch',
+    'offline_cache_hits': 'Kernels loaded from the offline cache',
+    'nparray_bytes': 'Bytes copied between numpy arrays and the device',
+    'atomic_ops': 'Atomic operations executed by CPU kernels',
+    'list_elements': 'Elements generated into the element list of an SNode',
+    'allocated_nodes': 'Nodes allocated for an SNode',
+}
+
+
+# The runtime counters in the Prometheus text exposition format
+def prometheus_metrics():
+  metrics = {}
+  for key, value in runtime_counters().items():
+    name, _, snode = key.partition(':')
+    labels = '{snode="%s"}' % snode if snode else ''
+    metrics.setdefault(name, []).append((labels, value))
+  lines = []
+  for name, samples in metrics.items():
+    metric = 'taichi_%s_total' % name
+    help = runtime_counter_help.get(name, name)
+    lines.append('# HELP %s %s' % (metric, help))
+    lines.append('# TYPE %s counter' % metric)
+    for labels, value in samples:
+      lines.append('%s%s %d' % (metric, labels, value))
+  return '\n'.join(lines) + '\n'
+
+
+# Compile time of each pass of each kernel compiled so far, recorded when
+# ti.cfg.profile_compilation is on
+def compile_report(clear=False):
+  prog = core.get_current_program()
+  report = []
+  for rec in prog.get_compile_pass_records():
+    report.append({
+        'kernel': rec.kernel,
+        'pass': rec.pass_name,
+        'time': rec.time,
+        'statements_before': rec.num_statements_before,
+        'statements_after': rec.num_statements_after,
+    })
+  if clear:
+    prog.clear_compile_pass_records()
+  return report
+
+
 def reset():
   from .impl import reset as impl_reset
   impl_reset()
@@ -35,6 +179,10 @@ def reset():
   runtime = get_runtime()
 
 
+def sync():
+  get_runtime().sync()
+
+
 def cache_shared(v):
   taichi_lang_core.cache(0, v.ptr)
 
@@ -47,6 +195,7 @@ parallelize = core.parallelize
 serialize = lambda: parallelize(1)
 vectorize = core.vectorize
 block_dim = core.block_dim
+schedule = core.schedule
 cache = core.cache
 
 def inversed(x):
@@ -54,17 +203,43 @@ def inversed(x):
 
 transposed = Matrix.transposed
 
-def polar_decompose(A, dt=None):
+def polar_decompose(A, dt=None, method='svd', iters=None, tol=None,
+                    svd_method='jacobi'):
   if dt is None:
     dt = get_runtime().default_fp
   from .linalg import polar_decompose
-  return polar_decompose(A, dt)
+  return polar_decompose(A, dt, method, iters, tol, svd_method)
 
-def svd(A, dt=None):
+def svd(A, dt=None, method='jacobi', iters=None):
   if dt is None:
     dt = get_runtime().default_fp
   from .linalg import svd
-  return svd(A, dt)
+  return svd(A, dt, method, iters)
+
+def sym_eig(A, dt=None):
+  if dt is None:
+    dt = get_runtime().default_fp
+  assert A.n == 3 and A.m == 3, 'Only 3x3 matrices are supported'
+  from .linalg import sym_eig3x3
+  return sym_eig3x3(A, dt)
+
+def solve(A, b, dt=None, method='lu', pivoting=True):
+  if dt is None:
+    dt = get_runtime().default_fp
+  from .linalg import solve
+  return solve(A, b, dt, method, pivoting)
+
+def cholesky(A, dt=None):
+  if dt is None:
+    dt = get_runtime().default_fp
+  from .linalg import cholesky
+  return cholesky(A, dt)
+
+def cholesky_solve(L, b, dt=None):
+  if dt is None:
+    dt = get_runtime().default_fp
+  from .linalg import cholesky_solve
+  return cholesky_solve(L, b, dt)
 
 determinant = Matrix.determinant
 trace = Matrix.trace
@@ -82,6 +257,46 @@ def Tape(loss, clear_gradients=True):
   return runtime.get_tape(loss)
 
 
+# Runs step(t, i) for t in range(num_steps) with O(num_steps / segment_size +
+# segment_size) state, see CheckpointedSteps
+def checkpointed_steps(num_steps,
+                       step,
+                       state,
+                       segment_size=None,
+                       alternate_state=None):
+  get_runtime().materialize()
+  if segment_size is None:
+    # The largest divisor of num_steps up to its square root
+    segment_size = max(1, int(num_steps**0.5))
+    while num_steps % segment_size != 0:
+      segment_size -= 1
+  from .tape import CheckpointedSteps
+  CheckpointedSteps(get_runtime(), num_steps, step, state, segment_size,
+                    alternate_state).forward()
+
+
+class DeferredLaunches:
+  """
+  Records the kernel launches in its scope, which run in a single native call
+  on exit, or as soon as a tensor is accessed from Python. Kernels with
+  external array arguments run right away.
+  """
+
+  def __enter__(self):
+    runtime = get_runtime()
+    runtime.materialize()
+    assert not runtime.defer_launches, "Deferred launches cannot be nested"
+    runtime.defer_launches = True
+
+  def __exit__(self, type, value, tb):
+    runtime = get_runtime()
+    runtime.defer_launches = False
+    runtime.prog.flush_deferred_launches()
+
+
+deferred_launches = DeferredLaunches
+
+
 def clear_all_gradients():
   get_runtime().materialize()
   
@@ -97,14 +312,251 @@ def clear_all_gradients():
           places.append(ch.get_expr())
       
     places = tuple(places)
-    if places:
+    if places and len(places) == node.ptr.get_num_ch() and \
+        node.ptr.can_clear_data():
+      # A memset per active block
+      node.ptr.clear_data()
+    elif places:
       from .meta import clear_gradients
       clear_gradients(places)
     
-  visit(ti.root)
+  for tree in get_runtime().snode_roots():
+    visit(tree)
+
+
+def compile_kernels(*kernels):
+  """Compiles kernels ahead of their first launch. With ti.cfg.use_llvm off,
+  the compilers of their sources run concurrently. Kernels with non-scalar
+  arguments are compiled for the arguments they were called with."""
+  taichi_kernels = []
+  for kernel in kernels:
+    if kernel.scalar_args_only:
+      kernel.materialize()
+    taichi_kernels += list(kernel.taichi_kernels.values())
+  core.compile_kernels(taichi_kernels)
+
+
+def precompile(*kernels, replay=None):
+  """Materializes and compiles kernel instances before their first launch, so
+  that the first frames of an application do not pay for them. Each entry is
+  a kernel with scalar arguments only, or a (kernel, args) pair whose example
+  arguments select the instance, as in a launch. replay is a file written by
+  ti.save_kernel_instances in an earlier run, whose instances are compiled as
+  well. With ti.cfg.async_compilation on, the kernels are compiled in the
+  background while the next ones are materialized."""
+  instances = []
+  for entry in kernels:
+    if isinstance(entry, tuple):
+      instances.append((entry[0], list(entry[1])))
+    else:
+      instances.append((entry, [0] * len(entry.arguments)))
+  if replay is not None:
+    import json
+    with open(replay) as f:
+      records = json.load(f)
+    # A kernel defined again replaces the earlier one of the same name
+    by_name = {}
+    for kernel in get_runtime().kernels:
+      by_name[kernel.qualified_name()] = kernel
+    for rec in records:
+      # Kernels that no longer exist, or whose signature changed, are skipped
+      kernel = by_name.get(rec['kernel'])
+      if kernel is not None and len(kernel.arguments) == len(rec['args']):
+        instances.append((kernel, kernel.replay_arguments(rec['args'])))
+  taichi_kernels = []
+  for kernel, args in instances:
+    key = kernel.instantiate(args)
+    taichi_kernels.append(kernel.taichi_kernels[key])
+  if not get_runtime().prog.config.async_compilation:
+    core.compile_kernels(taichi_kernels)
+
+
+def save_kernel_instances(filename):
+  """Writes the kernel instances materialized so far, for ti.precompile in
+  later runs. Instances with template arguments other than constexprs are
+  left out."""
+  import json
+  records = []
+  for kernel in get_runtime().kernels:
+    for args in kernel.recorded_instances:
+      rec = {'kernel': kernel.qualified_name(), 'args': args}
+      if rec not in records:
+        records.append(rec)
+  with open(filename, 'w') as f:
+    json.dump(records, f, indent=1)
+
+
+def save_aot_module(filename, kernels):
+  """Saves the layout and kernels (a dict from names to kernels) to a file
+  that C++ programs load with AotModule, without Python.
+  ti.cfg.use_offline_cache must be on when the kernels are compiled."""
+  taichi_kernels = {}
+  for name, kernel in kernels.items():
+    if kernel.scalar_args_only:
+      kernel.materialize()
+    assert len(kernel.taichi_kernels) == 1, \
+        'Kernel {} must have been compiled exactly once'.format(name)
+    taichi_kernels[name] = list(kernel.taichi_kernels.values())[0]
+  core.save_aot_module(taichi_kernels, filename)
+
+
+def device_loop(kernels, done, max_iterations, check_interval=16):
+  """Launches the kernels, which take no arguments, in order again and again
+  until the 0-D i32 tensor done is nonzero, for at most max_iterations
+  iterations, and returns the number of iterations that ran. The tasks of the
+  kernels check done on the device, and the host only reads it back once
+  every check_interval iterations. done should be set by the last task of an
+  iteration, e.g. a serial check of the residual in the last kernel."""
+  taichi_kernels = []
+  for kernel in kernels:
+    assert len(kernel.arguments) == 0, \
+        'Kernels of a device loop must take no arguments'
+    key = kernel.instantiate(())
+    taichi_kernels.append(kernel.taichi_kernels[key])
+  return get_runtime().prog.run_device_loop(taichi_kernels, done.ptr.snode(),
+                                            max_iterations, check_interval)
+
+
+def load_aot_module(filename):
+  return get_runtime().load_aot_module(filename)
+
+
+tensor_file_magic = 0x74637473
+
+
+def save_tensors(filename, tensors):
+  """Writes the tensors (and the entries of matrix tensors) to a binary file,
+  each as its size in bytes (u64) followed by its C-ordered cells. Tensors
+  stored in a dense array under the root are written straight from the data
+  structure, through a large buffer; others through to_numpy."""
+  import numpy as np
+  get_runtime().materialize()
+  out = core.BinaryFileStreamOutput(filename)
+  exprs = _tensor_exprs(tensors)
+  header = np.array([tensor_file_magic, len(exprs)], dtype=np.uint32)
+  out.write(header.ctypes.data, header.nbytes)
+  for e in exprs:
+    size = np.array([_tensor_nbytes(e)], dtype=np.uint64)
+    out.write(size.ctypes.data, size.nbytes)
+    snode = e.snode().ptr
+    if snode.has_bulk_copy():
+      snode.write_cells(out)
+    else:
+      arr = e.to_numpy()
+      out.write(arr.ctypes.data, arr.nbytes)
+  out.close()
+
+
+def load_tensors(filename, tensors):
+  """Reads tensors written by save_tensors back into tensors of the same
+  shapes and types."""
+  import numpy as np
+  get_runtime().materialize()
+  inp = core.BinaryFileStreamInput(filename)
+  exprs = _tensor_exprs(tensors)
+  header = np.empty(2, dtype=np.uint32)
+  inp.read(header.ctypes.data, header.nbytes)
+  assert header[0] == tensor_file_magic, \
+      '{} was not written by save_tensors'.format(filename)
+  assert header[1] == len(exprs), \
+      '{} holds {} tensors, not {}'.format(filename, header[1], len(exprs))
+  for e in exprs:
+    size = np.empty(1, dtype=np.uint64)
+    inp.read(size.ctypes.data, size.nbytes)
+    assert size[0] == _tensor_nbytes(e), \
+        'A tensor of {} B in {} does not match'.format(size[0], filename)
+    snode = e.snode().ptr
+    if snode.has_bulk_copy():
+      snode.read_cells(inp)
+    else:
+      arr = np.empty(e.shape(), dtype=to_numpy_type(snode.data_type()))
+      inp.read(arr.ctypes.data, arr.nbytes)
+      e.from_numpy(arr)
+  inp.close()
+
+
+def write_ply(filename, positions, **attributes):
+  """Writes a point cloud as a binary PLY file. positions is a 3D vector
+  tensor (or an (n, 3) array), and each attribute a tensor (or array) of n
+  scalars, giving the property of its name, or of n vectors, whose
+  components give <name>x, <name>y, ... (e.g. n for nx, ny and nz)."""
+  import numpy as np
+
+  def as_array(t):
+    if not isinstance(t, np.ndarray):
+      t = t.to_numpy()
+    return np.ascontiguousarray(t, dtype=np.float32)
+
+  # Kept alive until the file is written
+  arrays = [as_array(positions)]
+  n = arrays[0].shape[0]
+  assert arrays[0].shape == (n, 3), 'positions must be 3D vectors'
+  names, data, strides = [], [], []
+  for name, a in [('', arrays[0])] + list(attributes.items()):
+    if name:
+      a = as_array(a)
+      arrays.append(a)
+    assert a.shape[0] == n and a.ndim <= 2 and a.size <= 4 * n, \
+        'Attribute {} must hold n scalars or vectors'.format(name)
+    num_components = 1 if a.ndim == 1 else a.shape[1]
+    for c in range(num_components):
+      names.append(name + 'xyzw'[c] if a.ndim == 2 else name)
+      data.append(a.ctypes.data + c * a.itemsize)
+      strides.append(num_components)
+  core.write_binary_ply(filename, n, names, data, strides)
+
+
+def voxelize(vertices, faces, out, lower=(0, 0, 0), dx=1, value=1):
+  """Sets the voxels of out (a 3D tensor or numpy array) whose centers are
+  inside a closed triangle mesh to value, leaving the others as they are.
+  vertices is an (n, 3) array of positions and faces an (m, 3) array of
+  vertex indices; voxel (i, j, k) is centered at
+  lower + (i + 0.5, j + 0.5, k + 0.5) * dx."""
+  import numpy as np
+  vertices = (np.asarray(vertices, dtype=np.float64) - np.asarray(lower)) / dx
+  triangles = np.ascontiguousarray(vertices[np.asarray(faces)],
+                                   dtype=np.float32)
+  arr = out if isinstance(out, np.ndarray) else out.to_numpy()
+  assert arr.ndim == 3, 'Voxelizes into 3D tensors or arrays'
+  core.voxelize(list(arr.shape), triangles.ctypes.data, len(triangles),
+                arr.ctypes.data, list(arr.strides), arr.dtype.name, value)
+  if arr is not out:
+    out.from_numpy(arr)
+
+
+def _tensor_exprs(tensors):
+  exprs = []
+  for t in tensors:
+    if isinstance(t, Matrix):
+      exprs += t.entries
+    else:
+      exprs.append(t)
+  return exprs
+
+
+def _tensor_nbytes(e):
+  import numpy as np
+  dt = np.dtype(to_numpy_type(e.snode().data_type()))
+  return int(np.prod(e.shape(), dtype=np.int64)) * dt.itemsize
+
+
+def memory_stats():
+  get_runtime().materialize()
+
+  import taichi as ti
+  stats = {}
+  def visit(node):
+    if node.ptr.has_stat():
+      stats[node.ptr.stat().snode_id] = node.memory_stats()
+    for i in range(node.ptr.get_num_ch()):
+      visit(SNode(node.ptr.get_ch(i)))
+
+  for tree in get_runtime().snode_roots():
+    visit(tree)
+  return stats
 
 
-schedules = [parallelize, vectorize, block_dim, cache]
+schedules = [parallelize, vectorize, block_dim, schedule, cache]
 lang_core = core
 
 
@@ -0,0 +1,61 @@
+import numpy as np
+
+
+# An alias table over n choices, for O(1) importance sampling in kernels,
+# e.g. of lights or of the pixels of an environment map by their power.
+# Create it before the layout is materialized, since it declares its own
+# tensors, and build() it from the weights on the host, which takes O(n)
+# (Vose's algorithm, see AliasSampler in taichi/math/discrete_sampler.h).
+#
+# In kernels, sample(u) maps a uniform number in [0, 1) to a choice with
+# probability pdf(choice), the weight normalized by the total. Each sample
+# reads two entries of the table, whatever the distribution.
+class AliasTable:
+
+  def __init__(self, n):
+    import taichi as ti
+    self.n = n
+    # The probability of keeping each column rather than taking its alias
+    self.prob = ti.var(ti.f32, shape=n)
+    self.alias = ti.var(ti.i32, shape=n)
+    self.pdfs = ti.var(ti.f32, shape=n)
+    prob, alias, pdfs = self.prob, self.alias, self.pdfs
+
+    @ti.func
+    def sample(u):
+      x = u * n
+      i = min(ti.cast(x, ti.i32), n - 1)
+      ret = i
+      if x - i >= prob[i]:
+        ret = alias[i]
+      return ret
+
+    @ti.func
+    def pdf(i):
+      return pdfs[i]
+
+    @ti.kernel
+    def sample_batch(out: ti.template(), num: ti.i32):
+      for i in range(num):
+        out[i] = sample(ti.random(ti.f32))
+
+    self.sample = sample
+    self.pdf = pdf
+    self.sample_batch_kernel = sample_batch
+
+  def build(self, weights):
+    import taichi as ti
+    weights = np.asarray(weights, dtype=np.float32).ravel()
+    assert len(weights) == self.n, \
+        'Expected {} weights, got {}'.format(self.n, len(weights))
+    prob, alias, pdfs = ti.core.build_alias_table(weights.tolist())
+    self.prob.from_numpy(np.array(prob, dtype=np.float32))
+    self.alias.from_numpy(np.array(alias, dtype=np.int32))
+    self.pdfs.from_numpy(np.array(pdfs, dtype=np.float32))
+
+  # Writes num samples (by default, as many as out holds) to the 1D i32
+  # tensor out, drawn with ti.random
+  def sample_batch(self, out, num=None):
+    if num is None:
+      num = out.shape()[0]
+    self.sample_batch_kernel(out, num)
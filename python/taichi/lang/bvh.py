@@ -0,0 +1,365 @@
+import numpy as np
+
+# The bits of the Morton codes along each axis
+morton_bits = 10
+
+
+# The component-wise minimum (maximum) of two 3D vectors
+def vmin(a, b):
+  import taichi as ti
+  return ti.Vector([ti.min(a(k), b(k)) for k in range(3)])
+
+
+def vmax(a, b):
+  import taichi as ti
+  return ti.Vector([ti.max(a(k), b(k)) for k in range(3)])
+
+
+# A bounding volume hierarchy over up to max_triangles triangles, for ray
+# casts and closest point queries in kernels (renderers, collisions). Create
+# it before the layout is materialized, since it declares its own tensors.
+#
+# build() is a linear BVH (LBVH) built in kernels: the triangles are sorted
+# by the 30-bit Morton codes of their centroids with the radix sort of
+# ParticleSorter, and each internal node finds its range of sorted
+# triangles and its split from the common prefixes of the codes, in
+# parallel (Karras 2012). The box of each node is the union of the boxes in
+# its range. Node 0 is the root, nodes [0, n - 1) are internal and node
+# n - 1 + k is the leaf of the k-th sorted triangle.
+#
+# Traversals are stackless: each node holds where to go when its box is
+# missed (or after a leaf), the right sibling of its closest ancestor that
+# is a left child.
+class BVH:
+
+  def __init__(self, max_triangles, num_chunks=256):
+    import taichi as ti
+    from .sort import ParticleSorter
+    assert max_triangles > 0
+    self.max_triangles = max_triangles
+    self.n = 0
+    max_nodes = 2 * max_triangles - 1
+    # The vertices of the triangles, which kernels may move before a build()
+    self.v0 = ti.Vector(3, dt=ti.f32, shape=max_triangles)
+    self.v1 = ti.Vector(3, dt=ti.f32, shape=max_triangles)
+    self.v2 = ti.Vector(3, dt=ti.f32, shape=max_triangles)
+    # The bounds of the centroids, for the Morton codes
+    self.lower = ti.Vector(3, dt=ti.f32, shape=())
+    self.upper = ti.Vector(3, dt=ti.f32, shape=())
+    self.num_triangles = ti.var(ti.i32, shape=())
+    self.left = ti.var(ti.i32, shape=max_nodes)
+    self.right = ti.var(ti.i32, shape=max_nodes)
+    self.parent = ti.var(ti.i32, shape=max_nodes)
+    self.escape = ti.var(ti.i32, shape=max_nodes)
+    # The range of sorted triangles under each node
+    self.first = ti.var(ti.i32, shape=max_nodes)
+    self.last = ti.var(ti.i32, shape=max_nodes)
+    self.box_min = ti.Vector(3, dt=ti.f32, shape=max_nodes)
+    self.box_max = ti.Vector(3, dt=ti.f32, shape=max_nodes)
+    self.sorter = ParticleSorter([],
+                                 max_triangles,
+                                 self.morton_code,
+                                 1 << (3 * morton_bits),
+                                 num_chunks=num_chunks)
+    self.make_kernels()
+
+  # In kernels
+  def centroid(self, i):
+    import taichi as ti
+    return (ti.subscript(self.v0, i) + ti.subscript(self.v1, i) +
+            ti.subscript(self.v2, i)) * (1 / 3)
+
+  # The Morton code of the centroid of triangle i, within the bounds
+  def morton_code(self, i):
+    import taichi as ti
+    scale = 1 << morton_bits
+    c = self.centroid(i)
+    lower = ti.subscript(self.lower, None)
+    upper = ti.subscript(self.upper, None)
+    code = 0
+    for k in range(3):
+      extent = ti.max(upper(k) - lower(k), 1e-20)
+      q = ti.min(
+          ti.max(ti.cast((c(k) - lower(k)) / extent * scale, ti.i32), 0),
+          scale - 1)
+      for b in range(morton_bits):
+        code = code + q // (1 << b) % 2 * (1 << (3 * b + 2 - k))
+    return code
+
+  def make_kernels(self):
+    import taichi as ti
+    v0, v1, v2 = self.v0, self.v1, self.v2
+    lower, upper = self.lower, self.upper
+    num_triangles = self.num_triangles
+    left, right, parent = self.left, self.right, self.parent
+    escape, first, last = self.escape, self.first, self.last
+    box_min, box_max = self.box_min, self.box_max
+    centroid = self.centroid
+    keys = self.sorter.sorted_keys()
+    order = self.sorter.sorted_order()
+    code_bits = 3 * morton_bits
+
+    @ti.kernel
+    def compute_bounds(n: ti.i32):
+      for _ in range(1):
+        for k in ti.static(range(3)):
+          lower[None][k] = 1e30
+          upper[None][k] = -1e30
+        num_triangles[None] = n
+      for i in range(n):
+        c = centroid(i)
+        for k in ti.static(range(3)):
+          ti.atomic_min(lower[None][k], c[k])
+          ti.atomic_max(upper[None][k], c[k])
+
+    # The length of the common prefix of the bits of a and b, both in
+    # [0, 2^bits)
+    @ti.func
+    def common_prefix(a, b, bits):
+      ret = bits
+      for k in ti.static(range(31)):
+        if k < bits and a // (1 << k) != b // (1 << k):
+          ret = bits - 1 - k
+      return ret
+
+    # Of sorted triangles i and j, with the indices breaking ties, or -1
+    # for j outside [0, n)
+    @ti.func
+    def delta(i, j, n):
+      ret = -1
+      if 0 <= j and j < n:
+        if keys[i] == keys[j]:
+          ret = code_bits + common_prefix(i, j, 31)
+        else:
+          ret = common_prefix(keys[i], keys[j], code_bits)
+      return ret
+
+    @ti.kernel
+    def build_hierarchy(n: ti.i32):
+      for k in range(n):
+        leaf = n - 1 + k
+        left[leaf] = -1
+        right[leaf] = -1
+        first[leaf] = k
+        last[leaf] = k
+        t = order[k]
+        box_min[leaf] = vmin(vmin(v0[t], v1[t]), v2[t])
+        box_max[leaf] = vmax(vmax(v0[t], v1[t]), v2[t])
+      parent[0] = -1
+      for i in range(n - 1):
+        d = 1
+        if delta(i, i + 1, n) < delta(i, i - 1, n):
+          d = -1
+        # The other end of the range, found by exponential and binary search
+        delta_min = delta(i, i - d, n)
+        l_max = 2
+        while delta(i, i + l_max * d, n) > delta_min:
+          l_max *= 2
+        l = 0
+        t = l_max // 2
+        while t >= 1:
+          if delta(i, i + (l + t) * d, n) > delta_min:
+            l += t
+          t = t // 2
+        j = i + l * d
+        # The split, the last triangle sharing more than delta_node bits
+        # with i
+        delta_node = delta(i, j, n)
+        s = 0
+        t = l
+        searching = 1
+        while searching:
+          t = (t + 1) // 2
+          if delta(i, i + (s + t) * d, n) > delta_node:
+            s += t
+          if t <= 1:
+            searching = 0
+        gamma = i + s * d + min(d, 0)
+        lo = min(i, j)
+        hi = max(i, j)
+        first[i] = lo
+        last[i] = hi
+        left[i] = gamma
+        if lo == gamma:
+          left[i] = n - 1 + gamma
+        right[i] = gamma + 1
+        if hi == gamma + 1:
+          right[i] = n - 1 + gamma + 1
+      for i in range(n - 1):
+        parent[left[i]] = i
+        parent[right[i]] = i
+      for i in range(n - 1):
+        lo = box_min[n - 1 + first[i]]
+        hi = box_max[n - 1 + first[i]]
+        for k in range(first[i] + 1, last[i] + 1):
+          lo = vmin(lo, box_min[n - 1 + k])
+          hi = vmax(hi, box_max[n - 1 + k])
+        box_min[i] = lo
+        box_max[i] = hi
+      for x in range(2 * n - 1):
+        y = x
+        climbing = 1
+        while climbing:
+          climbing = 0
+          if y != 0:
+            if y == right[parent[y]]:
+              y = parent[y]
+              climbing = 1
+        escape[x] = -1
+        if y != 0:
+          escape[x] = right[parent[y]]
+
+    self.compute_bounds = compute_bounds
+    self.build_hierarchy = build_hierarchy
+
+    # The entry and exit t of the ray o + t * d, with inv_d = 1 / d, through
+    # the box of node
+    @ti.func
+    def ray_box(node, o, inv_d):
+      t0 = (box_min[node] - o) * inv_d
+      t1 = (box_max[node] - o) * inv_d
+      return vmin(t0, t1).max(), vmax(t0, t1).min()
+
+    # The t of the intersection with triangle t, or t_max if there is none
+    # closer (Moller-Trumbore)
+    @ti.func
+    def ray_triangle(o, d, t, t_max):
+      e1 = v1[t] - v0[t]
+      e2 = v2[t] - v0[t]
+      p = ti.Matrix.cross(d, e2)
+      det = e1.dot(p)
+      ret = t_max
+      if abs(det) > 1e-12:
+        inv_det = 1 / det
+        s = o - v0[t]
+        u = s.dot(p) * inv_det
+        q = ti.Matrix.cross(s, e1)
+        v = d.dot(q) * inv_det
+        hit_t = e2.dot(q) * inv_det
+        if u >= 0 and v >= 0 and u + v <= 1 and hit_t > 0 and hit_t < t_max:
+          ret = hit_t
+      return ret
+
+    # The closest intersection of the ray o + t * d with t in (0, t_max), as
+    # its t and triangle (t_max and -1 if there is none)
+    @ti.func
+    def ray_cast(o, d, t_max):
+      n = num_triangles[None]
+      inv_d = ti.Vector([0.0, 0.0, 0.0])
+      for k in ti.static(range(3)):
+        dk = d[k]
+        if abs(dk) < 1e-12:
+          dk = 1e-12
+        inv_d[k] = 1 / dk
+      best_t = t_max
+      best = -1
+      node = 0
+      if n == 0:
+        node = -1
+      while node != -1:
+        t_enter, t_exit = ray_box(node, o, inv_d)
+        if t_enter <= t_exit and t_exit > 0 and t_enter < best_t:
+          if node >= n - 1:
+            t = order[node - (n - 1)]
+            hit_t = ray_triangle(o, d, t, best_t)
+            if hit_t < best_t:
+              best_t = hit_t
+              best = t
+            node = escape[node]
+          else:
+            node = left[node]
+        else:
+          node = escape[node]
+      return best_t, best
+
+    # The point of triangle a, b, c closest to p (Ericson, Real-Time
+    # Collision Detection, 5.1.5)
+    @ti.func
+    def closest_on_triangle(p, a, b, c):
+      ab = b - a
+      ac = c - a
+      ap = p - a
+      d1 = ab.dot(ap)
+      d2 = ac.dot(ap)
+      ret = a
+      if d1 > 0 or d2 > 0:
+        bp = p - b
+        d3 = ab.dot(bp)
+        d4 = ac.dot(bp)
+        vc = d1 * d4 - d3 * d2
+        cp = p - c
+        d5 = ab.dot(cp)
+        d6 = ac.dot(cp)
+        vb = d5 * d2 - d1 * d6
+        va = d3 * d6 - d5 * d4
+        if d3 >= 0 and d4 <= d3:
+          ret = b
+        elif vc <= 0 and d1 >= 0 and d3 <= 0:
+          ret = a + d1 / (d1 - d3) * ab
+        elif d6 >= 0 and d5 <= d6:
+          ret = c
+        elif vb <= 0 and d2 >= 0 and d6 <= 0:
+          ret = a + d2 / (d2 - d6) * ac
+        elif va <= 0 and d4 - d3 >= 0 and d5 - d6 >= 0:
+          ret = b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b)
+        elif va + vb + vc > 0:
+          denom = 1 / (va + vb + vc)
+          ret = a + ab * (vb * denom) + ac * (vc * denom)
+      return ret
+
+    # The point of the mesh closest to p within max_dist, as its distance,
+    # triangle and position (max_dist, -1 and p if there is none)
+    @ti.func
+    def closest_point(p, max_dist):
+      n = num_triangles[None]
+      best_d2 = max_dist * max_dist
+      best = -1
+      best_q = p
+      node = 0
+      if n == 0:
+        node = -1
+      while node != -1:
+        # The squared distance from p to the box
+        gap = vmax(vmax(box_min[node] - p, p - box_max[node]),
+                   ti.Vector([0.0, 0.0, 0.0]))
+        if gap.norm_sqr() < best_d2:
+          if node >= n - 1:
+            t = order[node - (n - 1)]
+            q = closest_on_triangle(p, v0[t], v1[t], v2[t])
+            d2 = (q - p).norm_sqr()
+            if d2 < best_d2:
+              best_d2 = d2
+              best = t
+              best_q = q
+            node = escape[node]
+          else:
+            node = left[node]
+        else:
+          node = escape[node]
+      return ti.sqrt(best_d2), best, best_q
+
+    self.ray_cast = ray_cast
+    self.closest_point = closest_point
+
+  # Rebuilds the hierarchy over the first n triangles (all those of the
+  # last build by default). With vertices (an array of v x 3) and faces (an
+  # array of n x 3 vertex indices), first copies the triangles.
+  def build(self, vertices=None, faces=None, n=None):
+    if vertices is not None:
+      vertices = np.asarray(vertices, dtype=np.float32)
+      faces = np.asarray(faces, dtype=np.int64)
+      assert len(faces) <= self.max_triangles, 'Too many triangles'
+      n = len(faces)
+      for k, tensor in enumerate([self.v0, self.v1, self.v2]):
+        corners = np.zeros((self.max_triangles, 3), dtype=np.float32)
+        corners[:n] = vertices[faces[:, k]]
+        tensor.from_numpy(corners)
+    if n is None:
+      n = self.n
+    assert 0 <= n <= self.max_triangles
+    self.n = n
+    self.compute_bounds(n)
+    if n == 0:
+      return
+    self.sorter.sort(n)
+    self.build_hierarchy(n)
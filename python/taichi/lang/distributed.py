@@ -0,0 +1,179 @@
+import numpy as np
+
+reduce_ops = ['sum', 'max', 'min']
+
+
+# The process is the only rank
+class SingleRankCommunicator:
+
+  def __init__(self):
+    self.rank = 0
+    self.size = 1
+
+  # Sends send to dest and receives recv from source, at once. A rank of
+  # None is skipped.
+  def sendrecv(self, send, dest, recv, source):
+    if source is not None:
+      assert source == 0 and dest == 0
+      recv[...] = send
+
+  def allreduce(self, value, op):
+    return value
+
+
+# Ranks of an MPI job, through mpi4py
+class MPICommunicator:
+
+  def __init__(self, comm=None):
+    from mpi4py import MPI
+    self.mpi = MPI
+    self.comm = MPI.COMM_WORLD if comm is None else comm
+    self.rank = self.comm.Get_rank()
+    self.size = self.comm.Get_size()
+
+  def sendrecv(self, send, dest, recv, source):
+    null = self.mpi.PROC_NULL
+    self.comm.Sendrecv(send,
+                       dest=null if dest is None else dest,
+                       recvbuf=recv,
+                       source=null if source is None else source)
+
+  def allreduce(self, value, op):
+    ops = {'sum': self.mpi.SUM, 'max': self.mpi.MAX, 'min': self.mpi.MIN}
+    return self.comm.allreduce(value, op=ops[op])
+
+
+# MPI when the process runs in an MPI job of more than one rank
+def default_communicator():
+  try:
+    comm = MPICommunicator()
+  except ImportError:
+    return SingleRankCommunicator()
+  if comm.size == 1:
+    return SingleRankCommunicator()
+  return comm
+
+
+# Splits n cells into size ranges as even as possible
+def partition(n, size, rank):
+  begin = n * rank // size
+  end = n * (rank + 1) // size
+  return begin, end
+
+
+# Decomposes a grid of the given global shape across the ranks of comm by
+# index ranges along its first axis. Each rank declares the tensors of its
+# range with var(), which have halos of width halo, so that struct-fors over
+# them run over the cells the rank owns only; begin is the global index of
+# local index 0 along the first axis. exchange() fills the halos along the
+# first axis from the neighboring ranks (and the halos along the others as
+# with update_halo), at the sync points the program chooses, and
+# all_reduce() combines e.g. the losses of all ranks.
+class DomainDecomposition:
+
+  def __init__(self, shape, halo=1, comm=None, periodic=False,
+               boundary='clamp'):
+    if isinstance(shape, int):
+      shape = (shape,)
+    self.shape = tuple(shape)
+    self.halo = halo
+    self.comm = default_communicator() if comm is None else comm
+    self.periodic = periodic
+    # How update_halo fills the halos at the ends of the global grid
+    self.boundary = boundary
+    self.rank = self.comm.rank
+    self.size = self.comm.size
+    assert halo > 0
+    self.begin, self.end = partition(self.shape[0], self.size, self.rank)
+    assert self.end - self.begin >= halo, \
+        'Rank {} owns fewer cells than the halo is wide'.format(self.rank)
+    self.local_shape = (self.end - self.begin,) + self.shape[1:]
+    self.kernels = {}
+
+  def neighbors(self):
+    lower = self.rank - 1
+    upper = self.rank + 1
+    if self.periodic:
+      lower %= self.size
+      upper %= self.size
+    return (lower if lower >= 0 else None,
+            upper if upper < self.size else None)
+
+  # The tensor holding the cells of this rank
+  def var(self, dt, needs_grad=False):
+    import taichi as ti
+    return ti.var(dt, shape=self.local_shape, needs_grad=needs_grad,
+                  halo=self.halo)
+
+  # Copies a slab of cells of width halo along the first axis, spanning the
+  # halos of the other axes, between a tensor and a flat numpy array
+  def make_slab_kernels(self, tensor):
+    import taichi as ti
+    dim = len(self.shape)
+    h = self.halo
+    extents = [h] + [s + 2 * h for s in self.shape[1:]]
+    strides = [1] * dim
+    for d in reversed(range(dim - 1)):
+      strides[d] = strides[d + 1] * extents[d + 1]
+    num_cells = strides[0] * extents[0]
+
+    # The cells [start, start + h) along the first axis
+    @ti.kernel
+    def pack(arr: ti.ext_arr(), start: ti.i32):
+      for k in range(num_cells):
+        I = ti.Vector.zero(ti.i32, dim)
+        for d in ti.static(range(dim)):
+          I[d] = k // strides[d] % extents[d] - h
+        I[0] += start + h
+        arr[k] = tensor[I]
+
+    @ti.kernel
+    def unpack(arr: ti.ext_arr(), start: ti.i32):
+      for k in range(num_cells):
+        I = ti.Vector.zero(ti.i32, dim)
+        for d in ti.static(range(dim)):
+          I[d] = k // strides[d] % extents[d] - h
+        I[0] += start + h
+        tensor[I] = arr[k]
+
+    return num_cells, pack, unpack
+
+  def get_slab_kernels(self, tensor):
+    key = id(tensor)
+    if key not in self.kernels:
+      self.kernels[key] = self.make_slab_kernels(tensor)
+    return self.kernels[key]
+
+  # Fills the halos of the tensors (declared with var()), the cells of their
+  # first and last halo ranges along the first axis going to the neighbors
+  def exchange(self, *tensors):
+    from .util import to_numpy_type
+    h = self.halo
+    n = self.local_shape[0]
+    lower, upper = self.neighbors()
+    for tensor in tensors:
+      tensor.update_halo(self.boundary)
+      num_cells, pack, unpack = self.get_slab_kernels(tensor)
+      dtype = to_numpy_type(tensor.snode().data_type())
+      send = np.empty(num_cells, dtype=dtype)
+      recv = np.empty(num_cells, dtype=dtype)
+      # Upwards: the last owned cells become the lower halo of the next rank
+      pack(send, n - h)
+      self.comm.sendrecv(send, upper, recv, lower)
+      if lower is not None:
+        unpack(recv, -h)
+      # Downwards
+      pack(send, 0)
+      self.comm.sendrecv(send, lower, recv, upper)
+      if upper is not None:
+        unpack(recv, n)
+
+  # Combines value (a number, or a 0-D tensor, which is overwritten) over
+  # all ranks with op: 'sum', 'max' or 'min'. Returns the result.
+  def all_reduce(self, value, op='sum'):
+    assert op in reduce_ops, 'Unknown reduction {}'.format(op)
+    if hasattr(value, 'snode'):
+      result = self.comm.allreduce(value[None], op)
+      value[None] = result
+      return result
+    return self.comm.allreduce(value, op)
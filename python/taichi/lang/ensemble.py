@@ -0,0 +1,136 @@
+# The ensemble whose kernel is being traced, and the batch index of the
+# top-level loop being traced (None outside of them)
+tracing = None
+batch_index = None
+
+
+# Runs size independent instances of the same simulation in the same
+# launches, e.g. for parameter sweeps or RL rollouts, where a single small
+# instance leaves most of the GPU idle. The tensors of the instances are
+# batched: var(), Vector() and Matrix() declare them with an extra leading
+# index, the instance, and batched() marks tensors of custom layouts whose
+# first index is the instance. Per-instance parameters are batched 0-D
+# tensors, read as x[None] and set from an array with x.from_numpy().
+#
+# Kernels decorated with kernel() are written for one instance. Every
+# top-level loop runs over all instances at once: range-fors and ndrange-fors
+# get the instance as an outer index, and struct-fors over batched tensors
+# visit the cells of all instances. In their bodies, accesses to batched
+# tensors get the index of the instance prepended, including in ti.funcs.
+# Batched tensors cannot be accessed outside of the top-level loops, nor
+# through the SNode ops (ti.is_active, ti.append, ...), which take the
+# full indices. From Python, batched tensors take the instance as their
+# first index.
+class Ensemble:
+
+  def __init__(self, size):
+    assert size > 0
+    self.size = size
+
+  def get_shape(self, shape):
+    if shape is None:
+      shape = ()
+    elif isinstance(shape, int):
+      shape = (shape,)
+    return (self.size,) + tuple(shape)
+
+  def var(self, dt, shape=None, needs_grad=False):
+    import taichi as ti
+    return self.batched(
+        ti.var(dt, shape=self.get_shape(shape), needs_grad=needs_grad))
+
+  def Vector(self, n, dt, shape=None, needs_grad=False):
+    import taichi as ti
+    return self.batched(
+        ti.Vector(n,
+                  dt=dt,
+                  shape=self.get_shape(shape),
+                  needs_grad=needs_grad))
+
+  def Matrix(self, n, m, dt, shape=None, needs_grad=False):
+    import taichi as ti
+    return self.batched(
+        ti.Matrix(n,
+                  m,
+                  dt=dt,
+                  shape=self.get_shape(shape),
+                  needs_grad=needs_grad))
+
+  # Marks tensors whose first index is the instance, with their gradients.
+  # Returns the tensor if there is one.
+  def batched(self, *tensors):
+    from .matrix import Matrix
+    for t in tensors:
+      entries = t.entries if isinstance(t, Matrix) else [t]
+      for e in entries:
+        e.batched_by = self
+        if getattr(e, 'grad', None) is not None:
+          e.grad.batched_by = self
+    return tensors[0] if len(tensors) == 1 else tensors
+
+  def is_batched(self, loop_var):
+    if not hasattr(loop_var, 'loop_range'):
+      from .transformer import TaichiSyntaxError
+      raise TaichiSyntaxError(
+          'Top-level struct-fors of ensemble kernels must be over tensors')
+    return getattr(loop_var.loop_range(), 'batched_by', None) is self
+
+  # The kernel decorator
+  def kernel(self, func):
+    import taichi as ti
+    ret = ti.kernel(func)
+    for k in [ret, ret.grad, ret.forward_and_grad]:
+      k.ensemble = self
+    return ret
+
+  # Traces the kernel func of the ensemble
+  def trace(self, func):
+    global tracing, batch_index
+    tracing = self
+    batch_index = None
+    try:
+      func()
+    finally:
+      tracing = None
+      batch_index = None
+
+  # The indices of a top-level struct-for over loop_var
+  def loop_indices(self, loop_var, batch, indices):
+    if self.is_batched(loop_var):
+      return [batch] + list(indices)
+    return list(indices)
+
+  # The number of indices of the cells of an instance of loop_var
+  def instance_dim(self, loop_var):
+    return loop_var.loop_range().dim() - int(self.is_batched(loop_var))
+
+  # Called at the beginning of the body of the top-level loops, whose batch
+  # index is batch, if loop_var is batched for struct-fors
+  def enter(self, batch, loop_var=None):
+    global batch_index
+    if loop_var is None or self.is_batched(loop_var):
+      batch_index = batch
+    else:
+      batch_index = None
+
+  def leave(self):
+    global batch_index
+    batch_index = None
+
+
+# The indices of an access to x in a kernel
+def prepend_batch_index(x, indices):
+  ensemble = getattr(x, 'batched_by', None)
+  if ensemble is None or tracing is None:
+    return indices
+  from .transformer import TaichiSyntaxError
+  if ensemble is not tracing:
+    raise TaichiSyntaxError(
+        'The tensor is batched by another ensemble than the kernel')
+  if batch_index is None:
+    raise TaichiSyntaxError(
+        'Batched tensors can only be accessed in the top-level loops of '
+        'ensemble kernels')
+  if len(indices) == 1 and indices[0] is None:
+    indices = ()
+  return (batch_index,) + tuple(indices)
@@ -160,7 +160,7 @@ class Expr:
       return
     snode = self.ptr.snode()
 
-    if self.snode().data_type() == f32 or self.snode().data_type() == f64:
+    if self.snode().data_type() in [f16, f32, f64]:
       def getter(*key):
         assert len(key) == taichi_lang_core.get_max_num_indices()
         return snode.read_float(key)
@@ -180,6 +180,57 @@ class Expr:
     self.getter = getter
     self.setter = setter
 
+  def batch_indices(self, key):
+    # The indices of the cells a key with slices selects (one row each), and
+    # the shape of the selection
+    import numpy as np
+    ranges = []
+    shape = []
+    for i, k in enumerate(key):
+      if isinstance(k, slice):
+        r = np.arange(*k.indices(self.snode().get_shape(i)), dtype=np.int32)
+        shape.append(len(r))
+      else:
+        r = np.array([k], dtype=np.int32)
+      ranges.append(r)
+    grid = np.meshgrid(*ranges, indexing='ij')
+    indices = np.stack([g.reshape(-1) for g in grid], axis=1)
+    return indices, tuple(shape)
+
+  def value_type(self):
+    dt = self.snode().data_type()
+    if dt == f16:
+      return f32
+    return dt
+
+  # Reads the cells at indices, an array of shape (n, dim) (or (n,) for 1D
+  # tensors), in a single kernel launch
+  def gather(self, indices):
+    import numpy as np
+    if not Expr.layout_materialized:
+      self.materialize_layout_callback()
+    indices = np.ascontiguousarray(indices, dtype=np.int32)
+    indices = indices.reshape(-1, self.dim())
+    n = indices.shape[0]
+    values = np.empty(shape=(n,), dtype=to_numpy_type(self.value_type()))
+    if n > 0:
+      self.snode().ptr.gather(indices.ctypes.data, values.ctypes.data, n)
+    return values
+
+  # Writes values (a scalar, or one per index) to the cells at indices
+  def scatter(self, indices, values):
+    import numpy as np
+    if not Expr.layout_materialized:
+      self.materialize_layout_callback()
+    indices = np.ascontiguousarray(indices, dtype=np.int32)
+    indices = indices.reshape(-1, self.dim())
+    n = indices.shape[0]
+    values = np.broadcast_to(
+        np.asarray(values, dtype=to_numpy_type(self.value_type())), (n,))
+    values = np.ascontiguousarray(values)
+    if n > 0:
+      self.snode().ptr.scatter(indices.ctypes.data, values.ctypes.data, n)
+
   def __setitem__(self, key, value):
     if not Expr.layout_materialized:
       self.materialize_layout_callback()
@@ -189,6 +240,12 @@ class Expr:
     if not isinstance(key, tuple):
       key = (key,)
     assert len(key) == self.dim()
+    if any(isinstance(k, slice) for k in key):
+      import numpy as np
+      indices, shape = self.batch_indices(key)
+      values = np.broadcast_to(np.asarray(value), shape)
+      self.scatter(indices, values.reshape(-1))
+      return
     key = key + ((0,) * (taichi_lang_core.get_max_num_indices() - len(key)))
     self.setter(value, *key)
 
@@ -200,6 +257,10 @@ class Expr:
       key = ()
     if not isinstance(key, tuple):
       key = (key,)
+    if any(isinstance(k, slice) for k in key):
+      assert len(key) == self.dim()
+      indices, shape = self.batch_indices(key)
+      return self.gather(indices).reshape(shape)
     key = key + ((0,) * (taichi_lang_core.get_max_num_indices() - len(key)))
     return self.getter(*key)
 
@@ -226,19 +287,48 @@ class Expr:
     self.ptr.set_grad(grad.ptr)
 
   def clear(self, deactivate=False):
-    assert not deactivate
     node = self.ptr.snode().parent
     assert node
-    node.clear_data()
+    if deactivate:
+      node.clear_data_and_deactivate()
+    else:
+      node.clear_data()
 
   def fill(self, val):
+    if not Expr.layout_materialized:
+      self.materialize_layout_callback()
+    node = self.ptr.snode().parent
+    if isinstance(val, (int, float)) and val == 0 and \
+        node.get_num_ch() == 1 and node.can_clear_data():
+      node.clear_data()
+      return
     # TODO: avoid too many template instantiations
     from .meta import fill_tensor
     fill_tensor(self, val)
 
+  # Cells of padding on each side of each axis, from ti.var(..., halo=h)
+  def halo_width(self):
+    if not Expr.layout_materialized:
+      self.materialize_layout_callback()
+    return self.snode().ptr.halo_width()
+
+  # Fills the halo from the interior, for stencils to read neighbors at
+  # indices -h to n + h - 1 without boundary checks. mode is 'clamp',
+  # 'periodic' or 'constant' (set to value).
+  def update_halo(self, mode='clamp', value=0):
+    from .halo import update_halo
+    from .impl import get_runtime
+    get_runtime().materialize()
+    if not hasattr(self, 'halo_kernels'):
+      self.halo_kernels = {}
+    update_halo(self, mode, value)
+
   def atomic_add(self, other):
     taichi_lang_core.expr_atomic_add(self.ptr, other.ptr)
 
+  def atomic_op(self, op, other):
+    getattr(taichi_lang_core, 'expr_atomic_' + op)(self.ptr, other.ptr)
+
   def __pow__(self, power, modulo=None):
     assert isinstance(power, int) and power >= 0
     if power == 0:
@@ -288,7 +378,12 @@ class Expr:
     import numpy as np
     arr = np.empty(
         shape=self.shape(), dtype=to_numpy_type(self.snode().data_type()))
-    tensor_to_ext_arr(self, arr)
+    from .impl import get_runtime
+    get_runtime().materialize()
+    if self.snode().ptr.has_bulk_copy():
+      self.snode().ptr.bulk_copy(arr.ctypes.data, True)
+    else:
+      tensor_to_ext_arr(self, arr)
     return arr
 
   def to_torch(self, device=None):
@@ -305,6 +400,15 @@ class Expr:
     for i in range(self.dim()):
       assert s[i] == arr.shape[i]
     from .meta import ext_arr_to_tensor
+    from .impl import get_runtime
+    import numpy as np
+    get_runtime().materialize()
+    snode = self.snode().ptr
+    if isinstance(arr, np.ndarray) and snode.has_bulk_copy() and \
+        arr.dtype == to_numpy_type(snode.data_type()):
+      arr = np.ascontiguousarray(arr)
+      snode.bulk_copy(arr.ctypes.data, False)
+      return
     if hasattr(arr, 'contiguous'):
       arr = arr.contiguous()
     ext_arr_to_tensor(arr, self)
@@ -0,0 +1,144 @@
+import numpy as np
+import queue
+import struct
+import threading
+
+
+def encode_raw(f, arrays):
+  # The format of ti.save_tensors, readable with ti.load_tensors
+  import taichi as ti
+  f.write(struct.pack('<II', ti.tensor_file_magic, len(arrays)))
+  for a in arrays:
+    f.write(struct.pack('<Q', a.nbytes))
+    f.write(a.data)
+
+
+# Binary little-endian PLY of the vertices of the frame: the first tensor is a
+# 3D vector tensor of positions, and an optional second one of RGB colors in
+# [0, 1] is stored as uchars
+def encode_ply(f, arrays):
+  assert len(arrays) in [3, 6], \
+      'PLY frames take a position and optionally a color vector tensor'
+  n = arrays[0].size
+  properties = [('x', 'f4'), ('y', 'f4'), ('z', 'f4')]
+  if len(arrays) == 6:
+    properties += [('red', 'u1'), ('green', 'u1'), ('blue', 'u1')]
+  vertices = np.empty(n, dtype=[(name, '<' + t) for name, t in properties])
+  for (name, t), a in zip(properties, arrays):
+    if t == 'u1':
+      a = np.clip(a * 255 + 0.5, 0, 255)
+    vertices[name] = a.ravel()
+  types = {'f4': 'float', 'u1': 'uchar'}
+  header = 'ply\nformat binary_little_endian 1.0\n'
+  header += 'element vertex {}\n'.format(n)
+  for name, t in properties:
+    header += 'property {} {}\n'.format(types[t], name)
+  header += 'end_header\n'
+  f.write(header.encode())
+  f.write(vertices.data)
+
+
+encoders = {'raw': encode_raw, 'ply': encode_ply}
+
+
+# Writes frames of tensors in the background, so that the simulation does not
+# wait for the disk. write(filename) copies the tensors (and the entries of
+# matrix tensors) into one of queue_depth + 1 staging buffer sets, straight
+# from the data structure when they are stored in a dense array under the
+# root, and leaves the encoding and the writing to a thread of its own. When
+# all sets are taken, write() waits for the oldest frame to be written, which
+# bounds the memory used and the frames lost on a crash.
+#
+# encoder is 'raw' (the format of ti.save_tensors), 'ply' (binary particle
+# positions and colors), or a function (file, arrays) writing the numpy
+# arrays of the entries to a binary file. Filenames ending in .gz are
+# compressed with gzip on the writer thread.
+class FrameWriter:
+
+  def __init__(self, tensors, encoder='raw', queue_depth=2):
+    assert queue_depth >= 1
+    self.entries = []
+    for t in tensors:
+      self.entries += t.entries if hasattr(t, 'entries') else [t]
+    self.encoder = encoders[encoder] if isinstance(encoder, str) else encoder
+    self.queue_depth = queue_depth
+    self.free = queue.Queue()
+    self.frames = queue.Queue()
+    self.error = None
+    self.thread = None
+
+  def start(self):
+    from .util import to_numpy_type
+    for _ in range(self.queue_depth + 1):
+      self.free.put([
+          np.empty(e.shape(), dtype=to_numpy_type(e.snode().data_type()))
+          for e in self.entries
+      ])
+    self.thread = threading.Thread(target=self.run, daemon=True)
+    self.thread.start()
+
+  def run(self):
+    while True:
+      frame = self.frames.get()
+      if frame is None:
+        return
+      filename, arrays = frame
+      try:
+        if self.error is None:
+          self.write_file(filename, arrays)
+      except Exception as e:
+        self.error = e
+      self.free.put(arrays)
+
+  def write_file(self, filename, arrays):
+    if filename.endswith('.gz'):
+      import gzip
+      with gzip.open(filename, 'wb', compresslevel=1) as f:
+        self.encoder(f, arrays)
+    else:
+      with open(filename, 'wb') as f:
+        self.encoder(f, arrays)
+
+  def check_error(self):
+    if self.error is not None:
+      error, self.error = self.error, None
+      raise error
+
+  # Stages the current values of the tensors to be written to filename
+  def write(self, filename):
+    from .impl import get_runtime
+    get_runtime().materialize()
+    self.check_error()
+    if self.thread is None:
+      self.start()
+    arrays = self.free.get()
+    for e, a in zip(self.entries, arrays):
+      snode = e.snode().ptr
+      if snode.has_bulk_copy():
+        snode.bulk_copy(a.ctypes.data, True)
+      else:
+        a[...] = e.to_numpy()
+    self.frames.put((filename, arrays))
+
+  # Waits for the staged frames to be written
+  def flush(self):
+    if self.thread is not None:
+      # All sets are free once the writer has returned each of them
+      taken = [self.free.get() for _ in range(self.queue_depth + 1)]
+      for arrays in taken:
+        self.free.put(arrays)
+    self.check_error()
+
+  def close(self):
+    if self.thread is not None:
+      self.frames.put(None)
+      self.thread.join()
+      self.thread = None
+      self.free = queue.Queue()
+    self.check_error()
+
+  def __enter__(self):
+    return self
+
+  def __exit__(self, *args):
+    self.close()
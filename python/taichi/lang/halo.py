@@ -0,0 +1,55 @@
+modes = ['clamp', 'periodic', 'constant']
+
+
+# Makes the kernel filling the halo of a tensor declared with
+# ti.var(..., halo=h) on both sides of an axis, from its interior. The slab it
+# fills spans the halos of the other axes, so that filling the axes in turn
+# fills the edges and corners as well.
+def make_halo_kernel(tensor, axis, mode, value):
+  import taichi as ti
+  assert mode in modes, 'Unknown halo mode {}'.format(mode)
+  shape = tensor.shape()
+  dim = len(shape)
+  h = tensor.halo_width()
+  n = shape[axis]
+  assert h > 0, 'The tensor has no halo'
+  assert mode != 'periodic' or h <= n, 'The halo is wider than the tensor'
+  extents = [2 * h if d == axis else shape[d] + 2 * h for d in range(dim)]
+  # For decoding the flat index into the slab, in row-major order
+  strides = [1] * dim
+  for d in reversed(range(dim - 1)):
+    strides[d] = strides[d + 1] * extents[d + 1]
+  num_cells = strides[0] * extents[0]
+
+  @ti.kernel
+  def fill():
+    for k in range(num_cells):
+      I = ti.Vector.zero(ti.i32, dim)
+      for d in ti.static(range(dim)):
+        I[d] = k // strides[d] % extents[d] - h
+      # [-h, h) along the axis is [-h, 0) and [n, n + h)
+      if I[axis] >= 0:
+        I[axis] += n
+      if ti.static(mode == 'constant'):
+        tensor[I] = value
+      else:
+        J = I
+        if ti.static(mode == 'clamp'):
+          J[axis] = max(min(I[axis], n - 1), 0)
+        else:
+          J[axis] = (I[axis] + n) % n
+        tensor[I] = tensor[J]
+
+  return fill
+
+
+# Fills the whole halo: the nearest interior cells are copied into it with
+# mode 'clamp', the interior cells at the other end with 'periodic', and it
+# is set to value with 'constant'.
+def update_halo(tensor, mode='clamp', value=0):
+  kernels = tensor.halo_kernels
+  for axis in range(tensor.dim()):
+    key = (axis, mode, value)
+    if key not in kernels:
+      kernels[key] = make_halo_kernel(tensor, axis, mode, value)
+    kernels[key]()
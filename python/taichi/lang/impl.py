@@ -38,6 +38,28 @@ def atomic_add(a, b):
   a.atomic_add(wrap_scalar(b))
 
 
+# Atomically replace a with the minimum (maximum) of a and b, or with a bitwise
+# operation of a and b for integers, without returning the old value
+def atomic_min(a, b):
+  a.atomic_op('min', wrap_scalar(b))
+
+
+def atomic_max(a, b):
+  a.atomic_op('max', wrap_scalar(b))
+
+
+def atomic_and(a, b):
+  a.atomic_op('bit_and', wrap_scalar(b))
+
+
+def atomic_or(a, b):
+  a.atomic_op('bit_or', wrap_scalar(b))
+
+
+def atomic_xor(a, b):
+  a.atomic_op('bit_xor', wrap_scalar(b))
+
+
 def subscript(value, *indices):
   import numpy as np
   if isinstance(value, np.ndarray):
@@ -55,6 +77,8 @@ def subscript(value, *indices):
       ind = [indices[i]]
     flattened_indices += ind
   indices = tuple(flattened_indices)
+  from .ensemble import prepend_batch_index
+  indices = prepend_batch_index(value, indices)
   if is_taichi_class(value):
     return value.subscript(*indices)
   else:
@@ -72,8 +96,11 @@ class PyTaichi:
     self.materialized = False
     self.prog = None
     self.layout_functions = []
+    # The roots of the SNode trees added by layouts after materialization
+    self.snode_trees = []
     self.compiled_functions = {}
     self.compiled_grad_functions = {}
+    self.compiled_fused_functions = {}
     self.scope_stack = []
     self.inside_kernel = False
     self.global_vars = []
@@ -84,10 +111,15 @@ class PyTaichi:
     self.inside_complex_kernel = False
     self.kernels = kernels
     self.verbose_kernel_launch = False
+    # Kernel launches are recorded instead, see ti.deferred_launches
+    self.defer_launches = False
+    # Copied from the config of the program, see ti.launch_breakdown
+    self.launch_breakdown = False
     Expr.materialize_layout_callback = self.materialize
     
   def get_num_compiled_functions(self):
-    return len(self.compiled_functions) + len(self.compiled_grad_functions)
+    return len(self.compiled_functions) + len(
+        self.compiled_grad_functions) + len(self.compiled_fused_functions)
   
   def set_verbose_kernel_launch(self, val):
     self.verbose_kernel_launch = val
@@ -116,6 +148,7 @@ class PyTaichi:
       return
     Expr.layout_materialized = True
     self.prog = taichi_lang_core.Program()
+    self.launch_breakdown = self.prog.config.launch_breakdown
 
     def layout():
       for func in self.layout_functions:
@@ -128,6 +161,43 @@ class PyTaichi:
     for var in self.global_vars:
       assert var.ptr.snode() is not None, 'Some variable(s) not placed'
 
+  # Materializes a layout specified after the others on its own: func
+  # places its tensors under ti.root as usual, which stands for the root of
+  # a new SNode tree while it runs. The kernels compiled so far remain valid
+  # (LLVM backends).
+  def extend_layout(self, func):
+    import taichi as ti
+    num_vars = len(self.global_vars)
+    tree = SNode(self.prog.add_snode_tree())
+    roots = [ti.root, root]
+    ptrs = [r.ptr for r in roots]
+    for r in roots:
+      r.ptr = tree.ptr
+    try:
+      func()
+    finally:
+      for r, ptr in zip(roots, ptrs):
+        r.ptr = ptr
+    self.prog.materialize_snode_tree(tree.ptr)
+    self.snode_trees.append(tree)
+    for var in self.global_vars[num_vars:]:
+      assert var.ptr.snode() is not None, 'Some variable(s) not placed'
+
+  # The roots of all SNode trees
+  def snode_roots(self):
+    import taichi as ti
+    return [ti.root] + self.snode_trees
+
+  # Instead of materializing the layout defined in Python
+  def load_aot_module(self, filename):
+    assert not self.materialized, 'The layout is already materialized'
+    Expr.layout_materialized = True
+    self.prog = taichi_lang_core.Program()
+    self.launch_breakdown = self.prog.config.launch_breakdown
+    module = taichi_lang_core.AotModule(filename)
+    self.materialized = True
+    return module
+
   def clear(self):
     if self.prog:
       self.prog.finalize()
@@ -188,17 +258,26 @@ def index_nd(dim):
   return indices(*range(dim))
 
 
-def global_var(dt, shape=None, needs_grad=False):
+def global_var(dt, shape=None, needs_grad=False, halo=0):
+  from .quant import QuantizedType
   if isinstance(shape, numbers.Number):
     shape = (shape,)
+  assert halo == 0 or shape is not None, 'Halos need a shape'
+
+  quant = None
+  if isinstance(dt, QuantizedType):
+    quant = dt
+    dt = quant.compute_type
 
   # primal
   x = Expr(taichi_lang_core.make_id_expr(""))
   x.ptr = taichi_lang_core.global_new(x.ptr, dt)
   x.ptr.set_is_primal(True)
+  if quant is not None:
+    x.ptr.set_quantized(quant.num_bits, quant.signed, quant.scale)
   pytaichi.global_vars.append(x)
 
-  if taichi_lang_core.needs_grad(dt):
+  if taichi_lang_core.needs_grad(dt) and quant is None:
     # adjoint
     x_grad = Expr(taichi_lang_core.make_id_expr(""))
     x_grad.ptr = taichi_lang_core.global_new(x_grad.ptr, dt)
@@ -211,30 +290,71 @@ def global_var(dt, shape=None, needs_grad=False):
     def place():
       import taichi as ti
       dim = len(shape)
-      ti.root.dense(index_nd(dim), shape).place(x)
+      ti.root.dense(index_nd(dim), shape).halo(halo).place(x)
       if needs_grad:
-        ti.root.dense(index_nd(dim), shape).place(x.grad)
+        ti.root.dense(index_nd(dim), shape).halo(halo).place(x.grad)
 
   return x
 
 
+# How the fields of the elements of a tensor are laid out: interleaved (AoS),
+# one tensor per field (SoA), or interleaved in blocks of block elements
+# along each axis, with one block per field (AoSoA)
 class Layout:
 
-  def __init__(self, soa=False):
+  def __init__(self, soa=False, block=0):
+    assert not (soa and block), 'AoSoA layouts are not SoA'
     self.soa = soa
+    self.block = block
+
+  @property
+  def name(self):
+    if self.soa:
+      return 'soa'
+    elif self.block:
+      return 'aosoa%d' % self.block
+    else:
+      return 'aos'
+
+  def __repr__(self):
+    return self.name
+
+  # Places fields (scalar tensors or matrices) in tensors of shape
+  def place(self, shape, *fields):
+    import taichi as ti
+    entries = []
+    for f in fields:
+      entries += f.entries if hasattr(f, 'entries') else [f]
+    indices = index_nd(len(shape))
+    if self.soa:
+      for e in entries:
+        ti.root.dense(indices, shape).place(e)
+    elif self.block:
+      blocks = [(s + self.block - 1) // self.block for s in shape]
+      outer = ti.root.dense(indices, blocks)
+      for e in entries:
+        outer.dense(indices, self.block).place(e)
+    else:
+      ti.root.dense(indices, shape).place(*entries)
 
 
 SOA = Layout(soa=True)
 AOS = Layout(soa=False)
 
+
+def AOSOA(block=8):
+  return Layout(block=block)
+
 var = global_var
 
 root = SNode(taichi_lang_core.get_root())
 
 
 def layout(func):
-  assert not pytaichi.materialized, "All layout must be specified before the first kernel launch / data access."
-  pytaichi.layout_functions.append(func)
+  if pytaichi.materialized:
+    pytaichi.extend_layout(func)
+  else:
+    pytaichi.layout_functions.append(func)
 
 
 def ti_print(var):
@@ -275,6 +395,13 @@ def static(x):
   return x
 
 
+# Whether an inner range-for over [begin, end) is unrolled at compile time
+def can_unroll(begin, end):
+  if not isinstance(begin, int) or not isinstance(end, int):
+    return False
+  return end - begin <= current_cfg().unroll_threshold
+
+
 def grouped(x):
   import taichi as ti
   assert get_runtime().inside_kernel, 'ti.grouped can only be used inside Taichi kernels'
@@ -0,0 +1,47 @@
+import numpy as np
+
+
+# Streams the inputs of a time-stepped computation to the device while the
+# previous ones are computed on, e.g. the frames of a recorded sequence. It
+# holds two device buffers of the given shape and type: kernels take the
+# current one as a ti.ext_arr() argument, without any copy, while push()
+# fills the next one. On GPUs push() copies through pinned memory on a copy
+# stream of its own, overlapping with the kernels, and advance() makes the
+# next buffer current, only ordering the kernels launched after it after the
+# copy:
+#
+#   channel.push(inputs[0])
+#   channel.advance()
+#   for t in range(n):
+#     step(channel)
+#     if t + 1 < n:
+#       channel.push(inputs[t + 1])
+#       channel.advance()
+#
+# Each advance() must follow a push(), and the other way around.
+class InputChannel:
+
+  def __init__(self, shape, dt):
+    from .core import taichi_lang_core
+    from .util import to_numpy_type
+    if isinstance(shape, int):
+      shape = (shape,)
+    self.shape = tuple(shape)
+    self.dtype = np.dtype(to_numpy_type(dt))
+    self.nbytes = int(np.prod(self.shape)) * self.dtype.itemsize
+    self.channel = taichi_lang_core.InputChannel(self.nbytes)
+
+  # Copies the array into the next buffer, returning once it can be reused
+  def push(self, arr):
+    arr = np.ascontiguousarray(arr, dtype=self.dtype)
+    assert arr.shape == self.shape, \
+        'Input of shape {} pushed to a channel of shape {}'.format(
+            arr.shape, self.shape)
+    self.channel.push(int(arr.ctypes.data))
+
+  def advance(self):
+    self.channel.advance()
+
+  # The address of the current buffer
+  def current(self):
+    return self.channel.current()
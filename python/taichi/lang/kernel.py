@@ -1,8 +1,12 @@
 import inspect
+import collections
+import os
+import sys
 from .transformer import ASTTransformer
 import ast
 from .kernel_arguments import *
 from .util import *
+from .input_channel import InputChannel
 
 
 def remove_indent(lines):
@@ -24,6 +28,59 @@ def remove_indent(lines):
   return '\n'.join(cleaned)
 
 
+# Makes every statement of the function body record its source line first,
+# for the IR and the source profiler (ti.cfg.profile_source_lines). Only runs
+# when the kernel is traced.
+# file_id is the expression of the id of the file in the generated code.
+def insert_source_locations(tree, filename, file_id=None):
+  if file_id is None:
+    file_id = taichi_lang_core.register_source_file(filename)
+  for node in ast.walk(tree.body[0]):
+    for field in ['body', 'orelse', 'finalbody']:
+      stmts = getattr(node, field, None)
+      if not isinstance(stmts, list) or not stmts or not isinstance(
+          stmts[0], ast.stmt):
+        continue
+      located = []
+      for stmt in stmts:
+        call = ast.parse('ti.core.set_source_location({}, {})'.format(
+            file_id, stmt.lineno)).body[0]
+        located += [ast.copy_location(call, stmt), stmt]
+      setattr(node, field, located)
+  ast.fix_missing_locations(tree)
+
+
+# The on-disk cache of the preprocessed Python code of kernels, with
+# ti.cfg.use_offline_cache: the transformed AST only depends on the source
+# and the kinds of the arguments, so later runs skip parsing and transforming
+# it, and only trace the cached code into the IR.
+def frontend_cache_file(key):
+  import hashlib
+  from taichi.misc.settings import get_repo_directory
+  return os.path.join(get_repo_directory(), '.tlang_cache', 'python',
+                      hashlib.sha1(key.encode()).hexdigest() + '.bin')
+
+
+def load_frontend_code(key):
+  import marshal
+  try:
+    with open(frontend_cache_file(key), 'rb') as f:
+      return marshal.load(f)
+  except (IOError, EOFError, ValueError, TypeError):
+    return None
+
+
+def store_frontend_code(key, code):
+  import marshal
+  fn = frontend_cache_file(key)
+  os.makedirs(os.path.dirname(fn), exist_ok=True)
+  # Concurrent processes never see a partially written file
+  tmp_fn = '{}.{}.tmp'.format(fn, os.getpid())
+  with open(tmp_fn, 'wb') as f:
+    marshal.dump(code, f)
+  os.replace(tmp_fn, fn)
+
+
 # The ti.func decorator
 def func(foo):
   from .impl import get_runtime
@@ -43,6 +100,7 @@ def func(foo):
     print(astor.to_source(tree.body[0], indent_with='  '))
 
   ast.increment_lineno(tree, inspect.getsourcelines(foo)[1] - 1)
+  insert_source_locations(tree, inspect.getsourcefile(foo))
 
   frame = inspect.currentframe().f_back
   exec(
@@ -62,7 +120,16 @@ class KernelTemplateMapper:
     self.annotations = annotations
     self.num_args = len(annotations)
     self.template_slot_locations = template_slot_locations
-    self.mapping = {}
+    self.mapping = collections.OrderedDict()
+    self.num_instances = 0
+    # Values of constexpr arguments are part of the key, so the number of
+    # instances kept is bounded by the smallest max_variants among them
+    capacities = [
+        a.max_variants for a in annotations if isinstance(a, constexpr)
+    ]
+    self.capacity = min(capacities) if capacities else None
+    # Instances evicted from the mapping, whose compiled functions can go
+    self.evicted = []
 
   def extract(self, args):
     extracted = []
@@ -79,9 +146,14 @@ class KernelTemplateMapper:
           f'{self.num_args} argument(s) needed but {len(args)} provided.')
 
     key = self.extract(args)
-    if key not in self.mapping:
-      count = len(self.mapping)
-      self.mapping[key] = count
+    if key in self.mapping:
+      self.mapping.move_to_end(key)
+    else:
+      self.mapping[key] = self.num_instances
+      self.num_instances += 1
+      if self.capacity is not None and len(self.mapping) > self.capacity:
+        _, instance_id = self.mapping.popitem(last=False)
+        self.evicted.append(instance_id)
     return self.mapping[key]
 
 
@@ -106,11 +178,21 @@ class KernelArgError(Exception):
 class Kernel:
   counter = 0
 
-  def __init__(self, func, is_grad, classkernel=False):
+  def __init__(self, func, is_grad, classkernel=False, keep_primal=False):
     self.func = func
     self.kernel_counter = Kernel.counter
     Kernel.counter += 1
     self.is_grad = is_grad
+    # Runs the primal kernel and its adjoint in a single launch
+    self.keep_primal = keep_primal
+    # Caps the registers per thread on GPUs, see
+    # CompileConfig::gpu_max_registers. Set before the first call.
+    self.max_registers = 0
+    # The precision of the kernel and of its accumulators, see ti.precision
+    self.default_fp = None
+    self.accumulation_fp = None
+    # The ti.Ensemble whose instances the top-level loops run over
+    self.ensemble = None
     self.arguments = []
     self.argument_names = []
     self.classkernel = classkernel
@@ -121,6 +203,13 @@ class Kernel:
         self.template_slot_locations.append(i)
     self.mapper = KernelTemplateMapper(self.arguments,
                                        self.template_slot_locations)
+    # Kernels with only scalar arguments have a single instance, which can be
+    # launched without going through the mapper and func__
+    self.scalar_args_only = all(
+        isinstance(a, taichi_lang_core.DataType) for a in self.arguments)
+    # The arguments of the instances materialized so far, kept across
+    # ti.reset for ti.save_kernel_instances
+    self.recorded_instances = []
     from .impl import get_runtime
     get_runtime().kernels.append(self)
     self.reset()
@@ -128,10 +217,19 @@ class Kernel:
   def reset(self):
     from .impl import get_runtime
     self.runtime = get_runtime()
-    if self.is_grad:
+    if self.keep_primal:
+      self.compiled_functions = self.runtime.compiled_fused_functions
+    elif self.is_grad:
       self.compiled_functions = self.runtime.compiled_functions
     else:
       self.compiled_functions = self.runtime.compiled_grad_functions
+    # Set for kernels with scalar arguments only, once materialized
+    self.launcher = None
+    self.deferred_launcher = None
+    # Argument types that func__ accepted before, which need no checks
+    self.checked_arg_types = set()
+    # The C++ kernel of each instance, see ti.save_aot_module
+    self.taichi_kernels = {}
 
   def extract_arguments(self):
     sig = inspect.signature(self.func)
@@ -165,6 +263,70 @@ class Kernel:
       self.arguments.append(annotation)
       self.argument_names.append(param.name)
 
+  # Identifies the kernel across runs, see ti.precompile
+  def qualified_name(self):
+    suffix = ''
+    if self.keep_primal:
+      suffix = '_fused'
+    elif self.is_grad:
+      suffix = '_grad'
+    return '{}.{}{}'.format(self.func.__module__, self.func.__qualname__,
+                            suffix)
+
+  # The arguments of an instance as JSON values, from which
+  # replay_arguments recreates arguments instantiating it. None if a template
+  # argument other than a constexpr is needed.
+  def record_arguments(self, args):
+    recorded = []
+    for needed, v in zip(self.arguments, args):
+      if isinstance(needed, constexpr):
+        recorded.append(needed.extract(v))
+      elif isinstance(needed, template):
+        return None
+      elif isinstance(needed, ext_arr):
+        dt, dim = needed.extract(v)
+        recorded.append([taichi_lang_core.data_type_name(dt), dim])
+      else:
+        recorded.append(None)
+    return recorded
+
+  def replay_arguments(self, recorded):
+    args = []
+    for needed, r in zip(self.arguments, recorded):
+      if isinstance(needed, constexpr):
+        args.append(r)
+      elif isinstance(needed, ext_arr):
+        dt = getattr(taichi_lang_core.DataType, r[0])
+        args.append(np.zeros((1,) * r[1], dtype=to_numpy_type(dt)))
+      else:
+        args.append(0)
+    return args
+
+  # Materializes the instance for args, returning its key
+  def instantiate(self, args):
+    instance_id = self.mapper.lookup(args)
+    for evicted_id in self.mapper.evicted:
+      self.compiled_functions.pop((self.func, evicted_id), None)
+      self.taichi_kernels.pop((self.func, evicted_id), None)
+    self.mapper.evicted = []
+    key = (self.func, instance_id)
+    self.materialize(key=key, args=args, arg_features=self.mapper.extract(args))
+    return key
+
+  # Everything the preprocessed code of an instance depends on
+  def frontend_cache_key(self, src, filename, first_line, arg_features):
+    kinds = []
+    for i, a in enumerate(self.arguments):
+      if isinstance(a, ext_arr):
+        kinds.append('ext_arr{}'.format(arg_features[i]))
+      else:
+        kinds.append(type(a).__name__)
+    return '\n'.join([
+        taichi_lang_core.get_commit_hash(), sys.version, filename,
+        str(first_line), src,
+        str(self.ensemble is not None)
+    ] + kinds)
+
   def materialize(self, key=None, args=None, arg_features=None):
     if key is None:
       key = (self.func, 0)
@@ -173,47 +335,71 @@ class Kernel:
     if key in self.compiled_functions:
       return
     grad_suffix = ""
-    if self.is_grad:
+    if self.keep_primal:
+      grad_suffix = "_fused"
+    elif self.is_grad:
       grad_suffix = "_grad"
     kernel_name = "{}_c{}_{}_{}".format(self.func.__name__, self.kernel_counter, key[1], grad_suffix)
     import taichi as ti
     ti.info("Compiling kernel {}...".format(kernel_name))
 
     src = remove_indent(inspect.getsource(self.func))
-    tree = ast.parse(src)
-    if self.runtime.print_preprocessed:
-      import astor
-      print('Before preprocessing:')
-      print(astor.to_source(tree.body[0]))
-
-    func_body = tree.body[0]
-    func_body.decorator_list = []
-    
+    filename = inspect.getsourcefile(self.func)
+    first_line = inspect.getsourcelines(self.func)[1]
+    cached = None
+    cache_key = None
+    if ti.cfg.use_offline_cache and not self.runtime.print_preprocessed:
+      cache_key = self.frontend_cache_key(src, filename, first_line,
+                                          arg_features)
+      cached = load_frontend_code(cache_key)
+
     local_vars = {}
     # Discussions: https://github.com/yuanming-hu/taichi/issues/282
     import copy
     global_vars = copy.copy(self.func.__globals__)
-    
-    for i, arg in enumerate(func_body.args.args):
-      anno = arg.annotation
-      if isinstance(anno, ast.Name):
-        global_vars[anno.id] = self.arguments[i]
-      
-    visitor = ASTTransformer(
-        excluded_paremeters=self.template_slot_locations,
-        func=self,
-        arg_features=arg_features)
-
-    visitor.visit(tree)
-    ast.fix_missing_locations(tree)
-    
-    if self.runtime.print_preprocessed:
-      import astor
-      print('After preprocessing:')
-      print(astor.to_source(tree.body[0], indent_with='  '))
-
-    ast.increment_lineno(tree, inspect.getsourcelines(self.func)[1] - 1)
+    global_vars['__ti_source_file__'] = \
+        taichi_lang_core.register_source_file(filename)
+    global_vars['__ti_ensemble__'] = self.ensemble
 
+    if cached is not None:
+      code, annotation_names = cached
+    else:
+      tree = ast.parse(src)
+      if self.runtime.print_preprocessed:
+        import astor
+        print('Before preprocessing:')
+        print(astor.to_source(tree.body[0]))
+
+      func_body = tree.body[0]
+      func_body.decorator_list = []
+      annotation_names = []
+      for arg in func_body.args.args:
+        anno = arg.annotation
+        annotation_names.append(anno.id if isinstance(anno, ast.Name) else None)
+
+      visitor = ASTTransformer(
+          excluded_paremeters=self.template_slot_locations,
+          func=self,
+          arg_features=arg_features,
+          ensemble=self.ensemble is not None)
+
+      visitor.visit(tree)
+      ast.fix_missing_locations(tree)
+
+      if self.runtime.print_preprocessed:
+        import astor
+        print('After preprocessing:')
+        print(astor.to_source(tree.body[0], indent_with='  '))
+
+      ast.increment_lineno(tree, first_line - 1)
+      insert_source_locations(tree, filename, '__ti_source_file__')
+      code = compile(tree, filename=filename, mode='exec')
+      if cache_key is not None:
+        store_frontend_code(cache_key, (code, annotation_names))
+
+    for i, name in enumerate(annotation_names):
+      if name is not None:
+        global_vars[name] = self.arguments[i]
 
     freevar_names = self.func.__code__.co_freevars
     closure = self.func.__closure__
@@ -225,14 +411,21 @@ class Kernel:
     # inject template parameters into globals
     for i in self.template_slot_locations:
       template_var_name = self.argument_names[i]
-      global_vars[template_var_name] = args[i]
+      if isinstance(self.arguments[i], constexpr):
+        global_vars[template_var_name] = self.arguments[i].make_expr(args[i])
+      else:
+        global_vars[template_var_name] = args[i]
 
-    exec(
-        compile(tree, filename=inspect.getsourcefile(self.func), mode='exec'),
-        global_vars, local_vars)
+    exec(code, global_vars, local_vars)
     compiled = local_vars[self.func.__name__]
 
-    taichi_kernel = taichi_lang_core.create_kernel(kernel_name, self.is_grad)
+    taichi_kernel = taichi_lang_core.create_kernel(kernel_name, self.is_grad,
+                                                   self.keep_primal)
+    taichi_kernel.gpu_max_registers = self.max_registers
+    if self.default_fp is not None:
+      taichi_kernel.default_fp = self.default_fp
+    if self.accumulation_fp is not None:
+      taichi_kernel.accumulation_fp = self.accumulation_fp
 
     # Do not change the name of 'taichi_ast_generator'
     # The warning system needs this identifier to remove unnecessary messages
@@ -241,13 +434,32 @@ class Kernel:
         import taichi as ti
         raise ti.TaichiSyntaxError("Kernels cannot call other kernels. I.e., nested kernels are not allowed. Please check if you have direct/indirect invocation of kernels within kernels. Note that some methods provided by the Taichi standard library may invoke kernels, and please move their invocations to Python-scope.")
       self.runtime.inside_kernel = True
-      compiled()
+      # Float literals and the other defaults follow the kernel
+      default_fp = self.runtime.default_fp
+      if self.default_fp is not None:
+        self.runtime.default_fp = self.default_fp
+      try:
+        if self.ensemble is not None:
+          self.ensemble.trace(compiled)
+        else:
+          compiled()
+      finally:
+        self.runtime.default_fp = default_fp
       self.runtime.inside_kernel = False
 
     taichi_kernel = taichi_kernel.define(taichi_ast_generator)
 
     assert key not in self.compiled_functions
     self.compiled_functions[key] = self.get_function_body(taichi_kernel)
+    recorded = self.record_arguments(args) if args is not None else [
+        None
+    ] * len(self.arguments)
+    if recorded is not None and recorded not in self.recorded_instances:
+      self.recorded_instances.append(recorded)
+    self.taichi_kernels[key] = taichi_kernel
+    if self.scalar_args_only:
+      self.launcher = taichi_kernel.launch
+      self.deferred_launcher = taichi_kernel.defer
 
   def get_function_body(self, t_kernel):
     # The actual function body
@@ -266,19 +478,28 @@ class Kernel:
         provided = type(v)
         if isinstance(needed,
                       taichi_lang_core.DataType) and needed in [f32, f64]:
-          if type(v) not in [float, int]:
+          # Including numpy scalars
+          if not isinstance(v, (float, int, np.floating, np.integer)):
             raise KernelArgError(i, needed, provided)
           t_kernel.set_arg_float(actual_argument_slot, float(v))
         elif isinstance(needed,
                         taichi_lang_core.DataType) and needed in [i32, i64]:
-          if type(v) not in [int]:
+          if not isinstance(v, (int, np.integer)):
             raise KernelArgError(i, needed, provided)
           t_kernel.set_arg_int(actual_argument_slot, int(v))
         elif self.match_ext_arr(v, needed):
           dt = to_taichi_type(v.dtype)
           has_torch = has_pytorch()
           is_numpy = isinstance(v, np.ndarray)
-          if is_numpy:
+          if isinstance(v, InputChannel):
+            # The current buffer is bound in place
+            if self.runtime.prog.config.arch == taichi_lang_core.Arch.gpu:
+              t_kernel.set_arg_devptr(actual_argument_slot, v.current(),
+                                      v.nbytes)
+            else:
+              t_kernel.set_arg_nparray(actual_argument_slot, v.current(),
+                                       v.nbytes)
+          elif is_numpy:
             tmp = np.ascontiguousarray(v)
             t_kernel.set_arg_nparray(actual_argument_slot, int(tmp.ctypes.data),
                                      tmp.nbytes)
@@ -290,7 +511,8 @@ class Kernel:
             assert has_torch and isinstance(v, torch.Tensor)
             tmp = v
             taichi_arch = self.runtime.prog.config.arch
-            
+            on_device = False
+
             if str(v.device).startswith('cuda'):
               # External tensor on cuda
               if taichi_arch != taichi_lang_core.Arch.gpu:
@@ -298,14 +520,23 @@ class Kernel:
                 host_v = v.to(device='cpu', copy=True)
                 tmp = host_v
                 callbacks.append(get_call_back(v, host_v))
+              else:
+                # GPU kernels access the tensor in place
+                on_device = True
             else:
               # External tensor on cpu
               if taichi_arch != taichi_lang_core.Arch.x86_64:
                 gpu_v = v.cuda()
                 tmp = gpu_v
                 callbacks.append(get_call_back(v, gpu_v))
-            t_kernel.set_arg_nparray(actual_argument_slot, int(tmp.data_ptr()),
-                                     tmp.element_size() * tmp.nelement())
+                on_device = True
+            nbytes = tmp.element_size() * tmp.nelement()
+            if on_device:
+              t_kernel.set_arg_devptr(actual_argument_slot,
+                                      int(tmp.data_ptr()), nbytes)
+            else:
+              t_kernel.set_arg_nparray(actual_argument_slot,
+                                       int(tmp.data_ptr()), nbytes)
           shape = v.shape
           max_num_indices = taichi_lang_core.get_max_num_indices()
           assert len(
@@ -318,27 +549,48 @@ class Kernel:
           assert False
         actual_argument_slot += 1
       if not self.classkernel and self.runtime.target_tape and not self.runtime.inside_complex_kernel:
-        self.runtime.target_tape.insert(self, args)
-      t_kernel()
+        if self.keep_primal:
+          # Its adjoint is the first one the tape would have run
+          self.runtime.target_tape.close()
+        else:
+          self.runtime.target_tape.insert(self, args)
+      if self.runtime.defer_launches:
+        t_kernel.defer()
+      else:
+        t_kernel()
       for c in callbacks:
         c()
 
     return func__
 
+  # The C++ kernel of the instance for args, e.g. to inspect its compilation
+  def get_taichi_kernel(self, *args):
+    return self.taichi_kernels[self.instantiate(args)]
+
   def match_ext_arr(self, v, needed):
     needs_array = isinstance(needed,
                              np.ndarray) or needed == np.ndarray or isinstance(
                                  needed, ext_arr)
-    has_array = isinstance(v, np.ndarray)
+    has_array = isinstance(v, (np.ndarray, InputChannel))
     if not has_array and has_pytorch():
       has_array = isinstance(v, torch.Tensor)
     return has_array and needs_array
 
   def __call__(self, *args, **kwargs):
     assert len(kwargs) == 0, 'kwargs not supported for Taichi kernels'
-    instance_id = self.mapper.lookup(args)
-    key = (self.func, instance_id)
-    self.materialize(key=key, args=args, arg_features=self.mapper.extract(args))
+    if self.runtime.launch_breakdown:
+      self.runtime.prog.begin_launch_breakdown()
+    if self.launcher is not None and not self.runtime.target_tape and \
+        not self.runtime.verbose_kernel_launch:
+      arg_types = tuple(map(type, args))
+      if arg_types in self.checked_arg_types:
+        if self.runtime.defer_launches:
+          return self.deferred_launcher(*args)
+        return self.launcher(*args)
+      self.compiled_functions[(self.func, 0)](*args)
+      self.checked_arg_types.add(arg_types)
+      return
+    key = self.instantiate(args)
     if self.runtime.verbose_kernel_launch:
       import taichi as ti
       ti.debug('Launching kernel {}...'.format(self.func.__name__))
@@ -348,8 +600,31 @@ class Kernel:
 def kernel(foo):
   ret = Kernel(foo, False)
   ret.grad = Kernel(foo, True)
+  ret.forward_and_grad = Kernel(foo, True, keep_primal=True)
   return ret
 
+
+# Overrides the default float type (ti.cfg.default_fp) for a kernel and its
+# gradients: float literals, ti.random(), float() and the divisions of
+# integers are default_fp in it. With accumulation_fp, the local
+# accumulators of narrower floats (the variables that += and -= go to, and
+# the per-iteration sums of the atomic adds to a tensor) are widened to it,
+# e.g. f32 compute with f64 accumulation. Apply it to a ti.kernel before its
+# first call:
+#
+#   @ti.precision(ti.f32, accumulation_fp=ti.f64)
+#   @ti.kernel
+#   def diagnostics(): ...
+def precision(default_fp=None, accumulation_fp=None):
+
+  def decorator(kernel):
+    for k in [kernel, kernel.grad, kernel.forward_and_grad]:
+      k.default_fp = default_fp
+      k.accumulation_fp = accumulation_fp
+    return kernel
+
+  return decorator
+
 class DifferentiableMethod:
   def __init__(self, func):
     self.func = func
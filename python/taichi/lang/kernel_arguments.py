@@ -29,6 +29,45 @@ class Template:
 template = Template
 
 
+class Constexpr(Template):
+  """
+  A scalar argument whose value is compiled into the kernel as a constant.
+  One variant is compiled per distinct value, and only the variants of the
+  max_variants most recent values are kept.
+  """
+
+  def __init__(self, dt, max_variants=16):
+    super().__init__()
+    assert dt in [i32, i64, f32, f64], 'constexpr arguments must be scalars'
+    assert max_variants > 0
+    self.dt = dt
+    self.max_variants = max_variants
+
+  def extract(self, x):
+    if self.dt in [f32, f64]:
+      assert type(x) in [float, int], \
+          'constexpr argument of type {} needs a number'.format(self.dt)
+      return float(x)
+    else:
+      assert type(x) is int, \
+          'constexpr argument of type {} needs an int'.format(self.dt)
+      return x
+
+  def make_expr(self, x):
+    x = self.extract(x)
+    if self.dt == i32:
+      return Expr(taichi_lang_core.make_const_expr_i32(x))
+    elif self.dt == i64:
+      return Expr(taichi_lang_core.make_const_expr_i64(x))
+    elif self.dt == f32:
+      return Expr(taichi_lang_core.make_const_expr_f32(x))
+    else:
+      return Expr(taichi_lang_core.make_const_expr_f64(x))
+
+
+constexpr = Constexpr
+
+
 def decl_scalar_arg(dt):
   id = taichi_lang_core.decl_arg(dt, False)
   return Expr(taichi_lang_core.make_arg_load_expr(id))
@@ -0,0 +1,249 @@
+import hashlib
+import inspect
+import json
+import os
+import time
+from . import impl
+from .impl import AOS, SOA, AOSOA
+
+
+def default_candidates():
+  return [SOA, AOS, AOSOA(8)]
+
+
+def default_cache_file():
+  from taichi.misc.settings import get_repo_directory
+  return os.path.join(get_repo_directory(), '.tlang_cache', 'layouts.json')
+
+
+def program_hash(build, candidates):
+  import taichi as ti
+  source = inspect.getsource(build)
+  key = '\n'.join([source, str(ti.cfg.arch)] + [str(c) for c in candidates])
+  return hashlib.sha1(key.encode()).hexdigest()
+
+
+def load_choices(cache_file):
+  try:
+    with open(cache_file) as f:
+      return json.load(f)
+  except (IOError, ValueError):
+    return {}
+
+
+def store_choice(cache_file, key, name):
+  choices = load_choices(cache_file)
+  choices[key] = name
+  os.makedirs(os.path.dirname(cache_file), exist_ok=True)
+  with open(cache_file, 'w') as f:
+    json.dump(choices, f, indent=2)
+
+
+# Do the kernels of the window access more than one of the ids together?
+def fields_accessed_together(ids):
+  ids = set(ids)
+  for read, written in impl.get_runtime().prog.get_kernel_accesses():
+    if len(ids & (set(read) | set(written))) > 1:
+      return True
+  return False
+
+
+# Remembers the fields placed, to find their places in the kernel accesses
+class LayoutRecorder:
+
+  def __init__(self, layout):
+    self.layout = layout
+    self.entries = []
+
+  def __getattr__(self, attr):
+    return getattr(self.layout, attr)
+
+  def place(self, shape, *fields):
+    self.layout.place(shape, *fields)
+    for f in fields:
+      self.entries += f.entries if hasattr(f, 'entries') else [f]
+
+
+def reset_keeping_arch():
+  import taichi as ti
+  arch = ti.cfg.arch
+  ti.reset()
+  ti.cfg.arch = arch
+
+
+# Seconds per step, after warmup steps
+def time_steps(step, num_steps, warmup):
+  import taichi as ti
+  for i in range(warmup):
+    step()
+  ti.sync()
+  t = time.perf_counter()
+  for i in range(num_steps):
+    step()
+  ti.sync()
+  return (time.perf_counter() - t) / max(num_steps, 1)
+
+
+def run_candidate(build, layout, num_steps, warmup):
+  reset_keeping_arch()
+  recorder = LayoutRecorder(layout)
+  step = build(recorder)
+  elapsed = time_steps(step, num_steps, warmup)
+  ids = [e.snode().ptr.id for e in recorder.entries]
+  return step, elapsed, ids
+
+
+# Picks the layout under which step runs fastest. build(layout) declares the
+# tensors of the program, placing the fields in question with
+# layout.place(shape, *fields), and returns a function running one step of the
+# program (the profiling window). Each candidate is built after ti.reset()
+# (keeping ti.cfg.arch) and timed over num_steps steps after warmup steps.
+# When no kernel accesses two of the fields together, interleaving only
+# fetches unused bytes, so SoA is chosen without timing the others. The
+# choice is remembered per build function, arch and candidates in
+# cache_file. Returns the layout and the step function, built with it.
+def tune_layout(build,
+                candidates=None,
+                num_steps=10,
+                warmup=1,
+                cache=True,
+                cache_file=None,
+                verbose=False):
+  import taichi as ti
+  if candidates is None:
+    candidates = default_candidates()
+  assert len(candidates) > 0
+  if cache_file is None:
+    cache_file = default_cache_file()
+  key = program_hash(build, [c.name for c in candidates])
+  if cache:
+    name = load_choices(cache_file).get(key)
+    chosen = [c for c in candidates if c.name == name]
+    if chosen:
+      step, _, _ = run_candidate(build, chosen[0], 0, 0)
+      return chosen[0], step
+
+  times = {}
+  # SoA first, since its kernels tell whether the others could win
+  ordered = sorted(candidates, key=lambda c: not c.soa)
+  for layout in ordered:
+    step, elapsed, ids = run_candidate(build, layout, num_steps, warmup)
+    times[layout.name] = elapsed
+    last = layout
+    if layout.soa and not fields_accessed_together(ids):
+      break
+  best = min((c for c in ordered if c.name in times),
+             key=lambda c: times[c.name])
+  if verbose:
+    for name, t in times.items():
+      ti.info('Layout {}: {:.3f} ms per step'.format(name, t * 1000))
+    ti.info('Chose layout {}'.format(best.name))
+  if cache:
+    store_choice(cache_file, key, best.name)
+  if best is not last:
+    step, _, _ = run_candidate(build, best, 0, 0)
+  return best, step
+
+
+# The nodes whose children are all places: the blocks struct-fors visit
+def leaf_blocks(snode):
+  children = [snode.get_ch(i) for i in range(snode.get_num_ch())]
+  if children and all(c.is_place() for c in children):
+    return [snode]
+  return [b for c in children for b in leaf_blocks(c)]
+
+
+# Times num_steps steps, then profiles num_steps more task by task, for the
+# time going to list generation, and counts the cells of the leaf blocks
+# listed for struct-fors and allocated
+def measure_config(build, config, num_steps, warmup):
+  import taichi as ti
+  reset_keeping_arch()
+  step = build(**config)
+  elapsed = time_steps(step, num_steps, warmup)
+  blocks = leaf_blocks(impl.root.ptr)
+  steps = max(num_steps, 1)
+  before = ti.runtime_counters()
+  ti.core.current_compile_config().enable_profiler = True
+  ti.profiler_clear()
+  for i in range(num_steps):
+    step()
+  ti.sync()
+  records = ti.profiler_records()
+  ti.core.current_compile_config().enable_profiler = False
+  after = ti.runtime_counters()
+  listgen = sum(total for name, (count, total) in records.items()
+                if name.endswith(('_listgen', '_clear_list')))
+  listed = 0
+  allocated = 0
+  for b in blocks:
+    key = 'list_elements:{}'.format(b.id)
+    listed += (after.get(key, 0) - before.get(key, 0)) * b.max_num_elements()
+    if b.parent is not None:
+      key = 'allocated_nodes:{}'.format(b.parent.id)
+      allocated += after.get(key, 0) * b.max_num_elements()
+  return step, {
+      'config': config,
+      'time': elapsed,
+      'listgen_time': listgen / 1000 / steps,
+      'cells_listed': listed // steps,
+      'cells_allocated': allocated,
+  }
+
+
+# Picks the values of the free parameters of a layout, e.g. the leaf block
+# size of a sparse grid, under which step runs fastest. space maps each
+# parameter to its candidate values, and build(**config) declares the
+# tensors with the values of one config and returns a function running one
+# step of the program, whose kernels should activate the cells of a typical
+# occupancy. Each config is built after ti.reset() (keeping ti.cfg.arch) and
+# timed over num_steps steps after warmup steps. Larger blocks need fewer
+# list elements but visit more inactive cells, which the report tells apart:
+# for each config, the seconds per step, the seconds of list generation per
+# step (profiled separately), the cells of the leaf blocks listed for
+# struct-fors per step (none while the lists are reused since the structure
+# did not change), and the cells of the leaf blocks allocated under pointers
+# and dynamic nodes. The choice is remembered like in tune_layout. Returns the
+# config, the step function built with it, and the report (None if cached).
+def tune_parameters(build,
+                    space,
+                    num_steps=10,
+                    warmup=1,
+                    cache=True,
+                    cache_file=None,
+                    verbose=False):
+  import itertools
+  import taichi as ti
+  names = sorted(space)
+  configs = [
+      dict(zip(names, values))
+      for values in itertools.product(*(space[n] for n in names))
+  ]
+  assert len(configs) > 0
+  if cache_file is None:
+    cache_file = default_cache_file()
+  key = program_hash(build, [json.dumps(c, sort_keys=True) for c in configs])
+  if cache:
+    chosen = load_choices(cache_file).get(key)
+    if chosen in configs:
+      step, _ = measure_config(build, chosen, 0, 0)
+      return chosen, step, None
+
+  report = []
+  for config in configs:
+    step, stats = measure_config(build, config, num_steps, warmup)
+    report.append(stats)
+    last = config
+  best = min(report, key=lambda r: r['time'])['config']
+  if verbose:
+    for r in report:
+      ti.info('{}: {:.3f} ms per step, {:.3f} ms listgen, {} cells listed, '
+              '{} allocated'.format(r['config'], r['time'] * 1000,
+                                    r['listgen_time'] * 1000,
+                                    r['cells_listed'], r['cells_allocated']))
+    ti.info('Chose {}'.format(best))
+  if cache:
+    store_choice(cache_file, key, best)
+  if best is not last:
+    step, _ = measure_config(build, best, 0, 0)
+  return best, step, report
@@ -9,9 +9,12 @@ def polar_decompose2d(a, dt):
   r = ti.Matrix([[c, -s], [s, c]])
   return r, ti.Matrix.transposed(r) @ a
 
+def polar_decompose3d(A, dt, svd_method='jacobi'):
+  U, sig, V = svd(A, dt, svd_method)
+  return polar_from_svd(U, sig, V)
+
 @ti.func
-def polar_decompose3d(A, dt):
-  U, sig, V = ti.svd(A, dt)
+def polar_from_svd(U, sig, V):
   return U @ ti.transposed(V), V @ sig @ ti.transposed(V)
 
 # https://www.seas.upenn.edu/~cffjiang/research/svd/svd.pdf
@@ -74,22 +77,273 @@ def svd3d(A, dt, iters=None):
     sigma(i, i).assign(sig_entries[i])
   return U, sigma, V
 
+# The unit vectors u and v making (w, u, v) a right-handed orthonormal basis,
+# for a unit vector w
 @ti.func
-def svd(A, dt):
-  if ti.static(A.n == 2):
-    ret = svd2d(A, dt)
-    return ret
-  elif ti.static(A.n == 3):
-    return svd3d(A, dt)
+def orthogonal_complement(w, dt):
+  u = ti.Vector.zero(dt, 3)
+  if abs(w[0]) > abs(w[1]):
+    inv_length = 1 / ti.sqrt(w[0] * w[0] + w[2] * w[2])
+    u = ti.Vector([-w[2] * inv_length, ti.cast(0, dt), w[0] * inv_length])
   else:
-    raise Exception("SVD only supports 2D and 3D matrices.")
-  
+    inv_length = 1 / ti.sqrt(w[1] * w[1] + w[2] * w[2])
+    u = ti.Vector([ti.cast(0, dt), w[2] * inv_length, -w[1] * inv_length])
+  return u, ti.cross(w, u)
+
+# A unit eigenvector of the symmetric B for its simple eigenvalue e: the
+# longest cross product of two rows of B - e I
+@ti.func
+def sym_eig3x3_simple_vector(B, e, dt):
+  r0 = ti.Vector([B(0, 0) - e, B(0, 1), B(0, 2)])
+  r1 = ti.Vector([B(1, 0), B(1, 1) - e, B(1, 2)])
+  r2 = ti.Vector([B(2, 0), B(2, 1), B(2, 2) - e])
+  c01 = ti.cross(r0, r1)
+  c02 = ti.cross(r0, r2)
+  c12 = ti.cross(r1, r2)
+  v = c01
+  d = c01.norm_sqr()
+  if c02.norm_sqr() > d:
+    v = c02
+    d = c02.norm_sqr()
+  if c12.norm_sqr() > d:
+    v = c12
+    d = c12.norm_sqr()
+  return v * (1 / ti.sqrt(d))
+
+# A unit eigenvector of the symmetric B for its eigenvalue e, orthogonal to
+# the unit eigenvector w of another eigenvalue: the null vector of B - e I
+# restricted to the plane orthogonal to w
 @ti.func
-def polar_decompose(A, dt):
-  if ti.static(A.n == 2):
-    ret = polar_decompose2d(A, dt)
-    return ret
-  elif ti.static(A.n == 3):
-    return polar_decompose3d(A, dt)
+def sym_eig3x3_second_vector(B, w, e, dt):
+  u, v = orthogonal_complement(w, dt)
+  Bu = B @ u
+  Bv = B @ v
+  m00 = u.dot(Bu) - e
+  m01 = u.dot(Bv)
+  m11 = v.dot(Bv) - e
+  ret = u
+  if abs(m00) >= abs(m11):
+    if ti.max(abs(m00), abs(m01)) > 0:
+      if abs(m00) >= abs(m01):
+        t = m01 / m00
+        c = 1 / ti.sqrt(1 + t * t)
+        ret = (t * c) * u - c * v
+      else:
+        t = m00 / m01
+        c = 1 / ti.sqrt(1 + t * t)
+        ret = c * u - (t * c) * v
+  else:
+    if ti.max(abs(m11), abs(m01)) > 0:
+      if abs(m11) >= abs(m01):
+        t = m01 / m11
+        c = 1 / ti.sqrt(1 + t * t)
+        ret = c * u - (t * c) * v
+      else:
+        t = m11 / m01
+        c = 1 / ti.sqrt(1 + t * t)
+        ret = (t * c) * u - c * v
+  return ret
+
+# Eigenvalues and eigenvectors of a symmetric 3x3 matrix in closed form,
+# from the trigonometric solution of the characteristic polynomial (D.
+# Eberly, A Robust Eigensolver for 3x3 Symmetric Matrices). Returns the
+# eigenvalues in descending order as a vector, and a rotation whose columns
+# are the eigenvectors.
+@ti.func
+def sym_eig3x3(A, dt):
+  # Scaled into [-1, 1] and shifted by the mean eigenvalue q, so that close
+  # eigenvalues keep their precision
+  scale = ti.cast(1e-30, dt)
+  for i in ti.static(range(3)):
+    for j in ti.static(range(3)):
+      scale = ti.max(scale, abs(A(i, j)))
+  C = A * (1 / scale)
+  q = (C(0, 0) + C(1, 1) + C(2, 2)) / 3
+  B = ti.Matrix([[C(0, 0) - q, C(0, 1), C(0, 2)],
+                 [C(1, 0), C(1, 1) - q, C(1, 2)],
+                 [C(2, 0), C(2, 1), C(2, 2) - q]])
+  p2 = B(0, 0) * B(0, 0) + B(1, 1) * B(1, 1) + B(2, 2) * B(2, 2) + 2 * (
+      B(0, 1) * B(0, 1) + B(0, 2) * B(0, 2) + B(1, 2) * B(1, 2))
+  eigenvalues = ti.Vector([q, q, q])
+  Q = ti.Matrix.identity(dt, 3)
+  if p2 > 0:
+    p = ti.sqrt(p2 / 6)
+    B = B * (1 / p)
+    # The eigenvalues of B are 2 cos(phi + 2 k pi / 3)
+    half_det = ti.max(ti.min(ti.determinant(B) * 0.5, 1), -1)
+    phi = ti.acos(half_det) / 3
+    e_max = 2 * ti.cos(phi)
+    e_min = 2 * ti.cos(phi + ti.cast(2.0943951023931957, dt))
+    e_mid = -e_max - e_min
+    v_max = ti.Vector.zero(dt, 3)
+    v_mid = ti.Vector.zero(dt, 3)
+    v_min = ti.Vector.zero(dt, 3)
+    # The eigenvector of the eigenvalue farthest from the others first
+    if half_det >= 0:
+      v_max = sym_eig3x3_simple_vector(B, e_max, dt)
+      v_mid = sym_eig3x3_second_vector(B, v_max, e_mid, dt)
+      v_min = ti.cross(v_max, v_mid)
+    else:
+      v_min = sym_eig3x3_simple_vector(B, e_min, dt)
+      v_mid = sym_eig3x3_second_vector(B, v_min, e_mid, dt)
+      v_max = ti.cross(v_mid, v_min)
+    eigenvalues = ti.Vector([q + p * e_max, q + p * e_mid, q + p * e_min])
+    Q = ti.Matrix([[v_max[0], v_mid[0], v_min[0]],
+                   [v_max[1], v_mid[1], v_min[1]],
+                   [v_max[2], v_mid[2], v_min[2]]])
+  return eigenvalues * scale, Q
+
+# SVD through the eigenvectors V of A^T A, in closed form. Singular values
+# below about sqrt(machine epsilon) times the largest lose their relative
+# precision, which the Jacobi sweeps keep. Same conventions as svd3d: U and
+# V are rotations and the last singular value takes the sign of det(A).
+@ti.func
+def svd3d_eig(A, dt):
+  lam, V = sym_eig3x3(ti.transposed(A) @ A, dt)
+  AV = A @ V
+  b0 = ti.Vector([AV(0, 0), AV(1, 0), AV(2, 0)])
+  b1 = ti.Vector([AV(0, 1), AV(1, 1), AV(2, 1)])
+  b2 = ti.Vector([AV(0, 2), AV(1, 2), AV(2, 2)])
+  u0 = ti.Vector([ti.cast(1, dt), ti.cast(0, dt), ti.cast(0, dt)])
+  n0 = b0.norm_sqr()
+  if n0 > ti.cast(1e-30, dt):
+    u0 = b0 * (1 / ti.sqrt(n0))
+  u1, w = orthogonal_complement(u0, dt)
+  # Orthogonalized against u0, for the precision of small singular values
+  c1 = b1 - u0.dot(b1) * u0
+  n1 = c1.norm_sqr()
+  if n1 > n0 * ti.cast(1e-24, dt):
+    u1 = c1 * (1 / ti.sqrt(n1))
+  u2 = ti.cross(u0, u1)
+  U = ti.Matrix([[u0[0], u1[0], u2[0]], [u0[1], u1[1], u2[1]],
+                 [u0[2], u1[2], u2[2]]])
+  zero = ti.cast(0, dt)
+  sigma = ti.Matrix([[u0.dot(b0), zero, zero], [zero, u1.dot(b1), zero],
+                     [zero, zero, u2.dot(b2)]])
+  return U, sigma, V
+
+# Polar decomposition A = R S by the scaled Newton iteration of N. Higham,
+# R <- (g R + R^-T / g) / 2, which converges quadratically for non-singular
+# A. Stops after iters steps or once the step is at most tol relative to R.
+# R is a rotation if det(A) > 0.
+@ti.func
+def polar_decompose3d_newton(A, dt, iters, tol):
+  R = A
+  i = 0
+  while i < iters:
+    R_inv = R.inverse()
+    # Brings the singular values of R close to 1 (Frobenius scaling)
+    g = ti.sqrt(ti.sqrt(R_inv.norm_sqr() / R.norm_sqr()))
+    R_next = 0.5 * (g * R + ti.transposed(R_inv) * (1 / g))
+    step = (R_next - R).norm_sqr()
+    R = R_next
+    i += 1
+    if step <= tol * tol * R.norm_sqr():
+      break
+  S = ti.transposed(R) @ A
+  return R, 0.5 * (S + ti.transposed(S))
+
+svd_methods = ['jacobi', 'eig']
+polar_methods = ['svd', 'newton']
+
+# method 'jacobi' (for 3x3) is svd3d, taking iters Jacobi sweeps; 'eig' is
+# the closed-form svd3d_eig, which compiles to a fraction of the statements
+# but loses precision on singular values much smaller than the largest.
+def svd(A, dt, method='jacobi', iters=None):
+  assert method in svd_methods, 'Unknown SVD method {}'.format(method)
+  if A.n == 2:
+    return svd2d(A, dt)
+  elif A.n == 3:
+    if method == 'eig':
+      return svd3d_eig(A, dt)
+    return svd3d(A, dt, iters)
+  else:
+    raise Exception("SVD only supports 2D and 3D matrices.")
+
+# method 'svd' (for 3x3) goes through svd(A, dt, svd_method); 'newton' is
+# polar_decompose3d_newton, taking at most iters steps (default 8) until
+# a relative step of tol (default 1e-6 for f32 and 1e-12 for f64)
+def polar_decompose(A, dt, method='svd', iters=None, tol=None,
+                    svd_method='jacobi'):
+  assert method in polar_methods, \
+      'Unknown polar decomposition method {}'.format(method)
+  if A.n == 2:
+    return polar_decompose2d(A, dt)
+  elif A.n == 3:
+    if method == 'newton':
+      if iters is None:
+        iters = 8
+      if tol is None:
+        tol = 1e-6 if dt == ti.f32 else 1e-12
+      return polar_decompose3d_newton(A, dt, iters, tol)
+    return polar_decompose3d(A, dt, svd_method)
   else:
     raise Exception("Polar decomposition only supports 2D and 3D matrices.")
+
+solve_methods = ['lu', 'cholesky']
+
+def dense_solve_core(name, dt):
+  assert dt in [ti.f32, ti.f64]
+  return getattr(ti.core, name + ('_f32' if dt == ti.f32 else '_f64'))
+
+def dense_solve_entries(A):
+  from .expr import Expr
+  return [Expr(e).ptr for e in A.entries]
+
+def dense_solve_matrix(entries, n, m, dt):
+  ret = ti.expr_init(ti.Matrix.zero(dt, n, m))
+  for i in range(n):
+    for j in range(m):
+      ret(i, j).assign(entries[i * m + j])
+  return ret
+
+def check_square(A, max_size=16):
+  assert A.n == A.m, 'The matrix is not square'
+  assert A.n <= max_size, \
+      'Dense solves are for small matrices, up to {0}x{0}'.format(max_size)
+
+# Solves A x = b for square A of up to 16x16, b being a vector or a matrix
+# of as many rows (one system per column), with straight-line code emitted
+# by the compiler. Method 'lu' is Gaussian elimination, with partial
+# pivoting unless pivoting=False (about half the statements, for diagonally
+# dominant A); 'cholesky' is for symmetric positive definite A.
+def solve(A, b, dt, method='lu', pivoting=True):
+  assert method in solve_methods, 'Unknown solve method {}'.format(method)
+  check_square(A)
+  assert b.n == A.n, 'The right-hand side has {} rows instead of {}'.format(
+      b.n, A.n)
+  if method == 'cholesky':
+    return cholesky_solve(cholesky(A, dt), b, dt)
+  x = dense_solve_core('dense_lu_solve', dt)(dense_solve_entries(A),
+                                             dense_solve_entries(b), A.n,
+                                             pivoting)
+  return dense_solve_matrix(x, b.n, b.m, dt)
+
+# The lower triangular L with A = L L^T, for symmetric positive definite A
+def cholesky(A, dt):
+  check_square(A)
+  L = dense_solve_core('dense_cholesky', dt)(dense_solve_entries(A), A.n)
+  return dense_solve_matrix(L, A.n, A.n, dt)
+
+# Solves L L^T x = b, given the factor from cholesky, e.g. for reusing it
+def cholesky_solve(L, b, dt):
+  check_square(L)
+  assert b.n == L.n
+  x = dense_solve_core('dense_cholesky_solve', dt)(dense_solve_entries(L),
+                                                   dense_solve_entries(b),
+                                                   L.n)
+  return dense_solve_matrix(x, b.n, b.m, dt)
+
+# A @ B as a single statement of the IR, expanded late in the compilation.
+# With ti.cfg.use_tensor_cores, products of A of 16x16 or 32x32 (or 16x32,
+# 32x16) the same in all threads of a warp, e.g. the weights of a layer read
+# from a tensor at indices that do not depend on the loop index, by B of at
+# least two columns go to the tensor cores, which round the inputs to f16
+# and accumulate in f32. Used by Matrix.__matmul__. See taichi/matmul.h
+def matmul(A, B):
+  from .expr import Expr
+  entries = ti.core.matmul(dense_solve_entries(A), dense_solve_entries(B),
+                           A.n, A.m, B.m)
+  return ti.expr_init(
+      ti.Matrix([[Expr(entries[i * B.m + j]) for j in range(B.m)]
+                 for i in range(A.n)]))
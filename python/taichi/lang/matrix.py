@@ -77,20 +77,10 @@ class Matrix:
 
       @ti.layout
       def place():
-        dim = len(shape)
-        if layout.soa:
-          for i, e in enumerate(self.entries):
-            ti.root.dense(ti.index_nd(dim), shape).place(e)
-            if needs_grad:
-              ti.root.dense(ti.index_nd(dim), shape).place(e.grad)
-        else:
-          var_list = []
-          for i, e in enumerate(self.entries):
-            var_list.append(e)
-          if needs_grad:
-            for i, e in enumerate(self.entries):
-              var_list.append(e.grad)
-          ti.root.dense(ti.index_nd(dim), shape).place(*tuple(var_list))
+        var_list = list(self.entries)
+        if needs_grad:
+          var_list += [e.grad for e in self.entries]
+        layout.place(shape, *var_list)
 
   def is_global(self):
     results = [False for _ in self.entries]
@@ -113,6 +103,9 @@ class Matrix:
 
   def __matmul__(self, other):
     assert self.m == other.n
+    if impl.inside_kernel() and impl.taichi_lang_core.matmul_applicable():
+      from .linalg import matmul
+      return matmul(self, other)
     ret = Matrix(self.n, other.m)
     for i in range(self.n):
       for j in range(other.m):
@@ -429,6 +422,11 @@ class Matrix:
     for i in range(len(self.entries)):
       self.entries[i].atomic_add(other.entries[i])
 
+  def atomic_op(self, op, other):
+    assert self.n == other.n and self.m == other.m
+    for i in range(len(self.entries)):
+      self.entries[i].atomic_op(op, other.entries[i])
+
   def make_grad(self):
     ret = Matrix(self.n, self.m, empty=True)
     for i in range(len(ret.entries)):
@@ -7,6 +7,13 @@ def fill_tensor(tensor: ti.template(), val: ti.template()):
   for I in ti.grouped(tensor):
     tensor[I] = val
 
+# Sets the values of the active cells at most threshold in magnitude to zero
+@ti.kernel
+def snap_to_zero(tensor: ti.template(), threshold: ti.f32):
+  for I in ti.grouped(tensor):
+    if abs(tensor[I]) <= threshold:
+      tensor[I] = 0
+
 @ti.kernel
 def tensor_to_ext_arr(tensor: ti.template(), arr: ti.ext_arr()):
   for I in ti.grouped(tensor):
@@ -37,6 +44,23 @@ def ext_arr_to_matrix(arr: ti.ext_arr(), mat: ti.template(), as_vector: ti.templ
         else:
           mat[I][p, q] = arr[I, p, q]
 
+# Write the f32 RGBA pixels of GUI images: scalars are gray (alpha included,
+# like one-channel numpy images), and vectors of 3 values get an alpha of 0
+@ti.kernel
+def tensor_to_image(tensor: ti.template(), arr: ti.ext_arr()):
+  for I in ti.grouped(tensor):
+    t = ti.cast(tensor[I], ti.f32)
+    for c in ti.static(range(4)):
+      arr[I, c] = t
+
+@ti.kernel
+def vector_to_image(mat: ti.template(), arr: ti.ext_arr()):
+  for I in ti.grouped(mat):
+    for p in ti.static(range(mat.n)):
+      arr[I, p] = ti.cast(mat[I][p], ti.f32)
+    if ti.static(mat.n == 3):
+      arr[I, 3] = 0
+
 @ti.kernel
 def clear_gradients(vars: ti.template()):
   for I in ti.grouped(ti.Expr(vars[0])):
@@ -49,3 +73,25 @@ def fill_matrix(mat: ti.template(), vals: ti.template()):
     for p in ti.static(range(mat.n)):
       for q in ti.static(range(mat.m)):
         mat[I][p, q] = vals[p][q]
+
+# Copy slot src_slot of src into slot dst_slot of dst, along their first axis
+@ti.kernel
+def copy_slot(dst: ti.template(), dst_slot: ti.i32, src: ti.template(),
+              src_slot: ti.i32):
+  for I in ti.grouped(src):
+    if I[0] == src_slot:
+      if ti.static(src.dim() == 1):
+        dst[dst_slot] = src[I]
+      if ti.static(src.dim() == 2):
+        dst[dst_slot, I[1]] = src[I]
+      if ti.static(src.dim() == 3):
+        dst[dst_slot, I[1], I[2]] = src[I]
+      if ti.static(src.dim() == 4):
+        dst[dst_slot, I[1], I[2], I[3]] = src[I]
+
+@ti.kernel
+def zero_slots(tensor: ti.template(), begin: ti.i32, end: ti.i32):
+  for I in ti.grouped(tensor):
+    if I[0] >= begin:
+      if I[0] < end:
+        tensor[I] = 0
@@ -0,0 +1,359 @@
+from . import impl
+
+smoothers = ['rbgs', 'jacobi']
+
+
+# The sum of the 2 * dim neighbors of I in f. Cells outside the grid count
+# as zero: through the halo on dense grids, and by a bounds check on sparse
+# ones, where the inactive blocks read as zero too.
+def make_neighbor_sum(f, n, dim, dt, sparse):
+  import taichi as ti
+
+  @ti.func
+  def neighbor_sum(I):
+    s = ti.cast(0, dt)
+    for d in ti.static(range(dim)):
+      for o in ti.static((-1, 1)):
+        J = I
+        J[d] += o
+        if ti.static(not sparse):
+          s += f[J]
+        else:
+          if J[d] >= 0 and J[d] < n:
+            s += f[J]
+    return s
+
+  return neighbor_sum
+
+
+# Multigrid-preconditioned conjugate gradients for Poisson problems,
+# -laplace(x) = b on a grid of n^dim cells with unit spacing and x = 0
+# outside. Create it before the layout is materialized, since it declares
+# its own tensors: dense ones with a halo of one cell, or with sparse=True,
+# pointer blocks of block_size^dim cells, where the cells of the active
+# blocks of b form the domain. Write b (which solve() overwrites with the
+# residual) and read the solution from x.
+#
+# The preconditioner is a V-cycle over levels grids (by default, down to
+# about 4 cells along each axis), with pre_and_post_smoothing sweeps on the
+# finest one, twice that on each coarser one, and bottom_smoothing on the
+# coarsest. The smoother is red-black Gauss-Seidel ('rbgs'), or damped
+# Jacobi ('jacobi', with jacobi_weight), whose sweeps read and write
+# different tensors. Residuals are restricted by summing the children, and
+# corrections prolongated by injection.
+#
+# Passes are fused where the data dependencies allow: the first sweep of
+# each level starts from zero without reading z, the stencil of A p
+# accumulates p.Ap, and the update of x and r accumulates r.r. The dot
+# products are atomic adds to 0-D tensors, which the compiler combines
+# before they reach memory, and stencils cache their inputs in GPU shared
+# memory with ti.cache_shared. alpha and beta are computed in the kernels,
+# so the host only reads r.r once per iteration.
+class MGPCG:
+
+  def __init__(self,
+               dim,
+               n,
+               levels=None,
+               sparse=False,
+               block_size=8,
+               dt=None,
+               smoother='rbgs',
+               pre_and_post_smoothing=2,
+               bottom_smoothing=50,
+               jacobi_weight=2 / 3):
+    import taichi as ti
+    assert smoother in smoothers, 'Unknown smoother {}'.format(smoother)
+    if dt is None:
+      dt = impl.get_runtime().default_fp
+    if levels is None:
+      levels = 1
+      while (n >> levels) >= 4 and n % (1 << levels) == 0:
+        levels += 1
+    assert n % (1 << (levels - 1)) == 0, \
+        'n must be divisible by 2^(levels - 1)'
+    self.dim = dim
+    self.n = n
+    self.levels = levels
+    self.sparse = sparse
+    self.block_size = block_size
+    self.dt = dt
+    self.smoother = smoother
+    self.pre_and_post_smoothing = pre_and_post_smoothing
+    self.bottom_smoothing = bottom_smoothing
+    self.jacobi_weight = jacobi_weight
+
+    def new_grid(l):
+      if sparse:
+        return ti.var(dt)
+      return ti.var(dt, shape=(n >> l,) * dim, halo=1)
+
+    self.r = [new_grid(l) for l in range(levels)]
+    self.z = [new_grid(l) for l in range(levels)]
+    # The other buffer of the Jacobi sweeps
+    self.tmp = [new_grid(l) for l in range(levels)
+                ] if smoother == 'jacobi' else None
+    self.x = new_grid(0)
+    self.p = new_grid(0)
+    self.Ap = new_grid(0)
+    self.b = self.r[0]
+    self.rTr = ti.var(dt, shape=())
+    self.zTr = ti.var(dt, shape=())
+    self.old_zTr = ti.var(dt, shape=())
+    self.pAp = ti.var(dt, shape=())
+    # The relative residual |r| / |b| after the last solve()
+    self.residual = None
+
+    if sparse:
+
+      @ti.layout
+      def place():
+        idx = impl.index_nd(dim)
+        for l in range(levels):
+          n_l = n >> l
+          bs = min(block_size, n_l)
+          assert n_l % bs == 0, 'n must be divisible by the block size'
+          fields = [self.r[l], self.z[l]]
+          if self.tmp is not None:
+            fields.append(self.tmp[l])
+          if l == 0:
+            fields += [self.x, self.p, self.Ap]
+          # Separate leaves under one pointer, activated together
+          block = ti.root.dense(idx, n_l // bs).pointer()
+          for f in fields:
+            block.dense(idx, bs).place(f)
+
+    self.level_kernels = [self.make_level_kernels(l) for l in range(levels)]
+    self.make_cg_kernels()
+
+  def neighbor_sum(self, f, l):
+    return make_neighbor_sum(f, self.n >> l, self.dim, self.dt, self.sparse)
+
+  def make_level_kernels(self, l):
+    import taichi as ti
+    dim = self.dim
+    dt = self.dt
+    r = self.r[l]
+    z = self.z[l]
+    inv_diag = 1 / (2 * dim)
+    z_sum = self.neighbor_sum(z, l)
+    kernels = {}
+
+    @ti.func
+    def parity(I):
+      s = 0
+      for d in ti.static(range(dim)):
+        s += I[d]
+      return s % 2
+
+    # The cell of the coarser grid that I belongs to
+    @ti.func
+    def parent(I):
+      J = I
+      for d in ti.static(range(dim)):
+        J[d] = I[d] // 2
+      return J
+
+    # The first red sweep from z = 0
+    @ti.kernel
+    def rbgs_first():
+      for I in ti.grouped(r):
+        if parity(I) == 0:
+          z[I] = r[I] * inv_diag
+        else:
+          z[I] = ti.cast(0, dt)
+
+    @ti.kernel
+    def rbgs_sweep(phase: ti.i32):
+      for I in ti.grouped(r):
+        if parity(I) == phase:
+          z[I] = (r[I] + z_sum(I)) * inv_diag
+
+    kernels['rbgs_first'] = rbgs_first
+    kernels['rbgs_sweep'] = rbgs_sweep
+
+    if self.tmp is not None:
+      w = self.jacobi_weight
+      tmp = self.tmp[l]
+
+      @ti.kernel
+      def jacobi_first():
+        for I in ti.grouped(r):
+          z[I] = r[I] * (w * inv_diag)
+
+      def make_jacobi_sweep(src, dst):
+        src_sum = self.neighbor_sum(src, l)
+
+        @ti.kernel
+        def jacobi_sweep():
+          ti.cache_shared(src)
+          for I in ti.grouped(r):
+            dst[I] = src[I] + w * ((r[I] + src_sum(I)) * inv_diag - src[I])
+
+        return jacobi_sweep
+
+      @ti.kernel
+      def copy_tmp():
+        for I in ti.grouped(r):
+          z[I] = tmp[I]
+
+      kernels['jacobi_first'] = jacobi_first
+      kernels['jacobi_to_tmp'] = make_jacobi_sweep(z, tmp)
+      kernels['jacobi_to_z'] = make_jacobi_sweep(tmp, z)
+      kernels['copy_tmp'] = copy_tmp
+
+    if l + 1 < self.levels:
+      r_c = self.r[l + 1]
+      # For the unscaled Laplacian of the coarse grid
+      scale = 4 / 2**dim
+
+      @ti.kernel
+      def clear_coarse():
+        for I in ti.grouped(r_c):
+          r_c[I] = ti.cast(0, dt)
+
+      @ti.kernel
+      def restrict():
+        ti.cache_shared(z)
+        for I in ti.grouped(r):
+          res = r[I] - (2 * dim * z[I] - z_sum(I))
+          r_c[parent(I)] += res * scale
+
+      z_c = self.z[l + 1]
+
+      @ti.kernel
+      def prolongate():
+        for I in ti.grouped(r):
+          z[I] += z_c[parent(I)]
+
+      kernels['clear_coarse'] = clear_coarse
+      kernels['restrict'] = restrict
+      kernels['prolongate'] = prolongate
+
+    return kernels
+
+  def make_cg_kernels(self):
+    import taichi as ti
+    dt = self.dt
+    dim = self.dim
+    x, p, Ap, r, z = self.x, self.p, self.Ap, self.r[0], self.z[0]
+    rTr, zTr, old_zTr, pAp = self.rTr, self.zTr, self.old_zTr, self.pAp
+    p_sum = self.neighbor_sum(p, 0)
+
+    # x = 0, so that r = b
+    @ti.kernel
+    def init():
+      for I in ti.grouped(r):
+        x[I] = ti.cast(0, dt)
+        p[I] = ti.cast(0, dt)
+        rTr[None] += r[I] * r[I]
+
+    @ti.kernel
+    def reduce_zTr():
+      for I in ti.grouped(r):
+        zTr[None] += z[I] * r[I]
+
+    # p = z + beta p, and beta = 0 in the first iteration
+    @ti.kernel
+    def update_p():
+      for I in ti.grouped(r):
+        beta = ti.cast(0, dt)
+        if old_zTr[None] != 0:
+          beta = zTr[None] / old_zTr[None]
+        p[I] = z[I] + beta * p[I]
+
+    @ti.kernel
+    def compute_Ap():
+      ti.cache_shared(p)
+      for I in ti.grouped(r):
+        a = 2 * dim * p[I] - p_sum(I)
+        Ap[I] = a
+        pAp[None] += p[I] * a
+
+    @ti.kernel
+    def update_x_r():
+      for I in ti.grouped(r):
+        alpha = zTr[None] / pAp[None]
+        x[I] += alpha * p[I]
+        new_r = r[I] - alpha * Ap[I]
+        r[I] = new_r
+        rTr[None] += new_r * new_r
+
+    @ti.kernel
+    def next_iteration():
+      for _ in range(1):
+        old_zTr[None] = zTr[None]
+        zTr[None] = ti.cast(0, dt)
+        pAp[None] = ti.cast(0, dt)
+        rTr[None] = ti.cast(0, dt)
+
+    self.init = init
+    self.reduce_zTr = reduce_zTr
+    self.update_p = update_p
+    self.compute_Ap = compute_Ap
+    self.update_x_r = update_x_r
+    self.next_iteration = next_iteration
+
+  def smooth(self, l, sweeps, first=False, reverse=False):
+    k = self.level_kernels[l]
+    if self.smoother == 'rbgs':
+      phases = (1, 0) if reverse else (0, 1)
+      for i in range(sweeps):
+        for phase in phases:
+          if first and i == 0 and phase == 0:
+            k['rbgs_first']()
+          else:
+            k['rbgs_sweep'](phase)
+    else:
+      in_tmp = False
+      for i in range(sweeps):
+        if first and i == 0:
+          k['jacobi_first']()
+        elif in_tmp:
+          k['jacobi_to_z']()
+          in_tmp = False
+        else:
+          k['jacobi_to_tmp']()
+          in_tmp = True
+      if in_tmp:
+        k['copy_tmp']()
+
+  # z = M^-1 r, by a V-cycle from z = 0
+  def apply_preconditioner(self):
+    levels = self.levels
+    for l in range(levels - 1):
+      k = self.level_kernels[l]
+      self.smooth(l, self.pre_and_post_smoothing << l, first=True)
+      k['clear_coarse']()
+      k['restrict']()
+    self.smooth(levels - 1, self.bottom_smoothing, first=True)
+    for l in reversed(range(levels - 1)):
+      self.level_kernels[l]['prolongate']()
+      self.smooth(l, self.pre_and_post_smoothing << l, reverse=True)
+
+  # Iterates until |r| <= tol |b| or max_iters iterations, starting from
+  # x = 0. Returns the number of iterations.
+  def solve(self, max_iters=100, tol=1e-6, verbose=False):
+    import math
+    import taichi as ti
+    self.next_iteration()
+    self.old_zTr[None] = 0
+    self.init()
+    initial_rTr = self.rTr[None]
+    self.residual = 0.0
+    if initial_rTr == 0:
+      return 0
+    for i in range(max_iters):
+      self.next_iteration()
+      self.apply_preconditioner()
+      self.reduce_zTr()
+      self.update_p()
+      self.compute_Ap()
+      self.update_x_r()
+      self.residual = math.sqrt(max(self.rTr[None], 0) / initial_rTr)
+      if verbose:
+        ti.info('MGPCG iteration {}: residual {:.3e}'.format(
+            i + 1, self.residual))
+      if self.residual <= tol:
+        return i + 1
+    return max_iters
@@ -1,5 +1,7 @@
 class ndrange:
-  def __init__(self, *args):
+  # "tile" is a tuple of tile sizes along each dimension, or a tensor whose
+  # leaf block shape should be used. Iterations are then ordered tile by tile.
+  def __init__(self, *args, tile=None):
     args = list(args)
     for i in range(len(args)):
       if isinstance(args[i], list):
@@ -16,6 +18,77 @@ class ndrange:
     self.acc_dimensions = self.dimensions.copy()
     for i in reversed(range(len(self.bounds) - 1)):
        self.acc_dimensions[i] = self.acc_dimensions[i] * self.acc_dimensions[i + 1]
+
+    self.tile = None
+    if tile is not None:
+      self.init_tiles(tile)
+    else:
+      self.init_padding()
+
+  def init_tiles(self, tile):
+    from .expr import Expr
+    if isinstance(tile, Expr):
+      tile = ndrange.leaf_block_shape(tile, len(self.bounds))
+    tile = list(tile)
+    assert len(tile) == len(self.bounds)
+    for i in range(len(tile)):
+      tile[i] = max(1, min(tile[i], self.dimensions[i]))
+    self.set_tiles(tile)
+
+  # Recovering the indices from the flat loop index takes a division per
+  # dimension, unless the trailing dimensions are powers of two, which makes
+  # them shifts and masks. So those are padded to powers of two when that adds
+  # few iterations, and the range is iterated as a single tile of the padded
+  # shape, skipping the padding.
+  def init_padding(self):
+    dims = self.dimensions
+    if len(dims) < 2 or not all(isinstance(d, int) and d > 0 for d in dims):
+      return
+    padded = dims[:1] + [1 << (d - 1).bit_length() for d in dims[1:]]
+    total, padded_total = 1, 1
+    for d, p in zip(dims, padded):
+      total *= d
+      padded_total *= p
+    if padded == dims or padded_total * 8 > total * 9:
+      return
+    self.set_tiles(padded)
+
+  def set_tiles(self, tile):
+    self.tile = tile
+    self.num_tiles = [(d + t - 1) // t for d, t in zip(self.dimensions, tile)]
+    # Products of the trailing tile counts and sizes, for decomposing the
+    # tile id and the offset within the tile
+    self.acc_num_tiles = [1] * (len(tile) + 1)
+    self.acc_tile = [1] * (len(tile) + 1)
+    for i in reversed(range(len(tile))):
+      self.acc_num_tiles[i] = self.acc_num_tiles[i + 1] * self.num_tiles[i]
+      self.acc_tile[i] = self.acc_tile[i + 1] * tile[i]
+    # Tiles at the upper boundaries may be partial
+    self.partial = [d % t != 0 for d, t in zip(self.dimensions, tile)]
+    self.num_iterations = self.acc_num_tiles[0] * self.acc_tile[0]
+
+  # Whether the indices of a tiled iteration fall inside the range
+  def in_bounds(self, *indices):
+    ret = 1
+    for i in range(len(indices)):
+      if self.partial[i]:
+        ret = (indices[i] < self.dimensions[i]) & ret
+    return ret
+
+  @staticmethod
+  def leaf_block_shape(x, dim):
+    block = x.snode().ptr.parent
+    parent = block.parent
+    shape = []
+    for i in range(dim):
+      if i >= block.num_active_indices():
+        shape.append(1)
+        continue
+      n = block.get_num_elements_along_axis(i)
+      if parent is not None and i < parent.num_active_indices():
+        n //= parent.get_num_elements_along_axis(i)
+      shape.append(n)
+    return shape
        
   def __iter__(self):
     def gen(d, prefix):
@@ -0,0 +1,138 @@
+import itertools
+
+
+# Fixed-radius neighbor search over the particles of a 1D vector tensor (as in
+# SPH and DEM), on a uniform grid of cells of size radius. Create it before
+# the layout is materialized, since it declares its own tensors, and call
+# build() after the particles move.
+#
+# build() sorts the particle indices by cell with the radix sort of
+# ParticleSorter (a stable counting sort per 8 bits of the cell index, whose
+# offsets come from a scan of the counts) and marks the range of each cell
+# in the sorted order: the particles of cell c are order[begin[c]], ...,
+# order[end[c] - 1]. There are no lists to allocate and no contended
+# appends, and the result does not depend on the scheduling. Particles
+# outside the grid go to its boundary cells.
+class NeighborSearch:
+
+  # lower is the lower corner of the grid and res its number of cells along
+  # each axis (an int for all of them)
+  def __init__(self, x, n, radius, lower, res, num_chunks=256):
+    import taichi as ti
+    from .sort import ParticleSorter
+    self.x = x
+    self.n = n
+    self.dim = x.n
+    self.radius = radius
+    self.inv_h = 1 / radius
+    if isinstance(res, int):
+      res = (res,) * self.dim
+    if not isinstance(lower, (list, tuple)):
+      lower = (lower,) * self.dim
+    assert len(res) == self.dim and len(lower) == self.dim
+    self.res = tuple(res)
+    self.lower = tuple(lower)
+    self.num_cells = 1
+    for r in res:
+      self.num_cells *= r
+    self.sorter = ParticleSorter([], n, self.cell_index, self.num_cells,
+                                 num_chunks=num_chunks)
+    self.begin = ti.var(ti.i32, shape=self.num_cells)
+    self.end = ti.var(ti.i32, shape=self.num_cells)
+    self.order = None
+    self.num_particles = n
+    self.kernels = {}
+
+    num_cells = self.num_cells
+    begin = self.begin
+    end = self.end
+
+    # A cell begins (ends) where the sorted keys change
+    @ti.kernel
+    def mark_ranges(keys: ti.template(), n: ti.i32):
+      for c in range(num_cells):
+        begin[c] = 0
+        end[c] = 0
+      for i in range(n):
+        c = keys[i]
+        before = -1
+        if i > 0:
+          before = keys[i - 1]
+        after = -1
+        if i < n - 1:
+          after = keys[i + 1]
+        if before != c:
+          begin[c] = i
+        if after != c:
+          end[c] = i + 1
+
+    self.mark_ranges = mark_ranges
+
+  # The cell of particle i along each axis, clamped to the grid, in kernels
+  def cell(self, i):
+    import taichi as ti
+    x = ti.subscript(self.x, i)
+    return ti.Vector([
+        ti.min(ti.max(((x(d) - self.lower[d]) * self.inv_h).cast(int), 0),
+               self.res[d] - 1) for d in range(self.dim)
+    ])
+
+  def linear_index(self, c):
+    ret = c(0)
+    for d in range(1, self.dim):
+      ret = ret * self.res[d] + c(d)
+    return ret
+
+  def cell_index(self, i):
+    return self.linear_index(self.cell(i))
+
+  # Rebuilds the cells from the positions of the first n particles (all of
+  # them by default)
+  def build(self, n=None):
+    if n is None:
+      n = self.n
+    self.sorter.sort(n)
+    self.order = self.sorter.sorted_order()
+    self.num_particles = n
+    self.mark_ranges(self.sorter.sorted_keys(), n)
+
+  # Calls the ti.func func(i, j) for each particle i and each other particle
+  # j closer to it than radius, as of the last build(). The positions must
+  # not have changed since.
+  def for_each_neighbor(self, func):
+    assert self.order is not None, 'Call build() first'
+    if func not in self.kernels:
+      self.kernels[func] = self.make_loop(func)
+    self.kernels[func](self.num_particles)
+
+  def make_loop(self, func):
+    import taichi as ti
+    x = self.x
+    order = self.order
+    begin = self.begin
+    end = self.end
+    res = self.res
+    dim = self.dim
+    radius_sqr = self.radius**2
+    cell = self.cell
+    linear_index = self.linear_index
+    offsets = list(itertools.product((-1, 0, 1), repeat=dim))
+
+    @ti.kernel
+    def loop(n: ti.i32):
+      for i in range(n):
+        c = cell(i)
+        for offset in ti.static(offsets):
+          nc = c + ti.Vector(list(offset))
+          inside = 1
+          for d in ti.static(range(dim)):
+            if nc(d) < 0 or nc(d) >= res[d]:
+              inside = 0
+          if inside:
+            k = linear_index(nc)
+            for s in range(begin[k], end[k]):
+              j = order[s]
+              if j != i and (x[i] - x[j]).norm_sqr() < radius_sqr:
+                func(i, j)
+
+    return loop
@@ -187,6 +187,15 @@ def ti_min(*args):
     return ti_min(args[0], ti_min(*args[1:]))
 
 
+# val, an i32, is in [base + low, base + high), where base is an index of the
+# enclosing struct-for. Lets ti.cache_shared bound the cells accessed at val.
+def assume_in_range(val, base, low, high):
+  return Expr(
+      taichi_lang_core.expr_assume_in_range(
+          Expr(val).ptr,
+          Expr(base).ptr, low, high))
+
+
 def append(l, indices, val):
   import taichi as ti
   a = ti.expr_init(taichi_lang_core.insert_append(l.snode().ptr, make_expr_group(indices), Expr(val).ptr))
@@ -194,3 +203,13 @@ def append(l, indices, val):
 
 def length(l, indices):
   return taichi_lang_core.insert_len(l.snode().ptr, make_expr_group(indices))
+
+def deactivate(l, indices):
+  taichi_lang_core.insert_deactivate(l.snode().ptr, make_expr_group(indices))
+
+
+# Whether the cell of the pointer SNode snode holding the element at indices
+# is active, without activating it
+def is_active(snode, indices):
+  return Expr(
+      taichi_lang_core.insert_is_active(snode.ptr, make_expr_group(indices)))
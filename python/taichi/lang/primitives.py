@@ -0,0 +1,173 @@
+import numpy as np
+
+
+# Parallel scans, stream compaction and histograms over 1D tensors and
+# external arrays (numpy), as sequences of kernel launches that need no host
+# synchronization when they operate on tensors. Create the object before the
+# layout is materialized, since it declares its scratch tensors, for the data
+# types it will scan. The arrays of a call are either all tensors or all
+# numpy arrays.
+#
+# Scans are blocked and take two passes over the data: num_chunks chunks are
+# summed in parallel, the chunk sums are scanned, and each chunk is scanned
+# again from its offset. The same scheme runs on the thread pool and on GPUs,
+# where each chunk is a thread.
+class ParallelPrimitives:
+
+  def __init__(self, data_types=None, num_chunks=256):
+    import taichi as ti
+    if data_types is None:
+      data_types = [ti.i32, ti.f32]
+    self.num_chunks = num_chunks
+    self.chunk_sums = {}
+    # The sum of the last scan of each data type
+    self.totals = {}
+    for dt in data_types:
+      self.chunk_sums[dt] = ti.var(dt, shape=num_chunks)
+      self.totals[dt] = ti.var(dt, shape=())
+    # The number of elements kept by the last compact()
+    self.count = ti.var(ti.i32, shape=())
+    self.kernels = {}
+
+  def get_kernels(self, dt, is_ext_arr):
+    key = (dt, is_ext_arr)
+    if key not in self.kernels:
+      self.kernels[key] = self.make_kernels(dt, is_ext_arr)
+    return self.kernels[key]
+
+  def make_kernels(self, dt, is_ext_arr):
+    import taichi as ti
+    assert dt in self.chunk_sums, 'No scratch tensors for {}'.format(dt)
+    arr = ti.ext_arr() if is_ext_arr else ti.template()
+    num_chunks = self.num_chunks
+    sums = self.chunk_sums[dt]
+    total = self.totals[dt]
+    count = self.count
+
+    @ti.kernel
+    def sum_chunks(src: arr, chunk_size: ti.i32, n: ti.i32):
+      for c in range(num_chunks):
+        s = ti.cast(0, dt)
+        for i in range(c * chunk_size, min((c + 1) * chunk_size, n)):
+          s += src[i]
+        sums[c] = s
+
+    @ti.kernel
+    def scan_chunk_sums():
+      for _ in range(1):
+        s = ti.cast(0, dt)
+        for c in range(num_chunks):
+          v = sums[c]
+          sums[c] = s
+          s += v
+        total[None] = s
+
+    @ti.kernel
+    def scan_chunks(src: arr, dst: arr, inclusive: ti.i32, chunk_size: ti.i32,
+                    n: ti.i32):
+      for c in range(num_chunks):
+        s = sums[c]
+        for i in range(c * chunk_size, min((c + 1) * chunk_size, n)):
+          v = src[i]
+          if inclusive:
+            s += v
+            dst[i] = s
+          else:
+            dst[i] = s
+            s += v
+
+    # Counts the nonzero flags of each chunk
+    @ti.kernel
+    def count_chunks(flags: arr, chunk_size: ti.i32, n: ti.i32):
+      for c in range(num_chunks):
+        s = 0
+        for i in range(c * chunk_size, min((c + 1) * chunk_size, n)):
+          if flags[i] != 0:
+            s += 1
+        sums[c] = s
+
+    @ti.kernel
+    def write_indices(flags: arr, indices: arr, chunk_size: ti.i32,
+                      n: ti.i32):
+      for c in range(num_chunks):
+        j = sums[c]
+        for i in range(c * chunk_size, min((c + 1) * chunk_size, n)):
+          if flags[i] != 0:
+            indices[j] = i
+            j += 1
+      for _ in range(1):
+        count[None] = total[None]
+
+    @ti.kernel
+    def histogram(values: arr, bins: arr, num_bins: ti.i32, n: ti.i32):
+      for b in range(num_bins):
+        bins[b] = 0
+      for i in range(n):
+        v = values[i]
+        if 0 <= v and v < num_bins:
+          bins[v] += 1
+
+    return {
+        'sum_chunks': sum_chunks,
+        'scan_chunk_sums': scan_chunk_sums,
+        'scan_chunks': scan_chunks,
+        'count_chunks': count_chunks,
+        'write_indices': write_indices,
+        'histogram': histogram,
+    }
+
+  @staticmethod
+  def get_data_type(x):
+    from .util import to_taichi_type
+    if isinstance(x, np.ndarray):
+      return to_taichi_type(x.dtype)
+    return x.snode().data_type()
+
+  @staticmethod
+  def get_length(x, n):
+    if n is None:
+      n = x.shape[0] if isinstance(x, np.ndarray) else x.shape()[0]
+    return n
+
+  def chunk_size(self, n):
+    return max((n + self.num_chunks - 1) // self.num_chunks, 1)
+
+  def scan(self, src, dst, inclusive, n):
+    n = self.get_length(src, n)
+    dt = self.get_data_type(src)
+    kernels = self.get_kernels(dt, isinstance(src, np.ndarray))
+    chunk_size = self.chunk_size(n)
+    kernels['sum_chunks'](src, chunk_size, n)
+    kernels['scan_chunk_sums']()
+    kernels['scan_chunks'](src, dst, int(inclusive), chunk_size, n)
+    return self.totals[dt]
+
+  # dst[i] = src[0] + ... + src[i], for the first n elements (all by
+  # default). dst may be src. Returns the 0-D tensor holding the sum.
+  def inclusive_scan(self, src, dst, n=None):
+    return self.scan(src, dst, True, n)
+
+  # dst[i] = src[0] + ... + src[i - 1]
+  def exclusive_scan(self, src, dst, n=None):
+    return self.scan(src, dst, False, n)
+
+  # Writes the indices of the nonzero flags to indices, in order. Returns the
+  # 0-D tensor holding their number.
+  def compact(self, flags, indices, n=None):
+    n = self.get_length(flags, n)
+    import taichi as ti
+    kernels = self.get_kernels(ti.i32, isinstance(flags, np.ndarray))
+    chunk_size = self.chunk_size(n)
+    kernels['count_chunks'](flags, chunk_size, n)
+    kernels['scan_chunk_sums']()
+    kernels['write_indices'](flags, indices, chunk_size, n)
+    return self.count
+
+  # bins[b] = the number of values equal to b, for b in [0, num_bins). Other
+  # values are ignored.
+  def histogram(self, values, bins, num_bins=None, n=None):
+    n = self.get_length(values, n)
+    num_bins = self.get_length(bins, num_bins)
+    import taichi as ti
+    kernels = self.get_kernels(ti.i32, isinstance(values, np.ndarray))
+    kernels['histogram'](values, bins, num_bins, n)
@@ -0,0 +1,20 @@
+from .util import i32, f32
+
+
+class QuantizedType:
+  def __init__(self, compute_type, num_bits, signed, scale):
+    assert 0 < num_bits <= 32
+    self.compute_type = compute_type
+    self.num_bits = num_bits
+    self.signed = signed
+    self.scale = scale
+
+
+def integer(bits, signed=True):
+  return QuantizedType(i32, bits, signed, 0.0)
+
+
+# Values in [-range, range) if signed, or [0, range) otherwise, in steps of
+# range / 2 ** (bits - signed)
+def fixed(bits, signed=True, range=1.0):
+  return QuantizedType(f32, bits, signed, range / 2**(bits - signed))
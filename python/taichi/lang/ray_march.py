@@ -0,0 +1,103 @@
+# Ray marching through sparse grids, e.g. of smoke densities, that skips the
+# empty space. levels are the pointer SNodes of the grid, from the coarsest
+# to the finest: where the cell of a level is inactive, the ray jumps over it
+# whole, and it steps cell by cell only inside the active leaf blocks. This
+# is a hierarchical DDA over the SNode tree, with ti.is_active queries that
+# never activate cells, instead of fixed steps looking up every cell.
+#
+# The grid has res cells along each axis (an int for all of them), of size
+# dx, from lower. Make the ti.func marching the rays with
+# marcher.make(visit), where visit(I, t0, t1) is a ti.func called for each
+# active leaf cell I the ray d (not necessarily normalized) crosses from
+# o + t0 * d to o + t1 * d. It returns nonzero to stop there.
+# march(o, d, t_max) returns the t0 of the cell that stopped the ray, or
+# t_max.
+class SparseGridMarcher:
+
+  # The rays move by at least this many cells per step, and are nudged by it
+  # into the cell they enter
+  eps = 1e-4
+
+  def __init__(self, levels, res, dx=1, lower=0):
+    if not isinstance(levels, (list, tuple)):
+      levels = [levels]
+    self.levels = list(levels)
+    if isinstance(res, int):
+      res = (res,) * 3
+    self.res = tuple(res)
+    self.dim = len(self.res)
+    if not isinstance(lower, (list, tuple)):
+      lower = (lower,) * self.dim
+    self.lower = tuple(lower)
+    self.inv_dx = 1 / dx
+
+  # The number of leaf cells along axis k of each cell of level l
+  def extent(self, l, k):
+    return self.levels[l].ptr.cell_extent_along_axis(k)
+
+  def make(self, visit):
+    import taichi as ti
+    dim = self.dim
+    res = self.res
+    lower = ti.Vector(list(self.lower))
+    inv_dx = self.inv_dx
+    levels = self.levels
+    num_levels = len(levels)
+    eps = self.eps
+
+    # Known once the layout is materialized, when the kernels compile
+    def extents(l):
+      return [self.extent(l, k) for k in range(dim)]
+
+    @ti.func
+    def march(o, d, t_max):
+      # In cells, with t unchanged
+      og = (o - lower) * inv_dx
+      dg = d * inv_dx
+      s = ti.Vector([1] * dim)
+      for k in ti.static(range(dim)):
+        if dg[k] < 0:
+          s[k] = -1
+        if abs(dg[k]) < 1e-8:
+          dg[k] = 1e-8 * s[k]
+      # Clip the ray to the grid
+      t = 0.0
+      t_far = t_max
+      for k in ti.static(range(dim)):
+        t0 = (0 - og[k]) / dg[k]
+        t1 = (res[k] - og[k]) / dg[k]
+        t = max(t, min(t0, t1))
+        t_far = min(t_far, max(t0, t1))
+      dg_max = 0.0
+      for k in ti.static(range(dim)):
+        dg_max = max(dg_max, abs(dg[k]))
+      step = eps / dg_max
+      ret = t_max
+      while t < t_far:
+        p = og + dg * t
+        cell = ti.Vector([0] * dim)
+        for k in ti.static(range(dim)):
+          cell[k] = min(max(ti.cast(ti.floor(p[k] + eps * s[k]), ti.i32), 0),
+                        res[k] - 1)
+        # The coarsest inactive cell holding cell, or cell itself
+        ext = ti.Vector([1] * dim)
+        skip = 0
+        for l in ti.static(range(num_levels)):
+          if skip == 0:
+            if ti.is_active(levels[l], cell) == 0:
+              skip = 1
+              ext = ti.Vector(extents(l))
+        t_exit = t_far
+        for k in ti.static(range(dim)):
+          face = cell[k] // ext[k] * ext[k]
+          if s[k] > 0:
+            face += ext[k]
+          t_exit = min(t_exit, (face - og[k]) / dg[k])
+        if skip == 0:
+          if visit(cell, t, t_exit):
+            ret = t
+            t_far = t
+        t = max(t_exit, t + step)
+      return ret
+
+    return march
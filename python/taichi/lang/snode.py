@@ -8,19 +8,53 @@ class SNode:
       dimensions = [dimensions] * len(indices)
     return SNode(self.ptr.dense(indices, dimensions))
 
-  def dynamic(self, index, dimension, chunk_size=None):
+  def hash(self, indices, dimensions, capacity=None):
+    if isinstance(dimensions, int):
+      dimensions = [dimensions] * len(indices)
+    if capacity is None:
+      capacity = 0
+    return SNode(self.ptr.hash(indices, dimensions, capacity))
+
+  # With geometric=True, the chunks hold chunk_size, 2 * chunk_size,
+  # 4 * chunk_size, ... elements, so that nodes with a large dimension and
+  # small chunks stay small (LLVM backends)
+  def dynamic(self, index, dimension, chunk_size=None, geometric=False):
     assert len(index) == 1
     if chunk_size is None:
       chunk_size = dimension
-    return SNode(self.ptr.dynamic(index[0], dimension, chunk_size))
+    node = self.ptr.dynamic(index[0], dimension, chunk_size)
+    if geometric:
+      node.geometric(True)
+    return SNode(node)
+
+  # With compressed=True, each cell holds a 32-bit index into the node pool
+  # of the SNode instead of a lock and a 64-bit pointer (LLVM backends)
+  def pointer(self, compressed=False):
+    node = self.ptr.pointer()
+    if compressed:
+      node.compressed(True)
+    return SNode(node)
 
-  def pointer(self):
-    return SNode(self.ptr.pointer())
+  def bit_struct(self, num_bits=32):
+    return SNode(self.ptr.bit_struct(num_bits))
 
   def bitmasked(self, val=True):
     self.ptr.bitmasked(val)
     return self
 
+  # Cells in Z-order (dense only): the bits of the coordinates interleave in
+  # the cell index, so that neighbors along any axis stay close in memory
+  def morton(self, val=True):
+    self.ptr.morton(val)
+    return self
+
+  # Pads each axis of a dense node under the root with width cells on both
+  # sides, at indices -width to -1 and n to n + width - 1. Struct-fors over
+  # its places visit the interior only.
+  def halo(self, width):
+    self.ptr.halo(width)
+    return self
+
   def place(self, *args):
     from .expr import Expr
     for arg in args:
@@ -33,8 +67,72 @@ class SNode:
         arg.place(self)
     return self
 
-  def lazy_grad(self):
-    self.ptr.lazy_grad()
+  # With compress=True, each block is compressed on its own, in parallel
+  def snapshot(self, filename, compress=False):
+    self.ptr.snapshot(filename, compress)
+
+  def restore(self, filename):
+    self.ptr.restore(filename)
+
+  # With ti.cfg.root_file set, starts reading the elements [begin, end) of a
+  # dense SNode under the root (all by default) from the file
+  def prefetch(self, begin=0, end=-1):
+    self.ptr.prefetch(begin, end)
+
+  # Writes the elements back to the file and frees their memory
+  def evict(self, begin=0, end=-1):
+    self.ptr.evict(begin, end)
+
+  # Deactivates all cells of a pointer or dynamic SNode at once, freeing the
+  # nodes below them. Dense SNodes holding their tensors are zeroed instead.
+  def deactivate_all(self):
+    self.ptr.clear_data_and_deactivate()
+
+  # Moves the nodes of the active cells of a pointer SNode to the front of its
+  # pool, in the order struct-fors visit them, restoring the locality that
+  # deactivations and activations scatter. Data and activity are kept. Worth
+  # calling every few hundred steps of long sparse simulations.
+  def defragment(self):
+    self.ptr.defragment()
+
+  # Deactivates the cells of a pointer SNode whose blocks went back to the
+  # ambient value, zero, in bulk, so that the active region shrinks with the
+  # material in sparse simulations. With a threshold, the float values of
+  # the active cells below it (in magnitude) are set to zero first. Call it
+  # after the kernels of a step, e.g. every step or few.
+  def deactivate_ambient(self, threshold=0):
+    if threshold > 0:
+      from .core import taichi_lang_core
+      from .impl import pytaichi
+      from .meta import snap_to_zero
+      for x in pytaichi.global_vars:
+        p = x.ptr.snode()
+        # Only the real tensors below the SNode
+        if p is None or not taichi_lang_core.needs_grad(p.data_type()):
+          continue
+        while p is not None and p.id != self.ptr.id:
+          p = p.parent
+        if p is not None:
+          snap_to_zero(x, threshold)
+    self.ptr.deactivate_ambient()
+
+  def memory_stats(self):
+    stat = self.ptr.stat()
+    return {
+        'active_nodes': stat.num_resident_blocks,
+        'allocated_bytes': stat.num_resident_blocks * stat.node_size,
+        'committed_bytes': stat.pool_size,
+        'peak_bytes': stat.peak_num_blocks * stat.node_size,
+    }
+
+  # Places the gradients of the primals below the SNode that have none. With
+  # separate=True, they go into a copy of the structure of their primals
+  # instead of interleaving with them, so that they take no memory until
+  # gradient kernels (e.g. in a ti.Tape) touch them: dense pages are backed
+  # on first touch and sparse blocks where written. Runs without gradients
+  # keep the bandwidth and footprint of the primals alone.
+  def lazy_grad(self, separate=False):
+    self.ptr.lazy_grad(separate)
 
   def parent(self):
     return SNode(self.ptr.snode().parent)
@@ -0,0 +1,115 @@
+radix_bits = 8
+radix = 1 << radix_bits
+
+
+# Sorts the particles of 1D tensors by a key (e.g. the index of the grid cell
+# they are in) and permutes their fields in place, so that particles close in
+# space stay close in memory. Create it before the layout is materialized,
+# since it declares its own tensors, and call sort() every few steps.
+#
+# key is a ti.func mapping a particle index to a key in [0, num_keys). The
+# sort is a least significant digit radix sort with 8-bit digits: each pass
+# counts and scatters num_chunks chunks of particles in parallel, each chunk
+# in order, so that it is stable and the result does not depend on the
+# scheduling. It runs on every arch.
+class ParticleSorter:
+
+  def __init__(self, fields, n, key, num_keys, num_chunks=256):
+    import taichi as ti
+    assert num_keys > 0
+    self.n = n
+    self.num_chunks = num_chunks
+    self.num_passes = max(1, ((num_keys - 1).bit_length() + radix_bits - 1) //
+                          radix_bits)
+    self.entries = []
+    for f in fields:
+      self.entries += f.entries if hasattr(f, 'entries') else [f]
+    self.keys = [ti.var(ti.i32, shape=n) for _ in range(2)]
+    self.order = [ti.var(ti.i32, shape=n) for _ in range(2)]
+    # Where the next particle of each chunk with each digit goes
+    offsets = ti.var(ti.i32, shape=(num_chunks, radix))
+    # For the fields of each data type, in turn
+    self.temporaries = {}
+    for e in self.entries:
+      dt = e.ptr.get_data_type()
+      if dt not in self.temporaries:
+        self.temporaries[dt] = ti.var(dt, shape=n)
+
+    @ti.kernel
+    def compute_keys(keys: ti.template(), order: ti.template(), n: ti.i32):
+      for i in range(n):
+        keys[i] = key(i)
+        order[i] = i
+
+    @ti.kernel
+    def count(keys: ti.template(), scale: ti.i32, chunk_size: ti.i32,
+              n: ti.i32):
+      for c, b in offsets:
+        offsets[c, b] = 0
+      for c in range(num_chunks):
+        for i in range(c * chunk_size, min((c + 1) * chunk_size, n)):
+          offsets[c, keys[i] // scale % radix] += 1
+
+    @ti.kernel
+    def scan():
+      for _ in range(1):
+        total = 0
+        for b in range(radix):
+          for c in range(num_chunks):
+            num = offsets[c, b]
+            offsets[c, b] = total
+            total += num
+
+    @ti.kernel
+    def scatter(keys: ti.template(), order: ti.template(),
+                sorted_keys: ti.template(), sorted_order: ti.template(),
+                scale: ti.i32, chunk_size: ti.i32, n: ti.i32):
+      for c in range(num_chunks):
+        for i in range(c * chunk_size, min((c + 1) * chunk_size, n)):
+          b = keys[i] // scale % radix
+          j = offsets[c, b]
+          offsets[c, b] = j + 1
+          sorted_keys[j] = keys[i]
+          sorted_order[j] = order[i]
+
+    @ti.kernel
+    def permute(f: ti.template(), tmp: ti.template(), order: ti.template(),
+                n: ti.i32):
+      for i in range(n):
+        tmp[i] = f[order[i]]
+      for i in range(n):
+        f[i] = tmp[i]
+
+    self.compute_keys = compute_keys
+    self.count = count
+    self.scan = scan
+    self.scatter = scatter
+    self.permute = permute
+
+  # Sorts the first n particles (all of them by default)
+  def sort(self, n=None):
+    if n is None:
+      n = self.n
+    assert 0 <= n <= self.n
+    chunk_size = (n + self.num_chunks - 1) // self.num_chunks
+    self.compute_keys(self.keys[0], self.order[0], n)
+    scale = 1
+    for p in range(self.num_passes):
+      src, dst = p % 2, 1 - p % 2
+      self.count(self.keys[src], scale, chunk_size, n)
+      self.scan()
+      self.scatter(self.keys[src], self.order[src], self.keys[dst],
+                   self.order[dst], scale, chunk_size, n)
+      scale *= radix
+    order = self.sorted_order()
+    for e in self.entries:
+      self.permute(e, self.temporaries[e.ptr.get_data_type()], order, n)
+
+  # The keys of the particles, in order, as of the last sort()
+  def sorted_keys(self):
+    return self.keys[self.num_passes % 2]
+
+  # The particle at each position of the sorted order, as of the last sort().
+  # Without fields to permute, this is how the order is read.
+  def sorted_order(self):
+    return self.order[self.num_passes % 2]
@@ -0,0 +1,185 @@
+import itertools
+import numpy as np
+
+
+# The rule book of sparse convolutions over up to max_sites active sites of
+# a grid of res cells along each axis (an int for all of them), as in sparse
+# voxel CNNs. The sites are the integer coordinates in coords, without
+# duplicates. Create it before the layout is materialized, since it declares
+# its own tensors, and call build() once per sparsity pattern: all the
+# layers over the same sites (SparseConv) share it.
+#
+# The convolutions are submanifold: the output sites are the input sites,
+# and output site j gathers input site i through offset k of the
+# kernel_size^dim stencil where coords[i] = coords[j] + offset k. build()
+# sorts the sites by linear index (ParticleSorter), finds the neighbors of
+# each site with binary searches, and compacts the pairs (k, j) with a
+# neighbor (ParallelPrimitives), in order of offset. Inactive space costs
+# nothing.
+class SparseConvRules:
+
+  def __init__(self, max_sites, res, kernel_size=3, dim=3, num_chunks=256):
+    import taichi as ti
+    from .sort import ParticleSorter
+    from .primitives import ParallelPrimitives
+    assert kernel_size % 2 == 1, 'The kernel size is not odd'
+    if isinstance(res, int):
+      res = (res,) * dim
+    assert len(res) == dim
+    self.max_sites = max_sites
+    self.res = tuple(res)
+    self.dim = dim
+    r = kernel_size // 2
+    self.offsets = list(itertools.product(range(-r, r + 1), repeat=dim))
+    self.num_offsets = len(self.offsets)
+    num_keys = 1
+    for x in res:
+      num_keys *= x
+    self.coords = ti.Vector(dim, dt=ti.i32, shape=max_sites)
+    self.sorter = ParticleSorter([], max_sites, self.linear_index_of,
+                                 num_keys, num_chunks=num_chunks)
+    self.primitives = ParallelPrimitives([ti.i32], num_chunks=num_chunks)
+    # Pair k * max_sites + j is whether output site j has a neighbor through
+    # offset k, and which
+    num_pairs = self.num_offsets * max_sites
+    flags = ti.var(ti.i32, shape=num_pairs)
+    sources = ti.var(ti.i32, shape=num_pairs)
+    # The pairs with a neighbor, in order
+    self.pairs = ti.var(ti.i32, shape=num_pairs)
+    self.flags = flags
+    self.sources = sources
+    self.num_sites = 0
+    self.num_rules = 0
+
+    coords = self.coords
+    offsets = self.offsets
+    num_offsets = self.num_offsets
+    keys = self.sorter.sorted_keys()
+    order = self.sorter.sorted_order()
+
+    # The site at key among the first n sorted ones, or -1
+    @ti.func
+    def find(key, n):
+      lo = 0
+      hi = n
+      while lo < hi:
+        mid = (lo + hi) // 2
+        if keys[mid] < key:
+          lo = mid + 1
+        else:
+          hi = mid
+      ret = -1
+      if lo < n:
+        if keys[lo] == key:
+          ret = order[lo]
+      return ret
+
+    @ti.kernel
+    def find_rules(n: ti.i32):
+      for j in range(max_sites):
+        for k in ti.static(range(num_offsets)):
+          flags[k * max_sites + j] = 0
+        if j < n:
+          for k in ti.static(range(num_offsets)):
+            c = coords[j] + ti.Vector(list(offsets[k]))
+            inside = 1
+            for d in ti.static(range(dim)):
+              if c[d] < 0 or c[d] >= res[d]:
+                inside = 0
+            if inside:
+              i = find(self.linear_index(c), n)
+              if i >= 0:
+                flags[k * max_sites + j] = 1
+                sources[k * max_sites + j] = i
+
+    self.find_rules = find_rules
+
+  def linear_index(self, c):
+    ret = c(0)
+    for d in range(1, self.dim):
+      ret = ret * self.res[d] + c(d)
+    return ret
+
+  def linear_index_of(self, i):
+    import taichi as ti
+    return self.linear_index(ti.subscript(self.coords, i))
+
+  # Builds the rule book of the first n sites (all of them by default),
+  # optionally copying their coordinates from an n x dim array first. Waits
+  # for the number of rules.
+  def build(self, coords=None, n=None):
+    if coords is not None:
+      coords = np.asarray(coords, dtype=np.int32)
+      assert len(coords) <= self.max_sites, 'Too many sites'
+      n = len(coords)
+      padded = np.zeros((self.max_sites, self.dim), dtype=np.int32)
+      padded[:n] = coords
+      self.coords.from_numpy(padded)
+    if n is None:
+      n = self.max_sites
+    assert 0 <= n <= self.max_sites
+    self.num_sites = n
+    self.sorter.sort(n)
+    self.find_rules(n)
+    count = self.primitives.compact(self.flags, self.pairs)
+    self.num_rules = count[None]
+
+
+# A sparse convolution layer with in_channels input and out_channels output
+# channels over the sites of rules (SparseConvRules). Features are 2D
+# tensors of max_sites x channels, e.g. ti.var(ti.f32, shape=(max_sites,
+# in_channels), needs_grad=True), whose first rules.num_sites rows are the
+# active sites. weights[k, ci, co] is the weight of offset k from input
+# channel ci to output channel co, and bias[co] that of output channel co.
+#
+# forward(x, y) computes y = conv(x) + bias on the active sites: each thread
+# takes a rule and an output channel, gathers its input row and multiplies
+# it by the weights of the offset (the rules of an offset are contiguous),
+# scattering into the output with atomic adds. backward(x, y) runs the
+# gradient kernels from y.grad, accumulating into x.grad, weights.grad and
+# bias.grad. Inside a ti.Tape, forward() is differentiated as well.
+class SparseConv:
+
+  def __init__(self, rules, in_channels, out_channels, dt=None):
+    import taichi as ti
+    if dt is None:
+      dt = ti.f32
+    self.rules = rules
+    self.in_channels = in_channels
+    self.out_channels = out_channels
+    max_sites = rules.max_sites
+    self.weights = ti.var(dt,
+                          shape=(rules.num_offsets, in_channels, out_channels),
+                          needs_grad=True)
+    self.bias = ti.var(dt, shape=out_channels, needs_grad=True)
+
+    weights = self.weights
+    bias = self.bias
+    pairs = rules.pairs
+    sources = rules.sources
+
+    @ti.kernel
+    def initialize(y: ti.template(), n: ti.i32):
+      for j, co in ti.ndrange(n, out_channels):
+        y[j, co] = bias[co]
+
+    @ti.kernel
+    def convolve(x: ti.template(), y: ti.template(), num_rules: ti.i32):
+      for r, co in ti.ndrange(num_rules, out_channels):
+        p = pairs[r]
+        k = p // max_sites
+        j = p % max_sites
+        i = sources[p]
+        for ci in range(in_channels):
+          y[j, co] += weights[k, ci, co] * x[i, ci]
+
+    self.initialize = initialize
+    self.convolve = convolve
+
+  def forward(self, x, y):
+    self.initialize(y, self.rules.num_sites)
+    self.convolve(x, y, self.rules.num_rules)
+
+  def backward(self, x, y):
+    self.convolve.grad(x, y, self.rules.num_rules)
+    self.initialize.grad(y, self.rules.num_sites)
@@ -0,0 +1,202 @@
+# Sparse matrices of n x m scalars in block compressed sparse row (BSR)
+# storage, with blocks of block_size x block_size (CSR for block_size 1), for
+# implicit solvers. Create it before the layout is materialized, since it
+# declares its own tensors.
+#
+# Kernels assemble the matrix from triplets (i, j, value), with add(i, j, v),
+# which takes the next free triplet, or set_triplet(k, i, j, v), which writes
+# triplet k (e.g. k = 9 * element + local entry, for deterministic slots).
+# build() then sorts the triplets by block row and column (the radix sort of
+# ParticleSorter, by column and then stably by row), sums the duplicates and
+# compresses the rows with scans (ParallelPrimitives), all in kernels.
+#
+# spmv() and spmv_transpose() multiply 1D tensors, so that iterative solvers
+# such as conjugate gradient run entirely in Taichi. Each row of blocks is
+# a thread, whose products are unrolled across the block.
+class SparseMatrix:
+
+  def __init__(self,
+               n,
+               m=None,
+               max_triplets=None,
+               block_size=1,
+               dt=None,
+               num_chunks=256):
+    import taichi as ti
+    from .sort import ParticleSorter
+    from .primitives import ParallelPrimitives
+    if m is None:
+      m = n
+    if dt is None:
+      dt = ti.f32
+    b = block_size
+    assert n % b == 0 and m % b == 0, \
+        'The shape is not a multiple of the block size'
+    assert max_triplets is not None and max_triplets > 0
+    self.n = n
+    self.m = m
+    self.block_size = b
+    self.max_triplets = max_triplets
+    num_block_rows = n // b
+    num_block_cols = m // b
+    self.num_block_rows = num_block_rows
+
+    rows = ti.var(ti.i32, shape=max_triplets)
+    cols = ti.var(ti.i32, shape=max_triplets)
+    vals = ti.var(dt, shape=max_triplets)
+    # Only counts the triplets added: appending returns the next free slot
+    slots = ti.var(ti.i32)
+    num_triplets = ti.var(ti.i32, shape=())
+
+    @ti.layout
+    def place():
+      ti.root.dynamic(ti.i, max_triplets, 1024).place(slots)
+
+    self.slots = slots
+    self.num_triplets = num_triplets
+    self.by_col = ParticleSorter([rows, cols, vals],
+                                 max_triplets,
+                                 lambda k: ti.subscript(cols, k) // b,
+                                 num_block_cols,
+                                 num_chunks=num_chunks)
+    self.by_row = ParticleSorter([rows, cols, vals],
+                                 max_triplets,
+                                 lambda k: ti.subscript(rows, k) // b,
+                                 num_block_rows,
+                                 num_chunks=num_chunks)
+    self.primitives = ParallelPrimitives([ti.i32], num_chunks=num_chunks)
+    # Whether each sorted triplet is the first of its block, and the number
+    # of blocks up to it
+    flags = ti.var(ti.i32, shape=max_triplets)
+    positions = ti.var(ti.i32, shape=max_triplets)
+    self.flags = flags
+    self.positions = positions
+    # The blocks of row r are block_cols[row_ptr[r]], ...,
+    # block_cols[row_ptr[r + 1] - 1], block k holding the entries
+    # values[k * b * b + bi * b + bj], in row-major order.
+    row_counts = ti.var(ti.i32, shape=num_block_rows)
+    row_ptr = ti.var(ti.i32, shape=num_block_rows + 1)
+    block_cols = ti.var(ti.i32, shape=max_triplets)
+    values = ti.var(dt, shape=max_triplets * b * b)
+    self.row_counts = row_counts
+    self.row_ptr = row_ptr
+    self.block_cols = block_cols
+    self.values = values
+    num_blocks = self.primitives.totals[ti.i32]
+    self.num_blocks = num_blocks
+
+    @ti.func
+    def add(i, j, v):
+      k = ti.append(slots, [], 0)
+      if k < max_triplets:
+        rows[k] = i
+        cols[k] = j
+        vals[k] = v
+
+    @ti.func
+    def set_triplet(k, i, j, v):
+      rows[k] = i
+      cols[k] = j
+      vals[k] = v
+
+    @ti.kernel
+    def count_triplets():
+      num_triplets[None] = ti.length(slots, [])
+      if num_triplets[None] > max_triplets:
+        num_triplets[None] = max_triplets
+
+    @ti.kernel
+    def mark_blocks(n: ti.i32):
+      for k in range(n):
+        first = 1
+        if k > 0:
+          if rows[k] // b == rows[k - 1] // b and \
+              cols[k] // b == cols[k - 1] // b:
+            first = 0
+        flags[k] = first
+
+    @ti.kernel
+    def compress(n: ti.i32):
+      # There are at most n blocks
+      for k in range(n * b * b):
+        values[k] = 0
+      for r in range(num_block_rows):
+        row_counts[r] = 0
+      for k in range(n):
+        p = positions[k] - 1
+        i = rows[k]
+        j = cols[k]
+        if flags[k]:
+          block_cols[p] = j // b
+          row_counts[i // b] += 1
+        values[p * b * b + i % b * b + j % b] += vals[k]
+
+    @ti.kernel
+    def finish_rows():
+      row_ptr[num_block_rows] = num_blocks[None]
+
+    # y = A x
+    @ti.kernel
+    def spmv(x: ti.template(), y: ti.template()):
+      for r in range(num_block_rows):
+        begin = row_ptr[r]
+        end = row_ptr[r + 1]
+        for bi in ti.static(range(b)):
+          s = ti.cast(0, dt)
+          for k in range(begin, end):
+            c = block_cols[k]
+            for bj in ti.static(range(b)):
+              s += values[k * b * b + bi * b + bj] * x[c * b + bj]
+          y[r * b + bi] = s
+
+    # y = A^T x
+    @ti.kernel
+    def spmv_transpose(x: ti.template(), y: ti.template()):
+      for j in range(m):
+        y[j] = 0
+      for r in range(num_block_rows):
+        for k in range(row_ptr[r], row_ptr[r + 1]):
+          c = block_cols[k]
+          for bj in ti.static(range(b)):
+            s = ti.cast(0, dt)
+            for bi in ti.static(range(b)):
+              s += values[k * b * b + bi * b + bj] * x[r * b + bi]
+            y[c * b + bj] += s
+
+    self.add = add
+    self.set_triplet = set_triplet
+    self.count_triplets = count_triplets
+    self.mark_blocks = mark_blocks
+    self.compress = compress
+    self.finish_rows = finish_rows
+    self.spmv_kernel = spmv
+    self.spmv_transpose_kernel = spmv_transpose
+
+  # Builds the matrix from the first num_triplets triplets, by default those
+  # added since the last build(). Waits for the triplets to be counted.
+  def build(self, num_triplets=None):
+    if num_triplets is None:
+      self.count_triplets()
+      num_triplets = self.num_triplets[None]
+    assert 0 <= num_triplets <= self.max_triplets
+    self.by_col.sort(num_triplets)
+    self.by_row.sort(num_triplets)
+    self.mark_blocks(num_triplets)
+    self.primitives.inclusive_scan(self.flags, self.positions, num_triplets)
+    self.compress(num_triplets)
+    self.primitives.exclusive_scan(self.row_counts, self.row_ptr,
+                                   self.num_block_rows)
+    self.finish_rows()
+    self.slots.ptr.snode().parent.clear_data_and_deactivate()
+
+  # The number of nonzero blocks, as of the last build()
+  def nnz_blocks(self):
+    return self.row_ptr[self.num_block_rows]
+
+  # y = A x, for 1D tensors x of m and y of n elements
+  def spmv(self, x, y):
+    self.spmv_kernel(x, y)
+
+  # y = A^T x, for 1D tensors x of n and y of m elements
+  def spmv_transpose(self, x, y):
+    self.spmv_transpose_kernel(x, y)
@@ -6,6 +6,8 @@ class Tape:
     self.gradient_evaluated = False
     self.runtime = runtime
     self.eval_on_exit = loss is not None
+    # Set once a kernel ran its primal and adjoint together
+    self.closed = False
 
   def __enter__(self):
     self.runtime.target_tape = self
@@ -19,8 +21,14 @@ class Tape:
       self.grad()
 
   def insert(self, func, args):
+    assert not self.closed, \
+        "No kernels can be recorded after a forward_and_grad launch."
     self.calls.append((func, args))
 
+  def close(self):
+    assert not self.closed, "Tape already closed by forward_and_grad."
+    self.closed = True
+
   def grad(self):
     assert self.entered == True, "Before evaluating gradiends tape must be entered."
     assert self.gradient_evaluated == False, "Gradients of grad can be evaluated only once."
@@ -30,3 +38,165 @@ class Tape:
       else:
         func(*args, _gradient=True)
     self.gradient_evaluated = True
+
+
+class CheckpointedSteps:
+  """
+  num_steps calls of step(t, i) in segments of segment_size steps, where step
+  i of a segment reads slot i of the state tensors (their first index) and
+  writes slot i + 1. Only the state at the start of each segment is kept, and
+  the gradient recomputes the segments one by one before running their
+  adjoints.
+
+  With alternate_state, a second set of state tensors of the same shapes,
+  segments alternate between the two sets and run step(t, i, *state) on
+  theirs. The gradient then recomputes a segment while the adjoint of the
+  next one runs, which overlap under overlap_kernels as they touch different
+  tensors, and the state and its adjoint are carried by kernels instead of
+  host copies.
+  """
+
+  def __init__(self, runtime, num_steps, step, state, segment_size,
+               alternate_state=None):
+    assert num_steps % segment_size == 0, \
+        'The number of steps must be a multiple of the segment size'
+    self.runtime = runtime
+    self.step = step
+    self.segment_size = segment_size
+    self.num_segments = num_steps // segment_size
+    self.buffers = [state]
+    if alternate_state is not None:
+      assert len(alternate_state) == len(state), \
+          'The alternate state needs as many tensors as the state'
+      self.buffers.append(alternate_state)
+    # Matrices are checkpointed entry by entry
+    self.entries = [sum([getattr(s, 'entries', [s]) for s in b], [])
+                    for b in self.buffers]
+    self.state = self.entries[0]
+    for b in self.entries:
+      for s in b:
+        assert s.shape()[0] > segment_size, \
+            'State tensors need segment_size + 1 slots along their first axis'
+    self.checkpoints = []
+    self.last_segment = None
+
+  @property
+  def pipelined(self):
+    return len(self.buffers) == 2
+
+  def buffer(self, segment):
+    return segment % len(self.buffers)
+
+  @staticmethod
+  def slots(tensor, begin, end=None):
+    if end is None:
+      first = begin
+    else:
+      first = slice(begin, end)
+    return (first,) + (slice(None),) * (tensor.dim() - 1)
+
+  def clear_segment(self, segment):
+    # Steps may accumulate into the slots they write
+    k = self.segment_size
+    if not self.pipelined:
+      for s in self.state:
+        s[self.slots(s, 1, k + 1)] = 0
+      return
+    from .meta import zero_slots
+    for s in self.entries[self.buffer(segment)]:
+      zero_slots(s, 1, k + 1)
+
+  def run_steps(self, segment):
+    k = self.segment_size
+    for i in range(k):
+      if self.pipelined:
+        self.step(segment * k + i, i, *self.buffers[self.buffer(segment)])
+      else:
+        self.step(segment * k + i, i)
+
+  def run_segment(self, segment):
+    self.clear_segment(segment)
+    self.run_steps(segment)
+
+  def run_recorded_segment(self, segment):
+    # Clearing the slots is not part of the adjoint
+    self.clear_segment(segment)
+    tape = Tape(self.runtime)
+    with tape:
+      self.run_steps(segment)
+    return tape
+
+  def carry_state(self, segment):
+    # The final state of the previous segment is the initial one of segment
+    k = self.segment_size
+    src = self.entries[self.buffer(segment - 1)]
+    dst = self.entries[self.buffer(segment)]
+    if not self.pipelined:
+      for s in self.state:
+        s[self.slots(s, 0)] = s[self.slots(s, k)]
+      return
+    from .meta import copy_slot
+    for d, s in zip(dst, src):
+      copy_slot(d, 0, s, k)
+
+  def carry_grad(self, segment):
+    # The adjoint of the initial state of segment is that of the final state
+    # of the previous one
+    k = self.segment_size
+    src = self.entries[self.buffer(segment)]
+    dst = self.entries[self.buffer(segment - 1)]
+    if not self.pipelined:
+      for s in self.state:
+        g = s.grad[self.slots(s, 0)]
+        s.grad[self.slots(s, 0, k + 1)] = 0
+        s.grad[self.slots(s, k)] = g
+      return
+    from .meta import copy_slot, zero_slots
+    for d, s in zip(dst, src):
+      zero_slots(d.grad, 0, k + 1)
+      copy_slot(d.grad, k, s.grad, 0)
+
+  def restore(self, segment):
+    b = self.entries[self.buffer(segment)]
+    for s, c in zip(b, self.checkpoints[segment]):
+      s[self.slots(s, 0)] = c
+
+  def forward(self):
+    outer_tape = self.runtime.target_tape
+    self.runtime.target_tape = None
+    for segment in range(self.num_segments):
+      if segment > 0:
+        self.carry_state(segment)
+      if outer_tape is None:
+        self.run_segment(segment)
+        continue
+      b = self.entries[self.buffer(segment)]
+      self.checkpoints.append([s[self.slots(s, 0)] for s in b])
+      if segment == self.num_segments - 1:
+        self.last_segment = self.run_recorded_segment(segment)
+      else:
+        self.run_segment(segment)
+    self.runtime.target_tape = outer_tape
+    if outer_tape is not None:
+      outer_tape.insert(self, ())
+
+  def grad(self):
+    tape = self.last_segment
+    for segment in reversed(range(self.num_segments)):
+      if not self.pipelined:
+        if segment < self.num_segments - 1:
+          self.restore(segment)
+          tape = self.run_recorded_segment(segment)
+        tape.grad()
+        if segment > 0:
+          self.carry_grad(segment)
+        continue
+      # Issue the recomputation of the previous segment before the adjoint of
+      # this one, so that they run together
+      if segment > 0:
+        self.restore(segment - 1)
+        previous = self.run_recorded_segment(segment - 1)
+      tape.grad()
+      if segment > 0:
+        self.carry_grad(segment)
+        tape = previous
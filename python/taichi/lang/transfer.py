@@ -0,0 +1,98 @@
+# Particle-to-grid (P2G) and grid-to-particle (G2P) transfers, as in MPM, over
+# particles binned by the grid block they are in. Create it before the layout
+# is materialized, since it declares the lists of particles, and call place()
+# in the layout.
+#
+# bin() appends each particle to a dynamic list under the grid block holding
+# the lower corner (base) of its 3^dim stencil, for quadratic B-spline
+# weights. for_each_particle(func, cached) then calls the ti.func func(p, base)
+# for the particles, one grid block after the other. On GPUs, the cells of
+# the fields in cached that the particles of a block access (the block and 2
+# cells above it along each axis) are staged in a tile of shared memory
+# (ti.cache_shared): P2G accumulates into the tile with shared memory atomics
+# and adds each cell of the tile to the grid once, and G2P reads the grid
+# into the tile once per block. On CPUs, the atomics of the particles of a
+# block stay in the cache.
+class ParticleGridTransfer:
+
+  # x is the 1D tensor of the positions. block_size is the size along each
+  # axis of the leaf blocks of the grid.
+  def __init__(self, x, dx, block_size, max_particles_per_block):
+    import taichi as ti
+    self.x = x
+    self.inv_dx = 1 / dx
+    self.dim = x.n
+    self.block_size = block_size
+    self.max_particles_per_block = max_particles_per_block
+    self.pid = ti.var(ti.i32)
+    self.bin_kernel = None
+    self.kernels = {}
+
+  # Places the lists under block, the SNode of the grid blocks, whose first
+  # child is the dense(block_size) SNode of the grid fields. The lists take
+  # the axis after those of the grid.
+  def place(self, block):
+    import taichi as ti
+    block.dynamic(ti.indices(self.dim), self.max_particles_per_block).place(
+        self.pid)
+
+  # The base of the stencil of particle p, in kernels
+  def stencil_base(self, p):
+    import taichi as ti
+    return (ti.subscript(self.x, p) * self.inv_dx - 0.5).cast(int)
+
+  # The base of particle p, binned in the grid block of the loop index I, so
+  # that the accesses at base plus constant offsets can be cached
+  def binned_base(self, p, I):
+    import taichi as ti
+    base = self.stencil_base(p)
+    return ti.Vector([
+        ti.assume_in_range(base(d), I(d), 0, self.block_size)
+        for d in range(self.dim)
+    ])
+
+  # Rebuilds the lists from the positions. A block holds at most
+  # max_particles_per_block particles.
+  def bin(self):
+    import taichi as ti
+    if self.bin_kernel is None:
+      x = self.x
+      pid = self.pid
+      stencil_base = self.stencil_base
+
+      @ti.kernel
+      def bin_particles():
+        for p in x:
+          ti.append(pid, stencil_base(p).entries, p)
+
+      self.bin_kernel = bin_particles
+    self.pid.ptr.snode().parent.clear_data_and_deactivate()
+    self.bin_kernel()
+
+  # Calls func(p, base) for each binned particle p. cached are the grid fields
+  # func accesses at base plus constant offsets, either only adding to them
+  # (P2G) or only reading them (G2P). The positions must not have changed
+  # since bin().
+  def for_each_particle(self, func, cached=()):
+    key = (func, tuple(id(f) for f in cached))
+    if key not in self.kernels:
+      self.kernels[key] = self.make_loop(func, cached)
+    self.kernels[key]()
+
+  def make_loop(self, func, cached):
+    import taichi as ti
+    entries = []
+    for f in cached:
+      entries += f.entries if hasattr(f, 'entries') else [f]
+    pid = self.pid
+    binned_base = self.binned_base
+
+    @ti.kernel
+    def transfer():
+      for e in ti.static(entries):
+        ti.cache_shared(e)
+      for I in ti.grouped(pid):
+        p = pid[I]
+        func(p, binned_base(p, I))
+
+    return transfer
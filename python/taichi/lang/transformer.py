@@ -1,4 +1,5 @@
 import ast
+import copy
 from .util import to_taichi_type
 
 
@@ -34,13 +35,20 @@ class ASTTransformer(ast.NodeTransformer):
                excluded_paremeters=(),
                is_kernel=True,
                func=None,
-               arg_features=None):
+               arg_features=None,
+               ensemble=False):
     super().__init__()
     self.local_scopes = []
     self.excluded_parameters = excluded_paremeters
     self.is_kernel = is_kernel
     self.func = func
     self.arg_features = arg_features
+    # Number of enclosing non-static loops
+    self.loop_depth = 0
+    # The top-level loops run over the instances of an ensemble (kernels of
+    # ti.Ensemble), while translating one of them batching is False
+    self.ensemble = ensemble
+    self.batching = ensemble
 
   def variable_scope(self, *args):
     return ScopeGuard(self, *args)
@@ -274,25 +282,39 @@ if 1:
         raise Exception('Not supported')
     is_range_for = isinstance(node.iter, ast.Call) and isinstance(
         node.iter.func, ast.Name) and node.iter.func.id == 'range'
+    if self.batching and self.loop_depth == 0 and not is_static_for:
+      return self.visit_batched_for(node, is_range_for, is_ndrange_for,
+                                    is_grouped)
     ast.fix_missing_locations(node)
+    is_inner_loop = self.loop_depth > 0
+    has_break = any(
+        isinstance(n, ast.Break) for stmt in node.body for n in ast.walk(stmt))
     if not is_ndrange_for:
+      if not is_static_for:
+        self.loop_depth += 1
       self.generic_visit(node, ['body'])
+      if not is_static_for:
+        self.loop_depth -= 1
     if is_ndrange_for:
       template = '''
 if ti.static(1):
   __ndrange = 0
-  for __ndrange_I in range(0):
-    __I = __ndrange_I
+  if ti.static(__ndrange.tile is None):
+    for __ndrange_I in range(__ndrange.acc_dimensions[0]):
+      __I = __ndrange_I
+  else:
+    for __ndrange_I in range(__ndrange.num_iterations):
+      __T = __ndrange_I // __ndrange.acc_tile[0]
+      __J = __ndrange_I - __T * __ndrange.acc_tile[0]
       '''
       t = ast.parse(template).body[0]
       t.body[0].value = node.iter
-      t.body[1].iter.args[0] = self.parse_expr('__ndrange.acc_dimensions[0]')
       targets = node.target
       if isinstance(targets, ast.Tuple):
         targets = [name.id for name in targets.elts]
       else:
         targets = [targets.id]
-      loop_body = t.body[1].body
+      loop_body = t.body[1].body[0].body
       for i in range(len(targets)):
         if i + 1 < len(targets):
           stmt = '__{} = __I // __ndrange.acc_dimensions[{}]'.format(targets[i], i + 1)
@@ -305,7 +327,27 @@ if ti.static(1):
           stmt = '__I = __I - __{} * __ndrange.acc_dimensions[{}]'.format(targets[i], i + 1)
           loop_body.append(self.parse_stmt(stmt))
       loop_body += node.body
-      
+
+      # Tiled: the flat index is split into the tile id and the offset
+      # within the tile, each decomposed in row-major order
+      loop_body = t.body[1].orelse[0].body
+      for i in range(len(targets)):
+        stmts = [
+            '__tile_{0} = __T // __ndrange.acc_num_tiles[{1}]',
+            '__T = __T - __tile_{0} * __ndrange.acc_num_tiles[{1}]',
+            '__{0} = __J // __ndrange.acc_tile[{1}]',
+            '__J = __J - __{0} * __ndrange.acc_tile[{1}]',
+            '__{0} = __{0} + __tile_{0} * __ndrange.tile[{2}]',
+            '{0} = __{0} + __ndrange.bounds[{2}][0]',
+        ]
+        for stmt in stmts:
+          loop_body.append(
+              self.parse_stmt(stmt.format(targets[i], i + 1, i)))
+      guard = self.parse_stmt('if __ndrange.in_bounds({}): pass'.format(
+          ', '.join('__' + target for target in targets)))
+      guard.body = copy.deepcopy(node.body)
+      loop_body.append(guard)
+
       node = ast.copy_location(t, node)
       return self.visit(node) # further translate as a range for
     elif is_static_for:
@@ -333,11 +375,35 @@ if 1:
         bgn = self.make_constant(value=0)
         end = node.iter.args[0]
 
-      t.body[1].value.args[0] = bgn
-      t.body[2].value.args[0] = end
+      if not is_inner_loop or has_break:
+        t.body[1].value.args[0] = bgn
+        t.body[2].value.args[0] = end
+        t.body = t.body[:6] + node.body + t.body[6:]
+        t.body.append(self.parse_stmt('del {}'.format(loop_var)))
+        return ast.copy_location(t, node)
+
+      # Inner loops over a few iterations known at compile time are unrolled,
+      # as if they were ti.static loops
+      template = '''
+if 1:
+  ___unroll_begin = 0
+  ___unroll_end = 0
+  if ti.can_unroll(___unroll_begin, ___unroll_end):
+    for {} in range(___unroll_begin, ___unroll_end):
+      pass
+  else:
+    pass
+      '''.format(loop_var)
+      u = ast.parse(template).body[0]
+      u.body[0].value = bgn
+      u.body[1].value = end
+      u.body[2].body[0].body = copy.deepcopy(node.body)
+      t.body[1].value.args[0] = self.parse_expr('___unroll_begin')
+      t.body[2].value.args[0] = self.parse_expr('___unroll_end')
       t.body = t.body[:6] + node.body + t.body[6:]
       t.body.append(self.parse_stmt('del {}'.format(loop_var)))
-      return ast.copy_location(t, node)
+      u.body[2].orelse = t.body
+      return ast.copy_location(u, node)
     else:  # Struct for
       if isinstance(node.target, ast.Name):
         elts = [node.target]
@@ -381,6 +447,95 @@ if 1:
         t.body.append(self.parse_stmt('del {}'.format(loop_var.id)))
       return ast.copy_location(t, node)
 
+  # A top-level loop of an ensemble kernel, over all instances. Range-fors
+  # become ndrange-fors with the instance as their first index, __ti_batch.
+  def visit_batched_for(self, node, is_range_for, is_ndrange_for,
+                        is_grouped):
+    if is_range_for or is_ndrange_for:
+      if is_range_for:
+        args = node.iter.args
+        assert len(args) in [1, 2]
+        node.iter = self.parse_expr('ti.ndrange(__ti_ensemble__.size, 0)')
+        node.iter.args[1] = args[0] if len(args) == 1 else ast.Tuple(
+            elts=list(args), ctx=ast.Load())
+      else:
+        node.iter.args.insert(0, self.parse_expr('__ti_ensemble__.size'))
+      if isinstance(node.target, ast.Tuple):
+        targets = node.target.elts
+      else:
+        targets = [node.target]
+      node.target = ast.Tuple(
+          elts=[ast.Name(id='__ti_batch', ctx=ast.Store())] + targets,
+          ctx=ast.Store())
+      node.body = [self.parse_stmt('__ti_ensemble__.enter(__ti_batch)')
+                  ] + node.body
+    else:
+      # Struct-fors over batched tensors get the instance as their first
+      # index as well
+      return self.visit_batched_struct_for(node, is_grouped)
+    ast.fix_missing_locations(node)
+    wrapper = self.parse_stmt('if ti.static(1):\n  pass')
+    wrapper.body = [node, self.parse_stmt('__ti_ensemble__.leave()')]
+    wrapper = ast.copy_location(wrapper, node)
+    ast.fix_missing_locations(wrapper)
+    self.batching = False
+    ret = self.visit(wrapper)
+    self.batching = True
+    return ret
+
+  def visit_batched_struct_for(self, node, is_grouped):
+    if isinstance(node.target, ast.Name):
+      elts = [node.target]
+    else:
+      elts = node.target.elts
+    for loop_var in elts:
+      self.check_loop_var(loop_var.id)
+    self.loop_depth += 1
+    self.generic_visit(node, ['body'])
+    self.loop_depth -= 1
+
+    vars = ', '.join(ind.id for ind in elts)
+    if is_grouped:
+      template = '''
+if 1:
+  ___loop_var = 0
+  {0} = ti.make_var_vector(
+      size=__ti_ensemble__.instance_dim(___loop_var))
+  __ti_batch = ti.Expr(ti.core.make_id_expr(""))
+  ___expr_group = ti.make_expr_group(
+      __ti_ensemble__.loop_indices(___loop_var, __ti_batch, {0}.entries))
+  ti.core.begin_frontend_struct_for(___expr_group, ___loop_var.loop_range().ptr)
+  __ti_ensemble__.enter(__ti_batch, ___loop_var)
+  ti.core.end_frontend_range_for()
+  __ti_ensemble__.leave()
+      '''.format(vars)
+      t = ast.parse(template).body[0]
+      t.body[0].value = node.iter.args[0]
+    else:
+      var_decl = ''.join(
+          '  {} = ti.Expr(ti.core.make_id_expr(""))\n'.format(ind.id)
+          for ind in elts)
+      template = '''
+if 1:
+{}
+  ___loop_var = 0
+  __ti_batch = ti.Expr(ti.core.make_id_expr(""))
+  ___expr_group = ti.make_expr_group(
+      __ti_ensemble__.loop_indices(___loop_var, __ti_batch, [{}]))
+  ti.core.begin_frontend_struct_for(___expr_group, ___loop_var.loop_range().ptr)
+  __ti_ensemble__.enter(__ti_batch, ___loop_var)
+  ti.core.end_frontend_range_for()
+  __ti_ensemble__.leave()
+      '''.format(var_decl, vars)
+      t = ast.parse(template).body[0]
+      t.body[len(elts)].value = node.iter
+    cut = len(t.body) - 2
+    t.body = t.body[:cut] + node.body + t.body[cut:]
+    for loop_var in reversed(elts):
+      t.body.append(self.parse_stmt('del {}'.format(loop_var.id)))
+    t.body.append(self.parse_stmt('del __ti_batch'))
+    return ast.copy_location(t, node)
+
   @staticmethod
   def parse_stmt(stmt):
     return ast.parse(stmt).body[0]
@@ -24,6 +24,8 @@ def is_taichi_class(rhs):
   return taichi_class
 
 
+float16 = taichi_lang_core.DataType.float16
+f16 = float16
 float32 = taichi_lang_core.DataType.float32
 f32 = float32
 float64 = taichi_lang_core.DataType.float64
@@ -36,7 +38,9 @@ i64 = int64
 
 
 def to_numpy_type(dt):
-  if dt == f32:
+  if dt == f16:
+    return np.float16
+  elif dt == f32:
     return np.float32
   elif dt == f64:
     return np.float64
@@ -50,7 +54,9 @@ def to_numpy_type(dt):
 
 def to_pytorch_type(dt):
   import torch
-  if dt == f32:
+  if dt == f16:
+    return torch.float16
+  elif dt == f32:
     return torch.float32
   elif dt == f64:
     return torch.float64
@@ -65,7 +71,9 @@ def to_pytorch_type(dt):
 def to_taichi_type(dt):
   if type(dt) == taichi_lang_core.DataType:
     return dt
-  if dt == np.float32:
+  if dt == np.float16:
+    return f16
+  elif dt == np.float32:
     return f32
   elif dt == np.float64:
     return f64
@@ -75,7 +83,9 @@ def to_taichi_type(dt):
     return i64
 
   if has_pytorch():
-    if dt == torch.float32:
+    if dt == torch.float16:
+      return f16
+    elif dt == torch.float32:
       return f32
     elif dt == torch.float64:
       return f64
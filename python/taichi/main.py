@@ -96,6 +96,10 @@ def main(debug=False):
     if test_python() != 0:
       return -1
     return test_cpp()
+  elif mode == "benchmark":
+    import subprocess
+    run = os.path.join(ti.get_repo_directory(), 'benchmarks', 'run.py')
+    return subprocess.call([sys.executable, run] + sys.argv[2:])
   elif mode == "build":
     ti.core.build()
   elif mode == "format":
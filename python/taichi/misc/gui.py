@@ -1,14 +1,20 @@
 import numbers
 
 class GUI:
-  def __init__(self, name, res=512, background_color=0x0):
+  # With threaded=True, a thread of its own draws the window and handles its
+  # events, and show() hands the frame over without waiting for the display.
+  # Frames shown faster than the display rate are dropped, and the
+  # simulation is no longer throttled to it. Not supported on macOS.
+  def __init__(self, name, res=512, background_color=0x0, threaded=False):
     import taichi as ti
     self.name = name
     if isinstance(res, numbers.Number):
       res = (res, res)
     self.res = res
-    self.core = ti.core.GUI(name, ti.veci(*res))
+    self.core = ti.core.GUI(name, ti.veci(*res), True, threaded)
     self.canvas = self.core.get_canvas()
+    self.img_buffer = None
+    self.video = None
     self.background_color = background_color
     self.clear()
     
@@ -17,43 +23,120 @@ class GUI:
       color = self.background_color
     self.canvas.clear(color)
   
+  # The f32 RGBA pixels of the window, as a numpy array of shape res + (4,)
+  # over the buffer of the GUI
+  def get_image_buffer(self):
+    if self.img_buffer is None:
+      import ctypes
+      import numpy as np
+      w, h = self.res
+      pixels = (ctypes.c_float * (w * h * 4)).from_address(
+          self.core.get_img_ptr())
+      self.img_buffer = np.ctypeslib.as_array(pixels).reshape(w, h, 4)
+    return self.img_buffer
+
+  # Tensors (scalar, or vectors with 1, 3 or 4 channels) are converted by a
+  # kernel that writes the pixels straight into the buffer of the GUI
   def set_image(self, img):
     import numpy as np
     import taichi as ti
+    from taichi.lang.meta import tensor_to_image, vector_to_image
+    buffer = self.get_image_buffer()
     if isinstance(img, ti.Matrix):
-      img = img.to_numpy(as_vector=True)
+      assert img.m == 1 and img.n in [1, 3, 4], \
+          "Image tensors must be scalars or vectors of 1, 3 or 4 channels"
+      assert img.loop_range().shape() == self.res, \
+          "Image resolution does not match GUI resolution"
+      if img.n == 1:
+        tensor_to_image(img(0), buffer)
+      else:
+        vector_to_image(img, buffer)
+      return
     if isinstance(img, ti.Expr):
-      img = img.to_numpy()
+      assert img.shape() == self.res, \
+          "Image resolution does not match GUI resolution"
+      tensor_to_image(img, buffer)
+      return
     assert isinstance(img, np.ndarray)
     assert len(img.shape) in [2, 3]
-    img = img.astype(np.float32)
+    assert img.shape[:2] == self.res, \
+        "Image resolution does not match GUI resolution"
     if len(img.shape) == 2:
       img = img[..., None]
-    if img.shape[2] == 1:
-      img = img + np.zeros(shape=(1, 1, 4))
+    assert img.shape[2] in [1, 3, 4]
+    # Converted and padded in place
     if img.shape[2] == 3:
-      img = np.concatenate([
-        img,
-        np.zeros(shape=(img.shape[0], img.shape[1], 1), dtype=np.float32)
-      ],
-        axis=2)
-    img = img.astype(np.float32)
-    assert img.shape[:2] == self.res, "Image resolution does not match GUI resolution"
-    self.core.set_img(np.ascontiguousarray(img).ctypes.data)
-    
+      buffer[..., :3] = img
+      buffer[..., 3] = 0
+    else:
+      buffer[...] = img
+
   def circle(self, pos, color, radius=1):
     import taichi as ti
     self.canvas.circle(ti.vec(pos[0],
                          pos[1])).radius(radius).color(color).finish()
     
-  def circles(self, pos, color, radius=1):
+  # Colors and radii are either one value for all, or an array with one
+  # per primitive. The primitives are drawn by one native call.
+  @staticmethod
+  def batch_attributes(n, color, radius):
+    import numpy as np
+    colors, color = GUI.batch_array(color, np.uint32, n)
+    radii, radius = GUI.batch_array(radius, np.float32, n)
+    return colors, int(color or 0), radii, float(radius or 0)
+
+  @staticmethod
+  def batch_array(value, dtype, n):
+    import numpy as np
+    if np.isscalar(value):
+      return None, value
+    value = np.ascontiguousarray(value, dtype=dtype).ravel()
+    assert len(value) == n
+    return value, None
+
+  @staticmethod
+  def batch_ptr(array):
+    return 0 if array is None else array.ctypes.data
+
+  def circles(self, pos, color=0xFFFFFF, radius=1):
+    import numpy as np
+    pos = np.ascontiguousarray(pos, dtype=np.float32).reshape(-1, 2)
+    n = len(pos)
+    colors, color, radii, radius = self.batch_attributes(n, color, radius)
+    self.canvas.circles(n, pos.ctypes.data, self.batch_ptr(colors), color,
+                        self.batch_ptr(radii), radius)
+
+  def lines(self, begin, end, color=0xFFFFFF, radius=1):
+    import numpy as np
+    begin = np.ascontiguousarray(begin, dtype=np.float32).reshape(-1, 2)
+    end = np.ascontiguousarray(end, dtype=np.float32).reshape(-1, 2)
+    assert begin.shape == end.shape
+    n = len(begin)
+    colors, color, radii, radius = self.batch_attributes(n, color, radius)
+    self.canvas.segments(n, begin.ctypes.data, end.ctypes.data,
+                         self.batch_ptr(colors), color,
+                         self.batch_ptr(radii), radius)
+
+  # Streams every frame shown to a video file, encoded by ffmpeg as the
+  # frames come, instead of a screenshot per frame. codec can be any ffmpeg
+  # encoder, e.g. 'h264_nvenc'; quality is the CRF (lower is better).
+  def start_recording(self, filename, framerate=24, codec='libx264',
+                      quality=20, queue_depth=4):
     import taichi as ti
-    for i in range(len(pos)):
-      self.canvas.circle(ti.vec(pos[i, 0],
-                                pos[i, 1])).radius(radius).color(color[i]).finish()
-    
+    self.stop_recording()
+    self.video = ti.core.VideoWriter(filename, ti.veci(*self.res), framerate,
+                                     codec, quality, queue_depth)
+
+  # Waits for the encoder to finish the file
+  def stop_recording(self):
+    if self.video is not None:
+      self.video.close()
+      self.video = None
+
   def show(self, file=None):
     self.core.update()
     if file:
       self.core.screenshot(file)
+    if self.video is not None:
+      self.video.write_gui(self.core)
     self.clear(self.background_color)
@@ -0,0 +1,54 @@
+import numpy as np
+
+
+# Decodes image files on all threads and caches up to cache_size bytes of
+# decoded images, evicting the least recently used ones. Images are in the
+# order of their files: shape (height, width, channels), from the top row.
+# channels converts them to 1 to 4 channels; 0 keeps those of the file.
+class ImageLoader:
+
+  def __init__(self, cache_size=256 * 1024 * 1024):
+    import taichi as ti
+    self.core = ti.core.ImageLoader(cache_size)
+
+  # A uint8 array, decoded on demand unless cached
+  def load(self, filename, channels=0):
+    width, height, channels, pixels = self.core.get(filename, channels)
+    return np.frombuffer(pixels, dtype=np.uint8).reshape(
+        height, width, channels)
+
+  # Decodes the images not cached yet in parallel, for later loads
+  def prefetch(self, filenames, channels=0):
+    self.core.prefetch(list(filenames), channels)
+
+  # Decodes images of the same size in parallel into the slices of out, a
+  # numpy array or a tensor of shape (n, height, width) or
+  # (n, height, width, channels): as bytes for uint8 arrays (and integer
+  # tensors), and as values in [0, 1] for float32 arrays (and f32 tensors).
+  # Decoded images also go into the cache unless cache is False, e.g. for
+  # datasets read once.
+  def load_batch(self, filenames, out, cache=True):
+    import taichi as ti
+    filenames = list(filenames)
+    if isinstance(out, np.ndarray):
+      arr = out
+    else:
+      is_float = out.snode().data_type() == ti.f32
+      arr = np.empty(out.shape(), dtype=np.float32 if is_float else np.uint8)
+    assert arr.ndim in [3, 4] and arr.shape[0] == len(filenames)
+    assert arr.dtype in [np.uint8, np.float32]
+    assert arr.flags.c_contiguous
+    channels = 1 if arr.ndim == 3 else arr.shape[3]
+    self.core.load_batch(filenames, arr.ctypes.data, arr.dtype == np.float32,
+                         arr.shape[2], arr.shape[1], channels, cache)
+    if arr is not out:
+      from taichi.lang.util import to_numpy_type
+      out.from_numpy(
+          arr.astype(to_numpy_type(out.snode().data_type()), copy=False))
+    return out
+
+  def cache_bytes(self):
+    return self.core.get_cache_bytes()
+
+  def clear(self):
+    self.core.clear()
@@ -0,0 +1,49 @@
+// Counts the statements of the IR, including those in nested blocks
+
+#include "../ir.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class StatementCounter : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+  int count;
+
+  StatementCounter() {
+    count = 0;
+  }
+
+  void visit(Block *block) override {
+    count += (int)block->statements.size();
+    for (auto &stmt : block->statements)
+      stmt->accept(this);
+  }
+
+  // Before lower_ast
+  void visit(FrontendIfStmt *stmt) override {
+    if (stmt->true_statements)
+      stmt->true_statements->accept(this);
+    if (stmt->false_statements)
+      stmt->false_statements->accept(this);
+  }
+
+  void visit(FrontendForStmt *stmt) override {
+    stmt->body->accept(this);
+  }
+
+  void visit(FrontendWhileStmt *stmt) override {
+    stmt->body->accept(this);
+  }
+};
+
+namespace analysis {
+
+int count_statements(IRNode *root) {
+  StatementCounter counter;
+  root->accept(&counter);
+  return counter.count;
+}
+
+}  // namespace analysis
+
+TLANG_NAMESPACE_END
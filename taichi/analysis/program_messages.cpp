@@ -0,0 +1,36 @@
+// Finds the statements that refer to messages registered with the program,
+// by ids only valid within it
+
+#include "../ir.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class ProgramMessageFinder : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+  bool found = false;
+
+  void visit(PrintStmt *stmt) override {
+    found = true;
+  }
+
+  void visit(AssertStmt *stmt) override {
+    found = true;
+  }
+
+  void visit(BoundCheckStmt *stmt) override {
+    found = true;
+  }
+};
+
+namespace analysis {
+
+bool has_program_messages(IRNode *root) {
+  ProgramMessageFinder finder;
+  root->accept(&finder);
+  return finder.found;
+}
+
+}  // namespace analysis
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,92 @@
+// Finds the kernels whose range-for the host can share with the GPU, see
+// CompileConfig::cpu_gpu_split
+
+#include "../ir.h"
+
+TLANG_NAMESPACE_BEGIN
+
+// Iterations may run on either device at the same time, so they must only
+// access dense fields in unified memory, without atomics (which do not work
+// across devices) or state of the runtime
+class RangeForSplitChecker : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+  bool splittable = true;
+
+  void check_snode(SNode *snode) {
+    for (auto p = snode; p; p = p->parent) {
+      if (p->need_activation())
+        splittable = false;
+    }
+  }
+
+  void visit(GlobalPtrStmt *stmt) override {
+    for (int i = 0; i < (int)stmt->snodes.size(); i++)
+      check_snode(stmt->snodes[i]);
+  }
+
+  void visit(SNodeLookupStmt *stmt) override {
+    check_snode(stmt->snode);
+  }
+
+  void visit(GetChStmt *stmt) override {
+    check_snode(stmt->output_snode);
+  }
+
+  void visit(AtomicOpStmt *stmt) override {
+    if (!stmt->dest->is<AllocaStmt>())
+      splittable = false;
+  }
+
+  void visit(ExternalPtrStmt *stmt) override {
+    splittable = false;
+  }
+
+  void visit(GlobalTemporaryStmt *stmt) override {
+    splittable = false;
+  }
+
+  void visit(SNodeOpStmt *stmt) override {
+    splittable = false;
+  }
+
+  void visit(ClearAllStmt *stmt) override {
+    splittable = false;
+  }
+
+  void visit(ArgStoreStmt *stmt) override {
+    splittable = false;
+  }
+
+  void visit(PrintStmt *stmt) override {
+    splittable = false;
+  }
+
+  void visit(AssertStmt *stmt) override {
+    splittable = false;
+  }
+
+  void visit(BoundCheckStmt *stmt) override {
+    splittable = false;
+  }
+};
+
+namespace analysis {
+
+bool is_splittable_range_for(IRNode *root) {
+  auto block = dynamic_cast<Block *>(root);
+  if (!block || block->statements.size() != 1)
+    return false;
+  auto offloaded = block->statements[0]->cast<OffloadedStmt>();
+  if (!offloaded ||
+      offloaded->task_type != OffloadedStmt::TaskType::range_for ||
+      !offloaded->const_begin || !offloaded->const_end)
+    return false;
+  RangeForSplitChecker checker;
+  root->accept(&checker);
+  return checker.splittable;
+}
+
+}  // namespace analysis
+
+TLANG_NAMESPACE_END
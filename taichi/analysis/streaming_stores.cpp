@@ -0,0 +1,74 @@
+// Finds the stores that can bypass the caches on CPUs, see
+// CompileConfig::cpu_streaming_stores
+
+#include "../ir.h"
+
+TLANG_NAMESPACE_BEGIN
+
+// Stores at the top level of the loop body, which then writes a cell each
+// iteration, to fields that the task never reads
+class StreamingStoreFinder : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+  Block *loop_body;
+  std::set<SNode *> read;
+  std::vector<GlobalStoreStmt *> candidates;
+  // Set when memory is read through a pointer of unknown origin
+  bool unknown = false;
+
+  StreamingStoreFinder(Block *loop_body) : loop_body(loop_body) {
+  }
+
+  static SNode *field_of(Stmt *ptr) {
+    auto get_ch = ptr->cast<GetChStmt>();
+    if (!get_ch || get_ch->output_snode->type != SNodeType::place)
+      return nullptr;
+    return get_ch->output_snode;
+  }
+
+  void load(Stmt *ptr) {
+    if (auto field = field_of(ptr))
+      read.insert(field);
+    else if (!ptr->is<AllocaStmt>() && !ptr->is<ExternalPtrStmt>() &&
+             !ptr->is<GlobalTemporaryStmt>())
+      unknown = true;
+  }
+
+  void visit(GlobalLoadStmt *stmt) override {
+    load(stmt->ptr);
+  }
+
+  void visit(AtomicOpStmt *stmt) override {
+    load(stmt->dest);
+  }
+
+  void visit(GlobalStoreStmt *stmt) override {
+    auto field = field_of(stmt->ptr);
+    if (field && !field->is_bit_field() && stmt->width() == 1 &&
+        stmt->parent == loop_body)
+      candidates.push_back(stmt);
+  }
+};
+
+namespace analysis {
+
+std::set<Stmt *> gather_streaming_stores(OffloadedStmt *stmt) {
+  using Type = OffloadedStmt::TaskType;
+  std::set<Stmt *> ret;
+  if (stmt->task_type != Type::range_for &&
+      stmt->task_type != Type::struct_for)
+    return ret;
+  StreamingStoreFinder finder(stmt->body.get());
+  stmt->accept(&finder);
+  if (finder.unknown)
+    return ret;
+  for (auto store : finder.candidates) {
+    if (!finder.read.count(StreamingStoreFinder::field_of(store->ptr)))
+      ret.insert(store);
+  }
+  return ret;
+}
+
+}  // namespace analysis
+
+TLANG_NAMESPACE_END
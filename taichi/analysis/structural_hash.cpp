@@ -0,0 +1,42 @@
+// This analysis hashes the structure of the IR, so that kernels with identical
+// lowered IR can share one compiled binary.
+
+#include <xxhash.h>
+#include "../ir.h"
+
+TLANG_NAMESPACE_BEGIN
+
+// IRPrinter formats floating point constants with limited precision, so the
+// exact bits of all constants are collected separately.
+class ConstantBitsCollector : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+  std::string bits;
+
+  void visit(ConstStmt *stmt) override {
+    for (int i = 0; i < stmt->width(); i++) {
+      auto &val = stmt->val[i];
+      uint64 b = val.value_bits;
+      if (data_type_size(val.dt) == 4)
+        b &= 0xffffffffULL;
+      bits += fmt::format("{}:{:x};", data_type_name(val.dt), b);
+    }
+  }
+};
+
+namespace analysis {
+
+std::string structural_hash(IRNode *root) {
+  // Statement ids are part of the printed IR
+  irpass::re_id(root);
+  std::string ir_str;
+  irpass::print(root, &ir_str);
+  ConstantBitsCollector collector;
+  root->accept(&collector);
+  ir_str += collector.bits;
+  return fmt::format("{:016x}", (uint64)XXH64(ir_str.data(), ir_str.size(), 0));
+}
+
+}  // namespace analysis
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,102 @@
+// Estimates the memory traffic and floating point operations of an offloaded
+// task, for the bandwidth and roofline figures of the kernel profiler
+
+#include "../ir.h"
+#include <map>
+#include <set>
+
+TLANG_NAMESPACE_BEGIN
+
+class GatherTaskTraffic : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+
+  // Place SNodes, or -1 - arg_id for external arrays, with their element size
+  std::map<int64, int> sizes;
+  std::set<int64> reads, writes;
+  // Per iteration, counting the body of inner loops once
+  uint64 flops = 0;
+
+  void access(Stmt *ptr, DataType dt, bool read, bool write) {
+    int64 key;
+    if (auto get_ch = ptr->cast<GetChStmt>()) {
+      key = get_ch->output_snode->id;
+      dt = get_ch->output_snode->dt;
+    } else if (auto global_ptr = ptr->cast<GlobalPtrStmt>()) {
+      key = global_ptr->snodes[0]->id;
+      dt = global_ptr->snodes[0]->dt;
+    } else if (auto external_ptr = ptr->cast<ExternalPtrStmt>()) {
+      key = -1 - external_ptr->base_ptrs[0]->as<ArgLoadStmt>()->arg_id;
+    } else {
+      return;
+    }
+    sizes[key] = data_type_size(dt);
+    if (read)
+      reads.insert(key);
+    if (write)
+      writes.insert(key);
+  }
+
+  void visit(GlobalLoadStmt *stmt) override {
+    access(stmt->ptr, stmt->ret_type.data_type, true, false);
+  }
+
+  void visit(GlobalStoreStmt *stmt) override {
+    access(stmt->ptr, stmt->data->ret_type.data_type, false, true);
+  }
+
+  void visit(AtomicOpStmt *stmt) override {
+    access(stmt->dest, stmt->val->ret_type.data_type, true, true);
+    if (is_real(stmt->val->ret_type.data_type))
+      flops += stmt->width();
+  }
+
+  // Comparisons return integers and are not counted
+  void visit(BinaryOpStmt *stmt) override {
+    if (is_real(stmt->ret_type.data_type))
+      flops += stmt->width();
+  }
+
+  void visit(UnaryOpStmt *stmt) override {
+    if (is_real(stmt->ret_type.data_type) &&
+        stmt->op_type != UnaryOpType::cast)
+      flops += stmt->width();
+  }
+};
+
+namespace analysis {
+
+TaskTraffic estimate_task_traffic(OffloadedStmt *stmt) {
+  using Type = OffloadedStmt::TaskType;
+  TaskTraffic traffic;
+  if (stmt->task_type == Type::serial) {
+    traffic.num_elements = 1;
+  } else if (stmt->task_type == Type::range_for) {
+    // Unknown for bounds read at run time
+    if (stmt->const_begin && stmt->const_end)
+      traffic.num_elements = std::abs(stmt->end - stmt->begin);
+  } else if (stmt->task_type == Type::struct_for) {
+    // The cells of the leaf blocks, only known for dense trees
+    traffic.num_elements = 1;
+    for (auto s = stmt->snode->parent; s->type != SNodeType::root;
+         s = s->parent) {
+      if (s->type != SNodeType::dense)
+        traffic.num_elements = 0;
+      traffic.num_elements *= s->n;
+    }
+  }
+  if (traffic.num_elements == 0)
+    return traffic;
+  GatherTaskTraffic gather;
+  stmt->accept(&gather);
+  for (auto key : gather.reads)
+    traffic.bytes_read += gather.sizes[key] * traffic.num_elements;
+  for (auto key : gather.writes)
+    traffic.bytes_written += gather.sizes[key] * traffic.num_elements;
+  traffic.flops = gather.flops * traffic.num_elements;
+  return traffic;
+}
+
+}  // namespace analysis
+
+TLANG_NAMESPACE_END
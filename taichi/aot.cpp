@@ -0,0 +1,155 @@
+// Ahead-of-time modules: the SNode tree of a program and some of its compiled
+// kernels in one file
+
+#include <fstream>
+#include <iomanip>
+#include "aot.h"
+#include "program.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+constexpr int aot_version = 5;
+
+// Everything the struct compiler reads, before the properties it infers
+void write_snode(std::ostream &out, SNode &snode) {
+  out << (int)snode.type << " " << snode.id << " " << std::quoted(snode.name)
+      << " " << snode.n << " " << snode.chunk_size << " "
+      << snode.hash_capacity << " " << snode.index_id << " " << snode._morton
+      << " " << snode._bitmasked << " " << (int)snode.dt << " "
+      << snode.quant.num_bits << " " << snode.quant.is_signed << " "
+      << snode.quant.scale << " " << snode.data_bit_offset << " "
+      << snode.has_ambient << " " << (int)snode.ambient_val.dt << " "
+      << snode.ambient_val.value_bits << " " << snode._halo << " "
+      << snode._geometric;
+  for (int i = 0; i < max_num_indices; i++) {
+    auto &e = snode.extractors[i];
+    out << " " << e.active << " " << e.num_bits << " " << e.num_elements;
+  }
+  out << " " << snode.ch.size() << "\n";
+  for (auto &c : snode.ch)
+    write_snode(out, *c);
+}
+
+// Reads what follows the type, which the parent needs to create the node
+void read_snode(std::istream &in, SNode &snode, int &max_id) {
+  int dt, ambient_dt;
+  uint64 ambient_bits;
+  std::size_t num_children;
+  in >> snode.id >> std::quoted(snode.name) >> snode.n >> snode.chunk_size >>
+      snode.hash_capacity >> snode.index_id >> snode._morton >>
+      snode._bitmasked >> dt >> snode.quant.num_bits >>
+      snode.quant.is_signed >> snode.quant.scale >> snode.data_bit_offset >>
+      snode.has_ambient >> ambient_dt >> ambient_bits >> snode._halo >>
+      snode._geometric;
+  for (int i = 0; i < max_num_indices; i++) {
+    auto &e = snode.extractors[i];
+    in >> e.active >> e.num_bits >> e.num_elements;
+  }
+  in >> num_children;
+  TC_ERROR_UNLESS(in, "Corrupted AOT module");
+  snode.dt = (DataType)dt;
+  snode.ambient_val = TypedConstant((DataType)ambient_dt);
+  snode.ambient_val.value_bits = ambient_bits;
+  // Kernels refer to SNodes by id
+  snode.node_type_name = snode.get_node_type_name();
+  max_id = std::max(max_id, snode.id);
+  for (std::size_t i = 0; i < num_children; i++) {
+    int type;
+    in >> type;
+    auto &child = snode.insert_children((SNodeType)type);
+    read_snode(in, child, max_id);
+    snode.taken_data_bits += child.quant.num_bits;
+  }
+}
+
+}  // namespace
+
+void AotModule::save(Program &program,
+                     const std::map<std::string, Kernel *> &kernels,
+                     const std::string &fn) {
+  std::ofstream fout(fn, std::ios::binary);
+  TC_ERROR_UNLESS(fout, "Failed to write AOT module {}", fn);
+  fout << std::setprecision(17);
+  fout << "taichi_aot " << aot_version << " " << get_commit_hash() << " "
+       << arch_name(program.config.arch) << "\n";
+  write_snode(fout, *program.snode_root);
+  fout << kernels.size() << "\n";
+  for (auto &kv : kernels) {
+    auto kernel = kv.second;
+    kernel->compile();
+    OfflineCache::Entry entry;
+    TC_ERROR_UNLESS(!kernel->offline_cache_key.empty() &&
+                        OfflineCache::load(kernel->offline_cache_key, entry),
+                    "Kernel {} was not compiled with use_offline_cache",
+                    kernel->name);
+    fout << std::quoted(kv.first) << " " << kernel->args.size();
+    for (auto &arg : kernel->args) {
+      fout << " " << (int)arg.dt << " " << arg.is_nparray << " "
+           << arg.is_return_value << " " << arg.is_nparray_read << " "
+           << arg.is_nparray_written;
+    }
+    fout << "\n";
+    OfflineCache::write_entry(fout, entry);
+    fout << "\n";
+  }
+  TC_ERROR_UNLESS(fout, "Failed to write AOT module {}", fn);
+}
+
+AotModule::AotModule(Program &program, const std::string &fn) {
+  std::ifstream fin(fn, std::ios::binary);
+  TC_ERROR_UNLESS(fin, "Failed to open AOT module {}", fn);
+  std::string magic, commit, arch;
+  int version;
+  fin >> magic >> version >> commit >> arch;
+  TC_ERROR_UNLESS(magic == "taichi_aot" && version == aot_version &&
+                      commit == get_commit_hash(),
+                  "{} was not saved by this version of Taichi", fn);
+  TC_ERROR_UNLESS(arch == arch_name(program.config.arch),
+                  "{} was compiled for {}, not {}", fn, arch,
+                  arch_name(program.config.arch));
+  program.layout([&] {
+    int type, max_id = 0;
+    fin >> type;
+    TC_ERROR_UNLESS(fin && type == (int)SNodeType::root,
+                    "Corrupted AOT module {}", fn);
+    read_snode(fin, *program.snode_root, max_id);
+    SNode::counter = std::max(SNode::counter, max_id + 1);
+  });
+  std::size_t num_kernels;
+  fin >> num_kernels;
+  for (std::size_t i = 0; i < num_kernels; i++) {
+    std::string name;
+    std::size_t num_args;
+    fin >> std::quoted(name) >> num_args;
+    std::vector<Kernel::Arg> args(num_args);
+    for (auto &arg : args) {
+      int dt;
+      fin >> dt >> arg.is_nparray >> arg.is_return_value >>
+          arg.is_nparray_read >> arg.is_nparray_written;
+      arg.dt = (DataType)dt;
+    }
+    auto entry = std::make_shared<OfflineCache::Entry>();
+    TC_ERROR_UNLESS(fin && OfflineCache::read_entry(fin, *entry),
+                    "Corrupted AOT module {}", fn);
+    // The entry must be set before the kernel is compiled, possibly right
+    // after its definition
+    kernels[name] = &program.kernel(
+        [&] {
+          auto &kernel = program.get_current_kernel();
+          kernel.args = args;
+          kernel.aot_entry = entry;
+        },
+        name);
+  }
+}
+
+Kernel &AotModule::get_kernel(const std::string &name) {
+  auto it = kernels.find(name);
+  TC_ERROR_UNLESS(it != kernels.end(), "No kernel named {} in the AOT module",
+                  name);
+  return *it->second;
+}
+
+TLANG_NAMESPACE_END
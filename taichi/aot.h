@@ -0,0 +1,33 @@
+// Ahead-of-time modules: the SNode tree of a program and some of its compiled
+// kernels in one file, which can be loaded into a program without the Python
+// frontend
+#pragma once
+
+#include <map>
+#include <string>
+#include "tlang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class Program;
+class Kernel;
+
+class AotModule {
+ public:
+  // The kernels must have been compiled by the LLVM backends with
+  // CompileConfig::use_offline_cache, which keeps the object code (or PTX).
+  static void save(Program &program,
+                   const std::map<std::string, Kernel *> &kernels,
+                   const std::string &fn);
+
+  // Materializes the saved SNode tree as the layout of the program, which must
+  // not have a layout yet
+  AotModule(Program &program, const std::string &fn);
+
+  Kernel &get_kernel(const std::string &name);
+
+ private:
+  std::map<std::string, Kernel *> kernels;
+};
+
+TLANG_NAMESPACE_END
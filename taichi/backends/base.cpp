@@ -4,7 +4,10 @@
 #if !defined(TC_PLATFORM_WINDOWS)
 #include <xxhash.h>
 #endif
+#include <atomic>
+#include <cstdio>
 #include <sstream>
+#include <thread>
 #include <taichi/system/timer.h>
 
 TLANG_NAMESPACE_BEGIN
@@ -75,53 +78,109 @@ std::string CodeGenBase::get_source_name() {
   return fmt::format("tmp{:04d}.{}", id, suffix);
 }
 
-void CodeGenBase::generate_binary(std::string extra_flags) {
+std::string CodeGenBase::get_pch_flags(CompileConfig &config,
+                                       const std::string &extra_flags) {
+  if (pch_defines.empty() || !config.use_precompiled_headers ||
+      config.arch != Arch::x86_64)
+    return "";
+#if !defined(_WIN32)
+  // Built once per process for each set of flags, and kept in the binary
+  // database. The header is hashed after preprocessing so that editing the
+  // runtime rebuilds it.
+  static std::mutex mut;
+  static std::map<std::string, std::string> built;
+  std::lock_guard<std::mutex> _(mut);
+  auto flags = pch_defines + " " + extra_flags;
+  if (built.find(flags) != built.end())
+    return built[flags];
+  auto &ret = built[flags];
+  auto header = get_repo_dir() + "/taichi/legacy_kernel.h";
+  auto pp_fn = folder + "/legacy_kernel.h.i";
+  auto preprocess_cmd = config.preprocess_cmd(header, pp_fn, flags);
+  if (std::system(preprocess_cmd.c_str()) == 0) {
+    std::ifstream ifs(pp_fn);
+    auto hash_input =
+        preprocess_cmd + std::string(std::istreambuf_iterator<char>(ifs),
+                                     std::istreambuf_iterator<char>());
+    auto hash = XXH64(hash_input.data(), hash_input.size(), 0);
+    auto dir = db_folder() + fmt::format("/pch/{}", hash);
+    // GCC takes the .gch when including the header from the directory, clang
+    // needs the file named
+    bool clang = config.compiler_name().find("clang") == 0;
+    auto pch_fn = dir + (clang ? "/legacy_kernel.h.pch"
+                               : "/taichi/legacy_kernel.h.gch");
+    bool ready = (bool)std::ifstream(pch_fn);
+    if (!ready) {
+      create_directories(dir + "/taichi");
+      // Includes after the first find the header itself, which they skip as
+      // already included
+      trash(std::system(
+          fmt::format("ln -sf {} {}/taichi/legacy_kernel.h", header, dir)
+              .c_str()));
+      // Other processes may be reading the final name
+      auto tmp_fn = pch_fn + ".tmp";
+      auto cmd = config.precompile_header_cmd(header, tmp_fn, flags);
+      ready = std::system(cmd.c_str()) == 0 &&
+              std::rename(tmp_fn.c_str(), pch_fn.c_str()) == 0;
+    }
+    if (ready) {
+      ret = pch_defines + " " +
+            (clang ? fmt::format("-include-pch {}", pch_fn)
+                   : fmt::format("-I{}", dir));
+    }
+  }
+  std::remove(pp_fn.c_str());
+  if (ret.empty())
+    TC_WARN("Failed to precompile {}. Compiling kernels without it.", header);
+  return ret;
+#else
+  return "";
+#endif
+}
+
+std::string CodeGenBase::compile_binary(CompileConfig &config,
+                                        const std::string &extra_flags,
+                                        const std::string &pch_flags) {
 #if !defined(_WIN32)
-  auto t = Time::get_time();
   write_source();
   auto format_ret =
       std::system(fmt::format("clang-format -i {}", get_source_path()).c_str());
   trash(format_ret);
   auto pp_fn = get_source_path() + ".i";
-  auto preprocess_cmd = get_current_program().config.preprocess_cmd(
-      get_source_path(), pp_fn, extra_flags);
+  // Without pch_flags: binaries built with and without precompiled headers
+  // are the same
+  auto preprocess_cmd =
+      config.preprocess_cmd(get_source_path(), pp_fn, extra_flags);
   auto ret = std::system(preprocess_cmd.c_str());
   if (ret) {
     trash(std::system(
-        get_current_program()
-            .config.preprocess_cmd(get_source_path(), pp_fn, extra_flags, true)
+        config.preprocess_cmd(get_source_path(), pp_fn, extra_flags, true)
             .c_str()));
-    TC_ERROR("Preprocessing failed.");
+    return fmt::format("Preprocessing {} failed.", get_source_path());
   }
   std::ifstream ifs(pp_fn);
   TC_ASSERT(ifs);
   auto hash_input =
       preprocess_cmd + std::string(std::istreambuf_iterator<char>(ifs),
                                    std::istreambuf_iterator<char>());
-  // TC_P(preprocess_cmd);
   auto hash = XXH64(hash_input.data(), hash_input.size(), 0);
-  // TC_P(hash);
 
+  std::string error;
   std::string cached_binary_fn = db_folder() + fmt::format("/{}.so", hash);
   std::ifstream key_file(cached_binary_fn);
   if (key_file) {
     trash(std::system(
         fmt::format("cp {} {}", cached_binary_fn, get_library_path()).c_str()));
   } else {
-    /*
-    trash(std::system(
-        fmt::format("cp {} {}", get_source_path(), get_source_path())
-            .c_str()));
-            */
-    auto cmd = get_current_program().config.compile_cmd(
-        get_source_path(), get_library_path(), extra_flags);
+    auto cmd = config.compile_cmd(get_source_path(), get_library_path(),
+                                  extra_flags, false, pch_flags);
     auto compile_ret = std::system(cmd.c_str());
     if (compile_ret != 0) {
       TC_WARN("Compilation cmd: {}", cmd);
-      auto cmd = get_current_program().config.compile_cmd(
-          get_source_path(), get_library_path(), extra_flags, true);
+      auto cmd = config.compile_cmd(get_source_path(), get_library_path(),
+                                    extra_flags, true, pch_flags);
       trash(std::system(cmd.c_str()));
-      TC_ERROR("Source {} compilation failed.", get_source_path());
+      error = fmt::format("Source {} compilation failed.", get_source_path());
     } else {
       trash(std::system(
           fmt::format("cp {} {}", get_library_path(), cached_binary_fn)
@@ -129,12 +188,47 @@ void CodeGenBase::generate_binary(std::string extra_flags) {
     }
   }
   trash(std::system(fmt::format("rm {}", pp_fn).c_str()));
-  TC_INFO("Compilation time: {:.1f} ms", 1000 * (Time::get_time() - t));
+  return error;
 #else
   TC_NOT_IMPLEMENTED
+  return "";
 #endif
 }
 
+void CodeGenBase::generate_binary(std::string extra_flags) {
+  generate_binaries({this}, extra_flags);
+}
+
+void CodeGenBase::generate_binaries(const std::vector<CodeGenBase *> &codegens,
+                                    const std::string &extra_flags) {
+  auto t = Time::get_time();
+  auto &config = get_current_program().config;
+  int n = (int)codegens.size();
+  std::vector<std::string> pch_flags(n), errors(n);
+  for (int i = 0; i < n; i++)
+    pch_flags[i] = codegens[i]->get_pch_flags(config, extra_flags);
+  // One compiler process per hardware thread
+  std::atomic<int> next(0);
+  auto worker = [&] {
+    for (int i = next++; i < n; i = next++)
+      errors[i] =
+          codegens[i]->compile_binary(config, extra_flags, pch_flags[i]);
+  };
+  int num_threads =
+      std::min(n, std::max(1, (int)std::thread::hardware_concurrency()));
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_threads; i++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto &thread : threads)
+    thread.join();
+  for (auto &error : errors) {
+    if (!error.empty())
+      TC_ERROR("{}", error);
+  }
+  TC_INFO("Compilation time: {:.1f} ms", 1000 * (Time::get_time() - t));
+}
+
 CodeGenBase::~CodeGenBase() {
 }
 
@@ -20,6 +20,9 @@ class CodeGenBase {
   std::string folder;
   std::string func_name;
   std::string suffix;
+  // Defined ahead of taichi/legacy_kernel.h in the source, as -D flags for
+  // the precompiled header. None if empty.
+  std::string pch_defines;
 
   enum class CodeRegion : int {
     header,
@@ -127,11 +130,27 @@ class CodeGenBase {
 
   FunctionType load_function();
 
+  // The flags to compile with a precompiled taichi/legacy_kernel.h, built on
+  // first use. Empty if there is none.
+  std::string get_pch_flags(CompileConfig &config,
+                            const std::string &extra_flags);
+
+  // Writes the source and compiles it, unless the binary database has it.
+  // Returns the error, or an empty string.
+  std::string compile_binary(CompileConfig &config,
+                             const std::string &extra_flags,
+                             const std::string &pch_flags);
+
   void generate_binary(std::string extra_flags);
 
+  // Compiles the sources of the code generators by concurrent compiler
+  // processes
+  static void generate_binaries(const std::vector<CodeGenBase *> &codegens,
+                                const std::string &extra_flags);
+
   void disassemble();
 
-  ~CodeGenBase();
+  virtual ~CodeGenBase();
 };
 
 inline std::vector<std::string> indices_str(SNode *snode,
@@ -281,7 +281,7 @@ class GPUIRCodeGen : public IRVisitor {
         emit(
             R"(std::cout << "     device only : " << milliseconds << " ms\n";)");
 
-        if (current_program->current_kernel->benchmarking) {
+        if (current_program->get_current_kernel().benchmarking) {
           emit("cudaDeviceSynchronize();\n");
           emit("auto err = cudaGetLastError();");
           emit("if (err) {{");
@@ -992,6 +992,13 @@ void GPUCodeGen::lower_cuda() {
   if (prog->config.print_ir) {
     irpass::print(ir);
   }
+  if (prog->config.struct_for_fusion) {
+    irpass::fuse_struct_fors(ir);
+    if (prog->config.print_ir) {
+      irpass::re_id(ir);
+      irpass::print(ir);
+    }
+  }
   irpass::constant_fold(ir);
   if (prog->config.simplify_before_lower_access) {
     irpass::simplify(ir);
@@ -1005,7 +1012,7 @@ void GPUCodeGen::lower_cuda() {
     // irpass::re_id(ir);
     // TC_TRACE("Primal:");
     // irpass::print(ir);
-    irpass::make_adjoint(ir);
+    irpass::make_adjoint(ir, kernel->keep_primal);
     irpass::typecheck(ir);
     // irpass::re_id(ir);
     // TC_TRACE("Adjoint:");
@@ -1050,105 +1057,82 @@ void GPUCodeGen::lower_cuda() {
 
 void GPUCodeGen::lower_llvm() {
   auto ir = kernel->ir;
-  if (prog->config.print_ir) {
-    irpass::print(ir);
-  }
+  begin_passes();
   irpass::lower(ir);
-  irpass::re_id(ir);
-  if (prog->config.print_ir) {
-    irpass::print(ir);
-  }
+  end_pass("Lowered");
   irpass::typecheck(ir);
-  irpass::re_id(ir);
-  if (prog->config.print_ir) {
-    irpass::print(ir);
-  }
+  end_pass("Typechecked");
   irpass::constant_fold(ir);
+  end_pass("Constant folded");
   if (prog->config.simplify_before_lower_access) {
     irpass::simplify(ir);
-    irpass::re_id(ir);
-    if (prog->config.print_ir) {
-      TC_TRACE("Simplified I:");
-      irpass::print(ir);
-    }
+    end_pass("Simplified I");
   }
   if (kernel->grad) {
-    // irpass::re_id(ir);
-    // TC_TRACE("Primal:");
-    // irpass::print(ir);
+    // Differentiated entry by entry
+    irpass::scalarize(ir);
     irpass::demote_atomics(ir);
     irpass::full_simplify(ir);
     irpass::typecheck(ir);
-    if (prog->config.print_ir) {
-      TC_TRACE("Before make_adjoint:");
-      irpass::print(ir);
-    }
-    irpass::make_adjoint(ir);
-    if (prog->config.print_ir) {
-      TC_TRACE("After make_adjoint:");
-      irpass::print(ir);
-    }
+    end_pass("Before make_adjoint");
+    irpass::make_adjoint(ir, kernel->keep_primal);
+    end_pass("After make_adjoint");
     irpass::typecheck(ir);
-    // irpass::re_id(ir);
-    // TC_TRACE("Adjoint:");
-    // irpass::print(ir);
+    end_pass("Adjoint typechecked");
+    // Primal loads nothing uses would otherwise get scratch pads
+    irpass::die(ir);
+    end_pass("DIEd");
+  }
+  if (prog->config.check_out_of_bound) {
+    irpass::check_out_of_bound(ir);
+    end_pass("Bound Checked");
+  }
+  irpass::forward_global_accesses(ir);
+  end_pass("Global Accesses Forwarded");
+  if (prog->config.struct_for_fusion) {
+    irpass::fuse_struct_fors(ir);
+    end_pass("Struct-fors fused");
+  }
+  if (prog->config.gpu_fission_live_values > 0) {
+    irpass::fission_struct_fors(ir, prog->config.gpu_fission_live_values);
+    end_pass("Struct-fors split");
   }
+  irpass::insert_scratch_pads(ir);
+  end_pass("Scratch Pads Inserted");
   if (prog->config.lower_access || prog->config.use_llvm) {
     // TC_DEBUG("Always lower access when using llvm");
     irpass::lower_access(ir, prog->config.use_llvm);
-    if (prog->config.print_ir) {
-      TC_TRACE("Access Lowered:");
-      irpass::re_id(ir);
-      irpass::print(ir);
-    }
+    end_pass("Access Lowered");
     if (prog->config.simplify_after_lower_access) {
       irpass::die(ir);
-      if (prog->config.print_ir) {
-        TC_TRACE("DIEd:");
-        irpass::re_id(ir);
-        irpass::print(ir);
-      }
+      end_pass("DIEd");
       irpass::simplify(ir);
-      if (prog->config.print_ir) {
-        TC_TRACE("Simplified II:");
-        irpass::re_id(ir);
-        irpass::print(ir);
-      }
+      end_pass("Simplified II");
     }
   }
   irpass::die(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("DIEd:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("DIEd");
   irpass::flag_access(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("Access Flagged:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
-  irpass::offload(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("Offloaded:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("Access Flagged");
+  kernel->temporaries_size = irpass::offload(ir);
+  end_pass("Offloaded");
   irpass::demote_atomics(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("Atomics Demoted:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("Atomics Demoted");
   irpass::full_simplify(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("Simplified III:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("Simplified III");
+  irpass::reduce_strength(ir);
+  end_pass("Strength reduced");
+  irpass::scalarize(ir);
+  end_pass("Scalarized");
   if (kernel->grad) {
     irpass::reverse_offloads(ir);
+    end_pass("Offloads reversed");
   }
+  kernel->num_offloaded_tasks =
+      (int)dynamic_cast<Block *>(ir)->statements.size();
+  kernel->accesses = analysis::gather_accesses(ir);
+  kernel->splittable =
+      kernel->host_twin && analysis::is_splittable_range_for(ir);
 }
 
 void GPUCodeGen::lower() {
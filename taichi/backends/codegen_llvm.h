@@ -10,6 +10,8 @@
 #include "../tlang_util.h"
 
 #include "llvm_codegen_utils.h"
+#include "llvm_source_lines.h"
+#include "offline_cache.h"
 
 TLANG_NAMESPACE_BEGIN
 
@@ -27,11 +29,35 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
   llvm::Type *physical_coordinate_ty;
 
   llvm::Value *current_coordinates;
+  // The coordinates of the first cell of the current leaf block
+  llvm::Value *block_corner_coordinates;
+  // The Element of the leaf block in struct-for bodies, nullptr elsewhere
+  llvm::Value *current_element;
   llvm::BasicBlock *while_after_loop;
   llvm::FunctionType *task_function_type;
   OffloadedStmt *current_offloaded_stmt;
   SNodeAttributes &snode_attr;
   int task_counter;
+  // Counter-based RNG: the index of the current loop iteration, and the
+  // number of random numbers it has drawn so far (an alloca)
+  llvm::Value *rand_iteration;
+  llvm::Value *rand_counter;
+  // Atomic operations executed by the current task function on CPUs (an
+  // alloca), see RuntimeCounters::atomic_ops
+  llvm::Value *num_atomic_ops;
+  // The entries of the products of the MatmulStmts for the tensor cores,
+  // which irpass::scalarize leaves to the codegen
+  std::unordered_map<Stmt *, std::vector<llvm::Value *>> matmul_results;
+  // The TBAA tags of the fields (by SNode id) and of the external arrays (-1)
+  std::map<int, llvm::MDNode *> alias_tags;
+  // Of the current offloaded statement (task_accesses_stmt), for its loads
+  // that can be marked invariant
+  KernelAccesses task_accesses;
+  OffloadedStmt *task_accesses_stmt = nullptr;
+  // Of the current task, see CompileConfig::cpu_streaming_stores
+  std::set<Stmt *> streaming_stores;
+  // Set once the current loop body function emitted one of them
+  bool emitted_streaming_stores = false;
 
   using ModuleBuilder::call;
 
@@ -61,10 +87,31 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
 
     int block_dim;
     int grid_dim;
+    // The number of iterations of a GPU range-for without an explicit
+    // block_dim, whose block size is then picked on module load. 0 otherwise.
+    int auto_block_dim_range;
+    // Runs on the CPU thread pool together with the next task
+    bool concurrent_with_next;
+    // Of parallel CPU loops, 1 for the other tasks
+    int num_cpu_threads;
     void *cuda_func;
+    // For the kernel profiler
+    TaskTraffic traffic;
+    // Of GPU tasks, set on module load
+    TaskResources resources;
+    // Of tasks emitted to the module that other kernels may reuse, see
+    // reuse_compiled_task. Empty otherwise.
+    std::string cache_key;
+    TaskStructure structure;
 
     OffloadedTask(CodeGenLLVM *codegen) : codegen(codegen) {
       func = nullptr;
+      block_dim = 0;
+      grid_dim = 0;
+      auto_block_dim_range = 0;
+      concurrent_with_next = false;
+      num_cpu_threads = 1;
+      cuda_func = nullptr;
     }
 
     void begin(const std::string &name) {
@@ -76,7 +123,9 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
     }
 
     void compile() {
-      TC_ASSERT(!func);
+      // Reused tasks come compiled
+      if (func)
+        return;
       auto kernel_symbol = codegen->jit->lookup(name);
       TC_ASSERT_INFO(kernel_symbol, "Function not found");
 
@@ -85,23 +134,33 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
 
     void operator()(Context *context) {
       TC_ASSERT(func);
+      Timeline::Guard _(name, "task");
       func(context);
     }
   };
 
   std::unique_ptr<OffloadedTask> current_task;
   std::vector<OffloadedTask> offloaded_tasks;
+  // Non-empty if the compiled kernel should go to the offline cache
+  std::string offline_cache_key;
+  // See CompileConfig::profile_source_lines
+  std::unique_ptr<SourceLineDebugInfo> source_lines;
 
   CodeGenLLVM(CodeGenBase *codegen, Kernel *kernel)
       // TODO: simplify ModuleBuilder ctor input
       : ModuleBuilder(get_current_program()
                           .get_llvm_context(kernel->arch)
-                          ->clone_struct_module()),
+                          ->clone_struct_module_declarations()),
         kernel(kernel),
         snode_attr(
             get_current_program().get_llvm_context(kernel->arch)->snode_attr),
         task_counter(0) {
     initialize_context();
+    rand_iteration = nullptr;
+    rand_counter = nullptr;
+    num_atomic_ops = nullptr;
+    block_corner_coordinates = nullptr;
+    current_element = nullptr;
 
     context_ty = get_runtime_type("Context");
     physical_coordinate_ty = get_runtime_type("PhysicalCoordinates");
@@ -109,16 +168,16 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
 
     using namespace llvm;
 
-    for (auto &f : *module) {
-      if (!f.isDeclaration())
-        f.setLinkage(Function::PrivateLinkage);  // to avoid duplicated symbols
-    }
-
     std::string grad_suffix;
     if (kernel->grad) {
       grad_suffix = "_grad";
     }
     kernel_name = kernel->name + grad_suffix + "_kernel";
+    if (kernel->arch == Arch::x86_64 &&
+        get_current_program().config.profile_source_lines) {
+      source_lines =
+          std::make_unique<SourceLineDebugInfo>(module.get(), kernel_name);
+    }
   }
 
   llvm::Value *get_arg(int i) {
@@ -203,6 +262,7 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
     } else if (snode->type == SNodeType::pointer) {
       meta = std::make_unique<RuntimeObject>("PointerMeta", this, builder);
       emit_struct_meta_base("Pointer", meta->ptr, snode);
+      meta->call("set_compressed", tlctx->get_constant(snode->_compressed));
     } else if (snode->type == SNodeType::root) {
       meta = std::make_unique<RuntimeObject>("RootMeta", this, builder);
       emit_struct_meta_base("Root", meta->ptr, snode);
@@ -210,6 +270,12 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
       meta = std::make_unique<RuntimeObject>("DynamicMeta", this, builder);
       emit_struct_meta_base("Dynamic", meta->ptr, snode);
       meta->call("set_chunk_size", tlctx->get_constant(snode->chunk_size));
+      meta->call("set_geometric", tlctx->get_constant((int)snode->_geometric));
+    } else if (snode->type == SNodeType::hash) {
+      meta = std::make_unique<RuntimeObject>("HashMeta", this, builder);
+      emit_struct_meta_base("Hash", meta->ptr, snode);
+      meta->call("set_capacity",
+                 tlctx->get_constant(snode->get_hash_capacity()));
     } else {
       TC_P(snode_type_name(snode->type));
       TC_NOT_IMPLEMENTED;
@@ -227,22 +293,390 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
     kernel->ir->accept(this);
   }
 
+  // Records the time since |start_time| as a compilation stage, see
+  // CompileConfig::profile_compilation
+  void record_stage(const std::string &name, float64 start_time) {
+    get_current_program().record_compile_pass(*kernel, name,
+                                              Time::get_time() - start_time);
+  }
+
+  // Pulls in the runtime functions the kernel uses, which the module only
+  // declares until now
+  void link_runtime_functions() {
+    auto start_time = Time::get_time();
+    tlctx->link_struct_module_functions(module);
+    record_stage("Runtime functions linked", start_time);
+  }
+
+  // Hands the kernel a copy of the module, renamed so that its symbols do not
+  // clash, to be compiled at the full optimization level later on
+  void prepare_tiered_recompilation() {
+    auto module_copy = std::make_shared<std::unique_ptr<llvm::Module>>(
+        llvm::CloneModule(*module));
+    auto tasks = offloaded_tasks;
+    for (auto &task : tasks) {
+      auto f = (*module_copy)->getFunction(task.name);
+      TC_ASSERT(f);
+      task.name += "_optimized";
+      f->setName(task.name);
+    }
+    auto jit = this->jit;
+    kernel->recompile_optimized = [jit, module_copy, tasks]() mutable {
+      jit->addModule(std::move(*module_copy));
+      for (auto &task : tasks) {
+        task.func =
+            (OffloadedTask::task_fp_type)jit_lookup_name(jit, task.name);
+      }
+      return launch_tasks(tasks);
+    };
+  }
+
   virtual FunctionType compile_module_to_executable() {
-    jit->addModule(std::move(module));
+    if (!has_new_tasks())
+      return make_executable();
+    link_runtime_functions();
+    auto start_time = Time::get_time();
+    if (!offline_cache_key.empty() || source_lines) {
+      // Compiled eagerly: for the cache, or for the source profiler, since
+      // the lazily compiled partitions of the module lose its debug info
+      auto binary = jit->add_module_as_object(std::move(module));
+      if (!offline_cache_key.empty()) {
+        OfflineCache::Entry entry;
+        entry.binary = binary;
+        entry.tasks = get_offline_cache_tasks();
+        entry.temporaries_size = kernel->temporaries_size;
+        OfflineCache::store(offline_cache_key, entry);
+      }
+    } else if (get_current_program().config.tiered_compilation) {
+      prepare_tiered_recompilation();
+      jit->addModule(std::move(module), 0);
+    } else {
+      jit->addModule(std::move(module));
+    }
+    auto executable = make_executable();
+    record_stage("LLVM optimized and JITed", start_time);
+    return executable;
+  }
 
+  FunctionType make_executable() {
     for (auto &task : offloaded_tasks) {
       task.compile();
     }
-    auto offloaded_tasks_local = offloaded_tasks;
+    store_compiled_tasks();
+    return launch_tasks(offloaded_tasks);
+  }
+
+  // Whether the module has any task to compile, rather than only reused ones
+  bool has_new_tasks() {
+    for (auto &task : offloaded_tasks) {
+      if (!task.func && !task.cuda_func)
+        return true;
+    }
+    return false;
+  }
+
+  // The offline cache and the tiered compilation take the whole module, and
+  // the source profiler its debug info, so they need all tasks emitted. The
+  // range-fors of host twins differ from their IR.
+  bool reuses_compiled_tasks() {
+    auto &config = get_current_program().config;
+    return config.reuse_compiled_tasks && offline_cache_key.empty() &&
+           !source_lines && !config.tiered_compilation &&
+           !kernel->is_host_twin;
+  }
+
+  static bool uses_random(OffloadedStmt *stmt) {
+    class RandFinder : public BasicStmtVisitor {
+     public:
+      using BasicStmtVisitor::visit;
+      bool found = false;
+
+      void visit(RandStmt *stmt) override {
+        found = true;
+      }
+    } finder;
+    stmt->accept(&finder);
+    return finder.found;
+  }
+
+  // The printed IR leaves out some of the fields of the task itself. The
+  // random numbers of a task depend on its index in the kernel.
+  std::string task_cache_key(OffloadedStmt *stmt) {
+    return fmt::format(
+        "{} {} {} {} {} {} {} {} {} {} {} {} {} {} {} {}\n{}\n{}\n{}",
+        (int)stmt->task_type, stmt->snode ? stmt->snode->id : -1,
+        stmt->begin, stmt->end, stmt->const_begin, stmt->const_end,
+        stmt->begin_offset, stmt->end_offset, stmt->step, stmt->block_dim,
+        stmt->reversed, stmt->num_cpu_threads, stmt->vectorize,
+        (int)stmt->schedule, stmt->scratch_pad_size, uses_random(stmt) ? task_counter : -1,
+        tlctx->get_struct_module_hash(), get_offline_cache_config_key(),
+        analysis::structural_hash(stmt));
+  }
+
+  // Takes the machine code of a task compiled before with the same key
+  // instead of emitting it again. It runs under the name it would have had.
+  bool reuse_compiled_task(OffloadedStmt *stmt, const std::string &key) {
+    auto it = tlctx->compiled_tasks.find(key);
+    if (it == tlctx->compiled_tasks.end())
+      return false;
+    auto &compiled = it->second;
+    OffloadedTask task(this);
+    task.begin(get_task_name(stmt));
+    task.func = (OffloadedTask::task_fp_type)compiled.func;
+    task.cuda_func = compiled.cuda_func;
+    task.grid_dim = compiled.grid_dim;
+    task.block_dim = compiled.block_dim;
+    task.auto_block_dim_range = compiled.auto_block_dim_range;
+    task.traffic = compiled.traffic;
+    task.concurrent_with_next = stmt->concurrent_with_next;
+    task.num_cpu_threads = get_task_num_cpu_threads(stmt);
+    task.structure = get_task_structure(stmt);
+    task.end();
+    get_current_program().num_reused_tasks++;
+    return true;
+  }
+
+  static TaskStructure get_task_structure(OffloadedStmt *stmt) {
+    using Type = OffloadedStmt::TaskType;
+    auto &config = get_current_program().config;
+    TaskStructure ret;
+    auto accesses = analysis::gather_accesses(stmt);
+    ret.unknown_writes = accesses.unknown;
+    // SNode ids, the other keys are not part of the structure
+    for (auto key : accesses.writes) {
+      if (key >= 0)
+        ret.writes.push_back(key);
+    }
+    // Persistent struct-fors generate their lists in the same kernel
+    if ((stmt->task_type != Type::clear_list &&
+         stmt->task_type != Type::listgen) ||
+        !config.skip_unchanged_lists || config.gpu_persistent_threads)
+      return ret;
+    // Dynamic lists change with every append, see emit_clear_list
+    for (auto p = stmt->snode; p; p = p->parent) {
+      if (p->type == SNodeType::dynamic)
+        return ret;
+    }
+    ret.list_snode = stmt->snode->id;
+    ret.clears_list = stmt->task_type == Type::clear_list;
+    for (auto p = stmt->snode->parent; p; p = p->parent)
+      ret.list_ancestors.push_back(p->id);
+    return ret;
+  }
+
+  void store_compiled_tasks() {
+    for (auto &task : offloaded_tasks) {
+      if (task.cache_key.empty())
+        continue;
+      tlctx->compiled_tasks[task.cache_key] = {
+          (void *)task.func, task.cuda_func, task.grid_dim, task.block_dim,
+          task.auto_block_dim_range, task.traffic};
+    }
+  }
+
+  static int get_task_num_cpu_threads(OffloadedStmt *stmt) {
+    using Type = OffloadedStmt::TaskType;
+    if (stmt->task_type != Type::range_for &&
+        stmt->task_type != Type::struct_for)
+      return 1;
+    return std::max(1, stmt->num_cpu_threads);
+  }
+
+  // Picks the thread count of a parallel CPU task from its first runs
+  // (CompileConfig::cpu_thread_count_tuning): after a warm-up run, one run
+  // with each count from that of the task down to 1, halving it
+  struct ThreadCountTuner {
+    std::vector<int> candidates;
+    std::vector<float64> times;
+    bool warmed_up;
+    int best;
+
+    ThreadCountTuner() {
+      warmed_up = false;
+      best = 0;
+    }
+
+    bool done() const {
+      return times.size() == candidates.size();
+    }
+
+    void pick_best(const std::string &task_name) {
+      int best_index = 0;
+      for (int i = 1; i < (int)times.size(); i++) {
+        if (times[i] < times[best_index])
+          best_index = i;
+      }
+      best = candidates[best_index];
+      TC_TRACE("Tuned the CPU threads of {}: {} ({:.3f} ms)", task_name, best,
+               times[best_index] * 1000);
+    }
+  };
+
+  // Runs task with the thread count its tuner is trying or has picked
+  static void run_tuned(ThreadPool *thread_pool,
+                        const OffloadedTask &task,
+                        ThreadCountTuner &tuner,
+                        Context *context) {
+    if (tuner.candidates.empty()) {
+      task(context);
+    } else if (tuner.done()) {
+      thread_pool->thread_limit = tuner.best;
+      task(context);
+      thread_pool->thread_limit = 0;
+    } else if (!tuner.warmed_up) {
+      // Page faults and cold caches
+      task(context);
+      tuner.warmed_up = true;
+    } else {
+      thread_pool->thread_limit = tuner.candidates[tuner.times.size()];
+      auto begin = Time::get_time();
+      task(context);
+      tuner.times.push_back(Time::get_time() - begin);
+      thread_pool->thread_limit = 0;
+      if (tuner.done())
+        tuner.pick_best(task.name);
+    }
+  }
+
+  static FunctionType launch_tasks(
+      const std::vector<OffloadedTask> &offloaded_tasks_local) {
+    auto thread_pool = &get_current_program().thread_pool;
+    // Per kernel, for as long as it stays compiled
+    auto tuners = std::make_shared<std::vector<ThreadCountTuner>>(
+        offloaded_tasks_local.size());
+    if (get_current_program().config.cpu_thread_count_tuning) {
+      for (int i = 0; i < (int)offloaded_tasks_local.size(); i++) {
+        int n = std::min(offloaded_tasks_local[i].num_cpu_threads,
+                         thread_pool->max_num_threads);
+        // Serial tasks have nothing to tune
+        for (; n > 1; n /= 2)
+          (*tuners)[i].candidates.push_back(n);
+        if (!(*tuners)[i].candidates.empty())
+          (*tuners)[i].candidates.push_back(1);
+      }
+    }
     return [=](Context &context) {
-      for (auto task : offloaded_tasks_local) {
-        task(&context);
+      auto &program = get_current_program();
+      int num_tasks = (int)offloaded_tasks_local.size();
+      for (int i = 0; i < num_tasks; i++) {
+        auto &task = offloaded_tasks_local[i];
+        auto &tuner = (*tuners)[i];
+        if (program.list_tracker.skip(task.structure)) {
+          program.num_skipped_list_tasks++;
+          continue;
+        }
+        if (program.config.enable_profiler) {
+          // Tasks are timed one by one
+          auto &profiler = program.profiler_llvm;
+          profiler->start(task.name, task.traffic);
+          run_tuned(thread_pool, task, tuner, &context);
+          profiler->stop();
+          if (!tuner.candidates.empty() && tuner.done()) {
+            profiler->set_num_threads(profiler->get_record_id(task.name),
+                                      tuner.best);
+          }
+        } else if (task.concurrent_with_next && i + 1 < num_tasks) {
+          auto &next = offloaded_tasks_local[i + 1];
+          // Neither lists anything
+          program.list_tracker.skip(next.structure);
+          run_concurrently(thread_pool, &context, task, next);
+          i++;
+        } else {
+          run_tuned(thread_pool, task, tuner, &context);
+        }
       }
     };
   }
 
+  // Splits 0 and 1 of a two-way region. The range-for calls back into the
+  // pool with a nested region.
+  static void run_concurrently(ThreadPool *thread_pool,
+                               Context *context,
+                               const OffloadedTask &a,
+                               const OffloadedTask &b) {
+    struct Pair {
+      Context *context;
+      const OffloadedTask *tasks[2];
+    } pair{context, {&a, &b}};
+    thread_pool->run(2, 2, &pair, [](void *p, int i) {
+      auto pair = (Pair *)p;
+      (*pair->tasks[i])(pair->context);
+    });
+  }
+
+  // Turns a cache entry back into an executable, skipping codegen entirely
+  virtual FunctionType load_offline_cache(const OfflineCache::Entry &entry) {
+    jit->add_object(entry.binary);
+    set_offline_cache_tasks(entry.tasks);
+    return make_executable();
+  }
+
+  std::vector<OfflineCache::TaskInfo> get_offline_cache_tasks() {
+    std::vector<OfflineCache::TaskInfo> tasks;
+    for (auto &task : offloaded_tasks) {
+      tasks.push_back({task.name, task.grid_dim, task.block_dim,
+                       task.auto_block_dim_range, task.concurrent_with_next,
+                       task.num_cpu_threads, task.traffic});
+    }
+    return tasks;
+  }
+
+  void set_offline_cache_tasks(
+      const std::vector<OfflineCache::TaskInfo> &tasks) {
+    offloaded_tasks.clear();
+    for (auto &info : tasks) {
+      OffloadedTask task(this);
+      task.begin(info.name);
+      task.grid_dim = info.grid_dim;
+      task.block_dim = info.block_dim;
+      task.auto_block_dim_range = info.auto_block_dim_range;
+      task.concurrent_with_next = info.concurrent_with_next;
+      task.num_cpu_threads = info.num_cpu_threads;
+      task.traffic = info.traffic;
+      task.end();
+    }
+  }
+
+  virtual std::string get_offline_cache_config_key() {
+    auto &config = get_current_program().config;
+    return fmt::format(
+        "{} debug={} fast_math={} default_gpu_block_dim={} source_lines={} "
+        "streaming_stores={} block_prefetch={} block_local_access={}",
+        arch_name(current_arch()), config.debug, config.fast_math,
+        config.default_gpu_block_dim, source_lines != nullptr,
+        config.cpu_streaming_stores, config.cpu_block_prefetch,
+        config.block_local_access);
+  }
+
   virtual FunctionType gen() {
+    if (kernel->aot_entry) {
+      // Kernels of an AotModule have no IR to compile
+      kernel->temporaries_size = kernel->aot_entry->temporaries_size;
+      return load_offline_cache(*kernel->aot_entry);
+    }
+    // The ids of messages are only valid in this program
+    // Host twins compile differently from the same IR
+    if (get_current_program().config.use_offline_cache &&
+        !kernel->is_host_twin &&
+        !analysis::has_program_messages(kernel->ir)) {
+      offline_cache_key = OfflineCache::make_key(
+          kernel->ir, kernel_name, tlctx->get_struct_module_hash(),
+          get_offline_cache_config_key());
+      kernel->offline_cache_key = offline_cache_key;
+      OfflineCache::Entry entry;
+      if (OfflineCache::load(offline_cache_key, entry)) {
+        TC_TRACE("Loaded kernel {} from the offline cache", kernel_name);
+        get_current_program().num_compile_cache_hits++;
+        get_current_program().num_offline_cache_hits++;
+        return load_offline_cache(entry);
+      }
+    }
+    get_current_program().num_compile_cache_misses++;
+    auto start_time = Time::get_time();
     emit_to_module();
+    if (source_lines)
+      source_lines->finalize();
+    record_stage("LLVM IR emitted", start_time);
     return compile_module_to_executable();
   }
 
@@ -254,6 +688,8 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
 
   void visit(Block *stmt_list) override {
     for (auto &stmt : stmt_list->statements) {
+      if (source_lines)
+        source_lines->set_location(builder, stmt.get());
       stmt->accept(this);
     }
   }
@@ -266,9 +702,49 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
                          stmt->value);
   }
 
+  // Atomics are counted in a local variable of the function running the
+  // iterations, which adds it to the runtime counters once when it is done
+  void begin_counting_atomic_ops() {
+    if (current_arch() != Arch::x86_64)
+      return;
+    num_atomic_ops = create_entry_block_alloca(DataType::i64);
+    builder->CreateStore(tlctx->get_constant((int64)0), num_atomic_ops);
+  }
+
+  // Non-temporal stores are weakly ordered: they must be done before the
+  // thread pool hands the results of the loop body function to other threads
+  void fence_streaming_stores() {
+    if (!emitted_streaming_stores)
+      return;
+    builder->CreateIntrinsic(Intrinsic::x86_sse_sfence, {}, {});
+    emitted_streaming_stores = false;
+  }
+
+  void end_counting_atomic_ops() {
+    if (!num_atomic_ops)
+      return;
+    create_call("Runtime_count_atomic_ops",
+                {get_runtime(), builder->CreateLoad(num_atomic_ops)});
+    num_atomic_ops = nullptr;
+  }
+
+  // Restarts the random streams for the loop iteration "iteration". Must be
+  // called in the function that holds the loop body.
+  void begin_rand_iteration(llvm::Value *iteration) {
+    rand_iteration = iteration;
+    rand_counter = create_entry_block_alloca(DataType::i32);
+    builder->CreateStore(tlctx->get_constant(0), rand_counter);
+  }
+
   void visit(RandStmt *stmt) override {
+    TC_ASSERT(rand_counter != nullptr);
+    auto counter = builder->CreateLoad(rand_counter);
+    builder->CreateStore(builder->CreateAdd(counter, tlctx->get_constant(1)),
+                         rand_counter);
     stmt->value = create_call(
-        fmt::format("rand_{}", data_type_short_name(stmt->ret_type.data_type)));
+        fmt::format("rand_{}", data_type_short_name(stmt->ret_type.data_type)),
+        {get_context(), tlctx->get_constant(task_counter - 1), rand_iteration,
+         counter});
   }
 
   virtual void emit_extra_unary(UnaryOpStmt *stmt) {
@@ -292,7 +768,16 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
       TC_NOT_IMPLEMENTED                                               \
     }                                                                  \
   }
-    if (false) {
+    bool vectorizable_f32 = op == UnaryOpType::exp ||
+                            op == UnaryOpType::log ||
+                            op == UnaryOpType::tan || op == UnaryOpType::tanh;
+    if (vectorizable_f32 && input_taichi_type == DataType::f32 &&
+        get_current_program().config.fast_math) {
+      // Unlike the libm calls, these inline into vectorizable arithmetic
+      stmt->value = builder->CreateCall(
+          get_runtime_function(
+              fmt::format("vec_{}_f32", unary_op_type_name(op))),
+          input);
     }
     UNARY_STD(abs)
     UNARY_STD(exp)
@@ -613,33 +1098,24 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
 
   void visit(PrintStmt *stmt) override {
     TC_ASSERT(stmt->width() == 1);
-    std::vector<Value *> args;
-    std::string format;
     auto value = stmt->stmt->value;
     auto dt = stmt->stmt->ret_type.data_type;
+    auto i32 = tlctx->get_data_type(DataType::i32);
+    auto i64 = tlctx->get_data_type(DataType::i64);
+    // The bits of the value, formatted by the host
     if (dt == DataType::i32) {
-      format = "%d";
-    } else if (dt == DataType::i64) {
-#if defined(TC_PLATFORM_UNIX)
-      format = "%lld";
-#else
-      format = "%I64d";
-#endif
+      value = builder->CreateSExt(value, i64);
     } else if (dt == DataType::f32) {
-      format = "%f";
-      value = builder->CreateFPExt(value, tlctx->get_data_type(DataType::f64));
+      value = builder->CreateZExt(builder->CreateBitCast(value, i32), i64);
     } else if (dt == DataType::f64) {
-      format = "%.12f";
-    } else {
+      value = builder->CreateBitCast(value, i64);
+    } else if (dt != DataType::i64) {
       TC_NOT_IMPLEMENTED
     }
-    args.push_back(builder->CreateGlobalStringPtr(
-        ("[debug] " + stmt->str + " = " + format + "\n").c_str(),
-        "format_string"));
-    args.push_back(value);
-
-    stmt->value = builder->CreateCall(get_runtime_function("printf"), args,
-                                      "debug_printf");
+    auto message_id =
+        get_current_program().register_debug_message(stmt->str, dt);
+    stmt->value = call("taichi_debug_record", get_context(),
+                       tlctx->get_constant(message_id), value);
   }
 
   void visit(ConstStmt *stmt) override {
@@ -705,16 +1181,118 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
     auto meta_child = cast_pointer(emit_struct_meta(snode_child), "StructMeta");
     auto meta_parent =
         cast_pointer(emit_struct_meta(snode_parent), "StructMeta");
-    call("clear_list", get_runtime(), meta_parent, meta_child);
+    // The loop bounds of dynamic elements change with every append, so their
+    // lists (and, through the structure key, their descendants') are always
+    // regenerated
+    if (snode_child->type == SNodeType::dynamic) {
+      call("clear_list", get_runtime(), meta_parent, meta_child);
+    } else {
+      call("clear_list_if_outdated", get_runtime(), meta_parent, meta_child);
+    }
   }
 
-  void emit_list_gen(OffloadedStmt *listgen) {
+  void emit_gc(OffloadedStmt *stmt) {
+    call("node_gc", get_runtime(), tlctx->get_constant(stmt->snode->id));
+  }
+
+  void emit_zero_fill(OffloadedStmt *stmt) {
+    auto meta = cast_pointer(emit_struct_meta(stmt->snode), "StructMeta");
+    call("zero_fill_elements", get_runtime(), meta);
+  }
+
+  // The two steps of a deactivate_all task: the instances of the node drop
+  // their nodes, then the nodes of the node and its sparse descendants are
+  // freed, which must wait for the first step to be done everywhere
+  void emit_deactivate_all_elements(OffloadedStmt *stmt) {
+    auto snode = stmt->snode;
+    auto meta = cast_pointer(emit_struct_meta(snode), "StructMeta");
+    create_call("deactivate_all_elements",
+                {get_runtime(), meta,
+                 get_runtime_function(
+                     fmt::format("{}_reset", get_runtime_snode_name(snode)))});
+  }
+
+  // The three steps of a defragment task: the links to the active nodes are
+  // gathered in order and the allocator is emptied, then the nodes are
+  // copied aside and back to its front. Each step must be done everywhere
+  // before the next one.
+  void emit_defragment_gather(OffloadedStmt *stmt) {
+    auto meta = cast_pointer(emit_struct_meta(stmt->snode), "StructMeta");
+    call("Pointer_defragment_gather", get_runtime(), meta);
+  }
+
+  void emit_defragment_copy(OffloadedStmt *stmt, bool back) {
+    auto meta = cast_pointer(emit_struct_meta(stmt->snode), "StructMeta");
+    call("Pointer_defragment_copy", get_runtime(), meta,
+         tlctx->get_constant((int)back));
+  }
+
+  void emit_deactivate_ambient(OffloadedStmt *stmt) {
+    auto meta = cast_pointer(emit_struct_meta(stmt->snode), "StructMeta");
+    call("Pointer_deactivate_ambient", get_runtime(), meta);
+  }
+
+  void emit_node_resets(SNode *snode) {
+    if (snode->type == SNodeType::pointer || snode->type == SNodeType::dynamic)
+      call("node_reset", get_runtime(), tlctx->get_constant(snode->id));
+    for (auto &c : snode->ch)
+      emit_node_resets(c.get());
+  }
+
+  // Calls the runtime listgen function "func" on the parent and child metas
+  void emit_list_gen_pass(OffloadedStmt *listgen, const std::string &func) {
     auto snode_child = listgen->snode;
     auto snode_parent = listgen->snode->parent;
     auto meta_child = cast_pointer(emit_struct_meta(snode_child), "StructMeta");
     auto meta_parent =
         cast_pointer(emit_struct_meta(snode_parent), "StructMeta");
-    call("element_listgen", get_runtime(), meta_parent, meta_child);
+    call(func, get_runtime(), meta_parent, meta_child);
+  }
+
+  bool has_generic_list_gen(OffloadedStmt *listgen) {
+    auto snode_parent = listgen->snode->parent;
+    return !(snode_parent->type == SNodeType::dense &&
+             snode_parent->_bitmasked) &&
+           snode_parent->type != SNodeType::hash;
+  }
+
+  // Calls the element_listgen of the parent and child node types, which gets
+  // the node functions of the two SNodes and is inlined here, so that no
+  // node function is called through the metas
+  void emit_specialized_list_gen(OffloadedStmt *listgen) {
+    auto snode_child = listgen->snode;
+    auto snode_parent = listgen->snode->parent;
+    auto meta_child = cast_pointer(emit_struct_meta(snode_child), "StructMeta");
+    auto meta_parent =
+        cast_pointer(emit_struct_meta(snode_parent), "StructMeta");
+    auto func_name = fmt::format("element_listgen_{}_{}",
+                                 get_runtime_snode_name(snode_parent),
+                                 get_runtime_snode_name(snode_child));
+    auto listgen_call = create_call(
+        func_name,
+        {get_runtime(), meta_parent, meta_child,
+         get_runtime_function(snode_parent->refine_coordinates_func_name()),
+         get_runtime_function(snode_child->get_ch_from_parent_func_name())});
+    llvm::cast<llvm::CallInst>(listgen_call)
+        ->addAttribute(llvm::AttributeList::FunctionIndex,
+                       llvm::Attribute::AlwaysInline);
+  }
+
+  void emit_list_gen(OffloadedStmt *listgen) {
+    auto snode_parent = listgen->snode->parent;
+    auto child_type = listgen->snode->type;
+    if (snode_parent->type == SNodeType::dense && snode_parent->_bitmasked) {
+      emit_list_gen_pass(listgen, "element_listgen_bitmasked");
+    } else if (snode_parent->type == SNodeType::hash) {
+      emit_list_gen_pass(listgen, "element_listgen_hash");
+    } else if (child_type == SNodeType::dense ||
+               child_type == SNodeType::pointer ||
+               child_type == SNodeType::dynamic ||
+               child_type == SNodeType::hash) {
+      emit_specialized_list_gen(listgen);
+    } else {
+      emit_list_gen_pass(listgen, "element_listgen");
+    }
   }
 
   llvm::Value *create_call(llvm::Value *func, std::vector<Value *> args = {}) {
@@ -837,8 +1415,33 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
   }
 
   void visit(AssertStmt *stmt) {
+    auto message_id = get_current_program().register_debug_message(
+        stmt->text, DataType::unknown);
     stmt->value = call("taichi_assert", get_context(), stmt->val->value,
-                       builder->CreateGlobalStringPtr(stmt->text));
+                       tlctx->get_constant(message_id));
+  }
+
+  void visit(BoundCheckStmt *stmt) override {
+    auto out_of_bound = BasicBlock::Create(*llvm_context, "out_of_bound", func);
+    auto in_bound = BasicBlock::Create(*llvm_context, "in_bound", func);
+    builder->CreateCondBr(
+        builder->CreateICmpNE(stmt->in_bound->value, tlctx->get_constant(0)),
+        in_bound, out_of_bound);
+    builder->SetInsertPoint(out_of_bound);
+    auto i32 = tlctx->get_data_type(DataType::i32);
+    auto indices =
+        create_entry_block_alloca(llvm::ArrayType::get(i32, max_num_indices));
+    for (int i = 0; i < (int)stmt->indices.size(); i++) {
+      builder->CreateStore(
+          stmt->indices[i]->value,
+          builder->CreateGEP(indices, {tlctx->get_constant(0),
+                                       tlctx->get_constant(i)}));
+    }
+    call("taichi_report_out_of_bound", get_context(),
+         tlctx->get_constant(stmt->check_id),
+         builder->CreateBitCast(indices, llvm::PointerType::get(i32, 0)));
+    builder->CreateBr(in_bound);
+    builder->SetInsertPoint(in_bound);
   }
 
   void visit(SNodeOpStmt *stmt) override {
@@ -850,48 +1453,294 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
     } else if (stmt->op_type == SNodeOpType::probe) {
       TC_ASSERT(snode->type == SNodeType::dynamic);
       stmt->value = call(snode, stmt->ptr->value, "get_num_elements", {});
+    } else if (stmt->op_type == SNodeOpType::deactivate) {
+      if (snode->type != SNodeType::pointer &&
+          snode->type != SNodeType::dynamic) {
+        TC_ERROR("Deactivating {} is not supported",
+                 snode_type_name(snode->type));
+      }
+      call(snode, stmt->ptr->value, "deactivate", {tlctx->get_constant(0)});
+    } else if (stmt->op_type == SNodeOpType::is_active) {
+      if (snode->type == SNodeType::dense) {
+        stmt->value = tlctx->get_constant(1);
+      } else {
+        TC_ASSERT(snode->type == SNodeType::pointer);
+        // Inactive cells above lead to ambient nodes, which are inactive
+        stmt->value = builder->CreateZExt(
+            call(snode, stmt->ptr->value, "is_active",
+                 {tlctx->get_constant(0)}),
+            tlctx->get_data_type(DataType::i32));
+      }
     } else {
       TC_NOT_IMPLEMENTED
     }
   }
 
-  virtual void visit(AtomicOpStmt *stmt) override {
-    auto mask = stmt->parent->mask();
-    // TODO: deal with mask when vectorized
-    for (int l = 0; l < stmt->width(); l++) {
-      TC_ASSERT(stmt->op_type == AtomicOpType::add);
-      if (stmt->val->ret_type.data_type == DataType::i32)
-        builder->CreateAtomicRMW(llvm::AtomicRMWInst::BinOp::Add,
-                                 stmt->dest->value, stmt->val->value,
-                                 llvm::AtomicOrdering::SequentiallyConsistent);
-      else if (stmt->val->ret_type.data_type == DataType::f32) {
-        builder->CreateCall(get_runtime_function("atomic_add_cpu_f32"),
-                            {stmt->dest->value, stmt->val->value});
-      } else if (stmt->val->ret_type.data_type == DataType::f64) {
-        builder->CreateCall(get_runtime_function("atomic_add_cpu_f64"),
-                            {stmt->dest->value, stmt->val->value});
+  // The field a pointer refers to, if that is packed into a bit_struct
+  static SNode *bit_field_of(Stmt *ptr) {
+    auto get_ch = ptr->cast<GetChStmt>();
+    if (get_ch != nullptr && get_ch->output_snode->is_bit_field())
+      return get_ch->output_snode;
+    return nullptr;
+  }
+
+  static int word_bits_of(SNode *field) {
+    return data_type_size(field->parent->dt) * 8;
+  }
+
+  llvm::Value *bit_field_mask(SNode *field) {
+    auto mask = (~(uint64)0 >> (64 - field->quant.num_bits))
+                << field->data_bit_offset;
+    return llvm::ConstantInt::get(tlctx->get_data_type(field->parent->dt),
+                                  mask);
+  }
+
+  llvm::Value *load_bit_field(SNode *field, llvm::Value *word_ptr) {
+    return decode_bit_field(field, builder->CreateLoad(word_ptr));
+  }
+
+  // The value of the field in word
+  llvm::Value *decode_bit_field(SNode *field, llvm::Value *word) {
+    auto &quant = field->quant;
+    int word_bits = word_bits_of(field);
+    // Moves the field to the top bits, then back down, extending its sign
+    word = builder->CreateShl(
+        word, word_bits - field->data_bit_offset - quant.num_bits);
+    int shift = word_bits - quant.num_bits;
+    llvm::Value *val = quant.is_signed ? builder->CreateAShr(word, shift)
+                                       : builder->CreateLShr(word, shift);
+    auto type = tlctx->get_data_type(field->dt);
+    if (quant.scale == 0)
+      return builder->CreateIntCast(val, type, quant.is_signed);
+    val = quant.is_signed ? builder->CreateSIToFP(val, type)
+                          : builder->CreateUIToFP(val, type);
+    return builder->CreateFMul(val, llvm::ConstantFP::get(type, quant.scale));
+  }
+
+  // The integer a value is stored as, shifted to the position of the field.
+  // Bits beyond the field are not cleared.
+  llvm::Value *encode_bit_field(SNode *field, llvm::Value *val) {
+    auto &quant = field->quant;
+    auto word_type = tlctx->get_data_type(field->parent->dt);
+    if (quant.scale == 0) {
+      val = builder->CreateIntCast(val, word_type, quant.is_signed);
+    } else {
+      // Rounds to the nearest multiple of the scale
+      auto type = val->getType();
+      auto units = builder->CreateFMul(
+          val, llvm::ConstantFP::get(type, 1 / quant.scale));
+      val = builder->CreateFAdd(units, llvm::ConstantFP::get(type, 0.5));
+      val = builder->CreateIntrinsic(llvm::Intrinsic::floor, {type}, {val});
+      val = builder->CreateFPToSI(val, word_type);
+    }
+    return builder->CreateShl(val, field->data_bit_offset);
+  }
+
+  // Other threads may be storing to the other fields of the word, so that
+  // the word is updated with compare-and-swap
+  void store_bit_field(SNode *field, llvm::Value *word_ptr, llvm::Value *val) {
+    auto mask = bit_field_mask(field);
+    auto bits = builder->CreateAnd(encode_bit_field(field, val), mask);
+    builder->CreateCall(
+        get_runtime_function(
+            fmt::format("set_partial_bits_b{}", word_bits_of(field))),
+        {word_ptr, mask, bits});
+  }
+
+  // Returns false if the destination is not a bit field. The old value of
+  // the field is the result, as for other atomics.
+  bool atomic_add_bit_field(AtomicOpStmt *stmt) {
+    auto field = bit_field_of(stmt->dest);
+    if (field == nullptr)
+      return false;
+    if (stmt->op_type != AtomicOpType::add) {
+      TC_ERROR("Bit fields only support atomic additions, not atomic {}",
+               atomic_op_type_name(stmt->op_type));
+    }
+    auto old_word = builder->CreateCall(
+        get_runtime_function(
+            fmt::format("atomic_add_partial_bits_b{}", word_bits_of(field))),
+        {stmt->dest->value, bit_field_mask(field),
+         encode_bit_field(field, stmt->val->value)});
+    stmt->value = decode_bit_field(field, old_word);
+    return true;
+  }
+
+  // Float additions without a native instruction (x86) run a CAS loop of the
+  // runtime
+  virtual void create_atomic_add_float(AtomicOpStmt *stmt) {
+    auto dt = stmt->val->ret_type.data_type;
+    builder->CreateCall(
+        get_runtime_function(
+            fmt::format("atomic_add_cpu_{}", data_type_short_name(dt))),
+        {stmt->dest->value, stmt->val->value});
+  }
+
+  // Atomics only need to be indivisible: Taichi makes no promise on the order
+  // in which other threads observe the accesses of a kernel before it ends,
+  // so they are relaxed (monotonic) rather than sequentially consistent
+  void create_atomic(AtomicOpStmt *stmt) {
+    auto dt = stmt->val->ret_type.data_type;
+    auto op = stmt->op_type;
+    if (is_integral(dt)) {
+      using BinOp = llvm::AtomicRMWInst::BinOp;
+      BinOp bin_op;
+      if (op == AtomicOpType::add) {
+        bin_op = BinOp::Add;
+      } else if (op == AtomicOpType::sub) {
+        bin_op = BinOp::Sub;
+      } else if (op == AtomicOpType::max) {
+        bin_op = is_signed(dt) ? BinOp::Max : BinOp::UMax;
+      } else if (op == AtomicOpType::min) {
+        bin_op = is_signed(dt) ? BinOp::Min : BinOp::UMin;
+      } else if (op == AtomicOpType::bit_and) {
+        bin_op = BinOp::And;
+      } else if (op == AtomicOpType::bit_or) {
+        bin_op = BinOp::Or;
       } else {
-        TC_NOT_IMPLEMENTED
+        TC_ASSERT(op == AtomicOpType::bit_xor);
+        bin_op = BinOp::Xor;
+      }
+      builder->CreateAtomicRMW(bin_op, stmt->dest->value, stmt->val->value,
+                               llvm::AtomicOrdering::Monotonic);
+    } else if (dt == DataType::f32 || dt == DataType::f64) {
+      if (op == AtomicOpType::add) {
+        create_atomic_add_float(stmt);
+      } else {
+        if (op != AtomicOpType::max && op != AtomicOpType::min) {
+          TC_ERROR("Atomic {} is not supported on {}", atomic_op_type_name(op),
+                   data_type_name(dt));
+        }
+        builder->CreateCall(
+            get_runtime_function(fmt::format("atomic_{}_{}",
+                                             atomic_op_type_name(op),
+                                             data_type_short_name(dt))),
+            {stmt->dest->value, stmt->val->value});
       }
+    } else {
+      TC_NOT_IMPLEMENTED
     }
   }
 
+  virtual void visit(AtomicOpStmt *stmt) override {
+    if (num_atomic_ops) {
+      create_increment(num_atomic_ops,
+                       tlctx->get_constant((int64)stmt->width()));
+    }
+    if (atomic_add_bit_field(stmt))
+      return;
+    // TODO: deal with mask when vectorized
+    TC_ASSERT(stmt->width() == 1);
+    create_atomic(stmt);
+  }
+
   void visit(GlobalPtrStmt *stmt) override {
     TC_ERROR("Global Ptrs should have been lowered.");
   }
 
+  // Different fields never alias one another, or the external arrays, so
+  // that LLVM can reorder and vectorize their accesses. Other pointers (and
+  // bit fields, which share words) get no tag and may alias anything.
+  llvm::MDNode *get_alias_tag(Stmt *ptr) {
+    int key = -1;
+    if (auto get_ch = ptr->cast<GetChStmt>()) {
+      auto snode = get_ch->output_snode;
+      if (snode->type != SNodeType::place || snode->is_bit_field())
+        return nullptr;
+      key = snode->id;
+    } else if (!ptr->is<ExternalPtrStmt>()) {
+      return nullptr;
+    }
+    auto &tag = alias_tags[key];
+    if (tag == nullptr) {
+      llvm::MDBuilder md(*llvm_context);
+      auto type = md.createTBAAScalarTypeNode(
+          key < 0 ? "external" : fmt::format("snode_{}", key),
+          md.createTBAARoot("taichi"));
+      tag = md.createTBAAStructTagNode(type, type, 0);
+    }
+    return tag;
+  }
+
+  // Whether the memory behind ptr stays the same during the current GPU
+  // task, whose loads from it can then go through the read-only cache
+  // (CompileConfig::gpu_read_only_cache)
+  bool is_invariant_in_task(Stmt *ptr) {
+    if (current_arch() != Arch::gpu ||
+        !get_current_program().config.gpu_read_only_cache)
+      return false;
+    if (task_accesses_stmt != current_offloaded_stmt) {
+      // With persistent threads, the tasks chained in the launch of a
+      // struct-for only write element lists besides
+      task_accesses = analysis::gather_accesses(current_offloaded_stmt, true);
+      task_accesses_stmt = current_offloaded_stmt;
+    }
+    if (task_accesses.unknown)
+      return false;
+    if (ptr->is<ExternalPtrStmt>())
+      return task_accesses.writes.count(-1) == 0;
+    auto get_ch = ptr->cast<GetChStmt>();
+    if (!get_ch || get_ch->output_snode->type != SNodeType::place)
+      return false;
+    for (auto p = get_ch->output_snode; p; p = p->parent) {
+      if (task_accesses.writes.count(p->id))
+        return false;
+    }
+    return true;
+  }
+
   void visit(GlobalStoreStmt *stmt) override {
     TC_ASSERT(!stmt->parent->mask() || stmt->width() == 1);
     TC_ASSERT(stmt->data->value);
     TC_ASSERT(stmt->ptr->value);
-    builder->CreateStore(stmt->data->value, stmt->ptr->value);
+    auto data = stmt->data->value;
+    if (auto field = bit_field_of(stmt->ptr)) {
+      store_bit_field(field, stmt->ptr->value, data);
+      return;
+    }
+    auto storage_type = stmt->ptr->value->getType()->getPointerElementType();
+    if (storage_type->isHalfTy())
+      data = builder->CreateFPTrunc(data, storage_type);
+    auto store = builder->CreateStore(data, stmt->ptr->value);
+    if (auto tag = get_alias_tag(stmt->ptr))
+      store->setMetadata(llvm::LLVMContext::MD_tbaa, tag);
+    if (streaming_stores.count(stmt)) {
+      store->setMetadata(
+          llvm::LLVMContext::MD_nontemporal,
+          llvm::MDNode::get(*llvm_context, llvm::ConstantAsMetadata::get(
+                                               builder->getInt32(1))));
+      emitted_streaming_stores = true;
+    }
   }
 
   void visit(GlobalLoadStmt *stmt) override {
     int width = stmt->width();
     TC_ASSERT(stmt->width() == 1);
-    stmt->value = builder->CreateLoad(
-        tlctx->get_data_type(stmt->ret_type.data_type), stmt->ptr->value);
+    auto type = tlctx->get_data_type(stmt->ret_type.data_type);
+    auto storage_type = stmt->ptr->value->getType()->getPointerElementType();
+    if (auto field = bit_field_of(stmt->ptr)) {
+      stmt->value = load_bit_field(field, stmt->ptr->value);
+      return;
+    }
+    auto load_type = storage_type->isHalfTy() ? storage_type : type;
+    auto ptr = stmt->ptr->value;
+    bool invariant = is_invariant_in_task(stmt->ptr);
+    if (invariant) {
+      // Fields and external arrays are in global memory, where invariant
+      // loads become ld.global.nc
+      ptr = builder->CreateAddrSpaceCast(
+          ptr, llvm::PointerType::get(storage_type, 1));
+    }
+    auto load = builder->CreateLoad(load_type, ptr);
+    if (auto tag = get_alias_tag(stmt->ptr))
+      load->setMetadata(llvm::LLVMContext::MD_tbaa, tag);
+    if (invariant) {
+      load->setMetadata(llvm::LLVMContext::MD_invariant_load,
+                        llvm::MDNode::get(*llvm_context, llvm::None));
+    }
+    stmt->value = load;
+    if (storage_type->isHalfTy())
+      stmt->value = builder->CreateFPExt(load, type);
   }
 
   void visit(ElementShuffleStmt *stmt) override {
@@ -909,6 +1758,11 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
     }
   }
 
+  // The range only informs the analyses, e.g. of the scratch pads
+  void visit(RangeAssumptionStmt *stmt) override {
+    stmt->value = stmt->input->value;
+  }
+
   void visit(OffsetAndExtractBitsStmt *stmt) override {
     auto shifted = builder->CreateAdd(stmt->input->value,
                                       tlctx->get_constant((int32)stmt->offset));
@@ -920,6 +1774,22 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
 
   void visit(LinearizeStmt *stmt) override {
     llvm::Value *val = tlctx->get_constant(0);
+    if (stmt->morton) {
+      std::vector<int> num_bits;
+      for (auto stride : stmt->strides)
+        num_bits.push_back(bit::log2int(stride));
+      auto masks = morton_bit_masks(num_bits);
+      for (int i = 0; i < (int)stmt->inputs.size(); i++) {
+        if (masks[i] == 0)
+          continue;
+        val = builder->CreateOr(
+            val, create_call("deposit_bits",
+                             {stmt->inputs[i]->value,
+                              tlctx->get_constant((int32)masks[i])}));
+      }
+      stmt->value = val;
+      return;
+    }
     for (int i = 0; i < (int)stmt->inputs.size(); i++) {
       val = builder->CreateAdd(
           builder->CreateMul(val, tlctx->get_constant(stmt->strides[i])),
@@ -960,10 +1830,16 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
   }
 
   void visit(GetRootStmt *stmt) override {
+    auto root = get_current_program().snode_root;
+    llvm::Value *root_ptr = get_root();
+    if (stmt->root) {
+      // The buffers of the other trees are only known to the runtime
+      root = stmt->root;
+      root_ptr = call("Runtime_get_roots", get_runtime(),
+                      tlctx->get_constant(root->id));
+    }
     stmt->value = builder->CreateBitCast(
-        get_root(),
-        PointerType::get(snode_attr[get_current_program().snode_root].llvm_type,
-                         0));
+        root_ptr, PointerType::get(snode_attr[root].llvm_type, 0));
   }
 
   llvm::Value *call(SNode *snode,
@@ -985,15 +1861,92 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
     return call(builder, prefix + "_" + method, func_arguments);
   }
 
+  // Emits the lookups leading to ptr again, at the insertion point, keeping
+  // the values of the statements emitted before
+  llvm::Value *emit_access_chain(Stmt *ptr) {
+    auto ch = ptr->cast<GetChStmt>();
+    if (!ch)
+      return ptr->value;
+    auto lookup = ch->input_ptr->as<SNodeLookupStmt>();
+    auto input = lookup->input_snode;
+    auto values = std::make_tuple(input->value, lookup->value, ch->value);
+    input->value = emit_access_chain(input);
+    lookup->accept(this);
+    ch->accept(this);
+    auto ret = ch->value;
+    std::tie(input->value, lookup->value, ch->value) = values;
+    return ret;
+  }
+
+  // The leaf block of a lookup marked in_loop_block: the block of the
+  // current element if the indices agree with its corner above the bits of
+  // the block, otherwise the one found from the root. The lookups leading to
+  // the block are emitted again on that path only, so that those emitted
+  // before are left unused.
+  llvm::Value *lookup_loop_block(SNodeLookupStmt *stmt) {
+    auto snode = stmt->snode;
+    RuntimeObject element("Element", this, builder, current_element);
+    RuntimeObject corner("PhysicalCoordinates", this, builder,
+                         element.get_ptr("pcoord"));
+    llvm::Value *same_block = tlctx->get_constant(true);
+    for (int i = 0; i < (int)stmt->global_indices.size(); i++) {
+      auto j = snode->physical_index_position[i];
+      auto shift = tlctx->get_constant(snode->extractors[j].start +
+                                       snode->extractors[j].num_bits);
+      // The element only stores the coordinates that can be nonzero
+      llvm::Value *corner_j = tlctx->get_constant(0);
+      if (j < snode->num_element_coordinates())
+        corner_j = corner.get("val", tlctx->get_constant(j));
+      same_block = builder->CreateAnd(
+          same_block,
+          builder->CreateICmpEQ(
+              builder->CreateAShr(stmt->global_indices[i]->value, shift),
+              builder->CreateAShr(corner_j, shift)));
+    }
+    auto block = builder->CreateBitCast(element.get("element"),
+                                        stmt->input_snode->value->getType());
+    auto current_bb = builder->GetInsertBlock();
+    auto walk_bb = BasicBlock::Create(*llvm_context, "walk_to_block", func);
+    auto found_bb = BasicBlock::Create(*llvm_context, "block_found", func);
+    builder->CreateCondBr(same_block, found_bb, walk_bb);
+    builder->SetInsertPoint(walk_bb);
+    auto walked = emit_access_chain(stmt->input_snode);
+    auto walk_end_bb = builder->GetInsertBlock();
+    builder->CreateBr(found_bb);
+    builder->SetInsertPoint(found_bb);
+    auto ret = builder->CreatePHI(block->getType(), 2);
+    ret->addIncoming(block, current_bb);
+    ret->addIncoming(walked, walk_end_bb);
+    return ret;
+  }
+
   void visit(SNodeLookupStmt *stmt) override {
     llvm::Value *parent = nullptr;
     parent = stmt->input_snode->value;
     TC_ASSERT(parent);
     auto snode = stmt->snode;
+    if (stmt->in_loop_block && current_element &&
+        snode == current_offloaded_stmt->snode->parent) {
+      parent = lookup_loop_block(stmt);
+    }
     if (snode->type == SNodeType::root) {
       stmt->value = builder->CreateGEP(parent, stmt->input_index->value);
-    } else if (snode->type == SNodeType::dense ||
-               snode->type == SNodeType::pointer ||
+    } else if (snode->type == SNodeType::bit_struct) {
+      // A single word
+      stmt->value = parent;
+    } else if (snode->type == SNodeType::dense) {
+      if (stmt->activate) {
+        call(snode, stmt->input_snode->value, "activate",
+             {stmt->input_index->value});
+      }
+      // Same as Dense_lookup_element, with the cell size known here. Dense
+      // levels of an access chain thereby fold into a single GEP, instead of
+      // runtime calls on a StructMeta built for every access.
+      auto cells = builder->CreateBitCast(
+          parent, PointerType::get(snode_attr[snode].llvm_element_type, 0));
+      stmt->value = builder->CreateGEP(cells, stmt->input_index->value);
+    } else if (snode->type == SNodeType::pointer ||
+               snode->type == SNodeType::hash ||
                snode->type == SNodeType::dynamic) {
       if (stmt->activate) {
         call(snode, stmt->input_snode->value, "activate",
@@ -1008,10 +1961,20 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
   }
 
   void visit(GetChStmt *stmt) override {
-    auto ch = create_call(
-        stmt->output_snode->get_ch_from_parent_func_name(),
-        {builder->CreateBitCast(stmt->input_ptr->value,
-                                PointerType::getInt8PtrTy(*llvm_context))});
+    // Inlines the get_ch_from_parent function of the output SNode
+    auto parent = stmt->input_snode;
+    if (parent->type == SNodeType::bit_struct) {
+      // Bit fields are addressed through their word
+      stmt->value = builder->CreateBitCast(
+          stmt->input_ptr->value,
+          PointerType::get(snode_attr[stmt->output_snode].llvm_type, 0));
+      return;
+    }
+    auto cell = builder->CreateBitCast(
+        stmt->input_ptr->value,
+        PointerType::get(snode_attr[parent].llvm_element_type, 0));
+    auto ch = builder->CreateGEP(
+        cell, {tlctx->get_constant(0), tlctx->get_constant(stmt->chid)});
     stmt->value = builder->CreateBitCast(
         ch, PointerType::get(snode_attr[stmt->output_snode].llvm_type, 0));
   }
@@ -1047,6 +2010,12 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
 
   BasicBlock *func_body_bb;
 
+  // The task type tells e.g. the list generation apart in profiles
+  std::string get_task_name(OffloadedStmt *stmt) {
+    return fmt::format("{}_{}_{}", kernel_name, task_counter++,
+                       OffloadedStmt::task_type_name(stmt->task_type));
+  }
+
   void init_offloaded_task_function(OffloadedStmt *stmt) {
     while_after_loop = nullptr;
     current_offloaded_stmt = stmt;
@@ -1055,13 +2024,20 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
         llvm::FunctionType::get(llvm::Type::getVoidTy(*llvm_context),
                                 {PointerType::get(context_ty, 0)}, false);
 
-    auto task_kernel_name = fmt::format("{}_{}", kernel_name, task_counter);
-    task_counter += 1;
+    auto task_kernel_name = get_task_name(stmt);
     func = Function::Create(task_function_type, Function::ExternalLinkage,
                             task_kernel_name, module.get());
 
     current_task = std::make_unique<OffloadedTask>(this);
     current_task->begin(task_kernel_name);
+    current_task->concurrent_with_next = stmt->concurrent_with_next;
+    current_task->num_cpu_threads = get_task_num_cpu_threads(stmt);
+    current_task->traffic = analysis::estimate_task_traffic(stmt);
+    current_task->structure = get_task_structure(stmt);
+    streaming_stores.clear();
+    if (current_arch() == Arch::x86_64 &&
+        get_current_program().config.cpu_streaming_stores)
+      streaming_stores = analysis::gather_streaming_stores(stmt);
 
     for (auto &arg : func->args()) {
       kernel_args.push_back(&arg);
@@ -1074,6 +2050,18 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
     // The real function body
     func_body_bb = BasicBlock::Create(*llvm_context, "body", func);
     builder->SetInsertPoint(func_body_bb);
+    // Past the end of a device loop, see Program::run_device_loop
+    auto gate_closed = BasicBlock::Create(*llvm_context, "gate_closed", func);
+    auto gate_open = BasicBlock::Create(*llvm_context, "gate_open", func);
+    builder->CreateCondBr(
+        builder->CreateICmpNE(create_call("loop_gate_closed", {get_context()}),
+                              tlctx->get_constant(0)),
+        gate_closed, gate_open);
+    builder->SetInsertPoint(gate_closed);
+    builder->CreateRetVoid();
+    builder->SetInsertPoint(gate_open);
+    // Serial tasks run a single "iteration"
+    begin_rand_iteration(tlctx->get_constant(0));
   }
 
   void finalize_offloaded_task_function() {
@@ -1147,6 +2135,60 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
     return FunctionCreationGuard(this, argument_types);
   }
 
+  // Marks the task loop closed by back_edge for the LLVM loop vectorizer.
+  // The iterations of a parallel task are independent, which the vectorizer
+  // cannot prove by itself through the SNode accessors.
+  void annotate_task_loop(llvm::BranchInst *back_edge, OffloadedStmt *stmt) {
+    auto hint = [&](const std::string &name, llvm::Constant *val) {
+      return llvm::MDNode::get(
+          *llvm_context, {llvm::MDString::get(*llvm_context, name),
+                          llvm::ConstantAsMetadata::get(val)});
+    };
+    auto self = llvm::MDNode::getTemporary(*llvm_context, llvm::None);
+    std::vector<llvm::Metadata *> args{self.get()};
+    if (stmt->vectorize > 1) {
+      args.push_back(hint("llvm.loop.vectorize.enable", builder->getTrue()));
+      args.push_back(hint("llvm.loop.vectorize.width",
+                          builder->getInt32(stmt->vectorize)));
+    }
+    auto loop_id = llvm::MDNode::get(*llvm_context, args);
+    loop_id->replaceOperandWith(0, loop_id);
+    back_edge->setMetadata(llvm::LLVMContext::MD_loop, loop_id);
+
+    if (stmt->num_cpu_threads <= 1)
+      return;
+    // Local variables may still be carried across iterations until promoted
+    // to registers. Calls pass the metadata on to the accesses they inline.
+    for (auto &bb : *func) {
+      for (auto &inst : bb) {
+        if (!inst.mayReadOrWriteMemory())
+          continue;
+        llvm::Value *ptr = nullptr;
+        if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst))
+          ptr = load->getPointerOperand();
+        else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst))
+          ptr = store->getPointerOperand();
+        if (ptr && llvm::isa<llvm::AllocaInst>(ptr->stripPointerCasts()))
+          continue;
+        inst.setMetadata(llvm::LLVMContext::MD_mem_parallel_loop_access,
+                         loop_id);
+      }
+    }
+  }
+
+  // A bound of a range-for task, loaded from the temporaries when only known
+  // at run time
+  llvm::Value *get_range_bound(OffloadedStmt *stmt, bool end) {
+    if (end ? stmt->const_end : stmt->const_begin)
+      return tlctx->get_constant(end ? stmt->end : stmt->begin);
+    auto temporaries = call("Runtime_get_temporaries", get_runtime());
+    auto offset = end ? stmt->end_offset : stmt->begin_offset;
+    auto addr =
+        builder->CreateGEP(temporaries, tlctx->get_constant((int64)offset));
+    return builder->CreateLoad(builder->CreatePointerCast(
+        addr, llvm::PointerType::get(tlctx->get_data_type(DataType::i32), 0)));
+  }
+
   void create_offload_range_for(OffloadedStmt *stmt) {
     int step = 1;
     if (stmt->reversed) {
@@ -1156,26 +2198,79 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
     llvm::Function *body;
 
     {
+      // The runtime passes a chunk of iterations [begin, end), so that the
+      // loop over them can be vectorized
       auto guard = get_function_creation_gurad(
           {llvm::PointerType::get(get_runtime_type("Context"), 0),
-           tlctx->get_data_type<int>()});
+           tlctx->get_data_type<int>(), tlctx->get_data_type<int>()});
 
+      auto begin = get_arg(1);
+      auto end = get_arg(2);
+      begin_counting_atomic_ops();
       auto loop_var = create_entry_block_alloca(DataType::i32);
       stmt->loop_vars_llvm.push_back(loop_var);
-      builder->CreateStore(get_arg(1), loop_var);
-      stmt->body->accept(this);
+      if (step == 1) {
+        builder->CreateStore(begin, loop_var);
+      } else {
+        builder->CreateStore(builder->CreateSub(end, tlctx->get_constant(1)),
+                             loop_var);
+      }
+
+      auto test_bb = BasicBlock::Create(*llvm_context, "test", func);
+      auto body_bb = BasicBlock::Create(*llvm_context, "loop_body", func);
+      auto after_loop = BasicBlock::Create(*llvm_context, "after_loop", func);
+      builder->CreateBr(test_bb);
+      {
+        builder->SetInsertPoint(test_bb);
+        auto i = builder->CreateLoad(loop_var);
+        llvm::Value *cond;
+        if (step == 1) {
+          cond = builder->CreateICmp(llvm::CmpInst::Predicate::ICMP_SLT, i,
+                                     end);
+        } else {
+          cond = builder->CreateICmp(llvm::CmpInst::Predicate::ICMP_SGE, i,
+                                     begin);
+        }
+        builder->CreateCondBr(cond, body_bb, after_loop);
+      }
+      {
+        builder->SetInsertPoint(body_bb);
+        begin_rand_iteration(builder->CreateLoad(loop_var));
+        stmt->body->accept(this);
+        create_increment(loop_var, tlctx->get_constant(step));
+        annotate_task_loop(builder->CreateBr(test_bb), stmt);
+      }
+      builder->SetInsertPoint(after_loop);
+      fence_streaming_stores();
+      end_counting_atomic_ops();
 
       body = guard.body;
     }
 
+    auto begin = get_range_bound(stmt, false);
+    if (kernel->is_host_twin) {
+      // The GPU runs the iterations before the one in the slot after the
+      // arguments, see Kernel::host_twin
+      auto split = builder->CreateTrunc(
+          call(builder, "Context_get_args", get_context(),
+               tlctx->get_constant((int)kernel->args.size())),
+          tlctx->get_data_type(DataType::i32));
+      begin = builder->CreateSelect(builder->CreateICmpSGT(split, begin),
+                                    split, begin);
+    }
     create_call("cpu_parallel_range_for",
                 {get_arg(0), tlctx->get_constant(stmt->num_cpu_threads),
-                 tlctx->get_constant(stmt->begin),
-                 tlctx->get_constant(stmt->end), tlctx->get_constant(step),
-                 tlctx->get_constant(stmt->block_dim), body});
+                 begin, get_range_bound(stmt, true),
+                 tlctx->get_constant(step),
+                 tlctx->get_constant(stmt->block_dim),
+                 tlctx->get_constant((int)stmt->schedule), body});
   }
 
-  void create_offload_struct_for(OffloadedStmt *stmt, bool spmd = false) {
+  // With elements_per_block > 1 (spmd only), each group of stmt->block_dim
+  // threads of a GPU block runs an element of its own
+  void create_offload_struct_for(OffloadedStmt *stmt,
+                                 bool spmd = false,
+                                 int elements_per_block = 1) {
     llvm::Function *body;
     auto leaf_block = stmt->snode->parent;
     {
@@ -1196,8 +2291,11 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
       llvm::Value *threadIdx = nullptr, *blockDim = nullptr;
 
       RuntimeObject element("Element", this, builder, get_arg(1));
+      current_element = get_arg(1);
       auto lower_bound = get_arg(2);
       auto upper_bound = get_arg(3);
+      if (!spmd)
+        begin_counting_atomic_ops();
       // create_print("lower", DataType::i32, lower_bound);
       // create_print("upper", DataType::i32, upper_bound);
 
@@ -1206,12 +2304,34 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
             Intrinsic::nvvm_read_ptx_sreg_tid_x, {}, {});
         blockDim = builder->CreateIntrinsic(
             Intrinsic::nvvm_read_ptx_sreg_ntid_x, {}, {});
+        if (elements_per_block > 1) {
+          // The thread within its group
+          blockDim = tlctx->get_constant(stmt->block_dim);
+          threadIdx = builder->CreateURem(threadIdx, blockDim);
+        }
         builder->CreateStore(builder->CreateAdd(threadIdx, lower_bound),
                              loop_index);
       } else {
         builder->CreateStore(lower_bound, loop_index);
       }
 
+      auto refine =
+          get_runtime_function(leaf_block->refine_coordinates_func_name());
+      bool has_scratch_pads =
+          stmt->block_initialization || stmt->block_finalization;
+      if (has_scratch_pads) {
+        // The previous leaf block may still be using the scratch pads
+        create_call("block_barrier", {});
+        block_corner_coordinates =
+            create_entry_block_alloca(physical_coordinate_ty);
+        create_call(refine, {element.get_ptr("pcoord"),
+                             block_corner_coordinates, tlctx->get_constant(0)});
+      }
+      if (stmt->block_initialization) {
+        stmt->block_initialization->accept(this);
+        create_call("block_barrier", {});
+      }
+
       // test bb
       auto test_bb = BasicBlock::Create(*llvm_context, "test", func);
       auto body_bb = BasicBlock::Create(*llvm_context, "loop_body", func);
@@ -1229,29 +2349,49 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
       builder->SetInsertPoint(body_bb);
 
       // initialize the coordinates
-      auto refine =
-          get_runtime_function(leaf_block->refine_coordinates_func_name());
       auto new_coordinates = create_entry_block_alloca(physical_coordinate_ty);
       create_call(refine, {element.get_ptr("pcoord"), new_coordinates,
                            builder->CreateLoad(loop_index)});
 
       current_coordinates = new_coordinates;
 
-      // Additional compare if non-POT exists
+      // Cells are keyed by their coordinates, which do not depend on the
+      // element list order
+      llvm::Value *cell_key = tlctx->get_constant(0);
+      {
+        auto coords =
+            RuntimeObject("PhysicalCoordinates", this, builder, new_coordinates);
+        for (int i = 0; i < stmt->snode->num_active_indices; i++) {
+          auto j = stmt->snode->physical_index_position[i];
+          cell_key = builder->CreateAdd(
+              builder->CreateMul(cell_key, tlctx->get_constant((int32)0x9E3779B1)),
+              coords.get("val", tlctx->get_constant(j)));
+        }
+      }
+      begin_rand_iteration(cell_key);
+
+      // Additional compare if non-POT exists, or to skip the halo
       auto nonpot_cond = tlctx->get_constant(true);
       auto snode = stmt->snode;
+      int halo = snode->halo_width();
 
       auto coord_object =
           RuntimeObject("PhysicalCoordinates", this, builder, new_coordinates);
       for (int i = 0; i < snode->num_active_indices; i++) {
         auto j = snode->physical_index_position[i];
-        if (!bit::is_power_of_two(snode->extractors[j].num_elements)) {
+        int num_elements = snode->extractors[j].num_elements;
+        if (!bit::is_power_of_two(num_elements) || halo) {
           auto coord = coord_object.get("val", tlctx->get_constant(j));
           nonpot_cond = builder->CreateAnd(
               nonpot_cond,
-              builder->CreateICmp(
-                  llvm::CmpInst::ICMP_SLT, coord,
-                  tlctx->get_constant(snode->extractors[j].num_elements)));
+              builder->CreateICmp(llvm::CmpInst::ICMP_SLT, coord,
+                                  tlctx->get_constant(num_elements - halo)));
+          if (halo) {
+            nonpot_cond = builder->CreateAnd(
+                nonpot_cond,
+                builder->CreateICmp(llvm::CmpInst::ICMP_SGE, coord,
+                                    tlctx->get_constant(halo)));
+          }
         }
       }
 
@@ -1273,50 +2413,123 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
 
       if (spmd) {
         create_increment(loop_index, blockDim);
+        builder->CreateBr(test_bb);
       } else {
         create_increment(loop_index, tlctx->get_constant(1));
+        annotate_task_loop(builder->CreateBr(test_bb), stmt);
       }
-      builder->CreateBr(test_bb);
 
       builder->SetInsertPoint(after_loop);
+      if (stmt->block_finalization) {
+        create_call("block_barrier", {});
+        stmt->block_finalization->accept(this);
+      }
+      fence_streaming_stores();
+      end_counting_atomic_ops();
       builder->CreateRetVoid();
+      current_element = nullptr;
     }
 
     int num_splits = leaf_block->max_num_elements() / stmt->block_dim;
+    bool persistent =
+        spmd && get_current_program().config.gpu_persistent_threads;
+    // The bytes of the next leaf block to prefetch, at most a page
+    int prefetch_bytes = 0;
+    if (!spmd && get_current_program().config.cpu_block_prefetch) {
+      prefetch_bytes = (int)std::min<std::size_t>(
+          tlctx->get_type_size(snode_attr[leaf_block].llvm_type), 4096);
+    }
+    // The cells of dynamic leaf blocks are split between the CPU threads by
+    // their number, which varies from block to block
+    bool balance_work = !spmd && leaf_block->type == SNodeType::dynamic;
     // traverse leaf node
-    create_call("for_each_block",
+    create_call(persistent ? "for_each_block_persistent" : "for_each_block",
                 {get_context(), tlctx->get_constant(leaf_block->id),
                  tlctx->get_constant(leaf_block->max_num_elements()),
-                 tlctx->get_constant(num_splits), body,
-                 tlctx->get_constant(stmt->num_cpu_threads)});
+                 tlctx->get_constant(num_splits),
+                 tlctx->get_constant(elements_per_block), body,
+                 tlctx->get_constant(stmt->num_cpu_threads),
+                 tlctx->get_constant(prefetch_bytes),
+                 tlctx->get_constant((int)balance_work)});
+  }
+
+  // Struct-for indices are logical, after the halo
+  llvm::Value *create_logical_index(llvm::Value *coord) {
+    int halo = current_offloaded_stmt->snode->halo_width();
+    if (!halo)
+      return coord;
+    return builder->CreateSub(coord, tlctx->get_constant(halo));
   }
 
   void visit(LoopIndexStmt *stmt) override {
     if (stmt->is_struct_for) {
-      stmt->value = builder->CreateLoad(builder->CreateGEP(
+      stmt->value = create_logical_index(builder->CreateLoad(builder->CreateGEP(
           current_coordinates, {tlctx->get_constant(0), tlctx->get_constant(0),
-                                tlctx->get_constant(stmt->index)}));
+                                tlctx->get_constant(stmt->index)})));
     } else {
       stmt->value = builder->CreateLoad(
           current_offloaded_stmt->loop_vars_llvm[stmt->index]);
     }
   }
 
+  void visit(BlockCornerIndexStmt *stmt) override {
+    stmt->value = create_logical_index(builder->CreateLoad(builder->CreateGEP(
+        block_corner_coordinates,
+        {tlctx->get_constant(0), tlctx->get_constant(0),
+         tlctx->get_constant(stmt->index)})));
+  }
+
   void visit(GlobalTemporaryStmt *stmt) override {
-    auto runtime = get_runtime();
-    auto addr =
-        builder->CreateGEP(runtime, tlctx->get_constant((int64)stmt->offset));
+    auto temporaries = call("Runtime_get_temporaries", get_runtime());
+    auto addr = builder->CreateGEP(temporaries,
+                                   tlctx->get_constant((int64)stmt->offset));
     TC_ASSERT(stmt->width() == 1);
     auto ptr_type = llvm::PointerType::get(
         tlctx->get_data_type(stmt->ret_type.data_type), 0);
     stmt->value = builder->CreatePointerCast(addr, ptr_type);
   }
 
+  // With FMAs in each thread
+  std::vector<llvm::Value *> emit_matmul_fma(MatmulStmt *stmt) {
+    std::vector<llvm::Value *> ret;
+    for (int i = 0; i < stmt->n; i++) {
+      for (int j = 0; j < stmt->m; j++) {
+        llvm::Value *sum = nullptr;
+        for (int l = 0; l < stmt->k; l++) {
+          auto prod = builder->CreateFMul(stmt->a[i * stmt->k + l]->value,
+                                          stmt->b[l * stmt->m + j]->value);
+          sum = sum ? builder->CreateFAdd(sum, prod) : prod;
+        }
+        ret.push_back(sum);
+      }
+    }
+    return ret;
+  }
+
+  virtual void visit(MatmulStmt *stmt) override {
+    TC_ASSERT(stmt->tensor_cores);
+    matmul_results[stmt] = emit_matmul_fma(stmt);
+  }
+
+  void visit(MatmulResultStmt *stmt) override {
+    TC_ASSERT(matmul_results.count(stmt->mm));
+    stmt->value = matmul_results[stmt->mm][stmt->index];
+  }
+
   void visit(OffloadedStmt *stmt) override {
     using Type = OffloadedStmt::TaskType;
+    std::string cache_key;
+    if (reuses_compiled_tasks()) {
+      cache_key = task_cache_key(stmt);
+      if (reuse_compiled_task(stmt, cache_key))
+        return;
+    }
     init_offloaded_task_function(stmt);
+    current_task->cache_key = cache_key;
     if (stmt->task_type == Type::serial) {
+      begin_counting_atomic_ops();
       stmt->body->accept(this);
+      end_counting_atomic_ops();
     } else if (stmt->task_type == Type::range_for) {
       create_offload_range_for(stmt);
     } else if (stmt->task_type == Type::struct_for) {
@@ -1327,6 +2540,19 @@ class CodeGenLLVM : public IRVisitor, public ModuleBuilder {
       emit_clear_list(stmt);
     } else if (stmt->task_type == Type::listgen) {
       emit_list_gen(stmt);
+    } else if (stmt->task_type == Type::gc) {
+      emit_gc(stmt);
+    } else if (stmt->task_type == Type::zero_fill) {
+      emit_zero_fill(stmt);
+    } else if (stmt->task_type == Type::deactivate_all) {
+      emit_deactivate_all_elements(stmt);
+      emit_node_resets(stmt->snode);
+    } else if (stmt->task_type == Type::defragment) {
+      emit_defragment_gather(stmt);
+      emit_defragment_copy(stmt, false);
+      emit_defragment_copy(stmt, true);
+    } else if (stmt->task_type == Type::deactivate_ambient) {
+      emit_deactivate_ambient(stmt);
     } else {
       TC_NOT_IMPLEMENTED
     }
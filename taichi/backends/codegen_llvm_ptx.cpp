@@ -27,9 +27,21 @@ class CodeGenLLVMGPU : public CodeGenLLVM {
  public:
   int kernel_grid_dim;
   int kernel_block_dim;
+  // The shared memory scratch pads of the current struct-for task
+  llvm::GlobalVariable *scratch_pads;
+  // Of the MatmulStmts of the current task
+  int warp_matmul_shared_bytes;
+  // See is_warp_uniform
+  std::unordered_map<Stmt *, bool> warp_uniform;
+
+  static constexpr int warp_size = 32;
+  // Of static shared memory per block
+  static constexpr int max_shared_bytes = 48 * 1024;
 
   CodeGenLLVMGPU(CodeGenBase *codegen_base, Kernel *kernel)
       : CodeGenLLVM(codegen_base, kernel) {
+    scratch_pads = nullptr;
+    warp_matmul_shared_bytes = 0;
   }
 
   void mark_function_as_cuda_kernel(llvm::Function *func) {
@@ -57,12 +69,33 @@ class CodeGenLLVMGPU : public CodeGenLLVM {
     MDNode *md_node = MDNode::get(*llvm_context, md_args);
 
     module->getOrInsertNamedMetadata("nvvm.annotations")->addOperand(md_node);
+
+    // Emitted as .maxnreg, which ptxas meets by spilling
+    if (auto max_registers = get_max_registers()) {
+      llvm::Metadata *maxnreg_args[] = {
+          llvm::ValueAsMetadata::get(func),
+          MDString::get(*llvm_context, "maxnreg"),
+          llvm::ValueAsMetadata::get(tlctx->get_constant(max_registers))};
+      module->getOrInsertNamedMetadata("nvvm.annotations")
+          ->addOperand(MDNode::get(*llvm_context, maxnreg_args));
+    }
+  }
+
+  // See CompileConfig::gpu_max_registers
+  int get_max_registers() {
+    if (kernel->gpu_max_registers > 0)
+      return kernel->gpu_max_registers;
+    return get_current_program().config.gpu_max_registers;
   }
 
   FunctionType compile_module_to_executable() override {
 #if defined(TLANG_WITH_CUDA)
-    auto offloaded_local = offloaded_tasks;
-    for (auto &task : offloaded_local) {
+    if (!has_new_tasks())
+      return make_executable_from_image("");
+    link_runtime_functions();
+    for (auto &task : offloaded_tasks) {
+      if (task.cuda_func)
+        continue;
       llvm::Function *func = module->getFunction(task.name);
       TC_ASSERT(func);
       mark_function_as_cuda_kernel(func);
@@ -72,77 +105,361 @@ class CodeGenLLVMGPU : public CodeGenLLVM {
       TC_INFO("IR before global optimization");
       module->print(errs(), nullptr);
     }
+    auto start_time = Time::get_time();
     auto ptx = compile_module_to_ptx(module);
+    record_stage("PTX generated", start_time);
     if (get_current_program().config.print_kernel_llvm_ir_optimized) {
       TC_P(ptx);
     }
-    auto cuda_module = cuda_context->compile(ptx);
-
-    for (auto &task : offloaded_local) {
-      task.cuda_func =
-          (void *)cuda_context->get_function(cuda_module, task.name);
+    auto &config = get_current_program().config;
+    // Either PTX, which the driver JIT-assembles on every load, or cubin
+    auto image = ptx;
+    if (config.use_cubin) {
+      start_time = Time::get_time();
+      image = cuda_context->compile_to_cubin(ptx, config.cubin_opt_level);
+      record_stage("Cubin assembled", start_time);
+    }
+    if (!offline_cache_key.empty()) {
+      OfflineCache::Entry entry;
+      entry.binary = image;
+      entry.tasks = get_offline_cache_tasks();
+      entry.temporaries_size = kernel->temporaries_size;
+      OfflineCache::store(offline_cache_key, entry);
     }
-    return [offloaded_local](Context context) {
-      for (auto task : offloaded_local) {
-        if (get_current_program().config.verbose_kernel_launches)
-          TC_INFO("Launching kernel {}<<<{}, {}>>>", task.name, task.grid_dim,
-                  task.block_dim);
+    start_time = Time::get_time();
+    auto executable = make_executable_from_image(image);
+    record_stage("Module loaded", start_time);
+    return executable;
+#else
+    TC_NOT_IMPLEMENTED;
+    return nullptr;
+#endif
+  }
 
-        if (get_current_program().config.enable_profiler) {
-          get_current_program().profiler_llvm->start(task.name);
-        }
-        cuda_context->launch((CUfunction)task.cuda_func, &context,
-                             task.grid_dim, task.block_dim);
-        if (get_current_program().config.enable_profiler) {
-          get_current_program().profiler_llvm->stop();
-        }
-      }
-    };
+  FunctionType load_offline_cache(const OfflineCache::Entry &entry) override {
+#if defined(TLANG_WITH_CUDA)
+    set_offline_cache_tasks(entry.tasks);
+    return make_executable_from_image(entry.binary);
 #else
     TC_NOT_IMPLEMENTED;
     return nullptr;
 #endif
   }
 
-  void visit(PrintStmt *stmt) override {
-    TC_ASSERT(stmt->width() == 1);
+  std::string get_offline_cache_config_key() override {
+#if defined(TLANG_WITH_CUDA)
+    auto &config = get_current_program().config;
+    return fmt::format(
+        "{} {} use_cubin={} cubin_opt_level={} persistent_threads={} "
+        "read_only_cache={} pack_leaf_blocks={} max_registers={}",
+        CodeGenLLVM::get_offline_cache_config_key(), cuda_context->get_mcpu(),
+        config.use_cubin, config.cubin_opt_level,
+        config.gpu_persistent_threads, config.gpu_read_only_cache,
+        config.gpu_pack_leaf_blocks, get_max_registers());
+#else
+    return CodeGenLLVM::get_offline_cache_config_key();
+#endif
+  }
 
-    auto value_type = tlctx->get_data_type(stmt->stmt->ret_type.data_type);
+#if defined(TLANG_WITH_CUDA)
+  // Times the candidate block sizes of one task over its first invocations, so
+  // that no invocation is executed more than once.
+  struct BlockDimTuner {
+    std::vector<int> candidates;
+    std::vector<float> times;
+    int best;
 
-    std::string format;
+    BlockDimTuner() {
+      best = 0;
+    }
 
-    auto value = stmt->stmt->value;
+    bool done() const {
+      return times.size() == candidates.size();
+    }
 
-    if (stmt->stmt->ret_type.data_type == DataType::i32) {
-      format = "%d";
-    } else if (stmt->stmt->ret_type.data_type == DataType::i64) {
-      format = "%lld";
-    } else if (stmt->stmt->ret_type.data_type == DataType::f32) {
-      value_type = llvm::Type::getDoubleTy(*llvm_context);
-      value = builder->CreateFPExt(value, value_type);
-      format = "%f";
-    } else if (stmt->stmt->ret_type.data_type == DataType::f64) {
-      format = "%.12f";
-    } else {
-      TC_NOT_IMPLEMENTED
+    void pick_best(const std::string &task_name) {
+      int best_index = 0;
+      for (int i = 1; i < (int)times.size(); i++) {
+        if (times[i] < times[best_index])
+          best_index = i;
+      }
+      best = candidates[best_index];
+      TC_TRACE("Tuned block_dim of {}: {} ({:.3f} ms)", task_name, best,
+               times[best_index]);
     }
+  };
 
-    std::vector<llvm::Type *> types{value_type};
-    auto stype = llvm::StructType::get(*llvm_context, types, false);
-    auto values = builder->CreateAlloca(stype);
-    auto value_ptr = builder->CreateGEP(
-        values, {tlctx->get_constant(0), tlctx->get_constant(0)});
-    builder->CreateStore(value, value_ptr);
+  // The range-for of a splittable kernel (CompileConfig::cpu_gpu_split). The
+  // GPU runs the first gpu_share of the iterations, in whole blocks, and the
+  // host twin the rest. The share follows the throughput of either side.
+  struct RangeSplit {
+    Kernel *host_twin;
+    int begin, end;
+    float64 gpu_share;
 
-    auto format_str = "[debug] " + stmt->str + " = " + format + "\n";
+    RangeSplit(Kernel *host_twin, int begin, int end)
+        : host_twin(host_twin), begin(begin), end(end), gpu_share(0.75) {
+    }
 
-    stmt->value = ModuleBuilder::call(
-        builder, "vprintf",
-        builder->CreateGlobalStringPtr(format_str, "format_string"),
-        builder->CreateBitCast(values,
-                               llvm::Type::getInt8PtrTy(*llvm_context)));
+    // Both sides get at least a block, so that both are measured
+    int gpu_blocks(int block_dim) const {
+      int num_blocks = (end - begin + block_dim - 1) / block_dim;
+      int blocks = (int)std::lround(gpu_share * num_blocks);
+      return std::max(1, std::min(num_blocks - 1, blocks));
+    }
+
+    void update(int gpu_iterations,
+                float64 gpu_time,
+                int cpu_iterations,
+                float64 cpu_time) {
+      auto gpu_rate = gpu_iterations / std::max(gpu_time, 1e-6);
+      auto cpu_rate = cpu_iterations / std::max(cpu_time, 1e-6);
+      // Halfway to the share that balances this launch, against noise
+      gpu_share = 0.5 * gpu_share + 0.5 * gpu_rate / (gpu_rate + cpu_rate);
+    }
+  };
+
+  // Whether the host can run part of the kernel, see RangeSplit
+  std::shared_ptr<RangeSplit> select_range_split(int num_args,
+                                                 int num_extra_args) {
+    auto &config = get_current_program().config;
+    if (!kernel->splittable || num_extra_args != 0 ||
+        num_args >= taichi_max_num_args || config.overlap_kernels ||
+        offloaded_tasks.size() != 1)
+      return nullptr;
+    // The host accesses unified memory while the GPU kernel runs
+    if (!cuda_context->get_attribute(
+            CU_DEVICE_ATTRIBUTE_CONCURRENT_MANAGED_ACCESS)) {
+      TC_WARN("The device cannot share unified memory with the host while "
+              "kernels run, kernel {} is not split",
+              kernel->name);
+      return nullptr;
+    }
+    auto stmt = kernel->ir->as<Block>()->statements[0]->as<OffloadedStmt>();
+    if (stmt->end - stmt->begin < 2 * offloaded_tasks[0].block_dim)
+      return nullptr;
+    return std::make_shared<RangeSplit>(kernel->host_twin, stmt->begin,
+                                        stmt->end);
   }
 
+  // Replaces default_gpu_block_dim for range-for tasks without an explicit
+  // block_dim: either the block size with the highest occupancy, or, with
+  // CompileConfig::gpu_block_dim_autotuning, the fastest power of two.
+  std::shared_ptr<std::vector<BlockDimTuner>> select_block_dims(
+      std::vector<OffloadedTask> &tasks) {
+    auto &config = get_current_program().config;
+    auto tuners = std::make_shared<std::vector<BlockDimTuner>>(tasks.size());
+    if (!config.auto_gpu_block_dim)
+      return tuners;
+    int num_SMs =
+        cuda_context->get_attribute(CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT);
+    for (int i = 0; i < (int)tasks.size(); i++) {
+      auto &task = tasks[i];
+      if (task.auto_block_dim_range == 0)
+        continue;
+      auto range = task.auto_block_dim_range;
+      int max_block_dim = cuda_context->get_max_potential_block_size(
+          (CUfunction)task.cuda_func);
+      if (config.gpu_block_dim_autotuning) {
+        for (int candidate = 32; candidate <= max_block_dim; candidate *= 2) {
+          (*tuners)[i].candidates.push_back(candidate);
+          if (candidate >= range)
+            break;
+        }
+        continue;
+      }
+      int block_dim = max_block_dim;
+      // Small ranges are better spread across all SMs than packed into a few
+      // large blocks
+      while (block_dim > 32 && (range + block_dim - 1) / block_dim < num_SMs)
+        block_dim /= 2;
+      task.block_dim = block_dim;
+      task.grid_dim = (range + block_dim - 1) / block_dim;
+    }
+    return tuners;
+  }
+
+  static void launch_split(RangeSplit &split,
+                           const OffloadedTask &task,
+                           const BlockDimTuner &tuner,
+                           int num_args,
+                           Context &context) {
+    auto twin = split.host_twin;
+    if (!twin->is_compiled)
+      twin->compile();
+    auto block_dim = tuner.best != 0 ? tuner.best : task.block_dim;
+    auto gpu_blocks = split.gpu_blocks(block_dim);
+    auto cpu_begin = std::min(split.end, split.begin + gpu_blocks * block_dim);
+    // The host reads what earlier kernels write
+    get_current_program().synchronize();
+    context.set_arg(num_args, cpu_begin);
+    float64 cpu_time = 0;
+    auto gpu_time = cuda_context->launch_with_host_work(
+        (CUfunction)task.cuda_func, gpu_blocks, block_dim, [&] {
+          Timeline::Guard _(twin->name, "host twin");
+          auto begin = Time::get_time();
+          twin->compiled(context);
+          cpu_time = (Time::get_time() - begin) * 1000;
+        });
+    split.update(cpu_begin - split.begin, gpu_time, split.end - cpu_begin,
+                 cpu_time);
+  }
+
+  FunctionType make_executable_from_image(const std::string &image) {
+    if (has_new_tasks()) {
+      auto cuda_module = cuda_context->compile(image);
+      int num_SMs =
+          cuda_context->get_attribute(CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT);
+      // Reused tasks are in the modules of earlier kernels
+      for (auto &task : offloaded_tasks) {
+        if (!task.cuda_func) {
+          task.cuda_func =
+              (void *)cuda_context->get_function(cuda_module, task.name);
+        }
+        task.resources =
+            cuda_context->get_function_resources((CUfunction)task.cuda_func);
+        if (get_current_program().config.verbose) {
+          TC_INFO("Task {}: {} registers, {} B local memory (spills), {} B "
+                  "shared memory",
+                  task.name, task.resources.num_registers,
+                  task.resources.local_bytes, task.resources.shared_bytes);
+        }
+        if (task.grid_dim == 0) {
+          // Persistent tasks run as many blocks as can be resident at once,
+          // which grid_barrier relies on. So do range-fors with bounds known
+          // only at run time.
+          int blocks_per_SM =
+              cuda_context->get_max_active_blocks_per_multiprocessor(
+                  (CUfunction)task.cuda_func, task.block_dim);
+          TC_ASSERT(blocks_per_SM > 0);
+          task.grid_dim = std::min(
+              {num_SMs * blocks_per_SM, taichi_max_gpu_persistent_blocks,
+               taichi_listgen_max_num_threads / task.block_dim});
+        }
+      }
+    }
+    store_compiled_tasks();
+    auto offloaded_local = offloaded_tasks;
+    auto tuners = select_block_dims(offloaded_local);
+    // With CompileConfig::use_cuda_graph, the task launches are captured into
+    // a CUDA graph on the first invocation and replayed afterwards
+    auto graph = std::shared_ptr<CUgraphExec>(
+        new CUgraphExec(nullptr), [](CUgraphExec *graph) {
+          if (*graph)
+            cuGraphExecDestroy(*graph);
+          delete graph;
+        });
+    // Profiler record of each task, looked up on the first profiled launch
+    auto profiler_ids = std::make_shared<std::vector<int>>();
+    // Only the argument slots and array shapes of this kernel are uploaded
+    int num_args = (int)kernel->args.size();
+    int num_extra_args = 0;
+    for (int i = 0; i < num_args; i++) {
+      if (kernel->args[i].is_nparray)
+        num_extra_args = i + 1;
+    }
+    auto split = select_range_split(num_args, num_extra_args);
+    return [offloaded_local, graph, tuners, profiler_ids, num_args,
+            num_extra_args, split](Context &context) {
+      auto &config = get_current_program().config;
+      auto &profiler = get_current_program().profiler_llvm;
+      if (config.enable_profiler && profiler_ids->empty()) {
+        for (auto &task : offloaded_local) {
+          profiler_ids->push_back(profiler->get_record_id(task.name));
+          profiler->set_traffic(profiler_ids->back(), task.traffic);
+          profiler->set_resources(profiler_ids->back(), task.resources);
+        }
+      }
+      auto &breakdown = get_current_program().launch_breakdown;
+      auto upload_begin = breakdown.enabled ? Time::get_cycles() : 0;
+      cuda_context->upload_context(&context, num_args, num_extra_args);
+      if (breakdown.enabled) {
+        breakdown.add_nested(LaunchBreakdown::upload,
+                             Time::get_cycles() - upload_begin);
+      }
+      bool tuning = false;
+      for (auto &tuner : *tuners) {
+        tuning = tuning || !tuner.done();
+      }
+      if (split && !tuning && !config.enable_profiler) {
+        launch_split(*split, offloaded_local[0], (*tuners)[0], num_args,
+                     context);
+        return;
+      }
+      // Per-task profiling, logging, error checking and block_dim tuning need
+      // separate launches. Graphs keep the Context buffer of the stream they
+      // were captured on, while overlapped launches switch streams.
+      bool use_graph = config.use_cuda_graph && !config.overlap_kernels &&
+                       !config.enable_profiler &&
+                       !config.verbose_kernel_launches && !config.debug &&
+                       !tuning;
+      if (use_graph && *graph) {
+        // The graph has all tasks, whose effects are still recorded
+        for (auto &task : offloaded_local)
+          get_current_program().list_tracker.skip(task.structure);
+        auto launch_begin = breakdown.enabled ? Time::get_cycles() : 0;
+        cuda_context->launch_graph(*graph);
+        if (breakdown.enabled) {
+          breakdown.add_nested(LaunchBreakdown::launch,
+                               Time::get_cycles() - launch_begin);
+        }
+        return;
+      }
+      if (use_graph)
+        cuda_context->begin_capture();
+      for (int i = 0; i < (int)offloaded_local.size(); i++) {
+        auto &task = offloaded_local[i];
+        auto &tuner = (*tuners)[i];
+        // Captured graphs have all tasks
+        if (get_current_program().list_tracker.skip(task.structure) &&
+            !use_graph) {
+          get_current_program().num_skipped_list_tasks++;
+          continue;
+        }
+        auto block_dim = task.block_dim;
+        auto grid_dim = task.grid_dim;
+        if (!tuner.done()) {
+          block_dim = tuner.candidates[tuner.times.size()];
+          grid_dim = (task.auto_block_dim_range + block_dim - 1) / block_dim;
+        } else if (tuner.best != 0) {
+          block_dim = tuner.best;
+          grid_dim = (task.auto_block_dim_range + block_dim - 1) / block_dim;
+        }
+        if (config.verbose_kernel_launches)
+          TC_INFO("Launching kernel {}<<<{}, {}>>>", task.name, grid_dim,
+                  block_dim);
+
+        if (config.enable_profiler) {
+          profiler->start((*profiler_ids)[i]);
+        }
+        // Only the launch, since the task runs asynchronously
+        Timeline::Guard _(task.name, "launch");
+        if (!tuner.done()) {
+          tuner.times.push_back(cuda_context->launch_timed(
+              (CUfunction)task.cuda_func, grid_dim, block_dim));
+          if (tuner.done())
+            tuner.pick_best(task.name);
+        } else {
+          auto launch_begin = breakdown.enabled ? Time::get_cycles() : 0;
+          cuda_context->launch((CUfunction)task.cuda_func, grid_dim,
+                               block_dim);
+          if (breakdown.enabled) {
+            breakdown.add_nested(LaunchBreakdown::launch,
+                                 Time::get_cycles() - launch_begin);
+          }
+        }
+        if (config.enable_profiler) {
+          profiler->stop();
+        }
+      }
+      if (use_graph) {
+        *graph = cuda_context->end_capture();
+        cuda_context->launch_graph(*graph);
+      }
+    };
+  }
+#endif
+
   void emit_extra_unary(UnaryOpStmt *stmt) override {
     // functions from libdevice
     auto input = stmt->operand->value;
@@ -211,56 +528,324 @@ class CodeGenLLVMGPU : public CodeGenLLVM {
 
   void visit(AtomicOpStmt *stmt) override {
     TC_ASSERT(stmt->width() == 1);
+    if (atomic_add_bit_field(stmt))
+      return;
     // https://llvm.org/docs/NVPTXUsage.html#address-spaces
     bool is_local = stmt->dest->is<AllocaStmt>();
     if (is_local) {
       TC_ERROR("Local atomics should have been demoted.");
+    } else if (stmt->is_reduction) {
+      auto dt = stmt->val->ret_type.data_type;
+      auto func = fmt::format("reduce_add_{}", data_type_short_name(dt));
+      builder->CreateCall(get_runtime_function(func),
+                          {stmt->dest->value, stmt->val->value});
     } else {
-      for (int l = 0; l < stmt->width(); l++) {
-        TC_ASSERT(stmt->op_type == AtomicOpType::add);
-        if (is_integral(stmt->val->ret_type.data_type)) {
-          builder->CreateAtomicRMW(
-              llvm::AtomicRMWInst::BinOp::Add, stmt->dest->value,
-              stmt->val->value, llvm::AtomicOrdering::SequentiallyConsistent);
-        } else if (stmt->val->ret_type.data_type == DataType::f32) {
-          auto dt = tlctx->get_data_type(DataType::f32);
-          builder->CreateIntrinsic(Intrinsic::nvvm_atomic_load_add_f32,
-                                   {llvm::PointerType::get(dt, 0)},
-                                   {stmt->dest->value, stmt->val->value});
-        } else if (stmt->val->ret_type.data_type == DataType::f64) {
-          auto dt = tlctx->get_data_type(DataType::f64);
-          builder->CreateIntrinsic(Intrinsic::nvvm_atomic_load_add_f64,
-                                   {llvm::PointerType::get(dt, 0)},
-                                   {stmt->dest->value, stmt->val->value});
-        } else {
-          TC_NOT_IMPLEMENTED
-        }
-      }
+      create_atomic(stmt);
     }
   }
 
-  void visit(RandStmt *stmt) override {
-    stmt->value =
-        create_call(fmt::format("cuda_rand_{}",
-                                data_type_short_name(stmt->ret_type.data_type)),
-                    {get_context()});
+  // Native on GPUs
+  void create_atomic_add_float(AtomicOpStmt *stmt) override {
+    auto dt = stmt->val->ret_type.data_type;
+    auto intrinsic = dt == DataType::f32 ? Intrinsic::nvvm_atomic_load_add_f32
+                                         : Intrinsic::nvvm_atomic_load_add_f64;
+    builder->CreateIntrinsic(
+        intrinsic, {llvm::PointerType::get(tlctx->get_data_type(dt), 0)},
+        {stmt->dest->value, stmt->val->value});
   }
+
   void visit(RangeForStmt *for_stmt) override {
     create_naive_range_for(for_stmt);
   }
 
+  void visit(ThreadIndexStmt *stmt) override {
+    stmt->value =
+        builder->CreateIntrinsic(Intrinsic::nvvm_read_ptx_sreg_tid_x, {}, {});
+  }
+
+  void visit(ScratchPadPtrStmt *stmt) override {
+    if (!scratch_pads) {
+      auto size = current_offloaded_stmt->scratch_pad_size;
+      TC_ASSERT(size > 0);
+      auto type = llvm::ArrayType::get(llvm::Type::getInt8Ty(*llvm_context),
+                                       size);
+      // Address space 3 is shared memory
+      scratch_pads = new llvm::GlobalVariable(
+          *module, type, false, llvm::GlobalValue::InternalLinkage,
+          llvm::UndefValue::get(type),
+          fmt::format("{}_scratch_pads", func->getName().str()), nullptr,
+          llvm::GlobalValue::NotThreadLocal, 3);
+      scratch_pads->setAlignment(8);
+    }
+    auto addr = builder->CreateGEP(
+        scratch_pads, {tlctx->get_constant(0), stmt->offset->value});
+    auto ptr_type = llvm::PointerType::get(
+        tlctx->get_data_type(stmt->ret_type.data_type), 3);
+    stmt->value = builder->CreateAddrSpaceCast(
+        builder->CreatePointerCast(addr, ptr_type),
+        llvm::PointerType::get(tlctx->get_data_type(stmt->ret_type.data_type),
+                               0));
+  }
+
+  // Conservatively, is the value the same in all threads of a warp? Not if
+  // it depends on loop or thread indices, locals or random numbers.
+  bool is_warp_uniform(Stmt *stmt) {
+    if (warp_uniform.count(stmt))
+      return warp_uniform[stmt];
+    bool ret;
+    if (stmt->is<ConstStmt>() || stmt->is<ArgLoadStmt>() ||
+        stmt->is<GetRootStmt>() || stmt->is<GlobalTemporaryStmt>()) {
+      ret = true;
+    } else if (stmt->is<UnaryOpStmt>() || stmt->is<BinaryOpStmt>() ||
+               stmt->is<TernaryOpStmt>() || stmt->is<GlobalLoadStmt>() ||
+               stmt->is<GlobalPtrStmt>() || stmt->is<ExternalPtrStmt>() ||
+               stmt->is<SNodeLookupStmt>() || stmt->is<GetChStmt>() ||
+               stmt->is<LinearizeStmt>() ||
+               stmt->is<OffsetAndExtractBitsStmt>() ||
+               stmt->is<IntegerOffsetStmt>()) {
+      ret = true;
+      for (int i = 0; i < stmt->num_operands(); i++)
+        ret = ret && is_warp_uniform(stmt->operand(i));
+    } else {
+      ret = false;
+    }
+    warp_uniform[stmt] = ret;
+    return ret;
+  }
+
+  llvm::Function *get_nvvm_intrinsic(const std::string &name,
+                                     llvm::Type *ret_type,
+                                     std::vector<llvm::Type *> arg_types) {
+    auto f = module->getFunction(name);
+    if (!f) {
+      f = llvm::Function::Create(
+          llvm::FunctionType::get(ret_type, arg_types, false),
+          llvm::Function::ExternalLinkage, name, module.get());
+    }
+    return f;
+  }
+
+  // The product on the tensor cores, in a warp whose threads are all active.
+  // pad is the shared memory of the warp: the row-major n x k matrix a, then
+  // the k x 32 matrix of the columns j of the b of the threads, both in f16,
+  // and the n x 32 f32 products of the two.
+  std::vector<llvm::Value *> emit_warp_matmul_wmma(MatmulStmt *stmt,
+                                                   llvm::Value *pad) {
+    int n = stmt->n, k = stmt->k, m = stmt->m;
+    int b_offset = n * k * 2;
+    int c_offset = b_offset + k * warp_size * 2;
+    auto f16 = llvm::Type::getHalfTy(*llvm_context);
+    auto f32 = llvm::Type::getFloatTy(*llvm_context);
+    auto i32 = llvm::Type::getInt32Ty(*llvm_context);
+    auto i8 = llvm::Type::getInt8Ty(*llvm_context);
+    auto i8_shared = llvm::PointerType::get(i8, 3);
+    auto lane = builder->CreateURem(
+        builder->CreateIntrinsic(Intrinsic::nvvm_read_ptx_sreg_tid_x, {}, {}),
+        tlctx->get_constant(warp_size));
+    // At offset bytes, plus elem_bytes per lane unless 0
+    auto at = [&](int offset, llvm::Type *type, int elem_bytes = 0) {
+      llvm::Value *bytes = tlctx->get_constant(offset);
+      if (elem_bytes)
+        bytes = builder->CreateAdd(
+            bytes, builder->CreateMul(lane, tlctx->get_constant(elem_bytes)));
+      auto ptr = builder->CreateGEP(pad, bytes);
+      return builder->CreatePointerCast(ptr, llvm::PointerType::get(type, 3));
+    };
+    auto sync_warp = [&] {
+      builder->CreateIntrinsic(Intrinsic::nvvm_bar_warp_sync, {},
+                               {tlctx->get_constant(-1)});
+    };
+
+    // Fragments of 16x16 tiles, see the WMMA intrinsics of NVPTX
+    auto frag_ab = llvm::StructType::get(
+        *llvm_context,
+        std::vector<llvm::Type *>(8, llvm::VectorType::get(f16, 2)));
+    auto frag_cd = llvm::StructType::get(*llvm_context,
+                                         std::vector<llvm::Type *>(8, f32));
+    auto load_a = get_nvvm_intrinsic(
+        "llvm.nvvm.wmma.m16n16k16.load.a.row.stride.f16.p3i8", frag_ab,
+        {i8_shared, i32});
+    auto load_b = get_nvvm_intrinsic(
+        "llvm.nvvm.wmma.m16n16k16.load.b.row.stride.f16.p3i8", frag_ab,
+        {i8_shared, i32});
+    std::vector<llvm::Type *> mma_args(16, frag_ab->getElementType(0));
+    mma_args.resize(24, f32);
+    auto mma = get_nvvm_intrinsic(
+        "llvm.nvvm.wmma.m16n16k16.mma.row.row.f32.f32", frag_cd, mma_args);
+    std::vector<llvm::Type *> store_args(9, f32);
+    store_args[0] = i8_shared;
+    store_args.push_back(i32);
+    auto store_d = get_nvvm_intrinsic(
+        "llvm.nvvm.wmma.m16n16k16.store.d.row.stride.f32.p3i8",
+        llvm::Type::getVoidTy(*llvm_context), store_args);
+
+    // a is the same in all threads, which all store it
+    for (int i = 0; i < n * k; i++)
+      builder->CreateStore(builder->CreateFPTrunc(stmt->a[i]->value, f16),
+                           at(i * 2, f16));
+    sync_warp();
+    std::vector<llvm::Value *> a_frags;
+    for (int i = 0; i < n; i += 16) {
+      for (int l = 0; l < k; l += 16) {
+        a_frags.push_back(builder->CreateCall(
+            load_a,
+            {at((i * k + l) * 2, i8),
+             tlctx->get_constant(k)}));
+      }
+    }
+    auto fields = [&](llvm::Value *frag, std::vector<llvm::Value *> &args) {
+      for (int i = 0; i < 8; i++)
+        args.push_back(builder->CreateExtractValue(frag, i));
+    };
+
+    std::vector<llvm::Value *> ret(n * m);
+    for (int j = 0; j < m; j++) {
+      for (int l = 0; l < k; l++) {
+        builder->CreateStore(
+            builder->CreateFPTrunc(stmt->b[l * m + j]->value, f16),
+            at(b_offset + l * warp_size * 2, f16, 2));
+      }
+      sync_warp();
+      for (int c = 0; c < warp_size; c += 16) {
+        std::vector<llvm::Value *> b_frags;
+        for (int l = 0; l < k; l += 16) {
+          b_frags.push_back(builder->CreateCall(
+              load_b, {at(b_offset + (l * warp_size + c) * 2,
+                          i8),
+                       tlctx->get_constant(warp_size)}));
+        }
+        for (int i = 0; i < n; i += 16) {
+          llvm::Value *acc = nullptr;
+          for (int l = 0; l < k; l += 16) {
+            std::vector<llvm::Value *> args;
+            fields(a_frags[i / 16 * (k / 16) + l / 16], args);
+            fields(b_frags[l / 16], args);
+            if (acc)
+              fields(acc, args);
+            else
+              args.resize(24, llvm::ConstantFP::get(f32, 0));
+            acc = builder->CreateCall(mma, args);
+          }
+          std::vector<llvm::Value *> args;
+          args.push_back(at(c_offset + (i * warp_size + c) * 4,
+                            i8));
+          fields(acc, args);
+          args.push_back(tlctx->get_constant(warp_size));
+          builder->CreateCall(store_d, args);
+        }
+      }
+      sync_warp();
+      // Column lane of the products
+      for (int i = 0; i < n; i++) {
+        ret[i * m + j] =
+            builder->CreateLoad(at(c_offset + i * warp_size * 4, f32, 4));
+      }
+      // Before the next column overwrites the tiles
+      sync_warp();
+    }
+    return ret;
+  }
+
+  void visit(MatmulStmt *stmt) override {
+    TC_ASSERT(stmt->tensor_cores);
+    int n = stmt->n, k = stmt->k, m = stmt->m;
+    int num_warps = (kernel_block_dim + warp_size - 1) / warp_size;
+    int pad_bytes = (n * k + k * warp_size) * 2 + n * warp_size * 4;
+    int shared_bytes = current_offloaded_stmt->scratch_pad_size +
+                       warp_matmul_shared_bytes + num_warps * pad_bytes;
+    std::string reason;
+    if (cuda_context->get_compute_capability() < 70) {
+      reason = "no tensor cores before sm_70";
+    } else if (n % 16 != 0 || k % 16 != 0) {
+      reason = "the left-hand side is not of 16x16 tiles";
+    } else if (kernel_block_dim < warp_size ||
+               (current_offloaded_stmt->task_type ==
+                    OffloadedStmt::TaskType::struct_for &&
+                current_offloaded_stmt->block_dim < warp_size)) {
+      reason = "blocks are smaller than a warp";
+    } else if (!std::all_of(stmt->a.begin(), stmt->a.end(),
+                            [&](Stmt *s) { return is_warp_uniform(s); })) {
+      reason = "the left-hand side is not provably warp-uniform";
+    } else if (shared_bytes > max_shared_bytes) {
+      reason = fmt::format("{} B of shared memory for blocks of {} threads",
+                           shared_bytes, kernel_block_dim);
+    }
+    if (!reason.empty()) {
+      TC_WARN("warp_matmul<{}x{}x{}> falls back to FMAs: {}", n, k, m, reason);
+      CodeGenLLVM::visit(stmt);
+      return;
+    }
+
+    // The shared memory is sized for the block size chosen here
+    current_task->auto_block_dim_range = 0;
+    warp_matmul_shared_bytes += num_warps * pad_bytes;
+    auto type = llvm::ArrayType::get(llvm::Type::getInt8Ty(*llvm_context),
+                                     num_warps * pad_bytes);
+    auto pads = new llvm::GlobalVariable(
+        *module, type, false, llvm::GlobalValue::InternalLinkage,
+        llvm::UndefValue::get(type),
+        fmt::format("{}_warp_matmul_pads", func->getName().str()), nullptr,
+        llvm::GlobalValue::NotThreadLocal, 3);
+    pads->setAlignment(128);
+    auto warp = builder->CreateUDiv(
+        builder->CreateIntrinsic(Intrinsic::nvvm_read_ptx_sreg_tid_x, {}, {}),
+        tlctx->get_constant(warp_size));
+    auto pad = builder->CreateGEP(
+        pads, {tlctx->get_constant(0),
+               builder->CreateMul(warp, tlctx->get_constant(pad_bytes))});
+
+    // WMMA needs all threads of the warp, which e.g. the last block of a
+    // range-for may not have
+    auto full = builder->CreateICmpEQ(create_call("warp_active_mask"),
+                                      tlctx->get_constant(-1));
+    auto wmma_bb = BasicBlock::Create(*llvm_context, "warp_matmul_wmma", func);
+    auto fma_bb = BasicBlock::Create(*llvm_context, "warp_matmul_fma", func);
+    auto after = BasicBlock::Create(*llvm_context, "warp_matmul_after", func);
+    builder->CreateCondBr(full, wmma_bb, fma_bb);
+    builder->SetInsertPoint(wmma_bb);
+    // Reconverges the warp
+    builder->CreateIntrinsic(Intrinsic::nvvm_bar_warp_sync, {},
+                             {tlctx->get_constant(-1)});
+    auto wmma = emit_warp_matmul_wmma(stmt, pad);
+    auto wmma_end = builder->GetInsertBlock();
+    builder->CreateBr(after);
+    builder->SetInsertPoint(fma_bb);
+    auto fma = emit_matmul_fma(stmt);
+    auto fma_end = builder->GetInsertBlock();
+    builder->CreateBr(after);
+    builder->SetInsertPoint(after);
+    std::vector<llvm::Value *> results;
+    for (int i = 0; i < n * m; i++) {
+      auto phi = builder->CreatePHI(llvm::Type::getFloatTy(*llvm_context), 2);
+      phi->addIncoming(wmma[i], wmma_end);
+      phi->addIncoming(fma[i], fma_end);
+      results.push_back(phi);
+    }
+    matmul_results[stmt] = results;
+  }
+
   void create_offload_range_for(OffloadedStmt *stmt) {
     auto loop_var = create_entry_block_alloca(DataType::i32);
     stmt->loop_vars_llvm.push_back(loop_var);
-    auto loop_begin = stmt->begin;
-    auto loop_end = stmt->end;
     auto loop_block_dim = stmt->block_dim;
+    bool const_range = stmt->const_begin && stmt->const_end;
     if (loop_block_dim == 0) {
       loop_block_dim = get_current_program().config.default_gpu_block_dim;
+      // The loop body reads blockDim at run time, so the block size can still
+      // be changed once register usage is known. See select_block_dims.
+      if (const_range)
+        current_task->auto_block_dim_range = stmt->end - stmt->begin;
+    }
+    if (const_range) {
+      kernel_grid_dim =
+          (stmt->end - stmt->begin + loop_block_dim - 1) / loop_block_dim;
+    } else {
+      // The threads resident at once stride over the range read at launch,
+      // see make_executable_from_image
+      kernel_grid_dim = 0;
     }
-    kernel_grid_dim =
-        (loop_end - loop_begin + loop_block_dim - 1) / loop_block_dim;
     kernel_block_dim = loop_block_dim;
+    BasicBlock *test = BasicBlock::Create(*llvm_context, "loop_test", func);
     BasicBlock *body = BasicBlock::Create(*llvm_context, "loop_body", func);
     BasicBlock *after_loop = BasicBlock::Create(*llvm_context, "block", func);
 
@@ -271,60 +856,213 @@ class CodeGenLLVMGPU : public CodeGenLLVM {
     auto blockDim =
         builder->CreateIntrinsic(Intrinsic::nvvm_read_ptx_sreg_ntid_x, {}, {});
 
+    auto loop_begin = get_range_bound(stmt, false);
+    auto loop_end = get_range_bound(stmt, true);
     auto loop_id = builder->CreateAdd(
-        tlctx->get_constant(stmt->begin),
+        loop_begin,
         builder->CreateAdd(threadIdx, builder->CreateMul(blockIdx, blockDim)));
 
     builder->CreateStore(loop_id, loop_var);
+    builder->CreateBr(test);
 
+    builder->SetInsertPoint(test);
     auto cond = builder->CreateICmp(llvm::CmpInst::Predicate::ICMP_SLT,
-                                    builder->CreateLoad(loop_var),
-                                    tlctx->get_constant(stmt->end));
+                                    builder->CreateLoad(loop_var), loop_end);
 
     builder->CreateCondBr(cond, body, after_loop);
     {
       // body cfg
       builder->SetInsertPoint(body);
+      begin_rand_iteration(builder->CreateLoad(loop_var));
       stmt->body->accept(this);
-      builder->CreateBr(after_loop);
+      if (const_range) {
+        builder->CreateBr(after_loop);
+      } else {
+        auto gridDim = builder->CreateIntrinsic(
+            Intrinsic::nvvm_read_ptx_sreg_nctaid_x, {}, {});
+        create_increment(loop_var, builder->CreateMul(gridDim, blockDim));
+        builder->CreateBr(test);
+      }
     }
 
     builder->SetInsertPoint(after_loop);
   }
 
+  // Ends the current task and starts another kernel for the same offloaded
+  // statement
+  void begin_next_task(OffloadedStmt *stmt) {
+    finalize_offloaded_task_function();
+    current_task->grid_dim = kernel_grid_dim;
+    current_task->block_dim = kernel_block_dim;
+    current_task->end();
+    init_offloaded_task_function(stmt);
+  }
+
+  // With CompileConfig::gpu_persistent_threads, the clear_list and listgen
+  // tasks before a struct-for run in the kernel of the struct-for, one after
+  // the other with grid barriers in between, instead of a kernel each
+  bool is_chained_with_next(OffloadedStmt *stmt) {
+    using Type = OffloadedStmt::TaskType;
+    if (!get_current_program().config.gpu_persistent_threads)
+      return false;
+    if (stmt->task_type != Type::clear_list &&
+        stmt->task_type != Type::listgen)
+      return false;
+    auto &statements = stmt->parent->statements;
+    for (int i = stmt->parent->locate(stmt) + 1; i < (int)statements.size();
+         i++) {
+      auto next = statements[i]->cast<OffloadedStmt>();
+      if (!next)
+        return false;
+      if (next->task_type == Type::struct_for)
+        return true;
+      if (next->task_type != Type::clear_list &&
+          next->task_type != Type::listgen)
+        return false;
+    }
+    return false;
+  }
+
+  // Set while the kernel of the previous task continues with the next one
+  bool continuing_task = false;
+
+  // Emits body for the threads where cond holds
+  void emit_if(llvm::Value *cond, const std::function<void()> &body) {
+    auto then_bb = BasicBlock::Create(*llvm_context, "then", func);
+    auto after_bb = BasicBlock::Create(*llvm_context, "after", func);
+    builder->CreateCondBr(cond, then_bb, after_bb);
+    builder->SetInsertPoint(then_bb);
+    body();
+    builder->CreateBr(after_bb);
+    builder->SetInsertPoint(after_bb);
+  }
+
+  llvm::Value *is_first(const std::string &index_func) {
+    return builder->CreateICmpEQ(create_call(index_func),
+                                 tlctx->get_constant(0));
+  }
+
   void visit(OffloadedStmt *stmt) override {
 #if defined(TLANG_WITH_CUDA)
-    int num_SMs;
-    cudaDeviceGetAttribute(&num_SMs, cudaDevAttrMultiProcessorCount, 0);
-    int max_block_dim;
-    cudaDeviceGetAttribute(&max_block_dim, cudaDevAttrMaxBlockDimX, 0);
+    int num_SMs =
+        cuda_context->get_attribute(CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT);
     using Type = OffloadedStmt::TaskType;
-    kernel_grid_dim = 1;
-    kernel_block_dim = 1;
-    init_offloaded_task_function(stmt);
+    bool chained = continuing_task;
+    if (chained) {
+      // The previous tasks must be done on the whole grid
+      current_offloaded_stmt = stmt;
+      create_call("grid_barrier", {get_runtime()});
+    } else {
+      kernel_grid_dim = 1;
+      kernel_block_dim = 1;
+      scratch_pads = nullptr;
+      warp_matmul_shared_bytes = 0;
+      init_offloaded_task_function(stmt);
+    }
+    continuing_task = is_chained_with_next(stmt);
+    chained = chained || continuing_task;
     if (stmt->task_type == Type::serial) {
       stmt->body->accept(this);
     } else if (stmt->task_type == Type::range_for) {
       create_offload_range_for(stmt);
     } else if (stmt->task_type == Type::struct_for) {
       kernel_grid_dim = num_SMs * 32;  // each SM can have 16-32 resident blocks
+      if (get_current_program().config.gpu_persistent_threads) {
+        // The resident blocks, picked on module load
+        kernel_grid_dim = 0;
+      }
+      auto &config = get_current_program().config;
       kernel_block_dim = stmt->block_dim;
       if (kernel_block_dim == 0)
-        kernel_block_dim = get_current_program().config.default_gpu_block_dim;
+        kernel_block_dim = config.default_gpu_block_dim;
       kernel_block_dim =
           std::min(stmt->snode->parent->max_num_elements(), kernel_block_dim);
+      // Small leaf blocks share the blocks of the grid, unless the block size
+      // is given or the scratch pads of the block are for one element
+      int elements_per_block = 1;
+      if (config.gpu_pack_leaf_blocks && stmt->block_dim == 0 &&
+          !stmt->block_initialization && !stmt->block_finalization) {
+        elements_per_block =
+            std::max(1, config.default_gpu_block_dim / kernel_block_dim);
+      }
       stmt->block_dim = kernel_block_dim;
-      create_offload_struct_for(stmt, true);
+      kernel_block_dim *= elements_per_block;
+      create_offload_struct_for(stmt, true, elements_per_block);
     } else if (stmt->task_type == Type::clear_list) {
-      emit_clear_list(stmt);
+      if (chained) {
+        // A single thread, since other threads may be reading the list
+        emit_if(is_first("linear_thread_idx"),
+                [&] { emit_clear_list(stmt); });
+      } else {
+        emit_clear_list(stmt);
+      }
     } else if (stmt->task_type == Type::listgen) {
       int branching = stmt->snode->max_num_elements();
       kernel_grid_dim = num_SMs * 32;
       kernel_block_dim = std::min(branching, 64);
-      emit_list_gen(stmt);
+      if (has_generic_list_gen(stmt) && chained) {
+        // The passes of the two-pass listgen with the block size of the
+        // struct-for, the scan on the first block
+        emit_list_gen_pass(stmt, "element_listgen_count");
+        create_call("grid_barrier", {get_runtime()});
+        emit_if(is_first("block_idx"), [&] {
+          emit_list_gen_pass(stmt, "element_listgen_scan");
+        });
+        create_call("grid_barrier", {get_runtime()});
+        emit_list_gen_pass(stmt, "element_listgen_write");
+      } else if (has_generic_list_gen(stmt)) {
+        // Two-pass listgen (count, scan, write), one kernel per pass
+        TC_ASSERT(kernel_grid_dim * kernel_block_dim <=
+                  taichi_listgen_max_num_threads);
+        emit_list_gen_pass(stmt, "element_listgen_count");
+        begin_next_task(stmt);
+        kernel_grid_dim = 1;
+        kernel_block_dim = 1024;
+        emit_list_gen_pass(stmt, "element_listgen_scan");
+        begin_next_task(stmt);
+        kernel_grid_dim = num_SMs * 32;
+        kernel_block_dim = std::min(branching, 64);
+        emit_list_gen_pass(stmt, "element_listgen_write");
+      } else {
+        emit_list_gen(stmt);
+      }
+    } else if (stmt->task_type == Type::gc) {
+      emit_gc(stmt);
+    } else if (stmt->task_type == Type::zero_fill) {
+      // A thread block per listed instance
+      kernel_grid_dim = num_SMs * 32;
+      kernel_block_dim = get_current_program().config.default_gpu_block_dim;
+      emit_zero_fill(stmt);
+    } else if (stmt->task_type == Type::deactivate_all) {
+      kernel_grid_dim = num_SMs * 32;
+      kernel_block_dim = get_current_program().config.default_gpu_block_dim;
+      emit_deactivate_all_elements(stmt);
+      // The resets in a single thread
+      begin_next_task(stmt);
+      kernel_grid_dim = 1;
+      kernel_block_dim = 1;
+      emit_node_resets(stmt->snode);
+    } else if (stmt->task_type == Type::defragment) {
+      kernel_grid_dim = 1;
+      kernel_block_dim = 1;
+      emit_defragment_gather(stmt);
+      // A thread block per node
+      for (bool back : {false, true}) {
+        begin_next_task(stmt);
+        kernel_grid_dim = num_SMs * 32;
+        kernel_block_dim = get_current_program().config.default_gpu_block_dim;
+        emit_defragment_copy(stmt, back);
+      }
+    } else if (stmt->task_type == Type::deactivate_ambient) {
+      // A thread per listed instance
+      kernel_grid_dim = num_SMs * 32;
+      kernel_block_dim = get_current_program().config.default_gpu_block_dim;
+      emit_deactivate_ambient(stmt);
     } else {
       TC_NOT_IMPLEMENTED
     }
+    if (continuing_task)
+      return;
     finalize_offloaded_task_function();
     current_task->grid_dim = kernel_grid_dim;
     current_task->block_dim = kernel_block_dim;
@@ -1,7 +1,9 @@
 #include <llvm/Support/TargetRegistry.h>
+#include <llvm/ADT/StringExtras.h>
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/Analysis/TargetTransformInfo.h>
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
 #include <taichi/common/util.h>
 #include <taichi/io/io.h>
 #include <set>
@@ -13,6 +15,57 @@
 
 #include "codegen_llvm.h"
 
+// Conversions that LLVM lowers f16 loads and stores to on CPUs without F16C.
+// The JIT resolves them from the process.
+
+extern "C" float __gnu_h2f_ieee(taichi::uint16 h) {
+  taichi::uint32 sign = (h & 0x8000u) << 16;
+  taichi::uint32 exp = (h >> 10) & 0x1f, mant = h & 0x3ff, bits;
+  if (exp == 0x1f) {
+    bits = sign | 0x7f800000u | (mant << 13);
+  } else if (exp != 0) {
+    bits = sign | ((exp + 112) << 23) | (mant << 13);
+  } else if (mant == 0) {
+    bits = sign;
+  } else {
+    // Subnormal
+    exp = 113;
+    while (!(mant & 0x400)) {
+      mant <<= 1;
+      exp--;
+    }
+    bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+  }
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+extern "C" taichi::uint16 __gnu_f2h_ieee(float f) {
+  taichi::uint32 bits;
+  std::memcpy(&bits, &f, sizeof(f));
+  taichi::uint32 sign = (bits >> 16) & 0x8000u, mant = bits & 0x7fffff;
+  int exp = (int)((bits >> 23) & 0xff) - 112;
+  if (exp == 0xff - 112)
+    return sign | 0x7c00 | (mant ? 0x200 : 0);
+  if (exp >= 31)
+    return sign | 0x7c00;
+  int shift = 13;
+  if (exp <= 0) {
+    if (exp < -10)
+      return sign;
+    mant |= 0x800000;
+    shift = 14 - exp;
+    exp = 0;
+  }
+  // Round to nearest even. Carries into the exponent, up to infinity
+  taichi::uint32 half = (exp << 10) | (mant >> shift);
+  taichi::uint32 rem = mant & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+  if (rem > halfway || (rem == halfway && (half & 1)))
+    half++;
+  return sign | half;
+}
+
 TLANG_NAMESPACE_BEGIN
 
 using namespace llvm;
@@ -28,7 +81,8 @@ FunctionType CPUCodeGen::codegen_llvm() {
   return CodeGenLLVMCPU(this, kernel).gen();
 }
 
-void global_optimize_module_x86_64(std::unique_ptr<llvm::Module> &module) {
+void global_optimize_module_x86_64(std::unique_ptr<llvm::Module> &module,
+                                   int opt_level) {
   TI_AUTO_PROF
   auto JTMB = JITTargetMachineBuilder::detectHost();
   if (!JTMB) {
@@ -65,9 +119,11 @@ void global_optimize_module_x86_64(std::unique_ptr<llvm::Module> &module) {
   legacy::PassManager module_pass_manager;
 
   llvm::StringRef mcpu = llvm::sys::getHostCPUName();
+  auto features = llvm::join(get_host_cpu_features(), ",");
   std::unique_ptr<TargetMachine> target_machine(target->createTargetMachine(
-      triple.str(), mcpu.str(), "", options, llvm::Reloc::PIC_,
-      llvm::CodeModel::Small, CodeGenOpt::Aggressive));
+      triple.str(), mcpu.str(), features, options, llvm::Reloc::PIC_,
+      llvm::CodeModel::Small,
+      opt_level > 0 ? CodeGenOpt::Aggressive : CodeGenOpt::None));
 
   TC_ERROR_UNLESS(target_machine.get(), "Could not allocate target machine!");
 
@@ -79,10 +135,15 @@ void global_optimize_module_x86_64(std::unique_ptr<llvm::Module> &module) {
       target_machine->getTargetIRAnalysis()));
 
   PassManagerBuilder b;
-  b.OptLevel = 3;
-  b.Inliner = createFunctionInliningPass(b.OptLevel, 0, false);
-  b.LoopVectorize = true;
-  b.SLPVectorize = true;
+  b.OptLevel = opt_level;
+  if (opt_level > 0) {
+    b.Inliner = createFunctionInliningPass(b.OptLevel, 0, false);
+  } else {
+    // The runtime functions are still inlined, for a quick first tier
+    b.Inliner = createAlwaysInlinerLegacyPass();
+  }
+  b.LoopVectorize = opt_level >= 2;
+  b.SLPVectorize = opt_level >= 2;
 
   target_machine->adjustPassManager(b);
 
@@ -623,6 +623,14 @@ void CPUCodeGen::lower_cpp() {
     irpass::re_id(ir);
     irpass::print(ir);
   }
+  if (prog->config.struct_for_fusion) {
+    irpass::fuse_struct_fors(ir);
+    if (prog->config.print_ir) {
+      TC_TRACE("Struct-fors fused:");
+      irpass::re_id(ir);
+      irpass::print(ir);
+    }
+  }
   irpass::slp_vectorize(ir);
   if (prog->config.print_ir) {
     TC_TRACE("SLPed:");
@@ -654,7 +662,7 @@ void CPUCodeGen::lower_cpp() {
     // irpass::re_id(ir);
     // TC_TRACE("Primal:");
     // irpass::print(ir);
-    irpass::make_adjoint(ir);
+    irpass::make_adjoint(ir, kernel->keep_primal);
     irpass::typecheck(ir);
     if (prog->config.print_ir) {
       TC_TRACE("Adjoint:");
@@ -701,130 +709,85 @@ void CPUCodeGen::lower_cpp() {
 
 void CPUCodeGen::lower_llvm() {
   auto ir = kernel->ir;
-  if (prog->config.print_ir) {
-    TC_TRACE("Initial IR:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  begin_passes();
   irpass::lower(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("Lowered:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("Lowered");
   irpass::typecheck(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("Typechecked:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("Typechecked");
   irpass::slp_vectorize(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("SLPed:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
-  irpass::loop_vectorize(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("LoopVeced:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("SLPed");
+  // Loops are vectorized by LLVM instead, with the width hinted by
+  // CodeGenLLVM::annotate_task_loop
   irpass::vector_split(ir, prog->config.max_vector_width,
                        prog->config.serial_schedule);
-  if (prog->config.print_ir) {
-    TC_TRACE("LoopSplitted:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("LoopSplitted");
   if (prog->config.simplify_before_lower_access) {
     irpass::simplify(ir);
-    if (prog->config.print_ir) {
-      TC_TRACE("Simplified I:");
-      irpass::re_id(ir);
-      irpass::print(ir);
-    }
+    end_pass("Simplified I");
   }
   if (kernel->grad) {
     // irpass::re_id(ir);
     // TC_TRACE("Primal:");
     // irpass::print(ir);
+    // Differentiated entry by entry
+    irpass::scalarize(ir);
     irpass::demote_atomics(ir);
     irpass::simplify(ir);
-    irpass::make_adjoint(ir);
+    irpass::make_adjoint(ir, kernel->keep_primal);
     irpass::typecheck(ir);
-    if (prog->config.print_ir) {
-      TC_TRACE("Adjoint:");
-      irpass::re_id(ir);
-      irpass::print(ir);
-    }
+    end_pass("Adjoint");
+  }
+  if (prog->config.check_out_of_bound) {
+    irpass::check_out_of_bound(ir);
+    end_pass("Bound Checked");
+  }
+  irpass::forward_global_accesses(ir);
+  end_pass("Global Accesses Forwarded");
+  if (prog->config.struct_for_fusion) {
+    irpass::fuse_struct_fors(ir);
+    end_pass("Struct-fors fused");
   }
   if (prog->config.lower_access) {
     irpass::lower_access(ir, true);
-    if (prog->config.print_ir) {
-      TC_TRACE("Access Lowered:");
-      irpass::re_id(ir);
-      irpass::print(ir);
-    }
+    end_pass("Access Lowered");
     if (prog->config.simplify_after_lower_access) {
       irpass::die(ir);
-      if (prog->config.print_ir) {
-        TC_TRACE("DIEd:");
-        irpass::re_id(ir);
-        irpass::print(ir);
-      }
+      end_pass("DIEd");
       irpass::simplify(ir);
-      if (prog->config.print_ir) {
-        TC_TRACE("Simplified II:");
-        irpass::re_id(ir);
-        irpass::print(ir);
-      }
+      end_pass("Simplified II");
     }
   }
   irpass::die(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("DIEd:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("DIEd");
 
   irpass::flag_access(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("Access Flagged:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("Access Flagged");
 
   irpass::constant_fold(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("Constant folded:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("Constant folded");
 
-  irpass::offload(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("Offloaded:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  kernel->temporaries_size = irpass::offload(ir);
+  end_pass("Offloaded");
 
   irpass::full_simplify(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("Simplified III:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("Simplified III");
+
+  irpass::reduce_strength(ir);
+  end_pass("Strength reduced");
+
+  irpass::scalarize(ir);
+  end_pass("Scalarized");
 
   irpass::demote_atomics(ir);
-  if (prog->config.print_ir) {
-    TC_TRACE("Atomics demoted:");
-    irpass::re_id(ir);
-    irpass::print(ir);
-  }
+  end_pass("Atomics demoted");
   if (kernel->grad) {
     irpass::reverse_offloads(ir);
+    end_pass("Offloads reversed");
   }
+  irpass::mark_concurrent_tasks(ir);
+  end_pass("Concurrent tasks marked");
+  kernel->num_offloaded_tasks =
+      (int)dynamic_cast<Block *>(ir)->statements.size();
 }
 
 void CPUCodeGen::lower() {
@@ -6,33 +6,112 @@
 TLANG_NAMESPACE_BEGIN
 
 class CUDAContext {
+  int device_id;
   CUdevice device;
   std::vector<CUmodule> cudaModules;
   CUcontext context;
+  // All kernels are launched asynchronously on this stream. Since it is a
+  // blocking stream, work on the legacy default stream (e.g. cudaMemcpy) is
+  // still ordered with it. Program::synchronize waits for it.
+  CUstream stream;
   int dev_count;
   CUdeviceptr context_buffer;
+  // The streams and Context buffers that stream and context_buffer are
+  // switched between with CompileConfig::overlap_kernels, created on first
+  // use. The first ones are the default.
+  std::vector<CUstream> streams;
+  std::vector<CUdeviceptr> context_buffers;
+  int current_stream;
   std::string mcpu;
+  // e.g. 75 for sm_75
+  int compute_capability;
 
  public:
-  CUDAContext();
+  CUDAContext(int device_id = 0);
 
   bool detected() const {
     return dev_count != 0;
   }
 
-  CUmodule compile(const std::string &ptx);
+  // Loads a module from either PTX or cubin
+  CUmodule compile(const std::string &image);
+
+  // Assembles PTX into cubin for the device of this context, so that loading
+  // the module later needs no JIT compilation
+  std::string compile_to_cubin(const std::string &ptx, int opt_level);
 
   CUfunction get_function(CUmodule module, const std::string &func_name);
 
-  void launch(CUfunction func,
-              void *context_ptr,
-              unsigned gridDim,
-              unsigned blockDim);
+  // Copies the host Context to the device, with the first num_args argument
+  // slots and the shapes of the first num_extra_args ones. All offloaded
+  // tasks of one kernel invocation share the uploaded copy.
+  void upload_context(Context *context, int num_args, int num_extra_args);
+
+  void launch(CUfunction func, unsigned gridDim, unsigned blockDim);
+
+  // Zeroes size bytes of device memory, ordered with the launches
+  void memset_async(void *ptr, std::size_t size);
+
+  static constexpr int max_num_streams = 4;
+
+  // Makes the following uploads, launches and memsets go on stream i
+  void set_stream(int i);
+
+  int get_stream() const {
+    return current_stream;
+  }
+
+  // An event completing with the work issued to the current stream so far
+  CUevent record_event();
+
+  // Makes the following work on the current stream wait for event
+  void wait_event(CUevent event);
+
+  bool event_done(CUevent event);
+
+  void destroy_event(CUevent event);
+
+  // Launches and waits for the kernel, returning its run time in milliseconds
+  float launch_timed(CUfunction func, unsigned gridDim, unsigned blockDim);
+
+  // Launches the kernel, runs host_work meanwhile and waits for both.
+  // Returns the run time of the kernel in milliseconds.
+  float launch_with_host_work(CUfunction func,
+                              unsigned gridDim,
+                              unsigned blockDim,
+                              const std::function<void()> &host_work);
+
+  // The block size with the highest occupancy for func, given its register
+  // and shared memory usage
+  int get_max_potential_block_size(CUfunction func);
+
+  // The blocks of func that can be resident on one multiprocessor at once
+  int get_max_active_blocks_per_multiprocessor(CUfunction func, int block_dim);
+
+  int get_attribute(CUdevice_attribute attribute);
+
+  // The registers, local memory and shared memory func was compiled to use
+  TaskResources get_function_resources(CUfunction func);
+
+  // Records the following launches into a CUDA graph instead of running them
+  void begin_capture();
+
+  CUgraphExec end_capture();
+
+  void launch_graph(CUgraphExec graph);
+
+  int get_device_id() const {
+    return device_id;
+  }
 
   std::string get_mcpu() const {
     return mcpu;
   }
 
+  int get_compute_capability() const {
+    return compute_capability;
+  }
+
   void make_current() {
     check_cuda_errors(cuCtxSetCurrent(context));
   }
@@ -5,15 +5,67 @@
 
 TLANG_NAMESPACE_BEGIN
 
+void KernelCodeGen::begin_passes() {
+  if (prog->config.print_ir) {
+    TC_TRACE("Initial IR:");
+    irpass::re_id(kernel->ir);
+    irpass::print(kernel->ir);
+  }
+  if (prog->config.profile_compilation) {
+    pass_num_statements = analysis::count_statements(kernel->ir);
+    pass_start_time = Time::get_time();
+  }
+}
+
+void KernelCodeGen::end_pass(const std::string &name) {
+  auto time = Time::get_time() - pass_start_time;
+  if (prog->config.print_ir) {
+    TC_TRACE("{}:", name);
+    irpass::re_id(kernel->ir);
+    irpass::print(kernel->ir);
+  }
+  if (prog->config.profile_compilation) {
+    auto num_statements = analysis::count_statements(kernel->ir);
+    prog->record_compile_pass(*kernel, name, time, pass_num_statements,
+                              num_statements);
+    pass_num_statements = num_statements;
+    // Leave out the time spent printing and counting
+    pass_start_time = Time::get_time();
+  }
+}
+
+void KernelCodeGen::generate_source(Program &prog, Kernel &kernel) {
+  this->prog = &prog;
+  this->kernel = &kernel;
+  lower();
+  codegen();
+}
+
 FunctionType KernelCodeGen::compile(taichi::Tlang::Program &prog,
                                     taichi::Tlang::Kernel &kernel) {
   // auto t = Time::get_time();
   this->prog = &kernel.program;
   this->kernel = &kernel;
+  if (kernel.aot_entry) {
+    // Already compiled, see AotModule
+    return codegen_llvm();
+  }
   lower();
   if (prog.config.use_llvm) {
+    // Host twins start their range-fors at an argument slot
+    auto key = fmt::format("{}{}_{}", arch_name(kernel.arch),
+                           kernel.is_host_twin ? "_twin" : "",
+                           analysis::structural_hash(kernel.ir));
+    auto cached = prog.compiled_kernels.find(key);
+    if (cached != prog.compiled_kernels.end()) {
+      TC_TRACE("Kernel {} reuses an identical compiled kernel", kernel.name);
+      prog.num_compile_cache_hits++;
+      return cached->second;
+    }
     TC_PROFILER("codegen llvm")
-    return codegen_llvm();
+    auto func = codegen_llvm();
+    prog.compiled_kernels[key] = func;
+    return func;
   } else {
     codegen();
     generate_binary("");
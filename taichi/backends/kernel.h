@@ -14,12 +14,17 @@ class KernelCodeGen : public CodeGenBase {
   Program *prog;
   Kernel *kernel;
   KernelCodeGen(const std::string &kernel_name) : CodeGenBase(kernel_name) {
+    pass_start_time = 0;
+    pass_num_statements = 0;
   }
 
   virtual void generate_header() {
     emit("#define TLANG_KERNEL\n");
-    if (prog->config.debug)
+    pch_defines = "-DTLANG_KERNEL=";
+    if (prog->config.debug) {
       emit("#define TL_DEBUG");
+      pch_defines += " -DTL_DEBUG=";
+    }
     emit("#include <taichi/legacy_kernel.h>\n");
     emit("#include \"{}\"", prog->layout_fn);
     emit("using namespace taichi; using namespace Tlang;");
@@ -30,6 +35,17 @@ class KernelCodeGen : public CodeGenBase {
 
   virtual void lower() = 0;
 
+  // Start of the current pass of lower(), for
+  // CompileConfig::profile_compilation
+  float64 pass_start_time;
+  int pass_num_statements;
+
+  void begin_passes();
+
+  // Called after each pass of lower(): prints the IR if print_ir is on, and
+  // records the time and statement counts of the pass when profiling
+  void end_pass(const std::string &name);
+
   virtual void codegen() = 0;
 
   virtual FunctionType codegen_llvm() {
@@ -37,6 +53,10 @@ class KernelCodeGen : public CodeGenBase {
     return nullptr;
   }
 
+  // lower() and codegen(), for Program::compile_kernels to compile the
+  // sources of the legacy backends together
+  void generate_source(Program &prog, Kernel &kernel);
+
   virtual FunctionType compile(Program &prog, Kernel &kernel);
 };
 
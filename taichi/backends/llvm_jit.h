@@ -25,6 +25,8 @@
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/IR/LegacyPassManager.h"
@@ -43,7 +45,12 @@ std::string compile_module_to_ptx(std::unique_ptr<llvm::Module> &module);
 int compile_ptx_and_launch(const std::string &ptx,
                            const std::string &kernel_name,
                            void *);
-void global_optimize_module_x86_64(std::unique_ptr<llvm::Module> &module);
+// The features of the host CPU, e.g. "+avx2", for the target machines
+std::vector<std::string> get_host_cpu_features();
+
+// opt_level is 0 to 3, as in -O
+void global_optimize_module_x86_64(std::unique_ptr<llvm::Module> &module,
+                                   int opt_level = 3);
 
 class TaichiLLVMJIT {
  private:
@@ -64,14 +71,28 @@ class TaichiLLVMJIT {
   LegacyCompileOnDemandLayer<decltype(OptimizeLayer)> CODLayer;
 
  public:
+  // Called with each object file once it is loaded at its final address
+  std::function<void(const object::ObjectFile &,
+                     const RuntimeDyld::LoadedObjectInfo &)>
+      on_object_loaded;
+
   TaichiLLVMJIT(JITTargetMachineBuilder JTMB, DataLayout DL)
-      : TM(EngineBuilder().selectTarget()),
+      : TM(EngineBuilder()
+               .setMCPU(llvm::sys::getHostCPUName())
+               .setMAttrs(get_host_cpu_features())
+               .selectTarget()),
         DL(TM->createDataLayout()),
         ObjectLayer(ES,
                     [this](VModuleKey K) {
                       return LegacyRTDyldObjectLinkingLayer::Resources{
                           std::make_shared<SectionMemoryManager>(),
                           Resolvers[K]};
+                    },
+                    [this](VModuleKey,
+                           const object::ObjectFile &obj,
+                           const RuntimeDyld::LoadedObjectInfo &info) {
+                      if (on_object_loaded)
+                        on_object_loaded(obj, info);
                     }),
         CompileLayer(ObjectLayer, SimpleCompiler(*TM)),
         OptimizeLayer(CompileLayer,
@@ -119,13 +140,8 @@ class TaichiLLVMJIT {
     return llvm::make_unique<TaichiLLVMJIT>(std::move(*jtmb), std::move(*DL));
   }
 
-  VModuleKey addModule(std::unique_ptr<Module> M) {
-    global_optimize_module_x86_64(M);
-    // Create a new VModuleKey.
-    VModuleKey K = ES.allocateVModule();
-
-    // Build a resolver and associate it with the new key.
-    Resolvers[K] = createLegacyLookupResolver(
+  std::shared_ptr<SymbolResolver> create_resolver() {
+    return createLegacyLookupResolver(
         ES,
         [this](const std::string &Name) -> JITSymbol {
           if (auto Sym = CompileLayer.findSymbol(Name, false))
@@ -138,12 +154,39 @@ class TaichiLLVMJIT {
           return nullptr;
         },
         [](Error Err) { cantFail(std::move(Err), "lookupFlags failed"); });
+  }
+
+  VModuleKey addModule(std::unique_ptr<Module> M, int opt_level = 3) {
+    global_optimize_module_x86_64(M, opt_level);
+    // Create a new VModuleKey.
+    VModuleKey K = ES.allocateVModule();
+
+    // Build a resolver and associate it with the new key.
+    Resolvers[K] = create_resolver();
 
     // Add the module to the JIT with the new key.
     cantFail(CODLayer.addModule(K, std::move(M)));
     return K;
   }
 
+  // Eagerly compiles the module and returns the object file, so that it can
+  // be stored in the offline cache
+  std::string add_module_as_object(std::unique_ptr<Module> M) {
+    global_optimize_module_x86_64(M);
+    M = optimizeModule(std::move(M));
+    auto buffer = SimpleCompiler(*TM)(*M);
+    std::string binary = buffer->getBuffer().str();
+    add_object(binary);
+    return binary;
+  }
+
+  VModuleKey add_object(const std::string &binary) {
+    VModuleKey K = ES.allocateVModule();
+    Resolvers[K] = create_resolver();
+    cantFail(ObjectLayer.addObject(K, MemoryBuffer::getMemBufferCopy(binary)));
+    return K;
+  }
+
   JITSymbol lookup(const std::string Name) {
     std::string MangledName;
     raw_string_ostream MangledNameStream(MangledName);
@@ -16,6 +16,10 @@ TLANG_NAMESPACE_BEGIN
 #if defined(TLANG_WITH_CUDA)
 
 std::string cuda_mattrs() {
+  // The WMMA instructions of sm_70+ (see taichi/matmul.h) need PTX 6.0,
+  // which the drivers of these GPUs support
+  if (cuda_context->get_compute_capability() >= 70)
+    return "+ptx60";
   return "+ptx50";
 }
 
@@ -142,48 +146,106 @@ std::string compile_module_to_ptx(std::unique_ptr<llvm::Module> &module) {
   return buffer;
 }
 
-CUDAContext::CUDAContext() {
+CUDAContext::CUDAContext(int device_id) : device_id(device_id) {
   // CUDA initialization
   dev_count = 0;
+  compute_capability = 0;
   if (cuInit(0) == CUDA_SUCCESS) {
     check_cuda_errors(cuDeviceGetCount(&dev_count));
-    check_cuda_errors(cuDeviceGet(&device, 0));
+    if (dev_count == 0)
+      return;
+    if (device_id < 0 || device_id >= dev_count) {
+      TC_ERROR("CUDA device {} requested, but only {} device(s) found",
+               device_id, dev_count);
+    }
+    check_cuda_errors(cuDeviceGet(&device, device_id));
 
     char name[128];
     check_cuda_errors(cuDeviceGetName(name, 128, device));
-    std::cout << "Using CUDA Device [0]: " << name << "\n";
+    std::cout << "Using CUDA Device [" << device_id << "]: " << name << "\n";
 
     int devMajor, devMinor;
     check_cuda_errors(cuDeviceComputeCapability(&devMajor, &devMinor, device));
     std::cout << "Device Compute Capability: " << devMajor << "." << devMinor
               << "\n";
     if (devMajor < 2) {
-      TC_ERROR("Device 0 is not SM 2.0 or greater");
+      TC_ERROR("Device {} is not SM 2.0 or greater", device_id);
     }
     // Create driver context
     check_cuda_errors(cuCtxCreate(&context, 0, device));
+    check_cuda_errors(cuStreamCreate(&stream, CU_STREAM_DEFAULT));
     check_cuda_errors(cuMemAlloc(&context_buffer, sizeof(Context)));
+    streams.push_back(stream);
+    context_buffers.push_back(context_buffer);
+    current_stream = 0;
 
-    int cap_major, cap_minor;
-    cudaDeviceGetAttribute(&cap_major, cudaDevAttrComputeCapabilityMajor, 0);
-    cudaDeviceGetAttribute(&cap_minor, cudaDevAttrComputeCapabilityMinor, 0);
-    mcpu = fmt::format("sm_{}{}", cap_major, cap_minor);
+    mcpu = fmt::format("sm_{}{}", devMajor, devMinor);
+    compute_capability = devMajor * 10 + devMinor;
   }
 }
 
-CUmodule CUDAContext::compile(const std::string &ptx) {
+CUmodule CUDAContext::compile(const std::string &image) {
   // auto _ = cuda_context->get_guard();
   cuda_context->make_current();
   // Create module for object
   CUmodule cudaModule;
-  TC_INFO("PTX size: {:.2f}KB", ptx.size() / 1024.0);
+  TC_TRACE("CUDA module size: {:.2f}KB", image.size() / 1024.0);
   // auto t = Time::get_time();
-  check_cuda_errors(cuModuleLoadDataEx(&cudaModule, ptx.c_str(), 0, 0, 0));
+  check_cuda_errors(cuModuleLoadDataEx(&cudaModule, image.c_str(), 0, 0, 0));
   // TC_INFO("CUDA module load time : {}ms", (Time::get_time() - t) * 1000);
   cudaModules.push_back(cudaModule);
   return cudaModule;
 }
 
+std::string CUDAContext::compile_to_cubin(const std::string &ptx,
+                                          int opt_level) {
+  cuda_context->make_current();
+  TC_ASSERT(0 <= opt_level && opt_level <= 4);
+  constexpr int log_size = 8192;
+  std::vector<char> error_log(log_size, 0);
+  // With the registers, spills and shared memory of each function
+  std::vector<char> info_log(log_size, 0);
+  CUjit_option options[] = {CU_JIT_OPTIMIZATION_LEVEL,
+                            CU_JIT_TARGET_FROM_CUCONTEXT,
+                            CU_JIT_ERROR_LOG_BUFFER,
+                            CU_JIT_ERROR_LOG_BUFFER_SIZE_BYTES,
+                            CU_JIT_INFO_LOG_BUFFER,
+                            CU_JIT_INFO_LOG_BUFFER_SIZE_BYTES,
+                            CU_JIT_LOG_VERBOSE};
+  void *option_values[] = {(void *)(std::size_t)opt_level,
+                           nullptr,
+                           (void *)error_log.data(),
+                           (void *)(std::size_t)log_size,
+                           (void *)info_log.data(),
+                           (void *)(std::size_t)log_size,
+                           (void *)(std::size_t)1};
+  CUlinkState link_state;
+  check_cuda_errors(cuLinkCreate(7, options, option_values, &link_state));
+  // Destroys the link state on every exit, failures included
+  struct LinkStateGuard {
+    CUlinkState state;
+    ~LinkStateGuard() {
+      cuLinkDestroy(state);
+    }
+  } link_state_guard{link_state};
+  auto ret = cuLinkAddData(link_state, CU_JIT_INPUT_PTX, (void *)ptx.c_str(),
+                           ptx.size() + 1, "taichi_kernels.ptx", 0, nullptr,
+                           nullptr);
+  if (ret != CUDA_SUCCESS) {
+    TC_ERROR("PTX assembly failed: {}", error_log.data());
+  }
+  void *cubin;
+  std::size_t cubin_size;
+  check_cuda_errors(cuLinkComplete(link_state, &cubin, &cubin_size));
+  if (get_current_program().config.verbose)
+    TC_INFO("ptxas info:\n{}", info_log.data());
+  // The cubin is owned by the link state
+  std::string result((char *)cubin, cubin_size);
+  TC_TRACE("PTX size: {:.2f}KB, cubin size: {:.2f}KB", ptx.size() / 1024.0,
+           cubin_size / 1024.0);
+  return result;
+}
+
 CUfunction CUDAContext::get_function(CUmodule module,
                                      const std::string &func_name) {
   // auto _ = cuda_context->get_guard();
@@ -196,22 +258,32 @@ CUfunction CUDAContext::get_function(CUmodule module,
   return func;
 }
 
-void CUDAContext::launch(CUfunction func,
-                         void *context_ptr,
-                         unsigned gridDim,
-                         unsigned blockDim) {
+void CUDAContext::upload_context(Context *context,
+                                 int num_args,
+                                 int num_extra_args) {
+  cuda_context->make_current();
+  // Pageable memory is staged before cuMemcpyHtoDAsync returns, so the host
+  // Context can be modified right after this call.
+  check_cuda_errors(cuMemcpyHtoDAsync(context_buffer, context,
+                                      Context::used_size(num_args), stream));
+  if (num_extra_args > 0) {
+    auto offset = offsetof(Context, extra_args);
+    check_cuda_errors(cuMemcpyHtoDAsync(
+        context_buffer + offset, (char *)context + offset,
+        sizeof(context->extra_args[0]) * num_extra_args, stream));
+  }
+}
+
+void CUDAContext::launch(CUfunction func, unsigned gridDim, unsigned blockDim) {
   // auto _ = cuda_context->get_guard();
   cuda_context->make_current();
   // Kernel parameters
-
-  check_cuda_errors(cuMemcpyHtoD(context_buffer, context_ptr, sizeof(Context)));
-
   void *KernelParams[] = {&context_buffer};
 
   // Kernel launch
   if (gridDim > 0) {
     check_cuda_errors(cuLaunchKernel(func, gridDim, 1, 1, blockDim, 1, 1, 0,
-                                     nullptr, KernelParams, nullptr));
+                                     stream, KernelParams, nullptr));
   }
 
   if (get_current_program().config.debug) {
@@ -223,6 +295,159 @@ void CUDAContext::launch(CUfunction func,
   }
 }
 
+void CUDAContext::memset_async(void *ptr, std::size_t size) {
+  cuda_context->make_current();
+  check_cuda_errors(cuMemsetD8Async((CUdeviceptr)ptr, 0, size, stream));
+}
+
+void CUDAContext::set_stream(int i) {
+  TC_ASSERT(0 <= i && i < max_num_streams);
+  cuda_context->make_current();
+  while ((int)streams.size() <= i) {
+    // Blocking as well, so that the legacy default stream stays ordered with
+    // all of them
+    CUstream s;
+    CUdeviceptr buffer;
+    check_cuda_errors(cuStreamCreate(&s, CU_STREAM_DEFAULT));
+    check_cuda_errors(cuMemAlloc(&buffer, sizeof(Context)));
+    streams.push_back(s);
+    context_buffers.push_back(buffer);
+  }
+  current_stream = i;
+  stream = streams[i];
+  context_buffer = context_buffers[i];
+}
+
+CUevent CUDAContext::record_event() {
+  cuda_context->make_current();
+  CUevent event;
+  check_cuda_errors(cuEventCreate(&event, CU_EVENT_DISABLE_TIMING));
+  check_cuda_errors(cuEventRecord(event, stream));
+  return event;
+}
+
+void CUDAContext::wait_event(CUevent event) {
+  cuda_context->make_current();
+  check_cuda_errors(cuStreamWaitEvent(stream, event, 0));
+}
+
+bool CUDAContext::event_done(CUevent event) {
+  cuda_context->make_current();
+  auto ret = cuEventQuery(event);
+  if (ret == CUDA_ERROR_NOT_READY)
+    return false;
+  check_cuda_errors(ret);
+  return true;
+}
+
+void CUDAContext::destroy_event(CUevent event) {
+  cuda_context->make_current();
+  check_cuda_errors(cuEventDestroy(event));
+}
+
+float CUDAContext::launch_timed(CUfunction func,
+                                unsigned gridDim,
+                                unsigned blockDim) {
+  cuda_context->make_current();
+  CUevent start, stop;
+  check_cuda_errors(cuEventCreate(&start, CU_EVENT_DEFAULT));
+  check_cuda_errors(cuEventCreate(&stop, CU_EVENT_DEFAULT));
+  check_cuda_errors(cuEventRecord(start, stream));
+  launch(func, gridDim, blockDim);
+  check_cuda_errors(cuEventRecord(stop, stream));
+  check_cuda_errors(cuEventSynchronize(stop));
+  float milliseconds;
+  check_cuda_errors(cuEventElapsedTime(&milliseconds, start, stop));
+  check_cuda_errors(cuEventDestroy(start));
+  check_cuda_errors(cuEventDestroy(stop));
+  return milliseconds;
+}
+
+float CUDAContext::launch_with_host_work(
+    CUfunction func,
+    unsigned gridDim,
+    unsigned blockDim,
+    const std::function<void()> &host_work) {
+  cuda_context->make_current();
+  CUevent start, stop;
+  check_cuda_errors(cuEventCreate(&start, CU_EVENT_DEFAULT));
+  check_cuda_errors(cuEventCreate(&stop, CU_EVENT_DEFAULT));
+  check_cuda_errors(cuEventRecord(start, stream));
+  launch(func, gridDim, blockDim);
+  check_cuda_errors(cuEventRecord(stop, stream));
+  host_work();
+  check_cuda_errors(cuEventSynchronize(stop));
+  float milliseconds;
+  check_cuda_errors(cuEventElapsedTime(&milliseconds, start, stop));
+  check_cuda_errors(cuEventDestroy(start));
+  check_cuda_errors(cuEventDestroy(stop));
+  return milliseconds;
+}
+
+int CUDAContext::get_max_potential_block_size(CUfunction func) {
+  cuda_context->make_current();
+  int min_grid_size, block_size;
+  check_cuda_errors(cuOccupancyMaxPotentialBlockSize(
+      &min_grid_size, &block_size, func, nullptr, 0, 0));
+  return block_size;
+}
+
+int CUDAContext::get_max_active_blocks_per_multiprocessor(CUfunction func,
+                                                          int block_dim) {
+  cuda_context->make_current();
+  int num_blocks;
+  check_cuda_errors(cuOccupancyMaxActiveBlocksPerMultiprocessor(
+      &num_blocks, func, block_dim, 0));
+  return num_blocks;
+}
+
+int CUDAContext::get_attribute(CUdevice_attribute attribute) {
+  int value;
+  check_cuda_errors(cuDeviceGetAttribute(&value, attribute, device));
+  return value;
+}
+
+TaskResources CUDAContext::get_function_resources(CUfunction func) {
+  cuda_context->make_current();
+  TaskResources resources;
+  check_cuda_errors(cuFuncGetAttribute(&resources.num_registers,
+                                       CU_FUNC_ATTRIBUTE_NUM_REGS, func));
+  check_cuda_errors(cuFuncGetAttribute(
+      &resources.local_bytes, CU_FUNC_ATTRIBUTE_LOCAL_SIZE_BYTES, func));
+  check_cuda_errors(cuFuncGetAttribute(
+      &resources.shared_bytes, CU_FUNC_ATTRIBUTE_SHARED_SIZE_BYTES, func));
+  return resources;
+}
+
+void CUDAContext::begin_capture() {
+  cuda_context->make_current();
+#if CUDA_VERSION >= 10010
+  check_cuda_errors(
+      cuStreamBeginCapture(stream, CU_STREAM_CAPTURE_MODE_THREAD_LOCAL));
+#else
+  check_cuda_errors(cuStreamBeginCapture(stream));
+#endif
+}
+
+CUgraphExec CUDAContext::end_capture() {
+  CUgraph graph;
+  check_cuda_errors(cuStreamEndCapture(stream, &graph));
+  CUgraphExec graph_exec;
+#if CUDA_VERSION >= 12000
+  check_cuda_errors(cuGraphInstantiate(&graph_exec, graph, 0));
+#else
+  check_cuda_errors(
+      cuGraphInstantiate(&graph_exec, graph, nullptr, nullptr, 0));
+#endif
+  check_cuda_errors(cuGraphDestroy(graph));
+  return graph_exec;
+}
+
+void CUDAContext::launch_graph(CUgraphExec graph) {
+  cuda_context->make_current();
+  check_cuda_errors(cuGraphLaunch(graph, stream));
+}
+
 CUDAContext::~CUDAContext() {
   /*
   check_cuda_errors(cuMemFree(context_buffer));
@@ -0,0 +1,122 @@
+#include "llvm_source_lines.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Object/SymbolSize.h"
+
+TLANG_NAMESPACE_BEGIN
+
+SourceLineDebugInfo::SourceLineDebugInfo(llvm::Module *module,
+                                         const std::string &name)
+    : module(module) {
+  if (!module->getModuleFlag("Debug Info Version")) {
+    module->addModuleFlag(llvm::Module::Warning, "Debug Info Version",
+                          llvm::DEBUG_METADATA_VERSION);
+  }
+  if (!module->getModuleFlag("Dwarf Version"))
+    module->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+  dib = std::make_unique<llvm::DIBuilder>(*module);
+  unit = dib->createCompileUnit(llvm::dwarf::DW_LANG_Python,
+                                dib->createFile(name, ""), "taichi", true, "",
+                                0, llvm::StringRef(),
+                                llvm::DICompileUnit::LineTablesOnly);
+  function_type =
+      dib->createSubroutineType(dib->getOrCreateTypeArray(llvm::None));
+}
+
+void SourceLineDebugInfo::set_location(llvm::IRBuilder<> *builder,
+                                       Stmt *stmt) {
+  if (stmt->source_line == 0 || stmt->source_file == -1)
+    return;
+  auto &placeholder = placeholders[stmt->source_file];
+  if (!placeholder) {
+    auto file = dib->createFile(get_source_file(stmt->source_file), "");
+    placeholder =
+        dib->createFunction(file, "", "", file, 0, function_type, 0);
+  }
+  builder->SetCurrentDebugLocation(
+      llvm::DebugLoc::get(stmt->source_line, 0, placeholder));
+}
+
+void SourceLineDebugInfo::finalize() {
+  for (auto &f : *module) {
+    if (f.isDeclaration())
+      continue;
+    llvm::DISubprogram *sp = nullptr;
+    std::map<llvm::DIFile *, llvm::DIScope *> scopes;
+    for (auto &bb : f) {
+      for (auto &inst : bb) {
+        auto &loc = inst.getDebugLoc();
+        if (!loc)
+          continue;
+        auto file = loc->getFile();
+        int line = loc.getLine();
+        if (!sp) {
+          sp = dib->createFunction(
+              file, f.getName(), f.getName(), file, line, function_type, line,
+              llvm::DINode::FlagPrototyped,
+              llvm::DISubprogram::SPFlagDefinition |
+                  llvm::DISubprogram::SPFlagOptimized);
+          f.setSubprogram(sp);
+          scopes[file] = sp;
+        }
+        // Lines of ti.func from other files
+        auto &scope = scopes[file];
+        if (!scope)
+          scope = dib->createLexicalBlockFile(sp, file);
+        inst.setDebugLoc(llvm::DebugLoc::get(line, 0, scope));
+      }
+    }
+    if (!sp)
+      continue;
+    // The verifier wants locations on the calls of functions with debug
+    // info, and line 0 stands for none
+    for (auto &bb : f) {
+      for (auto &inst : bb) {
+        if (!inst.getDebugLoc())
+          inst.setDebugLoc(llvm::DebugLoc::get(0, 0, sp));
+      }
+    }
+  }
+  dib->finalize();
+}
+
+std::vector<SourceProfiler::LineRange> read_source_lines(
+    const llvm::object::ObjectFile &obj,
+    const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+  using namespace llvm;
+  std::vector<SourceProfiler::LineRange> ranges;
+  // A copy of the object with the sections at their load addresses
+  auto debug_obj_owner = info.getObjectForDebug(obj);
+  if (!debug_obj_owner.getBinary())
+    return ranges;
+  auto &debug_obj = *debug_obj_owner.getBinary();
+  auto context = DWARFContext::create(debug_obj);
+  for (auto &p : object::computeSymbolSizes(debug_obj)) {
+    auto type = p.first.getType();
+    if (!type) {
+      consumeError(type.takeError());
+      continue;
+    }
+    auto address = p.first.getAddress();
+    if (*type != object::SymbolRef::ST_Function || !address) {
+      if (!address)
+        consumeError(address.takeError());
+      continue;
+    }
+    auto end = *address + p.second;
+    auto lines = context->getLineInfoForAddressRange(
+        *address, p.second,
+        DILineInfoSpecifier::FileLineInfoKind::AbsoluteFilePath);
+    for (int i = 0; i < (int)lines.size(); i++) {
+      if (lines[i].second.Line == 0)
+        continue;
+      auto range_end =
+          i + 1 < (int)lines.size() ? lines[i + 1].first : end;
+      ranges.push_back({lines[i].first, range_end, lines[i].second.FileName,
+                        (int)lines[i].second.Line});
+    }
+  }
+  return ranges;
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,42 @@
+// The Python source lines of the statements as LLVM debug info, which the
+// source profiler reads back from the JITed objects
+// (CompileConfig::profile_source_lines)
+
+#pragma once
+
+#include "../ir.h"
+#include "../source_profiler.h"
+#include "llvm/ExecutionEngine/RuntimeDyld.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Object/ObjectFile.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class SourceLineDebugInfo {
+ public:
+  SourceLineDebugInfo(llvm::Module *module, const std::string &name);
+
+  // Instructions emitted from now on come from the line of stmt, if known
+  void set_location(llvm::IRBuilder<> *builder, Stmt *stmt);
+
+  // Creates a subprogram for each function with located instructions. Until
+  // then the locations are scoped to a placeholder per file, since codegen
+  // moves between functions freely.
+  void finalize();
+
+ private:
+  llvm::Module *module;
+  std::unique_ptr<llvm::DIBuilder> dib;
+  llvm::DICompileUnit *unit;
+  llvm::DISubroutineType *function_type;
+  std::map<int, llvm::DISubprogram *> placeholders;
+};
+
+// The line table of the functions in a loaded object, at their addresses in
+// memory
+std::vector<SourceProfiler::LineRange> read_source_lines(
+    const llvm::object::ObjectFile &obj,
+    const llvm::RuntimeDyld::LoadedObjectInfo &info);
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,108 @@
+// Persistent on-disk cache for kernels compiled by the LLVM backends
+
+#include <fstream>
+#include <xxhash.h>
+#include <taichi/io/io.h>
+#include <taichi/system/threading.h>
+
+#include "../ir.h"
+#include "offline_cache.h"
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+constexpr int offline_cache_version = 8;
+
+std::string hex_hash(const std::string &s) {
+  return fmt::format("{:016x}", (uint64)XXH64(s.data(), s.size(), 0));
+}
+
+std::string cache_file_name(const std::string &key) {
+  return fmt::format("{}/{}.tlc", OfflineCache::get_cache_dir(), key);
+}
+
+}  // namespace
+
+std::string OfflineCache::get_cache_dir() {
+  return get_repo_dir() + "/.tlang_cache/llvm";
+}
+
+std::string OfflineCache::make_key(IRNode *ir,
+                                   const std::string &kernel_name,
+                                   const std::string &struct_module_hash,
+                                   const std::string &config_key) {
+  auto key_str = fmt::format("{}\n{}\n{}\n{}\n{}\n{}",
+                             offline_cache_version, get_commit_hash(),
+                             kernel_name, struct_module_hash, config_key,
+                             analysis::structural_hash(ir));
+  return kernel_name + "_" + hex_hash(key_str);
+}
+
+bool OfflineCache::load(const std::string &key, Entry &entry) {
+  std::ifstream fin(cache_file_name(key), std::ios::binary);
+  if (!fin)
+    return false;
+  int version;
+  fin >> version;
+  if (!fin || version != offline_cache_version)
+    return false;
+  if (!read_entry(fin, entry)) {
+    TC_WARN("Ignoring corrupted kernel cache file {}", cache_file_name(key));
+    return false;
+  }
+  return true;
+}
+
+void OfflineCache::store(const std::string &key, const Entry &entry) {
+  create_directories(get_cache_dir());
+  auto fn = cache_file_name(key);
+  // Write to a temporary file first so that concurrent Taichi processes never
+  // observe a partially written entry.
+  auto tmp_fn = fmt::format("{}.{}.tmp", fn, PID::get_pid());
+  {
+    std::ofstream fout(tmp_fn, std::ios::binary);
+    if (!fout) {
+      TC_WARN("Failed to write kernel cache file {}", tmp_fn);
+      return;
+    }
+    fout << offline_cache_version << "\n";
+    write_entry(fout, entry);
+  }
+  std::rename(tmp_fn.c_str(), fn.c_str());
+}
+
+bool OfflineCache::read_entry(std::istream &in, Entry &entry) {
+  int num_tasks;
+  std::size_t binary_size;
+  in >> num_tasks >> entry.temporaries_size;
+  if (!in)
+    return false;
+  entry.tasks.resize(num_tasks);
+  for (auto &task : entry.tasks) {
+    in >> task.name >> task.grid_dim >> task.block_dim >>
+        task.auto_block_dim_range >> task.concurrent_with_next >>
+        task.num_cpu_threads >> task.traffic.bytes_read >> task.traffic.bytes_written >>
+        task.traffic.num_elements >> task.traffic.flops;
+  }
+  in >> binary_size;
+  in.get();  // the newline before the binary
+  entry.binary.resize(binary_size);
+  in.read(&entry.binary[0], binary_size);
+  return in && (std::size_t)in.gcount() == binary_size;
+}
+
+void OfflineCache::write_entry(std::ostream &out, const Entry &entry) {
+  out << entry.tasks.size() << " " << entry.temporaries_size << "\n";
+  for (auto &task : entry.tasks) {
+    out << task.name << " " << task.grid_dim << " " << task.block_dim << " "
+        << task.auto_block_dim_range << " " << task.concurrent_with_next
+        << " " << task.num_cpu_threads << " " << task.traffic.bytes_read << " " << task.traffic.bytes_written
+        << " " << task.traffic.num_elements << " " << task.traffic.flops
+        << "\n";
+  }
+  out << entry.binary.size() << "\n";
+  out.write(entry.binary.data(), entry.binary.size());
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,52 @@
+// Persistent on-disk cache for kernels compiled by the LLVM backends
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "../tlang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class IRNode;
+
+class OfflineCache {
+ public:
+  struct TaskInfo {
+    std::string name;
+    int grid_dim;
+    int block_dim;
+    int auto_block_dim_range;
+    bool concurrent_with_next;
+    int num_cpu_threads;
+    TaskTraffic traffic;
+  };
+
+  struct Entry {
+    // Relocatable object file on x86_64, PTX on GPUs
+    std::string binary;
+    std::vector<TaskInfo> tasks;
+    // See Kernel::temporaries_size
+    std::size_t temporaries_size = 0;
+  };
+
+  static std::string get_cache_dir();
+
+  // The key covers the lowered kernel IR, the struct module (which embeds the
+  // runtime), codegen-related config and the Taichi commit.
+  static std::string make_key(IRNode *ir,
+                              const std::string &kernel_name,
+                              const std::string &struct_module_hash,
+                              const std::string &config_key);
+
+  static bool load(const std::string &key, Entry &entry);
+
+  static void store(const std::string &key, const Entry &entry);
+
+  // The entry without the version, also used by AotModule
+  static bool read_entry(std::istream &in, Entry &entry);
+
+  static void write_entry(std::ostream &out, const Entry &entry);
+};
+
+TLANG_NAMESPACE_END
@@ -22,8 +22,10 @@ StructCompiler::StructCompiler() : CodeGenBase(), loopgen(this) {
     suffix = "cpp";
   else
     suffix = "cu";
+  pch_defines = "-DTL_HOST=";
   if (get_current_program().config.debug) {
     emit("#define TL_DEBUG");
+    pch_defines += " -DTL_DEBUG=";
   }
   emit("#define TL_HOST");
   emit("#include <taichi/legacy_kernel.h>");
@@ -156,6 +158,9 @@ void StructCompiler::generate_types(SNode &snode) {
   }
   emit("}};");
 
+  TC_ERROR_UNLESS(!snode._halo, "Halos are only supported with LLVM");
+  TC_ERROR_UNLESS(!snode._geometric,
+                  "Geometric dynamic SNodes are only supported with LLVM");
   if (type == SNodeType::dense) {
     emit("using {} = dense<{}_ch, {}, {}, {}>;", snode.node_type_name,
          snode.node_type_name, snode.n,
@@ -37,7 +37,11 @@ class StructCompiler : public CodeGenBase {
 
   virtual void run(SNode &node, bool host);
 
-  static std::unique_ptr<StructCompiler> make(bool use_llvm, Arch arch);
+  // With extension, for an SNode tree added to a materialized layout (see
+  // Program::add_snode_tree)
+  static std::unique_ptr<StructCompiler> make(bool use_llvm,
+                                              Arch arch,
+                                              bool extension = false);
 };
 
 TLANG_NAMESPACE_END
@@ -4,23 +4,377 @@
 #include "../ir.h"
 #include "../program.h"
 #include "../unified_allocator.h"
+#include "cuda_context.h"
 #include "struct.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include <llvm/IR/IRBuilder.h>
+#include <taichi/io/binary_stream.h>
+#include <taichi/system/virtual_memory.h>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <map>
 
 extern "C" void *taichi_allocate_aligned(std::size_t size, int alignment);
 
 TLANG_NAMESPACE_BEGIN
 
-void assert_failed_host(const char *msg) {
-  TC_ERROR("Assertion failure: {}", msg);
+// Nodes per pool chunk of the allocator of a pointer or dynamic SNode. The
+// chunks cover twice the largest number of nodes the SNode can hold, while
+// small pools start with a single chunk of at least 64 KB.
+constexpr int64 max_num_pool_chunks = 1024;  // taichi_max_num_node_chunks
+
+// The largest number of instances of an SNode
+int64 get_max_num_instances(SNode *snode) {
+  constexpr int64 max_int = std::numeric_limits<int>::max();
+  int64 max_num_nodes = 1;
+  for (auto p = snode->parent; p; p = p->parent) {
+    max_num_nodes = std::min(max_num_nodes * p->max_num_elements(), max_int);
+  }
+  return max_num_nodes;
+}
+
+int get_allocator_chunk_num_nodes(SNode *snode, std::size_t node_size) {
+  constexpr int64 max_num_chunks = max_num_pool_chunks;
+  constexpr int64 min_chunk_size = 64 * 1024;
+  constexpr int64 max_int = std::numeric_limits<int>::max();
+  int64 max_num_nodes = get_max_num_instances(snode);
+  if (snode->type == SNodeType::dynamic) {
+    max_num_nodes *= snode->num_dynamic_chunks();
+  } else if (snode->type == SNodeType::hash) {
+    max_num_nodes *= snode->get_hash_capacity();
+  }
+  int64 chunk_num_nodes =
+      (2 * max_num_nodes + max_num_chunks - 1) / max_num_chunks;
+  auto min_num_nodes = min_chunk_size / std::max((int64)node_size, (int64)8);
+  chunk_num_nodes = std::max(chunk_num_nodes, min_num_nodes);
+  if (snode->_compressed) {
+    // Node indices are split into chunks and positions with shifts, and
+    // must fit in 31 bits
+    chunk_num_nodes = (int64)bit::least_pot_bound(chunk_num_nodes);
+    TC_ERROR_UNLESS(chunk_num_nodes * max_num_chunks < (1LL << 31) - 1,
+                    "Too many cells for a compressed pointer SNode");
+  }
+  return (int)std::min(chunk_num_nodes, max_int / 2);
+}
+
+namespace {
+
+constexpr uint32 sparse_snapshot_magic = 0x50534954;      // "TISP"
+constexpr uint32 compressed_snapshot_magic = 0x43534954;  // "TISC"
+
+using Coordinates = std::array<int32, taichi_max_num_indices>;
+using ListLengthFunction = std::function<int32(void *, int)>;
+using ListElementFunction = std::function<void *(void *, int, int, int32 *)>;
+
+bool is_leaf_block(SNode *snode) {
+  if (snode->type != SNodeType::dense || snode->ch.empty())
+    return false;
+  for (auto &ch : snode->ch) {
+    if (ch->type != SNodeType::place)
+      return false;
+  }
+  return true;
+}
+
+// Fills the element list of a leaf block
+void generate_element_list(SNode *leaf) {
+  auto &prog = get_current_program();
+  if (leaf->listgen_kernel == nullptr) {
+    leaf->listgen_kernel = &prog.get_snode_listgen(leaf->ch[0].get());
+  }
+  prog.synchronize();
+  (*leaf->listgen_kernel)();
+}
+
+// Runs body(i) for i in [0, n) on the threads of the program
+void host_parallel_for(int n, const std::function<void(int)> &body) {
+  auto &pool = get_current_program().thread_pool;
+  if (n <= 0)
+    return;
+  pool.run(n, pool.max_num_threads,
+           const_cast<std::function<void(int)> *>(&body),
+           [](void *body, int i) {
+             (*(std::function<void(int)> *)body)(i);
+           });
+}
+
+// Groups the k-th bytes of the 32-bit words of a block together (or back),
+// which puts the exponents of floats and the high bytes of integers next to
+// each other for the compressor. A tail shorter than a word stays in place.
+void shuffle_bytes(const uint8 *in, uint8 *out, std::size_t size,
+                   bool inverse) {
+  std::size_t num_words = size / 4;
+  for (std::size_t w = 0; w < num_words; w++) {
+    for (int k = 0; k < 4; k++) {
+      if (inverse)
+        out[w * 4 + k] = in[k * num_words + w];
+      else
+        out[k * num_words + w] = in[w * 4 + k];
+    }
+  }
+  std::memcpy(out + num_words * 4, in + num_words * 4, size % 4);
+}
+
+// Format: magic, SNode id, block size, number of blocks, then the coordinates
+// and raw data of every block. Compressed snapshots list the coordinates and
+// compressed sizes of all blocks first, followed by the blocks, each
+// shuffled and deflated on its own (in parallel), so that a reader can find
+// any block without decompressing the others.
+void snapshot_blocks(SNode *leaf,
+                     std::size_t block_size,
+                     const ListLengthFunction &get_num_elements,
+                     const ListElementFunction &get_element,
+                     const std::string &filename,
+                     bool compress) {
+  generate_element_list(leaf);
+  auto runtime = get_current_program().llvm_runtime;
+  int32 num_blocks = get_num_elements(runtime, leaf->id);
+  std::vector<Coordinates> coords(num_blocks);
+  std::vector<uint8 *> blocks(num_blocks);
+  for (int i = 0; i < num_blocks; i++)
+    blocks[i] = (uint8 *)get_element(runtime, leaf->id, i, coords[i].data());
+  BinaryFileStreamOutput out(filename);
+  out << (compress ? compressed_snapshot_magic : sparse_snapshot_magic)
+      << (int32)leaf->id << (uint64)block_size << num_blocks;
+  if (!compress) {
+    for (int i = 0; i < num_blocks; i++) {
+      out << coords[i];
+      out.write(blocks[i], block_size);
+    }
+    return;
+  }
+  std::vector<std::vector<uint8>> compressed(num_blocks);
+  host_parallel_for(num_blocks, [&](int i) {
+    std::vector<uint8> shuffled(block_size);
+    shuffle_bytes(blocks[i], shuffled.data(), block_size, false);
+    compressed[i] = zip::compress_block(shuffled.data(), block_size);
+  });
+  for (int i = 0; i < num_blocks; i++)
+    out << coords[i] << (uint64)compressed[i].size();
+  for (int i = 0; i < num_blocks; i++)
+    out.write(compressed[i].data(), compressed[i].size());
+}
+
+void restore_blocks(SNode *leaf,
+                    std::size_t block_size,
+                    const ListLengthFunction &get_num_elements,
+                    const ListElementFunction &get_element,
+                    const std::string &filename) {
+  BinaryFileStreamInput in(filename);
+  uint32 magic;
+  int32 snode_id;
+  uint64 saved_block_size;
+  int32 num_blocks;
+  in >> magic >> snode_id >> saved_block_size >> num_blocks;
+  TC_ERROR_UNLESS(
+      magic == sparse_snapshot_magic || magic == compressed_snapshot_magic,
+      "{} is not a snapshot", filename);
+  TC_ERROR_UNLESS(snode_id == leaf->id && saved_block_size == block_size,
+                  "Snapshot {} was taken from a different SNode", filename);
+  std::vector<Coordinates> coords(num_blocks);
+  std::vector<uint8> data(block_size * num_blocks);
+  if (magic == sparse_snapshot_magic) {
+    for (int i = 0; i < num_blocks; i++) {
+      in >> coords[i];
+      in.read(&data[block_size * i], block_size);
+    }
+  } else {
+    // Where the compressed blocks start in the rest of the file
+    std::vector<uint64> offsets(num_blocks + 1, 0);
+    for (int i = 0; i < num_blocks; i++) {
+      uint64 size;
+      in >> coords[i] >> size;
+      offsets[i + 1] = offsets[i] + size;
+    }
+    std::vector<uint8> compressed(offsets[num_blocks]);
+    in.read(compressed.data(), compressed.size());
+    host_parallel_for(num_blocks, [&](int i) {
+      std::vector<uint8> shuffled(block_size);
+      zip::decompress_block(&compressed[offsets[i]],
+                            offsets[i + 1] - offsets[i], shuffled.data(),
+                            block_size);
+      shuffle_bytes(shuffled.data(), &data[block_size * i], block_size, true);
+    });
+  }
+
+  // Activate the blocks by writing to their first cells...
+  auto place = leaf->ch[0].get();
+  for (int i = 0; i < num_blocks; i++) {
+    std::vector<int> indices(place->num_active_indices);
+    for (int k = 0; k < place->num_active_indices; k++)
+      indices[k] = coords[i][place->physical_index_position[k]];
+    place->write_float(indices, 0);
+  }
+
+  // ...then find their nodes and overwrite them
+  generate_element_list(leaf);
+  get_current_program().synchronize();
+  auto runtime = get_current_program().llvm_runtime;
+  std::map<Coordinates, void *> nodes;
+  int32 num_elements = get_num_elements(runtime, leaf->id);
+  for (int i = 0; i < num_elements; i++) {
+    Coordinates c;
+    auto node = get_element(runtime, leaf->id, i, c.data());
+    nodes[c] = node;
+  }
+  for (int i = 0; i < num_blocks; i++) {
+    auto it = nodes.find(coords[i]);
+    TC_ASSERT(it != nodes.end());
+    std::memcpy(it->second, &data[block_size * i], block_size);
+  }
+}
+
+// Where the cells of a place SNode are, if they form a (possibly padded and
+// interleaved) C-ordered array in the root buffer
+struct BulkCopyLayout {
+  std::size_t offset;  // of the first cell from the root buffer
+  std::size_t cell_stride;
+  std::size_t cell_size;
+  std::vector<int> shape;
+  std::vector<int> extents;  // allocated along each axis
+};
+
+// Places directly under the root, or in a plain dense node that is
+bool get_bulk_copy_layout(SNode *snode,
+                          SNodeAttributes &snode_attr,
+                          const llvm::DataLayout &data_layout,
+                          BulkCopyLayout &layout) {
+  if (snode->type != SNodeType::place || snode->is_bit_field())
+    return false;
+  auto parent = snode->parent;
+  auto cell_type = snode_attr[snode].llvm_type;
+  layout.cell_size = data_layout.getTypeAllocSize(cell_type);
+  layout.shape.clear();
+  layout.extents.clear();
+  auto offset_in = [&](SNode *node, SNode *child, llvm::Type *type) {
+    return data_layout.getStructLayout(llvm::cast<llvm::StructType>(type))
+        ->getElementOffset(node->child_id(child));
+  };
+  if (parent->type == SNodeType::root) {
+    layout.offset = offset_in(parent, snode, snode_attr[parent].llvm_type);
+    layout.cell_stride = layout.cell_size;
+    return true;
+  }
+  if (parent->type != SNodeType::dense || parent->_bitmasked ||
+      parent->_morton || parent->_halo ||
+      parent->parent->type != SNodeType::root)
+    return false;
+  auto root = parent->parent;
+  auto element_type = snode_attr[parent].llvm_element_type;
+  layout.offset = offset_in(root, parent, snode_attr[root].llvm_type) +
+                  offset_in(parent, snode, element_type);
+  layout.cell_stride = data_layout.getTypeAllocSize(element_type);
+  for (int k = 0; k < snode->num_active_indices; k++) {
+    layout.shape.push_back(snode->num_elements_along_axis(k));
+    layout.extents.push_back(
+        1 << parent->extractors[snode->physical_index_position[k]].num_bits);
+  }
+  return true;
+}
+
+// The bytes [offset, offset + size) of the root buffer holding all instances
+// of a dense node, if it is a child of the root, or the only child of a dense
+// node that is
+bool get_contiguous_range(SNode *snode,
+                          SNodeAttributes &snode_attr,
+                          const llvm::DataLayout &data_layout,
+                          std::size_t &offset,
+                          std::size_t &size) {
+  auto top = snode;
+  while (true) {
+    if (top->type != SNodeType::dense || top->_bitmasked)
+      return false;
+    if (top->parent->type == SNodeType::root)
+      break;
+    top = top->parent;
+    if (top->ch.size() != 1)
+      return false;
+  }
+  auto root = top->parent;
+  offset = data_layout
+               .getStructLayout(
+                   llvm::cast<llvm::StructType>(snode_attr[root].llvm_type))
+               ->getElementOffset(root->child_id(top));
+  size = data_layout.getTypeAllocSize(snode_attr[top].llvm_type);
+  return true;
+}
+
+// Visits the cells of the layout as runs that are contiguous in the root
+// buffer, in C order: rows, or single cells if the cells are interleaved
+// with those of other places. f(run, offset in the C-ordered array, size)
+template <typename F>
+void for_each_bulk_run(uint8 *root, const BulkCopyLayout &layout, const F &f) {
+  int dim = (int)layout.shape.size();
+  int64 row_size = dim ? layout.shape[dim - 1] : 1;
+  int64 num_rows = 1;
+  for (int k = 0; k + 1 < dim; k++)
+    num_rows *= layout.shape[k];
+  auto cells = root + layout.offset;
+  for (int64 r = 0; r < num_rows; r++) {
+    // The index of the first cell of the row in the allocated array
+    int64 first = 0;
+    int64 rest = r;
+    int64 stride = dim ? layout.extents[dim - 1] : 1;
+    for (int k = dim - 2; k >= 0; k--) {
+      first += rest % layout.shape[k] * stride;
+      rest /= layout.shape[k];
+      stride *= layout.extents[k];
+    }
+    auto row = cells + first * layout.cell_stride;
+    auto row_offset = r * row_size * layout.cell_size;
+    if (layout.cell_stride == layout.cell_size) {
+      f(row, row_offset, row_size * layout.cell_size);
+      continue;
+    }
+    for (int64 c = 0; c < row_size; c++)
+      f(row + c * layout.cell_stride, row_offset + c * layout.cell_size,
+        layout.cell_size);
+  }
+}
+
+// One memcpy per run
+void bulk_copy(uint8 *root,
+               const BulkCopyLayout &layout,
+               uint8 *array,
+               bool to_array) {
+  for_each_bulk_run(root, layout,
+                    [&](uint8 *run, int64 offset, std::size_t size) {
+                      if (to_array)
+                        std::memcpy(array + offset, run, size);
+                      else
+                        std::memcpy(run, array + offset, size);
+                    });
+}
+
+// The module to generate the tree in: the runtime, or the struct module of
+// the trees materialized so far
+std::unique_ptr<llvm::Module> initial_struct_module(Arch arch,
+                                                    bool extension) {
+  auto tlctx = get_current_program().get_llvm_context(arch);
+  return extension ? tlctx->clone_struct_module() : tlctx->get_init_module();
 }
 
-StructCompilerLLVM::StructCompilerLLVM(Arch arch)
+// The functions and globals of module that old does not define, with
+// declarations of the others, so that extending the struct module does not
+// define the runtime and the other trees in the JIT again
+std::unique_ptr<llvm::Module> new_definitions(llvm::Module &module,
+                                              llvm::Module &old) {
+  llvm::ValueToValueMapTy vmap;
+  return llvm::CloneModule(module, vmap, [&](const llvm::GlobalValue *gv) {
+    // Local values cannot be resolved from the module that defines them
+    return gv->hasLocalLinkage() || !old.getNamedValue(gv->getName());
+  });
+}
+
+}  // namespace
+
+StructCompilerLLVM::StructCompilerLLVM(Arch arch, bool extension)
     : StructCompiler(),
-      ModuleBuilder(
-          get_current_program().get_llvm_context(arch)->get_init_module()),
-      arch(arch) {
+      ModuleBuilder(initial_struct_module(arch, extension)),
+      arch(arch),
+      extension(extension) {
   creator = [] {
     TC_WARN("Data structure creation not implemented");
     return nullptr;
@@ -50,38 +404,69 @@ void StructCompilerLLVM::generate_types(SNode &snode) {
   snode_attr[snode].llvm_element_type = ch_type;
 
   llvm::Type *body_type = nullptr, *aux_type = nullptr;
+  TC_ERROR_UNLESS(!snode._morton || type == SNodeType::dense,
+                  "Only dense SNodes can be Morton ordered");
+  // Accesses shift the whole index by the halo, which only maps to cells of
+  // the same node when it holds all the bits of the index
+  TC_ERROR_UNLESS(!snode._halo ||
+                      (snode.parent->type == SNodeType::root &&
+                       std::all_of(snode.ch.begin(), snode.ch.end(),
+                                   [](const auto &c) {
+                                     return c->type == SNodeType::place;
+                                   })),
+                  "Only dense SNodes of places under the root can have halos");
   if (type == SNodeType::dense) {
-    TC_ASSERT(snode._morton == false);
     body_type = llvm::ArrayType::get(ch_type, snode.max_num_elements());
     if (snode._bitmasked) {
-      aux_type = llvm::ArrayType::get(Type::getInt32Ty(*llvm_ctx),
-                                      (snode.max_num_elements() + 31) / 32);
+      aux_type = llvm::ArrayType::get(Type::getInt64Ty(*llvm_ctx),
+                                      (snode.max_num_elements() + 63) / 64);
     }
   } else if (type == SNodeType::root) {
     body_type = ch_type;
   } else if (type == SNodeType::place) {
-    if (snode.dt == DataType::f32) {
-      body_type = llvm::Type::getFloatTy(*ctx);
-    } else if (snode.dt == DataType::i32) {
-      body_type = llvm::Type::getInt32Ty(*ctx);
+    // Bit fields are addressed through the word they are packed into
+    body_type = tlctx->get_data_type(snode.is_bit_field() ? snode.parent->dt
+                                                          : snode.dt);
+  } else if (type == SNodeType::bit_struct) {
+    body_type = tlctx->get_data_type(snode.dt);
+  } else if (type == SNodeType::pointer) {
+    if (snode._compressed) {
+      // The index of the node and a lock bit, see node_pointer.h
+      body_type = Type::getInt32Ty(*ctx);
     } else {
-      body_type = llvm::Type::getDoubleTy(*ctx);
+      // mutex
+      aux_type = llvm::PointerType::getInt64Ty(*ctx);
+      body_type = llvm::PointerType::getInt8PtrTy(*ctx);
     }
-  } else if (type == SNodeType::pointer) {
-    // mutex
-    aux_type = llvm::PointerType::getInt64Ty(*ctx);
-    body_type = llvm::PointerType::getInt8PtrTy(*ctx);
+  } else if (type == SNodeType::hash) {
+    for (auto &ch : snode.ch) {
+      if (ch->type == SNodeType::place) {
+        TC_ERROR("Hash nodes cannot hold place nodes directly, e.g. use "
+                 "hash(...).dense(...).place(x)");
+      }
+    }
+    // keys and child pointers, see node_hash.h
+    auto capacity = snode.get_hash_capacity();
+    body_type = llvm::StructType::get(
+        *ctx, {llvm::ArrayType::get(Type::getInt32Ty(*ctx), capacity),
+               llvm::ArrayType::get(Type::getInt8PtrTy(*ctx), capacity)});
   } else if (type == SNodeType::dynamic) {
-    // mutex and n (number of elements)
+    // n (number of elements) and the chunk table, see node_dynamic.h
     aux_type =
-        llvm::StructType::get(*ctx, {llvm::PointerType::getInt32Ty(*ctx),
-                                     llvm::PointerType::getInt32Ty(*ctx)});
-    body_type = llvm::PointerType::getInt8PtrTy(*ctx);
+        llvm::StructType::get(*ctx, {llvm::PointerType::getInt32Ty(*ctx)});
+    int num_chunks = snode.num_dynamic_chunks();
+    body_type = llvm::ArrayType::get(llvm::PointerType::getInt8PtrTy(*ctx),
+                                     num_chunks);
   } else {
     TC_P(snode.type_name());
     TC_NOT_IMPLEMENTED;
   }
-  if (aux_type != nullptr) {
+  if (aux_type != nullptr && type == SNodeType::dense) {
+    // The activation mask follows the cells, so that cell lookups need no
+    // offset. See Dense_get_mask.
+    llvm_type = llvm::StructType::create(*ctx, {body_type, aux_type}, "");
+    snode.has_aux_structure = true;
+  } else if (aux_type != nullptr) {
     llvm_type = llvm::StructType::create(*ctx, {aux_type, body_type}, "");
     snode.has_aux_structure = true;
   } else {
@@ -120,17 +505,33 @@ void StructCompilerLLVM::generate_refine_coordinates(SNode *snode) {
   auto outp_coords = args[1];
   auto l = args[2];
 
+  std::vector<uint32> morton_masks;
+  if (snode->_morton) {
+    std::vector<int> num_bits;
+    for (int i = 0; i < max_num_indices; i++)
+      num_bits.push_back(snode->extractors[i].num_bits);
+    morton_masks = morton_bit_masks(num_bits);
+  }
+
   for (int i = 0; i < max_num_indices; i++) {
     auto addition = tlctx->get_constant(0);
-    if (snode->extractors[i].num_bits) {
+    if (snode->extractors[i].num_bits && snode->_morton) {
+      addition = call(&builder, "extract_bits", l,
+                      tlctx->get_constant((int32)morton_masks[i]));
+      addition = builder.CreateShl(
+          addition, tlctx->get_constant(snode->extractors[i].start));
+    } else if (snode->extractors[i].num_bits) {
       auto mask = ((1 << snode->extractors[i].num_bits) - 1);
       addition = builder.CreateAnd(
           builder.CreateAShr(l, snode->extractors[i].acc_offset), mask);
       addition = builder.CreateShl(
           addition, tlctx->get_constant(snode->extractors[i].start));
     }
-    auto in = call(&builder, "PhysicalCoordinates_get_val", inp_coords,
-                   tlctx->get_constant(i));
+    // The element lists only store the coordinates that can be nonzero
+    llvm::Value *in = tlctx->get_constant(0);
+    if (i < snode->num_element_coordinates())
+      in = call(&builder, "PhysicalCoordinates_get_val", inp_coords,
+                tlctx->get_constant(i));
     auto added = builder.CreateOr(in, addition);
     call(&builder, "PhysicalCoordinates_set_val", outp_coords,
          tlctx->get_constant(i), added);
@@ -172,10 +573,14 @@ void StructCompilerLLVM::generate_leaf_accessors(SNode &snode) {
       args.push_back(&arg);
     }
     llvm::Value *ret;
-    ret = builder.CreateGEP(
-        builder.CreateBitCast(args[0], inp_type),
-        {tlctx->get_constant(0), tlctx->get_constant(parent->child_id(&snode))},
-        "getch");
+    if (snode.is_bit_field()) {
+      ret = args[0];
+    } else {
+      ret = builder.CreateGEP(builder.CreateBitCast(args[0], inp_type),
+                              {tlctx->get_constant(0),
+                               tlctx->get_constant(parent->child_id(&snode))},
+                              "getch");
+    }
 
     builder.CreateRet(
         builder.CreateBitCast(ret, llvm::Type::getInt8PtrTy(*llvm_ctx)));
@@ -228,17 +633,25 @@ void StructCompilerLLVM::run(SNode &root, bool host) {
   }
 
   TC_ASSERT((int)snodes.size() <= max_num_snodes);
+  for (auto s : snodes) {
+    TC_ERROR_UNLESS(s->id < max_num_snodes, "Too many SNodes ({} at most)",
+                    max_num_snodes);
+  }
 
   auto root_size =
       tlctx->jit->getDataLayout().getTypeAllocSize(snode_attr[root].llvm_type);
 
   module->setDataLayout(tlctx->jit->getDataLayout());
 
+  std::unique_ptr<llvm::Module> fragment;
+  if (extension && arch == Arch::x86_64)
+    fragment = new_definitions(*module, *tlctx->struct_module);
+
   tlctx->set_struct_module(module);
 
   if (arch == Arch::x86_64)  // Do not compile the GPU struct module alone since
                              // it's useless unless used with kernels
-    tlctx->jit->addModule(std::move(module));
+    tlctx->jit->addModule(extension ? std::move(fragment) : std::move(module));
 
   if (host) {
     for (auto n : snodes) {
@@ -246,79 +659,328 @@ void StructCompilerLLVM::run(SNode &root, bool host) {
     }
 
     auto initialize_data_structure = tlctx->lookup_function<
-        std::function<void *(void *, int, std::size_t, int, void *, bool)>>(
-        "Runtime_initialize");
+        std::function<void *(void *, int, std::size_t, int, void *, bool,
+                             std::size_t)>>("Runtime_initialize");
+
+    auto initialize_snode =
+        tlctx->lookup_function<std::function<void(void *, int)>>(
+            "Runtime_initialize_snode");
+
+    auto add_root =
+        tlctx->lookup_function<std::function<void *(void *, std::size_t, int)>>(
+            "Runtime_add_root");
 
     auto get_allocator =
         tlctx->lookup_function<std::function<void *(void *, int)>>(
             "Runtime_get_node_allocators");
 
-    auto set_assert_failed =
-        tlctx->lookup_function<std::function<void(void *, void *)>>(
-            "Runtime_set_assert_failed");
-
     auto allocate_ambient =
         tlctx->lookup_function<std::function<void(void *, int)>>(
             "Runtime_allocate_ambient");
 
     auto initialize_allocator = tlctx->lookup_function<
-        std::function<void *(void *, void *, std::size_t)>>(
+        std::function<void *(void *, void *, std::size_t, int)>>(
         "NodeAllocator_initialize");
 
+    auto initialize_chunk_allocators = tlctx->lookup_function<
+        std::function<void(void *, int, int, std::size_t, int, int)>>(
+        "Runtime_initialize_chunk_allocators");
+
+    auto get_allocator_stat =
+        tlctx->lookup_function<std::function<void(void *, uint64 *)>>(
+            "NodeAllocator_get_stat");
+
+    auto set_memory_head =
+        tlctx->lookup_function<std::function<void(void *, void *)>>(
+            "Runtime_set_memory_head");
+
+    auto set_memory_tail =
+        tlctx->lookup_function<std::function<void(void *, void *)>>(
+            "Runtime_set_memory_tail");
+
+    auto get_num_list_elements = tlctx->lookup_function<ListLengthFunction>(
+        "Runtime_get_num_list_elements");
+
+    auto get_list_element = tlctx->lookup_function<ListElementFunction>(
+        "Runtime_get_list_element");
+
+    auto get_runtime_counters =
+        tlctx->lookup_function<std::function<void *(void *)>>(
+            "Runtime_get_ptr_counters");
+
+    auto set_list_num_coordinates =
+        tlctx->lookup_function<std::function<void(void *, int, int)>>(
+            "Runtime_set_list_num_coordinates");
+
     auto runtime_initialize_thread_pool =
         tlctx->lookup_function<std::function<void(void *, void *, void *)>>(
             "Runtime_initialize_thread_pool");
 
+    // Cleared with a memset instead of a kernel: {offset, size}
+    std::vector<std::pair<SNode *, std::pair<std::size_t, std::size_t>>>
+        clear_ranges;
+    for (auto n : snodes) {
+      std::size_t offset, size;
+      if (n->can_clear_data() &&
+          get_contiguous_range(n, snode_attr, tlctx->jit->getDataLayout(),
+                               offset, size))
+        clear_ranges.push_back({n, {offset, size}});
+    }
+
+    std::vector<std::pair<SNode *, BulkCopyLayout>> bulk_copy_layouts;
+    for (auto n : snodes) {
+      BulkCopyLayout layout;
+      if (get_bulk_copy_layout(n, snode_attr, tlctx->jit->getDataLayout(),
+                               layout))
+        bulk_copy_layouts.emplace_back(n, layout);
+    }
+
+    // The offsets and element sizes of the dense children of the root, if
+    // it may be file-backed
+    std::vector<std::pair<SNode *, std::pair<std::size_t, std::size_t>>>
+        element_ranges;
+    for (auto &c : root.ch) {
+      if (c->type != SNodeType::dense || c->_bitmasked || extension)
+        continue;
+      auto &data_layout = tlctx->jit->getDataLayout();
+      auto offset =
+          data_layout
+              .getStructLayout(llvm::cast<llvm::StructType>(
+                  snode_attr[&root].llvm_type))
+              ->getElementOffset(root.child_id(c.get()));
+      auto element_size =
+          data_layout.getTypeAllocSize(snode_attr[c.get()].llvm_element_type);
+      element_ranges.push_back({c.get(), {offset, element_size}});
+    }
+
     auto snodes = this->snodes;
     auto tlctx = this->tlctx;
     auto root_id = root.id;
+    auto extension = this->extension;
     creator = [=]() {
       TC_INFO("Allocating data structure of size {} B", root_size);
-      auto root_ptr = initialize_data_structure(
-          &get_current_program().llvm_runtime, (int)snodes.size(), root_size,
-          root_id, (void *)&::taichi_allocate_aligned,
-          get_current_program().config.verbose);
+      auto &config = get_current_program().config;
+      void *root_ptr;
+      if (extension) {
+        // The other trees and their kernels are left alone
+        auto rt = get_current_program().llvm_runtime;
+        for (auto s : snodes)
+          initialize_snode(rt, s->id);
+        root_ptr = add_root(rt, root_size, root_id);
+      } else {
+        auto page_size = config.use_huge_pages
+                             ? VirtualMemoryAllocator::huge_page_size
+                             : VirtualMemoryAllocator::page_size;
+        bool file_backed = !config.root_file.empty();
+        TC_ERROR_UNLESS(!file_backed || config.arch == Arch::x86_64,
+                        "File-backed data structures are only supported on "
+                        "CPUs");
+        // A file-backed root must not share pages with other allocations
+        auto allocated_root_size =
+            file_backed ? (root_size + page_size - 1) / page_size * page_size
+                        : root_size;
+        root_ptr = initialize_data_structure(
+            &get_current_program().llvm_runtime, (int)snodes.size(),
+            allocated_root_size, root_id, (void *)&::taichi_allocate_aligned,
+            config.verbose, page_size);
+        if (file_backed) {
+          TC_INFO("Mapping the data structure from {}", config.root_file);
+          get_current_program().root_file_mapping =
+              std::make_unique<FileBackedRange>(config.root_file, root_ptr,
+                                                allocated_root_size);
+        }
+        set_memory_head(get_current_program().llvm_runtime, allocator()->head);
+        set_memory_tail(get_current_program().llvm_runtime, allocator()->tail);
+        get_current_program().runtime_counters = (RuntimeCounters *)
+            get_runtime_counters(get_current_program().llvm_runtime);
+        if (config.cpu_numa_pinning && config.arch == Arch::x86_64 &&
+            !file_backed) {
+          // Place the dense part of the data structure next to the threads
+          // that will process it
+          get_current_program().thread_pool.first_touch(root_ptr, root_size);
+        }
+      }
+      for (auto s : snodes) {
+        set_list_num_coordinates(get_current_program().llvm_runtime, s->id,
+                                 s->num_element_coordinates());
+      }
       for (int i = 0; i < (int)snodes.size(); i++) {
         if (snodes[i]->type == SNodeType::pointer ||
+            snodes[i]->type == SNodeType::hash ||
             snodes[i]->type == SNodeType::dynamic) {
           std::size_t chunk_size;
-          if (snodes[i]->type == SNodeType::pointer)
+          if (snodes[i]->type != SNodeType::dynamic)
             chunk_size =
                 tlctx->get_type_size(snode_attr[snodes[i]].llvm_element_type);
           else {
             // dynamic. Allocators are for the chunks
             chunk_size =
-                sizeof(void *) +
                 tlctx->get_type_size(snode_attr[snodes[i]].llvm_element_type) *
-                    snodes[i]->chunk_size;
+                snodes[i]->chunk_size;
           }
-          TC_INFO("Initializing allocator for snode {} (chunk size {})",
-                  snodes[i]->id, chunk_size);
+          auto chunk_num_nodes =
+              get_allocator_chunk_num_nodes(snodes[i], chunk_size);
+          TC_INFO(
+              "Initializing allocator for snode {} (chunk size {}, {} per "
+              "pool chunk)",
+              snodes[i]->id, chunk_size, chunk_num_nodes);
           auto rt = get_current_program().llvm_runtime;
-          auto allocator = get_allocator(rt, i);
-          initialize_allocator(rt, allocator, chunk_size);
+          auto id = snodes[i]->id;
+          auto allocator = get_allocator(rt, id);
+          if (snodes[i]->_geometric) {
+            // Every instance may hold a chunk of each level
+            auto num_instances = get_max_num_instances(snodes[i]);
+            auto min_num_nodes = (2 * num_instances + max_num_pool_chunks - 1) /
+                                 max_num_pool_chunks;
+            initialize_chunk_allocators(
+                rt, id, snodes[i]->num_dynamic_chunks(), chunk_size,
+                chunk_num_nodes, (int)min_num_nodes);
+            allocator = get_allocator(rt, id);
+          } else {
+            initialize_allocator(rt, allocator, chunk_size, chunk_num_nodes);
+          }
+          snodes[i]->stat_func = [=]() {
+            get_current_program().synchronize();
+            uint64 stat[6];
+            get_allocator_stat(allocator, stat);
+            AllocatorStat ret;
+            ret.snode_id = snodes[i]->id;
+            ret.pool_size = stat[0];
+            ret.num_resident_blocks = stat[1];
+            ret.num_recycled_blocks = stat[2];
+            ret.node_size = stat[3];
+            ret.peak_num_blocks = stat[4];
+            ret.num_allocations = stat[5];
+            ret.resident_metas = nullptr;
+            return ret;
+          };
           TC_INFO("Allocating ambient element for snode {} (chunk size {})",
                   snodes[i]->id, chunk_size);
-          allocate_ambient(rt, i);
+          allocate_ambient(rt, id);
         }
       }
 
+      for (auto s : snodes) {
+        if (!is_leaf_block(s))
+          continue;
+        auto block_size = tlctx->get_type_size(snode_attr[s].llvm_type);
+        s->snapshot_func = [=](const std::string &filename, bool compress) {
+          snapshot_blocks(s, block_size, get_num_list_elements,
+                          get_list_element, filename, compress);
+        };
+        s->restore_func = [=](const std::string &filename) {
+          restore_blocks(s, block_size, get_num_list_elements,
+                         get_list_element, filename);
+        };
+      }
+
+      for (auto &it : element_ranges) {
+        auto snode = it.first;
+        auto offset = it.second.first;
+        auto element_size = it.second.second;
+        auto n = snode->max_num_elements();
+        snode->residency_func = [=](int64 begin, int64 end, bool prefetch) {
+          auto mapping = get_current_program().root_file_mapping.get();
+          TC_ERROR_UNLESS(mapping, "The data structure is not file-backed");
+          if (end < 0)
+            end = n;
+          TC_ERROR_UNLESS(0 <= begin && begin <= end && end <= n,
+                          "Elements [{}, {}) out of range", begin, end);
+          auto ptr = (char *)root_ptr + offset + begin * element_size;
+          auto size = (end - begin) * element_size;
+          if (prefetch) {
+            mapping->prefetch(ptr, size);
+          } else {
+            get_current_program().synchronize();
+            mapping->evict(ptr, size);
+          }
+        };
+      }
+
+      // Dense nodes have nothing to deactivate, see irpass::offload
+      for (auto &it : clear_ranges) {
+        auto ptr = (char *)root_ptr + it.second.first;
+        auto size = it.second.second;
+        it.first->clear_func = [=](int) {
+          if (get_current_program().config.arch == Arch::gpu) {
+#if defined(TLANG_WITH_CUDA)
+            get_current_program().join_overlapped_launches();
+            cuda_context->memset_async(ptr, size);
+            get_current_program().sync = false;
+#else
+            TC_NOT_IMPLEMENTED
+#endif
+          } else {
+            get_current_program().synchronize();
+            std::memset(ptr, 0, size);
+          }
+        };
+      }
+
+      for (auto &it : bulk_copy_layouts) {
+        auto layout = it.second;
+        it.first->bulk_copy_func = [=](void *array, bool to_array) {
+          get_current_program().synchronize();
+          bulk_copy((uint8 *)root_ptr, layout, (uint8 *)array, to_array);
+        };
+        it.first->cell_func = [=](const std::vector<int> &I) -> void * {
+          int64 cell = 0;
+          for (int k = 0; k < (int)layout.shape.size(); k++) {
+            if (I[k] < 0 || I[k] >= layout.shape[k])
+              return nullptr;
+            cell = cell * layout.extents[k] + I[k];
+          }
+          return (uint8 *)root_ptr + layout.offset + cell * layout.cell_stride;
+        };
+        // Straight between the file and the root buffer, without staging
+        // the array
+        it.first->bulk_write_func = [=](BinaryFileStreamOutput &out) {
+          get_current_program().synchronize();
+          for_each_bulk_run((uint8 *)root_ptr, layout,
+                            [&](uint8 *run, int64, std::size_t size) {
+                              out.write(run, size);
+                            });
+        };
+        it.first->bulk_read_func = [=](BinaryFileStreamInput &in) {
+          get_current_program().synchronize();
+          for_each_bulk_run((uint8 *)root_ptr, layout,
+                            [&](uint8 *run, int64, std::size_t size) {
+                              in.read(run, size);
+                            });
+        };
+      }
+
+      if (extension)
+        return root_ptr;
+
       runtime_initialize_thread_pool(get_current_program().llvm_runtime,
                                      &get_current_program().thread_pool,
                                      (void *)ThreadPool::static_run);
-      set_assert_failed(get_current_program().llvm_runtime,
-                        (void *)assert_failed_host);
+
+      if (config.arch == Arch::gpu) {
+        // The runtime, the root buffer and the ambient elements, plus the
+        // start of the pool that node chunks come from
+        allocator()->prefetch_to_device((std::size_t)config.gpu_prefetch_mb
+                                        << 20);
+      }
 
       return (void *)root_ptr;
     };
   }
-  tlctx->snode_attr = snode_attr;
+  if (extension)
+    tlctx->snode_attr.insert(snode_attr);
+  else
+    tlctx->snode_attr = snode_attr;
 }
 
-std::unique_ptr<StructCompiler> StructCompiler::make(bool use_llvm, Arch arch) {
+std::unique_ptr<StructCompiler> StructCompiler::make(bool use_llvm,
+                                                     Arch arch,
+                                                     bool extension) {
   if (use_llvm) {
-    return std::make_unique<StructCompilerLLVM>(arch);
+    return std::make_unique<StructCompilerLLVM>(arch, extension);
   } else {
+    TC_ERROR_UNLESS(!extension,
+                    "Layouts can only be extended with the LLVM backends");
     return std::make_unique<StructCompiler>();
   }
 }
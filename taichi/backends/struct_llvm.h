@@ -8,11 +8,14 @@ TLANG_NAMESPACE_BEGIN
 
 class StructCompilerLLVM : public StructCompiler, public ModuleBuilder {
  public:
-  StructCompilerLLVM(Arch arch);
+  StructCompilerLLVM(Arch arch, bool extension = false);
 
   SNodeAttributes snode_attr;
 
   Arch arch;
+  // The struct module is extended with the tree instead of replaced, and the
+  // runtime is already initialized
+  bool extension;
   TaichiLLVMContext *tlctx;
   llvm::LLVMContext *llvm_ctx;
 
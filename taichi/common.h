@@ -163,9 +163,33 @@ struct AllocatorStat {
   size_t pool_size;
   size_t num_resident_blocks;
   size_t num_recycled_blocks;
+  size_t node_size;
+  // Most blocks ever handed out at the same time
+  size_t peak_num_blocks;
+  // Nodes allocated so far, including reused ones
+  size_t num_allocations;
   SNodeMeta *resident_metas;
 };
 
+// Estimated memory traffic and floating point operations of one run of an
+// offloaded task, see analysis::estimate_task_traffic. All zero when unknown.
+struct TaskTraffic {
+  uint64 bytes_read = 0;
+  uint64 bytes_written = 0;
+  int64 num_elements = 0;
+  uint64 flops = 0;
+};
+
+// The resources a GPU task is compiled to use per thread and per block,
+// queried once the task is loaded. All zero when unknown.
+struct TaskResources {
+  int num_registers = 0;
+  // Per thread: register spills and local arrays
+  int local_bytes = 0;
+  // Static shared memory per block
+  int shared_bytes = 0;
+};
+
 template <typename T, typename G>
 T union_cast(G g) {
   static_assert(sizeof(T) == sizeof(G), "");
@@ -227,8 +227,89 @@ inline void write_data_to_file(const std::string &fn,
   }
 }
 
+// Values serialized as their raw bytes, so that arrays of them are copied at
+// once: trivially copyable types without io, and types that opt in by
+// specializing this (their binary io must write exactly their bytes)
+template <typename T>
+struct is_bulk_serializable
+    : std::integral_constant<bool,
+                             std::is_trivially_copyable<T>::value &&
+                                 !Serializer::has_io<T>::value &&
+                                 !std::is_pointer<T>::value &&
+                                 !std::is_same<T, bool>::value> {};
+
 template <bool writing>
 class BinarySerializer : public Serializer {
+ private:
+  // Copies size bytes at ptr to (or from) the buffer
+  void raw_io(const void *ptr, std::size_t size) {
+    if (writing) {
+      std::size_t new_size = head + size;
+      if (c_data) {
+        if (new_size > preserved) {
+          TC_CRITICAL("Preserved Buffer (size {}) Overflow.", preserved);
+        }
+        std::memcpy(&c_data[head], ptr, size);
+      } else {
+        data.resize(new_size);
+        std::memcpy(&data[head], ptr, size);
+      }
+    } else {
+      std::memcpy(const_cast<void *>(ptr), &c_data[head], size);
+    }
+    head += size;
+  }
+
+  // One memcpy for arrays and vectors of raw values
+  template <typename T, std::size_t n>
+  void c_array_io(const TArray<T, n> &val, std::true_type) {
+    raw_io(&val[0], sizeof(T) * n);
+  }
+
+  template <typename T, std::size_t n>
+  void c_array_io(const TArray<T, n> &val, std::false_type) {
+    if (writing) {
+      for (std::size_t i = 0; i < n; i++) {
+        this->operator()("", val[i]);
+      }
+    } else {
+      // TODO: why do I have to let it write to tmp, otherwise I get Sig Fault?
+      // Take care of std::vector<bool> ...
+      using Traw = typename type::remove_cvref_t<T>;
+      std::vector<
+          std::conditional_t<std::is_same<Traw, bool>::value, uint8, Traw>>
+          tmp(n);
+      for (std::size_t i = 0; i < n; i++) {
+        this->operator()("", tmp[i]);
+      }
+      std::memcpy(const_cast<typename std::remove_cv<T>::type *>(val), &tmp[0],
+                  sizeof(tmp[0]) * tmp.size());
+    }
+  }
+
+  template <typename T>
+  void vector_io(const std::vector<T> &val, std::true_type) {
+    if (!val.empty())
+      raw_io(val.data(), sizeof(T) * val.size());
+  }
+
+  template <typename T>
+  void vector_io(const std::vector<T> &val, std::false_type) {
+    for (std::size_t i = 0; i < val.size(); i++) {
+      this->operator()("", val[i]);
+    }
+  }
+
+  // A byte for each bit
+  void vector_io(const std::vector<bool> &val_, std::false_type) {
+    auto &val = get_writable(val_);
+    for (std::size_t i = 0; i < val.size(); i++) {
+      uint8 bit = val[i];
+      this->operator()("", bit);
+      val[i] = bit != 0;
+    }
+  }
+
  public:
   std::vector<uint8_t> data;
   uint8_t *c_data;
@@ -320,25 +401,10 @@ class BinarySerializer : public Serializer {
   // C-array
   template <typename T, std::size_t n>
   void operator()(const char *, const TArray<T, n> &val) {
-    if (writing) {
-      for (std::size_t i = 0; i < n; i++) {
-        this->operator()("", val[i]);
-      }
-    } else {
-      // TODO: why do I have to let it write to tmp, otherwise I get Sig Fault?
-      // Take care of std::vector<bool> ...
-      using Traw = typename type::remove_cvref_t<T>;
-      std::vector<
-          std::conditional_t<std::is_same<Traw, bool>::value, uint8, Traw>>
-          tmp(n);
-      for (std::size_t i = 0; i < n; i++) {
-        this->operator()("", tmp[i]);
-      }
-      std::memcpy(const_cast<typename std::remove_cv<T>::type *>(val), &tmp[0],
-                  sizeof(tmp[0]) * tmp.size());
-    }
+    c_array_io(val, is_bulk_serializable<type::remove_cvref_t<T>>());
   }
 
+
   // Elementary data types
   template <typename T>
   typename std::enable_if<!has_io<T>::value && !std::is_pointer<T>::value,
@@ -348,28 +414,7 @@ class BinarySerializer : public Serializer {
     static_assert(!std::is_const<T>::value, "T cannot be const");
     static_assert(!std::is_volatile<T>::value, "T cannot be volatile");
     static_assert(!std::is_pointer<T>::value, "T cannot be pointer");
-    if (writing) {
-      std::size_t new_size = head + sizeof(T);
-      if (c_data) {
-        if (new_size > preserved) {
-          TC_CRITICAL("Preserved Buffer (size {}) Overflow.", preserved);
-        }
-        //*reinterpret_cast<typename type::remove_cvref_t<T> *>(&c_data[head]) =
-        //    val;
-        std::memcpy(&c_data[head], &val, sizeof(T));
-      } else {
-        data.resize(new_size);
-        //*reinterpret_cast<typename type::remove_cvref_t<T> *>(&data[head]) =
-        //    val;
-        std::memcpy(&data[head], &val, sizeof(T));
-      }
-    } else {
-      // get_writable(val) =
-      //    *reinterpret_cast<typename std::remove_reference<T>::type *>(
-      //        &c_data[head]);
-      std::memcpy(&get_writable(val), &c_data[head], sizeof(T));
-    }
-    head += sizeof(T);
+    raw_io(&val, sizeof(T));
   }
 
   template <typename T>
@@ -471,16 +516,7 @@ class BinarySerializer : public Serializer {
       this->operator()("", n);
       val.resize(n);
     }
-    /*
-    for (std::size_t i = 0; i < val.size(); i++) {
-      printf("i %d\n", i);
-      printf("val %d\n", val[i]);
-    }
-
-     */
-    for (std::size_t i = 0; i < val.size(); i++) {
-      this->operator()("", val[i]);
-    }
+    vector_io(val, is_bulk_serializable<T>());
   }
 
   // std::pair
@@ -385,6 +385,15 @@ void write(std::string fn, const uint8 *data, std::size_t len);
 void write(const std::string &fn, const std::string &data);
 std::vector<uint8> read(const std::string fn, bool verbose = false);
 
+// Raw zlib streams, e.g. of blocks of a larger file
+std::vector<uint8> compress_block(const uint8 *data,
+                                  std::size_t len,
+                                  int level = 1);
+void decompress_block(const uint8 *data,
+                      std::size_t len,
+                      uint8 *out,
+                      std::size_t out_len);
+
 }  // namespace zip
 
 //******************************************************************************
@@ -0,0 +1,77 @@
+// Background kernel compilation (CompileConfig::async_compilation)
+
+#include "compilation_queue.h"
+#include "kernel.h"
+
+#if defined(CUDA_FOUND)
+#include "backends/cuda_context.h"
+#endif
+
+TLANG_NAMESPACE_BEGIN
+
+CompilationQueue::CompilationQueue() {
+  num_in_flight = 0;
+  exiting = false;
+  thread = std::thread([this] { target(); });
+}
+
+void CompilationQueue::push(Kernel *kernel) {
+  push([kernel] { kernel->compile(); });
+}
+
+void CompilationQueue::push(const std::function<void()> &job) {
+  {
+    std::lock_guard<std::mutex> _(mutex);
+    TC_ASSERT(!exiting);
+    queue.push_back(job);
+  }
+  cv.notify_all();
+}
+
+void CompilationQueue::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [this] { return queue.empty() && num_in_flight == 0; });
+}
+
+void CompilationQueue::stop() {
+  {
+    std::lock_guard<std::mutex> _(mutex);
+    if (exiting)
+      return;
+    exiting = true;
+    queue.clear();
+  }
+  cv.notify_all();
+  thread.join();
+}
+
+void CompilationQueue::target() {
+#if defined(CUDA_FOUND)
+  if (cuda_context)
+    cuda_context->make_current();
+#endif
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this] { return exiting || !queue.empty(); });
+      if (exiting)
+        return;
+      job = queue.front();
+      queue.pop_front();
+      num_in_flight++;
+    }
+    job();
+    {
+      std::lock_guard<std::mutex> _(mutex);
+      num_in_flight--;
+    }
+    cv.notify_all();
+  }
+}
+
+CompilationQueue::~CompilationQueue() {
+  stop();
+}
+
+TLANG_NAMESPACE_END
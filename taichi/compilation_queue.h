@@ -0,0 +1,48 @@
+// Background kernel compilation (CompileConfig::async_compilation)
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "tlang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class Kernel;
+
+// Compiles submitted kernels on a dedicated thread, so that compilation
+// overlaps with the execution of kernels that are already compiled.
+// Kernel::operator() only blocks on the kernel it is about to launch; a kernel
+// still in the queue is compiled on the calling thread instead.
+class CompilationQueue {
+ public:
+  CompilationQueue();
+
+  void push(Kernel *kernel);
+
+  // Runs |job| on the compilation thread
+  void push(const std::function<void()> &job);
+
+  // Blocks until all submitted kernels are compiled
+  void wait();
+
+  // Drops pending kernels and joins the compilation thread
+  void stop();
+
+  ~CompilationQueue();
+
+ private:
+  void target();
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::function<void()>> queue;
+  int num_in_flight;
+  bool exiting;
+  std::thread thread;
+};
+
+TLANG_NAMESPACE_END
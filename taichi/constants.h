@@ -1,8 +1,14 @@
 #pragma once
 
 constexpr int taichi_max_num_indices = 8;
-constexpr int taichi_max_num_args = 8;
+constexpr int taichi_max_num_args = 64;
 constexpr int taichi_max_num_snodes = 1024;
 constexpr int taichi_max_num_global_vars = 1024 * 1024;
-
-using assert_failed_type = void (*)(const char *);
+// Upper bound of grid_dim * block_dim of the two-pass listgen kernels
+constexpr int taichi_listgen_max_num_threads = 1024 * 1024;
+// Upper bound of grid_dim of the persistent GPU kernels, see
+// CompileConfig::gpu_persistent_threads
+constexpr int taichi_max_gpu_persistent_blocks = 64 * 1024;
+// Size of the ring of printed values and failed assertions in the runtime,
+// see RuntimeCounters::debug_records
+constexpr int taichi_max_num_debug_records = 4096;
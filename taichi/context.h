@@ -1,5 +1,6 @@
 #pragma once
 #include "common.h"
+#include <cstddef>
 #include <string>
 
 TLANG_NAMESPACE_BEGIN
@@ -9,17 +10,30 @@ class CPUProfiler;
 struct Context {
   using Buffer = void *;
   Buffer buffers[1];
-  uint64 args[max_num_args];
-  int32 extra_args[max_num_args][max_num_indices];
-
   void *leaves;
   int num_leaves;
   CPUProfiler *cpu_profiler;
   void *runtime;
+  // Random seed in the low, index of the kernel launch in the high 32 bits
+  uint64 rand_seed;
+  // Set by Program::run_device_loop: tasks return right away once the value
+  // loop_gate points to is nonzero, and otherwise record loop_iteration, the
+  // iteration of the loop their launch belongs to, counting from 1
+  int32 *loop_gate;
+  int32 loop_iteration;
+
+  // The arguments come last, so that a launch only needs to copy the slots
+  // of the arguments its kernel takes, see used_size()
+  uint64 args[max_num_args];
+  // The shapes of external array arguments
+  int32 extra_args[max_num_args][max_num_indices];
 
   Context() {
     leaves = 0;
     num_leaves = 0;
+    rand_seed = 0;
+    loop_gate = nullptr;
+    loop_iteration = 0;
     for (int i = 0; i < 1; i++)
       buffers[i] = nullptr;
   }
@@ -28,6 +42,11 @@ struct Context {
     buffers[0] = x;
   }
 
+  // The bytes up to the slot of argument num_args
+  static std::size_t used_size(int num_args) {
+    return offsetof(Context, args) + sizeof(uint64) * num_args;
+  }
+
   template <typename T>
   T get_arg(int i) {
     return union_cast_different_size<T>(args[i]);
@@ -0,0 +1,134 @@
+#include <taichi/ir.h>
+
+TLANG_NAMESPACE_BEGIN
+
+// Factorizations and solves of small dense matrices of a size known at
+// compile time, emitted as straight-line statements on local variables (which
+// end up in registers). The matrices are passed as their n * n entries in
+// row-major order, and right-hand sides as their n * m entries, for solving
+// m systems at once.
+
+// Copies the entries into fresh local variables
+template <typename Tf>
+std::vector<Expr> dense_solve_locals(const std::vector<Expr> &entries) {
+  std::vector<Expr> ret;
+  for (auto &e : entries) {
+    auto v = Var(Tf(0));
+    v = load_if_ptr(e);
+    ret.push_back(v);
+  }
+  return ret;
+}
+
+// Solves A x = b by Gaussian elimination. With pivoting, the row with the
+// largest entry in the pivot column is swapped in, through selects, since
+// the locals cannot be indexed at run time. Without pivoting, A should be
+// e.g. diagonally dominant or symmetric positive definite.
+template <typename Tf>
+std::vector<Expr> dense_lu_solve(const std::vector<Expr> &a_entries,
+                                 const std::vector<Expr> &b_entries,
+                                 int n,
+                                 bool pivoting) {
+  TC_ASSERT(n > 0 && (int)a_entries.size() == n * n);
+  TC_ASSERT(!b_entries.empty() && (int)b_entries.size() % n == 0);
+  int m = (int)b_entries.size() / n;
+  auto a = dense_solve_locals<Tf>(a_entries);
+  auto b = dense_solve_locals<Tf>(b_entries);
+  auto A = [&](int i, int j) -> Expr & { return a[i * n + j]; };
+  auto B = [&](int i, int j) -> Expr & { return b[i * m + j]; };
+  auto swap_if = [&](const Expr &cond, Expr &x, Expr &y) {
+    auto t = Var(x);
+    x = select(cond, y, t);
+    y = select(cond, t, y);
+  };
+  std::vector<Expr> inv_pivot;
+  for (int k = 0; k < n; k++) {
+    if (pivoting) {
+      // Keeps the largest entry of the column so far in row k
+      for (int i = k + 1; i < n; i++) {
+        auto larger = Var(abs(A(i, k)) > abs(A(k, k)));
+        for (int j = k; j < n; j++)
+          swap_if(larger, A(k, j), A(i, j));
+        for (int j = 0; j < m; j++)
+          swap_if(larger, B(k, j), B(i, j));
+      }
+    }
+    inv_pivot.push_back(Var(Expr(Tf(1)) / A(k, k)));
+    for (int i = k + 1; i < n; i++) {
+      auto l = Var(A(i, k) * inv_pivot[k]);
+      for (int j = k + 1; j < n; j++)
+        A(i, j) = A(i, j) - l * A(k, j);
+      for (int j = 0; j < m; j++)
+        B(i, j) = B(i, j) - l * B(k, j);
+    }
+  }
+  // Back substitution, in place
+  for (int i = n - 1; i >= 0; i--) {
+    for (int j = 0; j < m; j++) {
+      for (int k = i + 1; k < n; k++)
+        B(i, j) = B(i, j) - A(i, k) * B(k, j);
+      B(i, j) = B(i, j) * inv_pivot[i];
+    }
+  }
+  return b;
+}
+
+// The lower triangular L with A = L L^T, for symmetric positive definite A
+template <typename Tf>
+std::vector<Expr> dense_cholesky(const std::vector<Expr> &a_entries, int n) {
+  TC_ASSERT(n > 0 && (int)a_entries.size() == n * n);
+  std::vector<Expr> l;
+  for (int i = 0; i < n * n; i++)
+    l.push_back(Var(Tf(0)));
+  auto L = [&](int i, int j) -> Expr & { return l[i * n + j]; };
+  for (int j = 0; j < n; j++) {
+    auto d = Var(load_if_ptr(a_entries[j * n + j]));
+    for (int k = 0; k < j; k++)
+      d = d - L(j, k) * L(j, k);
+    L(j, j) = sqrt(d);
+    auto inv_d = Var(Expr(Tf(1)) / L(j, j));
+    for (int i = j + 1; i < n; i++) {
+      auto s = Var(load_if_ptr(a_entries[i * n + j]));
+      for (int k = 0; k < j; k++)
+        s = s - L(i, k) * L(j, k);
+      L(i, j) = s * inv_d;
+    }
+  }
+  return l;
+}
+
+// Solves L L^T x = b, given the factor from dense_cholesky
+template <typename Tf>
+std::vector<Expr> dense_cholesky_solve(const std::vector<Expr> &l_entries,
+                                       const std::vector<Expr> &b_entries,
+                                       int n) {
+  TC_ASSERT(n > 0 && (int)l_entries.size() == n * n);
+  TC_ASSERT(!b_entries.empty() && (int)b_entries.size() % n == 0);
+  int m = (int)b_entries.size() / n;
+  auto l = dense_solve_locals<Tf>(l_entries);
+  auto b = dense_solve_locals<Tf>(b_entries);
+  auto L = [&](int i, int j) -> Expr & { return l[i * n + j]; };
+  auto B = [&](int i, int j) -> Expr & { return b[i * m + j]; };
+  std::vector<Expr> inv_diag;
+  for (int i = 0; i < n; i++)
+    inv_diag.push_back(Var(Expr(Tf(1)) / L(i, i)));
+  // L y = b
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < m; j++) {
+      for (int k = 0; k < i; k++)
+        B(i, j) = B(i, j) - L(i, k) * B(k, j);
+      B(i, j) = B(i, j) * inv_diag[i];
+    }
+  }
+  // L^T x = y
+  for (int i = n - 1; i >= 0; i--) {
+    for (int j = 0; j < m; j++) {
+      for (int k = i + 1; k < n; k++)
+        B(i, j) = B(i, j) - L(k, i) * B(k, j);
+      B(i, j) = B(i, j) * inv_diag[i];
+    }
+  }
+  return b;
+}
+
+TLANG_NAMESPACE_END
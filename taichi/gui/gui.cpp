@@ -1,7 +1,153 @@
 #include <taichi/visual/gui.h>
+#include <taichi/system/threading.h>
 
 TC_NAMESPACE_BEGIN
 
 Vector2 Canvas::Line::vertices[128];
 
+namespace {
+
+constexpr int canvas_tile_size = 64;
+
+void canvas_parallel_for(int n, const std::function<void(int)> &body) {
+  static ThreadPool pool;
+  if (n <= 0)
+    return;
+  pool.run(n, pool.max_num_threads,
+           const_cast<std::function<void(int)> *>(&body),
+           [](void *body, int i) {
+             (*(std::function<void(int)> *)body)(i);
+           });
+}
+
+// Draws primitive i over the pixels [lower, upper] of one tile
+using DrawFunction = std::function<void(int, Vector2i, Vector2i)>;
+
+// Bins the pixel footprints [lower[i], upper[i]] of n primitives by tile,
+// keeping them in order within each tile, and draws the tiles in parallel
+void draw_tiled(Array2D<Vector4> &img,
+                const std::vector<Vector2i> &lower,
+                const std::vector<Vector2i> &upper,
+                const DrawFunction &draw) {
+  int n = (int)lower.size();
+  int tiles_x = (img.get_width() + canvas_tile_size - 1) / canvas_tile_size;
+  int tiles_y = (img.get_height() + canvas_tile_size - 1) / canvas_tile_size;
+  auto for_each_tile = [&](int i, const std::function<void(int)> &f) {
+    if (lower[i].x > upper[i].x || lower[i].y > upper[i].y)
+      return;
+    for (int tx = lower[i].x / canvas_tile_size;
+         tx <= upper[i].x / canvas_tile_size; tx++) {
+      for (int ty = lower[i].y / canvas_tile_size;
+           ty <= upper[i].y / canvas_tile_size; ty++) {
+        f(tx * tiles_y + ty);
+      }
+    }
+  };
+  // Counting sort of the (tile, primitive) pairs by tile
+  std::vector<int> offsets(tiles_x * tiles_y + 1, 0);
+  for (int i = 0; i < n; i++)
+    for_each_tile(i, [&](int t) { offsets[t + 1]++; });
+  for (int t = 0; t < tiles_x * tiles_y; t++)
+    offsets[t + 1] += offsets[t];
+  std::vector<int> ids(offsets.back());
+  std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+  for (int i = 0; i < n; i++)
+    for_each_tile(i, [&](int t) { ids[fill[t]++] = i; });
+  canvas_parallel_for(tiles_x * tiles_y, [&](int t) {
+    auto tile_lower = Vector2i(t / tiles_y, t % tiles_y) * canvas_tile_size;
+    auto tile_upper = tile_lower + Vector2i(canvas_tile_size - 1);
+    for (int k = offsets[t]; k < offsets[t + 1]; k++) {
+      int i = ids[k];
+      draw(i, Vector2i(std::max(lower[i].x, tile_lower.x),
+                       std::max(lower[i].y, tile_lower.y)),
+           Vector2i(std::min(upper[i].x, tile_upper.x),
+                    std::min(upper[i].y, tile_upper.y)));
+    }
+  });
+}
+
+}  // namespace
+
+void Canvas::draw_circles(int n,
+                          const float32 *centers,
+                          const uint32 *colors,
+                          uint32 color,
+                          const float32 *radii,
+                          real radius) {
+  auto res = img.get_res() - Vector2i(1);
+  std::vector<Vector2> pixel_centers(n);
+  std::vector<Vector2i> lower(n), upper(n);
+  canvas_parallel_for((n + 4095) / 4096, [&](int b) {
+    for (int i = b * 4096; i < std::min(n, (b + 1) * 4096); i++) {
+      auto center = transform(Vector2(centers[i * 2], centers[i * 2 + 1]));
+      auto center_i = (center + Vector2(0.5_f)).template cast<int>();
+      auto r = radii ? radii[i] : radius;
+      auto radius_i = (int)std::ceil(r + 0.5_f);
+      pixel_centers[i] = center;
+      lower[i] = max(center_i - Vector2i(radius_i), Vector2i(0));
+      upper[i] = min(center_i + Vector2i(radius_i), res);
+    }
+  });
+  auto single_color = color_from_hex(color);
+  draw_tiled(img, lower, upper, [&](int i, Vector2i lo, Vector2i hi) {
+    auto center = pixel_centers[i];
+    auto c = colors ? color_from_hex(colors[i]) : single_color;
+    auto r = radii ? radii[i] : radius;
+    for (int x = lo.x; x <= hi.x; x++) {
+      for (int y = lo.y; y <= hi.y; y++) {
+        real dist = length(center - Vector2(x, y));
+        auto alpha = c.w * clamp(r - dist);
+        auto &dest = img[x][y];
+        dest = lerp(alpha, dest, c);
+      }
+    }
+  });
+}
+
+void Canvas::draw_segments(int n,
+                           const float32 *begins,
+                           const float32 *ends,
+                           const uint32 *colors,
+                           uint32 color,
+                           const float32 *radii,
+                           real radius) {
+  auto res = img.get_res() - Vector2i(1);
+  std::vector<Vector2> a(n), b(n);
+  std::vector<Vector2i> lower(n), upper(n);
+  canvas_parallel_for((n + 4095) / 4096, [&](int block) {
+    for (int i = block * 4096; i < std::min(n, (block + 1) * 4096); i++) {
+      a[i] = transform(Vector2(begins[i * 2], begins[i * 2 + 1]));
+      b[i] = transform(Vector2(ends[i * 2], ends[i * 2 + 1]));
+      auto a_i = (a[i] + Vector2(0.5_f)).template cast<int>();
+      auto b_i = (b[i] + Vector2(0.5_f)).template cast<int>();
+      auto r = radii ? radii[i] : radius;
+      auto radius_i = (int)std::ceil(r + 0.5_f);
+      lower[i] = max(min(a_i, b_i) - Vector2i(radius_i), Vector2i(0));
+      upper[i] = min(max(a_i, b_i) + Vector2i(radius_i), res);
+    }
+  });
+  auto single_color = color_from_hex(color);
+  draw_tiled(img, lower, upper, [&](int i, Vector2i lo, Vector2i hi) {
+    auto c = colors ? color_from_hex(colors[i]) : single_color;
+    auto r = radii ? radii[i] : radius;
+    auto l = length(b[i] - a[i]);
+    auto direction = l > 0 ? (b[i] - a[i]) / l : Vector2(1, 0);
+    auto tangent = Vector2(-direction.y, direction.x);
+    for (int x = lo.x; x <= hi.x; x++) {
+      for (int y = lo.y; y <= hi.y; y++) {
+        auto pixel_coord = Vector2(x + 0.5_f, y + 0.5_f) - a[i];
+        auto u = dot(tangent, pixel_coord);
+        auto v = dot(direction, pixel_coord);
+        if (v > 0) {
+          v = std::max(0.0_f, v - l);
+        }
+        real dist = length(Vector2(u, v));
+        auto alpha = c.w * clamp(r - dist);
+        auto &dest = img[x][y];
+        dest = lerp(alpha, dest, c);
+      }
+    }
+  });
+}
+
 TC_NAMESPACE_END
@@ -97,12 +97,13 @@ void GUI::create_window() {
 void GUI::redraw() {
   UpdateWindow(hwnd);
   // http:// www.cplusplus.com/reference/cstdlib/calloc/
+  auto &img = *presented;
   for (int i = 0; i < width; i++) {
     for (int j = 0; j < height; j++) {
       auto c = reinterpret_cast<unsigned char *>(data + (j * width) + i);
-      c[0] = (unsigned char)(canvas->img[i][height - j - 1][2] * 255.0_f);
-      c[1] = (unsigned char)(canvas->img[i][height - j - 1][1] * 255.0_f);
-      c[2] = (unsigned char)(canvas->img[i][height - j - 1][0] * 255.0_f);
+      c[0] = (unsigned char)(img[i][height - j - 1][2] * 255.0_f);
+      c[1] = (unsigned char)(img[i][height - j - 1][1] * 255.0_f);
+      c[2] = (unsigned char)(img[i][height - j - 1][0] * 255.0_f);
       c[3] = 0;
     }
   }
@@ -117,6 +118,7 @@ void GUI::set_title(std::string title) {
 }
 
 GUI::~GUI() {
+  stop_presentation();
   std::free(data);
   DeleteDC(src);
   gui_from_hwnd.erase(hwnd);
@@ -84,7 +84,7 @@ void GUI::create_window() {
 }
 
 void GUI::redraw() {
-  img->set_data(buffer);
+  img->set_data(*presented);
   XPutImage((Display *)display, window, DefaultGC(display, 0), img->image, 0, 0,
             0, 0, width, height);
 }
@@ -94,6 +94,7 @@ void GUI::set_title(std::string title) {
 }
 
 GUI::~GUI() {
+  stop_presentation();
   delete img;
 }
 
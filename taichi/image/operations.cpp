@@ -4,9 +4,185 @@
 *******************************************************************************/
 
 #include "operations.h"
+#include <taichi/system/threading.h>
 
 TC_NAMESPACE_BEGIN
 
+void image_parallel_for(int n, const std::function<void(int)> &body) {
+  static ThreadPool pool;
+  if (n <= 0)
+    return;
+  pool.run(n, pool.max_num_threads,
+           const_cast<std::function<void(int)> *>(&body),
+           [](void *body, int i) {
+             (*(std::function<void(int)> *)body)(i);
+           });
+}
+
+template <int N>
+PlanarImage to_planar(const Array2D<VectorND<N, real>> &image) {
+  PlanarImage planar(image.get_res(), N);
+  int width = image.get_width(), height = image.get_height();
+  image_parallel_for(height, [&](int r) {
+    int j = height - 1 - r;
+    for (int c = 0; c < N; c++) {
+      auto row = planar.row(c, r);
+      for (int i = 0; i < width; i++)
+        row[i] = (float32)image[i][j][c];
+    }
+  });
+  return planar;
+}
+
+template <int N>
+Array2D<VectorND<N, real>> from_planar(const PlanarImage &planar) {
+  TC_ASSERT(planar.channels == N);
+  Array2D<VectorND<N, real>> image(planar.res);
+  int width = planar.res[0], height = planar.res[1];
+  image_parallel_for(width, [&](int i) {
+    for (int j = 0; j < height; j++) {
+      for (int c = 0; c < N; c++)
+        image[i][j][c] = planar.row(c, height - 1 - j)[i];
+    }
+  });
+  return image;
+}
+
+std::vector<uint8> to_8bit(const PlanarImage &planar, real gamma) {
+  int width = planar.res[0], channels = planar.channels;
+  std::vector<uint8> ret((std::size_t)width * planar.res[1] * channels);
+  float32 inv_gamma = float32(1 / gamma);
+  image_parallel_for(planar.res[1], [&](int r) {
+    auto out = &ret[(std::size_t)r * width * channels];
+    for (int c = 0; c < channels; c++) {
+      auto row = planar.row(c, r);
+      for (int i = 0; i < width; i++) {
+        float32 v = std::min(std::max(row[i], 0.0f), 1.0f);
+        if (inv_gamma != 1)
+          v = std::pow(v, inv_gamma);
+        out[i * channels + c] = (uint8)(v * 255.0f + 0.5f);
+      }
+    }
+  });
+  return ret;
+}
+
+template <typename T>
+Array2D<T> resize(const Array2D<T> &image, const Vector2i &res) {
+  Array2D<T> ret(res);
+  Vector2i in = image.get_res();
+  // The two source pixels around the center of pixel i of the output, and
+  // the weight of the second
+  auto sample = [](int i, int in, int out, int &i0, int &i1, real &t) {
+    real x = clamp((i + 0.5_f) * in / out - 0.5_f, 0.0_f, in - 1.0_f);
+    i0 = (int)x;
+    i1 = std::min(i0 + 1, in - 1);
+    t = x - i0;
+  };
+  image_parallel_for(res[0], [&](int i) {
+    int i0, i1;
+    real tx;
+    sample(i, in[0], res[0], i0, i1, tx);
+    for (int j = 0; j < res[1]; j++) {
+      int j0, j1;
+      real ty;
+      sample(j, in[1], res[1], j0, j1, ty);
+      ret[i][j] = lerp(tx, lerp(ty, image[i0][j0], image[i0][j1]),
+                       lerp(ty, image[i1][j0], image[i1][j1]));
+    }
+  });
+  return ret;
+}
+
+template <typename T>
+Array2D<T> downsample(const Array2D<T> &image, int factor) {
+  TC_ASSERT(factor >= 1);
+  Vector2i res = image.get_res() / factor;
+  Array2D<T> ret(res);
+  real scale = 1.0_f / (factor * factor);
+  image_parallel_for(res[0], [&](int i) {
+    auto out = ret[i];
+    for (int a = 0; a < factor; a++) {
+      auto column = image[i * factor + a];
+      for (int j = 0; j < res[1]; j++) {
+        for (int b = 0; b < factor; b++)
+          out[j] += column[j * factor + b];
+      }
+    }
+    for (int j = 0; j < res[1]; j++)
+      out[j] *= scale;
+  });
+  return ret;
+}
+
+template <typename T>
+Array2D<T> gaussian_blur(const Array2D<T> &image, real sigma) {
+  TC_ASSERT(sigma > 0);
+  int radius = (int)std::ceil(sigma * 3);
+  std::vector<real> weights(radius + 1);
+  real total = 0;
+  for (int t = 0; t <= radius; t++) {
+    weights[t] = std::exp(-0.5_f * t * t / (sigma * sigma));
+    total += weights[t] * (t == 0 ? 1 : 2);
+  }
+  for (auto &w : weights)
+    w /= total;
+  int width = image.get_width(), height = image.get_height();
+  // Along j, within the columns of the data
+  auto tmp = image.same_shape();
+  image_parallel_for(width, [&](int i) {
+    auto in = image[i];
+    auto out = tmp[i];
+    for (int j = 0; j < height; j++) {
+      T sum = weights[0] * in[j];
+      for (int t = 1; t <= radius; t++)
+        sum += weights[t] * (in[std::max(j - t, 0)] +
+                             in[std::min(j + t, height - 1)]);
+      out[j] = sum;
+    }
+  });
+  // Along i, adding whole columns
+  auto ret = image.same_shape();
+  image_parallel_for(width, [&](int i) {
+    auto out = ret[i];
+    for (int t = -radius; t <= radius; t++) {
+      auto in = tmp[clamp(i + t, 0, width - 1)];
+      real w = weights[std::abs(t)];
+      for (int j = 0; j < height; j++)
+        out[j] += w * in[j];
+    }
+  });
+  return ret;
+}
+
+template <typename T>
+Array2D<T> tone_map(const Array2D<T> &image, real exposure) {
+  auto ret = image;
+  image_parallel_for(image.get_width(), [&](int i) {
+    auto column = ret[i];
+    for (int j = 0; j < image.get_height(); j++) {
+      for (int c = 0; c < std::min(T::dim, 3); c++) {
+        real x = column[j][c] * exposure;
+        column[j][c] = x / (1 + x);
+      }
+    }
+  });
+  return ret;
+}
+
+template PlanarImage to_planar<3>(const Array2D<Vector3> &image);
+template PlanarImage to_planar<4>(const Array2D<Vector4> &image);
+template Array2D<Vector3> from_planar<3>(const PlanarImage &planar);
+template Array2D<Vector4> from_planar<4>(const PlanarImage &planar);
+#define TC_INSTANTIATE_IMAGE_OPERATIONS(T)                                 \
+  template Array2D<T> resize(const Array2D<T> &image, const Vector2i &res); \
+  template Array2D<T> downsample(const Array2D<T> &image, int factor);     \
+  template Array2D<T> gaussian_blur(const Array2D<T> &image, real sigma);  \
+  template Array2D<T> tone_map(const Array2D<T> &image, real exposure);
+TC_INSTANTIATE_IMAGE_OPERATIONS(Vector3)
+TC_INSTANTIATE_IMAGE_OPERATIONS(Vector4)
+#undef TC_INSTANTIATE_IMAGE_OPERATIONS
+
 int64 binomial(int n, int r) {
   int64 ret = 1;
   for (int i = 1; i <= r; i++) {
@@ -23,40 +199,42 @@ Array2D<Vector3> blur_with_depth(const Array2D<Vector3> &image,
   auto ret = image.same_shape();
   constexpr int max_radius = 50;
 
-  std::vector<real> kernel(max_radius, 0.0_f);
-
-  for (auto &ind : image.get_region()) {
-    int radius;
-    real sigma = aperature * std::abs(depth[ind].x - focal_plane) + 1e-7f;
-    if (filter_type == 0) {
-      // Gaussian
-      radius = int(std::ceil(sigma * 3.0f));
-      for (int i = 0; i <= radius; i++)
-        kernel[i] = std::exp(-0.5f * i * i / sigma / sigma);
-    } else {
-      // Binomial
-      radius = (int)(std::round(sigma) / 2);
-      for (int i = 0; i <= radius; i++)
-        kernel[i] = binomial(radius * 2 + 1, radius - i);
-    }
-    // normalize kernel
-    real kernel_tot(0.0);
-    for (int i = 0; i <= radius; i++) {
-      kernel_tot += kernel[i] * (1 + (i != 0));
-    }
-    for (int i = 0; i <= radius; i++) {
-      kernel[i] /= kernel_tot;
-    }
-    Vector3 tot(0.0_f);
-    for (int i = -radius; i <= radius; i++) {
-      for (int j = -radius; j <= radius; j++) {
-        Vector2i coord(clamp(ind.i + i, 0, image.get_width() - 1),
-                       clamp(ind.j + j, 0, image.get_height() - 1));
-        tot += kernel[std::abs(i)] * kernel[std::abs(j)] * image[coord];
+  image_parallel_for(image.get_width(), [&](int column) {
+    std::vector<real> kernel(max_radius, 0.0_f);
+    for (int row = 0; row < image.get_height(); row++) {
+      Index2D ind(column, row);
+      int radius;
+      real sigma = aperature * std::abs(depth[ind].x - focal_plane) + 1e-7f;
+      if (filter_type == 0) {
+        // Gaussian
+        radius = int(std::ceil(sigma * 3.0f));
+        for (int i = 0; i <= radius; i++)
+          kernel[i] = std::exp(-0.5f * i * i / sigma / sigma);
+      } else {
+        // Binomial
+        radius = (int)(std::round(sigma) / 2);
+        for (int i = 0; i <= radius; i++)
+          kernel[i] = binomial(radius * 2 + 1, radius - i);
+      }
+      // normalize kernel
+      real kernel_tot(0.0);
+      for (int i = 0; i <= radius; i++) {
+        kernel_tot += kernel[i] * (1 + (i != 0));
+      }
+      for (int i = 0; i <= radius; i++) {
+        kernel[i] /= kernel_tot;
       }
+      Vector3 tot(0.0_f);
+      for (int i = -radius; i <= radius; i++) {
+        for (int j = -radius; j <= radius; j++) {
+          Vector2i coord(clamp(ind.i + i, 0, image.get_width() - 1),
+                         clamp(ind.j + j, 0, image.get_height() - 1));
+          tot += kernel[std::abs(i)] * kernel[std::abs(j)] * image[coord];
+        }
+      }
+      ret[ind] = tot;
     }
-    ret[ind] = tot;
-  }
+  });
   return ret;
 }
 
@@ -5,11 +5,69 @@
 
 #pragma once
 
+#include <functional>
 #include <taichi/math/math.h>
 #include <taichi/image/image_buffer.h>
 
 TC_NAMESPACE_BEGIN
 
+// Runs body(i) for i in [0, n) on a thread pool shared by the image
+// operations, which split images into columns (i), the contiguous axis of
+// Array2D::data. Per-pixel arithmetic on Vector4 uses the SIMD operations of
+// VectorND.
+void image_parallel_for(int n, const std::function<void(int)> &body);
+
+// An image stored channel by channel, with rows from top to bottom as in
+// image files, so that conversions run over contiguous floats of one channel
+class PlanarImage {
+ public:
+  Vector2i res;
+  int channels;
+  std::vector<float32> data;
+
+  PlanarImage() : res(0, 0), channels(0) {
+  }
+
+  PlanarImage(const Vector2i &res, int channels)
+      : res(res), channels(channels) {
+    data.resize((std::size_t)res[0] * res[1] * channels);
+  }
+
+  float32 *row(int c, int r) {
+    return &data[((std::size_t)c * res[1] + r) * res[0]];
+  }
+
+  const float32 *row(int c, int r) const {
+    return &data[((std::size_t)c * res[1] + r) * res[0]];
+  }
+};
+
+template <int N>
+PlanarImage to_planar(const Array2D<VectorND<N, real>> &image);
+
+template <int N>
+Array2D<VectorND<N, real>> from_planar(const PlanarImage &planar);
+
+// Interleaved 8-bit pixels, rows from top to bottom (as stb_image_write
+// takes them), of the values in [0, 1] raised to 1 / gamma
+std::vector<uint8> to_8bit(const PlanarImage &planar, real gamma = 1);
+
+// Bilinear, for the pixel centers of res spanning the same area
+template <typename T>
+Array2D<T> resize(const Array2D<T> &image, const Vector2i &res);
+
+// Averages of factor x factor blocks, cropping the partial ones
+template <typename T>
+Array2D<T> downsample(const Array2D<T> &image, int factor);
+
+// Separable, with radius ceil(3 sigma) and clamped borders
+template <typename T>
+Array2D<T> gaussian_blur(const Array2D<T> &image, real sigma);
+
+// Reinhard, x e / (1 + x e) for exposure e, on the first three channels
+template <typename T>
+Array2D<T> tone_map(const Array2D<T> &image, real exposure = 1);
+
 Array2D<Vector3> blur_with_depth(const Array2D<Vector3> &image,
                                  const Array2D<Vector3> &depth,
                                  int filter_type,
@@ -37,6 +37,7 @@ PER_STATEMENT(LocalStoreStmt)
 PER_STATEMENT(SNodeOpStmt)
 PER_STATEMENT(RangeAssumptionStmt)
 PER_STATEMENT(AssertStmt)
+PER_STATEMENT(BoundCheckStmt)
 PER_STATEMENT(ArgStoreStmt)
 
 // SNode Micro Ops
@@ -62,3 +63,8 @@ PER_STATEMENT(ClearAllStmt)
 PER_STATEMENT(OffloadedStmt)
 PER_STATEMENT(LoopIndexStmt)
 PER_STATEMENT(GlobalTemporaryStmt)
+PER_STATEMENT(BlockCornerIndexStmt)
+PER_STATEMENT(ThreadIndexStmt)
+PER_STATEMENT(ScratchPadPtrStmt)
+PER_STATEMENT(MatmulStmt)
+PER_STATEMENT(MatmulResultStmt)
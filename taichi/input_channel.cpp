@@ -0,0 +1,116 @@
+// Streaming inputs to the device while the previous ones are computed on
+
+#include <cstring>
+#include <taichi/system/timeline.h>
+#include "input_channel.h"
+#include "program.h"
+
+#if defined(CUDA_FOUND)
+#include <cuda_runtime.h>
+#include "cuda_utils.h"
+#endif
+
+TLANG_NAMESPACE_BEGIN
+
+InputChannel::InputChannel(Program &program, std::size_t size)
+    : program(program),
+      size(size),
+      current_slot(0),
+      pushed(false),
+      on_device(program.config.arch == Arch::gpu),
+      copy_stream(nullptr) {
+  TC_ERROR_UNLESS(size > 0, "Input channels cannot be empty");
+  for (auto &slot : slots) {
+    slot.copied = nullptr;
+    slot.released = nullptr;
+    if (on_device) {
+#if defined(CUDA_FOUND)
+      check_cuda_errors(cudaMalloc(&slot.device_ptr, size));
+      check_cuda_errors(cudaHostAlloc(&slot.staging_ptr, size, 0));
+      cudaEvent_t copied, released;
+      check_cuda_errors(
+          cudaEventCreateWithFlags(&copied, cudaEventDisableTiming));
+      check_cuda_errors(
+          cudaEventCreateWithFlags(&released, cudaEventDisableTiming));
+      slot.copied = (void *)copied;
+      slot.released = (void *)released;
+#else
+      TC_ERROR("No CUDA support");
+#endif
+    } else {
+      slot.device_ptr = new uint8[size];
+      slot.staging_ptr = nullptr;
+    }
+  }
+  if (on_device) {
+#if defined(CUDA_FOUND)
+    // Not ordered with the legacy default stream, which the kernels are
+    cudaStream_t stream;
+    check_cuda_errors(
+        cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+    copy_stream = (void *)stream;
+#endif
+  }
+}
+
+InputChannel::~InputChannel() {
+  if (on_device) {
+#if defined(CUDA_FOUND)
+    // Copies and kernels may still use the buffers
+    cudaDeviceSynchronize();
+    for (auto &slot : slots) {
+      cudaFree(slot.device_ptr);
+      cudaFreeHost(slot.staging_ptr);
+      cudaEventDestroy((cudaEvent_t)slot.copied);
+      cudaEventDestroy((cudaEvent_t)slot.released);
+    }
+    cudaStreamDestroy((cudaStream_t)copy_stream);
+#endif
+  } else {
+    for (auto &slot : slots)
+      delete[](uint8 *) slot.device_ptr;
+  }
+}
+
+void InputChannel::push(void *host_ptr) {
+  TC_ERROR_UNLESS(!pushed,
+                  "The next input has already been pushed, advance() first");
+  auto &slot = slots[1 - current_slot];
+  pushed = true;
+  if (!on_device) {
+    std::memcpy(slot.device_ptr, host_ptr, size);
+    return;
+  }
+#if defined(CUDA_FOUND)
+  Timeline::Guard _("input channel", "copy");
+  auto stream = (cudaStream_t)copy_stream;
+  // The previous copy out of the staging buffer must be done
+  cudaEventSynchronize((cudaEvent_t)slot.copied);
+  std::memcpy(slot.staging_ptr, host_ptr, size);
+  // And so must the kernels reading the device buffer
+  cudaStreamWaitEvent(stream, (cudaEvent_t)slot.released, 0);
+  cudaMemcpyAsync(slot.device_ptr, slot.staging_ptr, size,
+                  cudaMemcpyHostToDevice, stream);
+  cudaEventRecord((cudaEvent_t)slot.copied, stream);
+#endif
+}
+
+void InputChannel::advance() {
+  TC_ERROR_UNLESS(pushed, "No input has been pushed since the last advance()");
+  // The kernels reading the current buffer must be issued before it is
+  // released
+  program.flush_deferred_launches();
+  if (on_device) {
+#if defined(CUDA_FOUND)
+    program.join_overlapped_launches();
+    auto &current = slots[current_slot];
+    auto &next = slots[1 - current_slot];
+    cudaEventRecord((cudaEvent_t)current.released, 0);
+    cudaStreamWaitEvent(0, (cudaEvent_t)next.copied, 0);
+#endif
+  }
+  current_slot = 1 - current_slot;
+  pushed = false;
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,63 @@
+// Streaming inputs to the device while the previous ones are computed on
+#pragma once
+
+#include "tlang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class Program;
+
+// Two device buffers of size bytes, the current one, which kernels read as
+// an external array, and the next one, which push() fills with the input of
+// the next step. On GPUs push() copies through pinned memory on a copy
+// stream of its own, so that the copy overlaps with the kernels reading the
+// current buffer, and only the kernels launched after advance() wait for
+// it. On CPUs the buffers are host memory and push() copies right away.
+class InputChannel {
+ public:
+  InputChannel(Program &program, std::size_t size);
+
+  InputChannel(const InputChannel &) = delete;
+
+  ~InputChannel();
+
+  // Starts copying size bytes from host_ptr into the next buffer. The data
+  // is copied out of host_ptr before returning.
+  void push(void *host_ptr);
+
+  // Makes the next buffer the current one, once the kernels launched so far
+  // are done reading the current one
+  void advance();
+
+  // The current buffer, on the device of the program
+  void *current() const {
+    return slots[current_slot].device_ptr;
+  }
+
+  std::size_t get_size() const {
+    return size;
+  }
+
+ private:
+  struct Slot {
+    void *device_ptr;
+    // Pinned, on GPUs
+    void *staging_ptr;
+    // Of the last copy out of staging_ptr into device_ptr
+    void *copied;
+    // Of the kernels that read device_ptr before it was last made the next
+    // buffer
+    void *released;
+  };
+
+  Program &program;
+  std::size_t size;
+  Slot slots[2];
+  int current_slot;
+  // Whether the next buffer has been pushed to since the last advance()
+  bool pushed;
+  bool on_device;
+  void *copy_stream;
+};
+
+TLANG_NAMESPACE_END
@@ -6,40 +6,199 @@
 #pragma once
 
 #include <taichi/common/interface.h>
+#include <taichi/common/serialization.h>
+#include <taichi/system/virtual_memory.h>
+#include <xxhash.h>
 #include <cstdio>
+#include <memory>
+#include <type_traits>
 
 TC_NAMESPACE_BEGIN
 
+// Raw binary files of trivially copyable values, e.g.
+//   BinaryFileStreamOutput out("data.bin");
+//   out << n;
+//   out.write(buffer, n);
+// Both streams buffer small values in a large buffer of their own; reads and
+// writes larger than the buffer go straight between the file and the data.
+// begin_checksum() starts a running XXH64 of the bytes that pass through a
+// stream, e.g. to check that a checkpoint was not truncated or corrupted:
+//   out.begin_checksum();
+//   out.serialize(scene);
+//   out << out.checksum();
+constexpr std::size_t binary_stream_buffer_size = 1 << 22;
+
+class StreamChecksum {
+ private:
+  XXH64_state_t *state = nullptr;
+
+ public:
+  StreamChecksum() = default;
+
+  StreamChecksum(const StreamChecksum &) = delete;
+
+  void reset() {
+    if (!state)
+      state = XXH64_createState();
+    XXH64_reset(state, 0);
+  }
+
+  void update(const void *data, std::size_t size) {
+    if (state)
+      XXH64_update(state, data, size);
+  }
+
+  uint64 digest() const {
+    TC_ASSERT_INFO(state, "The checksum was not started");
+    return XXH64_digest(state);
+  }
+
+  ~StreamChecksum() {
+    if (state)
+      XXH64_freeState(state);
+  }
+};
+
 class BinaryFileStreamInput final {
  private:
   FILE *f;
+  std::unique_ptr<char[]> buffer;
+  StreamChecksum hash;
 
  public:
-  BinaryFileStreamInput(const std::string &fn) {
+  BinaryFileStreamInput(const std::string &fn,
+                        std::size_t buffer_size = binary_stream_buffer_size) {
     f = std::fopen(fn.c_str(), "rb");
+    TC_ERROR_UNLESS(f != nullptr, "Cannot open {} for reading", fn);
+    buffer.reset(new char[buffer_size]);
+    std::setvbuf(f, buffer.get(), _IOFBF, buffer_size);
+  }
+
+  BinaryFileStreamInput(const BinaryFileStreamInput &) = delete;
+
+  void read(void *data, std::size_t size) {
+    auto ret = std::fread(data, 1, size, f);
+    TC_ASSERT_INFO(ret == size, "Unexpected end of file");
+    hash.update(data, size);
   }
 
+  void begin_checksum() {
+    hash.reset();
+  }
+
+  uint64 checksum() const {
+    return hash.digest();
+  }
+
+  // A value written with BinaryFileStreamOutput::serialize
   template <typename T>
-  BinaryFileStreamInput operator>>(const T &t) {
+  void deserialize(T &t) {
+    std::size_t size;
+    read(&size, sizeof(size));
+    std::vector<uint8> data(size);
+    std::memcpy(&data[0], &size, sizeof(size));
+    read(&data[sizeof(size)], size - sizeof(size));
+    BinaryInputSerializer reader;
+    reader.initialize(&data[0]);
+    reader(t);
+    reader.finalize();
   }
 
-  BinaryFileStreamInput() {
-    std::fclose(f);
+  template <typename T>
+  BinaryFileStreamInput &operator>>(T &t) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable values can be read");
+    read(&t, sizeof(T));
+    return *this;
+  }
+
+  void close() {
+    if (f)
+      std::fclose(f);
+    f = nullptr;
+  }
+
+  ~BinaryFileStreamInput() {
+    close();
   }
 };
 
 class BinaryFileStreamOutput final {
  private:
   FILE *f;
+  std::unique_ptr<char[]> buffer;
+  StreamChecksum hash;
 
  public:
-  BinaryFileStreamOutput(const std::string &fn) {
+  BinaryFileStreamOutput(const std::string &fn,
+                         std::size_t buffer_size = binary_stream_buffer_size) {
     f = std::fopen(fn.c_str(), "wb");
+    TC_ERROR_UNLESS(f != nullptr, "Cannot open {} for writing", fn);
+    buffer.reset(new char[buffer_size]);
+    std::setvbuf(f, buffer.get(), _IOFBF, buffer_size);
+  }
+
+  BinaryFileStreamOutput(const BinaryFileStreamOutput &) = delete;
+
+  void write(const void *data, std::size_t size) {
+    auto ret = std::fwrite(data, 1, size, f);
+    TC_ASSERT_INFO(ret == size, "Failed to write to file");
+    hash.update(data, size);
+  }
+
+  void begin_checksum() {
+    hash.reset();
+  }
+
+  uint64 checksum() const {
+    return hash.digest();
   }
 
-  BinaryFileStreamOutput() {
-    std::fclose(f);
+  // Any value with TC_IO_DEF, in the format of write_to_binary_file
+  template <typename T>
+  void serialize(const T &t) {
+    BinaryOutputSerializer writer;
+    writer.initialize();
+    writer(t);
+    writer.finalize();
+    write(&writer.data[0], writer.head);
+  }
+
+  void flush() {
+    std::fflush(f);
+  }
+
+  void close() {
+    if (f) {
+      auto ret = std::fclose(f);
+      TC_ERROR_UNLESS(ret == 0, "Failed to write to file");
+    }
+    f = nullptr;
+  }
+
+  template <typename T>
+  BinaryFileStreamOutput &operator<<(const T &t) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable values can be written");
+    write(&t, sizeof(T));
+    return *this;
+  }
+
+  ~BinaryFileStreamOutput() {
+    if (f)
+      std::fclose(f);
   }
 };
 
-TC_NAMESPACE_END
\ No newline at end of file
+// Like read_from_binary_file, but the values are copied straight from the
+// mapped file (uncompressed .tcb files only)
+template <typename T>
+void read_from_mapped_binary_file(T &t, const std::string &file_name) {
+  MappedFile file(file_name);
+  BinaryInputSerializer reader;
+  reader.initialize(file.ptr);
+  reader(t);
+  reader.finalize();
+}
+
+TC_NAMESPACE_END
@@ -0,0 +1,210 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#include "image_loader.h"
+#include <taichi/system/threading.h>
+
+#if !defined(TC_AMALGAMATED)
+#define TC_IMAGE_IO
+#endif
+
+#if defined(TC_IMAGE_IO)
+#include <stb_image.h>
+#endif
+
+TC_NAMESPACE_BEGIN
+
+namespace {
+
+void loader_parallel_for(int n, const std::function<void(int)> &body) {
+  static ThreadPool pool;
+  if (n <= 0)
+    return;
+  pool.run(n, pool.max_num_threads,
+           const_cast<std::function<void(int)> *>(&body),
+           [](void *body, int i) {
+             (*(std::function<void(int)> *)body)(i);
+           });
+}
+
+std::string failure_reason() {
+#if defined(TC_IMAGE_IO)
+  // Shared by all threads in stb_image, so possibly that of another file
+  return stbi_failure_reason();
+#else
+  return "";
+#endif
+}
+
+// Reports the first file that failed after the parallel region, since the
+// workers of the pool cannot raise errors themselves
+struct DecodeErrors {
+  std::mutex mutex;
+  std::string filename;
+  std::string reason;
+
+  void add(const std::string &fn, const std::string &why) {
+    std::lock_guard<std::mutex> _(mutex);
+    if (filename.empty()) {
+      filename = fn;
+      reason = why;
+    }
+  }
+
+  void check() {
+    TC_ERROR_UNLESS(filename.empty(), "Cannot load image {}: {}", filename,
+                    reason);
+  }
+};
+
+}  // namespace
+
+std::shared_ptr<const DecodedImage> ImageLoader::decode(
+    const std::string &filename,
+    int channels) {
+#if defined(TC_IMAGE_IO)
+  TC_ASSERT(0 <= channels && channels <= 4);
+  auto image = std::make_shared<DecodedImage>();
+  int file_channels;
+  // stbi_load keeps no state but the failure reason, so it runs on all
+  // threads at once
+  auto data = stbi_load(filename.c_str(), &image->width, &image->height,
+                        &file_channels, channels);
+  if (data == nullptr)
+    return nullptr;
+  image->channels = channels ? channels : file_channels;
+  image->pixels.assign(
+      data, data + (std::size_t)image->width * image->height * image->channels);
+  stbi_image_free(data);
+  return image;
+#else
+  TC_NOT_IMPLEMENTED
+  return nullptr;
+#endif
+}
+
+std::shared_ptr<const DecodedImage> ImageLoader::lookup(const Key &key) {
+  std::lock_guard<std::mutex> _(mutex);
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    num_misses++;
+    return nullptr;
+  }
+  num_hits++;
+  recency.splice(recency.begin(), recency, it->second.position);
+  return it->second.image;
+}
+
+void ImageLoader::insert(const Key &key,
+                         std::shared_ptr<const DecodedImage> image) {
+  std::lock_guard<std::mutex> _(mutex);
+  if (image->pixels.size() > cache_size || entries.count(key))
+    return;
+  recency.push_front(key);
+  entries[key] = Entry{image, recency.begin()};
+  cache_bytes += image->pixels.size();
+  while (cache_bytes > cache_size) {
+    auto &evicted = entries[recency.back()];
+    cache_bytes -= evicted.image->pixels.size();
+    entries.erase(recency.back());
+    recency.pop_back();
+  }
+}
+
+std::shared_ptr<const DecodedImage> ImageLoader::get(
+    const std::string &filename,
+    int channels) {
+  Key key(filename, channels);
+  if (auto image = lookup(key))
+    return image;
+  auto image = decode(filename, channels);
+  TC_ERROR_UNLESS(image != nullptr, "Cannot load image {}: {}", filename,
+                  failure_reason());
+  insert(key, image);
+  return image;
+}
+
+void ImageLoader::prefetch(const std::vector<std::string> &filenames,
+                           int channels) {
+  DecodeErrors errors;
+  loader_parallel_for((int)filenames.size(), [&](int i) {
+    Key key(filenames[i], channels);
+    if (lookup(key))
+      return;
+    auto image = decode(filenames[i], channels);
+    if (image == nullptr)
+      errors.add(filenames[i], failure_reason());
+    else
+      insert(key, image);
+  });
+  errors.check();
+}
+
+template <typename T>
+void ImageLoader::load_batch_typed(const std::vector<std::string> &filenames,
+                                   T *out,
+                                   int width,
+                                   int height,
+                                   int channels,
+                                   bool cache) {
+  TC_ASSERT(1 <= channels && channels <= 4);
+  auto slice = (std::size_t)width * height * channels;
+  DecodeErrors errors;
+  loader_parallel_for((int)filenames.size(), [&](int i) {
+    Key key(filenames[i], channels);
+    auto image = cache ? lookup(key) : nullptr;
+    if (image == nullptr) {
+      image = decode(filenames[i], channels);
+      if (image == nullptr) {
+        errors.add(filenames[i], failure_reason());
+        return;
+      }
+      if (cache)
+        insert(key, image);
+    }
+    if (image->width != width || image->height != height) {
+      errors.add(filenames[i],
+                 fmt::format("expected {}x{} pixels, found {}x{}", width,
+                             height, image->width, image->height));
+      return;
+    }
+    auto dest = out + i * slice;
+    auto &pixels = image->pixels;
+    if (std::is_same<T, uint8>::value) {
+      std::memcpy(dest, pixels.data(), slice);
+    } else {
+      for (std::size_t k = 0; k < slice; k++)
+        dest[k] = T(pixels[k] * (1.0f / 255));
+    }
+  });
+  errors.check();
+}
+
+void ImageLoader::load_batch(const std::vector<std::string> &filenames,
+                             uint8 *out,
+                             int width,
+                             int height,
+                             int channels,
+                             bool cache) {
+  load_batch_typed(filenames, out, width, height, channels, cache);
+}
+
+void ImageLoader::load_batch(const std::vector<std::string> &filenames,
+                             float32 *out,
+                             int width,
+                             int height,
+                             int channels,
+                             bool cache) {
+  load_batch_typed(filenames, out, width, height, channels, cache);
+}
+
+void ImageLoader::clear() {
+  std::lock_guard<std::mutex> _(mutex);
+  entries.clear();
+  recency.clear();
+  cache_bytes = 0;
+}
+
+TC_NAMESPACE_END
@@ -0,0 +1,112 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <taichi/common/util.h>
+
+TC_NAMESPACE_BEGIN
+
+// An 8-bit image as stored in its file: rows from top to bottom, with the
+// channels of each pixel interleaved
+struct DecodedImage {
+  int width, height, channels;
+  std::vector<uint8> pixels;
+};
+
+// Decodes image files (the formats of stb_image: PNG, JPEG, BMP, TGA, ...)
+// on the threads of a pool, and keeps up to cache_size bytes of decoded
+// images, evicting the least recently used ones. channels (1 to 4) converts
+// the images to that many channels, and 0 keeps those of the file;
+// conversions are cached separately.
+class ImageLoader {
+ public:
+  explicit ImageLoader(std::size_t cache_size = std::size_t(256) << 20)
+      : cache_size(cache_size), cache_bytes(0), num_hits(0), num_misses(0) {
+  }
+
+  // Decodes on demand, unless cached
+  std::shared_ptr<const DecodedImage> get(const std::string &filename,
+                                          int channels = 0);
+
+  // Decodes the images not cached yet, in parallel
+  void prefetch(const std::vector<std::string> &filenames, int channels = 0);
+
+  // Decodes images of width x height into consecutive height x width x
+  // channels slices of out, in parallel, and as values in [0, 1] for
+  // float32. With cache, the decoded images are also kept in the cache, and
+  // cached ones are not decoded again.
+  void load_batch(const std::vector<std::string> &filenames,
+                  uint8 *out,
+                  int width,
+                  int height,
+                  int channels,
+                  bool cache = true);
+
+  void load_batch(const std::vector<std::string> &filenames,
+                  float32 *out,
+                  int width,
+                  int height,
+                  int channels,
+                  bool cache = true);
+
+  std::size_t get_cache_bytes() const {
+    return cache_bytes;
+  }
+
+  int64 get_num_hits() const {
+    return num_hits;
+  }
+
+  int64 get_num_misses() const {
+    return num_misses;
+  }
+
+  void clear();
+
+ private:
+  using Key = std::pair<std::string, int>;
+
+  struct KeyHash {
+    std::size_t operator()(const Key &key) const {
+      return std::hash<std::string>()(key.first) * 31 + key.second;
+    }
+  };
+
+  struct Entry {
+    std::shared_ptr<const DecodedImage> image;
+    std::list<Key>::iterator position;
+  };
+
+  template <typename T>
+  void load_batch_typed(const std::vector<std::string> &filenames,
+                        T *out,
+                        int width,
+                        int height,
+                        int channels,
+                        bool cache);
+
+  // Null if the file cannot be decoded
+  static std::shared_ptr<const DecodedImage> decode(
+      const std::string &filename,
+      int channels);
+
+  std::shared_ptr<const DecodedImage> lookup(const Key &key);
+  void insert(const Key &key, std::shared_ptr<const DecodedImage> image);
+
+  std::size_t cache_size;
+  std::size_t cache_bytes;
+  int64 num_hits, num_misses;
+  std::mutex mutex;
+  // From the most to the least recently used
+  std::list<Key> recency;
+  std::unordered_map<Key, Entry, KeyHash> entries;
+};
+
+TC_NAMESPACE_END
@@ -5,9 +5,52 @@
 
 #include <taichi/io/ply_writer.h>
 #include <taichi/io/io.h>
+#include <taichi/io/binary_stream.h>
+#include <taichi/system/threading.h>
 
 TC_NAMESPACE_BEGIN
 
+void write_binary_ply(const std::string &fn,
+                      int64 n,
+                      const std::vector<PLYProperty> &properties) {
+  static ThreadPool pool;
+  constexpr int64 chunk_size = 1 << 16;
+  std::string header = fmt::format(
+      "ply\nformat binary_little_endian 1.0\nelement vertex {}\n", n);
+  for (auto &p : properties)
+    header += fmt::format("property float {}\n", p.name);
+  header += "end_header\n";
+
+  // The byte order of the host, little-endian on all supported platforms
+  int num_properties = (int)properties.size();
+  std::vector<float32> vertices(n * num_properties);
+  struct Context {
+    int64 n;
+    const std::vector<PLYProperty> *properties;
+    float32 *vertices;
+  } context{n, &properties, vertices.data()};
+  int num_chunks = (int)((n + chunk_size - 1) / chunk_size);
+  if (num_chunks > 0) {
+    pool.run(num_chunks, pool.max_num_threads, &context,
+             [](void *context_, int c) {
+               auto &ctx = *(Context *)context_;
+               auto &properties = *ctx.properties;
+               int num_properties = (int)properties.size();
+               auto end = std::min((c + 1) * chunk_size, ctx.n);
+               for (int64 i = c * chunk_size; i < end; i++) {
+                 auto vertex = ctx.vertices + i * num_properties;
+                 for (int k = 0; k < num_properties; k++)
+                   vertex[k] = properties[k].data[i * properties[k].stride];
+               }
+             });
+  }
+
+  BinaryFileStreamOutput out(fn);
+  out.write(header.data(), header.size());
+  out.write(vertices.data(), vertices.size() * sizeof(float32));
+  out.close();
+}
+
 class TestPLY : public Task {
   std::string run() override {
     PLYWriter ply("/tmp/test.ply");
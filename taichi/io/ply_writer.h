@@ -2,10 +2,29 @@
     Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
     The use of this software is governed by the LICENSE file.
 *******************************************************************************/
+
+#pragma once
+
 #include <taichi/util.h>
 
 TC_NAMESPACE_BEGIN
 
+// A float property of the vertices of a point cloud, stored with stride
+// floats between vertices, e.g. x, y and z of packed positions are
+// {"x", pos, 3}, {"y", pos + 1, 3} and {"z", pos + 2, 3}
+struct PLYProperty {
+  std::string name;
+  const float32 *data;
+  int stride;
+};
+
+// Writes n vertices with the properties as a binary little-endian PLY file.
+// The vertices are interleaved in chunks in parallel and written at once,
+// so that large particle clouds take about as long as the disk does.
+void write_binary_ply(const std::string &fn,
+                      int64 n,
+                      const std::vector<PLYProperty> &properties);
+
 class PLYWriter {
  public:
   FILE *file;
@@ -2,6 +2,7 @@
 // Intermediate representations
 
 #include "ir.h"
+#include <mutex>
 #include <thread>
 #include <numeric>
 #include "tlang.h"
@@ -33,6 +34,10 @@ std::string Stmt::type() {
 
 void IRBuilder::insert(std::unique_ptr<Stmt> &&stmt, int location) {
   TC_ASSERT(!stack.empty());
+  if (stmt->source_line == 0) {
+    stmt->source_file = source_file;
+    stmt->source_line = source_line;
+  }
   stack.back()->insert(std::move(stmt), location);
 }
 
@@ -185,6 +190,12 @@ void Expr::operator/=(const Expr &o) {
   (*this) = (*this) / load_if_ptr(o);
 }
 
+// Threads of parallel CPU loops without ti.parallelize
+static int default_cpu_parallelism() {
+  int n = get_current_program().config.cpu_max_num_threads;
+  return n > 0 ? n : (int)std::thread::hardware_concurrency();
+}
+
 FrontendForStmt::FrontendForStmt(const Expr &loop_var,
                                  const Expr &begin,
                                  const Expr &end)
@@ -193,6 +204,7 @@ FrontendForStmt::FrontendForStmt(const Expr &loop_var,
   parallelize = dec.parallelize;
   strictly_serialized = dec.strictly_serialized;
   block_dim = dec.block_dim;
+  schedule = dec.schedule;
   if (get_current_program().config.arch == Arch::gpu) {
     vectorize = 1;
     parallelize = 1;
@@ -200,7 +212,7 @@ FrontendForStmt::FrontendForStmt(const Expr &loop_var,
     if (block_dim == 0)
       block_dim = 128;  // default cpu block dim
     if (parallelize == 0)
-      parallelize = std::thread::hardware_concurrency();
+      parallelize = default_cpu_parallelism();
   }
   scratch_opt = dec.scratch_opt;
   dec.reset();
@@ -217,6 +229,7 @@ FrontendForStmt::FrontendForStmt(const ExprGroup &loop_var,
   parallelize = dec.parallelize;
   strictly_serialized = dec.strictly_serialized;
   block_dim = dec.block_dim;
+  schedule = dec.schedule;
   if (get_current_program().config.arch == Arch::gpu) {
     vectorize = 1;
     parallelize = 1;
@@ -226,7 +239,7 @@ FrontendForStmt::FrontendForStmt(const ExprGroup &loop_var,
     if (block_dim == 0)
       block_dim = 128;  // default cpu block dim
     if (parallelize == 0)
-      parallelize = std::thread::hardware_concurrency();
+      parallelize = default_cpu_parallelism();
   }
   scratch_opt = dec.scratch_opt;
   dec.reset();
@@ -266,6 +279,28 @@ std::atomic<int> Stmt::instance_id_counter(0);
 
 std::unique_ptr<FrontendContext> context;
 
+namespace {
+// Kernels may be compiled on another thread
+std::mutex source_files_mutex;
+std::vector<std::string> source_files;
+}  // namespace
+
+int register_source_file(const std::string &filename) {
+  std::lock_guard<std::mutex> _(source_files_mutex);
+  for (int i = 0; i < (int)source_files.size(); i++) {
+    if (source_files[i] == filename)
+      return i;
+  }
+  source_files.push_back(filename);
+  return (int)source_files.size() - 1;
+}
+
+std::string get_source_file(int id) {
+  std::lock_guard<std::mutex> _(source_files_mutex);
+  TC_ASSERT(0 <= id && id < (int)source_files.size());
+  return source_files[id];
+}
+
 void *Expr::evaluate_addr(int i, int j, int k, int l) {
   auto snode = this->cast<GlobalVariableExpression>()->snode;
   get_current_program().synchronize();
@@ -351,6 +386,7 @@ Stmt *Stmt::insert_before_me(std::unique_ptr<Stmt> &&new_stmt) {
   }
   TC_ASSERT(loc != -1);
   new_stmt->parent = parent;
+  new_stmt->inherit_source_line(this);
   stmts.insert(stmts.begin() + loc, std::move(new_stmt));
   return ret;
 }
@@ -368,6 +404,7 @@ Stmt *Stmt::insert_after_me(std::unique_ptr<Stmt> &&new_stmt) {
   }
   TC_ASSERT(loc != -1);
   new_stmt->parent = parent;
+  new_stmt->inherit_source_line(this);
   stmts.insert(stmts.begin() + loc + 1, std::move(new_stmt));
   return ret;
 }
@@ -523,13 +560,50 @@ Stmt *IRBuilder::get_last_stmt() {
 OffloadedStmt::OffloadedStmt(taichi::Tlang::OffloadedStmt::TaskType task_type)
     : task_type(task_type) {
   num_cpu_threads = 1;
+  vectorize = 1;
   begin = end = step = 0;
+  const_begin = const_end = true;
+  begin_offset = end_offset = 0;
   block_dim = 0;
+  schedule = CPUSchedule::dynamic;
+  concurrent_with_next = false;
   reversed = false;
+  scratch_pad_size = 0;
   device = get_current_program().config.arch;
-  if (task_type != TaskType::listgen) {
+  if (task_type != TaskType::listgen && task_type != TaskType::gc &&
+      task_type != TaskType::zero_fill &&
+      task_type != TaskType::deactivate_all &&
+      task_type != TaskType::defragment &&
+      task_type != TaskType::deactivate_ambient) {
     body = std::make_unique<Block>();
   }
 }
 
+std::string OffloadedStmt::task_type_name(TaskType task_type) {
+  switch (task_type) {
+    case serial:
+      return "serial";
+    case range_for:
+      return "range_for";
+    case struct_for:
+      return "struct_for";
+    case clear_list:
+      return "clear_list";
+    case listgen:
+      return "listgen";
+    case gc:
+      return "gc";
+    case zero_fill:
+      return "zero_fill";
+    case deactivate_all:
+      return "deactivate_all";
+    case defragment:
+      return "defragment";
+    case deactivate_ambient:
+      return "deactivate_ambient";
+  }
+  TC_NOT_IMPLEMENTED;
+  return "";
+}
+
 TLANG_NAMESPACE_END
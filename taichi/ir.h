@@ -3,9 +3,11 @@
 #pragma once
 
 #include <atomic>
+#include <set>
 #include <taichi/util.h>
 #include <taichi/common/bit.h>
 #include "tlang_util.h"
+#include "ir_arena.h"
 #include "snode.h"
 #include "expr.h"
 
@@ -74,6 +76,17 @@ class ScratchPads;
 #include "inc/statements.inc.h"
 #undef PER_STATEMENT
 
+// What the offloaded tasks of a kernel read and write: SNode ids, and keys of
+// state outside of the SNode tree, see analysis::gather_accesses
+struct KernelAccesses {
+  std::set<int> reads, writes;
+  // Set when the accesses could not all be attributed, or are unknown since
+  // the kernel was not lowered in this process
+  bool unknown = true;
+
+  bool conflicts_with(const KernelAccesses &o) const;
+};
+
 // IR passes
 namespace irpass {
 
@@ -82,7 +95,7 @@ void flag_access(IRNode *root);
 void die(IRNode *root);
 void simplify(IRNode *root);
 void full_simplify(IRNode *root);
-void print(IRNode *root);
+void print(IRNode *root, std::string *output = nullptr);
 void lower(IRNode *root);
 void typecheck(IRNode *root);
 void loop_vectorize(IRNode *root);
@@ -90,25 +103,63 @@ void slp_vectorize(IRNode *root);
 void vector_split(IRNode *root, int max_width, bool serial_schedule);
 void replace_all_usages_with(IRNode *root, Stmt *old_stmt, Stmt *new_stmt);
 void lower_access(IRNode *root, bool lower_atomic);
-void make_adjoint(IRNode *root);
+// With keep_primal, the adjoint kernel also performs the global stores of the
+// primal one
+void make_adjoint(IRNode *root, bool keep_primal = false);
 void constant_fold(IRNode *root);
-void offload(IRNode *root);
+// Returns the bytes of the temporary arena the offloaded tasks use
+std::size_t offload(IRNode *root);
 void fix_block_parents(IRNode *root);
 void replace_statements_with(IRNode *root,
                              std::function<bool(Stmt *)> filter,
                              std::function<std::unique_ptr<Stmt>()> generator);
 void demote_atomics(IRNode *root);
 void reverse_offloads(IRNode *root);
+void mark_concurrent_tasks(IRNode *root);
+void fuse_struct_fors(IRNode *root);
+// Splits the top-level struct-fors estimated to keep more than
+// max_live_values values live, see CompileConfig::gpu_fission_live_values
+void fission_struct_fors(IRNode *root, int max_live_values);
 std::unique_ptr<ScratchPads> initialize_scratch_pad(StructForStmt *root);
+void insert_scratch_pads(IRNode *root);
+void reduce_strength(IRNode *root);
+void forward_global_accesses(IRNode *root);
+// Expands the MatmulStmts not left to the tensor cores
+void scalarize(IRNode *root);
+// Inserts a BoundCheckStmt before each access of a field with indices not
+// known to be within its shape (CompileConfig::check_out_of_bound)
+void check_out_of_bound(IRNode *root);
 }  // namespace irpass
 
 // Analysis
 namespace analysis {
 DiffRange value_diff(Stmt *stmt, int lane, Stmt *alloca);
+std::string structural_hash(IRNode *root);
+int count_statements(IRNode *root);
+// Assumes every iteration accesses one cell of each field and external array
+// the task refers to
+TaskTraffic estimate_task_traffic(OffloadedStmt *stmt);
+// Whether root prints, asserts or checks bounds, which compiles to ids of
+// messages registered with the current program
+bool has_program_messages(IRNode *root);
+// The accesses of the offloaded tasks in root. Unknown with persistent
+// threads, whose chained tasks wait on one another inside a launch, unless
+// what matters is only what a launch of root touches (within_launch).
+KernelAccesses gather_accesses(IRNode *root, bool within_launch = false);
+// Whether root is a single range-for with constant bounds that the host can
+// run part of, see CompileConfig::cpu_gpu_split
+bool is_splittable_range_for(IRNode *root);
+// The stores of a loop task that may bypass the caches on CPUs, see
+// CompileConfig::cpu_streaming_stores
+std::set<Stmt *> gather_streaming_stores(OffloadedStmt *stmt);
 }
 
 IRBuilder &current_ast_builder();
 
+// Ids of the Python source files that statements refer to (Stmt::source_file)
+int register_source_file(const std::string &filename);
+std::string get_source_file(int id);
+
 struct VectorType {
   int width;
   DataType data_type;
@@ -144,6 +195,7 @@ class DecoratorRecorder {
   bool strictly_serialized;
   ScratchPadOptions scratch_opt;
   int block_dim;
+  CPUSchedule schedule;
   bool uniform;
 
   DecoratorRecorder() {
@@ -156,6 +208,7 @@ class DecoratorRecorder {
     uniform = false;
     scratch_opt.clear();
     block_dim = 0;
+    schedule = CPUSchedule::dynamic;
     strictly_serialized = false;
   }
 };
@@ -186,6 +239,10 @@ class IRBuilder {
   std::vector<Block *> stack;
 
  public:
+  // Of the statements inserted from now on, set by the Python frontend
+  int source_file = -1;
+  int source_line = 0;
+
   IRBuilder(Block *initial) {
     stack.push_back(initial);
   }
@@ -337,6 +394,15 @@ class IRNode {
     TC_NOT_IMPLEMENTED
   }
   virtual ~IRNode() = default;
+
+  // From the IR arena of the kernel being built or compiled, see IRArena
+  static void *operator new(std::size_t size) {
+    return ir_allocate(size);
+  }
+
+  static void operator delete(void *p) {
+    ir_free(p);
+  }
 };
 
 #define DEFINE_ACCEPT                        \
@@ -464,7 +530,7 @@ struct LaneAttribute {
 class Stmt : public IRNode {
  protected:  // NOTE: operands should not be directly modified, for the
              // correctness of operand_bitmap
-  std::vector<Stmt **> operands;
+  std::vector<Stmt **, IRAllocator<Stmt **>> operands;
 
  public:
   static std::atomic<int> instance_id_counter;
@@ -474,6 +540,10 @@ class Stmt : public IRNode {
   uint64 operand_bitmap;
   bool erased;
   std::string tb;
+  // Where the statement comes from in the Python source, see
+  // register_source_file. 0 if unknown.
+  int source_file;
+  int source_line;
   Stmt *adjoint;
   llvm::Value *value;
   bool is_ptr;
@@ -489,6 +559,16 @@ class Stmt : public IRNode {
     operand_bitmap = 0;
     erased = false;
     is_ptr = false;
+    source_file = -1;
+    source_line = 0;
+  }
+
+  // Statements replacing or implementing this one take its source line
+  void inherit_source_line(const Stmt *stmt) {
+    if (source_line == 0) {
+      source_file = stmt->source_file;
+      source_line = stmt->source_line;
+    }
   }
 
   static uint64 operand_hash(Stmt *stmt) {
@@ -994,9 +1074,13 @@ class AtomicOpStmt : public Stmt {
  public:
   AtomicOpType op_type;
   Stmt *dest, *val;
+  // Every thread of the task updates the same address and ignores the result,
+  // so the backend may combine the values before a single atomic
+  bool is_reduction;
 
   AtomicOpStmt(AtomicOpType op_type, Stmt *dest, Stmt *val)
       : op_type(op_type), dest(dest), val(val) {
+    is_reduction = false;
     add_operand(this->dest);
     add_operand(this->val);
   }
@@ -1161,6 +1245,7 @@ class GlobalVariableExpression : public Expression {
   TypedConstant ambient_value;
   bool is_primal;
   Expr adjoint;
+  QuantizedType quant;
 
   GlobalVariableExpression(DataType dt, Ident ident) : ident(ident), dt(dt) {
     snode = nullptr;
@@ -1315,6 +1400,7 @@ class Block : public IRNode {
     }
     TC_ASSERT(location != -1);
     for (int i = (int)new_statements.size() - 1; i >= 0; i--) {
+      new_statements[i]->inherit_source_line(old_statement);
       insert(std::move(new_statements[i]), location);
     }
   }
@@ -1332,6 +1418,8 @@ class Block : public IRNode {
     TC_ASSERT(location != -1);
     if (replace_usages)
       old_statement->replace_with(new_statements.back().get());
+    for (int i = 0; i < (int)new_statements.size(); i++)
+      new_statements[i]->inherit_source_line(old_statement);
     trash_bin.push_back(std::move(statements[location]));
     statements.erase(statements.begin() + location);
     for (int i = (int)new_statements.size() - 1; i >= 0; i--) {
@@ -1427,6 +1515,29 @@ class AssertStmt : public Stmt {
   DEFINE_ACCEPT
 };
 
+// Reports the access with the given indices as out of bound unless in_bound
+// holds, see irpass::check_out_of_bound. Unlike AssertStmt, the kernel goes
+// on, and the error is raised on the next synchronization.
+class BoundCheckStmt : public Stmt {
+ public:
+  Stmt *in_bound;
+  // Of Program::bound_checks
+  int check_id;
+  std::vector<Stmt *> indices;
+
+  BoundCheckStmt(Stmt *in_bound,
+                 int check_id,
+                 const std::vector<Stmt *> &indices)
+      : in_bound(in_bound), check_id(check_id), indices(indices) {
+    add_operand(this->in_bound);
+    for (int i = 0; i < (int)indices.size(); i++) {
+      add_operand(this->indices[i]);
+    }
+  }
+
+  DEFINE_ACCEPT
+};
+
 class RangeAssumptionStmt : public Stmt {
  public:
   Stmt *input;
@@ -1560,6 +1671,7 @@ class IfStmt : public Stmt {
   std::unique_ptr<Block> true_statements, false_statements;
 
   IfStmt(Stmt *cond) : cond(cond) {
+    true_mask = false_mask = nullptr;
     add_operand(this->cond);
   }
 
@@ -1681,6 +1793,7 @@ class FrontendForStmt : public Stmt {
   bool strictly_serialized;
   ScratchPadOptions scratch_opt;
   int block_dim;
+  CPUSchedule schedule;
 
   bool is_ranged() const {
     if (global_var.expr == nullptr) {
@@ -1712,6 +1825,7 @@ class RangeForStmt : public Stmt {
   int parallelize;
   bool strictly_serialized;
   int block_dim;
+  CPUSchedule schedule;
 
   RangeForStmt(Stmt *loop_var,
                Stmt *begin,
@@ -1732,6 +1846,7 @@ class RangeForStmt : public Stmt {
     add_operand(this->begin);
     add_operand(this->end);
     block_dim = 0;
+    schedule = CPUSchedule::dynamic;
   }
 
   bool is_container_statement() const override {
@@ -1751,12 +1866,16 @@ class StructForStmt : public Stmt {
   std::vector<Stmt *> loop_vars;
   SNode *snode;
   std::unique_ptr<Block> body;
+  // Run by every thread of a GPU thread block before and after the
+  // iterations over a leaf block, see irpass::insert_scratch_pads
   std::unique_ptr<Block> block_initialization;
   std::unique_ptr<Block> block_finalization;
   int vectorize;
   int parallelize;
   int block_dim;
   ScratchPadOptions scratch_opt;
+  // Bytes of shared memory used by the scratch pads
+  std::size_t scratch_pad_size;
 
   StructForStmt(std::vector<Stmt *> loop_vars,
                 SNode *snode,
@@ -1772,6 +1891,7 @@ class StructForStmt : public Stmt {
       add_operand(v);
     }
     block_dim = 0;
+    scratch_pad_size = 0;
   }
 
   bool is_container_statement() const override {
@@ -1901,19 +2021,32 @@ class IdExpression : public Expression {
 class SNodeOpExpression : public Expression {
  public:
   SNode *snode;
+  SNodeOpType op_type;
   ExprGroup indices;
   Expr value;
 
   SNodeOpExpression(SNode *snode, const ExprGroup &indices)
-      : snode(snode), indices(indices) {
+      : snode(snode), op_type(SNodeOpType::probe), indices(indices) {
   }
 
   SNodeOpExpression(SNode *snode, const ExprGroup &indices, const Expr &value)
-      : snode(snode), indices(indices), value(value) {
+      : snode(snode),
+        op_type(SNodeOpType::append),
+        indices(indices),
+        value(value) {
+  }
+
+  SNodeOpExpression(SNode *snode,
+                    SNodeOpType op_type,
+                    const ExprGroup &indices)
+      : snode(snode), op_type(op_type), indices(indices) {
   }
 
   std::string serialize() override {
-    if (value.expr) {
+    if (op_type == SNodeOpType::is_active) {
+      return fmt::format("is_active({}, [{}])", snode->node_type_name,
+                         indices.serialize());
+    } else if (value.expr) {
       return fmt::format("append({}, [{}], {})", snode->node_type_name,
                          indices.serialize(), value.serialize());
     } else {
@@ -1928,6 +2061,16 @@ class SNodeOpExpression : public Expression {
       indices[i]->flatten(ret);
       indices_stmt.push_back(indices[i]->stmt);
     }
+    if (op_type == SNodeOpType::is_active) {
+      // The snode itself, held by the cell of its parent
+      TC_ERROR_IF(snode->type != SNodeType::pointer &&
+                      snode->type != SNodeType::dense,
+                  "ti.is_active only works on pointer and dense nodes.");
+      auto ptr = ret.push_back<GlobalPtrStmt>(snode, indices_stmt);
+      ret.push_back<SNodeOpStmt>(SNodeOpType::is_active, snode, ptr, nullptr);
+      stmt = ret.back().get();
+      return;
+    }
     auto ptr = ret.push_back<GlobalPtrStmt>(snode->parent, indices_stmt);
     if (value.expr) {
       value->flatten(ret);
@@ -2037,6 +2180,10 @@ inline void Parallelize(int v) {
 #endif
 }
 
+inline void Schedule(const std::string &name) {
+  dec.schedule = cpu_schedule_from_name(name);
+}
+
 inline void StrictlySerialize() {
   dec.strictly_serialized = true;
 }
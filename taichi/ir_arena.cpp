@@ -0,0 +1,59 @@
+#include "ir_arena.h"
+#include <cstdlib>
+#include <new>
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+// Each allocation starts with the arena it comes from, nullptr for the
+// heap, padded to keep the allocation aligned
+constexpr std::size_t header_size = alignof(std::max_align_t);
+}  // namespace
+
+void *IRArena::allocate(std::size_t size) {
+  size = (size + header_size - 1) / header_size * header_size;
+  allocated += size;
+  if (size > max_request) {
+    // The current chunk keeps its free space
+    chunks.emplace_back(new char[size]);
+    return chunks.back().get();
+  }
+  if (head + size > tail) {
+    chunks.emplace_back(new char[chunk_size]);
+    head = chunks.back().get();
+    tail = head + chunk_size;
+  }
+  auto ret = head;
+  head += size;
+  return ret;
+}
+
+IRArena *&IRArena::current() {
+  thread_local IRArena *arena = nullptr;
+  return arena;
+}
+
+void *ir_allocate(std::size_t size) {
+  auto arena = IRArena::current();
+  char *p;
+  if (arena) {
+    p = (char *)arena->allocate(size + header_size);
+  } else {
+    p = (char *)std::malloc(size + header_size);
+    if (!p)
+      throw std::bad_alloc();
+  }
+  *(IRArena **)p = arena;
+  return p + header_size;
+}
+
+void ir_free(void *p) {
+  if (!p)
+    return;
+  auto base = (char *)p - header_size;
+  // Memory from an arena is freed with it
+  if (*(IRArena **)base == nullptr)
+    std::free(base);
+}
+
+TLANG_NAMESPACE_END
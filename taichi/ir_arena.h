@@ -0,0 +1,97 @@
+// Bump allocation for the IR of a kernel
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <taichi/common/util.h>
+#include <taichi/common.h>
+
+TLANG_NAMESPACE_BEGIN
+
+// Holds the statements, blocks and operand lists of a kernel, which are
+// allocated by bumping a pointer instead of one heap allocation each, and
+// freed all at once with the arena. Deleting a node from the arena only runs
+// its destructor, so passes replacing statements do not touch the heap.
+//
+// Allocations go to the arena of the calling thread set by a Guard, or to
+// the heap outside of one. Either kind can be freed anywhere, but nodes from
+// an arena must be destroyed before the arena is.
+class IRArena {
+  static constexpr std::size_t chunk_size = 64 * 1024;
+  // Larger requests take a chunk of their own
+  static constexpr std::size_t max_request = chunk_size / 4;
+
+  std::vector<std::unique_ptr<char[]>> chunks;
+  char *head;
+  char *tail;
+  std::size_t allocated;
+
+ public:
+  IRArena() : head(nullptr), tail(nullptr), allocated(0) {
+  }
+
+  IRArena(const IRArena &) = delete;
+
+  void *allocate(std::size_t size);
+
+  // The bytes allocated from the arena so far
+  std::size_t get_allocated() const {
+    return allocated;
+  }
+
+  static IRArena *&current();
+
+  // Makes the calling thread allocate IR from arena, until the guard goes
+  // out of scope
+  class Guard {
+    IRArena *previous;
+
+   public:
+    Guard(IRArena *arena) : previous(current()) {
+      current() = arena;
+    }
+
+    ~Guard() {
+      current() = previous;
+    }
+  };
+};
+
+// Allocates from IRArena::current() or the heap, see above
+void *ir_allocate(std::size_t size);
+
+void ir_free(void *p);
+
+// Lets standard containers of IR nodes use the arena
+template <typename T>
+struct IRAllocator {
+  using value_type = T;
+
+  IRAllocator() = default;
+
+  template <typename U>
+  IRAllocator(const IRAllocator<U> &) {
+  }
+
+  T *allocate(std::size_t n) {
+    return (T *)ir_allocate(n * sizeof(T));
+  }
+
+  void deallocate(T *p, std::size_t) {
+    ir_free(p);
+  }
+
+  template <typename U>
+  bool operator==(const IRAllocator<U> &) const {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const IRAllocator<U> &) const {
+    return false;
+  }
+};
+
+TLANG_NAMESPACE_END
@@ -1,4 +1,7 @@
+#include <cstring>
 #include <taichi/common/task.h>
+#include <taichi/system/timeline.h>
+#include <taichi/system/virtual_memory.h>
 #include "kernel.h"
 #include "program.h"
 #if defined(CUDA_FOUND)
@@ -10,21 +13,38 @@ TLANG_NAMESPACE_BEGIN
 Kernel::Kernel(Program &program,
                std::function<void()> func,
                std::string name,
-               bool grad)
-    : program(program), name(name), grad(grad) {
+               bool grad,
+               bool keep_primal)
+    : program(program), name(name), grad(grad), keep_primal(keep_primal) {
   program.initialize_device_llvm_context();
   is_reduction = false;
+  temporaries_size = 0;
   compiled = nullptr;
+  is_compiled = false;
+  num_launches = 0;
+  is_optimized = false;
+  runs_optimized = false;
   benchmarking = false;
-  taichi::Tlang::context = std::make_unique<FrontendContext>();
-  ir_holder = taichi::Tlang::context->get_root();
-  ir = ir_holder.get();
+  host_twin = nullptr;
+  is_host_twin = false;
+  splittable = false;
+  num_offloaded_tasks = 0;
+  gpu_max_registers = 0;
+  default_fp = DataType::unknown;
+  accumulation_fp = DataType::unknown;
+  ir_arena = std::make_unique<IRArena>();
+  {
+    IRArena::Guard _(ir_arena.get());
+    taichi::Tlang::context = std::make_unique<FrontendContext>();
+    ir_holder = taichi::Tlang::context->get_root();
+    ir = ir_holder.get();
 
-  program.current_kernel = this;
-  program.start_function_definition(this);
-  func();
-  program.end_function_definition();
-  program.current_kernel = nullptr;
+    program.current_kernel = this;
+    program.start_function_definition(this);
+    func();
+    program.end_function_definition();
+    program.current_kernel = nullptr;
+  }
 
   arch = program.config.arch;
 
@@ -33,50 +53,148 @@ Kernel::Kernel(Program &program,
 }
 
 void Kernel::compile() {
-  program.current_kernel = this;
-  compiled = program.compile(*this);
-  program.current_kernel = nullptr;
+  std::lock_guard<std::mutex> _(compilation_mutex);
+  if (is_compiled)
+    return;
+  std::lock_guard<std::mutex> __(program.compilation_mutex);
+  Timeline::Guard ___(name, "compile");
+  Program::compiling_kernel = this;
+  compiling_program = &program;
+  FunctionType func;
+  {
+    IRArena::Guard ____(ir_arena.get());
+    func = program.compile(*this);
+  }
+  Program::compiling_kernel = nullptr;
+  compiling_program = nullptr;
+  set_compiled(func);
+}
+
+void Kernel::set_compiled(FunctionType func) {
+  compiled = func;
+  // The compiled kernel no longer needs its IR. The nodes are destroyed
+  // before the arena frees their memory in one go.
+  ir = nullptr;
+  ir_holder.reset();
+  ir_arena.reset();
+  is_compiled = true;
+}
+
+void Kernel::reoptimize() {
+  std::lock_guard<std::mutex> _(program.compilation_mutex);
+  compiling_program = &program;
+  optimized = recompile_optimized();
+  compiling_program = nullptr;
+  is_optimized = true;
 }
 
 void Kernel::operator()() {
-  if (!compiled)
+  auto &breakdown = program.launch_breakdown;
+  // Not to be taken by the deferred launches
+  auto marshal_begin = breakdown.take_marshal_begin();
+  // Launches stay in order
+  program.flush_deferred_launches();
+  LaunchBreakdown::Timer timer(breakdown, marshal_begin);
+  Timeline::Guard _(name, "kernel");
+  if (!is_compiled)
     compile();
-  std::vector<void *> host_buffers(args.size());
-  std::vector<void *> device_buffers(args.size());
+  if (recompile_optimized) {
+    if (is_optimized) {
+      compiled = std::move(optimized);
+      recompile_optimized = nullptr;
+      runs_optimized = true;
+    } else if (++num_launches == program.config.tiered_compilation_threshold) {
+      program.reoptimize_async(*this);
+    }
+  }
+  program.context.rand_seed = ((uint64)program.num_kernel_launches++ << 32) |
+                              (uint32)program.config.random_seed;
+  program.reserve_temporaries(temporaries_size);
+  timer.mark(LaunchBreakdown::prepare);
   if (arch == Arch::gpu) {
 #if defined(CUDA_FOUND)
-    // copy data to GRAM
-    bool has_buffer = false;
+    // Stage ext_arr arguments through persistent device buffers. Arrays the
+    // kernel never writes are not copied back.
+    std::vector<void *> host_buffers(args.size());
+    bool has_written_buffer = false;
     for (int i = 0; i < (int)args.size(); i++) {
-      if (args[i].is_nparray) {
-        has_buffer = true;
-        cudaMalloc(&device_buffers[i], args[i].size);
-        // replace host buffer with device buffer
+      if (args[i].is_nparray && !args[i].is_device_ptr) {
         host_buffers[i] = program.context.get_arg<void *>(i);
-        set_arg_nparray(i, (uint64)device_buffers[i], args[i].size);
-        cudaMemcpy(device_buffers[i], host_buffers[i], args[i].size,
-                   cudaMemcpyHostToDevice);
+        auto &buffer =
+            program.get_ext_arr_buffer(host_buffers[i], args[i].size);
+        if (args[i].is_nparray_read || args[i].is_nparray_written) {
+          // The kernel may only write part of the array, so written arrays are
+          // copied in as well.
+          Timeline::Guard _("copy to device", "copy");
+          auto event = (cudaEvent_t)buffer.staging_event;
+          cudaEventSynchronize(event);
+          std::memcpy(buffer.staging_ptr, host_buffers[i], args[i].size);
+          cudaMemcpyAsync(buffer.device_ptr, buffer.staging_ptr, args[i].size,
+                          cudaMemcpyHostToDevice, 0);
+          program.num_nparray_bytes += args[i].size;
+          cudaEventRecord(event, 0);
+        }
+        has_written_buffer |= args[i].is_nparray_written;
+        set_arg_nparray(i, (uint64)buffer.device_ptr, args[i].size);
       }
     }
-    if (has_buffer)
-      cudaDeviceSynchronize();
+    timer.mark(LaunchBreakdown::upload);
     auto c = program.get_context();
+    timer.mark(LaunchBreakdown::context);
+    // The gate of a device loop orders its kernels, whatever they access
+    bool overlap = program.config.overlap_kernels && !c.loop_gate;
+    if (overlap)
+      program.begin_overlapped_launch(*this);
     compiled(c);
-    if (has_buffer)
+    if (overlap)
+      program.end_overlapped_launch(*this);
+    timer.mark(LaunchBreakdown::run);
+    if (has_written_buffer) {
+      for (int i = 0; i < (int)args.size(); i++) {
+        if (args[i].is_nparray && !args[i].is_device_ptr &&
+            args[i].is_nparray_written) {
+          auto &buffer =
+              program.get_ext_arr_buffer(host_buffers[i], args[i].size);
+          cudaMemcpyAsync(buffer.staging_ptr, buffer.device_ptr, args[i].size,
+                          cudaMemcpyDeviceToHost, 0);
+          program.num_nparray_bytes += args[i].size;
+        }
+      }
+      Timeline::Guard _("wait and copy to host", "copy");
       cudaDeviceSynchronize();
-    for (int i = 0; i < (int)args.size(); i++) {
-      if (args[i].is_nparray) {
-        cudaMemcpy(host_buffers[i], device_buffers[i], args[i].size,
-                   cudaMemcpyDeviceToHost);
-        cudaFree(device_buffers[i]);
+      for (int i = 0; i < (int)args.size(); i++) {
+        if (args[i].is_nparray && !args[i].is_device_ptr &&
+            args[i].is_nparray_written) {
+          auto &buffer =
+              program.get_ext_arr_buffer(host_buffers[i], args[i].size);
+          std::memcpy(host_buffers[i], buffer.staging_ptr, args[i].size);
+        }
       }
+      timer.mark(LaunchBreakdown::sync);
     }
 #else
     TC_ERROR("No CUDA");
 #endif
   } else {
     auto &c = program.get_context();
-    compiled(c);
+    timer.mark(LaunchBreakdown::context);
+    auto dispatch_cycles = program.thread_pool.dispatch_cycles;
+    if (program.config.count_page_faults) {
+      auto num_faults = get_num_page_faults();
+      compiled(c);
+      program.num_kernel_page_faults += get_num_page_faults() - num_faults;
+    } else {
+      compiled(c);
+    }
+    if (breakdown.enabled) {
+      breakdown.add_nested(LaunchBreakdown::launch,
+                           program.thread_pool.dispatch_cycles -
+                               dispatch_cycles);
+    }
+    timer.mark(LaunchBreakdown::run);
+    // CPU kernels are done, so their prints show up in order with those of
+    // the host
+    program.drain_debug_records();
   }
   program.sync = false;
 }
@@ -143,6 +261,17 @@ void Kernel::set_arg_nparray(int i, uint64 d, uint64 size) {
   TC_ASSERT_INFO(args[i].is_nparray,
                  "Setting numpy array to scalar argument is not allowed");
   args[i].size = size;
+  args[i].is_device_ptr = false;
+  program.context.set_arg(i, d);
+}
+
+void Kernel::set_arg_devptr(int i, uint64 d, uint64 size) {
+  TC_ASSERT_INFO(args[i].is_nparray,
+                 "Setting device array to scalar argument is not allowed");
+  TC_ERROR_UNLESS(arch == Arch::gpu,
+                  "Device arrays can only be passed to GPU kernels");
+  args[i].size = size;
+  args[i].is_device_ptr = true;
   program.context.set_arg(i, d);
 }
 
@@ -152,6 +281,9 @@ void Kernel::set_arch(Arch arch) {
 }
 
 int Kernel::insert_arg(DataType dt, bool is_nparray) {
+  TC_ERROR_UNLESS((int)args.size() < max_num_args,
+                  "Kernel {} takes more than {} arguments", name,
+                  max_num_args);
   args.push_back(Arg{dt, is_nparray, 0, false});
   return args.size() - 1;
 }
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <mutex>
+#include <set>
 #include "tlang_util.h"
 #include "snode.h"
 #include "ir.h"
+#include "backends/offline_cache.h"
 
 TLANG_NAMESPACE_BEGIN
 
@@ -10,7 +14,10 @@ class Program;
 
 class Kernel {
  public:
+  // Holds the IR, which is freed with it once the kernel is compiled
+  std::unique_ptr<IRArena> ir_arena;
   std::unique_ptr<IRNode> ir_holder;
+  // nullptr after compilation
   IRNode *ir;
   Program &program;
   FunctionType compiled;
@@ -21,6 +28,12 @@ class Kernel {
     bool is_nparray;
     std::size_t size;
     bool is_return_value;
+    // Set by irpass::flag_access
+    bool is_nparray_read;
+    bool is_nparray_written;
+    // The array of this launch is already in device memory, see
+    // set_arg_devptr
+    bool is_device_ptr;
 
     Arg(DataType dt = DataType::unknown,
         bool is_nparray = false,
@@ -29,21 +42,78 @@ class Kernel {
         : dt(dt),
           is_nparray(is_nparray),
           size(size),
-          is_return_value(is_return_value) {
+          is_return_value(is_return_value),
+          is_nparray_read(false),
+          is_nparray_written(false),
+          is_device_ptr(false) {
     }
   };
   std::vector<Arg> args;
+  // The places of the global tensors read or written, set by
+  // irpass::flag_access
+  std::set<SNode *> snodes_read;
+  std::set<SNode *> snodes_written;
   bool benchmarking;
   bool is_reduction;  // TODO: systematically treat all types of reduction
   bool grad;
+  // Adjoint kernels that also run the primal kernel, see irpass::make_adjoint
+  bool keep_primal;
+  // Bytes of the temporary arena (Runtime::temporaries) needed by each launch
+  std::size_t temporaries_size;
+  // Set for GPU kernels, see CompileConfig::overlap_kernels
+  KernelAccesses accesses;
+  // With CompileConfig::cpu_gpu_split: the kernel compiled for the host,
+  // which runs the iterations of the range-for from the argument slot after
+  // the last argument on, while the GPU runs the ones before
+  Kernel *host_twin;
+  bool is_host_twin;
+  // Set by the GPU codegen, see analysis::is_splittable_range_for
+  bool splittable;
+  // The offloaded tasks the LLVM backends lowered the kernel to
+  int num_offloaded_tasks;
+  // Overrides CompileConfig::gpu_max_registers if nonzero
+  int gpu_max_registers;
+  // Overrides CompileConfig::default_fp unless unknown
+  DataType default_fp;
+  // If real, the local accumulators of narrower real values (the targets of
+  // += and -=, and the sums of irpass::demote_atomics) are widened to it
+  DataType accumulation_fp;
+  // Kernels may be compiled by the background compilation thread
+  std::atomic<bool> is_compiled;
+  std::mutex compilation_mutex;
+  // Set by the codegen for tiered compilation
+  // (CompileConfig::tiered_compilation): compiles the kernel again at the
+  // full optimization level
+  std::function<FunctionType()> recompile_optimized;
+  int num_launches;
+  // The result of recompile_optimized, which the next launch switches to
+  FunctionType optimized;
+  std::atomic<bool> is_optimized;
+  // Whether launches run the result of recompile_optimized by now
+  bool runs_optimized;
+  // Set by the LLVM backends with CompileConfig::use_offline_cache
+  std::string offline_cache_key;
+  // Set for kernels of an AotModule, which are loaded from the module instead
+  // of being compiled from their (empty) IR
+  std::shared_ptr<OfflineCache::Entry> aot_entry;
 
   Kernel(Program &program,
          std::function<void()> func,
          std::string name = "",
-         bool grad = false);
+         bool grad = false,
+         bool keep_primal = false);
 
+  // Compiles the kernel unless it is already compiled. Blocks if another
+  // thread is compiling it.
   void compile();
 
+  // Takes the compiled function and frees the IR, with compilation_mutex
+  // held
+  void set_compiled(FunctionType func);
+
+  // Runs recompile_optimized, usually on the compilation thread
+  void reoptimize();
+
   void operator()();
 
   std::function<void()> func() {
@@ -62,6 +132,10 @@ class Kernel {
 
   void set_arg_nparray(int i, uint64 ptr, uint64 size);
 
+  // Passes an array in device memory (e.g. a CUDA torch tensor), which GPU
+  // kernels access in place instead of through a staging buffer
+  void set_arg_devptr(int i, uint64 ptr, uint64 size);
+
   void set_arch(Arch arch);
 };
 
@@ -0,0 +1,68 @@
+#include "launch_breakdown.h"
+
+TLANG_NAMESPACE_BEGIN
+
+LaunchBreakdown::Timer::Timer(LaunchBreakdown &breakdown,
+                              uint64 marshal_begin) {
+  if (!breakdown.enabled) {
+    this->breakdown = nullptr;
+    return;
+  }
+  this->breakdown = &breakdown;
+  last = Time::get_cycles();
+  if (marshal_begin != 0)
+    breakdown.cycles[marshal] += last - marshal_begin;
+  breakdown.nested = 0;
+}
+
+void LaunchBreakdown::Timer::mark(Phase phase) {
+  if (!breakdown)
+    return;
+  auto now = Time::get_cycles();
+  breakdown->cycles[phase] += now - last - breakdown->nested;
+  breakdown->nested = 0;
+  last = now;
+}
+
+LaunchBreakdown::Timer::~Timer() {
+  if (breakdown)
+    breakdown->num_launches++;
+}
+
+const char *LaunchBreakdown::phase_name(int phase) {
+  static const char *names[num_phases] = {
+      "marshal", "prepare", "context", "upload", "launch", "run", "sync"};
+  return names[phase];
+}
+
+std::map<std::string, double> LaunchBreakdown::get() const {
+  std::map<std::string, double> ret;
+  for (int i = 0; i < num_phases; i++) {
+    ret[phase_name(i)] =
+        num_launches ? (double)cycles[i] / num_launches : 0.0;
+  }
+  return ret;
+}
+
+void LaunchBreakdown::print() const {
+  uint64 total = 0;
+  for (int i = 0; i < num_phases; i++)
+    total += cycles[i];
+  printf("Launch breakdown (%lld launches, cycles per launch)\n",
+         (long long)num_launches);
+  for (int i = 0; i < num_phases; i++) {
+    printf("  %-8s %12.0f  %6.2f%%\n", phase_name(i),
+           num_launches ? (double)cycles[i] / num_launches : 0.0,
+           total ? cycles[i] * 100.0 / total : 0.0);
+  }
+}
+
+void LaunchBreakdown::clear() {
+  for (int i = 0; i < num_phases; i++)
+    cycles[i] = 0;
+  num_launches = 0;
+  marshal_begin = 0;
+  nested = 0;
+}
+
+TLANG_NAMESPACE_END
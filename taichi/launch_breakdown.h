@@ -0,0 +1,82 @@
+// Where the time of kernel launches goes (CompileConfig::launch_breakdown)
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <taichi/system/timer.h>
+#include "tlang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+// Cycles (Time::get_cycles) of each phase of Kernel::operator(), summed over
+// the launches
+class LaunchBreakdown {
+ public:
+  enum Phase {
+    // From Program::begin_launch_breakdown, called by the Python launcher
+    // before it sets the arguments
+    marshal,
+    // Compiling on the first launch, seeds, temporaries
+    prepare,
+    // Program::get_context
+    context,
+    // External arrays staged to the device, and the Context
+    upload,
+    // Waking up the thread pool and waiting for it, or cuLaunchKernel
+    launch,
+    // The rest of the compiled function: the tasks themselves on CPUs, host
+    // work of the launcher on GPUs, where the tasks run asynchronously
+    run,
+    // Waiting for the device, including in Program::synchronize
+    sync,
+    num_phases
+  };
+
+  // Stamps the phases of one launch
+  class Timer {
+   public:
+    // marshal_begin is 0 if the launch does not come from Python
+    Timer(LaunchBreakdown &breakdown, uint64 marshal_begin);
+
+    void mark(Phase phase);
+
+    ~Timer();
+
+   private:
+    LaunchBreakdown *breakdown;
+    uint64 last;
+  };
+
+  bool enabled = false;
+  uint64 cycles[num_phases] = {};
+  int64 num_launches = 0;
+  uint64 marshal_begin = 0;
+  // Cycles already counted by add_nested since the last Timer::mark
+  uint64 nested = 0;
+
+  static const char *phase_name(int phase);
+
+  // Returns marshal_begin and resets it
+  uint64 take_marshal_begin() {
+    auto ret = marshal_begin;
+    marshal_begin = 0;
+    return ret;
+  }
+
+  // For phases inside another one, e.g. the launch inside the run of the
+  // compiled function
+  void add_nested(Phase phase, uint64 c) {
+    cycles[phase] += c;
+    nested += c;
+  }
+
+  // Average cycles per launch
+  std::map<std::string, double> get() const;
+
+  void print() const;
+
+  void clear();
+};
+
+TLANG_NAMESPACE_END
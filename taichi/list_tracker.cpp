@@ -0,0 +1,45 @@
+#include "list_tracker.h"
+#include <algorithm>
+
+TLANG_NAMESPACE_BEGIN
+
+ListTracker::ListTracker()
+    : versions(taichi_max_num_snodes, 0),
+      list_keys(taichi_max_num_snodes, -1),
+      skipping(-1) {
+}
+
+bool ListTracker::skip(const TaskStructure &task) {
+  auto snode = task.list_snode;
+  if (snode != -1) {
+    if (task.clears_list) {
+      // Versions only grow, so the sum stays the same only if none of them
+      // changed
+      int64 key = 0;
+      for (auto ancestor : task.list_ancestors)
+        key += versions[ancestor];
+      if (list_keys[snode] == key) {
+        skipping = snode;
+        return true;
+      }
+      list_keys[snode] = key;
+      skipping = -1;
+    } else if (skipping == snode) {
+      return true;
+    }
+  }
+  if (task.unknown_writes) {
+    invalidate();
+  } else {
+    for (auto id : task.writes)
+      versions[id]++;
+  }
+  return false;
+}
+
+void ListTracker::invalidate() {
+  std::fill(list_keys.begin(), list_keys.end(), -1);
+  skipping = -1;
+}
+
+TLANG_NAMESPACE_END
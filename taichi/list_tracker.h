@@ -0,0 +1,48 @@
+// Skipping the list generation of struct-fors over unchanged structures
+
+#pragma once
+
+#include <vector>
+#include "constants.h"
+#include "tlang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+// What a launched task does to the sparse structure, see ListTracker
+struct TaskStructure {
+  // The SNode whose element list this clear_list or listgen task generates.
+  // -1 for other tasks, and for lists that are always regenerated.
+  int list_snode = -1;
+  bool clears_list = false;
+  // The ancestors of list_snode, whose versions make up the key of its list
+  std::vector<int> list_ancestors;
+  // The SNodes whose cells the task may activate or deactivate
+  std::vector<int> writes;
+  // Set if those are not known, e.g. of tasks from the offline cache
+  bool unknown_writes = true;
+};
+
+// A host-side mirror of the structure versions of the runtime (see
+// clear_list_if_outdated in runtime.cpp). Each launch of a task that may
+// activate or deactivate cells bumps the versions of the SNodes involved, so
+// that the clear_list and listgen tasks of a list whose ancestors are
+// unchanged since it was generated are not launched at all.
+class ListTracker {
+  std::vector<int64> versions;
+  // The sum of the versions of the ancestors when the list was generated,
+  // -1 if unknown
+  std::vector<int64> list_keys;
+  // The list whose clear_list was skipped, so are its listgen tasks
+  int skipping;
+
+ public:
+  ListTracker();
+
+  // Whether the task can be skipped. Records what it changes otherwise.
+  bool skip(const TaskStructure &task);
+
+  // The structure may have changed in an unknown way
+  void invalidate();
+};
+
+TLANG_NAMESPACE_END
@@ -707,5 +707,189 @@ void print(const Array3D<T> &arr) {
   arr.print("");
 }
 
+// An Array3D stored in bricks of tile^3 cells (tile = 2^log2_tile, 8 by
+// default), themselves in the (i, j, k) order of Array3D, so that cells
+// close in all three dimensions are close in memory: the 2x2x2 stencil of
+// trilinear sampling is usually within one brick. The bricks on the upper
+// boundaries are padded, and iteration goes brick by brick.
+template <typename T, int log2_tile = 3>
+class TiledArray3D {
+ public:
+  static constexpr int tile = 1 << log2_tile;
+  static constexpr int tile_mask = tile - 1;
+  static constexpr int tile_size = tile * tile * tile;
+
+ protected:
+  Vector3i res;
+  Vector3i num_tiles;
+  Vector3 storage_offset;
+
+ public:
+  std::vector<T> data;
+
+  TiledArray3D() : res(0), num_tiles(0), storage_offset(0.5f) {
+  }
+
+  TiledArray3D(const Vector3i &res,
+               T init = T(0),
+               Vector3 storage_offset = Vector3(0.5f)) {
+    initialize(res, init, storage_offset);
+  }
+
+  explicit TiledArray3D(const Array3D<T> &arr)
+      : TiledArray3D(arr.get_res(), T(0), arr.get_storage_offset()) {
+    for (auto &ind : arr.get_region())
+      (*this)[ind] = arr[ind];
+  }
+
+  void initialize(const Vector3i &res,
+                  T init = T(0),
+                  Vector3 storage_offset = Vector3(0.5f)) {
+    this->res = res;
+    for (int d = 0; d < 3; d++)
+      num_tiles[d] = (res[d] + tile_mask) >> log2_tile;
+    this->storage_offset = storage_offset;
+    data = std::vector<T>(
+        (std::size_t)num_tiles[0] * num_tiles[1] * num_tiles[2] * tile_size,
+        init);
+  }
+
+  Array3D<T> to_array() const {
+    Array3D<T> arr(res, T(0), storage_offset);
+    for (auto &ind : arr.get_region())
+      arr[ind] = (*this)[ind];
+    return arr;
+  }
+
+  TC_FORCE_INLINE std::size_t linearize(int i, int j, int k) const {
+    std::size_t t = ((std::size_t)(i >> log2_tile) * num_tiles[1] +
+                     (j >> log2_tile)) *
+                        num_tiles[2] +
+                    (k >> log2_tile);
+    return t * tile_size +
+           ((((i & tile_mask) << log2_tile) | (j & tile_mask)) << log2_tile |
+            (k & tile_mask));
+  }
+
+  TC_FORCE_INLINE T &operator()(int i, int j, int k) {
+    return data[linearize(i, j, k)];
+  }
+
+  TC_FORCE_INLINE const T &operator()(int i, int j, int k) const {
+    return data[linearize(i, j, k)];
+  }
+
+  TC_FORCE_INLINE T &operator[](const Vector3i &pos) {
+    return (*this)(pos.x, pos.y, pos.z);
+  }
+
+  TC_FORCE_INLINE const T &operator[](const Vector3i &pos) const {
+    return (*this)(pos.x, pos.y, pos.z);
+  }
+
+  TC_FORCE_INLINE T &operator[](const Index3D &index) {
+    return (*this)(index.i, index.j, index.k);
+  }
+
+  TC_FORCE_INLINE const T &operator[](const Index3D &index) const {
+    return (*this)(index.i, index.j, index.k);
+  }
+
+  const T &get(int i, int j, int k) const {
+    return (*this)(i, j, k);
+  }
+
+  void set(int i, int j, int k, const T &t) {
+    (*this)(i, j, k) = t;
+  }
+
+  bool inside(int i, int j, int k) const {
+    return 0 <= i && i < res[0] && 0 <= j && j < res[1] && 0 <= k && k < res[2];
+  }
+
+  bool inside(const Vector3i &pos) const {
+    return inside(pos[0], pos[1], pos[2]);
+  }
+
+  // Trilinear, as Array3D::sample. The stencil is addressed from its first
+  // cell when it does not cross a brick boundary.
+  T sample(real x, real y, real z) const {
+    x = clamp(x - storage_offset.x, 0.0_f, res[0] - 1.0_f - eps);
+    y = clamp(y - storage_offset.y, 0.0_f, res[1] - 1.0_f - eps);
+    z = clamp(z - storage_offset.z, 0.0_f, res[2] - 1.0_f - eps);
+    int x_i = clamp(int(x), 0, res[0] - 2);
+    int y_i = clamp(int(y), 0, res[1] - 2);
+    int z_i = clamp(int(z), 0, res[2] - 2);
+    real x_r = x - x_i;
+    real y_r = y - y_i;
+    real z_r = z - z_i;
+    T c[2][2][2];
+    if ((x_i & tile_mask) != tile_mask && (y_i & tile_mask) != tile_mask &&
+        (z_i & tile_mask) != tile_mask) {
+      const T *base = &data[linearize(x_i, y_i, z_i)];
+      for (int a = 0; a < 2; a++)
+        for (int b = 0; b < 2; b++)
+          for (int d = 0; d < 2; d++)
+            c[a][b][d] = base[(a * tile + b) * tile + d];
+    } else {
+      for (int a = 0; a < 2; a++)
+        for (int b = 0; b < 2; b++)
+          for (int d = 0; d < 2; d++)
+            c[a][b][d] = get(x_i + a, y_i + b, z_i + d);
+    }
+    return lerp(z_r,
+                lerp(x_r, lerp(y_r, c[0][0][0], c[0][1][0]),
+                     lerp(y_r, c[1][0][0], c[1][1][0])),
+                lerp(x_r, lerp(y_r, c[0][0][1], c[0][1][1]),
+                     lerp(y_r, c[1][0][1], c[1][1][1])));
+  }
+
+  T sample(const Vector3 &v) const {
+    return sample(v.x, v.y, v.z);
+  }
+
+  T sample_relative_coord(const Vector3 &vec) const {
+    return sample(vec.x * res[0], vec.y * res[1], vec.z * res[2]);
+  }
+
+  // Calls f(begin, end) for the cells [begin, end) of each brick, clipped to
+  // the array, in storage order
+  template <typename F>
+  void for_each_tile(const F &f) const {
+    for (int ti = 0; ti < num_tiles[0]; ti++) {
+      for (int tj = 0; tj < num_tiles[1]; tj++) {
+        for (int tk = 0; tk < num_tiles[2]; tk++) {
+          Vector3i begin(ti * tile, tj * tile, tk * tile);
+          Vector3i end(std::min(begin[0] + tile, res[0]),
+                       std::min(begin[1] + tile, res[1]),
+                       std::min(begin[2] + tile, res[2]));
+          f(begin, end);
+        }
+      }
+    }
+  }
+
+  // Calls f(index, value) for all cells, brick by brick
+  template <typename F>
+  void for_each(const F &f) {
+    for_each_tile([&](const Vector3i &begin, const Vector3i &end) {
+      for (auto &ind : Region3D(begin, end, storage_offset))
+        f(ind, (*this)[ind]);
+    });
+  }
+
+  Vector3i get_res() const {
+    return res;
+  }
+
+  Vector3i get_num_tiles() const {
+    return num_tiles;
+  }
+
+  Vector3 get_storage_offset() const {
+    return storage_offset;
+  }
+};
+
 void test_array_3d();
 TC_NAMESPACE_END
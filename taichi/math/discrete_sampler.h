@@ -98,6 +98,106 @@ class DiscreteSampler {
   }
 };
 
+// Walker's alias method, built with Vose's algorithm: samples from the same
+// weights as DiscreteSampler in O(1), with one uniform number each. The
+// number picks a column i and a fraction of it, which keeps i below prob[i]
+// and takes alias[i] above.
+class AliasSampler {
+ private:
+  std::vector<real> pdf;
+  std::vector<real> prob;
+  std::vector<int> alias;
+
+ public:
+  AliasSampler() {
+  }
+
+  AliasSampler(const std::vector<real> &weights) {
+    initialize(weights);
+  }
+
+  int get_num_elements() const {
+    return (int)pdf.size();
+  }
+
+  void initialize(const std::vector<real> &weights) {
+    int n = (int)weights.size();
+    assert_info(n > 0, "No choice for sampler.");
+    float64 sum = 0;
+    for (auto w : weights) {
+      assert_info(w >= 0, "No negative pdf allowed!");
+      sum += w;
+    }
+    assert_info(sum > 0, "Sum of pdf is zero.");
+    pdf.resize(n);
+    prob.resize(n);
+    alias.resize(n);
+    // The weights scaled to an average of one, in double precision so that
+    // rounding errors do not accumulate over the columns
+    std::vector<float64> scaled(n);
+    std::vector<int> small, large;
+    for (int i = 0; i < n; i++) {
+      pdf[i] = real(weights[i] / sum);
+      scaled[i] = weights[i] * n / sum;
+      (scaled[i] < 1 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+      int s = small.back(), l = large.back();
+      small.pop_back();
+      large.pop_back();
+      prob[s] = real(scaled[s]);
+      alias[s] = l;
+      scaled[l] -= 1 - scaled[s];
+      (scaled[l] < 1 ? small : large).push_back(l);
+    }
+    // Full columns, up to rounding
+    for (auto lists : {&small, &large}) {
+      for (auto i : *lists) {
+        prob[i] = 1;
+        alias[i] = i;
+      }
+    }
+  }
+
+  int sample(real r, real &pdf_out) const {
+    int n = get_num_elements();
+    real x = r * n;
+    int i = std::min(int(x), n - 1);
+    int index = x - i < prob[i] ? i : alias[i];
+    pdf_out = pdf[index];
+    return index;
+  }
+
+  int sample(real r) const {
+    real _;
+    return sample(r, _);
+  }
+
+  // A sample for each of the uniform numbers
+  std::vector<int> sample(const std::vector<real> &r) const {
+    std::vector<int> ret(r.size());
+    for (int i = 0; i < (int)r.size(); i++)
+      ret[i] = sample(r[i]);
+    return ret;
+  }
+
+  real get_pdf(int id) const {
+    return pdf[id];
+  }
+
+  const std::vector<real> &get_pdfs() const {
+    return pdf;
+  }
+
+  const std::vector<real> &get_probs() const {
+    return prob;
+  }
+
+  const std::vector<int> &get_aliases() const {
+    return alias;
+  }
+};
+
 inline void test_discrete_sampler() {
   const int n = 10;
   std::vector<real> p;
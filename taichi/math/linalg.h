@@ -10,19 +10,13 @@
 #include <functional>
 #include <vector>
 #include <array>
-#include <immintrin.h>
 #include <taichi/common/util.h>
+#include "linalg_simd.h"
 #include "scalar.h"
 #include "array_fwd.h"
 
 TC_NAMESPACE_BEGIN
 
-// Instruction Set Extension
-
-enum class InstSetExt { None };
-
-constexpr InstSetExt default_instruction_set = InstSetExt::None;
-
 /////////////////////////////////////////////////////////////////
 /////              N dimensional Vector
 /////////////////////////////////////////////////////////////////
@@ -60,7 +54,7 @@ struct VectorNDBase<2, T, ISE> {
 
 template <typename T, InstSetExt ISE>
 struct VectorNDBase<3, T, ISE> {
-  static constexpr bool simd = false;
+  static constexpr bool simd = linalg_simd::enabled<3, T, ISE>();
   static constexpr int storage_elements = 3;
   union {
     T d[3];
@@ -73,7 +67,7 @@ struct VectorNDBase<3, T, ISE> {
 template <typename T, InstSetExt ISE>
 struct VectorNDBase<4, T, ISE> {
   static constexpr int storage_elements = 4;
-  static constexpr bool simd = false;
+  static constexpr bool simd = linalg_simd::enabled<4, T, ISE>();
   union {
     T d[4];
     struct {
@@ -92,6 +86,7 @@ struct VectorND : public VectorNDBase<dim__, T, ISE> {
   using VectorBase = VectorNDBase<dim, T, ISE>;
   using VectorBase::d;
   static constexpr int storage_elements = VectorBase::storage_elements;
+  static constexpr bool simd = VectorBase::simd;
 
   TC_FORCE_INLINE VectorND() {
     for (int i = 0; i < dim; i++) {
@@ -218,7 +213,28 @@ struct VectorND : public VectorNDBase<dim__, T, ISE> {
     return d[i];
   }
 
+  // The elements in the lanes of a SIMD register, if simd
+  TC_FORCE_INLINE linalg_simd::f32x4 to_simd() const {
+    if (dim == 4)
+      return linalg_simd::load4((const float32 *)this->d);
+    return linalg_simd::load3((const float32 *)this->d);
+  }
+
+  static TC_FORCE_INLINE VectorND from_simd(linalg_simd::f32x4 v) {
+    VectorND ret;
+    if (dim == 4)
+      linalg_simd::store4((float32 *)ret.d, v);
+    else
+      linalg_simd::store3((float32 *)ret.d, v);
+    return ret;
+  }
+
   TC_FORCE_INLINE T dot(VectorND<dim, T, ISE> o) const {
+    if constexpr (simd) {
+      if (dim == 4)
+        return linalg_simd::dot4(to_simd(), o.to_simd());
+      return linalg_simd::dot3(to_simd(), o.to_simd());
+    }
     T ret = T(0);
     for (int i = 0; i < dim; i++)
       ret += this->d[i] * o[i];
@@ -248,24 +264,32 @@ struct VectorND : public VectorNDBase<dim__, T, ISE> {
     return *this;
   }
 
-  // Non-SIMD cases
+  // SIMD for float32 vectors of 3 or 4 elements
   template <int dim_ = dim, typename T_ = T, InstSetExt ISE_ = ISE>
   TC_FORCE_INLINE VectorND operator+(const VectorND &o) const {
+    if constexpr (simd)
+      return from_simd(linalg_simd::add(to_simd(), o.to_simd()));
     return VectorND([=](int i) { return this->d[i] + o[i]; });
   }
 
   template <int dim_ = dim, typename T_ = T, InstSetExt ISE_ = ISE>
   TC_FORCE_INLINE VectorND operator-(const VectorND &o) const {
+    if constexpr (simd)
+      return from_simd(linalg_simd::sub(to_simd(), o.to_simd()));
     return VectorND([=](int i) { return this->d[i] - o[i]; });
   }
 
   template <int dim_ = dim, typename T_ = T, InstSetExt ISE_ = ISE>
   TC_FORCE_INLINE VectorND operator*(const VectorND &o) const {
+    if constexpr (simd)
+      return from_simd(linalg_simd::mul(to_simd(), o.to_simd()));
     return VectorND([=](int i) { return this->d[i] * o[i]; });
   }
 
   template <int dim_ = dim, typename T_ = T, InstSetExt ISE_ = ISE>
   TC_FORCE_INLINE VectorND operator/(const VectorND &o) const {
+    if constexpr (simd)
+      return from_simd(linalg_simd::div(to_simd(), o.to_simd()));
     return VectorND([=](int i) { return this->d[i] / o[i]; });
   }
 
@@ -447,6 +471,8 @@ struct VectorND : public VectorNDBase<dim__, T, ISE> {
 
   template <int dim_ = dim, typename T_ = T, InstSetExt ISE_ = ISE>
   TC_FORCE_INLINE T length2() const {
+    if constexpr (simd)
+      return dot(*this);
     T ret = 0;
     for (int i = 0; i < dim; i++) {
       ret += this->d[i] * this->d[i];
@@ -535,6 +561,15 @@ struct VectorND : public VectorNDBase<dim__, T, ISE> {
   }
 };
 
+// The binary io of VectorND writes its elements, which are all of its bytes
+// (vectors of them are copied at once)
+template <int dim, typename T, InstSetExt ISE>
+struct is_bulk_serializable<VectorND<dim, T, ISE>>
+    : std::integral_constant<bool,
+                             std::is_arithmetic<T>::value &&
+                                 sizeof(VectorND<dim, T, ISE>) ==
+                                     sizeof(T) * dim> {};
+
 template <typename T, int dim, InstSetExt ISE = default_instruction_set>
 using TVector = VectorND<dim, T, ISE>;
 
@@ -730,6 +765,8 @@ struct MatrixND {
   template <int dim_ = dim, typename T_ = T, InstSetExt ISE_ = ISE>
   TC_FORCE_INLINE VectorND<dim, T, ISE> operator*(
       const VectorND<dim, T, ISE> &o) const {
+    if constexpr (dim == 4 && Vector::simd)
+      return Vector::from_simd(multiply_simd(o.to_simd()));
     VectorND<dim, T, ISE> ret = d[0] * o[0];
     for (int i = 1; i < dim; i++)
       ret += d[i] * o[i];
@@ -739,6 +776,11 @@ struct MatrixND {
   template <int dim_ = dim, typename T_ = T, InstSetExt ISE_ = ISE>
   TC_FORCE_INLINE MatrixND operator*(const MatrixND &o) const {
     MatrixND ret;
+    if constexpr (dim == 4 && Vector::simd) {
+      for (int i = 0; i < dim; i++)
+        ret[i] = Vector::from_simd(multiply_simd(o[i].to_simd()));
+      return ret;
+    }
     for (int i = 0; i < dim; i++) {
       for (int j = 0; j < dim; j++) {
         T tmp = 0;
@@ -751,6 +793,16 @@ struct MatrixND {
     return ret;
   }
 
+  // The columns times the lanes of v, for 4x4 SIMD matrices
+  TC_FORCE_INLINE linalg_simd::f32x4 multiply_simd(
+      linalg_simd::f32x4 v) const {
+    using namespace linalg_simd;
+    auto ret = mul(d[0].to_simd(), broadcast<0>(v));
+    ret = fmadd(d[1].to_simd(), broadcast<1>(v), ret);
+    ret = fmadd(d[2].to_simd(), broadcast<2>(v), ret);
+    return fmadd(d[3].to_simd(), broadcast<3>(v), ret);
+  }
+
   TC_FORCE_INLINE static MatrixND outer_product(Vector column, Vector row) {
     return MatrixND([&](int i) { return column * row[i]; });
   }
@@ -805,6 +857,13 @@ struct MatrixND {
 
   TC_FORCE_INLINE MatrixND transposed() const {
     MatrixND ret;
+    if constexpr (dim == 4 && Vector::simd) {
+      auto c0 = d[0].to_simd(), c1 = d[1].to_simd(), c2 = d[2].to_simd(),
+           c3 = d[3].to_simd();
+      linalg_simd::transpose(c0, c1, c2, c3);
+      return MatrixND(Vector::from_simd(c0), Vector::from_simd(c1),
+                      Vector::from_simd(c2), Vector::from_simd(c3));
+    }
     for (int i = 0; i < dim; i++) {
       for (int j = 0; j < dim; j++) {
         ret[i][j] = d[j][i];
@@ -958,6 +1017,9 @@ TC_FORCE_INLINE T cross(const VectorND<2, T, ISE> &a,
 template <typename T, InstSetExt ISE>
 TC_FORCE_INLINE VectorND<3, T, ISE> cross(const VectorND<3, T, ISE> &a,
                                           const VectorND<3, T, ISE> &b) {
+  using Vector = VectorND<3, T, ISE>;
+  if constexpr (Vector::simd)
+    return Vector::from_simd(linalg_simd::cross3(a.to_simd(), b.to_simd()));
   return VectorND<3, T, ISE>(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
                              a.x * b.y - a.y * b.x);
 }
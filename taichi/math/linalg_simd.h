@@ -0,0 +1,284 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <taichi/common/util.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#if defined(__SSE4_1__)
+#define TC_LINALG_SSE
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TC_LINALG_NEON
+#endif
+
+TC_NAMESPACE_BEGIN
+
+// Instruction Set Extension
+
+enum class InstSetExt { None, SSE, AVX, NEON };
+
+// Follows the target of the build (e.g. -march=native), unless TC_ISE_NONE
+// is defined
+#if defined(TC_ISE_NONE)
+constexpr InstSetExt default_instruction_set = InstSetExt::None;
+#elif defined(TC_LINALG_SSE) && defined(__AVX__)
+constexpr InstSetExt default_instruction_set = InstSetExt::AVX;
+#elif defined(TC_LINALG_SSE)
+constexpr InstSetExt default_instruction_set = InstSetExt::SSE;
+#elif defined(TC_LINALG_NEON)
+constexpr InstSetExt default_instruction_set = InstSetExt::NEON;
+#else
+constexpr InstSetExt default_instruction_set = InstSetExt::None;
+#endif
+
+// Four float32 lanes, for the SIMD specializations of VectorND and MatrixND.
+// The vectors keep their scalar layout: 3D vectors are loaded into the
+// first three lanes with a zero in the fourth, which stores ignore.
+namespace linalg_simd {
+
+// Are 3D and 4D float32 vectors of ISE computed with these?
+template <int dim, typename T, InstSetExt ISE>
+constexpr bool enabled() {
+  if (!std::is_same<T, float32>::value || (dim != 3 && dim != 4))
+    return false;
+#if defined(TC_LINALG_SSE)
+  return ISE == InstSetExt::SSE || ISE == InstSetExt::AVX;
+#elif defined(TC_LINALG_NEON)
+  return ISE == InstSetExt::NEON;
+#else
+  return false;
+#endif
+}
+
+#if defined(TC_LINALG_SSE)
+
+using f32x4 = __m128;
+
+TC_FORCE_INLINE f32x4 load4(const float32 *p) {
+  return _mm_loadu_ps(p);
+}
+
+TC_FORCE_INLINE f32x4 load3(const float32 *p) {
+  return _mm_setr_ps(p[0], p[1], p[2], 0.0f);
+}
+
+TC_FORCE_INLINE void store4(float32 *p, f32x4 v) {
+  _mm_storeu_ps(p, v);
+}
+
+TC_FORCE_INLINE void store3(float32 *p, f32x4 v) {
+  _mm_storel_pi((__m64 *)p, v);
+  _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+}
+
+TC_FORCE_INLINE f32x4 set1(float32 a) {
+  return _mm_set1_ps(a);
+}
+
+TC_FORCE_INLINE f32x4 add(f32x4 a, f32x4 b) {
+  return _mm_add_ps(a, b);
+}
+
+TC_FORCE_INLINE f32x4 sub(f32x4 a, f32x4 b) {
+  return _mm_sub_ps(a, b);
+}
+
+TC_FORCE_INLINE f32x4 mul(f32x4 a, f32x4 b) {
+  return _mm_mul_ps(a, b);
+}
+
+TC_FORCE_INLINE f32x4 div(f32x4 a, f32x4 b) {
+  return _mm_div_ps(a, b);
+}
+
+// a * b + c
+TC_FORCE_INLINE f32x4 fmadd(f32x4 a, f32x4 b, f32x4 c) {
+#if defined(__FMA__)
+  return _mm_fmadd_ps(a, b, c);
+#else
+  return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+TC_FORCE_INLINE float32 dot4(f32x4 a, f32x4 b) {
+  return _mm_cvtss_f32(_mm_dp_ps(a, b, 0xF1));
+}
+
+TC_FORCE_INLINE float32 dot3(f32x4 a, f32x4 b) {
+  return _mm_cvtss_f32(_mm_dp_ps(a, b, 0x71));
+}
+
+// (y, z, x, w)
+TC_FORCE_INLINE f32x4 yzxw(f32x4 a) {
+  return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+template <int i>
+TC_FORCE_INLINE f32x4 broadcast(f32x4 a) {
+  return _mm_shuffle_ps(a, a, _MM_SHUFFLE(i, i, i, i));
+}
+
+TC_FORCE_INLINE void transpose(f32x4 &r0, f32x4 &r1, f32x4 &r2, f32x4 &r3) {
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+}
+
+#elif defined(TC_LINALG_NEON)
+
+using f32x4 = float32x4_t;
+
+TC_FORCE_INLINE f32x4 load4(const float32 *p) {
+  return vld1q_f32(p);
+}
+
+TC_FORCE_INLINE f32x4 load3(const float32 *p) {
+  return vcombine_f32(vld1_f32(p), vld1_lane_f32(p + 2, vdup_n_f32(0), 0));
+}
+
+TC_FORCE_INLINE void store4(float32 *p, f32x4 v) {
+  vst1q_f32(p, v);
+}
+
+TC_FORCE_INLINE void store3(float32 *p, f32x4 v) {
+  vst1_f32(p, vget_low_f32(v));
+  vst1q_lane_f32(p + 2, v, 2);
+}
+
+TC_FORCE_INLINE f32x4 set1(float32 a) {
+  return vdupq_n_f32(a);
+}
+
+TC_FORCE_INLINE f32x4 add(f32x4 a, f32x4 b) {
+  return vaddq_f32(a, b);
+}
+
+TC_FORCE_INLINE f32x4 sub(f32x4 a, f32x4 b) {
+  return vsubq_f32(a, b);
+}
+
+TC_FORCE_INLINE f32x4 mul(f32x4 a, f32x4 b) {
+  return vmulq_f32(a, b);
+}
+
+TC_FORCE_INLINE f32x4 div(f32x4 a, f32x4 b) {
+  return vdivq_f32(a, b);
+}
+
+TC_FORCE_INLINE f32x4 fmadd(f32x4 a, f32x4 b, f32x4 c) {
+  return vfmaq_f32(c, a, b);
+}
+
+TC_FORCE_INLINE float32 dot4(f32x4 a, f32x4 b) {
+  return vaddvq_f32(vmulq_f32(a, b));
+}
+
+TC_FORCE_INLINE float32 dot3(f32x4 a, f32x4 b) {
+  return vaddvq_f32(vsetq_lane_f32(0, vmulq_f32(a, b), 3));
+}
+
+// (y, z, x, x): the fourth lane is not kept
+TC_FORCE_INLINE f32x4 yzxw(f32x4 a) {
+  return vsetq_lane_f32(vgetq_lane_f32(a, 0), vextq_f32(a, a, 1), 2);
+}
+
+template <int i>
+TC_FORCE_INLINE f32x4 broadcast(f32x4 a) {
+  return vdupq_laneq_f32(a, i);
+}
+
+TC_FORCE_INLINE void transpose(f32x4 &r0, f32x4 &r1, f32x4 &r2, f32x4 &r3) {
+  auto t01 = vtrnq_f32(r0, r1);
+  auto t23 = vtrnq_f32(r2, r3);
+  r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+  r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+  r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+  r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+#else
+
+// Never used (enabled() is false), but keeps the specializations compiling
+struct f32x4 {
+  float32 v[4];
+};
+
+TC_FORCE_INLINE f32x4 load4(const float32 *p) {
+  return f32x4{{p[0], p[1], p[2], p[3]}};
+}
+
+TC_FORCE_INLINE f32x4 load3(const float32 *p) {
+  return f32x4{{p[0], p[1], p[2], 0.0f}};
+}
+
+TC_FORCE_INLINE void store4(float32 *p, f32x4 v) {
+  for (int i = 0; i < 4; i++)
+    p[i] = v.v[i];
+}
+
+TC_FORCE_INLINE void store3(float32 *p, f32x4 v) {
+  for (int i = 0; i < 3; i++)
+    p[i] = v.v[i];
+}
+
+TC_FORCE_INLINE f32x4 set1(float32 a) {
+  return f32x4{{a, a, a, a}};
+}
+
+#define TC_LINALG_SCALAR_OP(name, op)                                   \
+  TC_FORCE_INLINE f32x4 name(f32x4 a, f32x4 b) {                        \
+    return f32x4{{a.v[0] op b.v[0], a.v[1] op b.v[1], a.v[2] op b.v[2], \
+                  a.v[3] op b.v[3]}};                                   \
+  }
+
+TC_LINALG_SCALAR_OP(add, +)
+TC_LINALG_SCALAR_OP(sub, -)
+TC_LINALG_SCALAR_OP(mul, *)
+TC_LINALG_SCALAR_OP(div, /)
+
+#undef TC_LINALG_SCALAR_OP
+
+TC_FORCE_INLINE f32x4 fmadd(f32x4 a, f32x4 b, f32x4 c) {
+  return add(mul(a, b), c);
+}
+
+TC_FORCE_INLINE float32 dot4(f32x4 a, f32x4 b) {
+  return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2] +
+         a.v[3] * b.v[3];
+}
+
+TC_FORCE_INLINE float32 dot3(f32x4 a, f32x4 b) {
+  return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2];
+}
+
+TC_FORCE_INLINE f32x4 yzxw(f32x4 a) {
+  return f32x4{{a.v[1], a.v[2], a.v[0], a.v[3]}};
+}
+
+template <int i>
+TC_FORCE_INLINE f32x4 broadcast(f32x4 a) {
+  return set1(a.v[i]);
+}
+
+TC_FORCE_INLINE void transpose(f32x4 &r0, f32x4 &r1, f32x4 &r2, f32x4 &r3) {
+  f32x4 r[4] = {r0, r1, r2, r3};
+  r0 = f32x4{{r[0].v[0], r[1].v[0], r[2].v[0], r[3].v[0]}};
+  r1 = f32x4{{r[0].v[1], r[1].v[1], r[2].v[1], r[3].v[1]}};
+  r2 = f32x4{{r[0].v[2], r[1].v[2], r[2].v[2], r[3].v[2]}};
+  r3 = f32x4{{r[0].v[3], r[1].v[3], r[2].v[3], r[3].v[3]}};
+}
+
+#endif
+
+// a x b, for 3D vectors
+TC_FORCE_INLINE f32x4 cross3(f32x4 a, f32x4 b) {
+  return yzxw(sub(mul(a, yzxw(b)), mul(yzxw(a), b)));
+}
+
+}  // namespace linalg_simd
+
+TC_NAMESPACE_END
@@ -0,0 +1,1064 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#include <taichi/common/util.h>
+#include "sifakis_svd.h"
+
+namespace SifakisSVD {
+
+// Batched 3x3 SVD: the branch-free algorithm of svd() on several matrices at
+// once, one per SIMD lane
+
+// width float32 lanes. Comparisons give masks of all-one bits, which the
+// bitwise operators combine.
+template <int width>
+struct Lanes;
+
+template <>
+struct Lanes<1> {
+  float v;
+
+  Lanes() = default;
+
+  Lanes(float v) : v(v) {
+  }
+
+  static Lanes load(const float *p) {
+    return Lanes(*p);
+  }
+
+  void store(float *p) const {
+    *p = v;
+  }
+
+  static Lanes from_bits(taichi::uint32 bits) {
+    Lanes ret;
+    std::memcpy(&ret.v, &bits, sizeof(bits));
+    return ret;
+  }
+
+  taichi::uint32 bits() const {
+    taichi::uint32 ret;
+    std::memcpy(&ret, &v, sizeof(ret));
+    return ret;
+  }
+};
+
+TC_FORCE_INLINE Lanes<1> operator+(Lanes<1> a, Lanes<1> b) {
+  return a.v + b.v;
+}
+
+TC_FORCE_INLINE Lanes<1> operator-(Lanes<1> a, Lanes<1> b) {
+  return a.v - b.v;
+}
+
+TC_FORCE_INLINE Lanes<1> operator*(Lanes<1> a, Lanes<1> b) {
+  return a.v * b.v;
+}
+
+TC_FORCE_INLINE Lanes<1> operator&(Lanes<1> a, Lanes<1> b) {
+  return Lanes<1>::from_bits(a.bits() & b.bits());
+}
+
+TC_FORCE_INLINE Lanes<1> operator|(Lanes<1> a, Lanes<1> b) {
+  return Lanes<1>::from_bits(a.bits() | b.bits());
+}
+
+TC_FORCE_INLINE Lanes<1> operator^(Lanes<1> a, Lanes<1> b) {
+  return Lanes<1>::from_bits(a.bits() ^ b.bits());
+}
+
+TC_FORCE_INLINE Lanes<1> operator~(Lanes<1> a) {
+  return Lanes<1>::from_bits(~a.bits());
+}
+
+TC_FORCE_INLINE Lanes<1> operator<(Lanes<1> a, Lanes<1> b) {
+  return Lanes<1>::from_bits(a.v < b.v ? ~0u : 0u);
+}
+
+TC_FORCE_INLINE Lanes<1> operator<=(Lanes<1> a, Lanes<1> b) {
+  return Lanes<1>::from_bits(a.v <= b.v ? ~0u : 0u);
+}
+
+TC_FORCE_INLINE Lanes<1> operator>=(Lanes<1> a, Lanes<1> b) {
+  return Lanes<1>::from_bits(a.v >= b.v ? ~0u : 0u);
+}
+
+TC_FORCE_INLINE Lanes<1> max(Lanes<1> a, Lanes<1> b) {
+  return std::max(a.v, b.v);
+}
+
+TC_FORCE_INLINE Lanes<1> rsqrt(Lanes<1> a) {
+  return rsqrt(a.v);
+}
+
+// The x86 vector lanes, where the build targets them. Their rsqrt is the
+// approximation that svd() uses as well.
+#define TC_SVD_LANES(width, type, pre, bit_and, bit_or, bit_xor, cmp_lt,    \
+                     cmp_le, cmp_ge, ones, rsqrt_ps)                        \
+  template <>                                                               \
+  struct Lanes<width> {                                                     \
+    type v;                                                                 \
+                                                                            \
+    Lanes() = default;                                                      \
+                                                                            \
+    Lanes(type v) : v(v) {                                                  \
+    }                                                                       \
+                                                                            \
+    Lanes(float a) : v(pre##_set1_ps(a)) {                                  \
+    }                                                                       \
+                                                                            \
+    static Lanes load(const float *p) {                                     \
+      return pre##_loadu_ps(p);                                             \
+    }                                                                       \
+                                                                            \
+    void store(float *p) const {                                            \
+      pre##_storeu_ps(p, v);                                                \
+    }                                                                       \
+  };                                                                        \
+                                                                            \
+  TC_FORCE_INLINE Lanes<width> operator+(Lanes<width> a, Lanes<width> b) {  \
+    return pre##_add_ps(a.v, b.v);                                          \
+  }                                                                         \
+                                                                            \
+  TC_FORCE_INLINE Lanes<width> operator-(Lanes<width> a, Lanes<width> b) {  \
+    return pre##_sub_ps(a.v, b.v);                                          \
+  }                                                                         \
+                                                                            \
+  TC_FORCE_INLINE Lanes<width> operator*(Lanes<width> a, Lanes<width> b) {  \
+    return pre##_mul_ps(a.v, b.v);                                          \
+  }                                                                         \
+                                                                            \
+  TC_FORCE_INLINE Lanes<width> operator&(Lanes<width> a, Lanes<width> b) {  \
+    return bit_and(a.v, b.v);                                               \
+  }                                                                         \
+                                                                            \
+  TC_FORCE_INLINE Lanes<width> operator|(Lanes<width> a, Lanes<width> b) {  \
+    return bit_or(a.v, b.v);                                                \
+  }                                                                         \
+                                                                            \
+  TC_FORCE_INLINE Lanes<width> operator^(Lanes<width> a, Lanes<width> b) {  \
+    return bit_xor(a.v, b.v);                                               \
+  }                                                                         \
+                                                                            \
+  TC_FORCE_INLINE Lanes<width> operator~(Lanes<width> a) {                  \
+    return bit_xor(a.v, ones);                                              \
+  }                                                                         \
+                                                                            \
+  TC_FORCE_INLINE Lanes<width> operator<(Lanes<width> a, Lanes<width> b) {  \
+    return cmp_lt(a.v, b.v);                                                \
+  }                                                                         \
+                                                                            \
+  TC_FORCE_INLINE Lanes<width> operator<=(Lanes<width> a, Lanes<width> b) { \
+    return cmp_le(a.v, b.v);                                                \
+  }                                                                         \
+                                                                            \
+  TC_FORCE_INLINE Lanes<width> operator>=(Lanes<width> a, Lanes<width> b) { \
+    return cmp_ge(a.v, b.v);                                                \
+  }                                                                         \
+                                                                            \
+  TC_FORCE_INLINE Lanes<width> max(Lanes<width> a, Lanes<width> b) {        \
+    return pre##_max_ps(a.v, b.v);                                          \
+  }                                                                         \
+                                                                            \
+  TC_FORCE_INLINE Lanes<width> rsqrt(Lanes<width> a) {                      \
+    return rsqrt_ps(a.v);                                                   \
+  }
+
+#if defined(__SSE__)
+TC_SVD_LANES(4,
+             __m128,
+             _mm,
+             _mm_and_ps,
+             _mm_or_ps,
+             _mm_xor_ps,
+             _mm_cmplt_ps,
+             _mm_cmple_ps,
+             _mm_cmpge_ps,
+             _mm_castsi128_ps(_mm_set1_epi32(-1)),
+             _mm_rsqrt_ps)
+#endif
+
+#if defined(__AVX__)
+TC_FORCE_INLINE __m256 avx_cmplt_ps(__m256 a, __m256 b) {
+  return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+}
+
+TC_FORCE_INLINE __m256 avx_cmple_ps(__m256 a, __m256 b) {
+  return _mm256_cmp_ps(a, b, _CMP_LE_OQ);
+}
+
+TC_FORCE_INLINE __m256 avx_cmpge_ps(__m256 a, __m256 b) {
+  return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+}
+
+TC_SVD_LANES(8,
+             __m256,
+             _mm256,
+             _mm256_and_ps,
+             _mm256_or_ps,
+             _mm256_xor_ps,
+             avx_cmplt_ps,
+             avx_cmple_ps,
+             avx_cmpge_ps,
+             _mm256_castsi256_ps(_mm256_set1_epi32(-1)),
+             _mm256_rsqrt_ps)
+#endif
+
+#if defined(__AVX512F__)
+// AVX-512F has the bitwise operations on integers only, and compares into
+// mask registers
+#define TC_SVD_AVX512_BITWISE(name, op)                                  \
+  TC_FORCE_INLINE __m512 avx512_##name##_ps(__m512 a, __m512 b) {        \
+    return _mm512_castsi512_ps(                                          \
+        op(_mm512_castps_si512(a), _mm512_castps_si512(b)));             \
+  }
+
+TC_SVD_AVX512_BITWISE(and, _mm512_and_epi32)
+TC_SVD_AVX512_BITWISE(or, _mm512_or_epi32)
+TC_SVD_AVX512_BITWISE(xor, _mm512_xor_epi32)
+
+#undef TC_SVD_AVX512_BITWISE
+
+#define TC_SVD_AVX512_CMP(name, pred)                                      \
+  TC_FORCE_INLINE __m512 avx512_##name##_ps(__m512 a, __m512 b) {          \
+    return _mm512_castsi512_ps(_mm512_maskz_mov_epi32(                     \
+        _mm512_cmp_ps_mask(a, b, pred), _mm512_set1_epi32(-1)));           \
+  }
+
+TC_SVD_AVX512_CMP(cmplt, _CMP_LT_OQ)
+TC_SVD_AVX512_CMP(cmple, _CMP_LE_OQ)
+TC_SVD_AVX512_CMP(cmpge, _CMP_GE_OQ)
+
+#undef TC_SVD_AVX512_CMP
+
+TC_SVD_LANES(16,
+             __m512,
+             _mm512,
+             avx512_and_ps,
+             avx512_or_ps,
+             avx512_xor_ps,
+             avx512_cmplt_ps,
+             avx512_cmple_ps,
+             avx512_cmpge_ps,
+             _mm512_castsi512_ps(_mm512_set1_epi32(-1)),
+             _mm512_rsqrt14_ps)
+#endif
+
+#undef TC_SVD_LANES
+
+// The widest lanes the build targets
+#if defined(__AVX512F__)
+constexpr int default_svd_width = 16;
+#elif defined(__AVX__)
+constexpr int default_svd_width = 8;
+#elif defined(__SSE__)
+constexpr int default_svd_width = 4;
+#else
+constexpr int default_svd_width = 1;
+#endif
+
+// Translated from the IR version in taichi/svd.h. a, u and v hold the
+// entries in row-major order, and sigma the singular values.
+template <typename L>
+TC_FORCE_INLINE void svd_lanes(const L *a,
+                               L *u,
+                               L *v,
+                               L *sigma,
+                               int num_iters) {
+  L Sfour_gamma_squared, Ssine_pi_over_eight, Scosine_pi_over_eight, Sone_half,
+    Sone, Stiny_number, Ssmall_number, Sa11, Sa21, Sa31, Sa12, Sa22, Sa32, Sa13,
+    Sa23, Sa33, Sv11, Sv21, Sv31, Sv12, Sv22, Sv32, Sv13, Sv23, Sv33, Su11,
+    Su21, Su31, Su12, Su22, Su32, Su13, Su23, Su33, Sc, Ss, Sch, Ssh, Stmp1,
+    Stmp2, Stmp3, Stmp4, Stmp5, Sqvs, Sqvvx, Sqvvy, Sqvvz, Ss11, Ss21, Ss31,
+    Ss22, Ss32, Ss33;
+  Sfour_gamma_squared = L(Four_Gamma_Squared);
+  Ssine_pi_over_eight = L(Sine_Pi_Over_Eight);
+  Scosine_pi_over_eight = L(Cosine_Pi_Over_Eight);
+  Sone_half = L(0.5f);
+  Sone = L(1.0f);
+  Stiny_number = L(1.e-20f);
+  Ssmall_number = L(1.e-12f);
+  Sa11 = a[0];
+  Sa21 = a[3];
+  Sa31 = a[6];
+  Sa12 = a[1];
+  Sa22 = a[4];
+  Sa32 = a[7];
+  Sa13 = a[2];
+  Sa23 = a[5];
+  Sa33 = a[8];
+  Sqvs = L(1.0f);
+  Sqvvx = L(0.0f);
+  Sqvvy = L(0.0f);
+  Sqvvz = L(0.0f);
+  Ss11 = Sa11 * Sa11;
+  Stmp1 = Sa21 * Sa21;
+  Ss11 = Stmp1 + Ss11;
+  Stmp1 = Sa31 * Sa31;
+  Ss11 = Stmp1 + Ss11;
+  Ss21 = Sa12 * Sa11;
+  Stmp1 = Sa22 * Sa21;
+  Ss21 = Stmp1 + Ss21;
+  Stmp1 = Sa32 * Sa31;
+  Ss21 = Stmp1 + Ss21;
+  Ss31 = Sa13 * Sa11;
+  Stmp1 = Sa23 * Sa21;
+  Ss31 = Stmp1 + Ss31;
+  Stmp1 = Sa33 * Sa31;
+  Ss31 = Stmp1 + Ss31;
+  Ss22 = Sa12 * Sa12;
+  Stmp1 = Sa22 * Sa22;
+  Ss22 = Stmp1 + Ss22;
+  Stmp1 = Sa32 * Sa32;
+  Ss22 = Stmp1 + Ss22;
+  Ss32 = Sa13 * Sa12;
+  Stmp1 = Sa23 * Sa22;
+  Ss32 = Stmp1 + Ss32;
+  Stmp1 = Sa33 * Sa32;
+  Ss32 = Stmp1 + Ss32;
+  Ss33 = Sa13 * Sa13;
+  Stmp1 = Sa23 * Sa23;
+  Ss33 = Stmp1 + Ss33;
+  Stmp1 = Sa33 * Sa33;
+  Ss33 = Stmp1 + Ss33;
+  for (int sweep = 0; sweep < num_iters; sweep++) {
+    Ssh = Ss21 * Sone_half;
+    Stmp5 = Ss11 - Ss22;
+    Stmp2 = Ssh * Ssh;
+    Stmp1 = Stmp2 >= Stiny_number;
+    Ssh = Stmp1 & Ssh;
+    Sch = Stmp1 & Stmp5;
+    Stmp2 = ~Stmp1 & Sone;
+    Sch = Sch | Stmp2;
+    Stmp1 = Ssh * Ssh;
+    Stmp2 = Sch * Sch;
+    Stmp3 = Stmp1 + Stmp2;
+    Stmp4 = rsqrt(Stmp3);
+    Ssh = Stmp4 * Ssh;
+    Sch = Stmp4 * Sch;
+    Stmp1 = Sfour_gamma_squared * Stmp1;
+    Stmp1 = Stmp2 <= Stmp1;
+    Stmp2 = Ssine_pi_over_eight & Stmp1;
+    Ssh = ~Stmp1 & Ssh;
+    Ssh = Ssh | Stmp2;
+    Stmp2 = Scosine_pi_over_eight & Stmp1;
+    Sch = ~Stmp1 & Sch;
+    Sch = Sch | Stmp2;
+    Stmp1 = Ssh * Ssh;
+    Stmp2 = Sch * Sch;
+    Sc = Stmp2 - Stmp1;
+    Ss = Sch * Ssh;
+    Ss = Ss + Ss;
+    Stmp3 = Stmp1 + Stmp2;
+    Ss33 = Ss33 * Stmp3;
+    Ss31 = Ss31 * Stmp3;
+    Ss32 = Ss32 * Stmp3;
+    Ss33 = Ss33 * Stmp3;
+    Stmp1 = Ss * Ss31;
+    Stmp2 = Ss * Ss32;
+    Ss31 = Sc * Ss31;
+    Ss32 = Sc * Ss32;
+    Ss31 = Stmp2 + Ss31;
+    Ss32 = Ss32 - Stmp1;
+    Stmp2 = Ss * Ss;
+    Stmp1 = Ss22 * Stmp2;
+    Stmp3 = Ss11 * Stmp2;
+    Stmp4 = Sc * Sc;
+    Ss11 = Ss11 * Stmp4;
+    Ss22 = Ss22 * Stmp4;
+    Ss11 = Ss11 + Stmp1;
+    Ss22 = Ss22 + Stmp3;
+    Stmp4 = Stmp4 - Stmp2;
+    Stmp2 = Ss21 + Ss21;
+    Ss21 = Ss21 * Stmp4;
+    Stmp4 = Sc * Ss;
+    Stmp2 = Stmp2 * Stmp4;
+    Stmp5 = Stmp5 * Stmp4;
+    Ss11 = Ss11 + Stmp2;
+    Ss21 = Ss21 - Stmp5;
+    Ss22 = Ss22 - Stmp2;
+    Stmp1 = Ssh * Sqvvx;
+    Stmp2 = Ssh * Sqvvy;
+    Stmp3 = Ssh * Sqvvz;
+    Ssh = Ssh * Sqvs;
+    Sqvs = Sch * Sqvs;
+    Sqvvx = Sch * Sqvvx;
+    Sqvvy = Sch * Sqvvy;
+    Sqvvz = Sch * Sqvvz;
+    Sqvvz = Sqvvz + Ssh;
+    Sqvs = Sqvs - Stmp3;
+    Sqvvx = Sqvvx + Stmp2;
+    Sqvvy = Sqvvy - Stmp1;
+    Ssh = Ss32 * Sone_half;
+    Stmp5 = Ss22 - Ss33;
+    Stmp2 = Ssh * Ssh;
+    Stmp1 = Stmp2 >= Stiny_number;
+    Ssh = Stmp1 & Ssh;
+    Sch = Stmp1 & Stmp5;
+    Stmp2 = ~Stmp1 & Sone;
+    Sch = Sch | Stmp2;
+    Stmp1 = Ssh * Ssh;
+    Stmp2 = Sch * Sch;
+    Stmp3 = Stmp1 + Stmp2;
+    Stmp4 = rsqrt(Stmp3);
+    Ssh = Stmp4 * Ssh;
+    Sch = Stmp4 * Sch;
+    Stmp1 = Sfour_gamma_squared * Stmp1;
+    Stmp1 = Stmp2 <= Stmp1;
+    Stmp2 = Ssine_pi_over_eight & Stmp1;
+    Ssh = ~Stmp1 & Ssh;
+    Ssh = Ssh | Stmp2;
+    Stmp2 = Scosine_pi_over_eight & Stmp1;
+    Sch = ~Stmp1 & Sch;
+    Sch = Sch | Stmp2;
+    Stmp1 = Ssh * Ssh;
+    Stmp2 = Sch * Sch;
+    Sc = Stmp2 - Stmp1;
+    Ss = Sch * Ssh;
+    Ss = Ss + Ss;
+    Stmp3 = Stmp1 + Stmp2;
+    Ss11 = Ss11 * Stmp3;
+    Ss21 = Ss21 * Stmp3;
+    Ss31 = Ss31 * Stmp3;
+    Ss11 = Ss11 * Stmp3;
+    Stmp1 = Ss * Ss21;
+    Stmp2 = Ss * Ss31;
+    Ss21 = Sc * Ss21;
+    Ss31 = Sc * Ss31;
+    Ss21 = Stmp2 + Ss21;
+    Ss31 = Ss31 - Stmp1;
+    Stmp2 = Ss * Ss;
+    Stmp1 = Ss33 * Stmp2;
+    Stmp3 = Ss22 * Stmp2;
+    Stmp4 = Sc * Sc;
+    Ss22 = Ss22 * Stmp4;
+    Ss33 = Ss33 * Stmp4;
+    Ss22 = Ss22 + Stmp1;
+    Ss33 = Ss33 + Stmp3;
+    Stmp4 = Stmp4 - Stmp2;
+    Stmp2 = Ss32 + Ss32;
+    Ss32 = Ss32 * Stmp4;
+    Stmp4 = Sc * Ss;
+    Stmp2 = Stmp2 * Stmp4;
+    Stmp5 = Stmp5 * Stmp4;
+    Ss22 = Ss22 + Stmp2;
+    Ss32 = Ss32 - Stmp5;
+    Ss33 = Ss33 - Stmp2;
+    Stmp1 = Ssh * Sqvvx;
+    Stmp2 = Ssh * Sqvvy;
+    Stmp3 = Ssh * Sqvvz;
+    Ssh = Ssh * Sqvs;
+    Sqvs = Sch * Sqvs;
+    Sqvvx = Sch * Sqvvx;
+    Sqvvy = Sch * Sqvvy;
+    Sqvvz = Sch * Sqvvz;
+    Sqvvx = Sqvvx + Ssh;
+    Sqvs = Sqvs - Stmp1;
+    Sqvvy = Sqvvy + Stmp3;
+    Sqvvz = Sqvvz - Stmp2;
+    Ssh = Ss31 * Sone_half;
+    Stmp5 = Ss33 - Ss11;
+    Stmp2 = Ssh * Ssh;
+    Stmp1 = Stmp2 >= Stiny_number;
+    Ssh = Stmp1 & Ssh;
+    Sch = Stmp1 & Stmp5;
+    Stmp2 = ~Stmp1 & Sone;
+    Sch = Sch | Stmp2;
+    Stmp1 = Ssh * Ssh;
+    Stmp2 = Sch * Sch;
+    Stmp3 = Stmp1 + Stmp2;
+    Stmp4 = rsqrt(Stmp3);
+    Ssh = Stmp4 * Ssh;
+    Sch = Stmp4 * Sch;
+    Stmp1 = Sfour_gamma_squared * Stmp1;
+    Stmp1 = Stmp2 <= Stmp1;
+    Stmp2 = Ssine_pi_over_eight & Stmp1;
+    Ssh = ~Stmp1 & Ssh;
+    Ssh = Ssh | Stmp2;
+    Stmp2 = Scosine_pi_over_eight & Stmp1;
+    Sch = ~Stmp1 & Sch;
+    Sch = Sch | Stmp2;
+    Stmp1 = Ssh * Ssh;
+    Stmp2 = Sch * Sch;
+    Sc = Stmp2 - Stmp1;
+    Ss = Sch * Ssh;
+    Ss = Ss + Ss;
+    Stmp3 = Stmp1 + Stmp2;
+    Ss22 = Ss22 * Stmp3;
+    Ss32 = Ss32 * Stmp3;
+    Ss21 = Ss21 * Stmp3;
+    Ss22 = Ss22 * Stmp3;
+    Stmp1 = Ss * Ss32;
+    Stmp2 = Ss * Ss21;
+    Ss32 = Sc * Ss32;
+    Ss21 = Sc * Ss21;
+    Ss32 = Stmp2 + Ss32;
+    Ss21 = Ss21 - Stmp1;
+    Stmp2 = Ss * Ss;
+    Stmp1 = Ss11 * Stmp2;
+    Stmp3 = Ss33 * Stmp2;
+    Stmp4 = Sc * Sc;
+    Ss33 = Ss33 * Stmp4;
+    Ss11 = Ss11 * Stmp4;
+    Ss33 = Ss33 + Stmp1;
+    Ss11 = Ss11 + Stmp3;
+    Stmp4 = Stmp4 - Stmp2;
+    Stmp2 = Ss31 + Ss31;
+    Ss31 = Ss31 * Stmp4;
+    Stmp4 = Sc * Ss;
+    Stmp2 = Stmp2 * Stmp4;
+    Stmp5 = Stmp5 * Stmp4;
+    Ss33 = Ss33 + Stmp2;
+    Ss31 = Ss31 - Stmp5;
+    Ss11 = Ss11 - Stmp2;
+    Stmp1 = Ssh * Sqvvx;
+    Stmp2 = Ssh * Sqvvy;
+    Stmp3 = Ssh * Sqvvz;
+    Ssh = Ssh * Sqvs;
+    Sqvs = Sch * Sqvs;
+    Sqvvx = Sch * Sqvvx;
+    Sqvvy = Sch * Sqvvy;
+    Sqvvz = Sch * Sqvvz;
+    Sqvvy = Sqvvy + Ssh;
+    Sqvs = Sqvs - Stmp2;
+    Sqvvz = Sqvvz + Stmp1;
+    Sqvvx = Sqvvx - Stmp3;
+  }
+  Stmp2 = Sqvs * Sqvs;
+  Stmp1 = Sqvvx * Sqvvx;
+  Stmp2 = Stmp1 + Stmp2;
+  Stmp1 = Sqvvy * Sqvvy;
+  Stmp2 = Stmp1 + Stmp2;
+  Stmp1 = Sqvvz * Sqvvz;
+  Stmp2 = Stmp1 + Stmp2;
+  Stmp1 = rsqrt(Stmp2);
+  Stmp4 = Stmp1 * Sone_half;
+  Stmp3 = Stmp1 * Stmp4;
+  Stmp3 = Stmp1 * Stmp3;
+  Stmp3 = Stmp2 * Stmp3;
+  Stmp1 = Stmp1 + Stmp4;
+  Stmp1 = Stmp1 - Stmp3;
+  Sqvs = Sqvs * Stmp1;
+  Sqvvx = Sqvvx * Stmp1;
+  Sqvvy = Sqvvy * Stmp1;
+  Sqvvz = Sqvvz * Stmp1;
+  Stmp1 = Sqvvx * Sqvvx;
+  Stmp2 = Sqvvy * Sqvvy;
+  Stmp3 = Sqvvz * Sqvvz;
+  Sv11 = Sqvs * Sqvs;
+  Sv22 = Sv11 - Stmp1;
+  Sv33 = Sv22 - Stmp2;
+  Sv33 = Sv33 + Stmp3;
+  Sv22 = Sv22 + Stmp2;
+  Sv22 = Sv22 - Stmp3;
+  Sv11 = Sv11 + Stmp1;
+  Sv11 = Sv11 - Stmp2;
+  Sv11 = Sv11 - Stmp3;
+  Stmp1 = Sqvvx + Sqvvx;
+  Stmp2 = Sqvvy + Sqvvy;
+  Stmp3 = Sqvvz + Sqvvz;
+  Sv32 = Sqvs * Stmp1;
+  Sv13 = Sqvs * Stmp2;
+  Sv21 = Sqvs * Stmp3;
+  Stmp1 = Sqvvy * Stmp1;
+  Stmp2 = Sqvvz * Stmp2;
+  Stmp3 = Sqvvx * Stmp3;
+  Sv12 = Stmp1 - Sv21;
+  Sv23 = Stmp2 - Sv32;
+  Sv31 = Stmp3 - Sv13;
+  Sv21 = Stmp1 + Sv21;
+  Sv32 = Stmp2 + Sv32;
+  Sv13 = Stmp3 + Sv13;
+  Stmp2 = Sa12;
+  Stmp3 = Sa13;
+  Sa12 = Sv12 * Sa11;
+  Sa13 = Sv13 * Sa11;
+  Sa11 = Sv11 * Sa11;
+  Stmp1 = Sv21 * Stmp2;
+  Sa11 = Sa11 + Stmp1;
+  Stmp1 = Sv31 * Stmp3;
+  Sa11 = Sa11 + Stmp1;
+  Stmp1 = Sv22 * Stmp2;
+  Sa12 = Sa12 + Stmp1;
+  Stmp1 = Sv32 * Stmp3;
+  Sa12 = Sa12 + Stmp1;
+  Stmp1 = Sv23 * Stmp2;
+  Sa13 = Sa13 + Stmp1;
+  Stmp1 = Sv33 * Stmp3;
+  Sa13 = Sa13 + Stmp1;
+  Stmp2 = Sa22;
+  Stmp3 = Sa23;
+  Sa22 = Sv12 * Sa21;
+  Sa23 = Sv13 * Sa21;
+  Sa21 = Sv11 * Sa21;
+  Stmp1 = Sv21 * Stmp2;
+  Sa21 = Sa21 + Stmp1;
+  Stmp1 = Sv31 * Stmp3;
+  Sa21 = Sa21 + Stmp1;
+  Stmp1 = Sv22 * Stmp2;
+  Sa22 = Sa22 + Stmp1;
+  Stmp1 = Sv32 * Stmp3;
+  Sa22 = Sa22 + Stmp1;
+  Stmp1 = Sv23 * Stmp2;
+  Sa23 = Sa23 + Stmp1;
+  Stmp1 = Sv33 * Stmp3;
+  Sa23 = Sa23 + Stmp1;
+  Stmp2 = Sa32;
+  Stmp3 = Sa33;
+  Sa32 = Sv12 * Sa31;
+  Sa33 = Sv13 * Sa31;
+  Sa31 = Sv11 * Sa31;
+  Stmp1 = Sv21 * Stmp2;
+  Sa31 = Sa31 + Stmp1;
+  Stmp1 = Sv31 * Stmp3;
+  Sa31 = Sa31 + Stmp1;
+  Stmp1 = Sv22 * Stmp2;
+  Sa32 = Sa32 + Stmp1;
+  Stmp1 = Sv32 * Stmp3;
+  Sa32 = Sa32 + Stmp1;
+  Stmp1 = Sv23 * Stmp2;
+  Sa33 = Sa33 + Stmp1;
+  Stmp1 = Sv33 * Stmp3;
+  Sa33 = Sa33 + Stmp1;
+  Stmp1 = Sa11 * Sa11;
+  Stmp4 = Sa21 * Sa21;
+  Stmp1 = Stmp1 + Stmp4;
+  Stmp4 = Sa31 * Sa31;
+  Stmp1 = Stmp1 + Stmp4;
+  Stmp2 = Sa12 * Sa12;
+  Stmp4 = Sa22 * Sa22;
+  Stmp2 = Stmp2 + Stmp4;
+  Stmp4 = Sa32 * Sa32;
+  Stmp2 = Stmp2 + Stmp4;
+  Stmp3 = Sa13 * Sa13;
+  Stmp4 = Sa23 * Sa23;
+  Stmp3 = Stmp3 + Stmp4;
+  Stmp4 = Sa33 * Sa33;
+  Stmp3 = Stmp3 + Stmp4;
+  Stmp4 = Stmp1 < Stmp2;
+  Stmp5 = Sa11 ^ Sa12;
+  Stmp5 = Stmp5 & Stmp4;
+  Sa11 = Sa11 ^ Stmp5;
+  Sa12 = Sa12 ^ Stmp5;
+  Stmp5 = Sa21 ^ Sa22;
+  Stmp5 = Stmp5 & Stmp4;
+  Sa21 = Sa21 ^ Stmp5;
+  Sa22 = Sa22 ^ Stmp5;
+  Stmp5 = Sa31 ^ Sa32;
+  Stmp5 = Stmp5 & Stmp4;
+  Sa31 = Sa31 ^ Stmp5;
+  Sa32 = Sa32 ^ Stmp5;
+  Stmp5 = Sv11 ^ Sv12;
+  Stmp5 = Stmp5 & Stmp4;
+  Sv11 = Sv11 ^ Stmp5;
+  Sv12 = Sv12 ^ Stmp5;
+  Stmp5 = Sv21 ^ Sv22;
+  Stmp5 = Stmp5 & Stmp4;
+  Sv21 = Sv21 ^ Stmp5;
+  Sv22 = Sv22 ^ Stmp5;
+  Stmp5 = Sv31 ^ Sv32;
+  Stmp5 = Stmp5 & Stmp4;
+  Sv31 = Sv31 ^ Stmp5;
+  Sv32 = Sv32 ^ Stmp5;
+  Stmp5 = Stmp1 ^ Stmp2;
+  Stmp5 = Stmp5 & Stmp4;
+  Stmp1 = Stmp1 ^ Stmp5;
+  Stmp2 = Stmp2 ^ Stmp5;
+  Stmp5 = L(-2.0f);
+  Stmp5 = Stmp5 & Stmp4;
+  Stmp4 = L(1.0f);
+  Stmp4 = Stmp4 + Stmp5;
+  Sa12 = Sa12 * Stmp4;
+  Sa22 = Sa22 * Stmp4;
+  Sa32 = Sa32 * Stmp4;
+  Sv12 = Sv12 * Stmp4;
+  Sv22 = Sv22 * Stmp4;
+  Sv32 = Sv32 * Stmp4;
+  Stmp4 = Stmp1 < Stmp3;
+  Stmp5 = Sa11 ^ Sa13;
+  Stmp5 = Stmp5 & Stmp4;
+  Sa11 = Sa11 ^ Stmp5;
+  Sa13 = Sa13 ^ Stmp5;
+  Stmp5 = Sa21 ^ Sa23;
+  Stmp5 = Stmp5 & Stmp4;
+  Sa21 = Sa21 ^ Stmp5;
+  Sa23 = Sa23 ^ Stmp5;
+  Stmp5 = Sa31 ^ Sa33;
+  Stmp5 = Stmp5 & Stmp4;
+  Sa31 = Sa31 ^ Stmp5;
+  Sa33 = Sa33 ^ Stmp5;
+  Stmp5 = Sv11 ^ Sv13;
+  Stmp5 = Stmp5 & Stmp4;
+  Sv11 = Sv11 ^ Stmp5;
+  Sv13 = Sv13 ^ Stmp5;
+  Stmp5 = Sv21 ^ Sv23;
+  Stmp5 = Stmp5 & Stmp4;
+  Sv21 = Sv21 ^ Stmp5;
+  Sv23 = Sv23 ^ Stmp5;
+  Stmp5 = Sv31 ^ Sv33;
+  Stmp5 = Stmp5 & Stmp4;
+  Sv31 = Sv31 ^ Stmp5;
+  Sv33 = Sv33 ^ Stmp5;
+  Stmp5 = Stmp1 ^ Stmp3;
+  Stmp5 = Stmp5 & Stmp4;
+  Stmp1 = Stmp1 ^ Stmp5;
+  Stmp3 = Stmp3 ^ Stmp5;
+  Stmp5 = L(-2.0f);
+  Stmp5 = Stmp5 & Stmp4;
+  Stmp4 = L(1.0f);
+  Stmp4 = Stmp4 + Stmp5;
+  Sa11 = Sa11 * Stmp4;
+  Sa21 = Sa21 * Stmp4;
+  Sa31 = Sa31 * Stmp4;
+  Sv11 = Sv11 * Stmp4;
+  Sv21 = Sv21 * Stmp4;
+  Sv31 = Sv31 * Stmp4;
+  Stmp4 = Stmp2 < Stmp3;
+  Stmp5 = Sa12 ^ Sa13;
+  Stmp5 = Stmp5 & Stmp4;
+  Sa12 = Sa12 ^ Stmp5;
+  Sa13 = Sa13 ^ Stmp5;
+  Stmp5 = Sa22 ^ Sa23;
+  Stmp5 = Stmp5 & Stmp4;
+  Sa22 = Sa22 ^ Stmp5;
+  Sa23 = Sa23 ^ Stmp5;
+  Stmp5 = Sa32 ^ Sa33;
+  Stmp5 = Stmp5 & Stmp4;
+  Sa32 = Sa32 ^ Stmp5;
+  Sa33 = Sa33 ^ Stmp5;
+  Stmp5 = Sv12 ^ Sv13;
+  Stmp5 = Stmp5 & Stmp4;
+  Sv12 = Sv12 ^ Stmp5;
+  Sv13 = Sv13 ^ Stmp5;
+  Stmp5 = Sv22 ^ Sv23;
+  Stmp5 = Stmp5 & Stmp4;
+  Sv22 = Sv22 ^ Stmp5;
+  Sv23 = Sv23 ^ Stmp5;
+  Stmp5 = Sv32 ^ Sv33;
+  Stmp5 = Stmp5 & Stmp4;
+  Sv32 = Sv32 ^ Stmp5;
+  Sv33 = Sv33 ^ Stmp5;
+  Stmp5 = Stmp2 ^ Stmp3;
+  Stmp5 = Stmp5 & Stmp4;
+  Stmp2 = Stmp2 ^ Stmp5;
+  Stmp3 = Stmp3 ^ Stmp5;
+  Stmp5 = L(-2.0f);
+  Stmp5 = Stmp5 & Stmp4;
+  Stmp4 = L(1.0f);
+  Stmp4 = Stmp4 + Stmp5;
+  Sa13 = Sa13 * Stmp4;
+  Sa23 = Sa23 * Stmp4;
+  Sa33 = Sa33 * Stmp4;
+  Sv13 = Sv13 * Stmp4;
+  Sv23 = Sv23 * Stmp4;
+  Sv33 = Sv33 * Stmp4;
+  Su11 = L(1.0f);
+  Su21 = L(0.0f);
+  Su31 = L(0.0f);
+  Su12 = L(0.0f);
+  Su22 = L(1.0f);
+  Su32 = L(0.0f);
+  Su13 = L(0.0f);
+  Su23 = L(0.0f);
+  Su33 = L(1.0f);
+  Ssh = Sa21 * Sa21;
+  Ssh = Ssh >= Ssmall_number;
+  Ssh = Ssh & Sa21;
+  Stmp5 = L(0.0f);
+  Sch = Stmp5 - Sa11;
+  Sch = max(Sch, Sa11);
+  Sch = max(Sch, Ssmall_number);
+  Stmp5 = Sa11 >= Stmp5;
+  Stmp1 = Sch * Sch;
+  Stmp2 = Ssh * Ssh;
+  Stmp2 = Stmp1 + Stmp2;
+  Stmp1 = rsqrt(Stmp2);
+  Stmp4 = Stmp1 * Sone_half;
+  Stmp3 = Stmp1 * Stmp4;
+  Stmp3 = Stmp1 * Stmp3;
+  Stmp3 = Stmp2 * Stmp3;
+  Stmp1 = Stmp1 + Stmp4;
+  Stmp1 = Stmp1 - Stmp3;
+  Stmp1 = Stmp1 * Stmp2;
+  Sch = Sch + Stmp1;
+  Stmp1 = ~Stmp5 & Ssh;
+  Stmp2 = ~Stmp5 & Sch;
+  Sch = Stmp5 & Sch;
+  Ssh = Stmp5 & Ssh;
+  Sch = Sch | Stmp1;
+  Ssh = Ssh | Stmp2;
+  Stmp1 = Sch * Sch;
+  Stmp2 = Ssh * Ssh;
+  Stmp2 = Stmp1 + Stmp2;
+  Stmp1 = rsqrt(Stmp2);
+  Stmp4 = Stmp1 * Sone_half;
+  Stmp3 = Stmp1 * Stmp4;
+  Stmp3 = Stmp1 * Stmp3;
+  Stmp3 = Stmp2 * Stmp3;
+  Stmp1 = Stmp1 + Stmp4;
+  Stmp1 = Stmp1 - Stmp3;
+  Sch = Sch * Stmp1;
+  Ssh = Ssh * Stmp1;
+  Sc = Sch * Sch;
+  Ss = Ssh * Ssh;
+  Sc = Sc - Ss;
+  Ss = Ssh * Sch;
+  Ss = Ss + Ss;
+  Stmp1 = Ss * Sa11;
+  Stmp2 = Ss * Sa21;
+  Sa11 = Sc * Sa11;
+  Sa21 = Sc * Sa21;
+  Sa11 = Sa11 + Stmp2;
+  Sa21 = Sa21 - Stmp1;
+  Stmp1 = Ss * Sa12;
+  Stmp2 = Ss * Sa22;
+  Sa12 = Sc * Sa12;
+  Sa22 = Sc * Sa22;
+  Sa12 = Sa12 + Stmp2;
+  Sa22 = Sa22 - Stmp1;
+  Stmp1 = Ss * Sa13;
+  Stmp2 = Ss * Sa23;
+  Sa13 = Sc * Sa13;
+  Sa23 = Sc * Sa23;
+  Sa13 = Sa13 + Stmp2;
+  Sa23 = Sa23 - Stmp1;
+  Stmp1 = Ss * Su11;
+  Stmp2 = Ss * Su12;
+  Su11 = Sc * Su11;
+  Su12 = Sc * Su12;
+  Su11 = Su11 + Stmp2;
+  Su12 = Su12 - Stmp1;
+  Stmp1 = Ss * Su21;
+  Stmp2 = Ss * Su22;
+  Su21 = Sc * Su21;
+  Su22 = Sc * Su22;
+  Su21 = Su21 + Stmp2;
+  Su22 = Su22 - Stmp1;
+  Stmp1 = Ss * Su31;
+  Stmp2 = Ss * Su32;
+  Su31 = Sc * Su31;
+  Su32 = Sc * Su32;
+  Su31 = Su31 + Stmp2;
+  Su32 = Su32 - Stmp1;
+  Ssh = Sa31 * Sa31;
+  Ssh = Ssh >= Ssmall_number;
+  Ssh = Ssh & Sa31;
+  Stmp5 = L(0.0f);
+  Sch = Stmp5 - Sa11;
+  Sch = max(Sch, Sa11);
+  Sch = max(Sch, Ssmall_number);
+  Stmp5 = Sa11 >= Stmp5;
+  Stmp1 = Sch * Sch;
+  Stmp2 = Ssh * Ssh;
+  Stmp2 = Stmp1 + Stmp2;
+  Stmp1 = rsqrt(Stmp2);
+  Stmp4 = Stmp1 * Sone_half;
+  Stmp3 = Stmp1 * Stmp4;
+  Stmp3 = Stmp1 * Stmp3;
+  Stmp3 = Stmp2 * Stmp3;
+  Stmp1 = Stmp1 + Stmp4;
+  Stmp1 = Stmp1 - Stmp3;
+  Stmp1 = Stmp1 * Stmp2;
+  Sch = Sch + Stmp1;
+  Stmp1 = ~Stmp5 & Ssh;
+  Stmp2 = ~Stmp5 & Sch;
+  Sch = Stmp5 & Sch;
+  Ssh = Stmp5 & Ssh;
+  Sch = Sch | Stmp1;
+  Ssh = Ssh | Stmp2;
+  Stmp1 = Sch * Sch;
+  Stmp2 = Ssh * Ssh;
+  Stmp2 = Stmp1 + Stmp2;
+  Stmp1 = rsqrt(Stmp2);
+  Stmp4 = Stmp1 * Sone_half;
+  Stmp3 = Stmp1 * Stmp4;
+  Stmp3 = Stmp1 * Stmp3;
+  Stmp3 = Stmp2 * Stmp3;
+  Stmp1 = Stmp1 + Stmp4;
+  Stmp1 = Stmp1 - Stmp3;
+  Sch = Sch * Stmp1;
+  Ssh = Ssh * Stmp1;
+  Sc = Sch * Sch;
+  Ss = Ssh * Ssh;
+  Sc = Sc - Ss;
+  Ss = Ssh * Sch;
+  Ss = Ss + Ss;
+  Stmp1 = Ss * Sa11;
+  Stmp2 = Ss * Sa31;
+  Sa11 = Sc * Sa11;
+  Sa31 = Sc * Sa31;
+  Sa11 = Sa11 + Stmp2;
+  Sa31 = Sa31 - Stmp1;
+  Stmp1 = Ss * Sa12;
+  Stmp2 = Ss * Sa32;
+  Sa12 = Sc * Sa12;
+  Sa32 = Sc * Sa32;
+  Sa12 = Sa12 + Stmp2;
+  Sa32 = Sa32 - Stmp1;
+  Stmp1 = Ss * Sa13;
+  Stmp2 = Ss * Sa33;
+  Sa13 = Sc * Sa13;
+  Sa33 = Sc * Sa33;
+  Sa13 = Sa13 + Stmp2;
+  Sa33 = Sa33 - Stmp1;
+  Stmp1 = Ss * Su11;
+  Stmp2 = Ss * Su13;
+  Su11 = Sc * Su11;
+  Su13 = Sc * Su13;
+  Su11 = Su11 + Stmp2;
+  Su13 = Su13 - Stmp1;
+  Stmp1 = Ss * Su21;
+  Stmp2 = Ss * Su23;
+  Su21 = Sc * Su21;
+  Su23 = Sc * Su23;
+  Su21 = Su21 + Stmp2;
+  Su23 = Su23 - Stmp1;
+  Stmp1 = Ss * Su31;
+  Stmp2 = Ss * Su33;
+  Su31 = Sc * Su31;
+  Su33 = Sc * Su33;
+  Su31 = Su31 + Stmp2;
+  Su33 = Su33 - Stmp1;
+  Ssh = Sa32 * Sa32;
+  Ssh = Ssh >= Ssmall_number;
+  Ssh = Ssh & Sa32;
+  Stmp5 = L(0.0f);
+  Sch = Stmp5 - Sa22;
+  Sch = max(Sch, Sa22);
+  Sch = max(Sch, Ssmall_number);
+  Stmp5 = Sa22 >= Stmp5;
+  Stmp1 = Sch * Sch;
+  Stmp2 = Ssh * Ssh;
+  Stmp2 = Stmp1 + Stmp2;
+  Stmp1 = rsqrt(Stmp2);
+  Stmp4 = Stmp1 * Sone_half;
+  Stmp3 = Stmp1 * Stmp4;
+  Stmp3 = Stmp1 * Stmp3;
+  Stmp3 = Stmp2 * Stmp3;
+  Stmp1 = Stmp1 + Stmp4;
+  Stmp1 = Stmp1 - Stmp3;
+  Stmp1 = Stmp1 * Stmp2;
+  Sch = Sch + Stmp1;
+  Stmp1 = ~Stmp5 & Ssh;
+  Stmp2 = ~Stmp5 & Sch;
+  Sch = Stmp5 & Sch;
+  Ssh = Stmp5 & Ssh;
+  Sch = Sch | Stmp1;
+  Ssh = Ssh | Stmp2;
+  Stmp1 = Sch * Sch;
+  Stmp2 = Ssh * Ssh;
+  Stmp2 = Stmp1 + Stmp2;
+  Stmp1 = rsqrt(Stmp2);
+  Stmp4 = Stmp1 * Sone_half;
+  Stmp3 = Stmp1 * Stmp4;
+  Stmp3 = Stmp1 * Stmp3;
+  Stmp3 = Stmp2 * Stmp3;
+  Stmp1 = Stmp1 + Stmp4;
+  Stmp1 = Stmp1 - Stmp3;
+  Sch = Sch * Stmp1;
+  Ssh = Ssh * Stmp1;
+  Sc = Sch * Sch;
+  Ss = Ssh * Ssh;
+  Sc = Sc - Ss;
+  Ss = Ssh * Sch;
+  Ss = Ss + Ss;
+  Stmp1 = Ss * Sa21;
+  Stmp2 = Ss * Sa31;
+  Sa21 = Sc * Sa21;
+  Sa31 = Sc * Sa31;
+  Sa21 = Sa21 + Stmp2;
+  Sa31 = Sa31 - Stmp1;
+  Stmp1 = Ss * Sa22;
+  Stmp2 = Ss * Sa32;
+  Sa22 = Sc * Sa22;
+  Sa32 = Sc * Sa32;
+  Sa22 = Sa22 + Stmp2;
+  Sa32 = Sa32 - Stmp1;
+  Stmp1 = Ss * Sa23;
+  Stmp2 = Ss * Sa33;
+  Sa23 = Sc * Sa23;
+  Sa33 = Sc * Sa33;
+  Sa23 = Sa23 + Stmp2;
+  Sa33 = Sa33 - Stmp1;
+  Stmp1 = Ss * Su12;
+  Stmp2 = Ss * Su13;
+  Su12 = Sc * Su12;
+  Su13 = Sc * Su13;
+  Su12 = Su12 + Stmp2;
+  Su13 = Su13 - Stmp1;
+  Stmp1 = Ss * Su22;
+  Stmp2 = Ss * Su23;
+  Su22 = Sc * Su22;
+  Su23 = Sc * Su23;
+  Su22 = Su22 + Stmp2;
+  Su23 = Su23 - Stmp1;
+  Stmp1 = Ss * Su32;
+  Stmp2 = Ss * Su33;
+  Su32 = Sc * Su32;
+  Su33 = Sc * Su33;
+  Su32 = Su32 + Stmp2;
+  Su33 = Su33 - Stmp1;
+  u[0] = Su11;
+  u[1] = Su12;
+  u[2] = Su13;
+  u[3] = Su21;
+  u[4] = Su22;
+  u[5] = Su23;
+  u[6] = Su31;
+  u[7] = Su32;
+  u[8] = Su33;
+  v[0] = Sv11;
+  v[1] = Sv12;
+  v[2] = Sv13;
+  v[3] = Sv21;
+  v[4] = Sv22;
+  v[5] = Sv23;
+  v[6] = Sv31;
+  v[7] = Sv32;
+  v[8] = Sv33;
+  sigma[0] = Sa11;
+  sigma[1] = Sa22;
+  sigma[2] = Sa33;
+}
+
+// Decomposes the n matrices A = U diag(sigma) V^T stored as structs of
+// arrays: a[3 * i + j][k] is A_ij of matrix k, likewise for u and v, and
+// sigma[i][k] is its i-th singular value. Groups of width matrices go
+// through the lanes together, and the rest one by one. The arrays of the
+// outputs may alias those of a.
+template <int width = default_svd_width>
+void svd_batched(int n,
+                 const float *const a[9],
+                 float *const u[9],
+                 float *const sigma[3],
+                 float *const v[9],
+                 int num_iters = 5) {
+  auto decompose = [&](auto lanes, int k) {
+    using L = decltype(lanes);
+    L A[9], U[9], V[9], S[3];
+    for (int i = 0; i < 9; i++)
+      A[i] = L::load(a[i] + k);
+    svd_lanes(A, U, V, S, num_iters);
+    for (int i = 0; i < 9; i++) {
+      U[i].store(u[i] + k);
+      V[i].store(v[i] + k);
+    }
+    for (int i = 0; i < 3; i++)
+      S[i].store(sigma[i] + k);
+  };
+  int k = 0;
+  for (; k + width <= n; k += width)
+    decompose(Lanes<width>(), k);
+  for (; k < n; k++)
+    decompose(Lanes<1>(), k);
+}
+
+}  // namespace SifakisSVD
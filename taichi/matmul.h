@@ -0,0 +1,119 @@
+#pragma once
+#include <taichi/ir.h>
+#include <taichi/program.h>
+
+TLANG_NAMESPACE_BEGIN
+
+// Matrix products kept whole through the frontend, type checking and the
+// simplifications as a single MatmulStmt, instead of n * m * (2k - 1) scalar
+// statements, and expanded by irpass::scalarize late in the pipeline.
+//
+// With CompileConfig::use_tensor_cores, products of a warp-uniform matrix
+// (the same in all threads of a warp, e.g. the weights of a layer) by the
+// matrices of each thread go to the tensor cores of the GPU instead. The
+// threads of a warp stage their right-hand sides as the columns of a shared
+// memory tile, which is multiplied with WMMA instructions in 16x16x16 steps.
+// The codegen falls back to FMAs when a is not provably uniform, the GPU is
+// older than sm_70, or not all threads of the warp take part.
+
+class MatmulExpression : public Expression {
+ public:
+  std::vector<Expr> a, b;
+  int n, k, m;
+  bool tensor_cores;
+
+  MatmulExpression(const std::vector<Expr> &a,
+                   const std::vector<Expr> &b,
+                   int n,
+                   int k,
+                   int m,
+                   bool tensor_cores)
+      : n(n), k(k), m(m), tensor_cores(tensor_cores) {
+    // The tensor cores take f32 in and out, other products are promoted
+    // like chains of binary ops by type_check
+    auto operand = [&](const Expr &e) {
+      return tensor_cores ? cast(load_if_ptr(e), DataType::f32)
+                          : load_if_ptr(e);
+    };
+    for (auto &e : a)
+      this->a.push_back(operand(e));
+    for (auto &e : b)
+      this->b.push_back(operand(e));
+  }
+
+  std::string serialize() override {
+    return fmt::format("{}matmul<{}x{}x{}>", tensor_cores ? "warp_" : "", n,
+                       k, m);
+  }
+
+  void flatten(VecStatement &ret) override {
+    std::vector<Stmt *> a_stmts, b_stmts;
+    for (auto &e : a) {
+      e->flatten(ret);
+      a_stmts.push_back(e->stmt);
+    }
+    for (auto &e : b) {
+      e->flatten(ret);
+      b_stmts.push_back(e->stmt);
+    }
+    ret.push_back(
+        Stmt::make<MatmulStmt>(a_stmts, b_stmts, n, k, m, tensor_cores));
+    stmt = ret.back().get();
+  }
+};
+
+class MatmulResultExpression : public Expression {
+ public:
+  Expr mm;
+  int index;
+
+  MatmulResultExpression(const Expr &mm, int index) : mm(mm), index(index) {
+  }
+
+  std::string serialize() override {
+    return fmt::format("{}[{}]", mm->serialize(), index);
+  }
+
+  void flatten(VecStatement &ret) override {
+    mm->flatten(ret);
+    ret.push_back(Stmt::make<MatmulResultStmt>(mm->stmt, index));
+    stmt = ret.back().get();
+  }
+};
+
+// Is the product of an n x k matrix by a k x m one in the kernel being
+// defined emitted for the tensor cores? Tiles of the tensor cores are 16x16, and for
+// a single column the FMAs are about as fast. Not for differentiation.
+inline bool warp_matmul_applicable(int n, int k, int m) {
+  auto &prog = get_current_program();
+  auto &kernel = prog.get_current_kernel();
+  if (!prog.config.use_tensor_cores || !prog.config.use_llvm ||
+      kernel.arch != Arch::gpu || kernel.grad)
+    return false;
+  return (n == 16 || n == 32) && (k == 16 || k == 32) && m >= 2;
+}
+
+// Are matrix products in the kernel being defined emitted as MatmulStmts?
+// The source-to-source backends expand them in Python instead.
+inline bool matmul_applicable() {
+  return get_current_program().config.use_llvm;
+}
+
+// The n * m entries (row-major) of the product of the n x k matrix a by the
+// k x m matrix b, given as their entries in row-major order
+inline std::vector<Expr> matmul(const std::vector<Expr> &a,
+                                const std::vector<Expr> &b,
+                                int n,
+                                int k,
+                                int m) {
+  TC_ASSERT((int)a.size() == n * k && (int)b.size() == k * m);
+  auto mm = Expr::make<MatmulExpression>(a, b, n, k, m,
+                                         warp_matmul_applicable(n, k, m))
+                .eval();
+  std::vector<Expr> ret;
+  for (int i = 0; i < n * m; i++)
+    ret.push_back(Expr::make<MatmulResultExpression>(mm, i));
+  return ret;
+}
+
+TLANG_NAMESPACE_END
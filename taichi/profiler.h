@@ -1,6 +1,8 @@
 #include <algorithm>
+#include <functional>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #if defined(TC_PLATFORM_UNIX)
 #include <sys/time.h>
@@ -24,9 +26,18 @@ struct ProfileRecord {
   double min;
   double max;
   double total;
+  // Of each run of a task, for the bandwidth columns
+  TaskTraffic traffic;
+  // Of GPU tasks, for the register columns
+  TaskResources resources;
+  // Of ProfilerBase::counter_names, summed over the runs
+  std::vector<uint64> counter_totals;
+  // The CPU threads the task runs with once tuned, 0 if not tuned, see
+  // CompileConfig::cpu_thread_count_tuning
+  int num_threads;
 
   ProfileRecord(const std::string &name)
-      : name(name), counter(0), min(0), max(0), total(0) {
+      : name(name), counter(0), min(0), max(0), total(0), num_threads(0) {
   }
 
   void insert_sample(double t) {
@@ -44,30 +55,125 @@ struct ProfileRecord {
 class ProfilerBase {
  protected:
   std::vector<ProfileRecord> records;
+  std::unordered_map<std::string, int> record_ids;
   double total_time;
 
  public:
-  void clear() {
+  // Optional event counts of each run (e.g. hardware counters), written by
+  // read_counters at the start and the end of a run
+  std::vector<std::string> counter_names;
+  std::function<void(uint64 *)> read_counters;
+  // Of the machine, for the roofline columns. 0 if unknown.
+  double peak_gflops = 0;
+  double peak_bandwidth = 0;  // GB/s
+
+  // Keeps the record ids
+  virtual void clear() {
     total_time = 0;
-    records.clear();
+    for (auto &rec : records) {
+      rec = ProfileRecord(rec.name);
+    }
   }
 
   virtual void sync() = 0;
 
   virtual std::string title() = 0;
 
-  virtual void start(const std::string &kernel_name) = 0;
+  // Ids stay valid for the lifetime of the profiler, so that launches can
+  // look them up once
+  int get_record_id(const std::string &name) {
+    auto it = record_ids.find(name);
+    if (it != record_ids.end())
+      return it->second;
+    records.emplace_back(name);
+    record_ids[name] = (int)records.size() - 1;
+    return (int)records.size() - 1;
+  }
+
+  const std::vector<ProfileRecord> &get_records() {
+    sync();
+    return records;
+  }
+
+  void set_traffic(int record_id, const TaskTraffic &traffic) {
+    records[record_id].traffic = traffic;
+  }
+
+  void set_resources(int record_id, const TaskResources &resources) {
+    records[record_id].resources = resources;
+  }
+
+  void set_num_threads(int record_id, int num_threads) {
+    records[record_id].num_threads = num_threads;
+  }
+
+  virtual void start(int record_id) = 0;
   virtual void stop() = 0;
 
+  void start(const std::string &name) {
+    start(get_record_id(name));
+  }
+
+  void start(const std::string &name, const TaskTraffic &traffic) {
+    auto id = get_record_id(name);
+    set_traffic(id, traffic);
+    start(id);
+  }
+
   void print() {
     sync();
     printf("%s\n", title().c_str());
     for (auto &rec : records) {
+      if (rec.counter == 0)
+        continue;
       printf(
           "[%6.2f%%] %30s     min %7.3f ms   avg %7.3f ms    max %7.3f ms   "
-          "total %7.3f s [%7dx]\n",
+          "total %7.3f s [%7dx]",
           rec.total / total_time * 100.0f, rec.name.c_str(), rec.min,
           rec.total / rec.counter, rec.max, rec.total / 1000.0f, rec.counter);
+      if (rec.num_threads > 0)
+        printf("  %3d threads", rec.num_threads);
+      if (rec.resources.num_registers > 0) {
+        // Local memory is mostly register spills
+        auto &r = rec.resources;
+        printf("  %3d regs  %5d B local  %6d B shared", r.num_registers,
+               r.local_bytes, r.shared_bytes);
+      }
+      if (rec.traffic.num_elements > 0) {
+        // Estimated from the fields accessed, see TaskTraffic
+        auto &t = rec.traffic;
+        auto avg_s = rec.total / rec.counter * 1e-3;
+        printf("  R %8.2f MB  W %8.2f MB  %7.2f GB/s  %8.3f ns/elem",
+               t.bytes_read * 1e-6, t.bytes_written * 1e-6,
+               (t.bytes_read + t.bytes_written) / avg_s * 1e-9,
+               avg_s * 1e9 / t.num_elements);
+        if (t.flops > 0)
+          print_roofline(t, avg_s);
+      }
+      // Averages per run
+      for (int i = 0; i < (int)rec.counter_totals.size(); i++) {
+        printf("  %s %.4g", counter_names[i].c_str(),
+               (double)rec.counter_totals[i] / rec.counter);
+      }
+      printf("\n");
+    }
+  }
+
+  // Achieved GFLOP/s and arithmetic intensity, and with the peaks, which of
+  // them bounds the task and how close it gets to that bound
+  void print_roofline(const TaskTraffic &t, double avg_s) {
+    auto bytes = (double)(t.bytes_read + t.bytes_written);
+    auto gflops = t.flops / avg_s * 1e-9;
+    printf("  %8.2f GFLOP/s", gflops);
+    if (bytes > 0)
+      printf("  %6.2f flop/B", t.flops / bytes);
+    if (peak_gflops > 0 && peak_bandwidth > 0) {
+      // The roof at this intensity
+      auto roof = peak_gflops;
+      if (bytes > 0)
+        roof = std::min(roof, t.flops / bytes * peak_bandwidth);
+      printf("  %s-bound %5.1f%% of peak",
+             roof < peak_gflops ? "memory" : "compute", gflops / roof * 100);
     }
   }
 
@@ -75,23 +181,64 @@ class ProfilerBase {
   }
 };
 
+// Times launches with pairs of CUDA events from a fixed ring, which are
+// harvested (without synchronizing) as later launches find them completed
 class GPUProfiler : public ProfilerBase {
  public:
+  using ProfilerBase::start;
+
 #if defined(TLANG_WITH_CUDA)
-  cudaEvent_t current_stop;
+  struct Launch {
+    cudaEvent_t start = nullptr;
+    cudaEvent_t stop = nullptr;
+    int record_id;
+  };
 
-  std::map<std::string, std::vector<std::pair<cudaEvent_t, cudaEvent_t>>>
-      outstanding_events;
+  static constexpr int ring_size = 1024;
+  std::vector<Launch> ring;
+  // Launches [tail, head) are in flight, in slots modulo ring_size
+  uint64 head = 0, tail = 0;
+
+  // Stops at the first launch still running, unless blocking
+  void harvest(bool blocking) {
+    while (tail < head) {
+      auto &launch = ring[tail % ring_size];
+      if (blocking) {
+        cudaEventSynchronize(launch.stop);
+      } else if (cudaEventQuery(launch.stop) != cudaSuccess) {
+        // Not an error, but it would linger as the last error
+        cudaGetLastError();
+        break;
+      }
+      float ms;
+      cudaEventElapsedTime(&ms, launch.start, launch.stop);
+      records[launch.record_id].insert_sample(ms);
+      total_time += ms;
+      tail++;
+    }
+  }
 #endif
 
-  void start(const std::string &kernel_name) override {
+  GPUProfiler() {
 #if defined(TLANG_WITH_CUDA)
-    cudaEvent_t start, stop;
-    cudaEventCreate(&start);
-    cudaEventCreate(&stop);
-    cudaEventRecord(start);
-    outstanding_events[kernel_name].push_back(std::make_pair(start, stop));
-    current_stop = stop;
+    ring.resize(ring_size);
+#endif
+    total_time = 0;
+  }
+
+  void start(int record_id) override {
+#if defined(TLANG_WITH_CUDA)
+    if (head - tail == ring_size)
+      cudaEventSynchronize(ring[tail % ring_size].stop);
+    harvest(false);
+    auto &launch = ring[head % ring_size];
+    // Created on first use, and reused for the lifetime of the profiler
+    if (!launch.start) {
+      cudaEventCreate(&launch.start);
+      cudaEventCreate(&launch.stop);
+    }
+    launch.record_id = record_id;
+    cudaEventRecord(launch.start);
 #else
     printf("GPU Profiler not implemented;\n");
 #endif
@@ -99,7 +246,8 @@ class GPUProfiler : public ProfilerBase {
 
   virtual void stop() override {
 #if defined(TLANG_WITH_CUDA)
-    cudaEventRecord(current_stop);
+    cudaEventRecord(ring[head % ring_size].stop);
+    head++;
 #else
     printf("GPU Profiler not implemented;\n");
 #endif
@@ -111,40 +259,57 @@ class GPUProfiler : public ProfilerBase {
 
   void sync() override {
 #if defined(TLANG_WITH_CUDA)
-    cudaDeviceSynchronize();
-    for (auto &map_elem : outstanding_events) {
-      auto &list = map_elem.second;
-      for (auto &item : list) {
-        auto start = item.first, stop = item.second;
-        float ms;
-        cudaEventElapsedTime(&ms, start, stop);
-        auto it = std::find_if(
-            records.begin(), records.end(),
-            [&](ProfileRecord &r) { return r.name == map_elem.first; });
-        if (it == records.end()) {
-          records.emplace_back(map_elem.first);
-          it = std::prev(records.end());
-        }
-        it->insert_sample(ms);
-        total_time += ms;
-      }
-    }
-    outstanding_events.clear();
+    harvest(true);
 #else
     printf("GPU Profiler not implemented;\n");
 #endif
   }
 
+  void clear() override {
+    sync();
+    ProfilerBase::clear();
+  }
+
+  ~GPUProfiler() {
+#if defined(TLANG_WITH_CUDA)
+    for (auto &launch : ring) {
+      if (launch.start) {
+        cudaEventDestroy(launch.start);
+        cudaEventDestroy(launch.stop);
+      }
+    }
+#endif
+  }
+
   static GPUProfiler &get_instance() {
     static GPUProfiler profiler;
     return profiler;
   }
 };
 
+// One pass in the compilation of a kernel, see
+// CompileConfig::profile_compilation
+struct CompilePassRecord {
+  std::string kernel;
+  std::string pass;
+  double time;
+  // Statements of the kernel IR before and after the pass, or -1 for stages
+  // after the IR is lowered (e.g. LLVM optimization)
+  int num_statements_before;
+  int num_statements_after;
+};
+
 class CPUProfiler : public ProfilerBase {
  public:
+  using ProfilerBase::start;
+
   double start_t;
-  std::string event_name;
+  int current_record_id;
+  std::vector<uint64> start_counters, stop_counters;
+
+  CPUProfiler() {
+    total_time = 0;
+  }
 
   void sync() override {
   }
@@ -153,23 +318,28 @@ class CPUProfiler : public ProfilerBase {
     return "CPU Profiler";
   }
 
-  void start(const std::string &kernel_name) override {
+  void start(int record_id) override {
+    current_record_id = record_id;
+    if (read_counters) {
+      start_counters.resize(counter_names.size());
+      read_counters(start_counters.data());
+    }
     start_t = get_time();
-    event_name = kernel_name;
   }
 
   void stop() override {
     auto t = get_time() - start_t;
     auto ms = t * 1000.0;
-    auto it =
-        std::find_if(records.begin(), records.end(),
-                     [&](ProfileRecord &r) { return r.name == event_name; });
-    if (it == records.end()) {
-      records.emplace_back(event_name);
-      it = std::prev(records.end());
-    }
-    it->insert_sample(ms);
+    auto &rec = records[current_record_id];
+    rec.insert_sample(ms);
     total_time += ms;
+    if (read_counters) {
+      stop_counters.resize(counter_names.size());
+      read_counters(stop_counters.data());
+      rec.counter_totals.resize(counter_names.size());
+      for (int i = 0; i < (int)counter_names.size(); i++)
+        rec.counter_totals[i] += stop_counters[i] - start_counters[i];
+    }
   }
 };
 
@@ -1,6 +1,7 @@
 // Program, which is a context for a taichi program execution
 
 #include <taichi/common/task.h>
+#include <taichi/system/timeline.h>
 #include "program.h"
 #include "snode.h"
 #include "backends/struct.h"
@@ -17,7 +18,9 @@
 TLANG_NAMESPACE_BEGIN
 
 Program *current_program = nullptr;
+thread_local Program *compiling_program = nullptr;
 std::atomic<int> Program::num_instances;
+thread_local Kernel *Program::compiling_kernel = nullptr;
 SNode root;
 
 FunctionType Program::compile(Kernel &kernel) {
@@ -34,11 +37,91 @@ FunctionType Program::compile(Kernel &kernel) {
     TC_NOT_IMPLEMENTED;
   }
   TC_ASSERT(ret);
+  record_compile_pass(kernel, "Total", Time::get_time() - start_t);
   total_compilation_time += Time::get_time() - start_t;
   return ret;
 }
 
+void Program::compile_kernels(const std::vector<Kernel *> &kernels) {
+  if (config.use_llvm) {
+    for (auto kernel : kernels)
+      kernel->compile();
+    return;
+  }
+  auto start_t = Time::get_time();
+  // Kernel::compile locks a single kernel and then the program. The kernels
+  // are locked in a fixed order.
+  auto sorted = kernels;
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  std::vector<std::unique_lock<std::mutex>> locks;
+  for (auto kernel : sorted)
+    locks.emplace_back(kernel->compilation_mutex);
+  std::lock_guard<std::mutex> _(compilation_mutex);
+
+  std::vector<Kernel *> pending;
+  std::vector<std::unique_ptr<KernelCodeGen>> codegens;
+  for (auto kernel : sorted) {
+    if (kernel->is_compiled)
+      continue;
+    std::unique_ptr<KernelCodeGen> codegen;
+    if (kernel->arch == Arch::x86_64) {
+      codegen = std::make_unique<CPUCodeGen>(kernel->name);
+    } else if (kernel->arch == Arch::gpu) {
+      codegen = std::make_unique<GPUCodeGen>(kernel->name);
+    } else {
+      TC_NOT_IMPLEMENTED;
+    }
+    compiling_kernel = kernel;
+    compiling_program = this;
+    {
+      IRArena::Guard __(kernel->ir_arena.get());
+      codegen->generate_source(*this, *kernel);
+    }
+    compiling_kernel = nullptr;
+    compiling_program = nullptr;
+    pending.push_back(kernel);
+    codegens.push_back(std::move(codegen));
+  }
+  std::vector<CodeGenBase *> sources;
+  for (auto &codegen : codegens)
+    sources.push_back(codegen.get());
+  CodeGenBase::generate_binaries(sources, "");
+  for (int i = 0; i < (int)pending.size(); i++)
+    pending[i]->set_compiled(codegens[i]->load_function());
+  total_compilation_time += Time::get_time() - start_t;
+}
+
+void Program::record_compile_pass(const Kernel &kernel,
+                                  const std::string &pass,
+                                  float64 time,
+                                  int num_statements_before,
+                                  int num_statements_after) {
+  if (!config.profile_compilation)
+    return;
+  auto kernel_name = kernel.name + (kernel.grad ? "_grad" : "");
+  compile_pass_records.push_back({kernel_name, pass, time,
+                                  num_statements_before,
+                                  num_statements_after});
+}
+
+void Program::compile_async(Kernel &kernel) {
+  if (!config.async_compilation)
+    return;
+  if (!compilation_queue)
+    compilation_queue = std::make_unique<CompilationQueue>();
+  compilation_queue->push(&kernel);
+}
+
+void Program::reoptimize_async(Kernel &kernel) {
+  if (!compilation_queue)
+    compilation_queue = std::make_unique<CompilationQueue>();
+  compilation_queue->push([&kernel] { kernel.reoptimize(); });
+}
+
 void Program::materialize_layout() {
+  // Background compilation may be reading the struct modules
+  std::lock_guard<std::mutex> _(compilation_mutex);
   // always use arch=x86_64 since this is for host accessors
   std::unique_ptr<StructCompiler> scomp =
       StructCompiler::make(config.use_llvm, Arch::x86_64);
@@ -57,17 +140,377 @@ void Program::materialize_layout() {
   }
 }
 
+SNode *Program::add_snode_tree() {
+  TC_ERROR_UNLESS(config.use_llvm,
+                  "Layouts can only be extended with the LLVM backends");
+  TC_ERROR_UNLESS(llvm_runtime, "The layout is not materialized");
+  snode_trees.push_back(std::make_unique<SNode>(0, SNodeType::root));
+  return snode_trees.back().get();
+}
+
+void Program::materialize_snode_tree(SNode *root) {
+  // The runtime is updated from the host
+  synchronize();
+  std::lock_guard<std::mutex> _(compilation_mutex);
+  auto scomp = StructCompiler::make(config.use_llvm, Arch::x86_64, true);
+  scomp->run(*root, true);
+  scomp->creator();
+  if (config.arch == Arch::gpu) {
+    auto scomp_gpu = StructCompiler::make(config.use_llvm, Arch::gpu, true);
+    scomp_gpu->run(*root, false);
+  }
+}
+
+void Program::reserve_temporaries(std::size_t size) {
+  if (size <= temporaries_capacity)
+    return;
+  // Launched kernels may still be using the current arena
+  synchronize();
+  while (temporaries_capacity < size)
+    temporaries_capacity *= 2;
+  // The runtime is on unified memory, so the host sets it on GPUs as well
+  auto set_temporaries =
+      llvm_context_host->lookup_function<std::function<void(void *, void *)>>(
+          "Runtime_set_temporaries");
+  // The old arena stays in the memory pool until the program is finalized
+  set_temporaries(llvm_runtime, allocate(temporaries_capacity, 1024));
+}
+
 void Program::synchronize() {
+  flush_deferred_launches();
+  Timeline::Guard _("synchronize", "sync");
   if (!sync) {
     if (config.arch == Arch::gpu) {
 #if defined(CUDA_FOUND)
+      auto begin_cycles = launch_breakdown.enabled ? Time::get_cycles() : 0;
       cudaDeviceSynchronize();
+      if (launch_breakdown.enabled) {
+        launch_breakdown.cycles[LaunchBreakdown::sync] +=
+            Time::get_cycles() - begin_cycles;
+      }
+      for (auto &launch : pending_launches)
+        cuda_context->destroy_event((CUevent)launch.event);
+      pending_launches.clear();
 #else
       TC_ERROR("No CUDA support");
 #endif
     }
     sync = true;
+    drain_debug_records();
+    check_out_of_bound_reports();
+    check_full_hash_tables();
+  }
+}
+
+int Program::register_debug_message(const std::string &message,
+                                    DataType dt) {
+  std::lock_guard<std::mutex> _(debug_messages_mutex);
+  debug_messages.emplace_back(message, dt);
+  return (int)debug_messages.size() - 1;
+}
+
+void Program::drain_debug_records() {
+  if (!runtime_counters)
+    return;
+  auto &counters = *runtime_counters;
+  auto end = counters.num_debug_records;
+  auto begin = num_drained_debug_records;
+  if (begin == end)
+    return;
+  num_drained_debug_records = end;
+  if (end - begin > taichi_max_num_debug_records) {
+    TC_WARN("{} printed values or failed assertions were overwritten",
+            end - begin - taichi_max_num_debug_records);
+    begin = end - taichi_max_num_debug_records;
+  }
+  std::string failed_assertion;
+  std::lock_guard<std::mutex> _(debug_messages_mutex);
+  for (auto i = begin; i < end; i++) {
+    auto &record = counters.debug_records[i % taichi_max_num_debug_records];
+    auto &message = debug_messages[record.message_id];
+    auto bits = record.value;
+    auto dt = message.second;
+    if (dt == DataType::unknown) {
+      if (failed_assertion.empty())
+        failed_assertion = message.first;
+    } else if (dt == DataType::i32 || dt == DataType::i64) {
+      std::printf("[debug] %s = %lld\n", message.first.c_str(),
+                  (long long)bits);
+    } else if (dt == DataType::f32) {
+      float32 value;
+      auto bits32 = (uint32)bits;
+      std::memcpy(&value, &bits32, sizeof(value));
+      std::printf("[debug] %s = %f\n", message.first.c_str(), value);
+    } else {
+      float64 value;
+      std::memcpy(&value, &bits, sizeof(value));
+      std::printf("[debug] %s = %.12f\n", message.first.c_str(), value);
+    }
+  }
+  std::fflush(stdout);
+  if (!failed_assertion.empty())
+    TC_ERROR("Assertion failure: {}", failed_assertion);
+}
+
+int Program::register_bound_check(const std::string &access,
+                                  int num_indices) {
+  std::lock_guard<std::mutex> _(bound_checks_mutex);
+  bound_checks.emplace_back(access, num_indices);
+  return (int)bound_checks.size() - 1;
+}
+
+void Program::check_out_of_bound_reports() {
+  if (!runtime_counters || runtime_counters->out_of_bound_check == 0)
+    return;
+  auto &counters = *runtime_counters;
+  std::pair<std::string, int> check;
+  {
+    std::lock_guard<std::mutex> _(bound_checks_mutex);
+    check = bound_checks[counters.out_of_bound_check - 1];
+  }
+  counters.out_of_bound_check = 0;
+  std::string indices;
+  for (int i = 0; i < check.second; i++) {
+    indices += fmt::format("{}{}", i ? ", " : "",
+                           counters.out_of_bound_indices[i]);
+  }
+  TC_ERROR("Out of bound access to {}, with index ({})", check.first,
+           indices);
+}
+
+void Program::check_full_hash_tables() {
+  if (!runtime_counters || runtime_counters->full_hash_table == 0)
+    return;
+  auto snode_id = runtime_counters->full_hash_table - 1;
+  runtime_counters->full_hash_table = 0;
+  TC_ERROR("The hash table of SNode {} is full, increase its capacity",
+           snode_id);
+}
+
+std::map<std::string, uint64> Program::get_runtime_counters() {
+  synchronize();
+  std::map<std::string, uint64> ret;
+  ret["kernel_launches"] = num_kernel_launches;
+  ret["compile_cache_hits"] = num_compile_cache_hits;
+  ret["compile_cache_misses"] = num_compile_cache_misses;
+  ret["offline_cache_hits"] = num_offline_cache_hits;
+  ret["reused_tasks"] = num_reused_tasks;
+  ret["skipped_list_tasks"] = num_skipped_list_tasks;
+  ret["nparray_bytes"] = num_nparray_bytes;
+  if (!runtime_counters)
+    return ret;
+  ret["atomic_ops"] = runtime_counters->atomic_ops;
+  std::function<void(SNode *)> visit = [&](SNode *snode) {
+    if (snode->type == SNodeType::place)
+      return;
+    ret[fmt::format("list_elements:{}", snode->id)] =
+        runtime_counters->list_elements[snode->id];
+    if (snode->stat_func) {
+      ret[fmt::format("allocated_nodes:{}", snode->id)] =
+          snode->stat().num_allocations;
+    }
+    for (auto &ch : snode->ch)
+      visit(ch.get());
+  };
+  visit(snode_root);
+  for (auto &tree : snode_trees)
+    visit(tree.get());
+  return ret;
+}
+
+std::map<std::string, std::pair<int, double>> Program::get_profiler_records() {
+  std::map<std::string, std::pair<int, double>> ret;
+  if (!config.use_llvm)
+    return ret;
+  for (auto &rec : profiler_llvm->get_records()) {
+    if (rec.counter)
+      ret[rec.name] = std::make_pair(rec.counter, rec.total);
+  }
+  return ret;
+}
+
+int Program::run_device_loop(const std::vector<Kernel *> &kernels,
+                             SNode *done,
+                             int max_iterations,
+                             int check_interval) {
+  TC_ERROR_UNLESS(config.use_llvm && runtime_counters,
+                  "Device loops need an LLVM backend");
+  TC_ERROR_UNLESS(done->type == SNodeType::place && done->dt == DataType::i32 &&
+                      done->num_active_indices == 0,
+                  "The condition of a device loop must be a 0-D i32 tensor");
+  TC_ERROR_UNLESS(done->cell_func && done->cell_func({}),
+                  "The condition of a device loop must be dense");
+  for (auto kernel : kernels) {
+    TC_ERROR_UNLESS(kernel->args.empty(),
+                    "Kernel {} of a device loop takes arguments",
+                    kernel->name);
+  }
+  check_interval = std::max(check_interval, 1);
+  auto gate = (int32 *)done->cell_func({});
+  synchronize();
+  if (*gate)
+    return 0;
+  runtime_counters->loop_iterations = 0;
+  context.loop_gate = gate;
+  for (int i = 0; i < max_iterations && !*gate;) {
+    auto end = std::min(i + check_interval, max_iterations);
+    for (; i < end; i++) {
+      context.loop_iteration = i + 1;
+      for (auto kernel : kernels)
+        (*kernel)();
+    }
+    synchronize();
+  }
+  context.loop_gate = nullptr;
+  context.loop_iteration = 0;
+  return (int)runtime_counters->loop_iterations;
+}
+
+void Program::defer_launch(Kernel &kernel) {
+  for (auto &arg : kernel.args) {
+    // The caller may read the array as soon as we return
+    if (arg.is_nparray) {
+      kernel();
+      return;
+    }
+  }
+  deferred_launches.emplace_back(&kernel, context);
+}
+
+void Program::flush_deferred_launches() {
+  if (deferred_launches.empty())
+    return;
+  auto launches = std::move(deferred_launches);
+  deferred_launches.clear();
+  for (auto &launch : launches) {
+    auto num_args = launch.first->args.size();
+    std::memcpy(context.args, launch.second.args,
+                sizeof(context.args[0]) * num_args);
+    std::memcpy(context.extra_args, launch.second.extra_args,
+                sizeof(context.extra_args[0]) * num_args);
+    (*launch.first)();
+  }
+}
+
+void Program::begin_overlapped_launch(Kernel &kernel) {
+#if defined(CUDA_FOUND)
+  constexpr int max_num_pending_launches = 64;
+  if ((int)pending_launches.size() >= max_num_pending_launches)
+    synchronize();
+  // The launches that completed impose no order
+  std::vector<PendingLaunch> running;
+  for (auto &launch : pending_launches) {
+    if (cuda_context->event_done((CUevent)launch.event))
+      cuda_context->destroy_event((CUevent)launch.event);
+    else
+      running.push_back(launch);
+  }
+  pending_launches = std::move(running);
+  constexpr int n = CUDAContext::max_num_streams;
+  // The event of the last conflicting launch on each stream
+  std::vector<void *> waits(n, nullptr);
+  std::vector<bool> busy(n, false);
+  int stream = -1;
+  for (auto &launch : pending_launches) {
+    busy[launch.stream] = true;
+    if (!launch.accesses || launch.accesses->conflicts_with(kernel.accesses)) {
+      waits[launch.stream] = launch.event;
+      stream = launch.stream;
+    }
+  }
+  if (stream == -1) {
+    stream = int(std::find(busy.begin(), busy.end(), false) - busy.begin());
+    if (stream == n)
+      stream = int(num_kernel_launches % n);
+  }
+  // There is a single temporary arena, so kernels using it must be ordered
+  // after each other. Their accesses include the arena, which does that.
+  for (auto &launch : pending_launches) {
+    TC_ASSERT(kernel.temporaries_size == 0 || !launch.uses_temporaries ||
+              launch.stream == stream || waits[launch.stream]);
   }
+  cuda_context->set_stream(stream);
+  for (int i = 0; i < n; i++) {
+    if (i != stream && waits[i])
+      cuda_context->wait_event((CUevent)waits[i]);
+  }
+#else
+  TC_ERROR("No CUDA support");
+#endif
+}
+
+void Program::end_overlapped_launch(Kernel &kernel) {
+#if defined(CUDA_FOUND)
+  pending_launches.push_back({&kernel.accesses, cuda_context->get_stream(),
+                              cuda_context->record_event(),
+                              kernel.temporaries_size > 0});
+  cuda_context->set_stream(0);
+#endif
+}
+
+void Program::join_overlapped_launches() {
+#if defined(CUDA_FOUND)
+  if (pending_launches.empty())
+    return;
+  cuda_context->set_stream(0);
+  for (auto &launch : pending_launches) {
+    if (launch.stream != 0)
+      cuda_context->wait_event((CUevent)launch.event);
+    cuda_context->destroy_event((CUevent)launch.event);
+  }
+  pending_launches.clear();
+  pending_launches.push_back(
+      {nullptr, 0, cuda_context->record_event(), false});
+#endif
+}
+
+Program::ExtArrBuffer &Program::get_ext_arr_buffer(void *host_ptr,
+                                                  std::size_t size) {
+#if defined(CUDA_FOUND)
+  constexpr int max_num_ext_arr_buffers = 64;
+  auto key = std::make_pair((uint64)host_ptr, (uint64)size);
+  auto it = ext_arr_buffers.find(key);
+  if (it == ext_arr_buffers.end()) {
+    if ((int)ext_arr_buffers.size() >= max_num_ext_arr_buffers) {
+      // Evict the least recently used buffer
+      auto lru = ext_arr_buffers.begin();
+      for (auto i = ext_arr_buffers.begin(); i != ext_arr_buffers.end(); i++) {
+        if (i->second.last_use < lru->second.last_use)
+          lru = i;
+      }
+      cudaDeviceSynchronize();
+      cudaFree(lru->second.device_ptr);
+      cudaFreeHost(lru->second.staging_ptr);
+      cudaEventDestroy((cudaEvent_t)lru->second.staging_event);
+      ext_arr_buffers.erase(lru);
+    }
+    ExtArrBuffer buffer;
+    check_cuda_errors(cudaMalloc(&buffer.device_ptr, size));
+    check_cuda_errors(cudaHostAlloc(&buffer.staging_ptr, size, 0));
+    cudaEvent_t event;
+    check_cuda_errors(cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
+    buffer.staging_event = (void *)event;
+    it = ext_arr_buffers.insert(std::make_pair(key, buffer)).first;
+  }
+  it->second.last_use = ext_arr_buffer_timestamp++;
+  return it->second;
+#else
+  TC_ERROR("No CUDA support");
+#endif
+}
+
+void Program::free_ext_arr_buffers() {
+#if defined(CUDA_FOUND)
+  if (ext_arr_buffers.empty())
+    return;
+  cudaDeviceSynchronize();
+  for (auto &it : ext_arr_buffers) {
+    cudaFree(it.second.device_ptr);
+    cudaFreeHost(it.second.staging_ptr);
+    cudaEventDestroy((cudaEvent_t)it.second.staging_event);
+  }
+  ext_arr_buffers.clear();
+#endif
 }
 
 std::string capitalize_first(std::string s) {
@@ -160,8 +603,9 @@ Program::Program(Arch arch) {
     arch = Arch::x86_64;
   }
 #else
-  if (!cuda_context) {
-    cuda_context = std::make_unique<CUDAContext>();
+  auto device_id = default_compile_config.device_id;
+  if (!cuda_context || cuda_context->get_device_id() != device_id) {
+    cuda_context = std::make_unique<CUDAContext>(device_id);
     if (!cuda_context->detected()) {
       TC_WARN("No CUDA device detected.");
       TC_WARN("Falling back to x86_64");
@@ -179,31 +623,89 @@ Program::Program(Arch arch) {
   current_program = this;
   config = default_compile_config;
   config.arch = arch;
+  thread_pool.spin_window_us = config.cpu_spin_window_us;
+  launch_breakdown.enabled = config.launch_breakdown;
+  thread_pool.count_dispatch_cycles = config.launch_breakdown;
+  Timeline::get_instance().enabled = config.timeline;
+  allocator()->set_huge_pages(config.use_huge_pages);
+  if (config.cpu_numa_pinning)
+    thread_pool.pin_threads();
   if (config.use_llvm) {
-    llvm_context_host = std::make_unique<TaichiLLVMContext>(Arch::x86_64);
+    llvm_context_host = TaichiLLVMContext::acquire(Arch::x86_64);
     if (config.arch == Arch::x86_64) {
       profiler_llvm = std::make_unique<CPUProfiler>();
+      if (config.profile_hardware_counters) {
+        if (hardware_counters.open(thread_pool.thread_tids)) {
+          profiler_llvm->counter_names = HardwareCounters::names();
+          profiler_llvm->read_counters = [this](uint64 *values) {
+            hardware_counters.read(values);
+          };
+        } else {
+          TC_WARN("Hardware performance counters are not available.");
+        }
+      }
     } else {
       profiler_llvm = std::make_unique<GPUProfiler>();
     }
+    profiler_llvm->peak_gflops = config.peak_gflops;
+    profiler_llvm->peak_bandwidth = config.peak_bandwidth;
+    if (config.profile_source_lines) {
+      source_profiler.interval_us = config.source_profiler_interval_us;
+      if (config.arch != Arch::x86_64) {
+        TC_WARN("Source lines are only profiled on CPUs.");
+      } else if (source_profiler.start()) {
+        llvm_context_host->set_source_profiler(&source_profiler);
+      } else {
+        TC_WARN("Source line profiling is not available on this platform.");
+      }
+    }
   }
   auto env_debug = getenv("TI_DEBUG");
   if (env_debug && env_debug == std::string("1"))
     config.debug = true;
+  auto env_check_out_of_bound = getenv("TI_CHECK_OUT_OF_BOUND");
+  if (env_check_out_of_bound && env_check_out_of_bound == std::string("1"))
+    config.check_out_of_bound = true;
   current_kernel = nullptr;
   snode_root = nullptr;
   sync = true;
   llvm_runtime = nullptr;
+  num_drained_debug_records = 0;
+  temporaries_capacity = taichi_max_num_global_vars;
+  ext_arr_buffer_timestamp = 0;
+  num_kernel_launches = 0;
+  num_compile_cache_hits = 0;
+  num_compile_cache_misses = 0;
+  num_offline_cache_hits = 0;
+  num_reused_tasks = 0;
+  num_skipped_list_tasks = 0;
+  num_nparray_bytes = 0;
+  runtime_counters = nullptr;
+  num_kernel_page_faults = 0;
   finalized = false;
 }
 
 void Program::initialize_device_llvm_context() {
   if (config.arch == Arch::gpu && config.use_llvm) {
     if (llvm_context_device == nullptr)
-      llvm_context_device = std::make_unique<TaichiLLVMContext>(Arch::gpu);
+      llvm_context_device = TaichiLLVMContext::acquire(Arch::gpu);
   }
 }
 
+Kernel &Program::create_host_twin(Kernel &kernel,
+                                  const std::function<void()> &body) {
+  // Compiled on the first launch that splits, since the arch is set after
+  // the definition
+  auto lazy_compilation = config.lazy_compilation;
+  config.lazy_compilation = true;
+  auto &twin = this->kernel(body, kernel.name + "_host", kernel.grad,
+                            kernel.keep_primal);
+  config.lazy_compilation = lazy_compilation;
+  twin.set_arch(get_host_arch());
+  twin.is_host_twin = true;
+  return twin;
+}
+
 Kernel &Program::get_snode_reader(SNode *snode) {
   TC_ASSERT(snode->type == SNodeType::place);
   auto kernel_name = fmt::format("snode_reader_{}", snode->id);
@@ -220,7 +722,7 @@ Kernel &Program::get_snode_reader(SNode *snode) {
   ker.name = kernel_name;
   for (int i = 0; i < snode->num_active_indices; i++)
     ker.insert_arg(DataType::i32, false);
-  auto ret_val = ker.insert_arg(snode->dt, false);
+  auto ret_val = ker.insert_arg(compute_type(snode->dt), false);
   ker.mark_arg_return_value(ret_val);
   return ker;
 }
@@ -240,7 +742,70 @@ Kernel &Program::get_snode_writer(SNode *snode) {
   ker.name = kernel_name;
   for (int i = 0; i < snode->num_active_indices; i++)
     ker.insert_arg(DataType::i32, false);
-  ker.insert_arg(snode->dt, false);
+  ker.insert_arg(compute_type(snode->dt), false);
+  return ker;
+}
+
+Kernel &Program::get_snode_gatherer(SNode *snode) {
+  TC_ASSERT(snode->type == SNodeType::place);
+  TC_ERROR_UNLESS(snode->num_active_indices > 0,
+                  "Batched accesses need a tensor with indices");
+  auto kernel_name = fmt::format("snode_gatherer_{}", snode->id);
+  auto value_type = compute_type(snode->dt);
+  auto &ker = kernel([&] {
+    auto indices = Expr::make<ExternalTensorExpression>(DataType::i32, 2, 0);
+    auto values = Expr::make<ExternalTensorExpression>(value_type, 1, 1);
+    For(Expr(0), Expr::make<ArgLoadExpression>(2), [&](Expr i) {
+      ExprGroup cell;
+      for (int k = 0; k < snode->num_active_indices; k++)
+        cell.push_back(load_if_ptr(indices[ExprGroup(i, Expr(k))]));
+      values[ExprGroup(i)] = load_if_ptr((snode->expr)[cell]);
+    });
+  });
+  ker.set_arch(get_host_arch());
+  ker.name = kernel_name;
+  ker.insert_arg(DataType::i32, true);
+  ker.insert_arg(value_type, true);
+  ker.insert_arg(DataType::i32, false);
+  return ker;
+}
+
+Kernel &Program::get_snode_scatterer(SNode *snode) {
+  TC_ASSERT(snode->type == SNodeType::place);
+  TC_ERROR_UNLESS(snode->num_active_indices > 0,
+                  "Batched accesses need a tensor with indices");
+  auto kernel_name = fmt::format("snode_scatterer_{}", snode->id);
+  auto value_type = compute_type(snode->dt);
+  auto &ker = kernel([&] {
+    auto indices = Expr::make<ExternalTensorExpression>(DataType::i32, 2, 0);
+    auto values = Expr::make<ExternalTensorExpression>(value_type, 1, 1);
+    For(Expr(0), Expr::make<ArgLoadExpression>(2), [&](Expr i) {
+      ExprGroup cell;
+      for (int k = 0; k < snode->num_active_indices; k++)
+        cell.push_back(load_if_ptr(indices[ExprGroup(i, Expr(k))]));
+      (snode->expr)[cell] = load_if_ptr(values[ExprGroup(i)]);
+    });
+  });
+  ker.set_arch(get_host_arch());
+  ker.name = kernel_name;
+  ker.insert_arg(DataType::i32, true);
+  ker.insert_arg(value_type, true);
+  ker.insert_arg(DataType::i32, false);
+  return ker;
+}
+
+Kernel &Program::get_snode_listgen(SNode *snode) {
+  TC_ASSERT(snode->type == SNodeType::place);
+  auto kernel_name = fmt::format("snode_listgen_{}", snode->id);
+  auto &ker = kernel([&] {
+    ExprGroup indices;
+    for (int i = 0; i < snode->num_active_indices; i++) {
+      indices.push_back(Expr(std::make_shared<IdExpression>()));
+    }
+    For(indices, snode->expr, [] {});
+  });
+  ker.set_arch(get_host_arch());
+  ker.name = kernel_name;
   return ker;
 }
 
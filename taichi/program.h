@@ -4,13 +4,23 @@
 
 #include "ir.h"
 #include "kernel.h"
+#include "compilation_queue.h"
+#include "launch_breakdown.h"
+#include "list_tracker.h"
+#include "runtime_counters.h"
+#include "source_profiler.h"
 #include "snode.h"
 #include "taichi_llvm_context.h"
 #include "tlang_util.h"
 #include <atomic>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 #include <taichi/context.h>
 #include <taichi/profiler.h>
+#include <taichi/system/hardware_counters.h>
 #include <taichi/system/threading.h>
+#include <taichi/system/virtual_memory.h>
 #include <taichi/unified_allocator.h>
 #if defined(TC_PLATFORM_UNIX)
 #include <dlfcn.h>
@@ -19,10 +29,13 @@
 TLANG_NAMESPACE_BEGIN
 
 extern Program *current_program;
+// The program of the kernel being compiled on this thread, if any. Kernels
+// of different programs can be compiled on different threads at once.
+extern thread_local Program *compiling_program;
 extern SNode root;
 
 TC_FORCE_INLINE Program &get_current_program() {
-  return *current_program;
+  return compiling_program ? *compiling_program : *current_program;
 }
 
 class Program {
@@ -31,11 +44,20 @@ class Program {
   // Should be copiable
   std::vector<void *> loaded_dlls;
   Kernel *current_kernel;
+  // The kernel being compiled on this thread, if any
+  static thread_local Kernel *compiling_kernel;
   SNode *snode_root;
+  // The roots of the SNode trees added to the materialized layout
+  std::vector<std::unique_ptr<SNode>> snode_trees;
   // pointer to the data structure. assigned to context.buffers[0] during kernel
   // launches
   void *llvm_runtime;
+  std::size_t temporaries_capacity;
+  // Counted with CompileConfig::count_page_faults
+  uint64 num_kernel_page_faults;
   void *data_structure;
+  // The root buffer mapped from CompileConfig::root_file
+  std::unique_ptr<FileBackedRange> root_file_mapping;
   CompileConfig config;
   CPUProfiler cpu_profiler;
   Context context;
@@ -43,17 +65,87 @@ class Program {
   bool sync;  // device/host synchronized?
   bool finalized;
   float64 total_compilation_time;
+  // Guarded by compilation_mutex
+  std::vector<CompilePassRecord> compile_pass_records;
   static std::atomic<int> num_instances;
   ThreadPool thread_pool;
 
   std::vector<std::unique_ptr<Kernel>> functions;
+  // Compiled LLVM kernels keyed by arch and structural hash of the lowered IR,
+  // shared by kernels that lower to identical IR
+  std::unordered_map<std::string, FunctionType> compiled_kernels;
+  // The compilation of the kernels of a program is serialized, since an
+  // LLVMContext can only be used by one thread at a time. Programs have
+  // contexts of their own, so their kernels compile concurrently.
+  std::mutex compilation_mutex;
+  std::unique_ptr<CompilationQueue> compilation_queue;
+
+  // Persistent device buffers and page-locked staging memory for ext_arr
+  // kernel arguments on GPUs, keyed by host pointer and size
+  struct ExtArrBuffer {
+    void *device_ptr;
+    void *staging_ptr;
+    void *staging_event;  // recorded after the last copy from staging_ptr
+    uint64 last_use;
+  };
+  std::map<std::pair<uint64, uint64>, ExtArrBuffer> ext_arr_buffers;
+  uint64 ext_arr_buffer_timestamp;
+  // Kernel launches so far, which seed the random numbers of the next launch
+  uint64 num_kernel_launches;
+  // Counted on the host, see get_runtime_counters. Kernels compiled from the
+  // compiled_kernels map or the offline cache are hits.
+  std::atomic<uint64> num_compile_cache_hits;
+  std::atomic<uint64> num_compile_cache_misses;
+  // The hits loaded from the offline cache
+  std::atomic<uint64> num_offline_cache_hits;
+  // Offloaded tasks taken from TaichiLLVMContext::compiled_tasks
+  std::atomic<uint64> num_reused_tasks;
+  ListTracker list_tracker;
+  // clear_list and listgen tasks not launched, see ListTracker
+  uint64 num_skipped_list_tasks;
+  // Copied between ext_arr arguments and the device
+  uint64 num_nparray_bytes;
+  // In the runtime, assigned when the data structure is created
+  RuntimeCounters *runtime_counters;
+  // The accesses checked by BoundCheckStmts, described with their source
+  // locations, and their numbers of indices
+  std::vector<std::pair<std::string, int>> bound_checks;
+  std::mutex bound_checks_mutex;
+  // The names of the values PrintStmts print and their types, and the texts
+  // of AssertStmts, with DataType::unknown
+  std::vector<std::pair<std::string, DataType>> debug_messages;
+  std::mutex debug_messages_mutex;
+  // Of RuntimeCounters::num_debug_records
+  uint64 num_drained_debug_records;
+  // Launches recorded by defer_launch, with their arguments
+  std::vector<std::pair<Kernel *, Context>> deferred_launches;
+  // GPU launches that may still be running with
+  // CompileConfig::overlap_kernels, in launch order
+  struct PendingLaunch {
+    // nullptr for a barrier, which conflicts with every launch
+    const KernelAccesses *accesses;
+    int stream;
+    void *event;  // CUevent recorded after the launch
+    // Of Runtime::temporaries, which all streams share
+    bool uses_temporaries;
+  };
+  std::vector<PendingLaunch> pending_launches;
 
   std::function<void()> profiler_print_gpu;
   std::function<void()> profiler_clear_gpu;
   std::unique_ptr<ProfilerBase> profiler_llvm;
+  // Of the thread pool, see CompileConfig::profile_hardware_counters
+  HardwareCounters hardware_counters;
+  LaunchBreakdown launch_breakdown;
+  SourceProfiler source_profiler;
 
   std::string layout_fn;
 
+  // The Python launcher calls this before setting the arguments
+  void begin_launch_breakdown() {
+    launch_breakdown.marshal_begin = Time::get_cycles();
+  }
+
   void profiler_print() {
     if (config.use_llvm) {
       profiler_llvm->print();
@@ -98,7 +190,73 @@ class Program {
 
   void synchronize();
 
+  // Returns the id of a new BoundCheckStmt
+  int register_bound_check(const std::string &access, int num_indices);
+
+  // Raises the first out of bound access the kernels reported since the
+  // last call, see CompileConfig::check_out_of_bound
+  void check_out_of_bound_reports();
+
+  // Raises a hash table the kernels found full since the last call. The
+  // cells that did not fit were left inactive.
+  void check_full_hash_tables();
+
+  // Returns the id of a new PrintStmt or AssertStmt message
+  int register_debug_message(const std::string &message, DataType dt);
+
+  // Prints the values kernels printed since the last call, and raises the
+  // first assertion that failed
+  void drain_debug_records();
+
+  // The always-on counters, by name. Counters of an SNode are named
+  // "<counter>:<snode id>".
+  std::map<std::string, uint64> get_runtime_counters();
+
+  // The number of runs and the total time (ms) of each task profiled by the
+  // LLVM backends, by task name
+  std::map<std::string, std::pair<int, double>> get_profiler_records();
+
+  // Launches the kernels, which take no arguments, in order until the i32
+  // place done of a 0-D tensor is nonzero, for at most max_iterations
+  // iterations. The tasks check done themselves, so that the host only reads
+  // it back every check_interval iterations. Returns the iterations that ran.
+  int run_device_loop(const std::vector<Kernel *> &kernels,
+                      SNode *done,
+                      int max_iterations,
+                      int check_interval);
+
+  // Records a launch of kernel with the arguments in context, to be run when
+  // any other kernel is launched, or on synchronize()
+  void defer_launch(Kernel &kernel);
+
+  void flush_deferred_launches();
+
+  // Makes Runtime::temporaries hold at least size bytes. Grows the arena when
+  // a kernel needs more than any kernel before it.
+  void reserve_temporaries(std::size_t size);
+
+  ExtArrBuffer &get_ext_arr_buffer(void *host_ptr, std::size_t size);
+
+  void free_ext_arr_buffers();
+
+  // Picks the stream of a GPU launch of kernel with
+  // CompileConfig::overlap_kernels: the stream of the last pending launch it
+  // conflicts with, after waiting for those on other streams, or an idle
+  // stream if there is none
+  void begin_overlapped_launch(Kernel &kernel);
+
+  // Records the launch as pending, and switches back to the default stream
+  void end_overlapped_launch(Kernel &kernel);
+
+  // Orders the work issued to the default stream from now on after all
+  // pending launches, and the later launches after it
+  void join_overlapped_launches();
+
   void finalize() {
+    if (compilation_queue)
+      compilation_queue->stop();
+    source_profiler.stop();
+    free_ext_arr_buffers();
     current_program = nullptr;
     for (auto &dll : loaded_dlls) {
 #if defined(TC_PLATFORM_UNIX)
@@ -107,7 +265,11 @@ class Program {
       TC_NOT_IMPLEMENTED
 #endif
     }
-    UnifiedAllocator::free();
+    // Before the memory pool is reset, which would discard the file pages
+    root_file_mapping.reset();
+    UnifiedAllocator::recycle();
+    TaichiLLVMContext::recycle(std::move(llvm_context_host));
+    TaichiLLVMContext::recycle(std::move(llvm_context_device));
     finalized = true;
     num_instances -= 1;
   }
@@ -130,25 +292,48 @@ class Program {
     std::string name;
     Program *prog;
     bool grad;
+    bool keep_primal;
+    int gpu_max_registers = 0;
+    DataType default_fp = DataType::unknown;
+    DataType accumulation_fp = DataType::unknown;
 
     Kernel &def(const std::function<void()> &func) {
-      return prog->kernel(func, name, grad);
+      auto &kernel = prog->kernel(func, name, grad, keep_primal);
+      kernel.gpu_max_registers = gpu_max_registers;
+      kernel.default_fp = default_fp;
+      kernel.accumulation_fp = accumulation_fp;
+      if (prog->config.cpu_gpu_split && prog->config.arch == Arch::gpu &&
+          prog->config.use_llvm && !grad) {
+        kernel.host_twin = &prog->create_host_twin(kernel, func);
+        kernel.host_twin->default_fp = default_fp;
+        kernel.host_twin->accumulation_fp = accumulation_fp;
+      }
+      prog->compile_async(kernel);
+      return kernel;
     }
   };
 
-  KernelProxy kernel(const std::string &name, bool grad = false) {
+  KernelProxy kernel(const std::string &name,
+                     bool grad = false,
+                     bool keep_primal = false) {
     KernelProxy proxy;
     proxy.prog = this;
     proxy.name = name;
     proxy.grad = grad;
+    proxy.keep_primal = keep_primal;
     return proxy;
   }
 
+  // See Kernel::host_twin. Defines the body again, for the host.
+  Kernel &create_host_twin(Kernel &kernel, const std::function<void()> &body);
+
   Kernel &kernel(const std::function<void()> &body,
                  const std::string &name = "",
-                 bool grad = false) {
+                 bool grad = false,
+                 bool keep_primal = false) {
     // Expr::set_allow_store(true);
-    auto func = std::make_unique<Kernel>(*this, body, name, grad);
+    auto func =
+        std::make_unique<Kernel>(*this, body, name, grad, keep_primal);
     // Expr::set_allow_store(false);
     functions.emplace_back(std::move(func));
     return *functions.back();
@@ -163,11 +348,37 @@ class Program {
 
   FunctionType compile(Kernel &kernel);
 
+  // Compiles the kernels not compiled yet. The legacy backends generate all
+  // the sources first and then run the compilers concurrently.
+  void compile_kernels(const std::vector<Kernel *> &kernels);
+
+  // Queues the kernel for background compilation if
+  // CompileConfig::async_compilation is on
+  void compile_async(Kernel &kernel);
+
+  // Recompiles a kernel at the full optimization level in the background,
+  // see CompileConfig::tiered_compilation
+  void reoptimize_async(Kernel &kernel);
+
   void materialize_layout();
 
+  // A new SNode tree for tensors declared after the layout is materialized.
+  // Once its SNodes are added, materialize_snode_tree compiles and allocates
+  // it alone, so that the kernels compiled so far remain valid (LLVM
+  // backends).
+  SNode *add_snode_tree();
+
+  void materialize_snode_tree(SNode *root);
+
+  // The kernel being compiled on this thread or defined, if any
+  inline Kernel *get_current_kernel_if_any() {
+    return compiling_kernel ? compiling_kernel : current_kernel;
+  }
+
   inline Kernel &get_current_kernel() {
-    TC_ASSERT(current_kernel);
-    return *current_kernel;
+    auto kernel = get_current_kernel_if_any();
+    TC_ASSERT(kernel);
+    return *kernel;
   }
 
   TaichiLLVMContext *get_llvm_context(Arch arch) {
@@ -182,6 +393,17 @@ class Program {
 
   Kernel &get_snode_writer(SNode *snode);
 
+  // Read or write the cells of a place node at a batch of indices, in one
+  // launch. Their arguments are the indices (an (n, dim) ext_arr of i32),
+  // the values (an ext_arr of n values of the compute type) and n.
+  Kernel &get_snode_gatherer(SNode *snode);
+
+  Kernel &get_snode_scatterer(SNode *snode);
+
+  // An empty struct-for over the place node snode. Its offloaded listgen
+  // tasks still fill the element lists of its ancestors.
+  Kernel &get_snode_listgen(SNode *snode);
+
   Arch get_host_arch() {
     return Arch::x86_64;
   }
@@ -189,6 +411,14 @@ class Program {
   float64 get_total_compilation_time() {
     return total_compilation_time;
   }
+
+  // Appends to compile_pass_records if CompileConfig::profile_compilation is
+  // on
+  void record_compile_pass(const Kernel &kernel,
+                           const std::string &pass,
+                           float64 time,
+                           int num_statements_before = -1,
+                           int num_statements_after = -1);
 };
 
 TLANG_NAMESPACE_END
@@ -5,6 +5,8 @@
 
 #include <taichi/python/export.h>
 #include <taichi/io/image_reader.h>
+#include <taichi/io/image_loader.h>
+#include <taichi/io/ply_writer.h>
 
 TC_NAMESPACE_BEGIN
 
@@ -12,6 +14,47 @@ void export_io(py::module &m) {
   py::class_<ImageReader, std::shared_ptr<ImageReader>>(m, "ImageReader")
       .def("initialize", &ImageReader::initialize)
       .def("read", &ImageReader::read);
+
+  // The properties as names, addresses of float32 arrays and strides
+  m.def("write_binary_ply",
+        [](const std::string &fn, int64 n,
+           const std::vector<std::string> &names,
+           const std::vector<uint64> &data, const std::vector<int> &strides) {
+          std::vector<PLYProperty> properties;
+          for (int i = 0; i < (int)names.size(); i++)
+            properties.push_back(
+                PLYProperty{names[i], (const float32 *)data[i], strides[i]});
+          write_binary_ply(fn, n, properties);
+        });
+
+  py::class_<ImageLoader>(m, "ImageLoader")
+      .def(py::init<std::size_t>())
+      // (width, height, channels, pixels)
+      .def("get",
+           [](ImageLoader *loader, const std::string &fn, int channels) {
+             auto image = loader->get(fn, channels);
+             return py::make_tuple(
+                 image->width, image->height, image->channels,
+                 py::bytes((const char *)image->pixels.data(),
+                           image->pixels.size()));
+           })
+      .def("prefetch", &ImageLoader::prefetch)
+      // Into a uint8 or float32 array at out
+      .def("load_batch",
+           [](ImageLoader *loader, const std::vector<std::string> &fns,
+              std::size_t out, bool is_float, int width, int height,
+              int channels, bool cache) {
+             if (is_float)
+               loader->load_batch(fns, (float32 *)out, width, height,
+                                  channels, cache);
+             else
+               loader->load_batch(fns, (uint8 *)out, width, height, channels,
+                                  cache);
+           })
+      .def("get_cache_bytes", &ImageLoader::get_cache_bytes)
+      .def("get_num_hits", &ImageLoader::get_num_hits)
+      .def("get_num_misses", &ImageLoader::get_num_misses)
+      .def("clear", &ImageLoader::clear);
 }
 
 TC_NAMESPACE_END
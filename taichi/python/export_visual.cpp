@@ -8,6 +8,8 @@
 
 #include <taichi/geometry/factory.h>
 #include <taichi/visual/gui.h>
+#include <taichi/visual/video_writer.h>
+#include <taichi/visual/voxelizer.h>
 
 TC_NAMESPACE_BEGIN
 
@@ -17,6 +19,7 @@ void export_visual(py::module &m) {
   using Circle = Canvas::Circle;
   py::class_<GUI>(m, "GUI")
       .def(py::init<std::string, Vector2i>())
+      .def(py::init<std::string, Vector2i, bool, bool>())
       .def("get_canvas", &GUI::get_canvas, py::return_value_policy::reference)
       .def("set_img",
            [&](GUI *gui, std::size_t ptr) {
@@ -24,6 +27,10 @@ void export_visual(py::module &m) {
              std::memcpy((void *)img.get_data().data(), (void *)ptr,
                          img.get_data_size());
            })
+      .def("get_img_ptr",
+           [](GUI *gui) {
+             return (uint64)gui->canvas->img.get_data().data();
+           })
       .def("screenshot", &GUI::screenshot)
       .def("update", &GUI::update);
   py::class_<Canvas>(m, "Canvas")
@@ -33,7 +40,21 @@ void export_visual(py::module &m) {
            static_cast<Line &(Canvas::*)(Vector2, Vector2)>(&Canvas::path),
            py::return_value_policy::reference)
       .def("circle", static_cast<Circle &(Canvas::*)(Vector2)>(&Canvas::circle),
-           py::return_value_policy::reference);
+           py::return_value_policy::reference)
+      .def("circles",
+           [](Canvas *canvas, int n, std::size_t centers, std::size_t colors,
+              uint32 color, std::size_t radii, real radius) {
+             canvas->draw_circles(n, (float32 *)centers, (uint32 *)colors,
+                                  color, (float32 *)radii, radius);
+           })
+      .def("segments",
+           [](Canvas *canvas, int n, std::size_t begins, std::size_t ends,
+              std::size_t colors, uint32 color, std::size_t radii,
+              real radius) {
+             canvas->draw_segments(n, (float32 *)begins, (float32 *)ends,
+                                   (uint32 *)colors, color, (float32 *)radii,
+                                   radius);
+           });
   py::class_<Line>(m, "Line")
       .def("finish", &Line::finish)
       .def("radius", &Line::radius, py::return_value_policy::reference)
@@ -45,6 +66,46 @@ void export_visual(py::module &m) {
       .def("radius", &Circle::radius, py::return_value_policy::reference)
       .def("color", static_cast<Circle &(Circle::*)(int)>(&Circle::color),
            py::return_value_policy::reference);
+  py::class_<VideoWriter>(m, "VideoWriter")
+      .def(py::init<std::string, Vector2i, int, std::string, int, int>())
+      .def("write_gui",
+           [](VideoWriter *writer, GUI *gui) {
+             writer->write(gui->canvas->img);
+           })
+      .def("write_rgb",
+           [](VideoWriter *writer, std::size_t ptr) {
+             writer->write_rgb((uint8 *)ptr);
+           })
+      .def("get_num_frames", &VideoWriter::get_num_frames)
+      .def("close", &VideoWriter::close);
+
+  // Voxelizes into a strided array of the numpy dtype named dtype
+  m.def("voxelize", [](const std::vector<int> &res, std::size_t triangles,
+                       int num_triangles, std::size_t out,
+                       const std::vector<int64> &strides,
+                       const std::string &dtype, float64 value) {
+    TC_ASSERT(res.size() == 3 && strides.size() == 3);
+    Voxelizer voxelizer(Vector3i(res[0], res[1], res[2]));
+#define VOXELIZE(name, T)                                                      \
+  if (dtype == name) {                                                         \
+    voxelizer.voxelize((float32 *)triangles, num_triangles, (T *)out,          \
+                       strides.data(), (T)value);                              \
+    return;                                                                    \
+  }
+    VOXELIZE("float32", float32);
+    VOXELIZE("float64", float64);
+    VOXELIZE("int8", int8);
+    VOXELIZE("int16", int16);
+    VOXELIZE("int32", int32);
+    VOXELIZE("int64", int64);
+    VOXELIZE("uint8", uint8);
+    VOXELIZE("bool", uint8);
+    VOXELIZE("uint16", uint16);
+    VOXELIZE("uint32", uint32);
+    VOXELIZE("uint64", uint64);
+#undef VOXELIZE
+    TC_ERROR("Cannot voxelize into arrays of {}", dtype);
+  });
 }
 
 TC_NAMESPACE_END
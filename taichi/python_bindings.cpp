@@ -1,11 +1,19 @@
 // Bindings for the python frontend
 
 #include "tlang.h"
+#include "aot.h"
+#include "readback.h"
+#include "input_channel.h"
 #include <pybind11/functional.h>
 #include <pybind11/pybind11.h>
 #include <taichi/common/interface.h>
 #include <taichi/python/export.h>
+#include <taichi/system/timeline.h>
 #include "svd.h"
+#include "dense_solve.h"
+#include "matmul.h"
+#include <taichi/math/discrete_sampler.h>
+#include <taichi/io/binary_stream.h>
 
 TC_NAMESPACE_BEGIN
 
@@ -34,6 +42,16 @@ std::vector<std::unique_ptr<IRBuilder::ScopeGuard>> scope_stack;
 void compile_runtimes();
 std::string libdevice_path();
 
+// By the declared types, since numpy scalars are not Python floats
+void set_scalar_args(Kernel *kernel, const py::args &args) {
+  for (int i = 0; i < (int)args.size(); i++) {
+    if (is_real(kernel->args[i].dt))
+      kernel->set_arg_float(i, args[i].cast<float64>());
+    else
+      kernel->set_arg_int(i, args[i].cast<int64>());
+  }
+}
+
 TLANG_NAMESPACE_END
 
 TC_NAMESPACE_BEGIN
@@ -69,7 +87,73 @@ void export_lang(py::module &m) {
       .def_readwrite("enable_profiler", &CompileConfig::enable_profiler)
       .def_readwrite("default_fp", &CompileConfig::default_fp)
       .def_readwrite("default_ip", &CompileConfig::default_ip)
-      .def_readwrite("fast_math", &CompileConfig::fast_math);
+      .def_readwrite("fast_math", &CompileConfig::fast_math)
+      .def_readwrite("check_out_of_bound", &CompileConfig::check_out_of_bound)
+      .def_readwrite("use_offline_cache", &CompileConfig::use_offline_cache)
+      .def_readwrite("async_compilation", &CompileConfig::async_compilation)
+      .def_readwrite("use_cuda_graph", &CompileConfig::use_cuda_graph)
+      .def_readwrite("overlap_kernels", &CompileConfig::overlap_kernels)
+      .def_readwrite("cpu_gpu_split", &CompileConfig::cpu_gpu_split)
+      .def_readwrite("device_id", &CompileConfig::device_id)
+      .def_readwrite("auto_gpu_block_dim", &CompileConfig::auto_gpu_block_dim)
+      .def_readwrite("gpu_block_dim_autotuning",
+                     &CompileConfig::gpu_block_dim_autotuning)
+      .def_readwrite("use_cubin", &CompileConfig::use_cubin)
+      .def_readwrite("cubin_opt_level", &CompileConfig::cubin_opt_level)
+      .def_readwrite("gpu_max_registers", &CompileConfig::gpu_max_registers)
+      .def_readwrite("random_seed", &CompileConfig::random_seed)
+      .def_readwrite("cpu_spin_window_us", &CompileConfig::cpu_spin_window_us)
+      .def_readwrite("cpu_numa_pinning", &CompileConfig::cpu_numa_pinning)
+      .def_readwrite("use_huge_pages", &CompileConfig::use_huge_pages)
+      .def_readwrite("root_file", &CompileConfig::root_file)
+      .def_readwrite("count_page_faults", &CompileConfig::count_page_faults)
+      .def_readwrite("gpu_prefetch_mb", &CompileConfig::gpu_prefetch_mb)
+      .def_readwrite("struct_for_fusion", &CompileConfig::struct_for_fusion)
+      .def_readwrite("gpu_fission_live_values",
+                     &CompileConfig::gpu_fission_live_values)
+      .def_readwrite("demote_dense_struct_fors",
+                     &CompileConfig::demote_dense_struct_fors)
+      .def_readwrite("gpu_persistent_threads",
+                     &CompileConfig::gpu_persistent_threads)
+      .def_readwrite("gpu_read_only_cache",
+                     &CompileConfig::gpu_read_only_cache)
+      .def_readwrite("gpu_pack_leaf_blocks",
+                     &CompileConfig::gpu_pack_leaf_blocks)
+      .def_readwrite("cpu_streaming_stores",
+                     &CompileConfig::cpu_streaming_stores)
+      .def_readwrite("cpu_block_prefetch", &CompileConfig::cpu_block_prefetch)
+      .def_readwrite("cpu_thread_count_tuning",
+                     &CompileConfig::cpu_thread_count_tuning)
+      .def_readwrite("block_local_access", &CompileConfig::block_local_access)
+      .def_readwrite("tiered_compilation", &CompileConfig::tiered_compilation)
+      .def_readwrite("tiered_compilation_threshold",
+                     &CompileConfig::tiered_compilation_threshold)
+      .def_readwrite("reuse_compiled_tasks",
+                     &CompileConfig::reuse_compiled_tasks)
+      .def_readwrite("skip_unchanged_lists",
+                     &CompileConfig::skip_unchanged_lists)
+      .def_readwrite("use_precompiled_headers",
+                     &CompileConfig::use_precompiled_headers)
+      .def_readwrite("profile_compilation",
+                     &CompileConfig::profile_compilation)
+      .def_readwrite("unroll_threshold", &CompileConfig::unroll_threshold)
+      .def_readwrite("timeline", &CompileConfig::timeline)
+      .def_readwrite("profile_hardware_counters",
+                     &CompileConfig::profile_hardware_counters)
+      .def_readwrite("launch_breakdown", &CompileConfig::launch_breakdown)
+      .def_readwrite("profile_source_lines",
+                     &CompileConfig::profile_source_lines)
+      .def_readwrite("source_profiler_interval_us",
+                     &CompileConfig::source_profiler_interval_us)
+      .def_readwrite("peak_gflops", &CompileConfig::peak_gflops)
+      .def_readwrite("peak_bandwidth", &CompileConfig::peak_bandwidth)
+      .def_readwrite("use_tensor_cores", &CompileConfig::use_tensor_cores)
+      .def_readwrite("cpu_max_num_threads",
+                     &CompileConfig::cpu_max_num_threads);
+
+  m.def("save_timeline",
+        [](const std::string &fn) { Timeline::get_instance().save(fn); });
+  m.def("clear_timeline", [] { Timeline::get_instance().clear(); });
 
   m.def("reset_default_compile_config",
         [&]() { default_compile_config = CompileConfig(); });
@@ -82,11 +166,58 @@ void export_lang(py::module &m) {
       .def(py::init<>())
       .def_readonly("config", &Program::config)
       .def("profiler_print", &Program::profiler_print)
-      .def("profiler_print", &Program::profiler_clear)
+      .def("profiler_clear", &Program::profiler_clear)
+      .def("get_profiler_records", &Program::get_profiler_records)
       .def("finalize", &Program::finalize)
+      .def("begin_launch_breakdown", &Program::begin_launch_breakdown)
+      .def("get_launch_breakdown",
+           [](Program *program) { return program->launch_breakdown.get(); })
+      .def("print_launch_breakdown",
+           [](Program *program) { program->launch_breakdown.print(); })
+      .def("clear_launch_breakdown",
+           [](Program *program) { program->launch_breakdown.clear(); })
+      .def("get_source_profile",
+           [](Program *program) { return program->source_profiler.get(); })
+      .def("print_source_profile",
+           [](Program *program) { program->source_profiler.print(); })
+      .def("clear_source_profile",
+           [](Program *program) { program->source_profiler.clear(); })
+      .def("get_runtime_counters", &Program::get_runtime_counters)
+      .def("run_device_loop", &Program::run_device_loop)
+      // Ids of the places read and written by each compiled kernel
+      .def("get_kernel_accesses",
+           [](Program *program) {
+             std::vector<std::pair<std::vector<int>, std::vector<int>>> ret;
+             for (auto &kernel : program->functions) {
+               if (!kernel->is_compiled)
+                 continue;
+               std::vector<int> read, written;
+               for (auto s : kernel->snodes_read)
+                 read.push_back(s->id);
+               for (auto s : kernel->snodes_written)
+                 written.push_back(s->id);
+               ret.emplace_back(read, written);
+             }
+             return ret;
+           })
       .def("get_snode_writer", &Program::get_snode_writer)
       .def("get_total_compilation_time", &Program::get_total_compilation_time)
-      .def("synchronize", &Program::synchronize);
+      .def("get_compile_pass_records",
+           [](Program *program) {
+             std::lock_guard<std::mutex> _(program->compilation_mutex);
+             return program->compile_pass_records;
+           })
+      .def("clear_compile_pass_records",
+           [](Program *program) {
+             std::lock_guard<std::mutex> _(program->compilation_mutex);
+             program->compile_pass_records.clear();
+           })
+      .def_readonly("num_kernel_page_faults", &Program::num_kernel_page_faults)
+      .def("synchronize", &Program::synchronize)
+      .def("add_snode_tree", &Program::add_snode_tree,
+           py::return_value_policy::reference)
+      .def("materialize_snode_tree", &Program::materialize_snode_tree)
+      .def("flush_deferred_launches", &Program::flush_deferred_launches);
 
   m.def("get_current_program", get_current_program,
         py::return_value_policy::reference);
@@ -95,20 +226,89 @@ void export_lang(py::module &m) {
         [&]() -> CompileConfig & { return get_current_program().config; },
         py::return_value_policy::reference);
 
+  py::class_<CompilePassRecord>(m, "CompilePassRecord")
+      .def_readonly("kernel", &CompilePassRecord::kernel)
+      .def_readonly("pass_name", &CompilePassRecord::pass)
+      .def_readonly("time", &CompilePassRecord::time)
+      .def_readonly("num_statements_before",
+                    &CompilePassRecord::num_statements_before)
+      .def_readonly("num_statements_after",
+                    &CompilePassRecord::num_statements_after);
+
+  py::class_<AllocatorStat>(m, "AllocatorStat")
+      .def_readonly("snode_id", &AllocatorStat::snode_id)
+      .def_readonly("pool_size", &AllocatorStat::pool_size)
+      .def_readonly("num_resident_blocks", &AllocatorStat::num_resident_blocks)
+      .def_readonly("num_recycled_blocks", &AllocatorStat::num_recycled_blocks)
+      .def_readonly("node_size", &AllocatorStat::node_size)
+      .def_readonly("peak_num_blocks", &AllocatorStat::peak_num_blocks)
+      .def_readonly("num_allocations", &AllocatorStat::num_allocations);
+
   py::class_<Index>(m, "Index").def(py::init<int>());
+  py::class_<BinaryFileStreamOutput>(m, "BinaryFileStreamOutput")
+      .def(py::init<std::string>())
+      .def("write",
+           [](BinaryFileStreamOutput *out, uint64 data, std::size_t size) {
+             out->write((void *)data, size);
+           })
+      .def("flush", &BinaryFileStreamOutput::flush)
+      .def("close", &BinaryFileStreamOutput::close);
+  py::class_<BinaryFileStreamInput>(m, "BinaryFileStreamInput")
+      .def(py::init<std::string>())
+      .def("read",
+           [](BinaryFileStreamInput *in, uint64 data, std::size_t size) {
+             in->read((void *)data, size);
+           })
+      .def("close", &BinaryFileStreamInput::close);
   py::class_<SNode>(m, "SNode")
       .def(py::init<>())
+      .def("can_clear_data", &SNode::can_clear_data)
       .def("clear_data", &SNode::clear_data)
       .def("clear_data_and_deactivate", &SNode::clear_data_and_deactivate)
+      .def("defragment", &SNode::defragment)
+      .def("deactivate_ambient", &SNode::deactivate_ambient)
+      .def("stat", &SNode::stat)
+      .def("has_stat", [](SNode *snode) { return (bool)snode->stat_func; })
+      .def("snapshot", &SNode::snapshot, py::arg("filename"),
+           py::arg("compress") = false)
+      .def("restore", &SNode::restore)
+      .def("prefetch", &SNode::prefetch)
+      .def("evict", &SNode::evict)
+      .def("has_bulk_copy",
+           [](SNode *snode) { return (bool)snode->bulk_copy_func; })
+      .def("bulk_copy",
+           [](SNode *snode, uint64 array, bool to_array) {
+             snode->bulk_copy_func((void *)array, to_array);
+           })
+      .def("write_cells", &SNode::write_cells)
+      .def("read_cells", &SNode::read_cells)
       .def_readwrite("parent", &SNode::parent)
+      .def_readonly("id", &SNode::id)
+      .def_readonly("n", &SNode::n)
+      .def_readonly("chunk_size", &SNode::chunk_size)
+      .def("max_num_elements", &SNode::max_num_elements)
+      .def("cell_extent_along_axis", &SNode::cell_extent_along_axis)
+      .def("type_name",
+           [](SNode *snode) { return snode_type_name(snode->type); })
       .def("dense",
            (SNode & (SNode::*)(const std::vector<Index> &,
                                const std::vector<int> &))(&SNode::dense),
            py::return_value_policy::reference)
+      .def("hash",
+           (SNode & (SNode::*)(const std::vector<Index> &,
+                               const std::vector<int> &, int))(&SNode::hash),
+           py::return_value_policy::reference)
       .def("dynamic", &SNode::dynamic_chunked,
            py::return_value_policy::reference)
       .def("pointer", &SNode::pointer, py::return_value_policy::reference)
+      .def("bit_struct", &SNode::bit_struct,
+           py::return_value_policy::reference)
       .def("bitmasked", &SNode::bitmasked)
+      .def("compressed", &SNode::compressed)
+      .def("morton", &SNode::morton)
+      .def("geometric", &SNode::geometric)
+      .def("halo", &SNode::halo, py::return_value_policy::reference)
+      .def("halo_width", &SNode::halo_width)
       .def("place", (SNode & (SNode::*)(Expr &))(&SNode::place),
            py::return_value_policy::reference)
       .def("data_type", [](SNode *snode) { return snode->dt; })
@@ -117,7 +317,7 @@ void export_lang(py::module &m) {
       .def("get_ch",
            [](SNode *snode, int i) -> SNode * { return snode->ch[i].get(); },
            py::return_value_policy::reference)
-      .def("lazy_grad", &SNode::lazy_grad)
+      .def("lazy_grad", &SNode::lazy_grad, py::arg("separate") = false)
       .def("read_int", &SNode::read_int)
       .def("read_float", &SNode::read_float)
       .def("has_grad", &SNode::has_grad)
@@ -127,6 +327,14 @@ void export_lang(py::module &m) {
       .def("write_int", &SNode::write_int)
       .def("write_float", &SNode::write_float)
       .def("get_num_elements_along_axis", &SNode::num_elements_along_axis)
+      .def("gather",
+           [](SNode *snode, uint64 indices, uint64 values, int n) {
+             snode->gather((int32 *)indices, (void *)values, n);
+           })
+      .def("scatter",
+           [](SNode *snode, uint64 indices, uint64 values, int n) {
+             snode->scatter((int32 *)indices, (void *)values, n);
+           })
       .def("num_active_indices",
            [](SNode *snode) { return snode->num_active_indices; });
 
@@ -135,7 +343,59 @@ void export_lang(py::module &m) {
       .def("set_extra_arg_int", &Kernel::set_extra_arg_int)
       .def("set_arg_float", &Kernel::set_arg_float)
       .def("set_arg_nparray", &Kernel::set_arg_nparray)
-      .def("__call__", &Kernel::operator());
+      .def("set_arg_devptr", &Kernel::set_arg_devptr)
+      .def_readonly("num_offloaded_tasks", &Kernel::num_offloaded_tasks)
+      .def_readonly("runs_optimized", &Kernel::runs_optimized)
+      .def("__call__", &Kernel::operator())
+      // Sets all (scalar) arguments and launches, in a single call
+      .def("launch", [](Kernel *kernel, py::args args) {
+        set_scalar_args(kernel, args);
+        (*kernel)();
+      })
+      // Like launch, but recorded with Program::defer_launch. Without
+      // arguments, the ones already set are used.
+      .def("defer", [](Kernel *kernel, py::args args) {
+        set_scalar_args(kernel, args);
+        kernel->program.defer_launch(*kernel);
+      });
+
+  py::class_<AotModule>(m, "AotModule")
+      .def(py::init([](const std::string &fn) {
+        return std::make_unique<AotModule>(get_current_program(), fn);
+      }))
+      .def("get_kernel", &AotModule::get_kernel,
+           py::return_value_policy::reference);
+
+  m.def("save_aot_module",
+        [](const std::map<std::string, Kernel *> &kernels,
+           const std::string &fn) {
+          AotModule::save(get_current_program(), kernels, fn);
+        });
+
+  py::class_<ReadbackFuture>(m, "ReadbackFuture")
+      .def(py::init([](const std::vector<SNode *> &places) {
+        return std::make_unique<ReadbackFuture>(get_current_program(), places);
+      }))
+      .def("done", &ReadbackFuture::done)
+      .def("read_float", &ReadbackFuture::read_float)
+      .def("read_int", &ReadbackFuture::read_int);
+
+  py::class_<InputChannel>(m, "InputChannel")
+      .def(py::init([](std::size_t size) {
+        return std::make_unique<InputChannel>(get_current_program(), size);
+      }))
+      .def("push",
+           [](InputChannel *channel, uint64 host_ptr) {
+             channel->push((void *)host_ptr);
+           })
+      .def("advance", &InputChannel::advance)
+      .def("current",
+           [](InputChannel *channel) { return (uint64)channel->current(); })
+      .def("get_size", &InputChannel::get_size);
+
+  m.def("compile_kernels", [](const std::vector<Kernel *> &kernels) {
+    get_current_program().compile_kernels(kernels);
+  });
 
   py::class_<Expr> expr(m, "Expr");
   expr.def("serialize", &Expr::serialize)
@@ -147,6 +407,17 @@ void export_lang(py::module &m) {
            [&](Expr *expr, bool v) {
              expr->cast<GlobalVariableExpression>()->is_primal = v;
            })
+      .def("set_quantized",
+           [&](Expr *expr, int num_bits, bool is_signed, float64 scale) {
+             auto &quant = expr->cast<GlobalVariableExpression>()->quant;
+             quant.num_bits = num_bits;
+             quant.is_signed = is_signed;
+             quant.scale = scale;
+           })
+      .def("get_data_type",
+           [&](Expr *expr) {
+             return expr->cast<GlobalVariableExpression>()->dt;
+           })
       .def("set_grad", &Expr::set_grad)
       .def("set_attribute", &Expr::set_attribute)
       .def("get_attribute", &Expr::get_attribute)
@@ -160,6 +431,10 @@ void export_lang(py::module &m) {
 
   py::class_<Stmt>(m, "Stmt");
   py::class_<Program::KernelProxy>(m, "KernelProxy")
+      .def_readwrite("gpu_max_registers",
+                     &Program::KernelProxy::gpu_max_registers)
+      .def_readwrite("default_fp", &Program::KernelProxy::default_fp)
+      .def_readwrite("accumulation_fp", &Program::KernelProxy::accumulation_fp)
       .def("define",
            [](Program::KernelProxy *ker,
               const std::function<void()> &func) -> Kernel & {
@@ -173,10 +448,18 @@ void export_lang(py::module &m) {
           return Append(snode, indices, val);
         });
 
+  m.def("expr_assume_in_range", AssumeInRange);
+
+  m.def("insert_is_active", IsActive);
+
   m.def("insert_len", [](SNode *snode, const ExprGroup &indices) {
     return Probe(snode, indices);
   });
 
+  m.def("insert_deactivate", [](SNode *snode, const ExprGroup &indices) {
+    return Deactivate(snode, indices);
+  });
+
   m.def("create_assert_stmt", [&](const Expr &cond, const std::string &msg) {
     auto stmt_unique = std::make_unique<FrontendAssertStmt>(msg, cond);
     current_ast_builder().insert(std::move(stmt_unique));
@@ -246,6 +529,19 @@ void export_lang(py::module &m) {
         AtomicOpType::sub, ptr_if_global(a), load_if_ptr(b)));
   });
 
+#define DEFINE_EXPR_ATOMIC(op)                                                 \
+  m.def("expr_atomic_" #op, [&](const Expr &a, const Expr &b) {                \
+    current_ast_builder().insert(Stmt::make<FrontendAtomicStmt>(               \
+        AtomicOpType::op, ptr_if_global(a), load_if_ptr(b)));                  \
+  });
+
+  DEFINE_EXPR_ATOMIC(max);
+  DEFINE_EXPR_ATOMIC(min);
+  DEFINE_EXPR_ATOMIC(bit_and);
+  DEFINE_EXPR_ATOMIC(bit_or);
+  DEFINE_EXPR_ATOMIC(bit_xor);
+#undef DEFINE_EXPR_ATOMIC
+
   m.def("expr_add", expr_add);
   m.def("expr_sub", expr_sub);
   m.def("expr_mul", expr_mul);
@@ -355,12 +651,19 @@ void export_lang(py::module &m) {
   });
 
   m.def("create_kernel",
-        [&](std::string name, bool grad) -> Program::KernelProxy {
-          return get_current_program().kernel(name, grad);
+        [&](std::string name, bool grad,
+            bool keep_primal) -> Program::KernelProxy {
+          return get_current_program().kernel(name, grad, keep_primal);
         });
 
   m.def("print_", Print_);
 
+  m.def("register_source_file", register_source_file);
+  m.def("set_source_location", [&](int file, int line) {
+    current_ast_builder().source_file = file;
+    current_ast_builder().source_line = line;
+  });
+
   m.def("decl_arg", [&](DataType dt, bool is_nparray) {
     return get_current_program().get_current_kernel().insert_arg(dt,
                                                                  is_nparray);
@@ -377,6 +680,7 @@ void export_lang(py::module &m) {
   m.def("parallelize", Parallelize);
   m.def("vectorize", Vectorize);
   m.def("block_dim", BlockDim);
+  m.def("schedule", Schedule);
   m.def("cache", Cache);
   m.def("stop_grad",
         [](SNode *snode) { current_ast_builder().stop_gradient(snode); });
@@ -402,6 +706,19 @@ void export_lang(py::module &m) {
   m.def("test_threading", test_threading);
   m.def("sifakis_svd_f32", sifakis_svd_export<float32, int32>);
   m.def("sifakis_svd_f64", sifakis_svd_export<float64, int64>);
+  m.def("dense_lu_solve_f32", dense_lu_solve<float32>);
+  m.def("dense_lu_solve_f64", dense_lu_solve<float64>);
+  m.def("dense_cholesky_f32", dense_cholesky<float32>);
+  m.def("dense_cholesky_f64", dense_cholesky<float64>);
+  m.def("dense_cholesky_solve_f32", dense_cholesky_solve<float32>);
+  m.def("dense_cholesky_solve_f64", dense_cholesky_solve<float64>);
+  m.def("matmul_applicable", matmul_applicable);
+  m.def("matmul", matmul);
+  m.def("build_alias_table", [](const std::vector<real> &weights) {
+    AliasSampler sampler(weights);
+    return std::make_tuple(sampler.get_probs(), sampler.get_aliases(),
+                           sampler.get_pdfs());
+  });
 }
 
 TC_NAMESPACE_END
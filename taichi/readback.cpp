@@ -0,0 +1,201 @@
+// Reading fields back to the host without waiting for the device
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <taichi/system/timeline.h>
+#include "readback.h"
+#include "program.h"
+#include "snode.h"
+
+#if defined(CUDA_FOUND)
+#include <cuda_runtime.h>
+#include "cuda_utils.h"
+#endif
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+
+#if defined(CUDA_FOUND)
+// The pinned buffers of finished readbacks, by size, kept for the next ones
+// since allocating pinned memory takes much longer than the copies
+constexpr int max_num_free_buffers = 16;
+std::mutex free_buffers_mutex;
+std::multimap<std::size_t, uint8 *> free_buffers;
+
+uint8 *take_pinned_buffer(std::size_t size) {
+  {
+    std::lock_guard<std::mutex> _(free_buffers_mutex);
+    auto it = free_buffers.lower_bound(size);
+    if (it != free_buffers.end() && it->first <= size * 2) {
+      auto buffer = it->second;
+      free_buffers.erase(it);
+      return buffer;
+    }
+  }
+  void *buffer;
+  check_cuda_errors(cudaHostAlloc(&buffer, size, 0));
+  return (uint8 *)buffer;
+}
+
+void return_pinned_buffer(uint8 *buffer, std::size_t size) {
+  std::lock_guard<std::mutex> _(free_buffers_mutex);
+  if ((int)free_buffers.size() >= max_num_free_buffers) {
+    cudaFreeHost(buffer);
+    return;
+  }
+  free_buffers.emplace(size, buffer);
+}
+#endif
+
+}  // namespace
+
+ReadbackFuture::ReadbackFuture(Program &program,
+                               const std::vector<SNode *> &places)
+    : places(places), buffer(nullptr), size(0), pinned(false), event(nullptr) {
+  // The bytes of the root buffer holding the cells of each place
+  std::vector<uint8 *> begins;
+  std::vector<std::size_t> sizes;
+  for (auto place : places) {
+    TC_ERROR_UNLESS(place->type == SNodeType::place && place->cell_func,
+                    "Only places dense under the root can be read back "
+                    "asynchronously");
+    TC_ERROR_UNLESS(place->dt == DataType::f32 || place->dt == DataType::f64 ||
+                        place->dt == DataType::i32 ||
+                        place->dt == DataType::i64,
+                    "Only f32, f64, i32 and i64 places can be read back "
+                    "asynchronously");
+    int n = place->num_active_indices;
+    std::vector<int> shape(n), I(n);
+    int64 num_cells = 1;
+    for (int k = 0; k < n; k++) {
+      shape[k] = place->num_elements_along_axis(k);
+      num_cells *= shape[k];
+    }
+    std::vector<uint8 *> cells;
+    uint8 *begin = nullptr, *end = nullptr;
+    for (int64 c = 0; c < num_cells; c++) {
+      auto rest = c;
+      for (int k = n - 1; k >= 0; k--) {
+        I[k] = (int)(rest % shape[k]);
+        rest /= shape[k];
+      }
+      auto cell = (uint8 *)place->cell_func(I);
+      TC_ASSERT(cell);
+      cells.push_back(cell);
+      if (!begin || cell < begin)
+        begin = cell;
+      end = std::max(end, cell + data_type_size(place->dt));
+    }
+    offsets.emplace_back();
+    for (auto cell : cells)
+      offsets.back().push_back(size + (cell - begin));
+    begins.push_back(begin);
+    sizes.push_back(end - begin);
+    size += end - begin;
+  }
+  // The copies are ordered after everything launched so far
+  program.flush_deferred_launches();
+  Timeline::Guard _("readback", "copy");
+  if (program.config.arch == Arch::gpu) {
+#if defined(CUDA_FOUND)
+    buffer = take_pinned_buffer(size);
+    pinned = true;
+    std::size_t offset = 0;
+    for (int i = 0; i < (int)places.size(); i++) {
+      cudaMemcpyAsync(buffer + offset, begins[i], sizes[i],
+                      cudaMemcpyDeviceToHost, 0);
+      offset += sizes[i];
+    }
+    cudaEvent_t copied;
+    check_cuda_errors(
+        cudaEventCreateWithFlags(&copied, cudaEventDisableTiming));
+    cudaEventRecord(copied, 0);
+    event = (void *)copied;
+#else
+    TC_ERROR("No CUDA support");
+#endif
+  } else {
+    // CPU kernels are done when their launches return
+    buffer = new uint8[size];
+    std::size_t offset = 0;
+    for (int i = 0; i < (int)places.size(); i++) {
+      std::memcpy(buffer + offset, begins[i], sizes[i]);
+      offset += sizes[i];
+    }
+  }
+}
+
+ReadbackFuture::~ReadbackFuture() {
+  // The copy may still be writing buffer
+  wait();
+  if (pinned) {
+#if defined(CUDA_FOUND)
+    return_pinned_buffer(buffer, size);
+#endif
+  } else {
+    delete[] buffer;
+  }
+}
+
+bool ReadbackFuture::done() {
+  if (!event)
+    return true;
+#if defined(CUDA_FOUND)
+  return cudaEventQuery((cudaEvent_t)event) == cudaSuccess;
+#else
+  return true;
+#endif
+}
+
+void ReadbackFuture::wait() {
+  if (!event)
+    return;
+#if defined(CUDA_FOUND)
+  Timeline::Guard _("wait for readback", "sync");
+  cudaEventSynchronize((cudaEvent_t)event);
+  cudaEventDestroy((cudaEvent_t)event);
+#endif
+  event = nullptr;
+}
+
+std::vector<float64> ReadbackFuture::read_float(int i) {
+  TC_ASSERT(0 <= i && i < (int)places.size());
+  wait();
+  auto dt = places[i]->dt;
+  std::vector<float64> ret;
+  for (auto offset : offsets[i]) {
+    auto cell = buffer + offset;
+    if (dt == DataType::f32)
+      ret.push_back(*(float32 *)cell);
+    else if (dt == DataType::f64)
+      ret.push_back(*(float64 *)cell);
+    else if (dt == DataType::i32)
+      ret.push_back(*(int32 *)cell);
+    else
+      ret.push_back((float64)(*(int64 *)cell));
+  }
+  return ret;
+}
+
+std::vector<int64> ReadbackFuture::read_int(int i) {
+  TC_ASSERT(0 <= i && i < (int)places.size());
+  wait();
+  auto dt = places[i]->dt;
+  std::vector<int64> ret;
+  for (auto offset : offsets[i]) {
+    auto cell = buffer + offset;
+    if (dt == DataType::f32)
+      ret.push_back((int64)(*(float32 *)cell));
+    else if (dt == DataType::f64)
+      ret.push_back((int64)(*(float64 *)cell));
+    else if (dt == DataType::i32)
+      ret.push_back(*(int32 *)cell);
+    else
+      ret.push_back(*(int64 *)cell);
+  }
+  return ret;
+}
+
+TLANG_NAMESPACE_END
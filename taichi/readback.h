@@ -0,0 +1,48 @@
+// Reading fields back to the host without waiting for the device
+#pragma once
+
+#include <vector>
+#include "tlang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class Program;
+class SNode;
+
+// The cells of some places, copied to the host in order with the kernels
+// launched before. On GPUs the copy is asynchronous, into pinned memory, so
+// that only reading the values waits, and only for the kernels launched
+// before the copy.
+class ReadbackFuture {
+ public:
+  // The places must be dense under the root, and of f32, f64, i32 or i64
+  ReadbackFuture(Program &program, const std::vector<SNode *> &places);
+
+  ReadbackFuture(const ReadbackFuture &) = delete;
+
+  ~ReadbackFuture();
+
+  // Whether the copy has completed, without waiting
+  bool done();
+
+  // The values of place i, in the row-major order of its indices
+  std::vector<float64> read_float(int i);
+
+  std::vector<int64> read_int(int i);
+
+ private:
+  // Waits for the copy
+  void wait();
+
+  std::vector<SNode *> places;
+  // Of each place, where its cells are in buffer
+  std::vector<std::vector<std::size_t>> offsets;
+  uint8 *buffer;
+  std::size_t size;
+  // Whether buffer is pinned memory, on GPUs
+  bool pinned;
+  // Of the copy on GPUs, nullptr once waited for
+  void *event;
+};
+
+TLANG_NAMESPACE_END
@@ -26,26 +26,77 @@ uint64 atomic_and_u64(volatile uint64 *dest, uint64 val) {
   return __atomic_fetch_and(dest, val, std::memory_order::memory_order_seq_cst);
 }
 
-float32 atomic_add_cpu_f32(volatile float32 *dest, float32 inc) {
-  float32 old_val;
-  float32 new_val;
-  do {
-    old_val = *dest;
-    new_val = old_val + inc;
-  } while (!__atomic_compare_exchange(dest, &old_val, &new_val, true,
-                                      std::memory_order::memory_order_seq_cst,
-                                      std::memory_order::memory_order_seq_cst));
-  return old_val;
-}
+// Float atomics without a native instruction, as compare-and-swap loops.
+// They are relaxed like those of kernels: atomic, but without ordering the
+// other accesses of the thread. A failed exchange reloads old_val, and min
+// and max stop as soon as *dest needs no update.
+#define DEFINE_ATOMIC_FLOAT(T)                                                 \
+  T atomic_add_cpu_##T(volatile T *dest, T inc) {                              \
+    T old_val;                                                                 \
+    __atomic_load(dest, &old_val, std::memory_order::memory_order_relaxed);    \
+    T new_val;                                                                 \
+    do {                                                                       \
+      new_val = old_val + inc;                                                 \
+    } while (!__atomic_compare_exchange(                                       \
+        dest, &old_val, &new_val, true,                                        \
+        std::memory_order::memory_order_relaxed,                               \
+        std::memory_order::memory_order_relaxed));                             \
+    return old_val;                                                            \
+  }                                                                            \
+  T atomic_min_##T(volatile T *dest, T val) {                                  \
+    T old_val;                                                                 \
+    __atomic_load(dest, &old_val, std::memory_order::memory_order_relaxed);    \
+    while (val < old_val &&                                                    \
+           !__atomic_compare_exchange(                                         \
+               dest, &old_val, &val, true,                                     \
+               std::memory_order::memory_order_relaxed,                        \
+               std::memory_order::memory_order_relaxed))                       \
+      ;                                                                        \
+    return old_val;                                                            \
+  }                                                                            \
+  T atomic_max_##T(volatile T *dest, T val) {                                  \
+    T old_val;                                                                 \
+    __atomic_load(dest, &old_val, std::memory_order::memory_order_relaxed);    \
+    while (val > old_val &&                                                    \
+           !__atomic_compare_exchange(                                         \
+               dest, &old_val, &val, true,                                     \
+               std::memory_order::memory_order_relaxed,                        \
+               std::memory_order::memory_order_relaxed))                       \
+      ;                                                                        \
+    return old_val;                                                            \
+  }
 
-float64 atomic_add_cpu_f64(volatile float64 *dest, float64 inc) {
-  float64 old_val;
-  float64 new_val;
-  do {
-    old_val = *dest;
-    new_val = old_val + inc;
-  } while (!__atomic_compare_exchange(dest, &old_val, &new_val, true,
-                                      std::memory_order::memory_order_seq_cst,
-                                      std::memory_order::memory_order_seq_cst));
-  return old_val;
-}
+DEFINE_ATOMIC_FLOAT(f32);
+DEFINE_ATOMIC_FLOAT(f64);
+
+// Bit fields of a bit_struct share a word with the other fields, which other
+// threads may be updating at the same time
+#define DEFINE_PARTIAL_BITS(N)                                                \
+  void set_partial_bits_b##N(volatile uint##N *dest, uint##N mask,            \
+                             uint##N value) {                                 \
+    uint##N old_val = *dest;                                                  \
+    uint##N new_val;                                                          \
+    do {                                                                      \
+      new_val = (old_val & ~mask) | value;                                    \
+    } while (!__atomic_compare_exchange(                                      \
+        dest, &old_val, &new_val, true,                                       \
+        std::memory_order::memory_order_seq_cst,                              \
+        std::memory_order::memory_order_seq_cst));                            \
+  }                                                                           \
+                                                                              \
+  /* Adds delta to the field in mask, with both shifted into place */        \
+  uint##N atomic_add_partial_bits_b##N(volatile uint##N *dest, uint##N mask,  \
+                                       uint##N delta) {                       \
+    uint##N old_val = *dest;                                                  \
+    uint##N new_val;                                                          \
+    do {                                                                      \
+      new_val = (old_val & ~mask) | ((old_val + delta) & mask);               \
+    } while (!__atomic_compare_exchange(                                      \
+        dest, &old_val, &new_val, true,                                       \
+        std::memory_order::memory_order_seq_cst,                              \
+        std::memory_order::memory_order_seq_cst));                            \
+    return old_val;                                                           \
+  }
+
+DEFINE_PARTIAL_BITS(32);
+DEFINE_PARTIAL_BITS(64);
@@ -9,27 +9,34 @@ struct DenseMeta : public StructMeta {
 STRUCT_FIELD(DenseMeta, bitmasked)
 STRUCT_FIELD(DenseMeta, morton_dim)
 
-void Dense_activate(Ptr meta, Ptr node, int i) {
+// Bitmasked dense nodes keep one activation bit per cell in 64-bit words
+// right after the (8-byte aligned) data section
+uint64 *Dense_get_mask(Ptr meta, Ptr node) {
   auto smeta = (StructMeta *)meta;
+  auto data_section_size = smeta->element_size * smeta->max_num_elements;
+  return (uint64 *)(node + (data_section_size + 7) / 8 * 8);
+}
+
+void Dense_activate(Ptr meta, Ptr node, int i) {
   auto dmeta = (DenseMeta *)meta;
   if (DenseMeta_get_bitmasked(dmeta)) {
-    auto element_size = StructMeta_get_element_size(smeta);
-    auto num_elements = StructMeta_get_element_size(smeta);
-    auto data_section_size = element_size * num_elements;
-    auto mask_begin = (uint64 *)(node + data_section_size);
-    atomic_or_u64(&mask_begin[i / 64], 1UL << (i % 64));
+    auto mask = Dense_get_mask(meta, node);
+    // Skip the atomic if the cell is already active, which is the common case
+    if ((mask[i / 64] >> (i % 64) & 1) == 0) {
+      auto bit = 1UL << (i % 64);
+      if ((atomic_or_u64(&mask[i / 64], bit) & bit) == 0) {
+        auto rt = (Runtime *)dmeta->context->runtime;
+        Runtime_bump_structure_version(rt, dmeta->snode_id);
+      }
+    }
   }
 }
 
 bool Dense_is_active(Ptr meta, Ptr node, int i) {
-  auto smeta = (StructMeta *)meta;
   auto dmeta = (DenseMeta *)meta;
   if (DenseMeta_get_bitmasked(dmeta)) {
-    auto element_size = StructMeta_get_element_size(smeta);
-    auto num_elements = StructMeta_get_element_size(smeta);
-    auto data_section_size = element_size * num_elements;
-    auto mask_begin = node + data_section_size;
-    return bool((mask_begin[i / 8] >> (i % 8)) & 1);
+    auto mask = Dense_get_mask(meta, node);
+    return bool((mask[i / 64] >> (i % 64)) & 1);
   } else {
     return true;
   }
@@ -1,70 +1,126 @@
 #pragma once
 
+// The elements live in chunks of chunk_size elements. The node holds a table
+// of all its chunks, which are allocated on demand and published with a CAS,
+// so that appends and lookups need neither locks nor chunk list walks.
+// Geometric nodes have chunks of chunk_size, 2 * chunk_size, 4 * chunk_size,
+// ... elements instead, so that they need a table of only a few entries.
 struct DynamicNode {
-  i32 lock;
   i32 n;
-  Ptr ptr;
+  Ptr chunks[1];  // actually SNode::num_dynamic_chunks() of them
 };
 
 // Specialized Attributes and functions
 struct DynamicMeta : public StructMeta {
   int chunk_size;
+  i32 geometric;
 };
 
 STRUCT_FIELD(DynamicMeta, chunk_size);
+STRUCT_FIELD(DynamicMeta, geometric);
+
+// The chunk holding element i, and the index of i in it. Chunk c of a
+// geometric node starts at element chunk_size * (2^c - 1).
+void Dynamic_locate(DynamicMeta *meta, int i, int &c, int &j) {
+  auto chunk_size = meta->chunk_size;
+  if (!meta->geometric) {
+    c = i / chunk_size;
+    j = i % chunk_size;
+    return;
+  }
+  c = 31 - __builtin_clz((u32)(i / chunk_size + 1));
+  j = i - chunk_size * ((1 << c) - 1);
+}
+
+NodeAllocator *Dynamic_get_allocator(DynamicMeta *meta, int c) {
+  auto rt = (Runtime *)meta->context->runtime;
+  if (meta->geometric)
+    return &rt->chunk_allocators[meta->snode_id][c];
+  return rt->node_allocators[meta->snode_id];
+}
+
+Ptr Dynamic_get_chunk(DynamicNode *node, int c) {
+  return __atomic_load_n(&node->chunks[c],
+                         std::memory_order::memory_order_seq_cst);
+}
+
+Ptr Dynamic_allocate_chunk(DynamicMeta *meta, DynamicNode *node, int c) {
+  auto chunk = Dynamic_get_chunk(node, c);
+  if (chunk != nullptr)
+    return chunk;
+  // Threads racing for the same chunk each allocate one; the losers hand
+  // theirs back to the allocator
+  auto alloc = Dynamic_get_allocator(meta, c);
+  auto new_chunk = NodeAllocator_allocate(alloc);
+  Ptr expected = nullptr;
+  if (__atomic_compare_exchange_n(&node->chunks[c], &expected, new_chunk,
+                                  false,
+                                  std::memory_order::memory_order_seq_cst,
+                                  std::memory_order::memory_order_seq_cst)) {
+    return new_chunk;
+  }
+  NodeAllocator_recycle(alloc, new_chunk);
+  return expected;
+}
 
 void Dynamic_activate(Ptr meta_, Ptr node_, int i) {
   auto meta = (DynamicMeta *)(meta_);
   auto node = (DynamicNode *)(node_);
-  locked_task(Ptr(&node->lock), [&] {
-    if (i < node->n)
-      return;
-    node->n = i + 1;
-    int chunk_start = 0;
-    auto p_chunk_ptr = &node->ptr;
-    auto chunk_size = meta->chunk_size;
-    auto rt = (Runtime *)meta->context->runtime;
-    auto alloc = rt->node_allocators[meta->snode_id];
-    while (true) {
-      if (*p_chunk_ptr == nullptr) {
-        *p_chunk_ptr = NodeAllocator_allocate(alloc);
-      }
-      if (i < chunk_start + chunk_size) {
-        return;
-      }
-      p_chunk_ptr = (Ptr *)*p_chunk_ptr;
-      chunk_start += chunk_size;
-    }
-  });
+  auto n = __atomic_load_n(&node->n, std::memory_order::memory_order_seq_cst);
+  if (i < n)
+    return;
+  // Chunks first, so that all elements below n are backed by memory
+  int last, j;
+  Dynamic_locate(meta, i, last, j);
+  for (int c = 0; c <= last; c++)
+    Dynamic_allocate_chunk(meta, node, c);
+  while (n < i + 1 &&
+         !__atomic_compare_exchange_n(&node->n, &n, i + 1, false,
+                                      std::memory_order::memory_order_seq_cst,
+                                      std::memory_order::memory_order_seq_cst))
+    ;
 }
 
 i32 Dynamic_append(Ptr meta_, Ptr node_, i32 data) {
   auto meta = (DynamicMeta *)(meta_);
   auto node = (DynamicNode *)(node_);
-  auto chunk_size = meta->chunk_size;
-  i32 tail;
-  locked_task(Ptr(&node->lock), [&] {
-    auto i = node->n;
-    int chunk_start = 0;
-    auto p_chunk_ptr = &node->ptr;
-    auto rt = (Runtime *)meta->context->runtime;
-    auto alloc = rt->node_allocators[meta->snode_id];
-    while (true) {
-      if (*p_chunk_ptr == nullptr) {
-        *p_chunk_ptr = NodeAllocator_allocate(alloc);
-      }
-      if (i < chunk_start + chunk_size) {
-        tail = node->n;
-        node->n += 1;
-        *(i32 *)(*p_chunk_ptr + sizeof(Ptr) +
-                 (i - chunk_start) * meta->element_size) = data;
-        return;
-      }
-      p_chunk_ptr = (Ptr *)(*p_chunk_ptr);
-      chunk_start += chunk_size;
-    }
-  });
-  return tail;
+  auto i = warp_aggregated_atomic_inc_i32(&node->n);
+  if (i >= meta->max_num_elements) {
+    atomic_add_i32(&node->n, -1);
+    return i;
+  }
+  int c, j;
+  Dynamic_locate(meta, i, c, j);
+  auto chunk = Dynamic_allocate_chunk(meta, node, c);
+  *(i32 *)(chunk + j * meta->element_size) = data;
+  return i;
+}
+
+// Deactivates the whole list, like the legacy backends
+void Dynamic_deactivate(Ptr meta_, Ptr node_, int i) {
+  auto meta = (DynamicMeta *)(meta_);
+  auto node = (DynamicNode *)(node_);
+  int last, j;
+  Dynamic_locate(meta, meta->max_num_elements - 1, last, j);
+  node->n = 0;
+  for (int c = 0; c <= last; c++) {
+    auto chunk =
+        __atomic_exchange_n(&node->chunks[c], (Ptr) nullptr,
+                            std::memory_order::memory_order_seq_cst);
+    if (chunk != nullptr)
+      NodeAllocator_recycle(Dynamic_get_allocator(meta, c), chunk);
+  }
+}
+
+// Drops the chunks without recycling them, see deactivate_all_elements
+void Dynamic_reset(Ptr meta_, Ptr node_) {
+  auto meta = (DynamicMeta *)(meta_);
+  auto node = (DynamicNode *)(node_);
+  int last, j;
+  Dynamic_locate(meta, meta->max_num_elements - 1, last, j);
+  node->n = 0;
+  for (int c = 0; c <= last; c++)
+    node->chunks[c] = nullptr;
 }
 
 bool Dynamic_is_active(Ptr meta_, Ptr node_, int i) {
@@ -75,24 +131,24 @@ bool Dynamic_is_active(Ptr meta_, Ptr node_, int i) {
 void *Dynamic_lookup_element(Ptr meta_, Ptr node_, int i) {
   auto meta = (DynamicMeta *)(meta_);
   auto node = (DynamicNode *)(node_);
+  Ptr chunk = nullptr;
+  int c, j;
   if (Dynamic_is_active(meta_, node_, i)) {
-    int chunk_start = 0;
-    auto chunk_ptr = node->ptr;
-    auto chunk_size = meta->chunk_size;
-    while (true) {
-      if (i < chunk_start + chunk_size) {
-        auto addr = chunk_ptr + sizeof(Ptr) + (i - chunk_start) * meta->element_size;
-        return addr;
-      }
-      chunk_ptr = *(Ptr *)chunk_ptr;
-      chunk_start += chunk_size;
-    }
-  } else {
+    Dynamic_locate(meta, i, c, j);
+    chunk = Dynamic_get_chunk(node, c);
+  }
+  if (chunk == nullptr) {
+    // Also covers elements of a concurrent append whose chunk is not yet
+    // published
     return ((Runtime *)meta->context->runtime)->ambient_elements[meta->snode_id];
   }
+  return chunk + j * meta->element_size;
 }
 
 int Dynamic_get_num_elements(Ptr meta_, Ptr node_) {
   auto node = (DynamicNode *)(node_);
-  return node->n;
+  auto n = node->n;
+  auto meta = (StructMeta *)meta_;
+  // Appends past the capacity are rolled back, but may be visible briefly
+  return n < meta->max_num_elements ? n : meta->max_num_elements;
 }
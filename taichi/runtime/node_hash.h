@@ -0,0 +1,117 @@
+#pragma once
+
+// An open-addressing hash table from the linearized cell index to the child
+// element. Keys are stored as index + 1 so that zero-initialized memory is an
+// empty table. Slots are claimed with a CAS on the key and never released, and
+// the child is published with a CAS on the value, so both insertion and lookup
+// are lock-free.
+struct HashMeta : public StructMeta {
+  int capacity;
+};
+
+STRUCT_FIELD(HashMeta, capacity);
+
+i32 *Hash_get_keys(Ptr node) {
+  return (i32 *)node;
+}
+
+Ptr *Hash_get_values(Ptr meta, Ptr node) {
+  return (Ptr *)(node + sizeof(i32) * ((HashMeta *)meta)->capacity);
+}
+
+int Hash_get_home_slot(Ptr meta, int i) {
+  // Fibonacci hashing spreads consecutive cell indices. The well-mixed bits
+  // of the product are the high ones.
+  auto log2_capacity = __builtin_ctz(((HashMeta *)meta)->capacity);
+  if (log2_capacity == 0)
+    return 0;
+  return (int)(((u32)i * 2654435769u) >> (32 - log2_capacity));
+}
+
+// Returns the slot holding cell i, or -1 if cell i is not in the table
+int Hash_find_slot(Ptr meta, Ptr node, int i) {
+  auto capacity = ((HashMeta *)meta)->capacity;
+  auto keys = Hash_get_keys(node);
+  int slot = Hash_get_home_slot(meta, i);
+  for (int probe = 0; probe < capacity; probe++) {
+    auto key = __atomic_load_n(&keys[slot],
+                               std::memory_order::memory_order_seq_cst);
+    if (key == i + 1)
+      return slot;
+    if (key == 0)
+      return -1;
+    slot = (slot + 1) & (capacity - 1);
+  }
+  return -1;
+}
+
+void Hash_activate(Ptr meta, Ptr node, int i) {
+  auto smeta = (StructMeta *)meta;
+  auto capacity = ((HashMeta *)meta)->capacity;
+  auto keys = Hash_get_keys(node);
+  auto values = Hash_get_values(meta, node);
+  int slot = Hash_get_home_slot(meta, i);
+  int probe = 0;
+  for (; probe < capacity; probe++) {
+    i32 key = 0;
+    if (__atomic_compare_exchange_n(&keys[slot], &key, i + 1, false,
+                                    std::memory_order::memory_order_seq_cst,
+                                    std::memory_order::memory_order_seq_cst) ||
+        key == i + 1) {
+      break;
+    }
+    slot = (slot + 1) & (capacity - 1);
+  }
+  auto rt = (Runtime *)smeta->context->runtime;
+  if (probe == capacity) {
+    // The cell stays inactive, and the host raises the error
+    rt->counters.full_hash_table = smeta->snode_id + 1;
+    return;
+  }
+  if (__atomic_load_n(&values[slot], std::memory_order::memory_order_seq_cst))
+    return;
+  // Threads racing for the same new cell each allocate a child; the losers
+  // hand theirs back to the allocator
+  auto alloc = rt->node_allocators[smeta->snode_id];
+  auto child = NodeAllocator_allocate(alloc);
+  Ptr expected = nullptr;
+  if (!__atomic_compare_exchange_n(&values[slot], &expected, child, false,
+                                   std::memory_order::memory_order_seq_cst,
+                                   std::memory_order::memory_order_seq_cst)) {
+    NodeAllocator_recycle(alloc, child);
+  } else {
+    Runtime_bump_structure_version(rt, smeta->snode_id);
+  }
+}
+
+bool Hash_is_active(Ptr meta, Ptr node, int i) {
+  int slot = Hash_find_slot(meta, node, i);
+  return slot != -1 && Hash_get_values(meta, node)[slot] != nullptr;
+}
+
+void *Hash_lookup_element(Ptr meta, Ptr node, int i) {
+  int slot = Hash_find_slot(meta, node, i);
+  Ptr data_ptr = nullptr;
+  if (slot != -1)
+    data_ptr = Hash_get_values(meta, node)[slot];
+  if (data_ptr == nullptr) {
+    auto smeta = (StructMeta *)meta;
+    auto context = smeta->context;
+    data_ptr = ((Runtime *)context->runtime)->ambient_elements[smeta->snode_id];
+  }
+  return data_ptr;
+}
+
+// Listgen iterates over slots instead of the (potentially huge) index space,
+// see element_listgen_hash
+int Hash_get_num_elements(Ptr meta, Ptr node) {
+  return ((HashMeta *)meta)->capacity;
+}
+
+int Hash_get_key(Ptr node, int slot) {
+  return Hash_get_keys(node)[slot];
+}
+
+Ptr Hash_get_value(Ptr meta, Ptr node, int slot) {
+  return Hash_get_values(meta, node)[slot];
+}
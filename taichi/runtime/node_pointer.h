@@ -2,31 +2,180 @@
 
 // Specialized Attributes and functions
 struct PointerMeta : public StructMeta {
-  bool _;
+  bool compressed;
 };
 
-STRUCT_FIELD(PointerMeta, _);
+STRUCT_FIELD(PointerMeta, compressed);
+
+// On GPUs, a node being activated by another thread holds this instead of
+// its data pointer
+#define POINTER_PENDING ((Ptr)1)
+
+// Compressed pointer nodes (SNode::compressed) hold a 32-bit word instead of
+// a lock and a 64-bit pointer: the position of their node in the allocator
+// of the SNode plus one, zero if inactive, shifted above a lock bit. The lock
+// bit alone is set while a thread activates the node.
+#define COMPRESSED_POINTER_PENDING 1u
+
+bool Pointer_is_compressed(Ptr meta) {
+  return PointerMeta_get_compressed((PointerMeta *)meta);
+}
+
+NodeAllocator *Pointer_get_allocator(Ptr meta) {
+  auto smeta = (StructMeta *)meta;
+  auto rt = (Runtime *)smeta->context->runtime;
+  return rt->node_allocators[smeta->snode_id];
+}
+
+// The node of an active compressed pointer node, otherwise nullptr
+Ptr CompressedPointer_get_data(Ptr meta, u32 word) {
+  if ((word >> 1) == 0)
+    return nullptr;
+  return NodeAllocator_node_at(Pointer_get_allocator(meta), (word >> 1) - 1);
+}
+
+void CompressedPointer_activate(Ptr meta, Ptr node) {
+  auto &word = *(u32 *)node;
+  // Most activations find the node active already
+  if (__atomic_load_n(&word, std::memory_order::memory_order_seq_cst) >> 1)
+    return;
+  u32 expected = 0;
+  if (__atomic_compare_exchange_n(&word, &expected, COMPRESSED_POINTER_PENDING,
+                                  false,
+                                  std::memory_order::memory_order_seq_cst,
+                                  std::memory_order::memory_order_seq_cst)) {
+    auto p = NodeAllocator_allocate_index(Pointer_get_allocator(meta));
+    // The zeroed node must be visible before other threads see its index
+    threadfence();
+    __atomic_store_n(&word, (u32)(p + 1) << 1,
+                     std::memory_order::memory_order_seq_cst);
+    auto smeta = (StructMeta *)meta;
+    Runtime_bump_structure_version((Runtime *)smeta->context->runtime,
+                                   smeta->snode_id);
+  }
+  // Nodes being activated by other threads
+  while (__atomic_load_n(&word, std::memory_order::memory_order_seq_cst) ==
+         COMPRESSED_POINTER_PENDING) {
+  }
+}
+
+// Without a lock: the thread that clears the word frees the node
+void CompressedPointer_deactivate(Ptr meta, Ptr node) {
+  auto &word = *(u32 *)node;
+  u32 expected =
+      __atomic_load_n(&word, std::memory_order::memory_order_seq_cst);
+  if ((expected >> 1) == 0 || (expected & 1))
+    return;
+  if (__atomic_compare_exchange_n(&word, &expected, 0u, false,
+                                  std::memory_order::memory_order_seq_cst,
+                                  std::memory_order::memory_order_seq_cst)) {
+    auto alloc = Pointer_get_allocator(meta);
+    NodeAllocator_recycle(alloc,
+                          NodeAllocator_node_at(alloc, (expected >> 1) - 1));
+    auto smeta = (StructMeta *)meta;
+    Runtime_bump_structure_version((Runtime *)smeta->context->runtime,
+                                   smeta->snode_id);
+  }
+}
 
 void Pointer_activate(Ptr meta, Ptr node, int i) {
+  if (Pointer_is_compressed(meta)) {
+    CompressedPointer_activate(meta, node);
+    return;
+  }
+  Ptr &data_ptr = *(Ptr *)(node + 8);
+  auto smeta = (StructMeta *)meta;
+  auto rt = (Runtime *)smeta->context->runtime;
+  auto alloc = rt->node_allocators[smeta->snode_id];
+#if ARCH_cuda
+  // Lanes of a warp activate together, without locks: first each lane marks
+  // its node as requested (only one of the lanes asking for a node wins),
+  // then the winners take their nodes in a batch and link them
+  Ptr expected = nullptr;
+  bool requested =
+      __atomic_load_n(&data_ptr, std::memory_order::memory_order_seq_cst) ==
+          nullptr &&
+      __atomic_compare_exchange_n(&data_ptr, &expected, POINTER_PENDING, false,
+                                  std::memory_order::memory_order_seq_cst,
+                                  std::memory_order::memory_order_seq_cst);
+  if (cuda_ballot(requested)) {
+    auto new_node = NodeAllocator_allocate_in_warp(alloc, requested);
+    if (requested) {
+      // The zeroed node must be visible before other threads see the pointer
+      threadfence();
+      __atomic_store_n(&data_ptr, new_node,
+                       std::memory_order::memory_order_seq_cst);
+      Runtime_bump_structure_version(rt, smeta->snode_id);
+    }
+  }
+  // Nodes requested by other warps
+  while (__atomic_load_n(&data_ptr, std::memory_order::memory_order_seq_cst) ==
+         POINTER_PENDING) {
+  }
+#else
+  // Most activations find the node active already, which needs no lock
+  if (__atomic_load_n(&data_ptr, std::memory_order::memory_order_seq_cst) !=
+      nullptr)
+    return;
   Ptr lock = node;
   locked_task(lock, [&] {
-    Ptr &data_ptr = *(Ptr *)(node + 8);
     if (data_ptr == nullptr) {
+      auto new_node = NodeAllocator_allocate(alloc);
+      // The zeroed node must be visible before threads taking the path
+      // above see the pointer
+      threadfence();
+      __atomic_store_n(&data_ptr, new_node,
+                       std::memory_order::memory_order_seq_cst);
+      Runtime_bump_structure_version(rt, smeta->snode_id);
+    }
+  });
+#endif
+}
+
+void Pointer_deactivate(Ptr meta, Ptr node, int i) {
+  if (Pointer_is_compressed(meta)) {
+    CompressedPointer_deactivate(meta, node);
+    return;
+  }
+  Ptr lock = node;
+  locked_task(lock, [&] {
+    Ptr &data_ptr = *(Ptr *)(node + 8);
+    if (data_ptr != nullptr && data_ptr != POINTER_PENDING) {
       auto smeta = (StructMeta *)meta;
       auto rt = (Runtime *)smeta->context->runtime;
       auto alloc = rt->node_allocators[smeta->snode_id];
-      data_ptr = NodeAllocator_allocate(alloc);
+      NodeAllocator_recycle(alloc, data_ptr);
+      data_ptr = nullptr;
+      Runtime_bump_structure_version(rt, smeta->snode_id);
     }
   });
 }
 
+// Drops the node without recycling it, see deactivate_all_elements
+void Pointer_reset(Ptr meta, Ptr node) {
+  if (Pointer_is_compressed(meta))
+    *(u32 *)node = 0;
+  else
+    *(Ptr *)(node + 8) = nullptr;
+}
+
+// The node of an active pointer node, otherwise nullptr
+Ptr Pointer_get_data(Ptr meta, Ptr node) {
+  if (Pointer_is_compressed(meta))
+    return CompressedPointer_get_data(meta, *(u32 *)node);
+  auto data_ptr = *(Ptr *)(node + 8);
+  return data_ptr == POINTER_PENDING ? nullptr : data_ptr;
+}
+
 bool Pointer_is_active(Ptr meta, Ptr node, int i) {
+  if (Pointer_is_compressed(meta))
+    return (*(u32 *)node >> 1) != 0;
   auto data_ptr = *(Ptr *)(node + 8);
-  return data_ptr != nullptr;
+  return data_ptr != nullptr && data_ptr != POINTER_PENDING;
 }
 
 void *Pointer_lookup_element(Ptr meta, Ptr node, int i) {
-  auto data_ptr = *(Ptr *)(node + 8);
+  auto data_ptr = Pointer_get_data(meta, node);
   if (data_ptr == nullptr) {
     auto smeta = (StructMeta *)meta;
     auto context = smeta->context;
@@ -39,3 +188,114 @@ int Pointer_get_num_elements(Ptr meta, Ptr node) {
   return 1;
 }
 
+
+// The first step of defragmenting a pointer node, in a single thread: lists
+// the links of its active instances, in the order of its element list, and
+// frees all nodes but the kept ones at once. The nodes keep their data,
+// since the copies below run before any other allocation.
+void Pointer_defragment_gather(Runtime *runtime, StructMeta *meta) {
+  auto list = runtime->element_lists[meta->snode_id];
+  auto alloc = runtime->node_allocators[meta->snode_id];
+  int n = 0;
+  for (int i = 0; i < list->tail; i++)
+    n += Pointer_is_active((Ptr)meta, ElementList_get(list, i)->element, 0);
+  // The instances, then the copies of their nodes. Outgrown buffers are left
+  // to the memory pool, so they grow geometrically.
+  std::size_t size = (std::size_t)n * (sizeof(Ptr) + alloc->node_size);
+  if (size > alloc->relocation_buffer_size) {
+    if (size < alloc->relocation_buffer_size * 2)
+      size = alloc->relocation_buffer_size * 2;
+    alloc->relocation_buffer = allocate_from_memory_pool(runtime, size, 4096);
+    alloc->relocation_buffer_size = size;
+  }
+  auto links = (Ptr *)alloc->relocation_buffer;
+  int k = 0;
+  for (int i = 0; i < list->tail; i++) {
+    auto node = ElementList_get(list, i)->element;
+    if (Pointer_is_active((Ptr)meta, node, 0))
+      links[k++] = node;
+  }
+  alloc->num_relocated_nodes = n;
+  NodeAllocator_reset(alloc);
+  alloc->tail = alloc->num_kept_nodes + n;
+  Runtime_bump_structure_version(runtime, meta->snode_id);
+}
+
+// The other two steps, a block of threads per node on GPUs: the nodes are
+// copied to the buffer (back = 0), then from it to the front of the
+// allocator (back = 1), where the links are pointed. The front was taken
+// before, so its chunks exist.
+void Pointer_defragment_copy(Runtime *runtime, StructMeta *meta, int back) {
+  auto alloc = runtime->node_allocators[meta->snode_id];
+  auto n = alloc->num_relocated_nodes;
+  auto links = (Ptr *)alloc->relocation_buffer;
+  auto copies = alloc->relocation_buffer + sizeof(Ptr) * n;
+  auto node_size = alloc->node_size;
+  auto num_words = node_size / 8;
+#if ARCH_cuda
+  int i_start = block_idx();
+  int i_step = grid_dim();
+  int j_start = thread_idx();
+  int j_step = block_dim();
+#else
+  int i_start = 0;
+  int i_step = 1;
+  int j_start = 0;
+  int j_step = 1;
+#endif
+  for (int i = i_start; i < n; i += i_step) {
+    auto copy = (uint64 *)(copies + node_size * i);
+    if (back) {
+      auto p = alloc->num_kept_nodes + i;
+      auto node = NodeAllocator_node_at(alloc, p);
+      for (std::size_t k = j_start; k < num_words; k += j_step)
+        ((uint64 *)node)[k] = copy[k];
+      if (j_start == 0) {
+        if (Pointer_is_compressed((Ptr)meta))
+          *(u32 *)links[i] = (u32)(p + 1) << 1;
+        else
+          *(Ptr *)(links[i] + 8) = node;
+      }
+    } else {
+      auto node = (uint64 *)Pointer_get_data((Ptr)meta, links[i]);
+      for (std::size_t k = j_start; k < num_words; k += j_step)
+        copy[k] = node[k];
+    }
+  }
+}
+
+// Deactivates the instances of a pointer node in its element list whose
+// nodes hold nothing but zeros, as the ambient node does, a thread per
+// instance on GPUs. Each node is scanned in runs of words that vectorize,
+// up to the first nonzero one.
+void Pointer_deactivate_ambient(Runtime *runtime, StructMeta *meta) {
+  auto list = runtime->element_lists[meta->snode_id];
+  auto alloc = runtime->node_allocators[meta->snode_id];
+  auto num_words = alloc->node_size / 8;
+  constexpr std::size_t run = 32;
+#if ARCH_cuda
+  int i_start = block_idx() * block_dim() + thread_idx();
+  int i_step = grid_dim() * block_dim();
+#else
+  int i_start = 0;
+  int i_step = 1;
+#endif
+  for (int i = i_start; i < list->tail; i += i_step) {
+    auto node = ElementList_get(list, i)->element;
+    if (!Pointer_is_active((Ptr)meta, node, 0))
+      continue;
+    auto data_ptr = Pointer_get_data((Ptr)meta, node);
+    auto words = (uint64 *)data_ptr;
+    uint64 bits = 0;
+    for (std::size_t k = 0; k < num_words && bits == 0; k += run) {
+      auto end = k + run < num_words ? k + run : num_words;
+      for (std::size_t j = k; j < end; j++)
+        bits |= words[j];
+    }
+    if (bits == 0) {
+      NodeAllocator_recycle(alloc, data_ptr);
+      Pointer_reset((Ptr)meta, node);
+      Runtime_bump_structure_version(runtime, meta->snode_id);
+    }
+  }
+}
@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <type_traits>
 #include "../constants.h"
+#include "../runtime_counters.h"
 
 #if defined(__linux__) && !ARCH_cuda
 __asm__(".symver logf,logf@GLIBC_2.2.5");
@@ -90,46 +91,117 @@ DEFINE_UNARY_REAL_FUNC(abs)
 DEFINE_UNARY_REAL_FUNC(acos)
 DEFINE_UNARY_REAL_FUNC(asin)
 
-int abs_i32(int a) {
-  if (a > 0) {
-    return a;
-  } else {
-    return -a;
-  }
+// Branch-free (Cephes) versions of the f32 functions above, made of
+// arithmetic only so that loops using them vectorize. Used on CPUs with fast
+// math. Errors are within a few ulp, except that denormal results flush to
+// zero.
+
+f32 bits_to_f32(i32 i) {
+  union {
+    f32 f;
+    i32 i;
+  } bits;
+  bits.i = i;
+  return bits.f;
 }
 
-#if ARCH_x86_64
-
-u32 rand_u32() {
-  static u32 x = 123456789, y = 362436069, z = 521288629, w = 88675123;
-  u32 t = x ^ (x << 11);
-  x = y;
-  y = z;
-  z = w;
-  return (w = (w ^ (w >> 19)) ^ (t ^ (t >> 8)));
+i32 f32_to_bits(f32 f) {
+  union {
+    f32 f;
+    i32 i;
+  } bits;
+  bits.f = f;
+  return bits.i;
 }
 
-u64 rand_u64() {
-  return ((u64)rand_u32() << 32) + rand_u32();
+f32 vec_exp_f32(f32 x) {
+  // exp(x) = 2^n exp(r), |r| <= ln(2) / 2
+  f32 c = x > 88.7228390520683f ? 88.7228390520683f : x;
+  c = c < -87.3365447504f ? -87.3365447504f : c;
+  f32 n = std::floor(c * 1.44269504088896341f + 0.5f);
+  f32 r = c - n * 0.693359375f + n * 2.12194440e-4f;
+  f32 p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+  // 2^n in two factors, which stay normal for n = 128
+  i32 n1 = (i32)n >> 1;
+  f32 ret = p * bits_to_f32((n1 + 127) << 23) *
+            bits_to_f32(((i32)n - n1 + 127) << 23);
+  ret = x > 88.7228390520683f ? __builtin_inff() : ret;
+  return x < -87.3365447504f ? 0.0f : ret;
 }
 
-f32 rand_f32() {
-  return rand_u32() * f32(1 / 4294967296.0);
+f32 vec_log_f32(f32 x) {
+  i32 bits = f32_to_bits(x);
+  // x = m 2^e, m in [sqrt(0.5), sqrt(2))
+  f32 e = (f32)(((bits >> 23) & 0xff) - 126);
+  f32 m = bits_to_f32((bits & 0x007fffff) | 0x3f000000);
+  bool small = m < 0.707106781186547524f;
+  e = small ? e - 1.0f : e;
+  m = small ? m + m - 1.0f : m - 1.0f;
+  f32 z = m * m;
+  f32 p = 7.0376836292e-2f;
+  p = p * m - 1.1514610310e-1f;
+  p = p * m + 1.1676998740e-1f;
+  p = p * m - 1.2420140846e-1f;
+  p = p * m + 1.4249322787e-1f;
+  p = p * m - 1.6668057665e-1f;
+  p = p * m + 2.0000714765e-1f;
+  p = p * m - 2.4999993993e-1f;
+  p = p * m + 3.3333331174e-1f;
+  f32 y = m * z * p - e * 2.12194440e-4f - 0.5f * z;
+  f32 ret = m + y + e * 0.693359375f;
+  ret = x == __builtin_inff() ? x : ret;
+  ret = x == 0.0f ? -__builtin_inff() : ret;
+  return x < 0.0f || x != x ? __builtin_nanf("") : ret;
 }
 
-f64 rand_f64() {
-  return rand_f32();
+f32 vec_tan_f32(f32 x) {
+  f32 a = x < 0.0f ? -x : x;
+  // Reduce to [-pi/4, pi/4] around the nearest multiple j of pi/4, j even
+  i32 j = (i32)(a * 1.27323954473516f);
+  j += j & 1;
+  f32 y = (f32)j;
+  f32 z = ((a - y * 0.78515625f) - y * 2.4187564849853515625e-4f) -
+          y * 3.77489497744594108e-8f;
+  f32 zz = z * z;
+  f32 p = 9.38540185543e-3f;
+  p = p * zz + 3.11992232697e-3f;
+  p = p * zz + 2.44301354525e-2f;
+  p = p * zz + 5.34112807005e-2f;
+  p = p * zz + 1.33387994085e-1f;
+  p = p * zz + 3.33331568548e-1f;
+  f32 t = p * zz * z + z;
+  t = (j & 2) ? -1.0f / t : t;
+  return x < 0.0f ? -t : t;
 }
 
-i32 rand_i32() {
-  return rand_u32();
+f32 vec_tanh_f32(f32 x) {
+  f32 a = x < 0.0f ? -x : x;
+  f32 z = x * x;
+  f32 p = -5.70498872745e-3f;
+  p = p * z + 2.06390887954e-2f;
+  p = p * z - 5.37397155531e-2f;
+  p = p * z + 1.33314422036e-1f;
+  p = p * z - 3.33332819422e-1f;
+  f32 small = p * z * x + x;
+  f32 large = 1.0f - 2.0f / (vec_exp_f32(a + a) + 1.0f);
+  large = x < 0.0f ? -large : large;
+  return a < 0.625f ? small : large;
 }
 
-i64 rand_i64() {
-  return rand_u64();
+int abs_i32(int a) {
+  if (a > 0) {
+    return a;
+  } else {
+    return -a;
+  }
 }
 
-#endif
 
 int max_i32(int a, int b) {
   return a > b ? a : b;
@@ -187,14 +259,19 @@ struct PhysicalCoordinates {
 
 STRUCT_FIELD_ARRAY(PhysicalCoordinates, val);
 
+// Same layout as the host Context
 struct Context {
   void *buffer;
-  ContextArgType args[taichi_max_num_args];
-  int32 extra_args[taichi_max_num_args][taichi_max_num_indices];
   void *leaves;
   int num_leaves;
   void *cpu_profiler;
   Ptr runtime;
+  // Random seed in the low, index of the kernel launch in the high 32 bits
+  u64 rand_seed;
+  i32 *loop_gate;
+  i32 loop_iteration;
+  ContextArgType args[taichi_max_num_args];
+  int32 extra_args[taichi_max_num_args][taichi_max_num_indices];
 };
 
 STRUCT_FIELD_ARRAY(Context, args);
@@ -205,6 +282,55 @@ int32 Context_get_extra_args(Context *ctx, int32 i, int32 j) {
   return ctx->extra_args[i][j];
 }
 
+// Philox-4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+// 3", SC'11). Its output is a pure function of the key and the counter, so
+// random numbers need neither state nor locks, and do not depend on how
+// loop iterations are mapped to threads.
+void philox4x32_10(u32 key0, u32 key1, u32 ctr[4]) {
+  for (int r = 0; r < 10; r++) {
+    u64 p0 = (u64)0xD2511F53 * ctr[0];
+    u64 p1 = (u64)0xCD9E8D57 * ctr[2];
+    u32 c0 = (u32)(p1 >> 32) ^ ctr[1] ^ key0;
+    u32 c2 = (u32)(p0 >> 32) ^ ctr[3] ^ key1;
+    ctr[0] = c0;
+    ctr[1] = (u32)p1;
+    ctr[2] = c2;
+    ctr[3] = (u32)p0;
+    key0 += 0x9E3779B9;
+    key1 += 0xBB67AE85;
+  }
+}
+
+// The key is the launch seed, the counter the task, the loop iteration and
+// the number of random numbers the iteration has drawn before
+u64 rand_u64(Context *context, i32 task, i32 iteration, i32 counter) {
+  u32 ctr[4] = {(u32)iteration, (u32)counter, (u32)task, 0};
+  philox4x32_10((u32)context->rand_seed, (u32)(context->rand_seed >> 32),
+                ctr);
+  return ((u64)ctr[1] << 32) | ctr[0];
+}
+
+u32 rand_u32(Context *context, i32 task, i32 iteration, i32 counter) {
+  return (u32)rand_u64(context, task, iteration, counter);
+}
+
+f32 rand_f32(Context *context, i32 task, i32 iteration, i32 counter) {
+  return (rand_u32(context, task, iteration, counter) >> 8) * (1.0f / 16777216);
+}
+
+f64 rand_f64(Context *context, i32 task, i32 iteration, i32 counter) {
+  return (rand_u64(context, task, iteration, counter) >> 11) *
+         (1.0 / 9007199254740992.0);
+}
+
+i32 rand_i32(Context *context, i32 task, i32 iteration, i32 counter) {
+  return (i32)rand_u32(context, task, iteration, counter);
+}
+
+i64 rand_i64(Context *context, i32 task, i32 iteration, i32 counter) {
+  return (i64)rand_u64(context, task, iteration, counter);
+}
+
 #include "atomic.h"
 
 // These structures are accessible by both the LLVM backend and this C++ runtime
@@ -251,21 +377,49 @@ void ___stubs___() {
 #endif
 }
 
+// The coordinates come last: the records of an element list only hold the
+// coordinates its cells can have, see ElementList::num_coordinates
 struct Element {
   Ptr element;
-  int self_idx;
   int loop_bounds[2];
   PhysicalCoordinates pcoord;
 };
 
+// The bytes of an element with n coordinates, keeping the node pointers of
+// consecutive ones aligned
+constexpr std::size_t element_stride(int n) {
+  return (sizeof(Element) - sizeof(int) * (taichi_max_num_indices - n) +
+          alignof(Element) - 1) /
+         alignof(Element) * alignof(Element);
+}
+
 STRUCT_FIELD(Element, element);
 STRUCT_FIELD(Element, pcoord);
 STRUCT_FIELD_ARRAY(Element, loop_bounds);
 
 struct ElementList {
   Element *elements;
+  // The coordinates of the cells of the SNode that can be nonzero, which the
+  // first num_coordinates entries of pcoord hold, and the bytes of a record
+  i32 num_coordinates;
+  i32 element_stride;
+  // Per parent element: the number of its active children, then the position
+  // of its first child in this list (two-pass listgen)
+  i32 *offsets;
+  // Per element: the cells of the elements before it, see
+  // balanced_block_helper (CPUs only)
+  i64 *work;
   i32 head;
   i32 tail;
+  // Sum of the structure versions of the ancestors when the list was
+  // generated, -1 if the list cannot be reused, see clear_list_if_outdated
+  i64 structure_key;
+  // Set if the list was reused, so that listgen skips it
+  i32 up_to_date;
+  // The next part of an element to claim, and the blocks done, in
+  // for_each_block_persistent
+  i32 next_part;
+  i32 num_finished_blocks;
 };
 
 void ElementList_initialize(Runtime *runtime, ElementList *element_list) {
@@ -274,127 +428,477 @@ void ElementList_initialize(Runtime *runtime, ElementList *element_list) {
 #else
   auto list_size = 1024 * 1024 * 1024;
 #endif
+  // Enough for the elements of a list of one coordinate
+  auto max_num_elements = list_size / element_stride(1);
   element_list->elements = (Element *)allocate(runtime, list_size);
+  element_list->offsets =
+      (i32 *)allocate(runtime, max_num_elements * sizeof(i32));
+#if ARCH_cuda
+  element_list->work = nullptr;
+#else
+  element_list->work =
+      (i64 *)allocate(runtime, (max_num_elements + 1) * sizeof(i64));
+#endif
+  element_list->num_coordinates = taichi_max_num_indices;
+  element_list->element_stride = sizeof(Element);
   element_list->tail = 0;
+  element_list->structure_key = -1;
+  element_list->up_to_date = 0;
+  element_list->next_part = 0;
+  element_list->num_finished_blocks = 0;
+}
+
+i32 warp_aggregated_atomic_inc_i32(volatile i32 *dest);
+
+Element *ElementList_get(ElementList *element_list, int i) {
+  return (Element *)((char *)element_list->elements +
+                     (std::size_t)i * element_list->element_stride);
+}
+
+// Stores element at position i, up to its last coordinate
+void ElementList_set(ElementList *element_list, int i, Element *element) {
+  auto dest = (u32 *)ElementList_get(element_list, i);
+  auto src = (u32 *)element;
+  for (int k = 0; k < element_list->element_stride / 4; k++)
+    dest[k] = src[k];
 }
 
 void ElementList_insert(ElementList *element_list, Element *element) {
-  element_list->elements[atomic_add_i32(&element_list->tail, 1)] = *element;
+  ElementList_set(element_list,
+                  warp_aggregated_atomic_inc_i32(&element_list->tail), element);
+}
+
+void ElementList_set_num_coordinates(ElementList *element_list, int n) {
+  element_list->num_coordinates = n;
+  element_list->element_stride = (i32)element_stride(n);
 }
 
 void ElementList_clear(ElementList *element_list) {
   element_list->tail = 0;
 }
 
+Ptr allocate_from_memory_pool(Runtime *runtime,
+                              std::size_t size,
+                              std::size_t alignment);
+
+std::size_t Runtime_get_page_size(Runtime *runtime);
+
+// Stops the kernel, which cannot go on without the memory it asked for
+void taichi_runtime_out_of_memory(const char *what, u64 value) {
+  printf("Taichi runtime out of memory: %s (%llu)\n", what,
+         (unsigned long long)value);
+  __builtin_trap();
+}
+
+// Deposits the low bits of x into the set bits of mask, and gathers them back
+// (pdep and pext of BMI2), for the cell indices of Morton ordered dense
+// nodes. The masks are constants, so the loops fold away when inlined.
+i32 deposit_bits(i32 x, i32 mask) {
+#if defined(__BMI2__)
+  return (i32)__builtin_ia32_pdep_si((u32)x, (u32)mask);
+#else
+  u32 ret = 0;
+  int k = 0;
+  for (int i = 0; i < 32; i++) {
+    if (((u32)mask >> i) & 1) {
+      ret |= (((u32)x >> k) & 1u) << i;
+      k++;
+    }
+  }
+  return (i32)ret;
+#endif
+}
+
+i32 extract_bits(i32 x, i32 mask) {
+#if defined(__BMI2__)
+  return (i32)__builtin_ia32_pext_si((u32)x, (u32)mask);
+#else
+  u32 ret = 0;
+  int k = 0;
+  for (int i = 0; i < 32; i++) {
+    if (((u32)mask >> i) & 1) {
+      ret |= (((u32)x >> i) & 1u) << k;
+      k++;
+    }
+  }
+  return (i32)ret;
+#endif
+}
+
+constexpr int taichi_max_num_node_chunks = 1024;
+
+// Nodes live in chunks of chunk_num_nodes nodes, allocated from the memory
+// pool when the first node of a chunk is requested.
+//
+// Nodes returned by deactivation are pushed onto the recycled list while
+// kernels run, and only become allocatable after NodeAllocator_gc has moved
+// them to the free list between kernels. Since each of the two lock-free
+// stacks is either only pushed or only popped during a kernel, neither of them
+// suffers from the ABA problem. The first word of a listed node links to the
+// next one.
 struct NodeAllocator {
-  Ptr pool;
+  Runtime *runtime;
+  Ptr chunks[taichi_max_num_node_chunks];
   std::size_t node_size;
+  int chunk_num_nodes;
+  // log2(chunk_num_nodes) if it is a power of two, otherwise -1
+  int chunk_num_nodes_log2;
+  int num_chunks;
   int tail;
+  i32 lock;
+  i32 num_free_nodes;
+  Ptr free_list;
+  Ptr recycled_list;
+  Ptr recycled_list_tail;
+  // Allocations so far, including reused nodes
+  u64 num_allocations;
+  // Nodes below dirty_tail were handed out before the last NodeAllocator_reset
+  // and are zeroed again when taken. The first num_kept_nodes survive resets.
+  int dirty_tail;
+  int num_kept_nodes;
+  // The links and copies of the nodes being moved by defragmentation, see
+  // Pointer_defragment_gather
+  Ptr relocation_buffer;
+  std::size_t relocation_buffer_size;
+  int num_relocated_nodes;
 };
 
 void NodeAllocator_initialize(Runtime *runtime,
                               NodeAllocator *node_allocator,
-                              std::size_t node_size) {
-  node_allocator->pool =
-      (Ptr)allocate_aligned(runtime, 1024 * 1024 * 1024, 4096);
-  node_allocator->node_size = node_size;
+                              std::size_t node_size,
+                              int chunk_num_nodes) {
+  node_allocator->runtime = runtime;
+  for (int i = 0; i < taichi_max_num_node_chunks; i++) {
+    node_allocator->chunks[i] = nullptr;
+  }
+  // Room and alignment for the list link
+  node_allocator->node_size = (node_size + 7) / 8 * 8;
+  node_allocator->chunk_num_nodes = chunk_num_nodes;
+  node_allocator->chunk_num_nodes_log2 = -1;
+  if ((chunk_num_nodes & (chunk_num_nodes - 1)) == 0)
+    node_allocator->chunk_num_nodes_log2 = __builtin_ctz(chunk_num_nodes);
+  node_allocator->num_chunks = 0;
   node_allocator->tail = 0;
+  node_allocator->lock = 0;
+  node_allocator->num_free_nodes = 0;
+  node_allocator->free_list = nullptr;
+  node_allocator->recycled_list = nullptr;
+  node_allocator->recycled_list_tail = nullptr;
+  node_allocator->num_allocations = 0;
+  node_allocator->dirty_tail = 0;
+  node_allocator->num_kept_nodes = 0;
+  node_allocator->relocation_buffer = nullptr;
+  node_allocator->relocation_buffer_size = 0;
+  node_allocator->num_relocated_nodes = 0;
+}
+
+Ptr NodeAllocator_get_chunk(NodeAllocator *node_allocator, int c) {
+  if (c >= taichi_max_num_node_chunks)
+    taichi_runtime_out_of_memory("more node chunks than the maximum",
+                                 taichi_max_num_node_chunks);
+  auto chunk = __atomic_load_n(&node_allocator->chunks[c],
+                               std::memory_order::memory_order_seq_cst);
+  if (chunk != nullptr)
+    return chunk;
+  locked_task(&node_allocator->lock, [&] {
+    chunk = node_allocator->chunks[c];
+    if (chunk == nullptr) {
+      auto size = node_allocator->node_size * node_allocator->chunk_num_nodes;
+      auto page_size = Runtime_get_page_size(node_allocator->runtime);
+      // Small chunks are not worth a whole huge page
+      chunk = allocate_from_memory_pool(node_allocator->runtime, size,
+                                        size >= page_size ? page_size : 4096);
+      __atomic_store_n(&node_allocator->chunks[c], chunk,
+                       std::memory_order::memory_order_seq_cst);
+      node_allocator->num_chunks += 1;
+    }
+  });
+  return chunk;
+}
+
+// Takes a node from the free list, or returns nullptr if it is empty
+Ptr NodeAllocator_pop_free(NodeAllocator *node_allocator) {
+  Ptr head = node_allocator->free_list;
+  while (head != nullptr) {
+    Ptr next = *(Ptr *)head;
+    if (__atomic_compare_exchange(&node_allocator->free_list, &head, &next,
+                                  true,
+                                  std::memory_order::memory_order_seq_cst,
+                                  std::memory_order::memory_order_seq_cst)) {
+      atomic_add_i32(&node_allocator->num_free_nodes, -1);
+      // Fresh nodes from the pool are zero, so recycled ones must be as well
+      for (std::size_t i = 0; i < node_allocator->node_size / 8; i++) {
+        ((uint64 *)head)[i] = 0;
+      }
+      return head;
+    }
+  }
+  return nullptr;
+}
+
+// The p-th node of the chunks, taken by bumping the tail past it
+Ptr NodeAllocator_get_node(NodeAllocator *node_allocator, int p) {
+  auto chunk_num_nodes = node_allocator->chunk_num_nodes;
+  auto chunk = NodeAllocator_get_chunk(node_allocator, p / chunk_num_nodes);
+  auto node = chunk + node_allocator->node_size * (p % chunk_num_nodes);
+  if (p < node_allocator->dirty_tail) {
+    for (std::size_t i = 0; i < node_allocator->node_size / 8; i++) {
+      ((uint64 *)node)[i] = 0;
+    }
+  }
+  return node;
+}
+
+// The p-th node of the chunks, which must have been taken before
+Ptr NodeAllocator_node_at(NodeAllocator *node_allocator, int p) {
+  auto log2 = node_allocator->chunk_num_nodes_log2;
+  int c, k;
+  if (log2 >= 0) {
+    c = p >> log2;
+    k = p & ((1 << log2) - 1);
+  } else {
+    c = p / node_allocator->chunk_num_nodes;
+    k = p % node_allocator->chunk_num_nodes;
+  }
+  return node_allocator->chunks[c] + node_allocator->node_size * k;
+}
+
+// The inverse of NodeAllocator_node_at, searching the chunks
+int NodeAllocator_locate(NodeAllocator *node_allocator, Ptr node) {
+  auto chunk_bytes =
+      node_allocator->node_size * node_allocator->chunk_num_nodes;
+  for (int c = 0; c < taichi_max_num_node_chunks; c++) {
+    auto chunk = node_allocator->chunks[c];
+    if (chunk != nullptr && chunk <= node && node < chunk + chunk_bytes)
+      return c * node_allocator->chunk_num_nodes +
+             (int)((node - chunk) / node_allocator->node_size);
+  }
+  return -1;
+}
+
+// NodeAllocator_allocate, returning the position of the node instead. Only
+// reused nodes need a search of the chunks.
+int NodeAllocator_allocate_index(NodeAllocator *node_allocator) {
+  atomic_add_u64(&node_allocator->num_allocations, 1);
+  auto node = NodeAllocator_pop_free(node_allocator);
+  if (node != nullptr)
+    return NodeAllocator_locate(node_allocator, node);
+  auto p = atomic_add_i32(&node_allocator->tail, 1);
+  NodeAllocator_get_node(node_allocator, p);
+  return p;
 }
 
 Ptr NodeAllocator_allocate(NodeAllocator *node_allocator) {
-  int p = atomic_add_i32(&node_allocator->tail, 1);
-  return node_allocator->pool + node_allocator->node_size * p;
+  atomic_add_u64(&node_allocator->num_allocations, 1);
+  auto node = NodeAllocator_pop_free(node_allocator);
+  if (node != nullptr)
+    return node;
+  return NodeAllocator_get_node(node_allocator,
+                                atomic_add_i32(&node_allocator->tail, 1));
+}
+
+void NodeAllocator_recycle(NodeAllocator *node_allocator, Ptr node) {
+  Ptr head = node_allocator->recycled_list;
+  do {
+    *(Ptr *)node = head;
+  } while (!__atomic_compare_exchange(&node_allocator->recycled_list, &head,
+                                      &node, true,
+                                      std::memory_order::memory_order_seq_cst,
+                                      std::memory_order::memory_order_seq_cst));
+  // Only the push onto the empty list sees nullptr here
+  if (head == nullptr)
+    node_allocator->recycled_list_tail = node;
+  atomic_add_i32(&node_allocator->num_free_nodes, 1);
+}
+
+// Writes {reserved bytes, nodes in use, nodes waiting for reuse, node size,
+// peak nodes in use, allocations}. Free nodes are reused before the tail
+// grows, so the tail is the high-water mark
+void NodeAllocator_get_stat(NodeAllocator *node_allocator, uint64 *stat) {
+  auto num_free_nodes = node_allocator->num_free_nodes;
+  stat[0] = (uint64)node_allocator->num_chunks *
+            node_allocator->chunk_num_nodes * node_allocator->node_size;
+  stat[1] = node_allocator->tail - num_free_nodes;
+  stat[2] = num_free_nodes;
+  stat[3] = node_allocator->node_size;
+  stat[4] = max_i32(node_allocator->tail, node_allocator->dirty_tail);
+  stat[5] = node_allocator->num_allocations;
+}
+
+// Must not run concurrently with any allocation or recycling
+void NodeAllocator_gc(NodeAllocator *node_allocator) {
+  if (node_allocator->recycled_list == nullptr)
+    return;
+  *(Ptr *)node_allocator->recycled_list_tail = node_allocator->free_list;
+  node_allocator->free_list = node_allocator->recycled_list;
+  node_allocator->recycled_list = nullptr;
+  node_allocator->recycled_list_tail = nullptr;
+}
+
+// Frees all nodes but the kept ones at once, keeping the chunks for the next
+// allocations. Must not run concurrently with any allocation or recycling.
+void NodeAllocator_reset(NodeAllocator *node_allocator) {
+  node_allocator->dirty_tail =
+      max_i32(node_allocator->dirty_tail, node_allocator->tail);
+  node_allocator->tail = node_allocator->num_kept_nodes;
+  node_allocator->num_free_nodes = 0;
+  node_allocator->free_list = nullptr;
+  node_allocator->recycled_list = nullptr;
+  node_allocator->recycled_list_tail = nullptr;
 }
 
 using vm_allocator_type = void *(*)(std::size_t, int);
-using CPUTaskFunc = void(Context *, int i);
+// Runs the iterations [begin, end) of a range-for, in loop order
+using CPUTaskFunc = void(Context *, int begin, int end);
 using parallel_for_type = void (*)(void *thread_pool,
                                    int splits,
                                    int num_desired_threads,
                                    void *context,
                                    void (*func)(void *, int i));
 
-constexpr int num_rand_states = 1024 * 32;
-
-struct RandState {
-  u32 x;
-  u32 y;
-  u32 z;
-  u32 w;
-  i32 lock;
-};
-
-void initialize_rand_state(RandState *state, u32 i) {
-  state->x = 123456789 * i * 1000000007;
-  state->y = 362436069;
-  state->z = 521288629;
-  state->w = 88675123;
-  state->lock = 0;
-}
-
 // Is "runtime" a correct name, even if it is created after the data layout is
 // materialized?
 struct Runtime {
   vm_allocator_type vm_allocator;
-  assert_failed_type assert_failed;
   Ptr thread_pool;
   parallel_for_type parallel_for;
   ElementList *element_lists[taichi_max_num_snodes];
   NodeAllocator *node_allocators[taichi_max_num_snodes];
+  // For geometric dynamic SNodes, the allocators of the chunks of each level
+  // (the first one is also in node_allocators)
+  NodeAllocator *chunk_allocators[taichi_max_num_snodes];
+  i32 num_chunk_levels[taichi_max_num_snodes];
   Ptr ambient_elements[taichi_max_num_snodes];
+  // The root buffers of the SNode trees, by the ids of their roots
+  Ptr roots[taichi_max_num_snodes];
   Ptr temporaries;
-  RandState *rand_states;
+  // Per-thread counters of the two-pass listgen kernels
+  i32 *listgen_scratch;
+  // The part claimed by each block in for_each_block_persistent
+  i32 *persistent_block_parts;
+  // See grid_barrier
+  i32 grid_barrier_arrived;
+  i32 grid_barrier_generation;
+  // Bumped whenever cells of an SNode are activated or deactivated
+  i32 structure_versions[taichi_max_num_snodes];
+  // The head pointer of the UnifiedAllocator, which is on unified memory so
+  // that node chunks can also be allocated from GPU kernels, and its tail
+  Ptr *memory_head;
+  Ptr *memory_tail;
+  // Alignment of the root buffer and of node chunks at least this large
+  std::size_t page_size;
+  RuntimeCounters counters;
 };
 
 STRUCT_FIELD_ARRAY(Runtime, element_lists);
 STRUCT_FIELD_ARRAY(Runtime, node_allocators);
+STRUCT_FIELD_ARRAY(Runtime, roots);
 STRUCT_FIELD(Runtime, temporaries);
-STRUCT_FIELD(Runtime, assert_failed);
+STRUCT_FIELD(Runtime, memory_head);
+STRUCT_FIELD(Runtime, memory_tail);
+STRUCT_FIELD(Runtime, counters);
 
 void *allocate_aligned(Runtime *runtime, std::size_t size, int alignment) {
   return runtime->vm_allocator(size, alignment);
 }
 
+void Runtime_bump_structure_version(Runtime *runtime, int snode_id) {
+  atomic_add_i32(&runtime->structure_versions[snode_id], 1);
+}
+
+std::size_t Runtime_get_page_size(Runtime *runtime) {
+  return runtime->page_size;
+}
+
+void Runtime_count_list_elements(Runtime *runtime, int snode_id, int n) {
+  if (n != 0)
+    atomic_add_u64(&runtime->counters.list_elements[snode_id], (u64)n);
+}
+
+void Runtime_count_atomic_ops(Runtime *runtime, i64 n) {
+  if (n != 0)
+    atomic_add_u64(&runtime->counters.atomic_ops, (u64)n);
+}
+
+Ptr allocate_from_memory_pool(Runtime *runtime,
+                              std::size_t size,
+                              std::size_t alignment) {
+  auto head = atomic_add_u64((uint64 *)runtime->memory_head,
+                             size + alignment - 1);
+  auto tail = (uint64)*runtime->memory_tail;
+  if (head + size + alignment - 1 > tail)
+    taichi_runtime_out_of_memory("memory pool exhausted, bytes requested",
+                                 size);
+  return (Ptr)((head + alignment - 1) / alignment * alignment);
+}
+
+void Runtime_initialize_snode(Runtime *runtime, int snode_id) {
+  runtime->element_lists[snode_id] =
+      (ElementList *)allocate(runtime, sizeof(ElementList));
+  ElementList_initialize(runtime, runtime->element_lists[snode_id]);
+
+  runtime->node_allocators[snode_id] =
+      (NodeAllocator *)allocate(runtime, sizeof(NodeAllocator));
+  runtime->structure_versions[snode_id] = 0;
+  runtime->chunk_allocators[snode_id] = nullptr;
+  runtime->num_chunk_levels[snode_id] = 0;
+  runtime->counters.list_elements[snode_id] = 0;
+}
+
+// Allocates the root buffer of an SNode tree, whose SNodes must have been
+// initialized, and puts it in the element list of the root
+Ptr Runtime_add_root(Runtime *runtime, uint64_t root_size, int root_id) {
+  auto root_ptr =
+      (Ptr)allocate_aligned(runtime, root_size, runtime->page_size);
+  runtime->roots[root_id] = root_ptr;
+
+  // initialize the root node element list
+  Element elem;
+  elem.loop_bounds[0] = 0;
+  elem.loop_bounds[1] = 1;
+  elem.element = root_ptr;
+  for (int i = 0; i < taichi_max_num_indices; i++) {
+    elem.pcoord.val[i] = 0;
+  }
+  ElementList_insert(runtime->element_lists[root_id], &elem);
+  // The root list never changes
+  runtime->element_lists[root_id]->structure_key = 0;
+  return root_ptr;
+}
+
 Ptr Runtime_initialize(Runtime **runtime_ptr,
                        int num_snodes,
                        uint64_t root_size,
                        int root_id,
                        void *_vm_allocator,
-                       bool verbose) {
+                       bool verbose,
+                       std::size_t page_size) {
   auto vm_allocator = (vm_allocator_type)_vm_allocator;
   *runtime_ptr = (Runtime *)vm_allocator(sizeof(Runtime), 128);
   Runtime *runtime = *runtime_ptr;
   runtime->vm_allocator = vm_allocator;
+  runtime->page_size = page_size;
   if (verbose)
     printf("Initializing runtime with %d elements\n", num_snodes);
   for (int i = 0; i < num_snodes; i++) {
-    runtime->element_lists[i] =
-        (ElementList *)allocate(runtime, sizeof(ElementList));
-    ElementList_initialize(runtime, runtime->element_lists[i]);
-
-    runtime->node_allocators[i] =
-        (NodeAllocator *)allocate(runtime, sizeof(NodeAllocator));
+    Runtime_initialize_snode(runtime, i);
   }
-  auto root_ptr = allocate_aligned(runtime, root_size, 4096);
+  runtime->counters.atomic_ops = 0;
+  runtime->counters.out_of_bound_check = 0;
+  runtime->counters.num_debug_records = 0;
+  runtime->counters.loop_iterations = 0;
+  auto root_ptr = Runtime_add_root(runtime, root_size, root_id);
 
   runtime->temporaries =
       (Ptr)allocate_aligned(runtime, taichi_max_num_global_vars, 1024);
 
-  // initialize the root node element list
-  Element elem;
-  elem.loop_bounds[0] = 0;
-  elem.loop_bounds[1] = 1;
-  elem.self_idx = 0;
-  elem.element = (Ptr)root_ptr;
-  for (int i = 0; i < taichi_max_num_indices; i++) {
-    elem.pcoord.val[i] = 0;
-  }
-  ElementList_insert(runtime->element_lists[root_id], &elem);
+  runtime->listgen_scratch = (i32 *)allocate_aligned(
+      runtime, sizeof(i32) * taichi_listgen_max_num_threads, 4096);
+  runtime->persistent_block_parts = (i32 *)allocate_aligned(
+      runtime, sizeof(i32) * taichi_max_gpu_persistent_blocks, 4096);
+  runtime->grid_barrier_arrived = 0;
+  runtime->grid_barrier_generation = 0;
 
-  runtime->rand_states = (RandState *)allocate_aligned(
-      runtime, sizeof(RandState) * num_rand_states, 4096);
-  for (int i = 0; i < num_rand_states; i++)
-    initialize_rand_state(&runtime->rand_states[i], i);
   if (verbose)
     printf("Runtime initialized.\n");
   return (Ptr)root_ptr;
@@ -407,17 +911,94 @@ void Runtime_initialize_thread_pool(Runtime *runtime,
   runtime->parallel_for = (parallel_for_type)parallel_for;
 }
 
+// Chunk c holds chunk_size << c bytes, and each pool chunk at least
+// min_pool_num_nodes of them
+void Runtime_initialize_chunk_allocators(Runtime *runtime,
+                                         int snode_id,
+                                         int num_levels,
+                                         std::size_t chunk_size,
+                                         int pool_num_nodes,
+                                         int min_pool_num_nodes) {
+  auto levels =
+      (NodeAllocator *)allocate(runtime, sizeof(NodeAllocator) * num_levels);
+  for (int c = 0; c < num_levels; c++) {
+    auto num_nodes = pool_num_nodes >> c;
+    NodeAllocator_initialize(
+        runtime, &levels[c], chunk_size << c,
+        num_nodes > min_pool_num_nodes ? num_nodes : min_pool_num_nodes);
+  }
+  runtime->chunk_allocators[snode_id] = levels;
+  runtime->num_chunk_levels[snode_id] = num_levels;
+  runtime->node_allocators[snode_id] = &levels[0];
+}
+
 void Runtime_allocate_ambient(Runtime *runtime, int snode_id) {
-  runtime->ambient_elements[snode_id] =
-      NodeAllocator_allocate(runtime->node_allocators[snode_id]);
+  auto alloc = runtime->node_allocators[snode_id];
+  runtime->ambient_elements[snode_id] = NodeAllocator_allocate(alloc);
+  alloc->num_kept_nodes = alloc->tail;
+}
+
+i32 Runtime_get_num_list_elements(Runtime *runtime, int snode_id) {
+  return runtime->element_lists[snode_id]->tail;
+}
+
+// Returns the node of element i of the list, and stores its coordinates
+Ptr Runtime_get_list_element(Runtime *runtime,
+                             int snode_id,
+                             int i,
+                             i32 *coords) {
+  auto list = runtime->element_lists[snode_id];
+  auto element = ElementList_get(list, i);
+  for (int k = 0; k < taichi_max_num_indices; k++)
+    coords[k] = k < list->num_coordinates ? element->pcoord.val[k] : 0;
+  return element->element;
+}
+
+// Set by the struct compiler before any list is generated
+void Runtime_set_list_num_coordinates(Runtime *runtime, int snode_id, int n) {
+  ElementList_set_num_coordinates(runtime->element_lists[snode_id], n);
+}
+
+void node_gc(Runtime *runtime, int snode_id) {
+  NodeAllocator_gc(runtime->node_allocators[snode_id]);
+  for (int c = 1; c < runtime->num_chunk_levels[snode_id]; c++)
+    NodeAllocator_gc(&runtime->chunk_allocators[snode_id][c]);
+}
+
+// Frees all nodes of the SNode, once nothing points to them anymore
+void node_reset(Runtime *runtime, int snode_id) {
+  NodeAllocator_reset(runtime->node_allocators[snode_id]);
+  for (int c = 1; c < runtime->num_chunk_levels[snode_id]; c++)
+    NodeAllocator_reset(&runtime->chunk_allocators[snode_id][c]);
+  Runtime_bump_structure_version(runtime, snode_id);
 }
 
+void threadfence();
+
+// Waiting threads spin on loads, which hit their cached copy of the lock,
+// and only retry the exchange once it looks free. GPUs only try locks, see
+// lock_guard.
 void mutex_lock_i32(Ptr mutex) {
-  while (atomic_exchange_i32((i32 *)mutex, 1) == 1)
-    ;
+  while (atomic_exchange_i32((i32 *)mutex, 1) == 1) {
+    while (*(volatile i32 *)mutex == 1)
+      ;
+  }
+  threadfence();
+}
+
+// Takes the lock if it is free, without waiting
+bool mutex_try_lock_i32(Ptr mutex) {
+  if (*(volatile i32 *)mutex == 1 ||
+      atomic_exchange_i32((i32 *)mutex, 1) == 1)
+    return false;
+  threadfence();
+  return true;
 }
 
 void mutex_unlock_i32(Ptr mutex) {
+  // The writes of the critical section must be visible before the lock is
+  // released; GPU atomics do not order other memory accesses by themselves
+  threadfence();
   atomic_exchange_i32((i32 *)mutex, 0);
 }
 
@@ -455,6 +1036,141 @@ int32 warp_active_mask() {
   return 0;
 }
 
+// The warp vote and shuffle helpers below are replaced by PTX on GPUs, see
+// TaichiLLVMContext::clone_runtime_module
+u32 cuda_ballot(i32 bit) {
+  return 0;
+}
+
+i32 cuda_shfl_i32(i32 val, i32 src_lane) {
+  return 0;
+}
+
+u64 cuda_shfl_u64(u64 val, i32 src_lane) {
+  return (u64)(u32)cuda_shfl_i32((i32)(u32)val, src_lane) |
+         ((u64)(u32)cuda_shfl_i32((i32)(u32)(val >> 32), src_lane) << 32);
+}
+
+// Returns the old value of *dest, and increments it by one. On GPUs the lanes
+// of a warp incrementing the same address are served by a single atomic: a
+// leader adds the size of its group and broadcasts the old value, from which
+// each lane takes its rank within the group.
+i32 warp_aggregated_atomic_inc_i32(volatile i32 *dest) {
+#if ARCH_cuda
+  int lane = warp_idx();
+  u64 addr = (u64)dest;
+  bool done = false;
+  i32 ret = 0;
+  while (true) {
+    u32 pending = cuda_ballot(!done);
+    if (pending == 0)
+      break;
+    int leader = __builtin_ctz(pending);
+    u64 leader_addr = cuda_shfl_u64(addr, leader);
+    bool in_group = !done && addr == leader_addr;
+    u32 group = cuda_ballot(in_group);
+    i32 base = 0;
+    if (lane == leader)
+      base = atomic_add_i32(dest, __builtin_popcount(group));
+    base = cuda_shfl_i32(base, leader);
+    if (in_group) {
+      ret = base + __builtin_popcount(group & ((1u << lane) - 1));
+      done = true;
+    }
+  }
+  return ret;
+#else
+  return atomic_add_i32(dest, 1);
+#endif
+}
+
+f32 cuda_shfl_f32(f32 val, i32 src_lane) {
+  union {
+    f32 f;
+    i32 i;
+  } bits;
+  bits.f = val;
+  bits.i = cuda_shfl_i32(bits.i, src_lane);
+  return bits.f;
+}
+
+// NodeAllocator_allocate for the lanes of a warp where request holds, which
+// must all make the call together. Recycled nodes are taken one by one, while
+// the lanes needing fresh nodes from the same allocator share a single bump
+// of its tail, each taking the node of its rank. Other lanes get nullptr.
+Ptr NodeAllocator_allocate_in_warp(NodeAllocator *node_allocator,
+                                   bool request) {
+#if ARCH_cuda
+  Ptr ret = nullptr;
+  if (request) {
+    ret = NodeAllocator_pop_free(node_allocator);
+    if (ret != nullptr)
+      atomic_add_u64(&node_allocator->num_allocations, 1);
+  }
+  bool done = !request || ret != nullptr;
+  int lane = warp_idx();
+  u64 addr = (u64)node_allocator;
+  while (true) {
+    u32 pending = cuda_ballot(!done);
+    if (pending == 0)
+      break;
+    int leader = __builtin_ctz(pending);
+    bool in_group = !done && addr == cuda_shfl_u64(addr, leader);
+    u32 group = cuda_ballot(in_group);
+    i32 base = 0;
+    if (lane == leader) {
+      int n = __builtin_popcount(group);
+      base = atomic_add_i32(&node_allocator->tail, n);
+      atomic_add_u64(&node_allocator->num_allocations, (u64)n);
+    }
+    base = cuda_shfl_i32(base, leader);
+    if (in_group) {
+      int rank = __builtin_popcount(group & ((1u << lane) - 1));
+      ret = NodeAllocator_get_node(node_allocator, base + rank);
+      done = true;
+    }
+  }
+  return ret;
+#else
+  return request ? NodeAllocator_allocate(node_allocator) : nullptr;
+#endif
+}
+
+// Adds val to *dest, which must be the same address for every lane. On GPUs
+// the active lanes of a warp first sum their values with shuffles (a butterfly
+// when the whole warp is active), and only the lowest lane issues the atomic.
+#if ARCH_cuda
+#define DEFINE_REDUCE_ADD(T, atomic_add)                   \
+  void reduce_add_##T(volatile T *dest, T val) {           \
+    u32 active = cuda_ballot(1);                           \
+    int lane = warp_idx();                                 \
+    int leader = __builtin_ctz(active);                    \
+    if (active == 0xFFFFFFFFu) {                           \
+      for (int offset = 16; offset > 0; offset /= 2)       \
+        val += cuda_shfl_##T(val, lane ^ offset);          \
+    } else {                                               \
+      T sum = val;                                         \
+      for (u32 rest = active & (active - 1); rest;         \
+           rest &= rest - 1) {                             \
+        T other = cuda_shfl_##T(val, __builtin_ctz(rest)); \
+        if (lane == leader)                                \
+          sum += other;                                    \
+      }                                                    \
+      val = sum;                                           \
+    }                                                      \
+    if (lane == leader)                                    \
+      atomic_add(dest, val);                               \
+  }
+#else
+#define DEFINE_REDUCE_ADD(T, atomic_add)         \
+  void reduce_add_##T(volatile T *dest, T val) { \
+    atomic_add(dest, val);                       \
+  }
+#endif
+
+DEFINE_REDUCE_ADD(i32, atomic_add_i32);
+DEFINE_REDUCE_ADD(f32, atomic_add_cpu_f32);
+
 void block_memfence() {
 }
 
@@ -463,20 +1179,121 @@ void threadfence() {
 
 // "Element", "component" are different concepts
 
+// Zeroes size bytes from data, with 8-byte stores where aligned: the j-th of
+// step threads stores words j, j + step, ... The loop becomes a memset on
+// CPUs.
+void zero_fill_bytes(Ptr data, std::size_t size, int j, int step) {
+  std::size_t head = (8 - (std::size_t)data % 8) % 8;
+  if (head > size)
+    head = size;
+  auto num_words = (size - head) / 8;
+  if (j == 0) {
+    for (std::size_t k = 0; k < head; k++)
+      data[k] = 0;
+    for (std::size_t k = head + num_words * 8; k < size; k++)
+      data[k] = 0;
+  }
+  auto words = (uint64 *)(data + head);
+  for (std::size_t k = j; k < num_words; k += step)
+    words[k] = 0;
+}
+
+// Zeroes the data sections of the instances of a (dense) node in its element
+// list, a block of threads per instance on GPUs
+void zero_fill_elements(Runtime *runtime, StructMeta *meta) {
+  auto list = runtime->element_lists[meta->snode_id];
+  auto size = meta->element_size * meta->max_num_elements;
+#if ARCH_cuda
+  int i_start = block_idx();
+  int i_step = grid_dim();
+  int j_start = thread_idx();
+  int j_step = block_dim();
+#else
+  int i_start = 0;
+  int i_step = 1;
+  int j_start = 0;
+  int j_step = 1;
+#endif
+  for (int i = i_start; i < list->tail; i += i_step)
+    zero_fill_bytes(ElementList_get(list, i)->element, size, j_start, j_step);
+}
+
+// Makes the instances of a sparse node in its element list inactive by
+// dropping their links to their nodes (reset), without freeing the nodes
+// one by one; node_reset frees them all afterwards
+void deactivate_all_elements(Runtime *runtime,
+                             StructMeta *meta,
+                             void (*reset)(Ptr meta, Ptr node)) {
+  auto list = runtime->element_lists[meta->snode_id];
+#if ARCH_cuda
+  int i_start = block_idx() * block_dim() + thread_idx();
+  int i_step = grid_dim() * block_dim();
+#else
+  int i_start = 0;
+  int i_step = 1;
+#endif
+  for (int i = i_start; i < list->tail; i += i_step)
+    reset((Ptr)meta, ElementList_get(list, i)->element);
+}
+
 void clear_list(Runtime *runtime, StructMeta *parent, StructMeta *child) {
   auto child_list = runtime->element_lists[child->snode_id];
   child_list->head = 0;
   child_list->tail = 0;
+  child_list->structure_key = -1;
+  child_list->up_to_date = 0;
+}
+
+// Keeps the list of child if no ancestor has been activated or deactivated
+// since the list was generated. Since versions only grow, the sum of the
+// versions of the ancestors only stays the same if none of them changed.
+void clear_list_if_outdated(Runtime *runtime,
+                            StructMeta *parent,
+                            StructMeta *child) {
+  auto parent_list = runtime->element_lists[parent->snode_id];
+  auto child_list = runtime->element_lists[child->snode_id];
+  i64 key = -1;
+  if (parent_list->structure_key != -1) {
+    key = parent_list->structure_key +
+          runtime->structure_versions[parent->snode_id];
+  }
+  if (key != -1 && key == child_list->structure_key) {
+    child_list->up_to_date = 1;
+  } else {
+    child_list->head = 0;
+    child_list->tail = 0;
+    child_list->structure_key = key;
+    child_list->up_to_date = 0;
+  }
 }
 
+using LookupElementFunction = Ptr (*)(Ptr, Ptr, int);
+using IsActiveFunction = bool (*)(Ptr, Ptr, int);
+using GetNumElementsFunction = int (*)(Ptr, Ptr);
+using FromParentElementFunction = Ptr (*)(Ptr);
+using RefineCoordinatesFunction = void (*)(PhysicalCoordinates *,
+                                           PhysicalCoordinates *,
+                                           int);
+
 /*
  * The element list of a SNode, maintains pointers to its instances, and
- * instances' parents' coordinates
+ * instances' parents' coordinates. The node functions are passed in, so that
+ * once inlined into a specialization they are called directly.
  */
-void element_listgen(Runtime *runtime, StructMeta *parent, StructMeta *child) {
+__attribute__((always_inline)) inline void element_listgen_with(
+    Runtime *runtime,
+    StructMeta *parent,
+    StructMeta *child,
+    LookupElementFunction lookup_element,
+    IsActiveFunction is_active,
+    RefineCoordinatesFunction refine_coordinates,
+    FromParentElementFunction from_parent_element,
+    GetNumElementsFunction get_num_elements) {
   auto parent_list = runtime->element_lists[parent->snode_id];
   int num_parent_elements = parent_list->tail;
   auto child_list = runtime->element_lists[child->snode_id];
+  if (child_list->up_to_date)
+    return;
 #if ARCH_cuda
   int i_start = block_idx();
   int i_step = grid_dim();
@@ -488,13 +1305,75 @@ void element_listgen(Runtime *runtime, StructMeta *parent, StructMeta *child) {
   int j_start = 0;
   int j_step = 1;
 #endif
+  // Per thread, to add to the counter once
+  int num_generated = 0;
   for (int i = i_start; i < num_parent_elements; i += i_step) {
-    auto element = parent_list->elements[i];
+    auto &element = *ElementList_get(parent_list, i);
     for (int j = element.loop_bounds[0] + j_start; j < element.loop_bounds[1];
          j += j_step) {
       PhysicalCoordinates refined_coord;
-      parent->refine_coordinates(&element.pcoord, &refined_coord, j);
-      if (parent->is_active((Ptr)parent, element.element, j)) {
+      refine_coordinates(&element.pcoord, &refined_coord, j);
+      if (is_active((Ptr)parent, element.element, j)) {
+        auto ch_element = lookup_element((Ptr)parent, element.element, j);
+        ch_element = from_parent_element((Ptr)ch_element);
+        Element elem;
+        elem.element = ch_element;
+        elem.loop_bounds[0] = 0;
+        elem.loop_bounds[1] = get_num_elements((Ptr)child, ch_element);
+        elem.pcoord = refined_coord;
+        ElementList_insert(child_list, &elem);
+        num_generated++;
+      }
+    }
+  }
+  Runtime_count_list_elements(runtime, child->snode_id, num_generated);
+}
+
+void element_listgen(Runtime *runtime, StructMeta *parent, StructMeta *child) {
+  element_listgen_with(runtime, parent, child, parent->lookup_element,
+                       parent->is_active, parent->refine_coordinates,
+                       child->from_parent_element, child->get_num_elements);
+}
+
+uint64 *Dense_get_mask(Ptr meta, Ptr node);
+
+// element_listgen for bitmasked dense parents: whole 64-cell words of the
+// activation mask are tested at once, and only their set bits are visited
+void element_listgen_bitmasked(Runtime *runtime,
+                               StructMeta *parent,
+                               StructMeta *child) {
+  auto parent_list = runtime->element_lists[parent->snode_id];
+  int num_parent_elements = parent_list->tail;
+  auto child_list = runtime->element_lists[child->snode_id];
+  if (child_list->up_to_date)
+    return;
+#if ARCH_cuda
+  int i_start = block_idx();
+  int i_step = grid_dim();
+  int w_start = thread_idx();
+  int w_step = block_dim();
+#else
+  int i_start = 0;
+  int i_step = 1;
+  int w_start = 0;
+  int w_step = 1;
+#endif
+  // Per thread, to add to the counter once
+  int num_generated = 0;
+  for (int i = i_start; i < num_parent_elements; i += i_step) {
+    auto &element = *ElementList_get(parent_list, i);
+    auto mask = Dense_get_mask((Ptr)parent, element.element);
+    int lower = element.loop_bounds[0];
+    int upper = element.loop_bounds[1];
+    for (int w = lower / 64 + w_start; w * 64 < upper; w += w_step) {
+      auto word = mask[w];
+      while (word != 0) {
+        int j = w * 64 + __builtin_ctzll(word);
+        word &= word - 1;
+        if (j < lower || j >= upper)
+          continue;
+        PhysicalCoordinates refined_coord;
+        parent->refine_coordinates(&element.pcoord, &refined_coord, j);
         auto ch_element =
             parent->lookup_element((Ptr)parent, element.element, j);
         ch_element = child->from_parent_element((Ptr)ch_element);
@@ -502,12 +1381,237 @@ void element_listgen(Runtime *runtime, StructMeta *parent, StructMeta *child) {
         elem.element = ch_element;
         elem.loop_bounds[0] = 0;
         elem.loop_bounds[1] = child->get_num_elements((Ptr)child, ch_element);
-        elem.self_idx = j;
         elem.pcoord = refined_coord;
         ElementList_insert(child_list, &elem);
+        num_generated++;
       }
     }
   }
+  Runtime_count_list_elements(runtime, child->snode_id, num_generated);
+}
+
+int Hash_get_key(Ptr node, int slot);
+
+Ptr Hash_get_value(Ptr meta, Ptr node, int slot);
+
+// element_listgen for hash parents: the loop bounds of a hash element are
+// slots, whose keys give the cell indices
+void element_listgen_hash(Runtime *runtime,
+                          StructMeta *parent,
+                          StructMeta *child) {
+  auto parent_list = runtime->element_lists[parent->snode_id];
+  int num_parent_elements = parent_list->tail;
+  auto child_list = runtime->element_lists[child->snode_id];
+  if (child_list->up_to_date)
+    return;
+#if ARCH_cuda
+  int i_start = block_idx();
+  int i_step = grid_dim();
+  int s_start = thread_idx();
+  int s_step = block_dim();
+#else
+  int i_start = 0;
+  int i_step = 1;
+  int s_start = 0;
+  int s_step = 1;
+#endif
+  // Per thread, to add to the counter once
+  int num_generated = 0;
+  for (int i = i_start; i < num_parent_elements; i += i_step) {
+    auto &element = *ElementList_get(parent_list, i);
+    for (int s = element.loop_bounds[0] + s_start; s < element.loop_bounds[1];
+         s += s_step) {
+      int j = Hash_get_key(element.element, s) - 1;
+      auto ch_element = Hash_get_value((Ptr)parent, element.element, s);
+      if (j == -1 || ch_element == nullptr)
+        continue;
+      PhysicalCoordinates refined_coord;
+      parent->refine_coordinates(&element.pcoord, &refined_coord, j);
+      ch_element = child->from_parent_element((Ptr)ch_element);
+      Element elem;
+      elem.element = ch_element;
+      elem.loop_bounds[0] = 0;
+      elem.loop_bounds[1] = child->get_num_elements((Ptr)child, ch_element);
+      elem.pcoord = refined_coord;
+      ElementList_insert(child_list, &elem);
+      num_generated++;
+    }
+  }
+  Runtime_count_list_elements(runtime, child->snode_id, num_generated);
+}
+
+/*
+ * Two-pass element_listgen, which avoids contention on the tail of the child
+ * list on GPUs: element_listgen_count counts the active children of each
+ * parent element, element_listgen_scan (a single block) turns the counts into
+ * offsets, and element_listgen_write stores every child element at its final
+ * position. The threads of a block split the children of a parent element
+ * into contiguous ranges, so the resulting list is ordered by parent element,
+ * then by child index, just like a serial listgen.
+ */
+void listgen_get_thread_range(Element *element, int &begin, int &end) {
+#if ARCH_cuda
+  int s = thread_idx();
+  int num_threads = block_dim();
+#else
+  int s = 0;
+  int num_threads = 1;
+#endif
+  int lower = element->loop_bounds[0];
+  int upper = element->loop_bounds[1];
+  int len = (upper - lower + num_threads - 1) / num_threads;
+  begin = lower + s * len;
+  if (begin > upper)
+    begin = upper;
+  end = begin + len;
+  if (end > upper)
+    end = upper;
+}
+
+i32 *listgen_get_block_scratch(Runtime *runtime) {
+#if ARCH_cuda
+  return runtime->listgen_scratch + block_idx() * block_dim();
+#else
+  return runtime->listgen_scratch;
+#endif
+}
+
+int listgen_count_active(StructMeta *parent, Element *element) {
+  int begin, end;
+  listgen_get_thread_range(element, begin, end);
+  int count = 0;
+  for (int j = begin; j < end; j++) {
+    if (parent->is_active((Ptr)parent, element->element, j))
+      count++;
+  }
+  return count;
+}
+
+void element_listgen_count(Runtime *runtime,
+                           StructMeta *parent,
+                           StructMeta *child) {
+  auto parent_list = runtime->element_lists[parent->snode_id];
+  int num_parent_elements = parent_list->tail;
+  auto child_list = runtime->element_lists[child->snode_id];
+  if (child_list->up_to_date)
+    return;
+  auto scratch = listgen_get_block_scratch(runtime);
+#if ARCH_cuda
+  int i_start = block_idx();
+  int i_step = grid_dim();
+  int s = thread_idx();
+  int num_threads = block_dim();
+#else
+  int i_start = 0;
+  int i_step = 1;
+  int s = 0;
+  int num_threads = 1;
+#endif
+  for (int i = i_start; i < num_parent_elements; i += i_step) {
+    auto &element = *ElementList_get(parent_list, i);
+    scratch[s] = listgen_count_active(parent, &element);
+    block_barrier();
+    if (s == 0) {
+      int total = 0;
+      for (int t = 0; t < num_threads; t++)
+        total += scratch[t];
+      child_list->offsets[i] = total;
+    }
+    block_barrier();
+  }
+}
+
+void element_listgen_scan(Runtime *runtime,
+                          StructMeta *parent,
+                          StructMeta *child) {
+  auto parent_list = runtime->element_lists[parent->snode_id];
+  int num_parent_elements = parent_list->tail;
+  auto child_list = runtime->element_lists[child->snode_id];
+  if (child_list->up_to_date)
+    return;
+  auto offsets = child_list->offsets;
+  auto scratch = runtime->listgen_scratch;
+#if ARCH_cuda
+  int s = thread_idx();
+  int num_threads = block_dim();
+#else
+  int s = 0;
+  int num_threads = 1;
+#endif
+  int chunk = (num_parent_elements + num_threads - 1) / num_threads;
+  int begin = s * chunk;
+  int end = begin + chunk;
+  if (end > num_parent_elements)
+    end = num_parent_elements;
+  int sum = 0;
+  for (int i = begin; i < end; i++)
+    sum += offsets[i];
+  scratch[s] = sum;
+  block_barrier();
+  if (s == 0) {
+    // exclusive scan of the per-thread sums, after the existing elements
+    int head = child_list->tail;
+    for (int t = 0; t < num_threads; t++) {
+      int c = scratch[t];
+      scratch[t] = head;
+      head += c;
+    }
+    Runtime_count_list_elements(runtime, child->snode_id,
+                                head - child_list->tail);
+    child_list->tail = head;
+  }
+  block_barrier();
+  int head = scratch[s];
+  for (int i = begin; i < end; i++) {
+    int c = offsets[i];
+    offsets[i] = head;
+    head += c;
+  }
+}
+
+void element_listgen_write(Runtime *runtime,
+                           StructMeta *parent,
+                           StructMeta *child) {
+  auto parent_list = runtime->element_lists[parent->snode_id];
+  int num_parent_elements = parent_list->tail;
+  auto child_list = runtime->element_lists[child->snode_id];
+  if (child_list->up_to_date)
+    return;
+  auto scratch = listgen_get_block_scratch(runtime);
+#if ARCH_cuda
+  int i_start = block_idx();
+  int i_step = grid_dim();
+  int s = thread_idx();
+#else
+  int i_start = 0;
+  int i_step = 1;
+  int s = 0;
+#endif
+  for (int i = i_start; i < num_parent_elements; i += i_step) {
+    auto &element = *ElementList_get(parent_list, i);
+    scratch[s] = listgen_count_active(parent, &element);
+    block_barrier();
+    int pos = child_list->offsets[i];
+    for (int t = 0; t < s; t++)
+      pos += scratch[t];
+    int begin, end;
+    listgen_get_thread_range(&element, begin, end);
+    for (int j = begin; j < end; j++) {
+      if (!parent->is_active((Ptr)parent, element.element, j))
+        continue;
+      PhysicalCoordinates refined_coord;
+      parent->refine_coordinates(&element.pcoord, &refined_coord, j);
+      auto ch_element = parent->lookup_element((Ptr)parent, element.element, j);
+      ch_element = child->from_parent_element((Ptr)ch_element);
+      Element elem;
+      elem.element = ch_element;
+      elem.loop_bounds[0] = 0;
+      elem.loop_bounds[1] = child->get_num_elements((Ptr)child, ch_element);
+      elem.pcoord = refined_coord;
+      ElementList_set(child_list, pos++, &elem);
+    }
+    block_barrier();
+  }
 }
 
 using BlockTask = void(Context *, Element *, int, int);
@@ -515,9 +1619,15 @@ using BlockTask = void(Context *, Element *, int, int);
 struct block_task_helper_context {
   Context *context;
   BlockTask *task;
-  Element *list;
+  ElementList *list;
+  int list_tail;
   int element_size;
   int element_split;
+  // See CompileConfig::cpu_block_prefetch
+  int prefetch_bytes;
+  // For balanced_block_helper
+  i64 *work;
+  i64 part_work;
 };
 
 void block_helper(void *ctx_, int i) {
@@ -526,12 +1636,48 @@ void block_helper(void *ctx_, int i) {
   int part_size = ctx->element_size / ctx->element_split;
   int part_id = i % ctx->element_split;
   // printf("%d %d %d\n", element_id, part_size, part_id);
-  auto &e = ctx->list[element_id];
+  auto &e = *ElementList_get(ctx->list, element_id);
   int lower = e.loop_bounds[0] + part_id * part_size;
   int upper = e.loop_bounds[0] + (part_id + 1) * part_size;
   upper = std::min(upper, e.loop_bounds[1]);
+  // The thread is likely to go on with the next element, which is anywhere
+  // in memory for sparse SNodes
+  if (ctx->prefetch_bytes && part_id == 0 && element_id + 1 < ctx->list_tail) {
+    auto next = (char *)ElementList_get(ctx->list, element_id + 1)->element;
+    for (int b = 0; b < ctx->prefetch_bytes; b += 64)
+      __builtin_prefetch(next + b);
+  }
   if (lower < upper) {
-    (*ctx->task)(ctx->context, &ctx->list[element_id], lower, upper);
+    (*ctx->task)(ctx->context, &e, lower, upper);
+  }
+}
+
+// On GPUs, the threads of a block are split between elements_per_block
+// consecutive elements, see CompileConfig::gpu_pack_leaf_blocks
+// Part i of the cells of all elements together, part_work cells each, which
+// may span several elements
+void balanced_block_helper(void *ctx_, int i) {
+  auto ctx = (block_task_helper_context *)(ctx_);
+  auto work = ctx->work;
+  auto total = work[ctx->list_tail];
+  i64 begin = i * ctx->part_work;
+  i64 end = std::min(begin + ctx->part_work, total);
+  // The last element starting at or before begin
+  int low = 0, high = ctx->list_tail;
+  while (high - low > 1) {
+    int mid = (low + high) / 2;
+    if (work[mid] <= begin)
+      low = mid;
+    else
+      high = mid;
+  }
+  for (int e = low; e < ctx->list_tail && work[e] < end; e++) {
+    auto &elem = *ElementList_get(ctx->list, e);
+    int lower = elem.loop_bounds[0] + (int)(std::max(begin, work[e]) - work[e]);
+    int upper =
+        elem.loop_bounds[0] + (int)(std::min(end, work[e + 1]) - work[e]);
+    if (lower < upper)
+      (*ctx->task)(ctx->context, &elem, lower, upper);
   }
 }
 
@@ -539,41 +1685,157 @@ void for_each_block(Context *context,
                     int snode_id,
                     int element_size,
                     int element_split,
+                    int elements_per_block,
                     BlockTask *task,
-                    int num_threads) {
+                    int num_threads,
+                    int prefetch_bytes,
+                    int balance_work) {
   auto list = ((Runtime *)context->runtime)->element_lists[snode_id];
   auto list_tail = list->tail;
 #if ARCH_cuda
-  int i = block_idx();
+  const int group_size = block_dim() / elements_per_block;
+  int i = block_idx() * elements_per_block + thread_idx() / group_size;
   const auto part_size = element_size / element_split;
   while (true) {
     int element_id = i / element_split;
     if (element_id >= list_tail)
       break;
     auto part_id = i % element_split;
-    auto &e = list->elements[element_id];
+    auto &e = *ElementList_get(list, element_id);
     int lower = e.loop_bounds[0] + part_id * part_size;
     int upper = e.loop_bounds[0] + (part_id + 1) * part_size;
     upper = std::min(upper, e.loop_bounds[1]);
     if (lower < upper)
-      task(context, &list->elements[element_id], lower, upper);
-    i += grid_dim();
+      task(context, &e, lower, upper);
+    i += grid_dim() * elements_per_block;
   }
 #else
   block_task_helper_context ctx;
   ctx.context = context;
   ctx.task = task;
-  ctx.list = list->elements;
+  ctx.list = list;
+  ctx.list_tail = list_tail;
   ctx.element_size = element_size;
   ctx.element_split = element_split;
+  ctx.prefetch_bytes = prefetch_bytes;
   // printf("size %d spilt %d tail %d\n", ctx.element_size, ctx.element_split,
   // list_tail);
   auto runtime = (Runtime *)context->runtime;
+  if (balance_work) {
+    // Elements with few active cells, e.g. short dynamic SNodes, would make
+    // parts that end at once while others go on: split the cells instead
+    auto work = list->work;
+    work[0] = 0;
+    for (int e = 0; e < list_tail; e++) {
+      auto &bounds = ElementList_get(list, e)->loop_bounds;
+      work[e + 1] = work[e] + std::max(bounds[1] - bounds[0], 0);
+    }
+    i64 total = work[list_tail];
+    // At least the cells of a part as above, and a few parts per thread to
+    // steal from one another
+    i64 part_work = std::max<i64>(element_size / element_split,
+                                  (total + num_threads * 8 - 1) /
+                                      (num_threads * 8));
+    ctx.work = work;
+    ctx.part_work = part_work;
+    runtime->parallel_for(runtime->thread_pool,
+                          (int)((total + part_work - 1) / part_work),
+                          num_threads, &ctx, balanced_block_helper);
+    return;
+  }
   runtime->parallel_for(runtime->thread_pool, list_tail * element_split,
                         num_threads, &ctx, block_helper);
 #endif
 }
 
+// for_each_block on GPUs with CompileConfig::gpu_persistent_threads: the
+// grid has as many blocks as can be resident at once, which claim the parts
+// of the elements in list order from a counter instead of striding over them
+void for_each_block_persistent(Context *context,
+                               int snode_id,
+                               int element_size,
+                               int element_split,
+                               int elements_per_block,
+                               BlockTask *task,
+                               int num_threads,
+                               int prefetch_bytes,
+                               int balance_work) {
+#if ARCH_cuda
+  auto runtime = (Runtime *)context->runtime;
+  auto list = runtime->element_lists[snode_id];
+  auto list_tail = list->tail;
+  auto claimed = (volatile i32 *)&runtime->persistent_block_parts[block_idx()];
+  const auto part_size = element_size / element_split;
+  const int group_size = block_dim() / elements_per_block;
+  while (true) {
+    if (thread_idx() == 0)
+      *claimed = atomic_add_i32(&list->next_part, elements_per_block);
+    block_barrier();
+    int first = *claimed;
+    // Before the next claim overwrites it
+    block_barrier();
+    // The whole block stops at once, since it claims together
+    if (first / element_split >= list_tail)
+      break;
+    int i = first + thread_idx() / group_size;
+    int element_id = i / element_split;
+    if (element_id >= list_tail)
+      continue;
+    auto part_id = i % element_split;
+    auto &e = *ElementList_get(list, element_id);
+    int lower = e.loop_bounds[0] + part_id * part_size;
+    int upper = e.loop_bounds[0] + (part_id + 1) * part_size;
+    upper = std::min(upper, e.loop_bounds[1]);
+    if (lower < upper)
+      task(context, &e, lower, upper);
+  }
+  // The last block done resets the counter for the next loop over the list,
+  // once every block has made its last claim
+  if (thread_idx() == 0) {
+    threadfence();
+    if (atomic_add_i32(&list->num_finished_blocks, 1) == grid_dim() - 1) {
+      list->next_part = 0;
+      list->num_finished_blocks = 0;
+      threadfence();
+    }
+  }
+#else
+  for_each_block(context, snode_id, element_size, element_split,
+                 elements_per_block, task, num_threads, prefetch_bytes,
+                 balance_work);
+#endif
+}
+
+// Waits for all the threads of the grid, whose blocks must all be resident
+// (CompileConfig::gpu_persistent_threads). The memory writes before the
+// barrier are visible after it.
+void grid_barrier(Runtime *runtime) {
+#if ARCH_cuda
+  block_barrier();
+  if (thread_idx() == 0) {
+    auto generation = (volatile i32 *)&runtime->grid_barrier_generation;
+    // Read before arriving: the last block to arrive bumps it
+    i32 current = *generation;
+    threadfence();
+    if (atomic_add_i32(&runtime->grid_barrier_arrived, 1) == grid_dim() - 1) {
+      runtime->grid_barrier_arrived = 0;
+      threadfence();
+      atomic_add_i32((i32 *)generation, 1);
+    } else {
+      while (*generation == current)
+        ;
+    }
+    threadfence();
+  }
+  block_barrier();
+#endif
+}
+
+// Values of CPUSchedule
+constexpr int cpu_schedule_dynamic = 0;
+constexpr int cpu_schedule_static = 1;
+constexpr int cpu_schedule_guided = 2;
+
 struct range_task_helper_context {
   Context *context;
   CPUTaskFunc *task;
@@ -581,46 +1843,87 @@ struct range_task_helper_context {
   int end;
   int block_size;
   int step;
+  int schedule;
+  int num_threads;
+  // The first iteration not yet claimed by a guided task
+  i32 next;
 };
 
+// Runs iterations [first, last) in loop order
+void range_for_run_iterations(range_task_helper_context *ctx,
+                              int first,
+                              int last) {
+  if (first >= last)
+    return;
+  if (ctx->step == 1) {
+    ctx->task(ctx->context, ctx->begin + first, ctx->begin + last);
+  } else {
+    ctx->task(ctx->context, ctx->end - last, ctx->end - first);
+  }
+}
+
 void parallel_range_for_task(void *range_context, int task_id) {
-  auto ctx = *(range_task_helper_context *)range_context;
-  if (ctx.step == 1) {
-    int block_start = ctx.begin + task_id * ctx.block_size;
-    int block_end = std::min(block_start + ctx.block_size, ctx.end);
-    for (int i = block_start; i < block_end; i++) {
-      ctx.task(ctx.context, i);
-    }
-  } else if (ctx.step == -1) {
-    int block_start = ctx.end - task_id * ctx.block_size;
-    int block_end = std::max(ctx.begin, block_start * ctx.block_size);
-    for (int i = block_start - 1; i >= block_end; i--) {
-      ctx.task(ctx.context, i);
+  auto ctx = (range_task_helper_context *)range_context;
+  int n = ctx->end - ctx->begin;
+  if (ctx->schedule == cpu_schedule_dynamic) {
+    // One task per block, balanced by work stealing
+    int first = task_id * ctx->block_size;
+    range_for_run_iterations(ctx, first,
+                             std::min(first + ctx->block_size, n));
+  } else if (ctx->schedule == cpu_schedule_static) {
+    // One contiguous partition per thread
+    int first = (int)((int64)n * task_id / ctx->num_threads);
+    int last = (int)((int64)n * (task_id + 1) / ctx->num_threads);
+    range_for_run_iterations(ctx, first, last);
+  } else {
+    // Guided: claim chunks that shrink with the remaining work, but not
+    // below the block size
+    int first = __atomic_load_n(&ctx->next, __ATOMIC_RELAXED);
+    while (first < n) {
+      int chunk =
+          std::max(ctx->block_size, (n - first) / (2 * ctx->num_threads));
+      int last = std::min(first + chunk, n);
+      if (__atomic_compare_exchange_n(&ctx->next, &first, last, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        range_for_run_iterations(ctx, first, last);
+        first = __atomic_load_n(&ctx->next, __ATOMIC_RELAXED);
+      }
     }
   }
 }
 
-#if ARCH_x86_64
-void taichi_assert(Context *context, i32 test, const char *msg) {
-  if (test == 0) {
-    auto runtime = (Runtime *)context->runtime;
-    runtime->assert_failed(msg);
+// Records the first failed BoundCheckStmt, which the host raises on the next
+// synchronization
+void taichi_report_out_of_bound(Context *context, i32 check_id, i32 *indices) {
+  auto runtime = (Runtime *)context->runtime;
+  auto &counters = runtime->counters;
+  i32 none = 0;
+  if (__atomic_compare_exchange_n(&counters.out_of_bound_check, &none,
+                                  check_id + 1, false,
+                                  std::memory_order::memory_order_seq_cst,
+                                  std::memory_order::memory_order_seq_cst)) {
+    for (int i = 0; i < taichi_max_num_indices; i++)
+      counters.out_of_bound_indices[i] = indices[i];
   }
 }
-#endif
-#if ARCH_cuda
-void __assertfail(const char *message,
-                  const char *file,
-                  i32 line,
-                  const char *function,
-                  std::size_t charSize);
 
-void taichi_assert(Context *context, i32 test, const char *msg) {
-  if (test == 0) {
-    __assertfail(msg, "", 1, "", 1);
-  }
+// Appends to RuntimeCounters::debug_records, which the host drains after
+// CPU kernels and when synchronizing, see Program::drain_debug_records
+void taichi_debug_record(Context *context, i32 message_id, u64 value) {
+  auto runtime = (Runtime *)context->runtime;
+  auto &counters = runtime->counters;
+  auto i = atomic_add_u64(&counters.num_debug_records, 1);
+  auto &record = counters.debug_records[i % taichi_max_num_debug_records];
+  record.message_id = message_id;
+  record.value = value;
+}
+
+// The kernel goes on after a failed assertion, which the host raises when
+// draining its record
+void taichi_assert(Context *context, i32 test, i32 message_id) {
+  if (test == 0)
+    taichi_debug_record(context, message_id, 0);
 }
-#endif
 
 void cpu_parallel_range_for(Context *context,
                             int num_threads,
@@ -628,6 +1931,7 @@ void cpu_parallel_range_for(Context *context,
                             int end,
                             int step,
                             int block_dim,
+                            int schedule,
                             CPUTaskFunc *task) {
   range_task_helper_context ctx;
   ctx.context = context;
@@ -636,24 +1940,69 @@ void cpu_parallel_range_for(Context *context,
   ctx.end = end;
   ctx.block_size = block_dim;
   ctx.step = step;
+  ctx.schedule = schedule;
+  ctx.num_threads = num_threads;
+  ctx.next = 0;
   if (step != 1 && step != -1) {
     printf("step must not be %d\n", step);
     exit(-1);
   }
+  int splits = num_threads;
+  if (schedule == cpu_schedule_dynamic)
+    splits = (end - begin + block_dim - 1) / block_dim;
   auto runtime = (Runtime *)context->runtime;
-  runtime->parallel_for(runtime->thread_pool,
-                        (end - begin + block_dim - 1) / block_dim, num_threads,
-                        &ctx, parallel_range_for_task);
+  runtime->parallel_for(runtime->thread_pool, splits, num_threads, &ctx,
+                        parallel_range_for_task);
 }
 
 i32 linear_thread_idx() {
   return block_idx() * block_dim() + thread_idx();
 }
 
+// Called at the start of each task, see Context::loop_gate. The launches run
+// in order, so the last iteration recorded is the last one that ran.
+i32 loop_gate_closed(Context *context) {
+  if (!context->loop_gate)
+    return 0;
+  if (*context->loop_gate)
+    return 1;
+  if (linear_thread_idx() == 0) {
+    auto runtime = (Runtime *)context->runtime;
+    runtime->counters.loop_iterations = (u64)context->loop_iteration;
+  }
+  return 0;
+}
+
 #include "node_dense.h"
 #include "node_dynamic.h"
+#include "node_hash.h"
 #include "node_pointer.h"
 #include "node_root.h"
+
+// element_listgen specialized for a pair of parent and child node types, with
+// the functions of the two SNodes passed in by the kernel. After inlining,
+// every node function is a direct call and the meta fields are constants.
+#define DEFINE_ELEMENT_LISTGEN(P, C)                                         \
+  void element_listgen_##P##_##C(                                            \
+      Runtime *runtime, StructMeta *parent, StructMeta *child,               \
+      RefineCoordinatesFunction refine_coordinates,                          \
+      FromParentElementFunction from_parent_element) {                       \
+    element_listgen_with(runtime, parent, child,                             \
+                         (LookupElementFunction)P##_lookup_element,          \
+                         P##_is_active, refine_coordinates,                  \
+                         from_parent_element, C##_get_num_elements);         \
+  }
+
+#define DEFINE_ELEMENT_LISTGENS(P)   \
+  DEFINE_ELEMENT_LISTGEN(P, Dense)   \
+  DEFINE_ELEMENT_LISTGEN(P, Pointer) \
+  DEFINE_ELEMENT_LISTGEN(P, Dynamic) \
+  DEFINE_ELEMENT_LISTGEN(P, Hash)
+
+DEFINE_ELEMENT_LISTGENS(Root)
+DEFINE_ELEMENT_LISTGENS(Dense)
+DEFINE_ELEMENT_LISTGENS(Pointer)
+DEFINE_ELEMENT_LISTGENS(Dynamic)
 }
 template <typename T>
 class lock_guard {
@@ -666,27 +2015,21 @@ class lock_guard {
     func();
     mutex_unlock_i32(lock);
 #else
-    // CUDA
-    for (int i = 0; i < warp_size(); i++) {
-      if (warp_idx() == i) {
-        mutex_lock_i32(lock);
-        threadfence();  // TODO
-        func();
-        mutex_unlock_i32(lock);
-      }
-    }
-    // Unfortunately critical sections on CUDA has undefined behavior (deadlock
-    // or not), if more than one thread in a warp try to acquire locks
-    /*
+    // Before Volta, a lane spinning on a lock held by another lane of its
+    // warp deadlocks, as the warp may never schedule the holder again. So
+    // no lane waits in a divergent branch: each round, every pending lane
+    // tries its lock once, the winners (one per lock) run their critical
+    // sections side by side, and a ballot repeats the round until no lane
+    // of the warp is left. Lanes contending for the same lock are thus
+    // serialized, while lanes with different locks are not.
     bool done = false;
-    while (!done) {
-      if (atomic_exchange_i32((i32 *)lock, 1) == 1) {
+    while (cuda_ballot(!done)) {
+      if (!done && mutex_try_lock_i32(lock)) {
         func();
-        done = true;
         mutex_unlock_i32(lock);
+        done = true;
       }
     }
-    */
 #endif
   }
 };
@@ -695,59 +2038,4 @@ void locked_task(void *lock, const T &func) {
   lock_guard<T> _((Ptr)lock, func);
 }
 
-#if ARCH_cuda
-
-extern "C" {
-
-u32 cuda_rand_u32(Context *context) {
-  auto state = &((Runtime *)context->runtime)
-                    ->rand_states[linear_thread_idx() % num_rand_states];
-  u32 ret;
-  auto lock = (Ptr)&state->lock;
-
-  bool done = false;
-  // TODO: whether this leads to a deadlock depends on how nvcc schedules the
-  // instructions...
-  while (!done) {
-    if (atomic_exchange_i32((i32 *)lock, 1) == 1) {
-      auto &x = state->x;
-      auto &y = state->y;
-      auto &z = state->z;
-      auto &w = state->w;
-      auto t = x ^ (x << 11);
-      x = y;
-      y = z;
-      z = w;
-      w = (w ^ (w >> 19)) ^ (t ^ (t >> 8));
-      ret = w;
-      done = true;
-      mutex_unlock_i32(lock);
-    }
-  }
-  return ret;
-}
-
-uint64 cuda_rand_u64(Context *context) {
-  return ((u64)cuda_rand_u32(context) << 32) + cuda_rand_u32(context);
-}
-
-f32 cuda_rand_f32(Context *context) {
-  return cuda_rand_u32(context) * (1.0f / 4294967296.0f);
-}
-
-f32 cuda_rand_f64(Context *context) {
-  return cuda_rand_f32(context);
-}
-
-i32 cuda_rand_i32(Context *context) {
-  return cuda_rand_u32(context);
-}
-
-i64 cuda_rand_i64(Context *context) {
-  return cuda_rand_u64(context);
-}
-};
-
-#endif
-
 #endif
@@ -0,0 +1,36 @@
+// Always-on counters that the runtime updates as kernels run, in
+// Runtime::counters, and the errors kernels report without stopping. Also
+// compiled into the runtime bitcode.
+#pragma once
+
+#include <cstdint>
+#include "constants.h"
+
+// A value printed by a PrintStmt, or an AssertStmt that failed
+struct DebugRecord {
+  // Of Program::debug_messages
+  int32_t message_id;
+  // The bits of the printed value, of the type of the message
+  uint64_t value;
+};
+
+struct RuntimeCounters {
+  // Elements generated into the element list of each SNode
+  uint64_t list_elements[taichi_max_num_snodes];
+  // Executed by CPU kernels, summed per task chunk
+  uint64_t atomic_ops;
+  // The first access found out of bound (CompileConfig::check_out_of_bound):
+  // the id of its check plus one, or 0 if none, and its indices
+  int32_t out_of_bound_check;
+  int32_t out_of_bound_indices[taichi_max_num_indices];
+  // The id plus one of an SNode whose hash table had no slot left for a cell
+  // being activated, or 0
+  int32_t full_hash_table;
+  // Records appended so far. The last taichi_max_num_debug_records of them
+  // are in debug_records, at their number modulo its size.
+  uint64_t num_debug_records;
+  DebugRecord debug_records[taichi_max_num_debug_records];
+  // The last iteration of the device loop that passed its gate, see
+  // Program::run_device_loop
+  uint64_t loop_iterations;
+};
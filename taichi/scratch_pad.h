@@ -198,8 +198,14 @@ class ScratchPads {
   }
 
   void finalize() {
-    for (auto &pad : pads) {
-      pad.second.finalize();
+    for (auto it = pads.begin(); it != pads.end();) {
+      // Nothing to stage for SNodes the loop does not access regularly
+      if (it->second.accesses.empty()) {
+        it = pads.erase(it);
+      } else {
+        it->second.finalize();
+        it++;
+      }
     }
   }
 
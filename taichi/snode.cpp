@@ -23,6 +23,19 @@ SNode &SNode::place(Expr &expr_) {
     }
     expr->snode->expr.set(Expr(expr));
     child.dt = expr->dt;
+    child.quant = expr->quant;
+    if (type == SNodeType::bit_struct) {
+      TC_ERROR_UNLESS(child.quant.num_bits > 0,
+                      "Only quantized types can be placed in a bit_struct");
+      child.data_bit_offset = taken_data_bits;
+      taken_data_bits += child.quant.num_bits;
+      TC_ERROR_UNLESS(taken_data_bits <= data_type_size(dt) * 8,
+                      "The fields take {} bits, more than the {}-bit word",
+                      taken_data_bits, data_type_size(dt) * 8);
+    } else {
+      TC_ERROR_UNLESS(child.quant.num_bits == 0,
+                      "Quantized types must be placed in a bit_struct");
+    }
   }
   return *this;
 }
@@ -60,6 +73,35 @@ SNode &SNode::create_node(std::vector<Index> indices,
   return new_node;
 }
 
+// Grows each axis by 2 * width cells, which accesses reach at logical indices
+// [-width, 0) and [n, n + width). Struct-fors still visit [0, n) only.
+SNode &SNode::halo(int width) {
+  TC_ERROR_UNLESS(type == SNodeType::dense, "Only dense SNodes can have halos");
+  TC_ERROR_UNLESS(ch.empty(), "The halo must be set before placing");
+  TC_ERROR_UNLESS(width >= 0, "Negative halo width {}", width);
+  n = 1;
+  for (int i = 0; i < max_num_indices; i++) {
+    auto &e = extractors[i];
+    if (!e.active)
+      continue;
+    e.num_elements += 2 * (width - _halo);
+    e.activate(bit::log2int(bit::least_pot_bound(e.num_elements)));
+    n *= 1 << e.num_bits;
+  }
+  _halo = width;
+  return *this;
+}
+
+bool SNode::can_clear_data() const {
+  if (type != SNodeType::dense || ch.empty())
+    return false;
+  for (auto &c : ch) {
+    if (c->type != SNodeType::place)
+      return false;
+  }
+  return true;
+}
+
 void SNode::clear_data() {
   if (clear_func == nullptr) {
     if (clear_kernel == nullptr) {
@@ -86,24 +128,98 @@ void SNode::clear_data_and_deactivate() {
   }
 }
 
-void SNode::lazy_grad() {
-  if (this->type == SNodeType::place)
-    return;
-  for (auto c : ch) {
-    c->lazy_grad();
+void SNode::defragment() {
+  TC_ERROR_UNLESS(get_current_program().config.use_llvm,
+                  "Only the LLVM backends can defragment nodes.");
+  if (defragment_kernel == nullptr) {
+    defragment_kernel = &kernel([&]() {
+      current_ast_builder().insert(Stmt::make<ClearAllStmt>(this, false, true));
+    });
   }
-  std::vector<Expr> new_grads;
-  for (auto c : ch) {
+  (*(Kernel *)defragment_kernel)();
+}
+
+void SNode::deactivate_ambient() {
+  TC_ERROR_UNLESS(get_current_program().config.use_llvm,
+                  "Only the LLVM backends can deactivate ambient blocks.");
+  if (deactivate_ambient_kernel == nullptr) {
+    deactivate_ambient_kernel = &kernel([&]() {
+      current_ast_builder().insert(
+          Stmt::make<ClearAllStmt>(this, true, false, true));
+    });
+  }
+  (*(Kernel *)deactivate_ambient_kernel)();
+}
+
+// The gradients of the place children of node that have none yet
+static std::vector<Expr> missing_grads(const SNode &node) {
+  std::vector<Expr> grads;
+  for (auto c : node.ch) {
     if (c->type == SNodeType::place && c->is_primal() && needs_grad(c->dt) &&
         !c->has_grad()) {
-      new_grads.push_back(c->expr.cast<GlobalVariableExpression>()->adjoint);
+      grads.push_back(c->expr.cast<GlobalVariableExpression>()->adjoint);
     }
   }
-  for (auto p : new_grads) {
+  return grads;
+}
+
+// Places the gradients below node into the copy of it that get_copy returns,
+// creating it (and its ancestors) on first use
+static void place_grads_separately(SNode &node,
+                                   const std::function<SNode &()> &get_copy) {
+  auto grads = missing_grads(node);
+  if (!grads.empty()) {
+    auto &copy = get_copy();
+    for (auto p : grads)
+      copy.place(p);
+  }
+  // Copies may be inserted into node itself
+  auto num_ch = node.ch.size();
+  for (std::size_t i = 0; i < num_ch; i++) {
+    auto c = node.ch[i];
+    if (c->type == SNodeType::place)
+      continue;
+    SNode *c_copy = nullptr;
+    place_grads_separately(*c, [&]() -> SNode & {
+      if (c_copy == nullptr)
+        c_copy = &get_copy().insert_copy_of(*c);
+      return *c_copy;
+    });
+  }
+}
+
+void SNode::lazy_grad(bool separate) {
+  if (this->type == SNodeType::place)
+    return;
+  if (separate) {
+    place_grads_separately(*this, [&]() -> SNode & { return *this; });
+    return;
+  }
+  for (auto c : ch) {
+    c->lazy_grad();
+  }
+  for (auto p : missing_grads(*this)) {
     this->place(p);
   }
 }
 
+SNode &SNode::insert_copy_of(const SNode &node) {
+  auto &copy = insert_children(node.type);
+  copy.n = node.n;
+  for (int i = 0; i < max_num_indices; i++)
+    copy.extractors[i] = node.extractors[i];
+  copy.index_id = node.index_id;
+  copy.chunk_size = node.chunk_size;
+  copy.hash_capacity = node.hash_capacity;
+  copy.dt = node.dt;
+  copy._morton = node._morton;
+  copy._geometric = node._geometric;
+  copy._bitmasked = node._bitmasked;
+  copy._compressed = node._compressed;
+  copy._halo = node._halo;
+  return copy;
+}
+
 bool SNode::is_primal() const {
   TC_ASSERT(expr.expr != nullptr);
   return expr.cast<GlobalVariableExpression>()->is_primal;
@@ -126,8 +242,27 @@ SNode *SNode::get_grad() const {
       ->snode;
 }
 
+// The cell at I, if it can be accessed from the host without a kernel
+static void *direct_cell(SNode *snode, const std::vector<int> &I) {
+  if (!snode->cell_func)
+    return nullptr;
+  auto cell = snode->cell_func(I);
+  if (cell)
+    get_current_program().synchronize();
+  return cell;
+}
+
 // for float and double
 void SNode::write_float(const std::vector<int> &I, float64 val) {
+  if (auto cell = direct_cell(this, I)) {
+    if (dt == DataType::f32) {
+      *(float32 *)cell = (float32)val;
+      return;
+    } else if (dt == DataType::f64) {
+      *(float64 *)cell = val;
+      return;
+    }
+  }
   if (writer_kernel == nullptr) {
     writer_kernel = &get_current_program().get_snode_writer(this);
   }
@@ -141,13 +276,19 @@ void SNode::write_float(const std::vector<int> &I, float64 val) {
 }
 
 float64 SNode::read_float(const std::vector<int> &I) {
+  if (auto cell = direct_cell(this, I)) {
+    if (dt == DataType::f32)
+      return *(float32 *)cell;
+    else if (dt == DataType::f64)
+      return *(float64 *)cell;
+  }
   if (reader_kernel == nullptr) {
     reader_kernel = &get_current_program().get_snode_reader(this);
   }
   set_kernel_args(reader_kernel, I);
   get_current_program().synchronize();
   (*reader_kernel)();
-  if (dt == DataType::f32) {
+  if (compute_type(dt) == DataType::f32) {
     return get_current_program().context.get_arg<float32>(num_active_indices);
   } else if (dt == DataType::f64) {
     return get_current_program().context.get_arg<float64>(num_active_indices);
@@ -158,6 +299,15 @@ float64 SNode::read_float(const std::vector<int> &I) {
 
 // for int32 and int64
 void SNode::write_int(const std::vector<int> &I, int64 val) {
+  if (auto cell = direct_cell(this, I)) {
+    if (dt == DataType::i32) {
+      *(int32 *)cell = (int32)val;
+      return;
+    } else if (dt == DataType::i64) {
+      *(int64 *)cell = val;
+      return;
+    }
+  }
   if (writer_kernel == nullptr) {
     writer_kernel = &get_current_program().get_snode_writer(this);
   }
@@ -168,6 +318,12 @@ void SNode::write_int(const std::vector<int> &I, int64 val) {
 }
 
 int64 SNode::read_int(const std::vector<int> &I) {
+  if (auto cell = direct_cell(this, I)) {
+    if (dt == DataType::i32)
+      return *(int32 *)cell;
+    else if (dt == DataType::i64)
+      return *(int64 *)cell;
+  }
   if (reader_kernel == nullptr) {
     reader_kernel = &get_current_program().get_snode_reader(this);
   }
@@ -183,8 +339,45 @@ int64 SNode::read_int(const std::vector<int> &I) {
   }
 }
 
+// Launches a kernel of Program::get_snode_gatherer/scatterer
+static void launch_batched_access(SNode *snode,
+                                  Kernel *kernel,
+                                  const int32 *indices,
+                                  const void *values,
+                                  int n) {
+  auto dim = snode->num_active_indices;
+  kernel->set_arg_nparray(0, (uint64)indices, sizeof(int32) * n * dim);
+  kernel->set_extra_arg_int(0, 0, n);
+  kernel->set_extra_arg_int(0, 1, dim);
+  kernel->set_arg_nparray(1, (uint64)values,
+                          data_type_size(compute_type(snode->dt)) * n);
+  kernel->set_extra_arg_int(1, 0, n);
+  kernel->set_arg_int(2, n);
+  get_current_program().synchronize();
+  (*kernel)();
+}
+
+void SNode::gather(const int32 *indices, void *values, int n) {
+  if (gatherer_kernel == nullptr) {
+    gatherer_kernel = &get_current_program().get_snode_gatherer(this);
+  }
+  launch_batched_access(this, gatherer_kernel, indices, values, n);
+}
+
+void SNode::scatter(const int32 *indices, const void *values, int n) {
+  if (scatterer_kernel == nullptr) {
+    scatterer_kernel = &get_current_program().get_snode_scatterer(this);
+  }
+  launch_batched_access(this, scatterer_kernel, indices, values, n);
+}
+
 int SNode::num_elements_along_axis(int i) const {
-  return extractors[physical_index_position[i]].num_elements;
+  return extractors[physical_index_position[i]].num_elements -
+         2 * halo_width();
+}
+
+int SNode::cell_extent_along_axis(int i) const {
+  return 1 << extractors[physical_index_position[i]].start;
 }
 
 void SNode::set_kernel_args(Kernel *kernel, const std::vector<int> &I) {
@@ -208,6 +401,13 @@ SNode::SNode(int depth, SNodeType t) : depth(depth), type(t) {
   std::memset(physical_index_position, -1, sizeof(physical_index_position));
   access_func = nullptr;
   stat_func = nullptr;
+  snapshot_func = nullptr;
+  restore_func = nullptr;
+  bulk_copy_func = nullptr;
+  bulk_write_func = nullptr;
+  bulk_read_func = nullptr;
+  cell_func = nullptr;
+  residency_func = nullptr;
   parent = nullptr;
   _verbose = false;
   _multi_threaded = false;
@@ -215,7 +415,10 @@ SNode::SNode(int depth, SNodeType t) : depth(depth), type(t) {
   has_ambient = false;
   dt = DataType::unknown;
   _morton = false;
+  _geometric = false;
+  _halo = 0;
   _bitmasked = false;
+  hash_capacity = 0;
 
   clear_func = nullptr;
   clear_kernel = nullptr;
@@ -223,9 +426,23 @@ SNode::SNode(int depth, SNodeType t) : depth(depth), type(t) {
 
   reader_kernel = nullptr;
   writer_kernel = nullptr;
+  listgen_kernel = nullptr;
 }
 
 SNode::~SNode() {
 }
 
+std::vector<uint32> morton_bit_masks(const std::vector<int> &num_bits) {
+  std::vector<uint32> masks(num_bits.size(), 0);
+  int pos = 0;
+  for (int b = 0; b < 32; b++) {
+    for (int i = (int)num_bits.size() - 1; i >= 0; i--) {
+      if (b < num_bits[i])
+        masks[i] |= 1u << pos++;
+    }
+  }
+  TC_ASSERT(pos <= 32);
+  return masks;
+}
+
 TLANG_NAMESPACE_END
\ No newline at end of file
@@ -4,6 +4,11 @@
 #include "expr.h"
 #include <taichi/common/bit.h>
 
+TC_NAMESPACE_BEGIN
+class BinaryFileStreamInput;
+class BinaryFileStreamOutput;
+TC_NAMESPACE_END
+
 TLANG_NAMESPACE_BEGIN
 
 struct Matrix;
@@ -74,13 +79,23 @@ class SNode {
   int64 n{};
   int total_num_bits{}, total_bit_start{};
   int chunk_size{};
+  int hash_capacity{};
+  static constexpr int default_hash_capacity = 1 << 16;
   DataType dt;
+  // For place nodes in a bit_struct (whose dt is the word type), the type
+  // and position of their bits in the word
+  QuantizedType quant;
+  int data_bit_offset{};
+  int taken_data_bits{};
   bool has_ambient{};
   TypedConstant ambient_val;
   // Note: parent will not be set until structural nodes are compiled!
   SNode *parent{};
   Kernel *reader_kernel{};
   Kernel *writer_kernel{};
+  Kernel *gatherer_kernel{};
+  Kernel *scatterer_kernel{};
+  Kernel *listgen_kernel{};
   Expr expr;
 
   std::string data_type_name() {
@@ -90,16 +105,44 @@ class SNode {
   using AccessorFunction = std::function<void *(void *, int, int, int, int)>;
   using StatFunction = std::function<AllocatorStat()>;
   using ClearFunction = std::function<void(int)>;
+  using SnapshotFunction = std::function<void(const std::string &, bool)>;
+  using RestoreFunction = std::function<void(const std::string &)>;
   AccessorFunction access_func;
   StatFunction stat_func;
   ClearFunction clear_func;
+  SnapshotFunction snapshot_func;
+  RestoreFunction restore_func;
+  // Prefetches (or evicts) the elements [begin, end) of a dense SNode under
+  // the root, when the root buffer is file-backed (CompileConfig::root_file)
+  using ResidencyFunction = std::function<void(int64, int64, bool)>;
+  ResidencyFunction residency_func;
+  // Copies all cells from (to_array) or to a C-ordered array, for place
+  // SNodes stored in a dense array under the root (LLVM backends)
+  using BulkCopyFunction = std::function<void(void *, bool)>;
+  BulkCopyFunction bulk_copy_func;
+  // The same, as a C-ordered array in a binary file
+  std::function<void(BinaryFileStreamOutput &)> bulk_write_func;
+  std::function<void(BinaryFileStreamInput &)> bulk_read_func;
+  // The address of a cell of such SNodes in the root buffer, or nullptr if
+  // the indices are out of the shape. Scalar reads and writes from the host
+  // go through it instead of compiling accessor kernels
+  using CellFunction = std::function<void *(const std::vector<int> &)>;
+  CellFunction cell_func;
   void *clear_kernel{}, *clear_and_deactivate_kernel{};
+  void *defragment_kernel{}, *deactivate_ambient_kernel{};
 
   std::string node_type_name;
   SNodeType type;
   int index_id{};
   bool _morton{};
+  // Dynamic SNodes only: chunks of geometrically growing sizes
+  bool _geometric{};
   bool _bitmasked{};
+  // Pointer SNodes only: 32-bit node indices instead of a lock and a pointer
+  bool _compressed{};
+  // Cells of padding before and after the interior along each axis, indexed
+  // from -_halo (dense SNodes under the root only)
+  int _halo{};
   bool has_aux_structure{};
 
   std::string get_node_type_name() {
@@ -195,8 +238,13 @@ class SNode {
     return child;
   }
 
-  SNode &hash(const std::vector<Index> indices, std::vector<int> sizes) {
-    return create_node(indices, sizes, SNodeType::hash);
+  // capacity: number of hash table slots (LLVM backends), 0 for the default
+  SNode &hash(const std::vector<Index> &indices,
+              const std::vector<int> &sizes,
+              int capacity = 0) {
+    auto &node = create_node(indices, sizes, SNodeType::hash);
+    node.hash_capacity = capacity;
+    return node;
   }
 
   SNode &hash(const std::vector<Index> indices, int sizes) {
@@ -211,11 +259,64 @@ class SNode {
     return insert_children(SNodeType::pointer);
   }
 
+  // Packs the quantized variables placed in it into a num_bits-bit word
+  SNode &bit_struct(int num_bits) {
+    TC_ERROR_UNLESS(num_bits == 32 || num_bits == 64,
+                    "bit_struct words must have 32 or 64 bits");
+    auto &node = create_node({}, {}, SNodeType::bit_struct);
+    node.dt = num_bits == 32 ? DataType::u32 : DataType::u64;
+    return node;
+  }
+
   SNode &morton(bool val = true) {
     _morton = val;
     return *this;
   }
 
+  SNode &halo(int width);
+
+  SNode &geometric(bool val = true) {
+    TC_ERROR_UNLESS(type == SNodeType::dynamic,
+                    "Only dynamic SNodes can have geometric chunks");
+    _geometric = val;
+    return *this;
+  }
+
+  // The length of the chunk table of a dynamic SNode
+  int num_dynamic_chunks() const {
+    int64 n = max_num_elements();
+    if (!_geometric)
+      return (int)((n + chunk_size - 1) / chunk_size);
+    int levels = 0;
+    while (chunk_size * ((1LL << levels) - 1) < n)
+      levels++;
+    return levels;
+  }
+
+  // The physical coordinates of the instances of this SNode that can be
+  // nonzero, i.e. those indexed by its ancestors. Its element list only
+  // stores as many.
+  int num_element_coordinates() const {
+    int n = 0;
+    if (parent) {
+      for (int i = 0; i < parent->num_active_indices; i++)
+        n = std::max(n, parent->physical_index_position[i] + 1);
+    }
+    return n;
+  }
+
+  // The halo width of the cells of a place SNode, or of a dense SNode
+  int halo_width() const {
+    return type == SNodeType::place && parent ? parent->_halo : _halo;
+  }
+
+  SNode &compressed(bool val = true) {
+    TC_ERROR_UNLESS(type == SNodeType::pointer,
+                    "Only pointer SNodes can be compressed");
+    _compressed = val;
+    return *this;
+  }
+
   SNode &bitmasked(bool val = true) {
     _bitmasked = val;
     return *this;
@@ -235,11 +336,67 @@ class SNode {
   void write_int(const std::vector<int> &I, int64);
   int64 read_int(const std::vector<int> &I);
 
+  // Read or write the cells at n indices, stored as n rows of
+  // num_active_indices. The values are of type compute_type(dt).
+  void gather(const int32 *indices, void *values, int n);
+
+  void scatter(const int32 *indices, const void *values, int n);
+
   TC_FORCE_INLINE AllocatorStat stat() {
     TC_ASSERT(stat_func);
     return stat_func();
   }
 
+  // Saves the active blocks of a dense SNode holding place nodes (LLVM
+  // backends), with their coordinates and raw data, or with each block
+  // compressed
+  void snapshot(const std::string &filename, bool compress = false) {
+    TC_ERROR_UNLESS(snapshot_func,
+                    "Only dense SNodes of place nodes can be snapshotted, with "
+                    "the LLVM backends");
+    snapshot_func(filename, compress);
+  }
+
+  // Activates the blocks of a snapshot (of either kind) and copies their
+  // data back
+  void restore(const std::string &filename) {
+    TC_ERROR_UNLESS(restore_func,
+                    "Only dense SNodes of place nodes can be restored, with "
+                    "the LLVM backends");
+    restore_func(filename);
+  }
+
+  // Writes (or reads) all cells as a C-ordered array, from (or to) the root
+  // buffer without staging them
+  void write_cells(BinaryFileStreamOutput &out) {
+    TC_ERROR_UNLESS(bulk_write_func,
+                    "Only place SNodes in a dense array under the root can "
+                    "be written directly, with the LLVM backends");
+    bulk_write_func(out);
+  }
+
+  void read_cells(BinaryFileStreamInput &in) {
+    TC_ERROR_UNLESS(bulk_read_func,
+                    "Only place SNodes in a dense array under the root can "
+                    "be read directly, with the LLVM backends");
+    bulk_read_func(in);
+  }
+
+  // end < 0 for all elements
+  void prefetch(int64 begin, int64 end) {
+    TC_ERROR_UNLESS(residency_func,
+                    "Only dense SNodes under a file-backed root can be "
+                    "prefetched");
+    residency_func(begin, end, true);
+  }
+
+  void evict(int64 begin, int64 end) {
+    TC_ERROR_UNLESS(residency_func,
+                    "Only dense SNodes under a file-backed root can be "
+                    "evicted");
+    residency_func(begin, end, false);
+  }
+
   int child_id(SNode *c) {
     for (int i = 0; i < (int)ch.size(); i++) {
       if (ch[i].get() == c) {
@@ -249,10 +406,22 @@ class SNode {
     return -1;
   }
 
+  // With the LLVM backends, only dense nodes that directly hold their
+  // tensors can be cleared, one memset per active instance
+  bool can_clear_data() const;
+
   void clear_data();
 
   void clear_data_and_deactivate();
 
+  // Moves the nodes of the active cells of a pointer node to the front of its
+  // pool, in the order struct-fors visit them (LLVM backends only)
+  void defragment();
+
+  // Deactivates the cells of a pointer node whose blocks are all zero, the
+  // ambient value (LLVM backends only)
+  void deactivate_ambient();
+
   bool has_null() const {
     return type == SNodeType::pointer || type == SNodeType::hash;
   }
@@ -264,12 +433,23 @@ class SNode {
 
   bool need_activation() const;
 
-  void lazy_grad();
+  // Places the missing gradients of the primals below this node. With
+  // separate, they go into a copy of the hierarchy of their primals below
+  // this node instead of next to them: the pages of dense gradients are only
+  // backed once touched, and sparse ones are only allocated where written.
+  void lazy_grad(bool separate = false);
+
+  // A new child with the structure of node (but no children)
+  SNode &insert_copy_of(const SNode &node);
 
   bool is_primal() const;
 
   bool is_place() const;
 
+  bool is_bit_field() const {
+    return parent != nullptr && parent->type == SNodeType::bit_struct;
+  }
+
   const Expr &get_expr() const {
     return expr;
   }
@@ -300,11 +480,32 @@ class SNode {
     return 1 << total_num_bits;
   }
 
+  // Power of two, at most the size of the index space
+  int get_hash_capacity() const {
+    TC_ASSERT(type == SNodeType::hash);
+    int capacity = hash_capacity;
+    if (capacity == 0)
+      capacity = default_hash_capacity;
+    capacity = std::min((int)bit::least_pot_bound(capacity),
+                        max_num_elements());
+    return std::max(capacity, 2);
+  }
+
   int num_elements_along_axis(int i) const;
 
+  // The number of elements each cell spans along axis i, after the struct
+  // compiler, e.g. 8 for pointer().dense(ti.ijk, 8)
+  int cell_extent_along_axis(int i) const;
+
   void set_kernel_args(Kernel *kernel, const std::vector<int> &I);
 };
 
+// The bits of the cell index of a Morton ordered dense node (SNode::morton)
+// that the bits of each coordinate go to, as masks. The coordinates take
+// turns from the least significant bit on, the last one first, and drop out
+// once they run out of bits.
+std::vector<uint32> morton_bit_masks(const std::vector<int> &num_bits);
+
 class SNodeAttribute {
  public:
   llvm::Type *llvm_type, *llvm_body_type, *llvm_aux_type;
@@ -327,6 +528,12 @@ class SNodeAttributes {
   SNodeAttribute &operator[](const Handle<SNode> &snode) {
     return snode_llvm_attr[snode.get()];
   }
+
+  // Adds the attributes of the SNodes of another tree
+  void insert(const SNodeAttributes &other) {
+    snode_llvm_attr.insert(other.snode_llvm_attr.begin(),
+                           other.snode_llvm_attr.end());
+  }
 };
 
 TLANG_NAMESPACE_END
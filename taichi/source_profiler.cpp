@@ -0,0 +1,160 @@
+#include "source_profiler.h"
+#include <atomic>
+#include <fstream>
+#include <set>
+
+#if defined(__linux__) && defined(__x86_64__)
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#define TI_SOURCE_PROFILER_SUPPORTED
+#endif
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+// Written by the signal handler, which may only touch these
+constexpr int64 max_num_samples = 1 << 22;
+uint64 *samples = nullptr;
+std::atomic<int64> num_samples(0);
+
+#if defined(TI_SOURCE_PROFILER_SUPPORTED)
+struct sigaction previous_action;
+
+void on_sigprof(int, siginfo_t *, void *ucontext) {
+  auto pc = ((ucontext_t *)ucontext)->uc_mcontext.gregs[REG_RIP];
+  auto i = num_samples.fetch_add(1, std::memory_order_relaxed);
+  if (i < max_num_samples)
+    samples[i] = (uint64)pc;
+}
+#endif
+}  // namespace
+
+bool SourceProfiler::start() {
+#if defined(TI_SOURCE_PROFILER_SUPPORTED)
+  if (running)
+    return true;
+  if (!samples)
+    samples = new uint64[max_num_samples];
+  struct sigaction action {};
+  action.sa_sigaction = on_sigprof;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, &previous_action) != 0)
+    return false;
+  itimerval timer{};
+  timer.it_interval.tv_sec = interval_us / 1000000;
+  timer.it_interval.tv_usec = interval_us % 1000000;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    sigaction(SIGPROF, &previous_action, nullptr);
+    return false;
+  }
+  running = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void SourceProfiler::stop() {
+#if defined(TI_SOURCE_PROFILER_SUPPORTED)
+  if (!running)
+    return;
+  itimerval timer{};
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  sigaction(SIGPROF, &previous_action, nullptr);
+  running = false;
+#endif
+}
+
+void SourceProfiler::add_lines(std::vector<LineRange> &&new_ranges) {
+  std::lock_guard<std::mutex> _(mut);
+  for (auto &r : new_ranges)
+    ranges[r.begin] = std::move(r);
+}
+
+void SourceProfiler::collect(
+    std::map<std::pair<std::string, int>, int64> &lines,
+    int64 &total) {
+  total = num_samples.load();
+  std::lock_guard<std::mutex> _(mut);
+  for (int64 i = 0; i < std::min(total, max_num_samples); i++) {
+    auto it = ranges.upper_bound(samples[i]);
+    if (it == ranges.begin())
+      continue;
+    --it;
+    if (samples[i] < it->second.end)
+      lines[std::make_pair(it->second.file, it->second.line)]++;
+  }
+}
+
+std::map<std::string, int64> SourceProfiler::get() {
+  std::map<std::pair<std::string, int>, int64> lines;
+  int64 total;
+  collect(lines, total);
+  std::map<std::string, int64> ret;
+  for (auto &l : lines)
+    ret[fmt::format("{}:{}", l.first.first, l.first.second)] = l.second;
+  ret["total"] = total;
+  return ret;
+}
+
+void SourceProfiler::print() {
+  std::map<std::pair<std::string, int>, int64> lines;
+  int64 total;
+  collect(lines, total);
+  int64 in_kernels = 0;
+  for (auto &l : lines)
+    in_kernels += l.second;
+  printf("Source profile (%lld samples, %.1f%% in kernels)\n",
+         (long long)total, total ? in_kernels * 100.0 / total : 0.0);
+  if (total > max_num_samples) {
+    printf("  (%lld samples dropped)\n",
+           (long long)(total - max_num_samples));
+  }
+  std::set<std::string> files;
+  for (auto &l : lines)
+    files.insert(l.first.first);
+  for (auto &file : files) {
+    printf("%s\n", file.c_str());
+    std::vector<std::string> source;
+    std::ifstream fin(file);
+    for (std::string s; std::getline(fin, s);)
+      source.push_back(s);
+    // The sampled lines, with up to two lines of context around them
+    auto first = lines.lower_bound(std::make_pair(file, 0));
+    int last_printed = 0;
+    for (auto it = first; it != lines.end() && it->first.first == file;
+         ++it) {
+      int line = it->first.second;
+      int begin = std::max(last_printed + 1, line - 2);
+      if (last_printed && begin > last_printed + 1)
+        printf("          ...\n");
+      auto next = std::next(it);
+      int end = line + 2;
+      if (next != lines.end() && next->first.first == file)
+        end = std::min(end, next->first.second - 1);
+      for (int i = begin; i <= end; i++) {
+        auto text = i - 1 < (int)source.size() ? source[i - 1] : "";
+        if (i == line) {
+          printf("  %6.2f%% %5d | %s\n", it->second * 100.0 / in_kernels, i,
+                 text.c_str());
+        } else if (i - 1 < (int)source.size()) {
+          printf("          %5d | %s\n", i, text.c_str());
+        }
+      }
+      last_printed = std::max(last_printed, end);
+    }
+  }
+}
+
+void SourceProfiler::clear() {
+  num_samples = 0;
+}
+
+SourceProfiler::~SourceProfiler() {
+  stop();
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,58 @@
+// Samples the program counter with SIGPROF and attributes the samples that
+// fall into compiled kernels to the Python source lines of the kernels
+// (CompileConfig::profile_source_lines)
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "tlang_util.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class SourceProfiler {
+ public:
+  // Machine code [begin, end) generated from a source line
+  struct LineRange {
+    uint64 begin, end;
+    std::string file;
+    int line;
+  };
+
+  // Interval of the samples, of the CPU time of the process
+  int interval_us = 1000;
+
+  // Returns false if sampling is not supported on this platform
+  bool start();
+
+  void stop();
+
+  // Of each object loaded by the JIT, which may be on a compilation thread
+  void add_lines(std::vector<LineRange> &&ranges);
+
+  // Samples per "file:line", and the total number of samples in "total",
+  // including those outside of kernels
+  std::map<std::string, int64> get();
+
+  // The kernel lines that got samples, annotated with the share of the
+  // samples inside kernels
+  void print();
+
+  void clear();
+
+  ~SourceProfiler();
+
+ private:
+  bool running = false;
+  std::mutex mut;
+  // Keyed by begin
+  std::map<uint64, LineRange> ranges;
+
+  // Resolves the samples taken so far
+  void collect(std::map<std::pair<std::string, int>, int64> &lines,
+               int64 &num_samples);
+};
+
+TLANG_NAMESPACE_END
@@ -65,10 +65,14 @@ class LinearizeStmt : public Stmt {
  public:
   std::vector<Stmt *> inputs;
   std::vector<int> strides;
+  // Interleaves the bits of the inputs instead, see morton_bit_masks. The
+  // strides are powers of two then.
+  bool morton;
 
   LinearizeStmt(const std::vector<Stmt *> &inputs,
-                const std::vector<int> &strides)
-      : inputs(inputs), strides(strides) {
+                const std::vector<int> &strides,
+                bool morton = false)
+      : inputs(inputs), strides(strides), morton(morton) {
     TC_ASSERT(inputs.size() == strides.size());
     for (auto &op : this->inputs) {
       add_operand(op);
@@ -101,7 +105,11 @@ class OffsetAndExtractBitsStmt : public Stmt {
 
 class GetRootStmt : public Stmt {
  public:
-  GetRootStmt() {}
+  // The root of the SNode tree, see Program::add_snode_tree. nullptr is the
+  // root of the layout.
+  SNode *root;
+
+  GetRootStmt(SNode *root = nullptr) : root(root) {}
 
   DEFINE_ACCEPT
 };
@@ -113,6 +121,10 @@ class SNodeLookupStmt : public Stmt {
   Stmt *input_index;
   std::vector<Stmt *> global_indices;
   bool activate;
+  // Set by lower_access for lookups in the leaf block of the enclosing
+  // struct-for, at the loop indices plus constants: the cell is likely in the
+  // block of the current element (CompileConfig::block_local_access)
+  bool in_loop_block;
 
   SNodeLookupStmt(SNode *snode,
                   Stmt *input_snode,
@@ -123,7 +135,8 @@ class SNodeLookupStmt : public Stmt {
         input_snode(input_snode),
         input_index(input_index),
         global_indices(global_indices),
-        activate(activate) {
+        activate(activate),
+        in_loop_block(false) {
     add_operand(this->input_snode);
     add_operand(this->input_index);
     for (int i = 0; i < (int)global_indices.size(); i++) {
@@ -149,9 +162,21 @@ class ClearAllStmt : public Stmt {
  public:
   SNode *snode;
   bool deactivate;
-
-  ClearAllStmt(SNode *snode, bool deactivate)
-      : snode(snode), deactivate(deactivate) {
+  // Instead of clearing the pointer node, moves its nodes to the front of its
+  // allocator in the order of its element list
+  bool defragment;
+  // With deactivate, only deactivates the cells of the pointer node whose
+  // nodes hold nothing but zeros, the ambient value
+  bool only_ambient;
+
+  ClearAllStmt(SNode *snode,
+               bool deactivate,
+               bool defragment = false,
+               bool only_ambient = false)
+      : snode(snode),
+        deactivate(deactivate),
+        defragment(defragment),
+        only_ambient(only_ambient) {
   }
 
   DEFINE_ACCEPT
@@ -165,21 +190,50 @@ class OffloadedStmt : public Stmt {
     struct_for,
     clear_list,
     listgen,
+    gc,
+    // Zeroes the data of the instances in the element list of snode
+    zero_fill,
+    // Deactivates the instances in the element list of snode, and frees the
+    // nodes of snode and its sparse descendants at once
+    deactivate_all,
+    // Moves the nodes of the active instances in the element list of the
+    // pointer snode to the front of its allocator, in order
+    defragment,
+    // Deactivates the instances in the element list of the pointer snode
+    // whose nodes are all zero
+    deactivate_ambient,
   };
 
   TaskType task_type;
   SNode *snode;
   int begin, end, step;
+  // Range-for bounds only known at run time are stored by the previous serial
+  // task into the temporaries at these offsets, see irpass::offload
+  bool const_begin, const_end;
+  std::size_t begin_offset, end_offset;
   int block_dim;
   bool reversed;
   int num_cpu_threads;
+  // Vectorization width for the LLVM loop vectorizer, see
+  // CodeGenLLVM::annotate_task_loop
+  int vectorize;
+  CPUSchedule schedule;
+  // A serial task independent of the next range-for, see
+  // irpass::mark_concurrent_tasks
+  bool concurrent_with_next;
   Arch device;
   std::vector<Stmt *> loop_vars;
   std::vector<llvm::Value *> loop_vars_llvm;
   std::unique_ptr<Block> body;
+  // Struct-fors only, see StructForStmt
+  std::unique_ptr<Block> block_initialization;
+  std::unique_ptr<Block> block_finalization;
+  std::size_t scratch_pad_size;
 
   OffloadedStmt(TaskType task_type);
 
+  static std::string task_type_name(TaskType task_type);
+
   DEFINE_ACCEPT
 };
 
@@ -207,6 +261,102 @@ class GlobalTemporaryStmt : public Stmt {
   DEFINE_ACCEPT
 };
 
+// The physical index of the first cell of the leaf block a struct-for is
+// working on
+class BlockCornerIndexStmt : public Stmt {
+ public:
+  int index;
+
+  BlockCornerIndexStmt(int index) : index(index) {
+    ret_type = VectorType(1, DataType::i32);
+  }
+
+  virtual bool has_global_side_effect() const override {
+    return false;
+  }
+  DEFINE_ACCEPT
+};
+
+// The index of the current thread within its GPU thread block
+class ThreadIndexStmt : public Stmt {
+ public:
+  ThreadIndexStmt() {
+    ret_type = VectorType(1, DataType::i32);
+  }
+
+  virtual bool has_global_side_effect() const override {
+    return false;
+  }
+  DEFINE_ACCEPT
+};
+
+// Points offset bytes into the shared memory scratch pads of the current
+// struct-for task
+class ScratchPadPtrStmt : public Stmt {
+ public:
+  Stmt *offset;
+
+  ScratchPadPtrStmt(Stmt *offset, VectorType ret_type) : offset(offset) {
+    this->ret_type = ret_type;
+    add_operand(this->offset);
+  }
+
+  virtual bool has_global_side_effect() const override {
+    return false;
+  }
+  DEFINE_ACCEPT
+};
+
+// The n x m product of the n x k matrix a by the k x m matrix b, both in
+// row-major order, whose entries are read with MatmulResultStmt. Expanded
+// into scalar arithmetic by irpass::scalarize, except for tensor_cores
+// products (in f32, of a warp-uniform a) left to the codegen. See
+// taichi/matmul.h
+class MatmulStmt : public Stmt {
+ public:
+  std::vector<Stmt *> a, b;
+  int n, k, m;
+  bool tensor_cores;
+
+  MatmulStmt(const std::vector<Stmt *> &a,
+             const std::vector<Stmt *> &b,
+             int n,
+             int k,
+             int m,
+             bool tensor_cores)
+      : a(a), b(b), n(n), k(k), m(m), tensor_cores(tensor_cores) {
+    TC_ASSERT((int)a.size() == n * k && (int)b.size() == k * m);
+    if (tensor_cores)
+      this->ret_type = VectorType(1, DataType::f32);
+    for (auto &s : this->a)
+      add_operand(s);
+    for (auto &s : this->b)
+      add_operand(s);
+  }
+
+  virtual bool has_global_side_effect() const override {
+    return false;
+  }
+  DEFINE_ACCEPT
+};
+
+// Entry index (row-major) of the product of a MatmulStmt, of its type
+class MatmulResultStmt : public Stmt {
+ public:
+  Stmt *mm;
+  int index;
+
+  MatmulResultStmt(Stmt *mm, int index) : mm(mm), index(index) {
+    this->ret_type = mm->ret_type;
+    add_operand(this->mm);
+  }
+
+  virtual bool has_global_side_effect() const override {
+    return false;
+  }
+  DEFINE_ACCEPT
+};
+
 // Visits all non-containing statements
 class BasicStmtVisitor : public IRVisitor {
  public:
@@ -244,13 +394,21 @@ class BasicStmtVisitor : public IRVisitor {
 
   void visit(StructForStmt *for_stmt) override {
     current_struct_for = for_stmt;
+    if (for_stmt->block_initialization)
+      for_stmt->block_initialization->accept(this);
     for_stmt->body->accept(this);
+    if (for_stmt->block_finalization)
+      for_stmt->block_finalization->accept(this);
     current_struct_for = nullptr;
   }
 
   void visit(OffloadedStmt *stmt) override {
+    if (stmt->block_initialization)
+      stmt->block_initialization->accept(this);
     if (stmt->body)
       stmt->body->accept(this);
+    if (stmt->block_finalization)
+      stmt->block_finalization->accept(this);
   }
 };
 
@@ -134,6 +134,9 @@ struct SNodeAllocator {
     stat.pool_size = pool_size;
     stat.num_recycled_blocks = recycle_tail;
     stat.num_resident_blocks = resident_tail;
+    stat.node_size = sizeof(data_type);
+    stat.peak_num_blocks = resident_tail;
+    stat.num_allocations = resident_tail;
     stat.resident_metas = resident_pool;
     return stat;
   }
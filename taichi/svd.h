@@ -157,8 +157,9 @@ sifakis_svd_export(const Expr &a00,
   Ss33 = Stmp1 + Ss33;
   Stmp1 = Sa33 * Sa33;
   Ss33 = Stmp1 + Ss33;
-  StrictlySerialize();
-  For(0, num_iters, [&](Expr sweep) {
+  // Unrolled, so that a loop over matrices around it stays innermost, which
+  // the LLVM loop vectorizer needs to put the matrices into lanes
+  for (int sweep = 0; sweep < num_iters; sweep++) {
     Ssh = Ss21 * Sone_half;
     Stmp5 = Ss11 - Ss22;
     Stmp2 = Ssh * Ssh;
@@ -366,7 +367,7 @@ sifakis_svd_export(const Expr &a00,
     Sqvs = Sqvs - Stmp2;
     Sqvvz = Sqvvz + Stmp1;
     Sqvvx = Sqvvx - Stmp3;
-  });
+  }
   Stmp2 = Sqvs * Sqvs;
   Stmp1 = Sqvvx * Sqvvx;
   Stmp2 = Stmp1 + Stmp2;
@@ -0,0 +1,83 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#include <cstring>
+#include <taichi/system/hardware_counters.h>
+#if defined(TC_PLATFORM_LINUX)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+TC_NAMESPACE_BEGIN
+
+std::vector<std::string> HardwareCounters::names() {
+  return {"instructions", "cache_misses", "branch_misses"};
+}
+
+bool HardwareCounters::open(const std::vector<int> &tids) {
+  close();
+#if defined(TC_PLATFORM_LINUX)
+  const uint64 configs[num_counters] = {PERF_COUNT_HW_INSTRUCTIONS,
+                                        PERF_COUNT_HW_CACHE_MISSES,
+                                        PERF_COUNT_HW_BRANCH_MISSES};
+  for (auto tid : tids) {
+    int leader = -1;
+    for (int i = 0; i < num_counters; i++) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[i];
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      // Counts the thread on whichever CPU it runs
+      int fd = (int)syscall(SYS_perf_event_open, &attr, tid, -1, leader, 0);
+      if (fd < 0) {
+        close();
+        return false;
+      }
+      fds.push_back(fd);
+      if (i == 0) {
+        leader = fd;
+        group_fds.push_back(fd);
+      }
+    }
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void HardwareCounters::read(uint64 *values) const {
+  std::memset(values, 0, sizeof(uint64) * num_counters);
+#if defined(TC_PLATFORM_LINUX)
+  // The number of counters in the group, then their values
+  uint64 buffer[1 + num_counters];
+  for (auto fd : group_fds) {
+    if (::read(fd, buffer, sizeof(buffer)) != (ssize_t)sizeof(buffer))
+      continue;
+    for (int i = 0; i < num_counters; i++)
+      values[i] += buffer[1 + i];
+  }
+#endif
+}
+
+void HardwareCounters::close() {
+#if defined(TC_PLATFORM_LINUX)
+  for (auto fd : fds)
+    ::close(fd);
+#endif
+  fds.clear();
+  group_fds.clear();
+}
+
+HardwareCounters::~HardwareCounters() {
+  close();
+}
+
+TC_NAMESPACE_END
@@ -0,0 +1,40 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <taichi/common/util.h>
+
+TC_NAMESPACE_BEGIN
+
+// Hardware performance counters of a set of threads, summed over them, via
+// perf_event_open (Linux only)
+class HardwareCounters {
+ public:
+  static constexpr int num_counters = 3;
+
+  static std::vector<std::string> names();
+
+  // Returns false (after closing what was opened) if any counter is not
+  // available, e.g. on other platforms, in VMs without a virtual PMU, or with
+  // a restrictive /proc/sys/kernel/perf_event_paranoid
+  bool open(const std::vector<int> &tids);
+
+  // Writes num_counters values, event counts since open()
+  void read(uint64 *values) const;
+
+  void close();
+
+  ~HardwareCounters();
+
+ private:
+  // One group per thread, led by its first counter
+  std::vector<int> group_fds;
+  std::vector<int> fds;
+};
+
+TC_NAMESPACE_END
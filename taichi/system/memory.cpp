@@ -6,6 +6,11 @@
 #include <taichi/system/timer.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/embed.h>
+#if defined(TC_PLATFORM_UNIX)
+#include <sys/resource.h>
+#else
+#include <psapi.h>
+#endif
 
 TC_NAMESPACE_BEGIN
 
@@ -37,6 +42,18 @@ uint64 get_memory_usage(int pid) {
   return locals["mem"].cast<int64>();
 }
 
+uint64 get_num_page_faults() {
+#if defined(TC_PLATFORM_UNIX)
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (uint64)usage.ru_minflt + (uint64)usage.ru_majflt;
+#else
+  PROCESS_MEMORY_COUNTERS counters;
+  GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+  return counters.PageFaultCount;
+#endif
+}
+
 MemoryMonitor::MemoryMonitor(int pid, std::string output_fn) {
   log.open(output_fn, std::ios_base::out);
   locals = new py::dict;
@@ -4,8 +4,14 @@
 *******************************************************************************/
 
 #include <algorithm>
+#include <chrono>
 #include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <taichi/system/benchmark.h>
 #include <taichi/system/threading.h>
+#include <taichi/system/timeline.h>
+#include <taichi/system/timer.h>
 #include <thread>
 #include <vector>
 #if defined(TC_PLATFORM_WINDOWS)
@@ -14,7 +20,11 @@
 // Mac and Linux
 #include "threading.h"
 #include <unistd.h>
-
+#if defined(TC_PLATFORM_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
 #endif
 
 TC_NAMESPACE_BEGIN
@@ -37,6 +47,14 @@ bool test_threading() {
   return true;
 }
 
+static int get_thread_tid() {
+#if defined(TC_PLATFORM_LINUX)
+  return (int)syscall(SYS_gettid);
+#else
+  return 0;
+#endif
+}
+
 int PID::get_pid() {
 #if defined(TC_PLATFORM_WINDOWS)
   return (int)GetCurrentProcessId();
@@ -54,98 +72,325 @@ int PID::get_parent_pid() {
 #endif
 }
 
+void WorkerQueue::reset(int begin, int end) {
+  range = (uint64)(uint32)begin | ((uint64)(uint32)end << 32);
+}
+
+bool WorkerQueue::pop_front(int &task) {
+  uint64 r = range.load();
+  while (true) {
+    int begin = (int)(uint32)r, end = (int)(r >> 32);
+    if (begin >= end)
+      return false;
+    auto new_range = (uint64)(uint32)(begin + 1) | (r & ~(uint64)0xffffffff);
+    if (range.compare_exchange_weak(r, new_range)) {
+      task = begin;
+      return true;
+    }
+  }
+}
+
+bool WorkerQueue::steal_back(int &begin, int &end) {
+  uint64 r = range.load();
+  while (true) {
+    int b = (int)(uint32)r, e = (int)(r >> 32);
+    if (b >= e)
+      return false;
+    int mid = b + (e - b) / 2;
+    auto new_range = (uint64)(uint32)b | ((uint64)(uint32)mid << 32);
+    if (range.compare_exchange_weak(r, new_range)) {
+      begin = mid;
+      end = e;
+      return true;
+    }
+  }
+}
+
 ThreadPool::ThreadPool() {
   exiting = false;
-  started = false;
-  running_threads = 0;
-  timestamp = 0;
-  task_head = 0;
-  task_tail = 0;
-  thread_counter = 0;
-  max_num_threads = std::thread::hardware_concurrency();
-  threads.resize((std::size_t)max_num_threads);
+  epoch = 0;
+  num_waiting_callers = 0;
+  spin_window_us = 0;
+  count_dispatch_cycles = false;
+  dispatch_cycles = 0;
+  thread_limit = 0;
+  owner = std::this_thread::get_id();
+  max_num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+  threads.resize((std::size_t)max_num_threads - 1);
+  thread_tids.assign(max_num_threads, 0);
+  thread_tids[0] = get_thread_tid();
+  std::atomic<int> num_started(0);
+  for (int i = 0; i < (int)threads.size(); i++) {
+    threads[i] = std::thread([this, i, &num_started] {
+      thread_tids[i + 1] = get_thread_tid();
+      num_started++;
+      this->target(i + 1);
+    });
+  }
+  // So that thread_tids is complete once the pool is constructed
+  while (num_started.load() < (int)threads.size())
+    std::this_thread::yield();
+}
+
+#if defined(TC_PLATFORM_LINUX)
+// Parses a sysfs cpu list such as "0-15,32-47"
+static std::vector<int> parse_cpu_list(const std::string &list) {
+  std::vector<int> cpus;
+  std::size_t pos = 0;
+  while (pos < list.size()) {
+    auto next = list.find(',', pos);
+    if (next == std::string::npos)
+      next = list.size();
+    auto item = list.substr(pos, next - pos);
+    auto dash = item.find('-');
+    int begin = std::stoi(item);
+    int end =
+        dash == std::string::npos ? begin : std::stoi(item.substr(dash + 1));
+    for (int i = begin; i <= end; i++)
+      cpus.push_back(i);
+    pos = next + 1;
+  }
+  return cpus;
+}
+#endif
+
+void ThreadPool::pin_threads() {
+#if defined(TC_PLATFORM_LINUX)
+  std::vector<int> cpus, nodes;
+  for (int node = 0;; node++) {
+    std::ifstream fs(
+        fmt::format("/sys/devices/system/node/node{}/cpulist", node));
+    std::string list;
+    if (!fs || !std::getline(fs, list))
+      break;
+    for (auto cpu : parse_cpu_list(list)) {
+      cpus.push_back(cpu);
+      nodes.push_back(node);
+    }
+  }
+  if (cpus.empty()) {
+    // No NUMA information: a single node of all cores
+    for (int i = 0; i < max_num_threads; i++) {
+      cpus.push_back(i);
+      nodes.push_back(0);
+    }
+  }
+  thread_nodes.resize(max_num_threads);
   for (int i = 0; i < max_num_threads; i++) {
-    threads[i] = std::thread([this] { this->target(); });
+    int k = i % (int)cpus.size();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[k], &set);
+    auto handle = i == 0 ? pthread_self() : threads[i - 1].native_handle();
+    if (pthread_setaffinity_np(handle, sizeof(set), &set) != 0)
+      TC_WARN("Failed to pin thread {} to core {}", i, cpus[k]);
+    thread_nodes[i] = nodes[k];
   }
+#else
+  TC_WARN("Thread pinning is only supported on Linux.");
+#endif
 }
 
+struct FirstTouchContext {
+  char *ptr;
+  std::size_t size;
+  int num_splits;
+};
+
+void ThreadPool::first_touch(void *ptr, std::size_t size) {
+  FirstTouchContext ctx{(char *)ptr, size, max_num_threads};
+  run(max_num_threads, max_num_threads, &ctx, [](void *c, int i) {
+    auto ctx = (FirstTouchContext *)c;
+    auto begin = ctx->size * i / ctx->num_splits;
+    auto end = ctx->size * (i + 1) / ctx->num_splits;
+    // The memory is freshly mapped and thus zero
+    std::memset(ctx->ptr + begin, 0, end - begin);
+  });
+}
+
+// Regions the current thread is working on
+static thread_local int run_depth = 0;
+
 void ThreadPool::run(int splits,
                      int desired_num_threads,
                      void *context,
                      CPUTaskFunc *func) {
+  bool counted = count_dispatch_cycles && run_depth == 0 &&
+                 std::this_thread::get_id() == owner;
+  uint64 begin_cycles = counted ? Time::get_cycles() : 0;
+  int n = std::min(desired_num_threads, max_num_threads);
+  if (thread_limit > 0 && run_depth == 0 &&
+      std::this_thread::get_id() == owner)
+    n = std::min(n, thread_limit);
+  TC_ASSERT(n > 0);
+  ParallelRegion region;
+  region.func = func;
+  region.context = context;
+  region.num_threads = n;
+  region.queues = std::vector<WorkerQueue>((std::size_t)n);
+  // Contiguous initial partitions keep neighboring splits on one worker
+  for (int i = 0; i < n; i++) {
+    region.queues[i].reset((int)((int64)splits * i / n),
+                           (int)((int64)splits * (i + 1) / n));
+  }
+  region.slot_taken.assign(n, 0);
+  region.slot_taken[0] = 1;
+  region.num_joined = 0;
+  region.num_left = 0;
+  if (n == 1) {
+    run_depth++;
+    work(&region, 0);
+    run_depth--;
+    return;
+  }
+
   {
     std::lock_guard _(mutex);
-    this->context = context;
-    this->func = func;
-    this->desired_num_threads = std::min(desired_num_threads, max_num_threads);
-    TC_ASSERT(this->desired_num_threads > 0);
-    // TC_P(this->desired_num_threads);
-    started = false;
-    task_head = 0;
-    task_tail = splits;
-    timestamp++;
-  }
-
-  // wake up all slaves
+    regions.push_back(&region);
+    epoch++;
+  }
+  // Spinning workers pick up the new epoch by themselves, the parked ones
+  // are woken up here
   slave_cv.notify_all();
+
+  uint64 work_begin = counted ? Time::get_cycles() : 0;
+  run_depth++;
+  work(&region, 0);
+  run_depth--;
+  uint64 work_end = counted ? Time::get_cycles() : 0;
+
   {
-    std::unique_lock<std::mutex> lock(mutex);
-    // TODO: the workers may have finished before master waiting on master_cv
-    master_cv.wait(lock, [this] {
-      return started && running_threads == 0;
-    });
+    std::lock_guard _(mutex);
+    regions.erase(std::find(regions.begin(), regions.end(), &region));
+  }
+  wait_for_workers(region);
+  if (counted) {
+    dispatch_cycles +=
+        (work_begin - begin_cycles) + (Time::get_cycles() - work_end);
   }
-  TC_ASSERT(task_head == task_tail);
 }
 
-void ThreadPool::target() {
-  uint64 last_timestamp = 0;
-  int thread_id;
-  {
-    std::lock_guard<std::mutex> lock(mutex);
-    thread_id = thread_counter++;
+void ThreadPool::wait_for_workers(ParallelRegion &region) {
+  // No worker joins any more. The joined ones are busy with their last
+  // tasks: spin for a while before sleeping.
+  int num_joined = region.num_joined;
+  constexpr int num_spins = 4096;
+  for (int i = 0; i < num_spins; i++) {
+    if (region.num_left.load() == num_joined)
+      return;
+    std::this_thread::yield();
   }
-  while (true) {
-    {
-      std::unique_lock<std::mutex> lock(mutex);
-      slave_cv.wait(lock, [this, last_timestamp, thread_id] {
-        return (timestamp > last_timestamp &&
-                thread_id < desired_num_threads) ||
-               this->exiting;
-      });
-      last_timestamp = timestamp;
-      if (exiting) {
-        break;
-      } else {
-        started = true;
-        running_threads++;
+  std::unique_lock<std::mutex> lock(mutex);
+  num_waiting_callers++;
+  master_cv.wait(lock, [&] { return region.num_left.load() == num_joined; });
+  num_waiting_callers--;
+}
+
+bool ThreadPool::get_task(ParallelRegion *region, int slot, int &task) {
+  auto &queues = region->queues;
+  int num_slots = region->num_threads;
+  if (queues[slot].pop_front(task))
+    return true;
+  // With pinned threads, steal from the same NUMA node first
+  int num_passes = thread_nodes.empty() ? 1 : 2;
+  for (int pass = 0; pass < num_passes; pass++) {
+    for (int i = 1; i < num_slots; i++) {
+      int victim = (slot + i) % num_slots;
+      if (num_passes == 2 &&
+          (thread_nodes[victim] == thread_nodes[slot]) != (pass == 0))
+        continue;
+      int begin, end;
+      if (queues[victim].steal_back(begin, end)) {
+        // Run the first stolen task and make the rest stealable again
+        queues[slot].reset(begin + 1, end);
+        task = begin;
+        return true;
       }
     }
+  }
+  return false;
+}
 
-    while (true) {
-      // For a single parallel task
-      int task_id;
-      {
+void ThreadPool::work(ParallelRegion *region, int slot) {
+  Timeline::Guard _("work", "thread_pool");
+  int task_id;
+  while (get_task(region, slot, task_id)) {
+    region->func(region->context, task_id);
+  }
+}
+
+bool ThreadPool::wait_for_regions(uint64 last_epoch) {
+  int window_us = spin_window_us;
+  if (window_us > 0) {
+    auto start = std::chrono::steady_clock::now();
+    auto window = std::chrono::microseconds(window_us);
+    for (int i = 1;; i++) {
+      if (exiting)
+        return false;
+      if (epoch.load() != last_epoch)
+        return true;
+      // Reading the clock is slower than polling the epoch
+      if (i % 64 == 0 && std::chrono::steady_clock::now() - start > window)
+        break;
+      std::this_thread::yield();
+    }
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  slave_cv.wait(lock, [&] { return exiting || epoch.load() != last_epoch; });
+  return !exiting;
+}
+
+ParallelRegion *ThreadPool::join_region(int thread_id, uint64 &last_epoch) {
+  std::lock_guard<std::mutex> lock(mutex);
+  last_epoch = epoch;
+  for (auto region : regions) {
+    if (thread_id < region->num_threads && !region->slot_taken[thread_id]) {
+      region->slot_taken[thread_id] = 1;
+      region->num_joined++;
+      return region;
+    }
+  }
+  return nullptr;
+}
+
+void ThreadPool::target(int thread_id) {
+  uint64 last_epoch = 0;
+  while (wait_for_regions(last_epoch)) {
+    while (auto region = join_region(thread_id, last_epoch)) {
+      work(region, thread_id);
+      // The region may be gone right after this
+      region->num_left++;
+      if (num_waiting_callers.load() > 0) {
+        // Lock so that the notification cannot slip in between a caller's
+        // check of its predicate and its wait
         std::lock_guard<std::mutex> lock(mutex);
-        task_id = task_head;
-        if (task_id >= task_tail)
-          break;
-        task_head++;
+        master_cv.notify_all();
       }
-      func(context, task_id);
     }
+  }
+}
+
+// Seconds per ThreadPool::run of empty tasks, one per thread
+class ThreadPoolLaunchBenchmark : public Benchmark {
+  std::unique_ptr<ThreadPool> pool;
+  int num_threads;
 
-    bool all_finished = false;
-    {
-      std::lock_guard<std::mutex> lock(mutex);
-      running_threads--;
-      if (running_threads == 0)
-        all_finished = true;
+ public:
+  void initialize(const Config &config) override {
+    Benchmark::initialize(config);
+    returns_time = true;
+    pool = std::make_unique<ThreadPool>();
+    num_threads = config.get("num_threads", pool->max_num_threads);
+  }
+
+  void iterate() override {
+    for (int64 i = 0; i < workload; i++) {
+      pool->run(num_threads, num_threads, nullptr, [](void *, int) {});
     }
-    if (all_finished)
-      master_cv.notify_one();
   }
-}
+};
+
+TC_IMPLEMENTATION(Benchmark, ThreadPoolLaunchBenchmark, "thread_pool_launch");
 
 ThreadPool::~ThreadPool() {
   {
@@ -22,26 +22,83 @@ class PID {
   static int get_parent_pid();
 };
 
+// The tasks [begin, end) not yet claimed by a worker, packed as
+// begin | end << 32 so that the owner (popping from the front) and thieves
+// (taking the back half) can both claim tasks with a single CAS
+struct alignas(64) WorkerQueue {
+  std::atomic<uint64> range;
+
+  WorkerQueue() {
+    range = 0;
+  }
+
+  void reset(int begin, int end);
+
+  bool pop_front(int &task);
+
+  bool steal_back(int &begin, int &end);
+};
+
+// The splits of one ThreadPool::run. The calling thread works on slot 0,
+// while worker i may join as slot i. Tasks of slots nobody joined are
+// stolen.
+struct ParallelRegion {
+  CPUTaskFunc *func;
+  void *context;
+  int num_threads;
+  std::vector<WorkerQueue> queues;
+  // Guarded by the pool mutex
+  std::vector<char> slot_taken;
+  std::atomic<int> num_joined;
+  std::atomic<int> num_left;
+};
+
+// Several regions can be in flight at once: run() may be called from
+// different threads, and from tasks of another region. The thread calling
+// run() works on its region, so the pool spawns max_num_threads - 1 workers.
 class ThreadPool {
  public:
   std::vector<std::thread> threads;
   std::condition_variable slave_cv;
   std::condition_variable master_cv;
   std::mutex mutex;
-  int task_head;
-  int task_tail;
-  int running_threads;
+  // The regions workers can join, guarded by mutex
+  std::vector<ParallelRegion *> regions;
+  // Bumped whenever a region is published
+  std::atomic<uint64> epoch;
+  std::atomic<int> num_waiting_callers;
+  std::atomic<bool> exiting;
   int max_num_threads;
-  int desired_num_threads;
-  uint64 timestamp;
-  bool started;
-  bool exiting;
-  CPUTaskFunc *func;
-  void *context;
-  int thread_counter;
+  // How long idle workers spin on epoch before parking on slave_cv
+  std::atomic<int> spin_window_us;
+  // NUMA node of each thread, empty unless the threads are pinned
+  std::vector<int> thread_nodes;
+  // OS thread ids (Linux only, 0 elsewhere), thread 0 being the one that
+  // created the pool
+  std::vector<int> thread_tids;
+  // With count_dispatch_cycles, the cycles (Time::get_cycles) that runs
+  // called outside of any task by the thread that created the pool spend
+  // apart from its own tasks: publishing, waking up and waiting for workers
+  bool count_dispatch_cycles;
+  uint64 dispatch_cycles;
+  // If positive, the most threads of the runs called outside of any task by
+  // the thread that created the pool, e.g. while the thread count of a task
+  // is tuned
+  int thread_limit;
+  std::thread::id owner;
 
   ThreadPool();
 
+  // Pins thread i to the i-th core, numbering the cores NUMA node by node.
+  // With the contiguous initial partitions of run(), a split then stays on
+  // the same core (and node) across regions of the same size.
+  void pin_threads();
+
+  // Touches the pages of [ptr, ptr + size) from the threads whose initial
+  // partitions of a max_num_threads-way region cover them, so that the OS
+  // places them on the NUMA nodes of those threads
+  void first_touch(void *ptr, std::size_t size);
+
   void run(int splits,
            int desired_num_threads,
            void *context,
@@ -55,7 +112,23 @@ class ThreadPool {
     return pool->run(splits, desired_num_threads, context, func);
   }
 
-  void target();
+  void target(int thread_id);
+
+  // Waits until a region is published after last_epoch. Returns false when
+  // the pool is exiting.
+  bool wait_for_regions(uint64 last_epoch);
+
+  // Takes slot thread_id of a published region, and records the epoch seen
+  ParallelRegion *join_region(int thread_id, uint64 &last_epoch);
+
+  // Runs tasks of region until none is left
+  void work(ParallelRegion *region, int slot);
+
+  // Waits until the workers that joined region have left it
+  void wait_for_workers(ParallelRegion &region);
+
+  // Claims a task from the queue of slot, or steals from another slot
+  bool get_task(ParallelRegion *region, int slot, int &task);
 
   ~ThreadPool();
 };
@@ -0,0 +1,94 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#include <fstream>
+#include <taichi/system/timeline.h>
+
+TC_NAMESPACE_BEGIN
+
+namespace {
+
+// Small thread ids in the order threads first record an event
+int get_tid() {
+  static std::atomic<int> num_threads(0);
+  thread_local int tid = num_threads++;
+  return tid;
+}
+
+std::string json_escape(const std::string &s) {
+  std::string ret;
+  for (auto c : s) {
+    if (c == '"' || c == '\\')
+      ret.push_back('\\');
+    ret.push_back(c);
+  }
+  return ret;
+}
+
+}  // namespace
+
+Timeline::Guard::Guard(const std::string &name, const char *category) {
+  auto &timeline = Timeline::get_instance();
+  active = timeline.enabled;
+  if (active) {
+    this->name = name;
+    this->category = category;
+    begin = timeline.get_time();
+  }
+}
+
+Timeline::Guard::~Guard() {
+  if (active) {
+    auto &timeline = Timeline::get_instance();
+    timeline.insert(
+        {std::move(name), category, begin, timeline.get_time(), get_tid()});
+  }
+}
+
+Timeline::Timeline() {
+  enabled = false;
+  start_time = std::chrono::steady_clock::now();
+}
+
+Timeline &Timeline::get_instance() {
+  static Timeline timeline;
+  return timeline;
+}
+
+double Timeline::get_time() const {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - start_time)
+      .count();
+}
+
+void Timeline::insert(Event &&event) {
+  std::lock_guard<std::mutex> _(mut);
+  events.push_back(std::move(event));
+}
+
+void Timeline::clear() {
+  std::lock_guard<std::mutex> _(mut);
+  events.clear();
+}
+
+void Timeline::save(const std::string &fn) {
+  std::lock_guard<std::mutex> _(mut);
+  std::ofstream fout(fn);
+  TC_ERROR_UNLESS(fout, "Failed to write timeline {}", fn);
+  fout << "{\"traceEvents\": [";
+  for (int i = 0; i < (int)events.size(); i++) {
+    auto &e = events[i];
+    // Complete events, with their duration
+    fout << (i ? ",\n" : "\n")
+         << fmt::format(
+                "{{\"name\": \"{}\", \"cat\": \"{}\", \"ph\": \"X\", "
+                "\"ts\": {:.3f}, \"dur\": {:.3f}, \"pid\": 0, \"tid\": {}}}",
+                json_escape(e.name), e.category, e.begin, e.end - e.begin,
+                e.tid);
+  }
+  fout << "\n]}\n";
+}
+
+TC_NAMESPACE_END
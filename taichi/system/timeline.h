@@ -0,0 +1,66 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <taichi/common/util.h>
+
+TC_NAMESPACE_BEGIN
+
+// Records when kernel launches, offloaded tasks, compilation, host-device
+// copies and thread pool work happen, on which thread, to be saved in the
+// Chrome trace event format (chrome://tracing, https://ui.perfetto.dev)
+class Timeline {
+ public:
+  struct Event {
+    std::string name;
+    const char *category;
+    // Microseconds since the timeline was created
+    double begin, end;
+    int tid;
+  };
+
+  // Records the lifetime of the guard as an event, if the timeline is enabled
+  class Guard {
+   public:
+    Guard(const std::string &name, const char *category);
+
+    ~Guard();
+
+   private:
+    bool active;
+    std::string name;
+    const char *category;
+    double begin;
+  };
+
+  // Checked before recording anything, so that a disabled timeline costs
+  // nothing but this load
+  std::atomic<bool> enabled;
+
+  static Timeline &get_instance();
+
+  double get_time() const;
+
+  void insert(Event &&event);
+
+  void clear();
+
+  void save(const std::string &fn);
+
+ private:
+  Timeline();
+
+  std::chrono::steady_clock::time_point start_time;
+  std::mutex mut;
+  std::vector<Event> events;
+};
+
+TC_NAMESPACE_END
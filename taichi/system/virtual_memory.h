@@ -4,6 +4,8 @@
 
 #if defined(TC_PLATFORM_UNIX)
 #include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #else
 #include <windows.h>
 #endif
@@ -14,6 +16,7 @@ TC_NAMESPACE_BEGIN
 class VirtualMemoryAllocator {
  public:
   static constexpr size_t page_size = (1 << 12);  // 4 KB page size by default
+  static constexpr size_t huge_page_size = (1 << 21);  // 2 MB
   void *ptr;
   size_t size;
   explicit VirtualMemoryAllocator(size_t size) : size(size) {
@@ -41,6 +44,32 @@ class VirtualMemoryAllocator {
                 page_size);
   }
 
+  // Asks the OS to back the memory with (transparent) huge pages. Only
+  // huge-page-aligned ranges benefit.
+  void advise_huge_pages(bool enable) {
+#if defined(TC_PLATFORM_LINUX)
+    TC_WARN_IF(madvise(ptr, size, enable ? MADV_HUGEPAGE : MADV_NOHUGEPAGE),
+               "Failed to advise huge pages");
+#else
+    // Windows large pages must be locked and committed at allocation time,
+    // which does not fit a reserved pool of this size
+    TC_WARN_IF(enable, "Huge pages are only supported on Linux.");
+#endif
+  }
+
+  // Returns the pages of [begin, begin + size) to the OS. They read as zero
+  // when touched again. begin and size must be page-aligned.
+  void discard(void *begin, size_t size) {
+#if defined(TC_PLATFORM_UNIX)
+    TC_ERROR_IF(madvise(begin, size, MADV_DONTNEED) != 0,
+                "Failed to discard virtual memory ({} B)", size);
+#else
+    TC_ERROR_IF(!VirtualFree(begin, size, MEM_DECOMMIT) ||
+                    !VirtualAlloc(begin, size, MEM_COMMIT, PAGE_READWRITE),
+                "Failed to discard virtual memory ({} B)", size);
+#endif
+  }
+
   ~VirtualMemoryAllocator() {
 #if defined(TC_PLATFORM_UNIX)
     if (munmap(ptr, size) != 0)
@@ -53,8 +82,112 @@ class VirtualMemoryAllocator {
   }
 };
 
+// Maps a file over [ptr, ptr + size), a page-aligned part of a reserved
+// range, so that its pages are read from the file when first touched and
+// written back to it when evicted. The anonymous (zero) pages return when
+// the mapping is destroyed.
+class FileBackedRange {
+ public:
+  char *ptr;
+  size_t size;
+  int fd;
+
+  FileBackedRange(const std::string &filename, void *ptr, size_t size)
+      : ptr((char *)ptr), size(size) {
+#if defined(TC_PLATFORM_UNIX)
+    TC_ERROR_IF((uint64_t)ptr % VirtualMemoryAllocator::page_size ||
+                    size % VirtualMemoryAllocator::page_size,
+                "File-backed memory must be page-aligned");
+    fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    TC_ERROR_IF(fd < 0, "Failed to open {}", filename);
+    // Grow (never shrink) the file to the size of the range
+    if (lseek(fd, 0, SEEK_END) < (off_t)size)
+      TC_ERROR_IF(ftruncate(fd, size) != 0, "Failed to resize {} to {} B",
+                  filename, size);
+    TC_ERROR_IF(mmap(ptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                     fd, 0) == MAP_FAILED,
+                "Failed to map {} ({} B)", filename, size);
+#else
+    TC_ERROR("File-backed memory is only supported on Unix.");
+#endif
+  }
+
+  // Starts reading the pages of [begin, begin + size) from the file
+  void prefetch(void *begin, size_t size) {
+#if defined(TC_PLATFORM_UNIX)
+    auto range = page_range(begin, size);
+    madvise(range.first, range.second, MADV_WILLNEED);
+#endif
+  }
+
+  // Writes the pages of [begin, begin + size) back to the file and drops
+  // them from memory. They are read again when touched.
+  void evict(void *begin, size_t size) {
+#if defined(TC_PLATFORM_UNIX)
+    auto range = page_range(begin, size);
+    TC_ERROR_IF(msync(range.first, range.second, MS_SYNC) != 0 ||
+                    madvise(range.first, range.second, MADV_DONTNEED) != 0,
+                "Failed to evict file-backed memory ({} B)", range.second);
+#endif
+  }
+
+  ~FileBackedRange() {
+#if defined(TC_PLATFORM_UNIX)
+    msync(ptr, size, MS_SYNC);
+    if (mmap(ptr, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1,
+             0) == MAP_FAILED)
+      TC_ERROR("Failed to unmap file-backed memory ({} B)", size);
+    close(fd);
+#endif
+  }
+
+ private:
+  // The pages overlapping [begin, begin + size), within the range
+  std::pair<char *, size_t> page_range(void *begin, size_t size) {
+    auto page = VirtualMemoryAllocator::page_size;
+    auto first = std::max(ptr, (char *)begin - (uint64_t)begin % page);
+    auto end = std::min(ptr + this->size,
+                        (char *)begin + size + (page - 1) -
+                            ((uint64_t)begin + size + page - 1) % page);
+    return {first, end > first ? (size_t)(end - first) : 0};
+  }
+};
+
+// A whole file mapped read-only, so that its pages are read from the disk
+// only as they are touched, without copies through a buffer
+class MappedFile {
+ public:
+  void *ptr;
+  size_t size;
+
+  explicit MappedFile(const std::string &filename) {
+#if defined(TC_PLATFORM_UNIX)
+    int fd = open(filename.c_str(), O_RDONLY);
+    TC_ERROR_IF(fd < 0, "Failed to open {}", filename);
+    size = (size_t)lseek(fd, 0, SEEK_END);
+    TC_ERROR_IF(size == 0, "{} is empty", filename);
+    ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    TC_ERROR_IF(ptr == MAP_FAILED, "Failed to map {} ({} B)", filename, size);
+#else
+    TC_ERROR("Mapped files are only supported on Unix.");
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+
+  ~MappedFile() {
+#if defined(TC_PLATFORM_UNIX)
+    munmap(ptr, size);
+#endif
+  }
+};
+
 float64 get_memory_usage_gb(int pid = -1);
 uint64 get_memory_usage(int pid = -1);
+// Minor and major page faults of this process so far
+uint64 get_num_page_faults();
 
 #define TC_MEMORY_USAGE(name) \
   TC_DEBUG("Memory Usage [{}] = {:.2f} GB", name, get_memory_usage_gb());
@@ -8,6 +8,7 @@
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InlineAsm.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
@@ -15,6 +16,7 @@
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Host.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Transforms/InstCombine/InstCombine.h"
@@ -22,35 +24,53 @@
 #include "llvm/Transforms/Scalar/GVN.h"
 #include "llvm/Transforms/Utils.h"
 #include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include <llvm/Linker/Linker.h>
 #include <llvm/Demangle/Demangle.h>
+#include <xxhash.h>
+#include <map>
+#include <mutex>
+#include <set>
 
 #include "tlang_util.h"
 #include "taichi_llvm_context.h"
 #include "backends/llvm_jit.h"
+#include "backends/llvm_source_lines.h"
 
 TLANG_NAMESPACE_BEGIN
 
 static llvm::ExitOnError exit_on_err;
 
+namespace {
+// Process-wide LLVM state is set up once, even if programs are created on
+// several threads
+std::once_flag llvm_initialized, x86_64_initialized, nvptx_initialized;
+}  // namespace
+
 TaichiLLVMContext::TaichiLLVMContext(Arch arch) : arch(arch) {
-  llvm::remove_fatal_error_handler();
-  llvm::install_fatal_error_handler(
-      [](void *user_data, const std::string &reason, bool gen_crash_diag) {
-        TC_ERROR("LLVM Fatal Error: {}", reason);
-      },
-      nullptr);
+  std::call_once(llvm_initialized, [] {
+    llvm::remove_fatal_error_handler();
+    llvm::install_fatal_error_handler(
+        [](void *user_data, const std::string &reason, bool gen_crash_diag) {
+          TC_ERROR("LLVM Fatal Error: {}", reason);
+        },
+        nullptr);
+  });
 
   if (arch == Arch::x86_64) {
-    llvm::InitializeNativeTarget();
-    llvm::InitializeNativeTargetAsmPrinter();
-    llvm::InitializeNativeTargetAsmParser();
+    std::call_once(x86_64_initialized, [] {
+      llvm::InitializeNativeTarget();
+      llvm::InitializeNativeTargetAsmPrinter();
+      llvm::InitializeNativeTargetAsmParser();
+    });
   } else {
 #if defined(TLANG_WITH_CUDA)
-    LLVMInitializeNVPTXTarget();
-    LLVMInitializeNVPTXTargetMC();
-    LLVMInitializeNVPTXTargetInfo();
-    LLVMInitializeNVPTXAsmPrinter();
+    std::call_once(nvptx_initialized, [] {
+      LLVMInitializeNVPTXTarget();
+      LLVMInitializeNVPTXTargetMC();
+      LLVMInitializeNVPTXTargetInfo();
+      LLVMInitializeNVPTXAsmPrinter();
+    });
 #else
     TC_NOT_IMPLEMENTED
 #endif
@@ -63,15 +83,63 @@ TaichiLLVMContext::TaichiLLVMContext(Arch arch) : arch(arch) {
 TaichiLLVMContext::~TaichiLLVMContext() {
 }
 
+namespace {
+std::mutex recycled_contexts_mutex;
+std::map<Arch, std::unique_ptr<TaichiLLVMContext>> recycled_contexts;
+}  // namespace
+
+std::unique_ptr<TaichiLLVMContext> TaichiLLVMContext::acquire(Arch arch) {
+  std::unique_ptr<TaichiLLVMContext> context;
+  {
+    std::lock_guard<std::mutex> _(recycled_contexts_mutex);
+    auto it = recycled_contexts.find(arch);
+    if (it != recycled_contexts.end()) {
+      context = std::move(it->second);
+      recycled_contexts.erase(it);
+    }
+  }
+  if (!context)
+    return std::make_unique<TaichiLLVMContext>(arch);
+  context->reset();
+  return context;
+}
+
+void TaichiLLVMContext::recycle(std::unique_ptr<TaichiLLVMContext> context) {
+  if (context) {
+    auto arch = context->arch;
+    std::lock_guard<std::mutex> _(recycled_contexts_mutex);
+    recycled_contexts[arch] = std::move(context);
+  }
+}
+
+void TaichiLLVMContext::reset() {
+  // The kernels of the last program may refer to the struct module
+  jit = exit_on_err(TaichiLLVMJIT::create(arch));
+  struct_module.reset();
+  struct_module_hash.clear();
+  snode_attr = SNodeAttributes();
+  compiled_tasks.clear();
+}
+
+void TaichiLLVMContext::set_source_profiler(SourceProfiler *profiler) {
+  jit->on_object_loaded =
+      [profiler](const llvm::object::ObjectFile &obj,
+                 const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+        profiler->add_lines(read_source_lines(obj, info));
+      };
+}
+
 llvm::Type *TaichiLLVMContext::get_data_type(DataType dt) {
-  if (dt == DataType::i32) {
+  if (dt == DataType::i32 || dt == DataType::u32) {
     return llvm::Type::getInt32Ty(*ctx);
   } else if (dt == DataType::i8) {
     return llvm::Type::getInt8Ty(*ctx);
   } else if (dt == DataType::i16) {
     return llvm::Type::getInt16Ty(*ctx);
-  } else if (dt == DataType::i64) {
+  } else if (dt == DataType::i64 || dt == DataType::u64) {
     return llvm::Type::getInt64Ty(*ctx);
+  } else if (dt == DataType::f16) {
+    return llvm::Type::getHalfTy(*ctx);
   } else if (dt == DataType::f32) {
     return llvm::Type::getFloatTy(*ctx);
   } else if (dt == DataType::f64) {
@@ -93,25 +161,70 @@ std::string find_existing_command(const std::vector<std::string> &commands) {
   TC_ERROR("No command found.");
 }
 
+std::vector<std::string> get_host_cpu_features() {
+  std::vector<std::string> features;
+  llvm::StringMap<bool> host_features;
+  if (llvm::sys::getHostCPUFeatures(host_features)) {
+    for (auto &f : host_features) {
+      features.push_back((f.second ? "+" : "-") + f.first().str());
+    }
+  }
+  return features;
+}
+
+// The x86_64 runtime is built for a few ISA levels, so that its functions
+// use the vector instructions of the host. Pairs of file name suffixes and
+// clang -march values.
+const std::vector<std::pair<std::string, std::string>> x86_64_isa_levels = {
+    {"", "x86-64"},
+    {"_avx2", "haswell"},
+    {"_avx512", "skylake-avx512"}};
+
+// Index into x86_64_isa_levels
+int host_x86_64_isa_level() {
+  llvm::StringMap<bool> features;
+  if (!llvm::sys::getHostCPUFeatures(features))
+    return 0;
+  auto has = [&](const std::string &name) {
+    return features.count(name) && features[name];
+  };
+  if (has("avx512f") && has("avx512vl") && has("avx512bw") && has("avx512dq"))
+    return 2;
+  if (has("avx2") && has("fma") && has("bmi2"))
+    return 1;
+  return 0;
+}
+
+std::string get_runtime_fn(Arch arch, int isa_level) {
+  auto suffix = arch == Arch::x86_64 ? x86_64_isa_levels[isa_level].first : "";
+  return fmt::format("runtime_{}{}.bc", arch_name(arch), suffix);
+}
+
 std::string get_runtime_fn(Arch arch) {
-  return fmt::format("runtime_{}.bc", arch_name(arch));
+  return get_runtime_fn(
+      arch, arch == Arch::x86_64 ? host_x86_64_isa_level() : 0);
 }
 
 std::string get_runtime_dir() {
   return get_repo_dir() + "/taichi/runtime/";
 }
 
-void compile_runtime_bitcode(Arch arch) {
+void compile_runtime_bitcode(Arch arch, int isa_level) {
   if (is_release())
     return;
   TI_AUTO_PROF;
-  static std::set<int> runtime_compiled;
-  if (runtime_compiled.find((int)arch) == runtime_compiled.end()) {
+  static std::mutex mut;
+  static std::set<std::string> runtime_compiled;
+  std::lock_guard<std::mutex> _(mut);
+  auto fn = get_runtime_fn(arch, isa_level);
+  if (runtime_compiled.find(fn) == runtime_compiled.end()) {
     auto clang = find_existing_command({"clang-7", "clang"});
     TC_ASSERT(command_exist("llvm-as"));
     TC_TRACE("Compiling runtime module bitcode...");
     auto runtime_folder = get_runtime_dir();
     std::string macro = fmt::format(" -D ARCH_{} ", arch_name(arch));
+    if (arch == Arch::x86_64)
+      macro += "-march=" + x86_64_isa_levels[isa_level].second + " ";
     int ret = std::system(
         fmt::format(
             "{} -S {}runtime.cpp -o {}runtime.ll -emit-llvm -std=c++17 {}",
@@ -121,14 +234,21 @@ void compile_runtime_bitcode(Arch arch) {
       TC_ERROR("Runtime compilation failed.");
     }
     std::system(fmt::format("llvm-as {}runtime.ll -o {}{}", runtime_folder,
-                            runtime_folder, get_runtime_fn(arch))
+                            runtime_folder, fn)
                     .c_str());
-    runtime_compiled.insert((int)arch);
+    runtime_compiled.insert(fn);
   }
 }
 
+void compile_runtime_bitcode(Arch arch) {
+  compile_runtime_bitcode(
+      arch, arch == Arch::x86_64 ? host_x86_64_isa_level() : 0);
+}
+
+// Builds every runtime for the release, which picks one at load time
 void compile_runtimes() {
-  compile_runtime_bitcode(Arch::x86_64);
+  for (int i = 0; i < (int)x86_64_isa_levels.size(); i++)
+    compile_runtime_bitcode(Arch::x86_64, i);
 #if defined(TLANG_WITH_CUDA)
   compile_runtime_bitcode(Arch::gpu);
 #endif
@@ -153,12 +273,8 @@ std::unique_ptr<llvm::Module> TaichiLLVMContext::get_init_module() {
   return clone_runtime_module();
 }
 
-std::unique_ptr<llvm::Module> module_from_bitcode_file(std::string bitcode_path,
-                                                       llvm::LLVMContext *ctx) {
-  TI_AUTO_PROF
-  std::ifstream ifs(bitcode_path, std::ios::binary);
-  std::string bitcode(std::istreambuf_iterator<char>(ifs),
-                      (std::istreambuf_iterator<char>()));
+std::unique_ptr<llvm::Module> module_from_bitcode(const std::string &bitcode,
+                                                  llvm::LLVMContext *ctx) {
   auto runtime =
       parseBitcodeFile(MemoryBufferRef(bitcode, "runtime_bitcode"), *ctx);
   if (!runtime) {
@@ -167,17 +283,27 @@ std::unique_ptr<llvm::Module> module_from_bitcode_file(std::string bitcode_path,
     llvm::errs() << error << "\n";
     TC_ERROR("Runtime bitcode load failure.");
   }
+  return std::move(runtime.get());
+}
+
+std::unique_ptr<llvm::Module> module_from_bitcode_file(std::string bitcode_path,
+                                                       llvm::LLVMContext *ctx) {
+  TI_AUTO_PROF
+  std::ifstream ifs(bitcode_path, std::ios::binary);
+  std::string bitcode(std::istreambuf_iterator<char>(ifs),
+                      (std::istreambuf_iterator<char>()));
+  auto runtime = module_from_bitcode(bitcode, ctx);
 
-  for (auto &f : *(runtime.get())) {
+  for (auto &f : *runtime) {
     f.removeAttribute(AttributeList::FunctionIndex,
                       llvm::Attribute::OptimizeNone);
     f.removeAttribute(AttributeList::FunctionIndex, llvm::Attribute::NoInline);
     f.addAttribute(AttributeList::FunctionIndex, llvm::Attribute::AlwaysInline);
   }
 
-  bool module_broken = llvm::verifyModule(*runtime.get(), &llvm::errs());
+  bool module_broken = llvm::verifyModule(*runtime, &llvm::errs());
   TC_ERROR_IF(module_broken, "Module broken");
-  return std::move(runtime.get());
+  return runtime;
 }
 
 int num_instructions(llvm::Function *func) {
@@ -231,8 +357,27 @@ void remove_useless_libdevice_functions(llvm::Module *module) {
   module->getFunction("__internal_lgamma_pos")->eraseFromParent();
 }
 
+namespace {
+// The runtime module of each arch as prepared below, written to bitcode by
+// the first context that loads it. The modules of an LLVMContext cannot be
+// used in another, but parsing this is cheaper than loading the runtime from
+// scratch, which patches intrinsics and links libdevice on GPUs.
+std::mutex prepared_runtimes_mutex;
+std::map<Arch, std::shared_ptr<const std::string>> prepared_runtimes;
+}  // namespace
+
 std::unique_ptr<llvm::Module> TaichiLLVMContext::clone_runtime_module() {
   TI_AUTO_PROF
+  if (!runtime_module) {
+    std::shared_ptr<const std::string> prepared;
+    {
+      std::lock_guard<std::mutex> _(prepared_runtimes_mutex);
+      prepared = prepared_runtimes[arch];
+    }
+    if (prepared)
+      runtime_module = module_from_bitcode(*prepared, ctx.get());
+  }
+  // Contexts created at once may all prepare the runtime, which is harmless
   if (!runtime_module) {
     if (is_release()) {
       runtime_module = module_from_bitcode_file(
@@ -244,6 +389,13 @@ std::unique_ptr<llvm::Module> TaichiLLVMContext::clone_runtime_module() {
           fmt::format("{}/{}", get_runtime_dir(), get_runtime_fn(arch)),
           ctx.get());
     }
+    if (arch == Arch::x86_64) {
+      // Take the CPU and features of the kernels they are inlined into
+      for (auto &f : *runtime_module) {
+        f.removeFnAttr("target-cpu");
+        f.removeFnAttr("target-features");
+      }
+    }
     if (arch == Arch::gpu) {
       runtime_module->setTargetTriple("nvptx64-nvidia-cuda");
 
@@ -279,11 +431,51 @@ std::unique_ptr<llvm::Module> TaichiLLVMContext::clone_runtime_module() {
       // patch_intrinsic("warp_ballot", Intrinsic::nvvm_vote_ballot, false);
       // patch_intrinsic("warp_active_mask", Intrinsic::nvvm_membar_cta, false);
       patch_intrinsic("block_memfence", Intrinsic::nvvm_membar_cta, false);
+      patch_intrinsic("threadfence", Intrinsic::nvvm_membar_gl, false);
+
+      // Non-sync warp votes and shuffles, which PTX 5.0 provides on all
+      // architectures
+      auto patch_asm = [&](std::string name, std::string asm_string,
+                           std::string constraints) {
+        auto func = runtime_module->getFunction(name);
+        func->getEntryBlock().eraseFromParent();
+        auto bb = llvm::BasicBlock::Create(*ctx, "entry", func);
+        IRBuilder<> builder(*ctx);
+        builder.SetInsertPoint(bb);
+        std::vector<llvm::Value *> args;
+        for (auto &arg : func->args())
+          args.push_back(&arg);
+        auto asm_func = InlineAsm::get(func->getFunctionType(), asm_string,
+                                       constraints, true);
+        builder.CreateRet(builder.CreateCall(asm_func, args));
+        func->removeAttribute(AttributeList::FunctionIndex,
+                              llvm::Attribute::OptimizeNone);
+        func->removeAttribute(AttributeList::FunctionIndex,
+                              llvm::Attribute::NoInline);
+        func->addAttribute(AttributeList::FunctionIndex,
+                           llvm::Attribute::AlwaysInline);
+      };
+
+      patch_asm("warp_active_mask",
+                "{ .reg .pred p; setp.eq.s32 p, 1, 1; "
+                "vote.ballot.b32 $0, p; }",
+                "=r");
+      patch_asm("cuda_ballot",
+                "{ .reg .pred p; setp.ne.s32 p, $1, 0; "
+                "vote.ballot.b32 $0, p; }",
+                "=r,r");
+      patch_asm("cuda_shfl_i32", "shfl.idx.b32 $0, $1, $2, 0x1f;", "=r,r,r");
 
       link_module_with_libdevice(runtime_module);
 
       // runtime_module->print(llvm::errs(), nullptr);
     }
+    std::string bitcode;
+    llvm::raw_string_ostream os(bitcode);
+    llvm::WriteBitcodeToFile(*runtime_module, os);
+    os.flush();
+    std::lock_guard<std::mutex> _(prepared_runtimes_mutex);
+    prepared_runtimes[arch] = std::make_shared<const std::string>(bitcode);
 
     /*
     int total_inst = 0;
@@ -346,6 +538,90 @@ std::unique_ptr<llvm::Module> TaichiLLVMContext::clone_struct_module() {
   return llvm::CloneModule(*struct_module);
 }
 
+std::unique_ptr<llvm::Module>
+TaichiLLVMContext::clone_struct_module_declarations() {
+  TI_AUTO_PROF
+  TC_ASSERT(struct_module);
+  llvm::ValueToValueMapTy vmap;
+  // Global variables are cheap to clone, and must be defined exactly once
+  return llvm::CloneModule(
+      *struct_module, vmap,
+      [](const GlobalValue *gv) { return !llvm::isa<llvm::Function>(gv); });
+}
+
+// Names of the functions defined in |module| that are reachable from |roots|
+std::set<std::string> reachable_functions(
+    llvm::Module *module,
+    const std::vector<std::string> &roots) {
+  std::set<std::string> functions;
+  std::set<llvm::Value *> visited;
+  std::vector<llvm::Value *> stack;
+  for (auto &name : roots) {
+    if (auto f = module->getFunction(name))
+      stack.push_back(f);
+  }
+  while (!stack.empty()) {
+    auto v = stack.back();
+    stack.pop_back();
+    if (!visited.insert(v).second)
+      continue;
+    if (auto f = llvm::dyn_cast<llvm::Function>(v)) {
+      if (f->isDeclaration())
+        continue;
+      functions.insert(f->getName());
+      for (auto &bb : *f) {
+        for (auto &inst : bb) {
+          for (auto &op : inst.operands()) {
+            if (llvm::isa<llvm::Constant>(op))
+              stack.push_back(op);
+          }
+        }
+      }
+    } else if (auto gv = llvm::dyn_cast<llvm::GlobalVariable>(v)) {
+      if (gv->hasInitializer())
+        stack.push_back(gv->getInitializer());
+    } else if (auto c = llvm::dyn_cast<llvm::Constant>(v)) {
+      // Constant expressions and aggregates
+      for (auto &op : c->operands())
+        stack.push_back(op);
+    }
+  }
+  return functions;
+}
+
+void TaichiLLVMContext::link_struct_module_functions(
+    std::unique_ptr<llvm::Module> &module) {
+  TI_AUTO_PROF
+  TC_ASSERT(struct_module);
+  std::vector<std::string> roots;
+  for (auto &f : *module) {
+    if (f.isDeclaration() && !f.isIntrinsic() && !f.use_empty())
+      roots.push_back(f.getName());
+  }
+  auto needed = reachable_functions(struct_module.get(), roots);
+  if (needed.empty())
+    return;
+  llvm::ValueToValueMapTy vmap;
+  // Local globals have no counterpart the linker could resolve to
+  auto bodies = llvm::CloneModule(
+      *struct_module, vmap, [&](const GlobalValue *gv) {
+        if (llvm::isa<llvm::Function>(gv))
+          return needed.count(gv->getName()) != 0;
+        return gv->hasLocalLinkage();
+      });
+  // Internal functions (e.g. from libdevice) must resolve the declarations
+  for (auto &name : needed)
+    bodies->getFunction(name)->setLinkage(Function::ExternalLinkage);
+  bodies->setDataLayout(module->getDataLayout());
+  if (llvm::Linker::linkModules(*module, std::move(bodies))) {
+    TC_ERROR("Failed to link runtime functions.");
+  }
+  for (auto &name : needed) {
+    // To avoid duplicated symbols
+    module->getFunction(name)->setLinkage(Function::PrivateLinkage);
+  }
+}
+
 void TaichiLLVMContext::set_struct_module(
     const std::unique_ptr<llvm::Module> &module) {
   TC_ASSERT(module);
@@ -354,6 +630,20 @@ void TaichiLLVMContext::set_struct_module(
     TC_ERROR("module broken");
   }
   struct_module = llvm::CloneModule(*module);
+  struct_module_hash.clear();
+}
+
+std::string TaichiLLVMContext::get_struct_module_hash() {
+  TC_ASSERT(struct_module);
+  if (struct_module_hash.empty()) {
+    std::string bitcode;
+    llvm::raw_string_ostream os(bitcode);
+    llvm::WriteBitcodeToFile(*struct_module, os);
+    os.flush();
+    struct_module_hash = fmt::format(
+        "{:016x}", (uint64)XXH64(bitcode.data(), bitcode.size(), 0));
+  }
+  return struct_module_hash;
 }
 
 template <typename T>
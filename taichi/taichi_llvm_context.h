@@ -1,12 +1,14 @@
 #pragma once
 // A helper for the llvm backend
 
+#include <unordered_map>
 #include "tlang_util.h"
 #include "llvm_fwd.h"
 #include "snode.h"
 
 TLANG_NAMESPACE_BEGIN
 class TaichiLLVMJIT;
+class SourceProfiler;
 
 void *jit_lookup_name(TaichiLLVMJIT *jit, const std::string &name);
 
@@ -18,17 +20,52 @@ class TaichiLLVMContext {
   Arch arch;
 
   SNodeAttributes snode_attr;
+  std::string struct_module_hash;
+
+  // The offloaded tasks compiled with this JIT, by the key of their IR, see
+  // CompileConfig::reuse_compiled_tasks
+  struct CompiledTask {
+    void *func;       // x86_64
+    void *cuda_func;  // GPUs
+    int grid_dim;
+    int block_dim;
+    int auto_block_dim_range;
+    TaskTraffic traffic;
+  };
+  std::unordered_map<std::string, CompiledTask> compiled_tasks;
 
   TaichiLLVMContext(Arch arch);
 
   ~TaichiLLVMContext();
 
+  // The context a finalized program left for arch if there is one, reset,
+  // so that the runtime module is only loaded and prepared once per process
+  static std::unique_ptr<TaichiLLVMContext> acquire(Arch arch);
+
+  // Keeps the context of a finalized program for the next one
+  static void recycle(std::unique_ptr<TaichiLLVMContext> context);
+
+  // Drops the state of the program: the JIT (with the kernels and the struct
+  // module) is recreated, the runtime module is kept
+  void reset();
+
   std::unique_ptr<llvm::Module> get_init_module();
 
   std::unique_ptr<llvm::Module> clone_struct_module();
 
+  // A copy of the struct module with function bodies left out, so that
+  // kernels do not have to clone the whole runtime
+  std::unique_ptr<llvm::Module> clone_struct_module_declarations();
+
+  // Links in the bodies of the struct module functions |module| calls,
+  // directly or not
+  void link_struct_module_functions(std::unique_ptr<llvm::Module> &module);
+
   void set_struct_module(const std::unique_ptr<llvm::Module> &module);
 
+  // Hash of the struct module bitcode, used as part of offline cache keys
+  std::string get_struct_module_hash();
+
   template <typename T>
   T lookup_function(const std::string &name) {
     auto ret = T((function_pointer_type<T>)jit_lookup_name(jit.get(), name));
@@ -56,6 +93,9 @@ class TaichiLLVMContext {
   std::string type_name(llvm::Type *type);
 
   void link_module_with_libdevice(std::unique_ptr<llvm::Module> &module);
+
+  // Hands the source lines of the kernels JITed from now on to |profiler|
+  void set_source_profiler(SourceProfiler *profiler);
 };
 
 TLANG_NAMESPACE_END
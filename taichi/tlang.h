@@ -33,7 +33,9 @@ TLANG_NAMESPACE_BEGIN
 void layout(const std::function<void()> &body);
 
 inline Kernel &kernel(const std::function<void()> &body) {
-  return get_current_program().kernel(body);
+  auto &kernel = get_current_program().kernel(body);
+  get_current_program().compile_async(kernel);
+  return kernel;
 }
 
 inline void kernel_name(std::string name) {
@@ -183,6 +185,12 @@ inline Expr Probe(const Expr &expr, const ExprGroup &indices) {
   return Probe(expr.snode(), indices);
 }
 
+// Whether the cell of a pointer SNode holding the element at indices is
+// active, without activating it. Always 1 for dense SNodes.
+inline Expr IsActive(SNode *snode, const ExprGroup &indices) {
+  return Expr::make<SNodeOpExpression>(snode, SNodeOpType::is_active, indices);
+}
+
 inline Expr AssumeInRange(const Expr &expr,
                           const Expr &base,
                           int low,
@@ -9,6 +9,16 @@ namespace Tlang {
 
 CompileConfig default_compile_config;
 
+namespace {
+// The tables below are built on first use by a thread-safe static
+// initialization, since concurrent compilations use them
+template <typename K, typename V>
+V lookup(const std::map<K, V> &table, K key) {
+  auto it = table.find(key);
+  return it == table.end() ? V() : it->second;
+}
+}  // namespace
+
 real get_cpu_frequency() {
   static real cpu_frequency = 0;
   if (cpu_frequency == 0) {
@@ -60,9 +70,22 @@ real measure_cpe(std::function<void()> target,
   return elasped_cycles / float64(total_batches * elements_per_call);
 }
 
+// In 32-bit lanes, from the widest vector ISA of the host
+int default_simd_width_x86_64() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  if (__builtin_cpu_supports("avx512f"))
+    return 16;
+  if (__builtin_cpu_supports("avx"))
+    return 8;
+  return 4;
+#else
+  return 8;
+#endif
+}
+
 int default_simd_width(Arch arch) {
   if (arch == Arch::x86_64) {
-    return default_simd_width_x86_64;
+    return default_simd_width_x86_64();
   } else if (arch == Arch::gpu) {
     return 32;
   } else {
@@ -72,8 +95,8 @@ int default_simd_width(Arch arch) {
 }
 
 std::string data_type_name(DataType t) {
-  static std::map<DataType, std::string> type_names;
-  if (type_names.empty()) {
+  static const auto type_names = [] {
+    std::map<DataType, std::string> type_names;
 #define REGISTER_DATA_TYPE(i, j) type_names[DataType::i] = #j;
     REGISTER_DATA_TYPE(f16, float16);
     REGISTER_DATA_TYPE(f32, float32);
@@ -91,13 +114,14 @@ std::string data_type_name(DataType t) {
     REGISTER_DATA_TYPE(none, none);
     REGISTER_DATA_TYPE(unknown, unknown);
 #undef REGISTER_DATA_TYPE
-  }
-  return type_names[t];
+    return type_names;
+  }();
+  return lookup(type_names, t);
 }
 
 int data_type_size(DataType t) {
-  static std::map<DataType, int> type_sizes;
-  if (type_sizes.empty()) {
+  static const auto type_sizes = [] {
+    std::map<DataType, int> type_sizes;
 #define REGISTER_DATA_TYPE(i, j) type_sizes[DataType::i] = sizeof(j);
     type_sizes[DataType::f16] = 2;
     REGISTER_DATA_TYPE(f32, float32);
@@ -115,13 +139,14 @@ int data_type_size(DataType t) {
     type_sizes[DataType::none] = 0;
     type_sizes[DataType::unknown] = -1;
 #undef REGISTER_DATA_TYPE
-  }
-  return type_sizes[t];
+    return type_sizes;
+  }();
+  return lookup(type_sizes, t);
 }
 
 std::string data_type_short_name(DataType t) {
-  static std::map<DataType, std::string> type_names;
-  if (type_names.empty()) {
+  static const auto type_names = [] {
+    std::map<DataType, std::string> type_names;
 #define REGISTER_DATA_TYPE(i) type_names[DataType::i] = #i;
     REGISTER_DATA_TYPE(f16);
     REGISTER_DATA_TYPE(f32);
@@ -139,13 +164,14 @@ std::string data_type_short_name(DataType t) {
     REGISTER_DATA_TYPE(none);
     REGISTER_DATA_TYPE(unknown);
 #undef REGISTER_DATA_TYPE
-  }
-  return type_names[t];
+    return type_names;
+  }();
+  return lookup(type_names, t);
 }
 
 std::string snode_type_name(SNodeType t) {
-  static std::map<SNodeType, std::string> type_names;
-  if (type_names.empty()) {
+  static const auto type_names = [] {
+    std::map<SNodeType, std::string> type_names;
 #define REGISTER_TYPE(i) type_names[SNodeType::i] = #i;
     REGISTER_TYPE(undefined);
     REGISTER_TYPE(root);
@@ -155,24 +181,27 @@ std::string snode_type_name(SNodeType t) {
     REGISTER_TYPE(hash);
     REGISTER_TYPE(pointer);
     REGISTER_TYPE(indirect);
+    REGISTER_TYPE(bit_struct);
 #undef REGISTER_TYPE
-  }
-  return type_names[t];
+    return type_names;
+  }();
+  return lookup(type_names, t);
 }
 
 std::string unary_op_type_name(UnaryOpType type) {
-  static std::map<UnaryOpType, std::string> type_names;
-  if (type_names.empty()) {
+  static const auto type_names = [] {
+    std::map<UnaryOpType, std::string> type_names;
 #define PER_UNARY_OP(i) type_names[UnaryOpType::i] = #i;
 #include "inc/unary_op.h"
 #undef PER_UNARY_OP
-  }
-  return type_names[type];
+    return type_names;
+  }();
+  return lookup(type_names, type);
 }
 
 std::string binary_op_type_name(BinaryOpType type) {
-  static std::map<BinaryOpType, std::string> type_names;
-  if (type_names.empty()) {
+  static const auto type_names = [] {
+    std::map<BinaryOpType, std::string> type_names;
 #define REGISTER_TYPE(i) type_names[BinaryOpType::i] = #i;
     REGISTER_TYPE(mul);
     REGISTER_TYPE(add);
@@ -194,13 +223,14 @@ std::string binary_op_type_name(BinaryOpType type) {
     REGISTER_TYPE(cmp_eq);
     REGISTER_TYPE(atan2);
 #undef REGISTER_TYPE
-  }
-  return type_names[type];
+    return type_names;
+  }();
+  return lookup(type_names, type);
 }
 
 std::string binary_op_type_symbol(BinaryOpType type) {
-  static std::map<BinaryOpType, std::string> type_names;
-  if (type_names.empty()) {
+  static const auto type_names = [] {
+    std::map<BinaryOpType, std::string> type_names;
 #define REGISTER_TYPE(i, s) type_names[BinaryOpType::i] = #s;
     REGISTER_TYPE(mul, *);
     REGISTER_TYPE(add, +);
@@ -219,47 +249,77 @@ std::string binary_op_type_symbol(BinaryOpType type) {
     REGISTER_TYPE(bit_or, |);
     REGISTER_TYPE(bit_xor, ^);
 #undef REGISTER_TYPE
-  }
-  return type_names[type];
+    return type_names;
+  }();
+  return lookup(type_names, type);
 }
 
 std::string ternary_type_name(TernaryOpType type) {
-  static std::map<TernaryOpType, std::string> type_names;
-  if (type_names.empty()) {
+  static const auto type_names = [] {
+    std::map<TernaryOpType, std::string> type_names;
 #define REGISTER_TYPE(i) type_names[TernaryOpType::i] = #i;
     REGISTER_TYPE(select);
 #undef REGISTER_TYPE
-  }
-  return type_names[type];
+    return type_names;
+  }();
+  return lookup(type_names, type);
 }
 
 std::string atomic_op_type_name(AtomicOpType type) {
-  static std::map<AtomicOpType, std::string> type_names;
-  if (type_names.empty()) {
+  static const auto type_names = [] {
+    std::map<AtomicOpType, std::string> type_names;
 #define REGISTER_TYPE(i) type_names[AtomicOpType::i] = #i;
     REGISTER_TYPE(add);
+    REGISTER_TYPE(sub);
     REGISTER_TYPE(max);
     REGISTER_TYPE(min);
+    REGISTER_TYPE(bit_and);
+    REGISTER_TYPE(bit_or);
+    REGISTER_TYPE(bit_xor);
 #undef REGISTER_TYPE
-  }
-  return type_names[type];
+    return type_names;
+  }();
+  return lookup(type_names, type);
 }
 
 std::string snode_op_type_name(SNodeOpType type) {
-  static std::map<SNodeOpType, std::string> type_names;
-  if (type_names.empty()) {
+  static const auto type_names = [] {
+    std::map<SNodeOpType, std::string> type_names;
 #define REGISTER_TYPE(i) type_names[SNodeOpType::i] = #i;
     REGISTER_TYPE(probe);
     REGISTER_TYPE(activate);
     REGISTER_TYPE(deactivate);
     REGISTER_TYPE(append);
     REGISTER_TYPE(clear);
+    REGISTER_TYPE(is_active);
 #undef REGISTER_TYPE
+    return type_names;
+  }();
+  return lookup(type_names, type);
+}
+
+std::string cpu_schedule_name(CPUSchedule schedule) {
+  if (schedule == CPUSchedule::dynamic) {
+    return "dynamic";
+  } else if (schedule == CPUSchedule::static_) {
+    return "static";
+  } else {
+    return "guided";
   }
-  return type_names[type];
 }
 
-std::string CompileConfig::compiler_config() {
+CPUSchedule cpu_schedule_from_name(const std::string &name) {
+  for (auto schedule :
+       {CPUSchedule::dynamic, CPUSchedule::static_, CPUSchedule::guided}) {
+    if (cpu_schedule_name(schedule) == name)
+      return schedule;
+  }
+  TC_ERROR("Unknown schedule \"{}\" (dynamic, static or guided)", name);
+  return CPUSchedule::dynamic;
+}
+
+std::string CompileConfig::compiler_config(const std::string &pch_flags,
+                                           bool link) {
   std::string cmd;
 #if defined(OPENMP_FOUND)
   std::string omp_flag = "-fopenmp -DTLANG_WITH_OPENMP";
@@ -285,14 +345,18 @@ std::string CompileConfig::compiler_config() {
     linking = fmt::format(" -L{}/build -ltaichi_core ", get_repo_dir());
     include_flag = fmt::format(" -I{}/ ", get_repo_dir());
   }
+  // Ahead of the repo, where the compiler looks for precompiled headers first
+  include_flag = pch_flags + " " + include_flag;
+  if (!link)
+    linking = "";
   if (arch == Arch::x86_64) {
     cmd = fmt::format(
-        "{} -std=c++14 -shared -fPIC {} -march=native -mfma {} "
+        "{} -std=c++14 {} -fPIC {} -march=native -mfma {} "
         "-ffp-contract=fast "
         "{} -Wall -g -DTLANG_CPU "
-        "-lstdc++  {} {}",
-        compiler_name(), gcc_opt_flag(), include_flag, omp_flag, linking,
-        extra_flags);
+        "{}  {} {}",
+        compiler_name(), link ? "-shared" : "", gcc_opt_flag(), include_flag,
+        omp_flag, link ? "-lstdc++" : "", linking, extra_flags);
   } else {
     cmd = fmt::format(
         "nvcc -g -lineinfo -std=c++14 -shared {} -Xcompiler \"-fPIC "
@@ -323,8 +387,9 @@ std::string CompileConfig::preprocess_cmd(const std::string &input,
 std::string CompileConfig::compile_cmd(const std::string &input,
                                        const std::string &output,
                                        const std::string &extra_flags,
-                                       bool verbose) {
-  std::string cmd = compiler_config();
+                                       bool verbose,
+                                       const std::string &pch_flags) {
+  std::string cmd = compiler_config(pch_flags);
   std::string io = fmt::format(" {} {} -o {} ", extra_flags, input, output);
 
   cmd += io;
@@ -335,6 +400,16 @@ std::string CompileConfig::compile_cmd(const std::string &input,
   return cmd;
 }
 
+std::string CompileConfig::precompile_header_cmd(
+    const std::string &input,
+    const std::string &output,
+    const std::string &extra_flags) {
+  TC_ASSERT(arch == Arch::x86_64);
+  return compiler_config("", false) +
+         fmt::format(" {} -x c++-header {} -o {} 2> {}.log", extra_flags,
+                     input, output, output);
+}
+
 bool command_exist(const std::string &command) {
 #if defined(TC_PLATFORM_UNIX)
   if (std::system(fmt::format("which {} > /dev/null 2>&1", command).c_str())) {
@@ -370,6 +445,7 @@ CompileConfig::CompileConfig() {
   force_vectorized_global_load = false;
   force_vectorized_global_store = false;
   debug = CoreState::get_debug();
+  check_out_of_bound = false;
 #if defined(TC_PLATFORM_OSX)
   gcc_version = -1;
 #else
@@ -399,6 +475,54 @@ CompileConfig::CompileConfig() {
   default_gpu_block_dim = 64;
   verbose = true;
   fast_math = true;
+  use_offline_cache = false;
+  auto offline_cache_char = getenv("TI_OFFLINE_CACHE");
+  if (offline_cache_char != nullptr && offline_cache_char[0] == '1') {
+    use_offline_cache = true;
+  }
+  async_compilation = false;
+  use_cuda_graph = false;
+  overlap_kernels = false;
+  cpu_gpu_split = false;
+  device_id = 0;
+  auto_gpu_block_dim = true;
+  gpu_block_dim_autotuning = false;
+  use_cubin = false;
+  cubin_opt_level = 4;
+  gpu_max_registers = 0;
+  random_seed = 0;
+  cpu_spin_window_us = 0;
+  cpu_max_num_threads = 0;
+  cpu_numa_pinning = false;
+  use_huge_pages = false;
+  root_file = "";
+  count_page_faults = false;
+  gpu_prefetch_mb = 0;
+  struct_for_fusion = true;
+  gpu_fission_live_values = 0;
+  demote_dense_struct_fors = true;
+  gpu_persistent_threads = false;
+  gpu_read_only_cache = true;
+  gpu_pack_leaf_blocks = true;
+  cpu_streaming_stores = false;
+  cpu_block_prefetch = false;
+  cpu_thread_count_tuning = false;
+  block_local_access = true;
+  tiered_compilation = false;
+  tiered_compilation_threshold = 10;
+  reuse_compiled_tasks = true;
+  skip_unchanged_lists = true;
+  use_precompiled_headers = true;
+  profile_compilation = false;
+  unroll_threshold = 8;
+  timeline = false;
+  profile_hardware_counters = false;
+  launch_breakdown = false;
+  profile_source_lines = false;
+  source_profiler_interval_us = 1000;
+  peak_gflops = 0;
+  peak_bandwidth = 0;
+  use_tensor_cores = false;
 }
 
 std::string CompileConfig::compiler_name() {
@@ -11,8 +11,6 @@ TLANG_NAMESPACE_BEGIN
 template <typename T>
 using Handle = std::shared_ptr<T>;
 
-constexpr int default_simd_width_x86_64 = 8;
-
 enum class Arch { x86_64, gpu };
 
 inline std::string arch_name(Arch arch) {
@@ -89,6 +87,22 @@ std::string data_type_name(DataType t);
 
 std::string data_type_short_name(DataType t);
 
+// A custom-width integer, or a fixed-point number stored as one, for fields
+// packed into a bit_struct SNode
+struct QuantizedType {
+  // 0 for regular types
+  int num_bits;
+  bool is_signed;
+  // What one unit of the integer stands for, 0 for plain integers
+  float64 scale;
+
+  QuantizedType() {
+    num_bits = 0;
+    is_signed = true;
+    scale = 0;
+  }
+};
+
 enum class SNodeType {
   undefined,
   root,
@@ -98,6 +112,7 @@ enum class SNodeType {
   hash,
   pointer,
   indirect,
+  bit_struct,
 };
 
 std::string snode_type_name(SNodeType t);
@@ -120,6 +135,11 @@ inline bool constexpr is_real(DataType dt) {
   return dt == DataType::f16 || dt == DataType::f32 || dt == DataType::f64;
 }
 
+// f16 is a storage-only type: values are loaded into and stored from f32
+inline DataType compute_type(DataType dt) {
+  return dt == DataType::f16 ? DataType::f32 : dt;
+}
+
 inline bool constexpr is_signed(DataType dt) {
   return dt == DataType::i32 || dt == DataType::i64;
 }
@@ -185,14 +205,31 @@ enum class TernaryOpType : int { select, undefined };
 
 std::string ternary_type_name(TernaryOpType type);
 
-enum class AtomicOpType : int { add, sub, max, min };
+enum class AtomicOpType : int { add, sub, max, min, bit_and, bit_or, bit_xor };
 
 std::string atomic_op_type_name(AtomicOpType type);
 
-enum class SNodeOpType : int { probe, activate, deactivate, append, clear };
+enum class SNodeOpType : int {
+  probe,
+  activate,
+  deactivate,
+  append,
+  clear,
+  is_active
+};
 
 std::string snode_op_type_name(SNodeOpType type);
 
+// How a CPU range-for distributes its iterations over the threads:
+// dynamic: blocks of block_dim iterations, balanced by work stealing
+// static_: one contiguous partition per thread, the same in every launch
+// guided: chunks shrinking with the remaining work, at least block_dim
+enum class CPUSchedule : int { dynamic, static_, guided };
+
+std::string cpu_schedule_name(CPUSchedule schedule);
+
+CPUSchedule cpu_schedule_from_name(const std::string &name);
+
 class IRModified {};
 
 class TypedConstant {
@@ -321,6 +358,9 @@ DataType promoted_type(DataType a, DataType b);
 struct CompileConfig {
   Arch arch;
   bool debug;
+  // LLVM kernels check the indices of field accesses, and the next
+  // synchronization raises the first access out of bound
+  bool check_out_of_bound;
   int simd_width;
   int gcc_version;
   bool internal_optimization;
@@ -347,6 +387,99 @@ struct CompileConfig {
   DataType default_ip;
   std::string extra_flags;
   int default_gpu_block_dim;
+  bool use_offline_cache;
+  bool async_compilation;
+  bool use_cuda_graph;
+  // Runs GPU kernels that access nothing the pending ones write (and vice
+  // versa) on other streams, so that they overlap
+  bool overlap_kernels;
+  // GPU kernels of a single range-for over dense fields run part of their
+  // range on the host at the same time, sized by the measured throughput of
+  // either side. See Kernel::host_twin.
+  bool cpu_gpu_split;
+  int device_id;
+  bool auto_gpu_block_dim;
+  bool gpu_block_dim_autotuning;
+  bool use_cubin;
+  int cubin_opt_level;
+  // Caps the registers per thread of GPU kernels (.maxnreg), trading spills
+  // for occupancy, unless set per kernel (Kernel::gpu_max_registers). 0 for
+  // no cap.
+  int gpu_max_registers;
+  int random_seed;
+  int cpu_spin_window_us;
+  // Threads of parallel CPU loops, unless set by ti.parallelize. 0 for all
+  // hardware threads.
+  int cpu_max_num_threads;
+  bool cpu_numa_pinning;
+  bool use_huge_pages;
+  // Maps the dense part of the data structure (the root buffer) from this
+  // file instead of anonymous memory, on CPUs. Empty for none.
+  std::string root_file;
+  bool count_page_faults;
+  int gpu_prefetch_mb;
+  bool struct_for_fusion;
+  // GPU struct-fors whose bodies keep more values live at once are split
+  // into several loops, which takes fewer registers. 0 for never.
+  int gpu_fission_live_values;
+  // Struct-fors over dense SNodes become range-fors without element lists
+  // (LLVM backends)
+  bool demote_dense_struct_fors;
+  // GPU struct-fors run as many blocks as fit on the device at once, which
+  // claim blocks of elements from the list, and run the list generation
+  // before them in the same kernel
+  bool gpu_persistent_threads;
+  // GPU loads of fields and external arrays that the kernel (or the task)
+  // does not write go through the read-only data cache (ld.global.nc)
+  bool gpu_read_only_cache;
+  // GPU struct-fors without a block_dim over leaf blocks smaller than
+  // default_gpu_block_dim run several elements per block, a group of threads
+  // each
+  bool gpu_pack_leaf_blocks;
+  // CPU loops store to the fields they write every iteration and never read
+  // with non-temporal stores, which bypass the caches
+  bool cpu_streaming_stores;
+  // CPU struct-fors prefetch the next leaf block of each thread
+  bool cpu_block_prefetch;
+  // Parallel CPU loops run with the fastest of a few thread counts, timed
+  // over the first runs of each kernel
+  bool cpu_thread_count_tuning;
+  // Loads in struct-fors at the loop indices plus constants, e.g. stencils,
+  // take the leaf block of the current element when the cell is in it,
+  // instead of looking it up from the root
+  bool block_local_access;
+  bool tiered_compilation;
+  int tiered_compilation_threshold;
+  // Offloaded tasks identical to one compiled before, e.g. the list
+  // generation of struct-fors or the unchanged loops of an edited kernel,
+  // reuse its machine code. See CodeGenLLVM::reuse_compiled_task.
+  bool reuse_compiled_tasks;
+  // The clear_list and listgen tasks of element lists whose ancestors no
+  // task activated or deactivated since are not launched, see ListTracker
+  bool skip_unchanged_lists;
+  // Legacy backends on CPUs: precompiles taichi/legacy_kernel.h once for all
+  // kernels, see CodeGenBase::get_pch_flags
+  bool use_precompiled_headers;
+  bool profile_compilation;
+  int unroll_threshold;
+  // See taichi/system/timeline.h
+  bool timeline;
+  // Instructions, cache misses and branch misses of each profiled task on
+  // CPUs, with enable_profiler
+  bool profile_hardware_counters;
+  // See taichi/launch_breakdown.h
+  bool launch_breakdown;
+  // Samples CPU kernels to attribute time to their source lines, see
+  // taichi/source_profiler.h
+  bool profile_source_lines;
+  int source_profiler_interval_us;
+  // Of the machine, for the roofline columns of the profiler. 0 if unknown.
+  double peak_gflops;
+  double peak_bandwidth;  // GB/s
+  // Multiplies 16x16 and 32x32 matrices by warp-uniform ones on the tensor
+  // cores of sm_70+ GPUs, with the inputs rounded to f16. See
+  // taichi/matmul.h
+  bool use_tensor_cores;
 
   CompileConfig();
 
@@ -354,7 +487,10 @@ struct CompileConfig {
 
   std::string gcc_opt_flag();
 
-  std::string compiler_config();
+  // The command line of the compiler, after pch_flags from
+  // CodeGenBase::get_pch_flags. Without the linking flags if !link.
+  std::string compiler_config(const std::string &pch_flags = "",
+                              bool link = true);
 
   std::string preprocess_cmd(const std::string &input,
                              const std::string &output,
@@ -364,7 +500,13 @@ struct CompileConfig {
   std::string compile_cmd(const std::string &input,
                           const std::string &output,
                           const std::string &extra_flags,
-                          bool verbose = false);
+                          bool verbose = false,
+                          const std::string &pch_flags = "");
+
+  // Precompiles a header with the flags of compile_cmd, on CPUs
+  std::string precompile_header_cmd(const std::string &input,
+                                    const std::string &output,
+                                    const std::string &extra_flags);
 };
 
 extern CompileConfig default_compile_config;
@@ -0,0 +1,153 @@
+// Checks the indices of field accesses against the shapes of the fields
+// (CompileConfig::check_out_of_bound). The indices of an access are checked
+// with a single comparison: the bitwise or of (index - low) and
+// (high - 1 - index) over all of them is negative if and only if one is out
+// of [low, high), wrap-around included. Indices that are constant, or kept
+// within the shape by the bounds of an enclosing loop, are not checked.
+
+#include "../ir.h"
+#include "../program.h"
+
+TLANG_NAMESPACE_BEGIN
+
+class CheckOutOfBound : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+
+  // The enclosing loops
+  std::vector<Stmt *> loops;
+  // Accesses to check, with the positions of their unknown indices
+  std::vector<std::pair<GlobalPtrStmt *, std::vector<int>>> accesses;
+
+  static bool constant(Stmt *stmt, int32 &val) {
+    auto c = stmt->cast<ConstStmt>();
+    if (!c || c->width() != 1 || c->ret_type.data_type != DataType::i32)
+      return false;
+    val = c->val[0].val_i32;
+    return true;
+  }
+
+  // Whether index is known to be in [low, high)
+  bool within(Stmt *index, int low, int high) {
+    int32 c;
+    if (constant(index, c))
+      return low <= c && c < high;
+    // index - loop variable is in [diff.low, diff.high)
+    for (auto loop : loops) {
+      if (auto range_for = loop->cast<RangeForStmt>()) {
+        int32 begin, end;
+        if (!constant(range_for->begin, begin) ||
+            !constant(range_for->end, end))
+          continue;
+        auto diff = analysis::value_diff(index, 0, range_for->loop_var);
+        if (diff.linear_related() && low <= begin + diff.low &&
+            end + diff.high - 2 < high)
+          return true;
+      } else {
+        auto struct_for = loop->as<StructForStmt>();
+        for (int j = 0; j < (int)struct_for->loop_vars.size(); j++) {
+          auto diff =
+              analysis::value_diff(index, 0, struct_for->loop_vars[j]);
+          int n = struct_for->snode->num_elements_along_axis(j);
+          if (diff.linear_related() && low <= diff.low &&
+              n + diff.high - 2 < high)
+            return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  void visit(RangeForStmt *for_stmt) override {
+    loops.push_back(for_stmt);
+    for_stmt->body->accept(this);
+    loops.pop_back();
+  }
+
+  void visit(StructForStmt *for_stmt) override {
+    loops.push_back(for_stmt);
+    BasicStmtVisitor::visit(for_stmt);
+    loops.pop_back();
+  }
+
+  void visit(GlobalPtrStmt *stmt) override {
+    auto snode = stmt->snodes[0];
+    if (stmt->width() != 1 ||
+        (int)stmt->indices.size() != snode->num_active_indices)
+      return;
+    int halo = snode->halo_width();
+    std::vector<int> unknown;
+    for (int k = 0; k < (int)stmt->indices.size(); k++) {
+      int n = snode->num_elements_along_axis(k);
+      if (!within(stmt->indices[k], -halo, n + halo))
+        unknown.push_back(k);
+    }
+    if (!unknown.empty())
+      accesses.emplace_back(stmt, unknown);
+  }
+
+  static std::string describe(GlobalPtrStmt *stmt) {
+    auto snode = stmt->snodes[0];
+    std::string shape;
+    for (int k = 0; k < snode->num_active_indices; k++) {
+      shape += fmt::format("{}{}", k ? ", " : "",
+                           snode->num_elements_along_axis(k));
+    }
+    std::string location = "unknown location";
+    if (stmt->source_line != 0) {
+      location = fmt::format("{}:{}", get_source_file(stmt->source_file),
+                             stmt->source_line);
+    }
+    return fmt::format("{} of shape ({}) at {}",
+                       snode->get_node_type_name_hinted(), shape, location);
+  }
+
+  void insert_check(GlobalPtrStmt *stmt, const std::vector<int> &unknown) {
+    auto snode = stmt->snodes[0];
+    int halo = snode->halo_width();
+    VecStatement checks;
+    auto make = [&](BinaryOpType op, Stmt *lhs, Stmt *rhs) {
+      auto ret = checks.push_back<BinaryOpStmt>(op, lhs, rhs);
+      ret->ret_type.data_type = DataType::i32;
+      return ret;
+    };
+    auto make_constant = [&](int32 val) {
+      auto ret = checks.push_back<ConstStmt>(TypedConstant(val));
+      ret->ret_type.data_type = DataType::i32;
+      return ret;
+    };
+    Stmt *bits = nullptr;
+    for (auto k : unknown) {
+      auto index = stmt->indices[k];
+      int n = snode->num_elements_along_axis(k);
+      Stmt *above = index;
+      if (halo)
+        above = make(BinaryOpType::add, index, make_constant(halo));
+      auto below = make(BinaryOpType::sub, make_constant(n + halo - 1), index);
+      auto both = make(BinaryOpType::bit_or, above, below);
+      bits = bits ? make(BinaryOpType::bit_or, bits, both) : both;
+    }
+    auto in_bound = make(BinaryOpType::cmp_ge, bits, make_constant(0));
+    int check_id = get_current_program().register_bound_check(
+        describe(stmt), (int)stmt->indices.size());
+    checks.push_back<BoundCheckStmt>(in_bound, check_id, stmt->indices);
+    stmt->parent->insert_before(stmt, std::move(checks));
+  }
+
+  static void run(IRNode *root) {
+    CheckOutOfBound pass;
+    root->accept(&pass);
+    for (auto &access : pass.accesses)
+      pass.insert_check(access.first, access.second);
+  }
+};
+
+namespace irpass {
+
+void check_out_of_bound(IRNode *root) {
+  return CheckOutOfBound::run(root);
+}
+
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
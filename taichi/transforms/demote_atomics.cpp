@@ -1,5 +1,7 @@
 #include "../ir.h"
+#include "../program.h"
 #include <deque>
+#include <map>
 #include <set>
 
 TLANG_NAMESPACE_BEGIN
@@ -26,27 +28,44 @@ class DemoteAtomics : public BasicStmtVisitor {
       is_local = true;
     }
     if (demote) {
-      // replace atomics with load, add, store
-      if (stmt->op_type == AtomicOpType::add) {
-        auto ptr = stmt->dest;
-        auto val = stmt->val;
-
-        auto new_stmts = VecStatement();
-        if (is_local) {
-          TC_ASSERT(stmt->width() == 1);
-          auto load = new_stmts.push_back<LocalLoadStmt>(LocalAddress(ptr, 0));
-          auto add =
-              new_stmts.push_back<BinaryOpStmt>(BinaryOpType::add, load, val);
-          new_stmts.push_back<LocalStoreStmt>(ptr, add);
-        } else {
-          auto load = new_stmts.push_back<GlobalLoadStmt>(ptr);
-          auto add =
-              new_stmts.push_back<BinaryOpStmt>(BinaryOpType::add, load, val);
-          new_stmts.push_back<GlobalStoreStmt>(ptr, add);
-        }
-        stmt->parent->replace_with(stmt, new_stmts);
-        throw IRModified();
+      // replace atomics with load, op, store
+      auto ptr = stmt->dest;
+      auto val = stmt->val;
+      auto op = binary_op_of(stmt->op_type);
+
+      auto new_stmts = VecStatement();
+      if (is_local) {
+        TC_ASSERT(stmt->width() == 1);
+        auto load = new_stmts.push_back<LocalLoadStmt>(LocalAddress(ptr, 0));
+        auto result = new_stmts.push_back<BinaryOpStmt>(op, load, val);
+        new_stmts.push_back<LocalStoreStmt>(ptr, result);
+      } else {
+        auto load = new_stmts.push_back<GlobalLoadStmt>(ptr);
+        auto result = new_stmts.push_back<BinaryOpStmt>(op, load, val);
+        new_stmts.push_back<GlobalStoreStmt>(ptr, result);
       }
+      stmt->parent->replace_with(stmt, new_stmts);
+      throw IRModified();
+    }
+  }
+
+  static BinaryOpType binary_op_of(AtomicOpType op) {
+    switch (op) {
+      case AtomicOpType::add:
+        return BinaryOpType::add;
+      case AtomicOpType::sub:
+        return BinaryOpType::sub;
+      case AtomicOpType::max:
+        return BinaryOpType::max;
+      case AtomicOpType::min:
+        return BinaryOpType::min;
+      case AtomicOpType::bit_and:
+        return BinaryOpType::bit_and;
+      case AtomicOpType::bit_or:
+        return BinaryOpType::bit_or;
+      default:
+        TC_ASSERT(op == AtomicOpType::bit_xor);
+        return BinaryOpType::bit_xor;
     }
   }
 
@@ -71,10 +90,189 @@ class DemoteAtomics : public BasicStmtVisitor {
   }
 };
 
+// Within one iteration of an offloaded task, sums every atomic add to the
+// same global pointer in a local variable, and adds the total to the pointer
+// once at the end of the iteration. Applies when the task only ever adds to
+// that SNode, so that no thread can observe the partial sums.
+class AccumulateAtomics : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+
+  Block *body;
+  int loop_depth;
+  // Atomic adds by destination, and whether one of them may run repeatedly
+  std::map<Stmt *, std::vector<AtomicOpStmt *>> atomics;
+  std::set<Stmt *> repeated;
+  std::set<Stmt *> used;
+  // SNodes loaded or stored by the task. nullptr when a pointer of unknown
+  // SNode is.
+  std::set<SNode *> accessed;
+
+  // See Kernel::accumulation_fp
+  DataType accumulation_fp;
+
+  AccumulateAtomics(Block *body) : BasicStmtVisitor(), body(body) {
+    loop_depth = 0;
+    accumulation_fp = DataType::unknown;
+    auto kernel = get_current_program().get_current_kernel_if_any();
+    if (kernel && is_real(kernel->accumulation_fp))
+      accumulation_fp = kernel->accumulation_fp;
+  }
+
+  static SNode *pointee(Stmt *ptr) {
+    if (auto get_ch = ptr->cast<GetChStmt>())
+      return get_ch->output_snode;
+    if (auto global_ptr = ptr->cast<GlobalPtrStmt>()) {
+      if (global_ptr->width() == 1)
+        return global_ptr->snodes[0];
+    }
+    return nullptr;
+  }
+
+  void visit(Block *block) override {
+    for (auto &stmt : block->statements) {
+      for (int i = 0; i < stmt->num_operands(); i++)
+        used.insert(stmt->operand(i));
+    }
+    BasicStmtVisitor::visit(block);
+  }
+
+  void visit(RangeForStmt *for_stmt) override {
+    loop_depth++;
+    for_stmt->body->accept(this);
+    loop_depth--;
+  }
+
+  void visit(WhileStmt *stmt) override {
+    loop_depth++;
+    stmt->body->accept(this);
+    loop_depth--;
+  }
+
+  void visit(GlobalLoadStmt *stmt) override {
+    accessed.insert(pointee(stmt->ptr));
+  }
+
+  void visit(GlobalStoreStmt *stmt) override {
+    accessed.insert(pointee(stmt->ptr));
+  }
+
+  void visit(AtomicOpStmt *stmt) override {
+    if (stmt->dest->is<AllocaStmt>())
+      return;
+    if (stmt->op_type != AtomicOpType::add || stmt->width() != 1 ||
+        !pointee(stmt->dest)) {
+      accessed.insert(pointee(stmt->dest));
+      return;
+    }
+    atomics[stmt->dest].push_back(stmt);
+    if (loop_depth > 0)
+      repeated.insert(stmt->dest);
+  }
+
+  bool accumulate() {
+    body->accept(this);
+    if (accessed.count(nullptr))
+      return false;
+    bool modified = false;
+    for (auto &kv : atomics) {
+      auto dest = kv.first;
+      auto &sites = kv.second;
+      if (dest->parent != body || accessed.count(pointee(dest)) ||
+          (sites.size() < 2 && !repeated.count(dest)))
+        continue;
+      bool result_used = false;
+      for (auto site : sites)
+        result_used |= used.count(site) > 0;
+      if (result_used)
+        continue;
+      auto dt = sites[0]->val->ret_type.data_type;
+      if (accumulation_fp != DataType::unknown && is_real(dt) &&
+          promoted_type(dt, accumulation_fp) != dt)
+        dt = accumulation_fp;
+      auto alloca = Stmt::make<AllocaStmt>(dt);
+      auto alloca_ptr = alloca.get();
+      body->insert(std::move(alloca), 0);
+      for (auto site : sites) {
+        site->parent->replace_with(
+            site, Stmt::make<AtomicOpStmt>(AtomicOpType::add, alloca_ptr,
+                                           site->val));
+      }
+      auto sum = Stmt::make<LocalLoadStmt>(LocalAddress(alloca_ptr, 0));
+      auto sum_ptr = sum.get();
+      body->insert(std::move(sum));
+      body->insert(Stmt::make<AtomicOpStmt>(AtomicOpType::add, dest, sum_ptr));
+      modified = true;
+    }
+    return modified;
+  }
+
+  static void run(IRNode *root) {
+    auto block = dynamic_cast<Block *>(root);
+    for (auto &stmt : block->statements) {
+      auto offloaded = stmt->cast<OffloadedStmt>();
+      if (offloaded && offloaded->body) {
+        AccumulateAtomics pass(offloaded->body.get());
+        pass.accumulate();
+      }
+    }
+  }
+};
+
+// Flags the atomic adds of parallel GPU tasks to 0-D tensors as reductions,
+// so that each warp combines its values before issuing a single atomic
+class FlagReductions : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+
+  std::set<Stmt *> used;
+  std::vector<AtomicOpStmt *> candidates;
+
+  FlagReductions() : BasicStmtVisitor() {
+  }
+
+  void visit(Block *block) override {
+    for (auto &stmt : block->statements) {
+      for (int i = 0; i < stmt->num_operands(); i++)
+        used.insert(stmt->operand(i));
+    }
+    BasicStmtVisitor::visit(block);
+  }
+
+  void visit(AtomicOpStmt *stmt) override {
+    if (stmt->op_type != AtomicOpType::add || stmt->width() != 1)
+      return;
+    auto snode = AccumulateAtomics::pointee(stmt->dest);
+    auto dt = stmt->val->ret_type.data_type;
+    if (snode && snode->num_active_indices == 0 &&
+        (dt == DataType::i32 || dt == DataType::f32))
+      candidates.push_back(stmt);
+  }
+
+  static void run(IRNode *root) {
+    auto block = dynamic_cast<Block *>(root);
+    for (auto &stmt : block->statements) {
+      auto offloaded = stmt->cast<OffloadedStmt>();
+      if (!offloaded || offloaded->device != Arch::gpu ||
+          (offloaded->task_type != OffloadedStmt::TaskType::range_for &&
+           offloaded->task_type != OffloadedStmt::TaskType::struct_for))
+        continue;
+      FlagReductions pass;
+      offloaded->body->accept(&pass);
+      for (auto atomic : pass.candidates) {
+        if (!pass.used.count(atomic))
+          atomic->is_reduction = true;
+      }
+    }
+  }
+};
+
 namespace irpass {
 
 void demote_atomics(IRNode *root) {
+  AccumulateAtomics::run(root);
   DemoteAtomics::run(root);
+  FlagReductions::run(root);
   typecheck(root);
 }
 
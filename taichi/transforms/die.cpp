@@ -84,12 +84,20 @@ class DIE : public IRVisitor {
 
   void visit(StructForStmt *for_stmt) {
     register_usage(for_stmt);
+    if (for_stmt->block_initialization)
+      for_stmt->block_initialization->accept(this);
     for_stmt->body->accept(this);
+    if (for_stmt->block_finalization)
+      for_stmt->block_finalization->accept(this);
   }
 
   void visit(OffloadedStmt *stmt) {
+    if (stmt->block_initialization)
+      stmt->block_initialization->accept(this);
     if (stmt->body)
       stmt->body->accept(this);
+    if (stmt->block_finalization)
+      stmt->block_finalization->accept(this);
   }
 };
 
@@ -1,8 +1,12 @@
 #include "../ir.h"
+#include "../program.h"
 
 TLANG_NAMESPACE_BEGIN
 
-// Flag accesses to be either weak (non-activating) or strong (activating)
+// Flag accesses to be either weak (non-activating) or strong (activating).
+// Also records whether external array arguments are read or written, so that
+// unnecessary host-device copies can be skipped at launch time, and which
+// global tensors the kernel accesses.
 class FlagAccess : public IRVisitor {
  public:
   FlagAccess(IRNode *node) {
@@ -34,7 +38,11 @@ class FlagAccess : public IRVisitor {
   }
 
   void visit(StructForStmt *for_stmt) {
+    if (for_stmt->block_initialization)
+      for_stmt->block_initialization->accept(this);
     for_stmt->body->accept(this);
+    if (for_stmt->block_finalization)
+      for_stmt->block_finalization->accept(this);
   }
 
   // Assuming pointers will be visited before global load/st
@@ -42,16 +50,50 @@ class FlagAccess : public IRVisitor {
     stmt->activate = false;
   }
 
+  static void flag_external_access(Stmt *ptr, bool read, bool write) {
+    if (!ptr->is<ExternalPtrStmt>())
+      return;
+    auto &args = get_current_program().get_current_kernel().args;
+    auto &base_ptrs = ptr->as<ExternalPtrStmt>()->base_ptrs;
+    for (int i = 0; i < (int)base_ptrs.size(); i++) {
+      auto &arg = args[base_ptrs[i]->as<ArgLoadStmt>()->arg_id];
+      arg.is_nparray_read |= read;
+      arg.is_nparray_written |= write;
+    }
+  }
+
+  static void flag_global_access(Stmt *ptr, bool read, bool write) {
+    if (!ptr->is<GlobalPtrStmt>())
+      return;
+    auto &kernel = get_current_program().get_current_kernel();
+    auto &snodes = ptr->as<GlobalPtrStmt>()->snodes;
+    for (int i = 0; i < (int)snodes.size(); i++) {
+      if (read)
+        kernel.snodes_read.insert(snodes[i]);
+      if (write)
+        kernel.snodes_written.insert(snodes[i]);
+    }
+  }
+
+  void visit(GlobalLoadStmt *stmt) {
+    flag_external_access(stmt->ptr, true, false);
+    flag_global_access(stmt->ptr, true, false);
+  }
+
   void visit(GlobalStoreStmt *stmt) {
     if (stmt->ptr->is<GlobalPtrStmt>()) {
       stmt->ptr->as<GlobalPtrStmt>()->activate = true;
     }
+    flag_external_access(stmt->ptr, false, true);
+    flag_global_access(stmt->ptr, false, true);
   }
 
   void visit(AtomicOpStmt *stmt) {
     if (stmt->dest->is<GlobalPtrStmt>()) {
       stmt->dest->as<GlobalPtrStmt>()->activate = true;
     }
+    flag_external_access(stmt->dest, true, true);
+    flag_global_access(stmt->dest, true, true);
   }
 };
 
@@ -0,0 +1,207 @@
+// Within straight-line code, forwards values stored to or loaded from an
+// SNode cell to later loads of the same cell, and removes stores that are
+// overwritten before anything can read them
+
+#include "../ir.h"
+#include <map>
+#include <utility>
+
+TLANG_NAMESPACE_BEGIN
+
+class ForwardGlobalAccesses : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+
+  // An index, as a statement plus a constant offset. The statement is nullptr
+  // for constant indices.
+  using Index = std::pair<Stmt *, int64>;
+  // Cells of different place SNodes never alias
+  using Address = std::pair<SNode *, std::vector<Index>>;
+
+  // The known value of each cell, and the store that wrote it if no one has
+  // read that yet
+  std::map<Address, Stmt *> values;
+  std::map<Address, GlobalStoreStmt *> pending_stores;
+
+  static bool constant(Stmt *stmt, int32 &val) {
+    auto c = stmt->cast<ConstStmt>();
+    if (!c || c->width() != 1 || c->ret_type.data_type != DataType::i32)
+      return false;
+    val = c->val[0].val_i32;
+    return true;
+  }
+
+  static Index decompose(Stmt *stmt) {
+    int64 offset = 0;
+    int32 c;
+    while (auto binary = stmt->cast<BinaryOpStmt>()) {
+      if (binary->op_type == BinaryOpType::add && constant(binary->rhs, c)) {
+        offset += c;
+        stmt = binary->lhs;
+      } else if (binary->op_type == BinaryOpType::add &&
+                 constant(binary->lhs, c)) {
+        offset += c;
+        stmt = binary->rhs;
+      } else if (binary->op_type == BinaryOpType::sub &&
+                 constant(binary->rhs, c)) {
+        offset -= c;
+        stmt = binary->lhs;
+      } else {
+        break;
+      }
+    }
+    if (constant(stmt, c))
+      return {nullptr, offset + c};
+    return {stmt, offset};
+  }
+
+  // Returns false for pointers to more than one cell
+  static bool get_address(Stmt *ptr, Address &address) {
+    auto global_ptr = ptr->cast<GlobalPtrStmt>();
+    if (!global_ptr || global_ptr->width() != 1)
+      return false;
+    address.first = global_ptr->snodes[0];
+    address.second.clear();
+    for (auto index : global_ptr->indices)
+      address.second.push_back(decompose(index));
+    return true;
+  }
+
+  // Two indices into the same SNode differ when some index is the same
+  // statement plus different offsets
+  static bool may_alias(const Address &a, const Address &b) {
+    if (a.first != b.first)
+      return false;
+    if (a.second.size() != b.second.size())
+      return true;
+    for (int i = 0; i < (int)a.second.size(); i++) {
+      if (a.second[i].first == b.second[i].first &&
+          a.second[i].second != b.second[i].second)
+        return false;
+    }
+    return true;
+  }
+
+  template <typename T>
+  static void erase_aliases(std::map<Address, T> &map, const Address &address) {
+    for (auto it = map.begin(); it != map.end();) {
+      if (may_alias(it->first, address))
+        it = map.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  void clear() {
+    values.clear();
+    pending_stores.clear();
+  }
+
+  // The cell may have been read
+  void read(const Address &address) {
+    erase_aliases(pending_stores, address);
+  }
+
+  // The cell may have been changed
+  void write(const Address &address) {
+    erase_aliases(values, address);
+  }
+
+  void visit(Block *block) override {
+    auto backup_values = std::move(values);
+    auto backup_stores = std::move(pending_stores);
+    clear();
+    for (int i = 0; i < (int)block->statements.size(); i++) {
+      auto stmt = block->statements[i].get();
+      if (stmt->is_container_statement()) {
+        // Anything may happen in there
+        stmt->accept(this);
+        clear();
+      } else {
+        stmt->accept(this);
+      }
+    }
+    values = std::move(backup_values);
+    pending_stores = std::move(backup_stores);
+  }
+
+  void visit(GlobalLoadStmt *stmt) override {
+    Address address;
+    if (!get_address(stmt->ptr, address)) {
+      if (stmt->ptr->is<GlobalPtrStmt>())
+        pending_stores.clear();
+      return;
+    }
+    auto it = values.find(address);
+    if (it != values.end() && it->second->ret_type == stmt->ret_type) {
+      stmt->replace_with(it->second);
+      stmt->parent->erase(stmt);
+      throw IRModified();
+    }
+    read(address);
+    values[address] = stmt;
+  }
+
+  void visit(GlobalStoreStmt *stmt) override {
+    Address address;
+    if (!get_address(stmt->ptr, address)) {
+      if (stmt->ptr->is<GlobalPtrStmt>())
+        values.clear();
+      return;
+    }
+    auto it = pending_stores.find(address);
+    if (it != pending_stores.end()) {
+      // Overwritten before being read
+      it->second->parent->erase(it->second);
+      throw IRModified();
+    }
+    write(address);
+    // Stores to f16 cells and bit fields round the value
+    if (address.first->dt != DataType::f16 && !address.first->is_bit_field())
+      values[address] = stmt->data;
+    pending_stores[address] = stmt;
+  }
+
+  void visit(AtomicOpStmt *stmt) override {
+    Address address;
+    if (!get_address(stmt->dest, address)) {
+      if (stmt->dest->is<GlobalPtrStmt>())
+        clear();
+      return;
+    }
+    read(address);
+    write(address);
+  }
+
+  void visit(SNodeOpStmt *stmt) override {
+    // Activation and deactivation change what cells read
+    clear();
+  }
+
+  void visit(ClearAllStmt *stmt) override {
+    clear();
+  }
+
+  static void run(IRNode *root) {
+    ForwardGlobalAccesses pass;
+    while (true) {
+      try {
+        root->accept(&pass);
+      } catch (IRModified) {
+        pass.clear();
+        continue;
+      }
+      break;
+    }
+  }
+};
+
+namespace irpass {
+
+void forward_global_accesses(IRNode *root) {
+  ForwardGlobalAccesses::run(root);
+}
+
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
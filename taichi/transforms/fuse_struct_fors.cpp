@@ -0,0 +1,403 @@
+// Merges adjacent top-level struct-fors over the same leaf block, so that the
+// block list is generated and traversed once, and splits those whose bodies
+// keep too many values live
+
+#include "../ir.h"
+#include <algorithm>
+#include <map>
+
+TLANG_NAMESPACE_BEGIN
+
+class GatherLoopAccesses : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+
+  struct Access {
+    bool read = false;
+    bool write = false;
+    // Every access is to the element of the current iteration
+    bool aligned = true;
+  };
+
+  StructForStmt *for_stmt;
+  SNode *leaf_block;
+  // nullptr stands for external arrays
+  std::map<SNode *, Access> accesses;
+  std::map<Stmt *, std::pair<SNode *, bool>> pointers;
+  bool fusible;
+
+  GatherLoopAccesses(StructForStmt *for_stmt)
+      : GatherLoopAccesses(for_stmt, 0,
+                           (int)for_stmt->body->statements.size()) {
+  }
+
+  // Only the top-level statements [begin, end) of the body
+  GatherLoopAccesses(StructForStmt *for_stmt, int begin, int end)
+      : for_stmt(for_stmt) {
+    leaf_block = for_stmt->snode->parent;
+    fusible = true;
+    for (int i = begin; i < end; i++)
+      for_stmt->body->statements[i]->accept(this);
+  }
+
+  bool is_loop_index(Stmt *index, int i) {
+    auto diff = analysis::value_diff(index, 0, for_stmt->loop_vars[i]);
+    return diff.linear_related() && diff.certain() && diff.low == 0;
+  }
+
+  void visit(GlobalPtrStmt *stmt) override {
+    if (stmt->width() != 1) {
+      fusible = false;
+      return;
+    }
+    auto snode = stmt->snodes[0];
+    bool aligned = snode->parent == leaf_block &&
+                   stmt->indices.size() == for_stmt->loop_vars.size();
+    for (int i = 0; aligned && i < (int)stmt->indices.size(); i++)
+      aligned = is_loop_index(stmt->indices[i], i);
+    pointers[stmt] = {snode, aligned};
+  }
+
+  void visit(ExternalPtrStmt *stmt) override {
+    pointers[stmt] = {nullptr, false};
+  }
+
+  void access(Stmt *ptr, bool write) {
+    auto it = pointers.find(ptr);
+    if (it == pointers.end()) {
+      fusible = false;
+      return;
+    }
+    auto snode = it->second.first;
+    auto aligned = it->second.second;
+    if (write && !aligned && snode) {
+      // May activate a block that the other loop would have listed
+      for (auto p = snode->parent; p; p = p->parent) {
+        for (auto q = leaf_block; q; q = q->parent) {
+          if (p == q && p->need_activation())
+            fusible = false;
+        }
+      }
+    }
+    auto &a = accesses[snode];
+    a.read = true;
+    a.write |= write;
+    a.aligned &= aligned;
+  }
+
+  void visit(GlobalLoadStmt *stmt) override {
+    access(stmt->ptr, false);
+  }
+
+  void visit(GlobalStoreStmt *stmt) override {
+    access(stmt->ptr, true);
+  }
+
+  void visit(AtomicOpStmt *stmt) override {
+    if (!stmt->dest->is<AllocaStmt>())
+      access(stmt->dest, true);
+  }
+
+  void visit(SNodeOpStmt *stmt) override {
+    fusible = false;
+  }
+
+  void visit(ClearAllStmt *stmt) override {
+    fusible = false;
+  }
+
+  void visit(ArgStoreStmt *stmt) override {
+    fusible = false;
+  }
+
+  // No iteration of either loop may see what another iteration of the other
+  // one changed
+  bool can_fuse_with(const GatherLoopAccesses &o) const {
+    if (!fusible || !o.fusible)
+      return false;
+    for (auto &kv : accesses) {
+      auto it = o.accesses.find(kv.first);
+      if (it == o.accesses.end())
+        continue;
+      if ((kv.second.write || it->second.write) &&
+          !(kv.second.aligned && it->second.aligned))
+        return false;
+    }
+    return true;
+  }
+};
+
+// The statements that the statements of a subtree use
+class GatherOperands : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+
+  std::vector<Stmt *> operands;
+
+  GatherOperands() {
+    invoke_default_visitor = true;
+  }
+
+  void record(Stmt *stmt) {
+    for (int i = 0; i < stmt->num_operands(); i++)
+      operands.push_back(stmt->operand(i));
+  }
+
+  void visit(Stmt *stmt) override {
+    record(stmt);
+  }
+
+  void visit(IfStmt *stmt) override {
+    record(stmt);
+    BasicStmtVisitor::visit(stmt);
+  }
+
+  void visit(WhileStmt *stmt) override {
+    record(stmt);
+    BasicStmtVisitor::visit(stmt);
+  }
+
+  void visit(RangeForStmt *stmt) override {
+    record(stmt);
+    BasicStmtVisitor::visit(stmt);
+  }
+};
+
+// Splits a struct-for into consecutive struct-fors over the same leaf block
+// where its body keeps few values live. Values of the first part that the
+// second one uses are recomputed if they only depend on the loop indices,
+// constants and arguments; a cut that any other value, e.g. a local variable
+// or a load, crosses is not taken. The cost model is the peak number of
+// values of the body live at once: the values computed once per iteration
+// (indices, addresses) stay live to their last use, which the backend keeps
+// in registers next to those of every phase.
+class StructForFission {
+ public:
+  StructForStmt *for_stmt;
+  // Per top-level statement of the body
+  std::map<Stmt *, int> position;
+  std::vector<std::vector<int>> uses;
+  std::vector<bool> recomputable;
+
+  StructForFission(StructForStmt *for_stmt) : for_stmt(for_stmt) {
+    auto &statements = for_stmt->body->statements;
+    int n = (int)statements.size();
+    uses.resize(n);
+    recomputable.resize(n);
+    for (int i = 0; i < n; i++) {
+      auto stmt = statements[i].get();
+      position[stmt] = i;
+      recomputable[i] = is_recomputable(stmt);
+      GatherOperands gather;
+      stmt->accept(&gather);
+      for (auto op : gather.operands) {
+        auto it = position.find(op);
+        if (it != position.end() && it->second != i &&
+            (uses[it->second].empty() || uses[it->second].back() != i))
+          uses[it->second].push_back(i);
+      }
+    }
+  }
+
+  bool is_loop_var(Stmt *stmt) {
+    auto &vars = for_stmt->loop_vars;
+    return std::find(vars.begin(), vars.end(), stmt) != vars.end();
+  }
+
+  bool is_operand_recomputable(Stmt *op) {
+    auto it = position.find(op);
+    // Statements outside the loop are visible to both parts
+    return it == position.end() || recomputable[it->second];
+  }
+
+  bool is_recomputable(Stmt *stmt) {
+    if (stmt->width() != 1)
+      return false;
+    if (stmt->is<ConstStmt>() || stmt->is<ArgLoadStmt>())
+      return true;
+    if (auto load = stmt->cast<LocalLoadStmt>())
+      return load->ptr[0].offset == 0 && is_loop_var(load->ptr[0].var);
+    if (auto unary = stmt->cast<UnaryOpStmt>())
+      return is_operand_recomputable(unary->operand);
+    if (auto binary = stmt->cast<BinaryOpStmt>())
+      return is_operand_recomputable(binary->lhs) &&
+             is_operand_recomputable(binary->rhs);
+    return false;
+  }
+
+  // The peak number of live values of the statements [begin, end) of the
+  // body, those of the earlier statements used there recomputed at begin
+  int estimate_live_values(int begin, int end) {
+    std::vector<int> delta(end - begin + 1, 0);
+    for (int i = 0; i < end; i++) {
+      // The last use before end
+      int last = -1;
+      for (auto u : uses[i]) {
+        if (u < end)
+          last = u;
+      }
+      if (last < begin)
+        continue;
+      delta[std::max(i + 1, begin) - begin]++;
+      delta[last + 1 - begin]--;
+    }
+    int live = 0, peak = 0;
+    for (int i = 0; i < end - begin; i++) {
+      live += delta[i];
+      peak = std::max(peak, live);
+    }
+    return peak;
+  }
+
+  // Whether the body can be cut before statement p
+  bool can_cut(int p) {
+    for (int i = 0; i < p; i++) {
+      if (!uses[i].empty() && uses[i].back() >= p && !recomputable[i])
+        return false;
+    }
+    int n = (int)for_stmt->body->statements.size();
+    return GatherLoopAccesses(for_stmt, 0, p)
+        .can_fuse_with(GatherLoopAccesses(for_stmt, p, n));
+  }
+
+  // Returns a copy of the recomputable top-level statement stmt and of what
+  // it depends on, appended to block
+  Stmt *recompute(Stmt *stmt,
+                  Block *block,
+                  std::map<Stmt *, Stmt *> &copies) {
+    if (position.find(stmt) == position.end())
+      return stmt;
+    if (copies.find(stmt) != copies.end())
+      return copies[stmt];
+    std::unique_ptr<Stmt> copy;
+    if (auto c = stmt->cast<ConstStmt>()) {
+      copy = Stmt::make<ConstStmt>(c->val);
+    } else if (auto arg_load = stmt->cast<ArgLoadStmt>()) {
+      copy = Stmt::make<ArgLoadStmt>(arg_load->arg_id, arg_load->is_ptr);
+    } else if (auto load = stmt->cast<LocalLoadStmt>()) {
+      copy = Stmt::make<LocalLoadStmt>(load->ptr);
+    } else if (auto unary = stmt->cast<UnaryOpStmt>()) {
+      auto operand = recompute(unary->operand, block, copies);
+      auto copy_unary =
+          Stmt::make_typed<UnaryOpStmt>(unary->op_type, operand);
+      copy_unary->cast_type = unary->cast_type;
+      copy_unary->cast_by_value = unary->cast_by_value;
+      copy = std::move(copy_unary);
+    } else {
+      auto binary = stmt->as<BinaryOpStmt>();
+      auto lhs = recompute(binary->lhs, block, copies);
+      auto rhs = recompute(binary->rhs, block, copies);
+      copy = Stmt::make<BinaryOpStmt>(binary->op_type, lhs, rhs);
+    }
+    copy->ret_type = stmt->ret_type;
+    auto ret = copy.get();
+    block->insert(std::move(copy));
+    copies[stmt] = ret;
+    return ret;
+  }
+
+  // Moves the statements from p on into a new struct-for, which is returned
+  std::unique_ptr<StructForStmt> cut(int p) {
+    auto &statements = for_stmt->body->statements;
+    int n = (int)statements.size();
+    auto body = std::make_unique<Block>();
+    std::map<Stmt *, Stmt *> copies;
+    for (int i = 0; i < p; i++) {
+      if (!uses[i].empty() && uses[i].back() >= p)
+        recompute(statements[i].get(), body.get(), copies);
+    }
+    for (int i = p; i < n; i++)
+      body->insert(std::move(statements[i]));
+    statements.erase(statements.begin() + p, statements.end());
+    for (auto &kv : copies)
+      irpass::replace_all_usages_with(body.get(), kv.first, kv.second);
+    auto ret = std::make_unique<StructForStmt>(
+        for_stmt->loop_vars, for_stmt->snode, std::move(body),
+        for_stmt->vectorize, for_stmt->parallelize);
+    ret->block_dim = for_stmt->block_dim;
+    return ret;
+  }
+
+  // The cut that minimizes the larger estimate of the two parts, or -1 if
+  // none of them brings both under the estimate of the whole body
+  int find_cut() {
+    int n = (int)for_stmt->body->statements.size();
+    int best = -1;
+    int best_estimate = estimate_live_values(0, n);
+    for (int p = 1; p < n; p++) {
+      int estimate =
+          std::max(estimate_live_values(0, p), estimate_live_values(p, n));
+      if (estimate < best_estimate && can_cut(p)) {
+        best = p;
+        best_estimate = estimate;
+      }
+    }
+    return best;
+  }
+};
+
+namespace irpass {
+
+void fuse_struct_fors(IRNode *root) {
+  auto block = dynamic_cast<Block *>(root);
+  auto &statements = block->statements;
+  for (int i = 0; i < (int)statements.size(); i++) {
+    auto a = statements[i]->cast<StructForStmt>();
+    if (!a)
+      continue;
+    // The loop variables of the next loop are allocated in between
+    int j = i + 1;
+    while (j < (int)statements.size() && statements[j]->is<AllocaStmt>())
+      j++;
+    if (j == (int)statements.size())
+      break;
+    auto b = statements[j]->cast<StructForStmt>();
+    if (!b || a->snode->parent != b->snode->parent ||
+        a->loop_vars.size() != b->loop_vars.size() ||
+        a->vectorize != b->vectorize || a->parallelize != b->parallelize ||
+        a->block_dim != b->block_dim || !a->scratch_opt.empty() ||
+        !b->scratch_opt.empty())
+      continue;
+    bool same_indices = true;
+    for (int k = 0; k < (int)a->loop_vars.size(); k++) {
+      same_indices &= a->snode->physical_index_position[k] ==
+                      b->snode->physical_index_position[k];
+    }
+    if (!same_indices ||
+        !GatherLoopAccesses(a).can_fuse_with(GatherLoopAccesses(b)))
+      continue;
+    for (int k = 0; k < (int)a->loop_vars.size(); k++)
+      irpass::replace_all_usages_with(b->body.get(), b->loop_vars[k],
+                                      a->loop_vars[k]);
+    for (auto &s : b->body->statements)
+      a->body->insert(std::move(s));
+    statements.erase(statements.begin() + j);
+    // Try to fuse the next loop as well
+    i--;
+  }
+}
+
+void fission_struct_fors(IRNode *root, int max_live_values) {
+  auto block = dynamic_cast<Block *>(root);
+  auto &statements = block->statements;
+  for (int i = 0; i < (int)statements.size(); i++) {
+    auto s = statements[i]->cast<StructForStmt>();
+    if (!s || !s->scratch_opt.empty() || s->block_initialization ||
+        s->block_finalization)
+      continue;
+    StructForFission fission(s);
+    int n = (int)s->body->statements.size();
+    if (fission.estimate_live_values(0, n) <= max_live_values)
+      continue;
+    int p = fission.find_cut();
+    if (p == -1)
+      continue;
+    block->insert(fission.cut(p), i + 1);
+    // Either part may be split again
+    i--;
+  }
+}
+
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
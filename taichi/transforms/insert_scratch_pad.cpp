@@ -1,57 +1,90 @@
 #include "../ir.h"
 #include "../scratch_pad.h"
+#include <functional>
+#include <set>
 
 TLANG_NAMESPACE_BEGIN
 
+// Whether index i of the accesses of snode is at the loop index i of the
+// struct-for. There may be more loop indices, e.g. of the particles in a
+// dynamic list under each grid block.
+static bool indices_match_loop(SNode *snode,
+                               StructForStmt *for_stmt,
+                               std::size_t num_indices) {
+  if ((int)num_indices != snode->num_active_indices ||
+      num_indices > for_stmt->loop_vars.size())
+    return false;
+  for (int i = 0; i < (int)num_indices; i++) {
+    if (snode->physical_index_position[i] !=
+        for_stmt->snode->physical_index_position[i])
+      return false;
+  }
+  return true;
+}
+
 // Figure out accessed snodes, and their ranges in this for stmt
 class AccessAnalysis : public IRVisitor {
  public:
   StructForStmt *for_stmt;
   ScratchPads *pads;
 
-  std::vector<std::vector<int>> block_indices;
-
   AccessAnalysis(StructForStmt *for_stmt, ScratchPads *pads)
       : for_stmt(for_stmt), pads(pads) {
     allow_undefined_visitor = true;
     invoke_default_visitor = false;
 
-    TC_WARN(
-        "Using the size of scratch_opt[0].second as the snode size to cache");
-    generate_block_indices(for_stmt->scratch_opt[0].second->parent, {}, 0);
+    for_stmt->body->accept(this);
+  }
 
-    const auto &block = for_stmt->body;
+  void visit(Block *block) override {
+    for (auto &stmt : block->statements)
+      stmt->accept(this);
+  }
 
-    for (int i = 0; i < (int)block->statements.size(); i++) {
-      block->statements[i]->accept(this);
-    }
+  // Accesses under control flow are assumed to happen
+  void visit(IfStmt *if_stmt) override {
+    if (if_stmt->true_statements)
+      if_stmt->true_statements->accept(this);
+    if (if_stmt->false_statements)
+      if_stmt->false_statements->accept(this);
+  }
 
-    pads->print();
+  void visit(RangeForStmt *stmt) override {
+    stmt->body->accept(this);
   }
 
-  void generate_block_indices(SNode *snode, std::vector<int> index, int s) {
-    // NOTE: Assuming not vectorized
-    if (s == max_num_indices) {
-      block_indices.push_back(index);
-      return;
-    }
+  void visit(WhileStmt *stmt) override {
+    stmt->body->accept(this);
+  }
 
-    if (snode->extractors[s].active) {
-      for (int i = 0; i < (1 << snode->extractors[s].num_bits); i++) {
-        auto new_index = index;
-        new_index.push_back(i);
-        generate_block_indices(snode, new_index, s + 1);
+  // The offsets of the cells of a leaf block from its corner along the first
+  // num_indices loop indices. Indices the leaf does not split, such as those
+  // of the grid block a dynamic list of particles is under, stay at 0.
+  std::vector<std::vector<int>> block_indices(int num_indices) {
+    auto leaf = for_stmt->snode->parent;
+    std::vector<std::vector<int>> ret = {{}};
+    for (int i = 0; i < num_indices; i++) {
+      auto &e = leaf->extractors[for_stmt->snode->physical_index_position[i]];
+      int n = e.active ? 1 << e.num_bits : 1;
+      std::vector<std::vector<int>> next;
+      for (auto &index : ret) {
+        for (int j = 0; j < n; j++) {
+          next.push_back(index);
+          next.back().push_back(j);
+        }
       }
-    } else {
-      generate_block_indices(snode, index, s + 1);
+      ret = std::move(next);
     }
+    return ret;
   }
 
   void visit(GlobalPtrStmt *stmt) override {
   }
 
   void access(Stmt *stmt, AccessFlag flag) {
-    auto ptr = stmt->as<GlobalPtrStmt>();
+    auto ptr = stmt->cast<GlobalPtrStmt>();
+    if (!ptr)
+      return;
     for (int l = 0; l < stmt->width(); l++) {
       auto snode = ptr->snodes[l];
       // std::vector<SNode *> snodes;
@@ -65,11 +98,12 @@ class AccessAnalysis : public IRVisitor {
       if (!pads->has(snode)) {
         continue;
       }
-      bool matching_indices = true;
+      bool matching_indices =
+          indices_match_loop(snode, for_stmt, ptr->indices.size());
       std::vector<std::pair<int, int>> offsets;
       offsets.resize(ptr->indices.size());
       int num_indices = (int)ptr->indices.size();
-      for (int i = 0; i < num_indices; i++) {
+      for (int i = 0; matching_indices && i < num_indices; i++) {
         auto diff =
             analysis::value_diff(ptr->indices[i], l, for_stmt->loop_vars[i]);
         if (diff.linear_related()) {
@@ -96,7 +130,7 @@ class AccessAnalysis : public IRVisitor {
           TC_P(offsets[i]);
         }
         */
-        for (const auto &bind : block_indices) {
+        for (const auto &bind : block_indices(num_indices)) {
           std::function<void(std::vector<int>, int)> visit =
               [&](std::vector<int> ind, int depth) {
                 if (depth == num_indices) {
@@ -173,8 +207,10 @@ class InsertScratchPad : public IRVisitor {
   void visit(StructForStmt *for_stmt) override {
     // do the work here...
     if (!for_stmt->scratch_opt.empty()) {
+      // Only ti.cache_shared needs a scratch pad
       for (auto &opt : for_stmt->scratch_opt) {
-        pads->insert(opt.second);
+        if (opt.first == 0)
+          pads->insert(opt.second);
       }
       AccessAnalysis _(for_stmt, pads.get());
       // WeakenAccess _(for_stmt);
@@ -187,6 +223,303 @@ class InsertScratchPad : public IRVisitor {
   }
 };
 
+// Serves the accesses of a GPU struct-for to the SNodes cached with
+// ti.cache_shared from scratch pads in shared memory. The block
+// initialization loads the cells a leaf block reads (including the halo) into
+// the pads, and the block finalization writes back or accumulates the cells it
+// writes.
+class MakeScratchPads : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+  using AccessFlag = ScratchPad::AccessFlag;
+
+  // Static shared memory available to a thread block
+  static constexpr std::size_t max_scratch_pad_size = 48 << 10;
+
+  StructForStmt *for_stmt;
+  int block_dim;
+  std::unique_ptr<ScratchPads> pads;
+  std::map<SNode *, std::vector<GlobalPtrStmt *>> pointers;
+  // SNodes with accesses that a scratch pad cannot serve
+  std::set<SNode *> irregular;
+  // SNodes stored to by statements that some iterations may skip
+  std::set<SNode *> conditionally_written;
+  bool changes_structure;
+
+  MakeScratchPads(StructForStmt *for_stmt, int block_dim)
+      : for_stmt(for_stmt), block_dim(block_dim) {
+    changes_structure = false;
+    pads = irpass::initialize_scratch_pad(for_stmt);
+    for_stmt->body->accept(this);
+  }
+
+  void visit(GlobalPtrStmt *stmt) override {
+    for (int l = 0; l < stmt->width(); l++) {
+      auto snode = stmt->snodes[l];
+      if (!pads->has(snode))
+        continue;
+      pointers[snode].push_back(stmt);
+      bool regular = stmt->width() == 1 &&
+                     indices_match_loop(snode, for_stmt, stmt->indices.size());
+      for (int i = 0; regular && i < (int)stmt->indices.size(); i++) {
+        regular = analysis::value_diff(stmt->indices[i], 0,
+                                       for_stmt->loop_vars[i])
+                      .linear_related();
+      }
+      if (!regular)
+        irregular.insert(snode);
+    }
+  }
+
+  void visit(GlobalStoreStmt *stmt) override {
+    auto ptr = stmt->ptr->cast<GlobalPtrStmt>();
+    if (ptr && stmt->parent != for_stmt->body.get()) {
+      for (int l = 0; l < ptr->width(); l++)
+        conditionally_written.insert(ptr->snodes[l]);
+    }
+  }
+
+  void visit(AtomicOpStmt *stmt) override {
+    auto ptr = stmt->dest->cast<GlobalPtrStmt>();
+    if (ptr && stmt->op_type != AtomicOpType::add) {
+      for (int l = 0; l < ptr->width(); l++)
+        irregular.insert(ptr->snodes[l]);
+    }
+  }
+
+  void visit(SNodeOpStmt *stmt) override {
+    if (stmt->op_type != SNodeOpType::probe &&
+        stmt->op_type != SNodeOpType::is_active)
+      changes_structure = true;
+  }
+
+  void visit(ClearAllStmt *stmt) override {
+    changes_structure = true;
+  }
+
+  std::string unsupported_reason(SNode *snode, ScratchPad &pad) {
+    if (changes_structure)
+      return "the loop changes the data structure";
+    if (irregular.count(snode))
+      return "not every access is at a constant offset from the loop index";
+    if (!pad.is_pure())
+      return "reads, writes and atomic adds cannot be mixed";
+    if (pad.total_flags == AccessFlag::write) {
+      // Every entry is written back, so every entry must have been written
+      auto leaf_block = for_stmt->snode->parent;
+      if (leaf_block->type != SNodeType::dense)
+        return "the leaf block may have inactive cells";
+      if (block_dim < leaf_block->max_num_elements())
+        return "the leaf block is shared by several thread blocks";
+      if (conditionally_written.count(snode))
+        return "some iterations may skip the writes";
+      for (auto flag : pad.flags) {
+        if (flag == AccessFlag(0))
+          return "the writes do not cover the scratch pad";
+      }
+    }
+    return "";
+  }
+
+  static Stmt *constant(VecStatement &stmts, int32 val) {
+    return stmts.push_back<ConstStmt>(TypedConstant(val));
+  }
+
+  static Stmt *binary(VecStatement &stmts,
+                      BinaryOpType op,
+                      Stmt *lhs,
+                      Stmt *rhs) {
+    return stmts.push_back<BinaryOpStmt>(op, lhs, rhs);
+  }
+
+  Stmt *corner(VecStatement &stmts, int i) {
+    return stmts.push_back<BlockCornerIndexStmt>(
+        for_stmt->snode->physical_index_position[i]);
+  }
+
+  static Stmt *entry_ptr(VecStatement &stmts,
+                         ScratchPad &pad,
+                         std::size_t base,
+                         Stmt *linear) {
+    auto dt = pad.snode->dt;
+    auto offset = binary(
+        stmts, BinaryOpType::add,
+        binary(stmts, BinaryOpType::mul, linear,
+               constant(stmts, (int32)data_type_size(dt))),
+        constant(stmts, (int32)base));
+    return stmts.push_back<ScratchPadPtrStmt>(offset, VectorType(1, dt));
+  }
+
+  void promote_pointer(GlobalPtrStmt *ptr, ScratchPad &pad, std::size_t base) {
+    VecStatement stmts;
+    Stmt *linear = nullptr;
+    for (int i = 0; i < pad.dim; i++) {
+      auto local =
+          binary(stmts, BinaryOpType::sub, ptr->indices[i], corner(stmts, i));
+      local = binary(stmts, BinaryOpType::sub, local,
+                     constant(stmts, pad.bounds[0][i]));
+      if (linear) {
+        linear = binary(stmts, BinaryOpType::mul, linear,
+                        constant(stmts, pad.pad_size[i]));
+        linear = binary(stmts, BinaryOpType::add, linear, local);
+      } else {
+        linear = local;
+      }
+    }
+    entry_ptr(stmts, pad, base, linear);
+    ptr->parent->replace_with(ptr, stmts);
+  }
+
+  using EntryFunc = std::function<
+      void(VecStatement &, Stmt *, const std::vector<Stmt *> &)>;
+
+  // Appends to block a loop in which the threads of a thread block visit the
+  // entries of the pad. func emits the work on one entry, given its pointer
+  // and the global indices of its cell.
+  void for_each_entry(Block *block,
+                      ScratchPad &pad,
+                      std::size_t base,
+                      const EntryFunc &func) {
+    int size = pad.linear_size();
+    VecStatement loop;
+    auto round = loop.push_back<AllocaStmt>(DataType::i32);
+    auto begin = constant(loop, 0);
+    auto end = constant(loop, (size + block_dim - 1) / block_dim);
+
+    VecStatement body;
+    auto j = body.push_back<LocalLoadStmt>(LocalAddress(round, 0));
+    auto flat = binary(body, BinaryOpType::add,
+                       binary(body, BinaryOpType::mul, j,
+                              constant(body, block_dim)),
+                       body.push_back<ThreadIndexStmt>());
+
+    VecStatement entry;
+    std::vector<Stmt *> indices;
+    int stride = size;
+    for (int i = 0; i < pad.dim; i++) {
+      stride /= pad.pad_size[i];
+      auto local = binary(entry, BinaryOpType::div, flat,
+                          constant(entry, stride));
+      local = binary(entry, BinaryOpType::mod, local,
+                     constant(entry, pad.pad_size[i]));
+      local = binary(entry, BinaryOpType::add, local,
+                     constant(entry, pad.bounds[0][i]));
+      indices.push_back(
+          binary(entry, BinaryOpType::add, corner(entry, i), local));
+    }
+    func(entry, entry_ptr(entry, pad, base, flat), indices);
+
+    if (size % block_dim != 0) {
+      auto inside =
+          binary(body, BinaryOpType::cmp_lt, flat, constant(body, size));
+      auto if_stmt = body.push_back<IfStmt>(inside);
+      if_stmt->true_statements = std::make_unique<Block>();
+      if_stmt->true_statements->set_statements(std::move(entry));
+    } else {
+      for (int i = 0; i < (int)entry.size(); i++)
+        body.push_back(std::move(entry[i]));
+    }
+    auto body_block = std::make_unique<Block>();
+    body_block->set_statements(std::move(body));
+    loop.push_back<RangeForStmt>(round, begin, end, std::move(body_block), 1,
+                                 0, false);
+    for (int i = 0; i < (int)loop.size(); i++)
+      block->insert(std::move(loop[i]));
+  }
+
+  static void add_to_block(std::unique_ptr<Block> &block,
+                           const std::function<void(Block *)> &func) {
+    if (!block)
+      block = std::make_unique<Block>();
+    func(block.get());
+  }
+
+  void stage(ScratchPad &pad, std::size_t base) {
+    auto snode = pad.snode;
+    for (auto ptr : pointers[snode])
+      promote_pointer(ptr, pad, base);
+    auto global_ptr = [snode](VecStatement &stmts,
+                              const std::vector<Stmt *> &indices) {
+      return stmts.push_back<GlobalPtrStmt>(LaneAttribute<SNode *>(snode),
+                                            indices);
+    };
+    if (pad.total_flags == AccessFlag::read) {
+      add_to_block(for_stmt->block_initialization, [&](Block *block) {
+        for_each_entry(block, pad, base,
+                       [&](VecStatement &stmts, Stmt *pad_ptr,
+                           const std::vector<Stmt *> &indices) {
+                         auto ptr = global_ptr(stmts, indices);
+                         ptr->as<GlobalPtrStmt>()->activate = false;
+                         auto val = stmts.push_back<GlobalLoadStmt>(ptr);
+                         stmts.push_back<GlobalStoreStmt>(pad_ptr, val);
+                       });
+      });
+    } else if (pad.total_flags == AccessFlag::write) {
+      add_to_block(for_stmt->block_finalization, [&](Block *block) {
+        for_each_entry(block, pad, base,
+                       [&](VecStatement &stmts, Stmt *pad_ptr,
+                           const std::vector<Stmt *> &indices) {
+                         auto val = stmts.push_back<GlobalLoadStmt>(pad_ptr);
+                         stmts.push_back<GlobalStoreStmt>(
+                             global_ptr(stmts, indices), val);
+                       });
+      });
+    } else {
+      add_to_block(for_stmt->block_initialization, [&](Block *block) {
+        for_each_entry(block, pad, base,
+                       [&](VecStatement &stmts, Stmt *pad_ptr,
+                           const std::vector<Stmt *> &indices) {
+                         auto zero = stmts.push_back<ConstStmt>(
+                             TypedConstant(snode->dt));
+                         stmts.push_back<GlobalStoreStmt>(pad_ptr, zero);
+                       });
+      });
+      // Cells no iteration added to are left alone, so that they are not
+      // activated
+      add_to_block(for_stmt->block_finalization, [&](Block *block) {
+        for_each_entry(
+            block, pad, base,
+            [&](VecStatement &stmts, Stmt *pad_ptr,
+                const std::vector<Stmt *> &indices) {
+              auto val = stmts.push_back<GlobalLoadStmt>(pad_ptr);
+              auto zero =
+                  stmts.push_back<ConstStmt>(TypedConstant(snode->dt));
+              auto nonzero =
+                  binary(stmts, BinaryOpType::cmp_ne, val, zero);
+              auto if_stmt = stmts.push_back<IfStmt>(nonzero);
+              VecStatement add;
+              add.push_back<AtomicOpStmt>(AtomicOpType::add,
+                                          global_ptr(add, indices), val);
+              if_stmt->true_statements = std::make_unique<Block>();
+              if_stmt->true_statements->set_statements(std::move(add));
+            });
+      });
+    }
+  }
+
+  // Returns the bytes of shared memory the staged pads take
+  std::size_t run() {
+    std::size_t size = 0;
+    for (auto &kv : pads->pads) {
+      auto snode = kv.first;
+      auto &pad = kv.second;
+      auto reason = unsupported_reason(snode, pad);
+      auto base = (size + 7) / 8 * 8;
+      auto bytes = pad.linear_size() * data_type_size(snode->dt);
+      if (reason.empty() && base + bytes > max_scratch_pad_size)
+        reason = fmt::format("{} B exceeds the shared memory left", bytes);
+      if (!reason.empty()) {
+        TC_WARN("Not caching {} in shared memory: {}.",
+                snode->get_node_type_name_hinted(), reason);
+        continue;
+      }
+      stage(pad, base);
+      size = base + bytes;
+    }
+    return size;
+  }
+};
+
 namespace irpass {
 
 std::unique_ptr<ScratchPads> initialize_scratch_pad(StructForStmt *root) {
@@ -194,6 +527,34 @@ std::unique_ptr<ScratchPads> initialize_scratch_pad(StructForStmt *root) {
   return _.get();
 }
 
+// GPU only: the scratch pads live in the shared memory of a thread block
+void insert_scratch_pads(IRNode *root) {
+  auto block = dynamic_cast<Block *>(root);
+  bool modified = false;
+  for (auto &stmt : block->statements) {
+    auto for_stmt = stmt->cast<StructForStmt>();
+    if (!for_stmt || for_stmt->scratch_opt.empty())
+      continue;
+    // The block dim the struct-for will be launched with
+    int block_dim = for_stmt->block_dim;
+    if (block_dim == 0)
+      block_dim = get_current_program().config.default_gpu_block_dim;
+    block_dim = std::min(for_stmt->snode->parent->max_num_elements(),
+                         block_dim);
+    MakeScratchPads pass(for_stmt, block_dim);
+    auto size = pass.run();
+    if (size) {
+      for_stmt->block_dim = block_dim;
+      for_stmt->scratch_pad_size = size;
+      modified = true;
+    }
+  }
+  if (modified) {
+    fix_block_parents(root);
+    typecheck(root);
+  }
+}
+
 }  // namespace irpass
 
 TLANG_NAMESPACE_END
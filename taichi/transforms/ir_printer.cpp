@@ -1,6 +1,7 @@
 // The IRPrinter prints the IR in a human-readable format
 
 #include <typeinfo>
+#include <sstream>
 #include "../ir.h"
 
 TLANG_NAMESPACE_BEGIN
@@ -9,7 +10,10 @@ class IRPrinter : public IRVisitor {
  public:
   int current_indent;
 
-  IRPrinter() {
+  std::string *output;
+  std::stringstream ss;
+
+  IRPrinter(std::string *output = nullptr) : output(output) {
     current_indent = 0;
   }
 
@@ -20,18 +24,25 @@ class IRPrinter : public IRVisitor {
 
   void print_raw(std::string f) {
     for (int i = 0; i < current_indent; i++)
-      fmt::print("  ");
-    std::cout << f;
-    fmt::print("\n");
+      f.insert(0, "  ");
+    f += "\n";
+    if (output) {
+      ss << f;
+    } else {
+      std::cout << f;
+    }
   }
 
-  static void run(IRNode *node) {
-    auto p = IRPrinter();
-    fmt::print("==========\n");
-    fmt::print("kernel {{\n");
+  static void run(IRNode *node, std::string *output) {
+    auto p = IRPrinter(output);
+    p.print("==========");
+    p.print("kernel {{");
     node->accept(&p);
-    fmt::print("}}\n");
-    fmt::print("==========\n");
+    p.print("}}");
+    p.print("==========");
+    if (output) {
+      *output = p.ss.str();
+    }
   }
 
   void visit(Block *stmt_list) override {
@@ -64,6 +75,15 @@ class IRPrinter : public IRVisitor {
           assert->text);
   }
 
+  void visit(BoundCheckStmt *stmt) override {
+    std::string indices;
+    for (int i = 0; i < (int)stmt->indices.size(); i++) {
+      indices += (i ? ", " : "") + stmt->indices[i]->name();
+    }
+    print("{} : bound check {} #{} [{}]", stmt->id, stmt->in_bound->name(),
+          stmt->check_id, indices);
+  }
+
   void visit(FrontendSNodeOpStmt *stmt) override {
     std::string extras = "[";
     for (int i = 0; i < (int)stmt->indices.size(); i++) {
@@ -128,7 +148,8 @@ class IRPrinter : public IRVisitor {
   }
 
   void visit(AtomicOpStmt *stmt) override {
-    print("{}{} = atomic {}({}, {})", stmt->type_hint(), stmt->name(),
+    print("{}{} = atomic {}{}({}, {})", stmt->type_hint(), stmt->name(),
+          stmt->is_reduction ? "reduce " : "",
           atomic_op_type_name(stmt->op_type), stmt->dest->name(),
           stmt->val->name());
   }
@@ -220,10 +241,23 @@ class IRPrinter : public IRVisitor {
         [](Stmt *const &stmt) -> std::string { return stmt->name(); });
     print("for {} where {} active, step {} {{", loop_vars,
           for_stmt->snode->get_node_type_name_hinted(), for_stmt->vectorize);
+    print_optional_block("block initialization", for_stmt->block_initialization);
     for_stmt->body->accept(this);
+    print_optional_block("block finalization", for_stmt->block_finalization);
     print("}}");
   }
 
+  void print_optional_block(const std::string &name,
+                          const std::unique_ptr<Block> &block) {
+    if (!block)
+      return;
+    current_indent++;
+    print("{} {{", name);
+    block->accept(this);
+    print("}}");
+    current_indent--;
+  }
+
   void visit(GlobalPtrStmt *stmt) override {
     std::string s =
         fmt::format("{}{} = global ptr [", stmt->type_hint(), stmt->name());
@@ -312,7 +346,8 @@ class IRPrinter : public IRVisitor {
         stmt->strides,
         [&](const int &stride) { return std::to_string(stride); }, "{");
 
-    print("{} = linearized(ind {}, stride {})", stmt->name(), ind, stride);
+    print("{} = linearized{}(ind {}, stride {})", stmt->name(),
+          stmt->morton ? "_morton" : "", ind, stride);
   }
 
   void visit(IntegerOffsetStmt *stmt) override {
@@ -326,7 +361,11 @@ class IRPrinter : public IRVisitor {
   }
 
   void visit(GetRootStmt *stmt) override {
-    print("{} = get root", stmt->name());
+    if (stmt->root)
+      print("{} = get root [{}]", stmt->name(),
+            stmt->root->get_node_type_name_hinted());
+    else
+      print("{} = get root", stmt->name());
   }
 
   void visit(SNodeLookupStmt *stmt) override {
@@ -347,8 +386,9 @@ class IRPrinter : public IRVisitor {
   }
 
   void visit(ClearAllStmt *stmt) override {
-    print("{} = clear {} deactivate={}", stmt->name(),
-          stmt->snode->get_node_type_name_hinted(), stmt->deactivate);
+    print("{} = clear {} deactivate={} defragment={} only_ambient={}",
+          stmt->name(), stmt->snode->get_node_type_name_hinted(),
+          stmt->deactivate, stmt->defragment, stmt->only_ambient);
   }
 
   void visit(ExternalPtrStmt *stmt) override {
@@ -375,10 +415,26 @@ class IRPrinter : public IRVisitor {
   void visit(OffloadedStmt *stmt) override {
     std::string details;
     if (stmt->task_type == stmt->range_for) {
-      details = fmt::format("range_for({}, {})", stmt->begin, stmt->end);
+      // Bounds known only at run time are shown by their temporaries
+      auto bound = [](bool is_const, int val, std::size_t offset) {
+        return is_const ? std::to_string(val)
+                        : fmt::format("tmp[{}]", offset);
+      };
+      details = fmt::format(
+          "{}range_for({}, {}) block_dim={} cpu_threads={} schedule={}",
+          stmt->reversed ? "reversed " : "",
+          bound(stmt->const_begin, stmt->begin, stmt->begin_offset),
+          bound(stmt->const_end, stmt->end, stmt->end_offset), stmt->block_dim, stmt->num_cpu_threads,
+          cpu_schedule_name(stmt->schedule));
     } else if (stmt->task_type == stmt->struct_for) {
-      details = fmt::format("struct_for({})",
-                            stmt->snode->get_node_type_name_hinted());
+      details = fmt::format("struct_for({}) block_dim={}",
+                            stmt->snode->get_node_type_name_hinted(),
+                            stmt->block_dim);
+      if (stmt->scratch_pad_size)
+        details += fmt::format(" scratch_pads={} B", stmt->scratch_pad_size);
+    }
+    if (stmt->concurrent_with_next) {
+      details += " concurrent_with_next";
     }
     if (stmt->task_type == OffloadedStmt::TaskType::listgen) {
       print("{} = offloaded listgen {}", stmt->name(),
@@ -386,10 +442,28 @@ class IRPrinter : public IRVisitor {
     } else if (stmt->task_type == OffloadedStmt::TaskType::clear_list) {
       print("{} = offloaded clear_list {}", stmt->name(),
             stmt->snode->get_node_type_name_hinted());
+    } else if (stmt->task_type == OffloadedStmt::TaskType::gc) {
+      print("{} = offloaded gc {}", stmt->name(),
+            stmt->snode->get_node_type_name_hinted());
+    } else if (stmt->task_type == OffloadedStmt::TaskType::zero_fill) {
+      print("{} = offloaded zero_fill {}", stmt->name(),
+            stmt->snode->get_node_type_name_hinted());
+    } else if (stmt->task_type == OffloadedStmt::TaskType::deactivate_all) {
+      print("{} = offloaded deactivate_all {}", stmt->name(),
+            stmt->snode->get_node_type_name_hinted());
+    } else if (stmt->task_type == OffloadedStmt::TaskType::defragment) {
+      print("{} = offloaded defragment {}", stmt->name(),
+            stmt->snode->get_node_type_name_hinted());
+    } else if (stmt->task_type ==
+               OffloadedStmt::TaskType::deactivate_ambient) {
+      print("{} = offloaded deactivate_ambient {}", stmt->name(),
+            stmt->snode->get_node_type_name_hinted());
     } else {
       print("{} = offloaded {} {{", stmt->name(), details);
       TC_ASSERT(stmt->body);
+      print_optional_block("block initialization", stmt->block_initialization);
       stmt->body->accept(this);
+      print_optional_block("block finalization", stmt->block_finalization);
       print("}}");
     }
   }
@@ -402,12 +476,43 @@ class IRPrinter : public IRVisitor {
     print("{}{} = global tmp var (offset = {} B)", stmt->type_hint(),
           stmt->name(), stmt->offset);
   }
+
+  void visit(BlockCornerIndexStmt *stmt) override {
+    print("{}{} = block corner index {}", stmt->type_hint(), stmt->name(),
+          stmt->index);
+  }
+
+  void visit(ThreadIndexStmt *stmt) override {
+    print("{}{} = thread index", stmt->type_hint(), stmt->name());
+  }
+
+  void visit(ScratchPadPtrStmt *stmt) override {
+    print("{}{} = scratch pad ptr (offset = {} B)", stmt->type_hint(),
+          stmt->name(), stmt->offset->name());
+  }
+
+  void visit(MatmulStmt *stmt) override {
+    auto names = [](const std::vector<Stmt *> &stmts) {
+      std::string ret;
+      for (auto s : stmts)
+        ret += (ret.empty() ? "" : ", ") + s->name();
+      return ret;
+    };
+    print("{}{} = {}matmul<{}x{}x{}>([{}], [{}])", stmt->type_hint(),
+          stmt->name(), stmt->tensor_cores ? "warp_" : "", stmt->n, stmt->k,
+          stmt->m, names(stmt->a), names(stmt->b));
+  }
+
+  void visit(MatmulResultStmt *stmt) override {
+    print("{}{} = {}[{}]", stmt->type_hint(), stmt->name(), stmt->mm->name(),
+          stmt->index);
+  }
 };
 
 namespace irpass {
 
-void print(IRNode *root) {
-  return IRPrinter::run(root);
+void print(IRNode *root, std::string *output) {
+  return IRPrinter::run(root, output);
 }
 
 }  // namespace irpass
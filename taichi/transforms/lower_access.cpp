@@ -1,4 +1,5 @@
 #include "../ir.h"
+#include "../program.h"
 #include <deque>
 #include <set>
 
@@ -43,10 +44,33 @@ class LowerAccess : public IRVisitor {
 
   void visit(StructForStmt *for_stmt) override {
     current_struct_for = for_stmt;
+    if (for_stmt->block_initialization)
+      for_stmt->block_initialization->accept(this);
     for_stmt->body->accept(this);
+    if (for_stmt->block_finalization)
+      for_stmt->block_finalization->accept(this);
     current_struct_for = nullptr;
   }
 
+  // Whether snode is the dense leaf block of the current struct-for, looked
+  // up at the loop indices plus constants. Such cells, e.g. the neighbors in
+  // a stencil, are mostly in the block of the current element.
+  bool near_loop_block(SNode *snode, const std::vector<Stmt *> &indices) {
+    if (!current_struct_for ||
+        !get_current_program().config.block_local_access ||
+        current_struct_for->snode->parent != snode ||
+        snode->type != SNodeType::dense || snode->halo_width() != 0 ||
+        indices.size() != current_struct_for->loop_vars.size())
+      return false;
+    for (int j = 0; j < (int)indices.size(); j++) {
+      auto diff =
+          analysis::value_diff(indices[j], 0, current_struct_for->loop_vars[j]);
+      if (!diff.linear_related() || !diff.certain())
+        return false;
+    }
+    return true;
+  }
+
   void lower_scalar_ptr(VecStatement &lowered,
                         SNode *snode,
                         std::vector<Stmt *> indices,
@@ -59,11 +83,24 @@ class LowerAccess : public IRVisitor {
       }
     }
 
+    // Logical indices start after the halo
+    std::vector<Stmt *> physical_indices = indices;
+    if (int halo = snode->halo_width()) {
+      auto offset = lowered.push_back<ConstStmt>(TypedConstant(halo));
+      for (auto &ind : physical_indices) {
+        ind = lowered.push_back<BinaryOpStmt>(BinaryOpType::add, ind, offset);
+        ind->ret_type.data_type = DataType::i32;
+      }
+    }
+
     std::deque<SNode *> snodes;
     for (; snode != nullptr; snode = snode->parent)
       snodes.push_front(snode);
 
-    Stmt *last = lowered.push_back<GetRootStmt>();
+    auto root = snodes.front();
+    if (root == get_current_program().snode_root)
+      root = nullptr;
+    Stmt *last = lowered.push_back<GetRootStmt>(root);
     for (int i = 0; i < (int)snodes.size() - 1; i++) {
       auto snode = snodes[i];
       std::vector<Stmt *> lowered_indices;
@@ -75,7 +112,7 @@ class LowerAccess : public IRVisitor {
             int begin = snode->extractors[k].start;
             int end = begin + snode->extractors[k].num_bits;
             auto extracted = Stmt::make<OffsetAndExtractBitsStmt>(
-                indices[k_], begin, end, 0);
+                physical_indices[k_], begin, end, 0);
             lowered_indices.push_back(extracted.get());
             lowered.push_back(std::move(extracted));
             strides.push_back(1 << snode->extractors[k].num_bits);
@@ -106,7 +143,8 @@ class LowerAccess : public IRVisitor {
 
       // linearize
       auto linearized =
-          lowered.push_back<LinearizeStmt>(lowered_indices, strides);
+          lowered.push_back<LinearizeStmt>(lowered_indices, strides,
+                                           snode->_morton);
 
       int chid = snode->child_id(snodes[i + 1]);
       auto lookup = lowered.push_back<SNodeLookupStmt>(
@@ -114,6 +152,9 @@ class LowerAccess : public IRVisitor {
           snode->need_activation() && activate && !on_loop_tree,
           indices);  // if snode has no possibility of null child, set activate
       // = false
+      // Only loads, since the activation of the lookups leading to the block
+      // would have to run anyway
+      lookup->in_loop_block = !activate && near_loop_block(snode, indices);
       last = lowered.push_back<GetChStmt>(lookup, chid);
     }
   }
@@ -164,7 +205,9 @@ class LowerAccess : public IRVisitor {
 
   void visit(SNodeOpStmt *stmt) override {
     if (stmt->ptr->is<GlobalPtrStmt>()) {
-      auto lowered = lower_vector_ptr(stmt->ptr->as<GlobalPtrStmt>(), true);
+      // Queries must not activate the cells they look at
+      auto lowered = lower_vector_ptr(stmt->ptr->as<GlobalPtrStmt>(),
+                                      stmt->op_type != SNodeOpType::is_active);
       stmt->ptr = lowered.back().get();
       stmt->parent->insert_before(stmt, std::move(lowered));
       throw IRModified();
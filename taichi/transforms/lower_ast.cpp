@@ -172,15 +172,20 @@ class LowerAST : public IRVisitor {
           end->stmt, std::move(stmt->body), stmt->vectorize, stmt->parallelize,
           stmt->strictly_serialized);
       new_for->block_dim = stmt->block_dim;
+      new_for->schedule = stmt->schedule;
       flattened.push_back(std::move(new_for));
     } else {
       std::vector<Stmt *> vars(stmt->loop_var_id.size());
       for (int i = 0; i < (int)stmt->loop_var_id.size(); i++) {
         vars[i] = stmt->parent->lookup_var(stmt->loop_var_id[i]);
       }
+      auto snode = stmt->global_var.cast<GlobalVariableExpression>()->snode;
+      // The fields of a bit_struct share its cells, which are iterated over
+      if (snode->is_bit_field())
+        snode = snode->parent;
       auto &&new_for = std::make_unique<StructForStmt>(
-          vars, stmt->global_var.cast<GlobalVariableExpression>()->snode,
-          std::move(stmt->body), stmt->vectorize, stmt->parallelize);
+          vars, snode, std::move(stmt->body), stmt->vectorize,
+          stmt->parallelize);
       new_for->scratch_opt = stmt->scratch_opt;
       new_for->block_dim = stmt->block_dim;
       flattened.push_back(std::move(new_for));
@@ -276,10 +281,16 @@ class LowerAST : public IRVisitor {
       indices_stmt[i] = stmt->indices[i]->stmt;
     }
 
-    auto ptr =
-        flattened.push_back<GlobalPtrStmt>(stmt->snode->parent, indices_stmt);
-    flattened.push_back<SNodeOpStmt>(stmt->op_type, stmt->snode->parent, ptr,
-                                     val_stmt);
+    auto snode = stmt->snode->parent;
+    if (stmt->op_type == SNodeOpType::deactivate) {
+      // Deactivate the innermost sparse cell holding the element
+      while ((snode->type == SNodeType::dense ||
+              snode->type == SNodeType::bit_struct) &&
+             snode->parent)
+        snode = snode->parent;
+    }
+    auto ptr = flattened.push_back<GlobalPtrStmt>(snode, indices_stmt);
+    flattened.push_back<SNodeOpStmt>(stmt->op_type, snode, ptr, val_stmt);
 
     stmt->parent->replace_with(stmt, flattened);
     throw IRModified();
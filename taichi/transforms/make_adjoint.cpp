@@ -66,14 +66,44 @@ class MakeAdjoint : public IRVisitor {
  public:
   Block *current_block;
   int for_depth;
+  // Keep the global stores and atomics of the primal kernel
+  bool keep_primal;
 
-  MakeAdjoint() {
+  MakeAdjoint(bool keep_primal) : keep_primal(keep_primal) {
     current_block = nullptr;
     for_depth = 0;
   }
 
-  static void run(IRNode *node) {
-    auto p = MakeAdjoint();
+  static bool has_global_side_effects(Stmt *stmt) {
+    if (stmt->is<GlobalStoreStmt>())
+      return true;
+    if (auto atomic = stmt->cast<AtomicOpStmt>())
+      return !atomic->dest->is<AllocaStmt>();
+    return stmt->is_container_statement();
+  }
+
+  // The adjoint of each offloaded task directly follows its primal
+  // computation, which must then be the only task with side effects
+  static void check_single_task(IRNode *node) {
+    auto block = dynamic_cast<Block *>(node);
+    TC_ASSERT(block);
+    int num_loops = 0;
+    bool serial_side_effects = false;
+    for (auto &s : block->statements) {
+      if (s->is<RangeForStmt>() || s->is<StructForStmt>())
+        num_loops++;
+      else if (has_global_side_effects(s.get()))
+        serial_side_effects = true;
+    }
+    TC_ERROR_UNLESS(num_loops <= 1 && !(num_loops == 1 && serial_side_effects),
+                    "Kernels that run their primal and adjoint together can "
+                    "only have a single top-level for loop");
+  }
+
+  static void run(IRNode *node, bool keep_primal) {
+    if (keep_primal)
+      check_single_task(node);
+    auto p = MakeAdjoint(keep_primal);
     node->accept(&p);
   }
 
@@ -271,6 +301,17 @@ class MakeAdjoint : public IRVisitor {
   }
 
   void visit(StructForStmt *for_stmt) override {
+    // Adjoints of SNodes cached in shared memory are accumulated in their own
+    // scratch pads, and added to global memory once per block
+    auto &opt = for_stmt->scratch_opt;
+    for (int i = 0, n = (int)opt.size(); i < n; i++) {
+      auto snode = opt[i].second;
+      if (opt[i].first != 0 || !snode->has_grad())
+        continue;
+      auto grad = std::make_pair(0, snode->get_grad());
+      if (std::find(opt.begin(), opt.end(), grad) == opt.end())
+        opt.push_back(grad);
+    }
     for_depth += 1;
     for_stmt->body->accept(this);
     for_depth -= 1;
@@ -340,7 +381,8 @@ class MakeAdjoint : public IRVisitor {
     snodes[0] = snodes[0]->get_grad();
     auto adjoint_ptr = insert<GlobalPtrStmt>(snodes, ptr->indices);
     accumulate(stmt->data, insert<GlobalLoadStmt>(adjoint_ptr));
-    stmt->parent->erase(stmt);
+    if (!keep_primal)
+      stmt->parent->erase(stmt);
   }
 
   void visit(AtomicOpStmt *stmt) override {
@@ -349,6 +391,9 @@ class MakeAdjoint : public IRVisitor {
     TC_ASSERT(ptr->width() == 1);
     auto snodes = ptr->snodes;
     if (snodes[0]->has_grad()) {
+      TC_ERROR_UNLESS(stmt->op_type == AtomicOpType::add,
+                      "Atomic {} is not differentiable.",
+                      atomic_op_type_name(stmt->op_type));
       TC_ASSERT(snodes[0]->get_grad() != nullptr);
       snodes[0] = snodes[0]->get_grad();
       auto adjoint_ptr = insert<GlobalPtrStmt>(snodes, ptr->indices);
@@ -356,7 +401,8 @@ class MakeAdjoint : public IRVisitor {
     } else {
       // no gradient (likely integer types)
     }
-    stmt->parent->erase(stmt);
+    if (!keep_primal)
+      stmt->parent->erase(stmt);
   }
 
   void visit(ElementShuffleStmt *stmt) override {
@@ -374,8 +420,8 @@ class MakeAdjoint : public IRVisitor {
 
 namespace irpass {
 
-void make_adjoint(IRNode *root) {
-  MakeAdjoint::run(root);
+void make_adjoint(IRNode *root, bool keep_primal) {
+  MakeAdjoint::run(root, keep_primal);
   // print(root);
   typecheck(root);
 }
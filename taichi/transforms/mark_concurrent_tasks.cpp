@@ -0,0 +1,233 @@
+#include "../ir.h"
+#include "../program.h"
+#include <map>
+#include <set>
+
+TLANG_NAMESPACE_BEGIN
+
+// Collects what an offloaded task reads and writes: SNode ids, or one of
+// the negative keys below for state outside of the SNode tree
+class GatherTaskAccesses : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+
+  static constexpr int external = -1;
+  static constexpr int temporaries = -2;
+  static constexpr int args = -3;
+  static constexpr int io = -4;
+  // The scratch buffer shared by all list generations
+  static constexpr int listgen_scratch = -5;
+
+  // The element list of snode
+  static int list(SNode *snode) {
+    return -16 - snode->id;
+  }
+
+  std::set<int> reads, writes;
+  // Set when a global pointer of unknown origin is accessed
+  bool unknown;
+  std::map<Stmt *, std::vector<int>> pointees;
+  // Pointers that may activate their (sparse) ancestors
+  std::map<Stmt *, std::vector<SNode *>> activating;
+
+  GatherTaskAccesses() : BasicStmtVisitor() {
+    unknown = false;
+  }
+
+  void add_snode(Stmt *ptr, SNode *snode, bool activate) {
+    auto &keys = pointees[ptr];
+    keys.push_back(snode->id);
+    // Accessing a cell reads the structure of its sparse ancestors
+    for (auto p = snode->parent; p; p = p->parent) {
+      if (p->need_activation())
+        reads.insert(p->id);
+    }
+    if (activate)
+      activating[ptr].push_back(snode);
+  }
+
+  void visit(GlobalPtrStmt *stmt) override {
+    for (int i = 0; i < (int)stmt->snodes.size(); i++)
+      add_snode(stmt, stmt->snodes[i], stmt->activate);
+  }
+
+  void visit(SNodeLookupStmt *stmt) override {
+    add_snode(stmt, stmt->snode, stmt->activate);
+  }
+
+  void visit(GetChStmt *stmt) override {
+    add_snode(stmt, stmt->output_snode, activating.count(stmt->input_ptr) > 0);
+  }
+
+  void visit(ExternalPtrStmt *stmt) override {
+    pointees[stmt].push_back(external);
+  }
+
+  void visit(GlobalTemporaryStmt *stmt) override {
+    pointees[stmt].push_back(temporaries);
+  }
+
+  void access(Stmt *ptr, bool write) {
+    if (ptr->is<AllocaStmt>())
+      return;
+    auto it = pointees.find(ptr);
+    if (it == pointees.end()) {
+      unknown = true;
+      return;
+    }
+    for (auto key : it->second) {
+      reads.insert(key);
+      if (write)
+        writes.insert(key);
+    }
+    // Loads through activating lookups activate as well
+    if (activating.count(ptr)) {
+      for (auto snode : activating[ptr]) {
+        for (auto p = snode->parent; p; p = p->parent) {
+          if (p->need_activation())
+            writes.insert(p->id);
+        }
+      }
+    }
+  }
+
+  void visit(GlobalLoadStmt *stmt) override {
+    access(stmt->ptr, false);
+  }
+
+  void visit(GlobalStoreStmt *stmt) override {
+    access(stmt->ptr, true);
+  }
+
+  void visit(AtomicOpStmt *stmt) override {
+    access(stmt->dest, true);
+  }
+
+  void visit(SNodeOpStmt *stmt) override {
+    // Activation, deactivation and appends change the structure
+    for (auto p = stmt->snode; p; p = p->parent) {
+      reads.insert(p->id);
+      if (stmt->op_type != SNodeOpType::is_active)
+        writes.insert(p->id);
+    }
+  }
+
+  void visit(ClearAllStmt *stmt) override {
+    unknown = true;
+  }
+
+  void write_descendants(SNode *snode) {
+    writes.insert(snode->id);
+    for (auto &ch : snode->ch)
+      write_descendants(ch.get());
+  }
+
+  void visit(OffloadedStmt *stmt) override {
+    using Type = OffloadedStmt::TaskType;
+    auto type = stmt->task_type;
+    if (type == Type::listgen) {
+      // Walks the structure of snode and the list of its parent
+      for (auto p = stmt->snode; p; p = p->parent)
+        reads.insert(p->id);
+      if (stmt->snode->parent)
+        reads.insert(list(stmt->snode->parent));
+      writes.insert(list(stmt->snode));
+      writes.insert(listgen_scratch);
+    } else if (type == Type::clear_list) {
+      writes.insert(list(stmt->snode));
+    } else if (type == Type::struct_for || type == Type::zero_fill) {
+      reads.insert(list(stmt->snode));
+      if (type == Type::zero_fill)
+        write_descendants(stmt->snode);
+    } else if (type == Type::gc) {
+      reads.insert(stmt->snode->id);
+      writes.insert(stmt->snode->id);
+    } else if (type == Type::deactivate_all || type == Type::defragment ||
+               type == Type::deactivate_ambient) {
+      unknown = true;
+    } else if (type == Type::range_for) {
+      // The bounds computed at run time are read at launch
+      if (!stmt->const_begin || !stmt->const_end)
+        reads.insert(temporaries);
+    }
+    BasicStmtVisitor::visit(stmt);
+  }
+
+  void visit(ArgStoreStmt *stmt) override {
+    writes.insert(args);
+  }
+
+  void visit(PrintStmt *stmt) override {
+    writes.insert(io);
+  }
+
+  void visit(AssertStmt *stmt) override {
+    writes.insert(io);
+  }
+
+  void visit(BoundCheckStmt *stmt) override {
+    writes.insert(io);
+  }
+
+  static bool intersect(const std::set<int> &a, const std::set<int> &b) {
+    for (auto key : a) {
+      if (b.count(key))
+        return true;
+    }
+    return false;
+  }
+
+  bool conflicts_with(const GatherTaskAccesses &o) const {
+    return unknown || o.unknown || intersect(writes, o.reads) ||
+           intersect(writes, o.writes) || intersect(o.writes, reads);
+  }
+};
+
+namespace irpass {
+
+// Marks CPU serial tasks that touch nothing the following range-for writes
+// (and vice versa), so that the two tasks can run at the same time
+void mark_concurrent_tasks(IRNode *root) {
+  auto block = dynamic_cast<Block *>(root);
+  for (int i = 0; i + 1 < (int)block->statements.size(); i++) {
+    auto serial = block->statements[i]->as<OffloadedStmt>();
+    auto next = block->statements[i + 1]->as<OffloadedStmt>();
+    if (serial->task_type != OffloadedStmt::TaskType::serial ||
+        next->task_type != OffloadedStmt::TaskType::range_for ||
+        serial->device != Arch::x86_64 || next->device != Arch::x86_64 ||
+        serial->body->statements.empty())
+      continue;
+    GatherTaskAccesses serial_accesses, next_accesses;
+    serial->accept(&serial_accesses);
+    next->accept(&next_accesses);
+    if (!serial_accesses.conflicts_with(next_accesses))
+      serial->concurrent_with_next = true;
+  }
+}
+
+}  // namespace irpass
+
+bool KernelAccesses::conflicts_with(const KernelAccesses &o) const {
+  using G = GatherTaskAccesses;
+  return unknown || o.unknown || G::intersect(writes, o.reads) ||
+         G::intersect(writes, o.writes) || G::intersect(o.writes, reads);
+}
+
+namespace analysis {
+
+KernelAccesses gather_accesses(IRNode *root, bool within_launch) {
+  GatherTaskAccesses gather;
+  root->accept(&gather);
+  KernelAccesses ret;
+  ret.reads = std::move(gather.reads);
+  ret.writes = std::move(gather.writes);
+  // Chained tasks synchronize the whole device with grid_barrier
+  ret.unknown = gather.unknown ||
+                (!within_launch &&
+                 get_current_program().config.gpu_persistent_threads);
+  return ret;
+}
+
+}  // namespace analysis
+
+TLANG_NAMESPACE_END
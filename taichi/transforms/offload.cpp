@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <set>
 #include "../ir.h"
+#include "../program.h"
 
 TLANG_NAMESPACE_BEGIN
 
@@ -7,10 +9,62 @@ namespace irpass {
 
 class Offloader {
  public:
-  Offloader(IRNode *root) {
+  // Bytes of the temporaries taken by range-for bounds
+  std::size_t temporaries_size;
+
+  Offloader(IRNode *root) : temporaries_size(0) {
     run(root);
   }
 
+  // Returns stmt, or a copy of it computed in serial if it is in an earlier
+  // task: the simplifier merges pure computations, e.g. argument loads,
+  // across loops
+  Stmt *materialize(Stmt *stmt, OffloadedStmt *serial) {
+    if (serial->body->locate(stmt) != -1)
+      return stmt;
+    std::unique_ptr<Stmt> copy;
+    if (auto arg_load = stmt->cast<ArgLoadStmt>()) {
+      copy = Stmt::make<ArgLoadStmt>(arg_load->arg_id);
+    } else if (auto c = stmt->cast<ConstStmt>()) {
+      copy = Stmt::make<ConstStmt>(c->val);
+    } else if (auto unary = stmt->cast<UnaryOpStmt>()) {
+      auto operand = materialize(unary->operand, serial);
+      auto copy_unary =
+          Stmt::make_typed<UnaryOpStmt>(unary->op_type, operand);
+      copy_unary->cast_type = unary->cast_type;
+      copy_unary->cast_by_value = unary->cast_by_value;
+      copy = std::move(copy_unary);
+    } else if (auto binary = stmt->cast<BinaryOpStmt>()) {
+      auto lhs = materialize(binary->lhs, serial);
+      auto rhs = materialize(binary->rhs, serial);
+      copy = Stmt::make<BinaryOpStmt>(binary->op_type, lhs, rhs);
+    } else {
+      TC_ERROR("Range-for bounds must be computed after the previous "
+               "parallel loop.");
+    }
+    copy->ret_type = stmt->ret_type;
+    auto ret = copy.get();
+    serial->body->insert(std::move(copy));
+    return ret;
+  }
+
+  // Makes serial store bound into the temporaries for a range-for to read
+  // when launched. Returns its offset.
+  std::size_t store_range_bound(Stmt *bound, OffloadedStmt *serial) {
+    TC_ERROR_UNLESS(bound->ret_type.data_type == DataType::i32,
+                    "Range-for bounds must be i32, not {}.",
+                    data_type_name(bound->ret_type.data_type));
+    bound = materialize(bound, serial);
+    auto offset = temporaries_size;
+    temporaries_size += sizeof(int32);
+    auto ptr = Stmt::make_typed<GlobalTemporaryStmt>(
+        offset, VectorType(1, DataType::i32));
+    auto store = Stmt::make<GlobalStoreStmt>(ptr.get(), bound);
+    serial->body->insert(std::move(ptr));
+    serial->body->insert(std::move(store));
+    return offset;
+  }
+
   void fix_loop_index_load(Stmt *s,
                            Stmt *loop_var,
                            int index,
@@ -28,7 +82,28 @@ class Offloader {
         [&]() { return Stmt::make<LoopIndexStmt>(index, is_struct_for); });
   }
 
+  // Collects the SNodes deactivated in the kernel, in program order. Appends
+  // count too, since racing appends recycle the chunks they lose.
+  class GatherDeactivations : public BasicStmtVisitor {
+   public:
+    using BasicStmtVisitor::visit;
+
+    std::vector<SNode *> snodes;
+
+    void visit(SNodeOpStmt *stmt) override {
+      if ((stmt->op_type == SNodeOpType::deactivate ||
+           stmt->op_type == SNodeOpType::append) &&
+          std::find(snodes.begin(), snodes.end(), stmt->snode) ==
+              snodes.end()) {
+        snodes.push_back(stmt->snode);
+      }
+    }
+  };
+
   void run(IRNode *root) {
+    GatherDeactivations gather;
+    root->accept(&gather);
+
     auto root_block = dynamic_cast<Block *>(root);
     auto root_statements = std::move(root_block->statements);
     root_block->statements.clear();
@@ -47,14 +122,30 @@ class Offloader {
     for (int i = 0; i < (int)root_statements.size(); i++) {
       auto &stmt = root_statements[i];
       if (auto s = stmt->cast<RangeForStmt>(); s && !s->strictly_serialized) {
-        assemble_serial_statements();
         auto offloaded =
             Stmt::make_typed<OffloadedStmt>(OffloadedStmt::TaskType::range_for);
         offloaded->body = std::make_unique<Block>();
-        offloaded->begin = s->begin->as<ConstStmt>()->val[0].val_int32();
-        offloaded->end = s->end->as<ConstStmt>()->val[0].val_int32();
+        // The bounds computed by the kernel, e.g. from its arguments or
+        // fields, are passed through the temporaries
+        if (auto begin = s->begin->cast<ConstStmt>()) {
+          offloaded->begin = begin->val[0].val_int32();
+        } else {
+          offloaded->const_begin = false;
+          offloaded->begin_offset =
+              store_range_bound(s->begin, pending_serial_statements.get());
+        }
+        if (auto end = s->end->cast<ConstStmt>()) {
+          offloaded->end = end->val[0].val_int32();
+        } else {
+          offloaded->const_end = false;
+          offloaded->end_offset =
+              store_range_bound(s->end, pending_serial_statements.get());
+        }
+        assemble_serial_statements();
         offloaded->block_dim = s->block_dim;
         offloaded->num_cpu_threads = s->parallelize;
+        offloaded->vectorize = s->vectorize;
+        offloaded->schedule = s->schedule;
         fix_loop_index_load(s, s->loop_var, 0, false);
         for (int j = 0; j < (int)s->body->statements.size(); j++) {
           offloaded->body->insert(std::move(s->body->statements[j]));
@@ -63,22 +154,37 @@ class Offloader {
       } else if (auto s = stmt->cast<StructForStmt>()) {
         assemble_serial_statements();
         emit_struct_for(s, root_block);
+      } else if (auto s = stmt->cast<ClearAllStmt>();
+                 s && get_current_program().config.use_llvm) {
+        assemble_serial_statements();
+        if (s->defragment)
+          emit_defragment(s, root_block);
+        else if (s->deactivate && s->only_ambient)
+          emit_deactivate_ambient(s, root_block);
+        else if (s->deactivate && !s->snode->can_clear_data())
+          emit_deactivate_all(s, root_block);
+        else
+          emit_zero_fill(s, root_block);
       } else {
         pending_serial_statements->body->insert(std::move(stmt));
       }
     }
     assemble_serial_statements();
+
+    // Nodes recycled by deactivation become allocatable again after the
+    // kernel, once no task can be holding them anymore
+    for (auto snode : gather.snodes) {
+      auto offloaded_gc =
+          Stmt::make_typed<OffloadedStmt>(OffloadedStmt::TaskType::gc);
+      offloaded_gc->snode = snode;
+      root_block->insert(std::move(offloaded_gc));
+    }
   }
 
-  void emit_struct_for(StructForStmt *for_stmt, Block *root_block) {
-    auto leaf = for_stmt->snode;
-    TC_ASSERT(leaf->type == SNodeType::place)
-    // make a list of nodes, from the leaf block (instead of 'place') to root
+  // Generates the element lists from the root down to snode
+  void emit_list_gens(SNode *snode, Block *root_block) {
     std::vector<SNode *> path;
-    // leaf is the place (scalar)
-    // leaf->parent is the leaf block
-    // so listgen should be invoked from the root to leaf->parent->parent
-    for (auto p = leaf->parent; p; p = p->parent) {
+    for (auto p = snode; p; p = p->parent) {
       path.push_back(p);
     }
     std::reverse(path.begin(), path.end());
@@ -94,6 +200,226 @@ class Offloader {
       offloaded_listgen->snode = snode_child;
       root_block->insert(std::move(offloaded_listgen));
     }
+  }
+
+  // Only the instances with active ancestors are listed, and zeroed. Dense
+  // nodes have nothing to deactivate.
+  void emit_zero_fill(ClearAllStmt *clear, Block *root_block) {
+    auto snode = clear->snode;
+    TC_ERROR_UNLESS(snode->can_clear_data(),
+                    "{} cannot be cleared: only dense nodes that directly hold "
+                    "their tensors can.",
+                    snode->get_node_type_name_hinted());
+    emit_list_gens(snode, root_block);
+    auto offloaded_zero_fill =
+        Stmt::make_typed<OffloadedStmt>(OffloadedStmt::TaskType::zero_fill);
+    offloaded_zero_fill->snode = snode;
+    root_block->insert(std::move(offloaded_zero_fill));
+  }
+
+  // Deactivates all instances of a pointer or dynamic node, which frees the
+  // nodes below them. Their data is zeroed when they are allocated again.
+  void emit_deactivate_all(ClearAllStmt *clear, Block *root_block) {
+    auto snode = clear->snode;
+    TC_ERROR_UNLESS(snode->type == SNodeType::pointer ||
+                        snode->type == SNodeType::dynamic,
+                    "{} cannot be deactivated: only pointer and dynamic "
+                    "nodes, and dense nodes that directly hold their tensors, "
+                    "can.",
+                    snode->get_node_type_name_hinted());
+    std::function<void(SNode *)> check = [&](SNode *s) {
+      TC_ERROR_UNLESS(s->type != SNodeType::hash,
+                      "{} cannot be deactivated, since it holds the hash "
+                      "node {}.",
+                      snode->get_node_type_name_hinted(),
+                      s->get_node_type_name_hinted());
+      for (auto &c : s->ch)
+        check(c.get());
+    };
+    check(snode);
+    emit_list_gens(snode, root_block);
+    auto offloaded_deactivate_all = Stmt::make_typed<OffloadedStmt>(
+        OffloadedStmt::TaskType::deactivate_all);
+    offloaded_deactivate_all->snode = snode;
+    root_block->insert(std::move(offloaded_deactivate_all));
+  }
+
+  // Packs the nodes of a pointer node in the order its struct-fors visit
+  // them, which deactivations and activations scatter over time
+  void emit_defragment(ClearAllStmt *clear, Block *root_block) {
+    auto snode = clear->snode;
+    TC_ERROR_UNLESS(snode->type == SNodeType::pointer,
+                    "{} cannot be defragmented: only pointer nodes can.",
+                    snode->get_node_type_name_hinted());
+    emit_list_gens(snode, root_block);
+    auto offloaded_defragment =
+        Stmt::make_typed<OffloadedStmt>(OffloadedStmt::TaskType::defragment);
+    offloaded_defragment->snode = snode;
+    root_block->insert(std::move(offloaded_defragment));
+  }
+
+  // Deactivates the cells of a pointer node whose nodes went back to zero,
+  // which a kernel writing the ambient value does not do by itself. The
+  // nodes become allocatable again after the gc.
+  void emit_deactivate_ambient(ClearAllStmt *clear, Block *root_block) {
+    auto snode = clear->snode;
+    TC_ERROR_UNLESS(snode->type == SNodeType::pointer,
+                    "Only the cells of pointer nodes can be deactivated where "
+                    "ambient, not those of {}.",
+                    snode->get_node_type_name_hinted());
+    emit_list_gens(snode, root_block);
+    auto offloaded_deactivate = Stmt::make_typed<OffloadedStmt>(
+        OffloadedStmt::TaskType::deactivate_ambient);
+    offloaded_deactivate->snode = snode;
+    root_block->insert(std::move(offloaded_deactivate));
+    auto offloaded_gc =
+        Stmt::make_typed<OffloadedStmt>(OffloadedStmt::TaskType::gc);
+    offloaded_gc->snode = snode;
+    root_block->insert(std::move(offloaded_gc));
+  }
+
+  class GatherStructForIndices : public BasicStmtVisitor {
+   public:
+    using BasicStmtVisitor::visit;
+
+    std::vector<LoopIndexStmt *> indices;
+
+    void visit(LoopIndexStmt *stmt) override {
+      if (stmt->is_struct_for)
+        indices.push_back(stmt);
+    }
+  };
+
+  // A struct-for over a hierarchy of dense SNodes visits every cell, whose
+  // coordinates follow from the cell's position in the whole hierarchy. It
+  // becomes a range-for over the cells without element lists. Returns false
+  // if the loop cannot be demoted.
+  bool demote_dense_struct_for(StructForStmt *for_stmt, Block *root_block) {
+    auto &config = get_current_program().config;
+    auto leaf = for_stmt->snode;
+    if (!config.use_llvm || !config.demote_dense_struct_fors ||
+        for_stmt->block_initialization || for_stmt->block_finalization ||
+        leaf->halo_width())
+      return false;
+    // From the leaf block up
+    std::vector<SNode *> path;
+    int total_bits = 0;
+    for (auto p = leaf->parent; p; p = p->parent) {
+      if ((p->type != SNodeType::dense && p->type != SNodeType::root) ||
+          p->_morton || p->_bitmasked)
+        return false;
+      path.push_back(p);
+      total_bits += p->total_num_bits;
+    }
+    if (total_bits >= 31)
+      return false;
+    // The padding of non-power-of-two sizes is skipped by checking the
+    // coordinates, which only works if the outermost level along the axis is
+    // the only one padded
+    bool bounded[max_num_indices] = {};
+    for (int k = 0; k < max_num_indices; k++) {
+      bool outer_padded = false;
+      for (auto p : path) {
+        auto &e = p->extractors[k];
+        if (!e.num_bits)
+          continue;
+        if (outer_padded)
+          return false;
+        int size = e.num_elements;
+        if (p->parent)
+          size /= p->parent->extractors[k].num_elements;
+        outer_padded = size != (1 << e.num_bits);
+      }
+      bounded[k] = outer_padded;
+    }
+
+    auto offloaded =
+        Stmt::make_typed<OffloadedStmt>(OffloadedStmt::TaskType::range_for);
+    offloaded->begin = 0;
+    offloaded->end = 1 << total_bits;
+    offloaded->block_dim = for_stmt->block_dim;
+    offloaded->num_cpu_threads = for_stmt->parallelize;
+    offloaded->vectorize = for_stmt->vectorize;
+
+    // The bits of the index are those of the child of each level, the leaf
+    // block's lowest, split into the coordinates like refine_coordinates
+    // does
+    VecStatement stmts;
+    auto index = stmts.push_back<LoopIndexStmt>(0, false);
+    auto constant = [&](int32 val) {
+      return stmts.push_back<ConstStmt>(TypedConstant(val));
+    };
+    auto binary = [&](BinaryOpType op, Stmt *lhs, Stmt *rhs) {
+      return stmts.push_back<BinaryOpStmt>(op, lhs, rhs);
+    };
+    std::vector<Stmt *> coords(max_num_indices, nullptr);
+    int offset = 0;
+    for (auto p : path) {
+      for (int k = 0; k < max_num_indices; k++) {
+        auto &e = p->extractors[k];
+        if (!e.num_bits)
+          continue;
+        Stmt *bits = index;
+        if (offset + e.acc_offset)
+          bits = binary(BinaryOpType::div, bits,
+                        constant(1 << (offset + e.acc_offset)));
+        bits = binary(BinaryOpType::bit_and, bits,
+                      constant((1 << e.num_bits) - 1));
+        if (e.start)
+          bits = binary(BinaryOpType::mul, bits, constant(1 << e.start));
+        coords[k] = coords[k] ? binary(BinaryOpType::add, coords[k], bits)
+                              : bits;
+      }
+      offset += p->total_num_bits;
+    }
+    Stmt *in_bounds = nullptr;
+    for (int k = 0; k < max_num_indices; k++) {
+      if (!coords[k])
+        coords[k] = constant(0);
+      if (!bounded[k])
+        continue;
+      auto cond = binary(BinaryOpType::cmp_lt, coords[k],
+                         constant(leaf->extractors[k].num_elements));
+      in_bounds =
+          in_bounds ? binary(BinaryOpType::bit_and, in_bounds, cond) : cond;
+    }
+    for (auto &stmt : stmts.stmts)
+      offloaded->body->insert(std::move(stmt));
+
+    for (int i = 0; i < for_stmt->loop_vars.size(); i++) {
+      fix_loop_index_load(for_stmt, for_stmt->loop_vars[i],
+                          leaf->physical_index_position[i], true);
+    }
+    auto body = offloaded->body.get();
+    if (in_bounds) {
+      auto guard = Stmt::make_typed<IfStmt>(in_bounds);
+      guard->true_statements = std::make_unique<Block>();
+      body = guard->true_statements.get();
+      offloaded->body->insert(std::move(guard));
+    }
+    for (int i = 0; i < (int)for_stmt->body->statements.size(); i++)
+      body->insert(std::move(for_stmt->body->statements[i]));
+
+    GatherStructForIndices gather;
+    offloaded->body->accept(&gather);
+    for (auto stmt : gather.indices) {
+      irpass::replace_all_usages_with(offloaded->body.get(), stmt,
+                                      coords[stmt->index]);
+      stmt->parent->erase(stmt);
+    }
+    root_block->insert(std::move(offloaded));
+    return true;
+  }
+
+  void emit_struct_for(StructForStmt *for_stmt, Block *root_block) {
+    auto leaf = for_stmt->snode;
+    TC_ASSERT(leaf->type == SNodeType::place ||
+              leaf->type == SNodeType::bit_struct)
+    if (demote_dense_struct_for(for_stmt, root_block))
+      return;
+    // leaf is the place (scalar), and leaf->parent is the leaf block, whose
+    // list the struct-for visits
+    emit_list_gens(leaf->parent, root_block);
 
     auto offloaded_struct_for =
         Stmt::make_typed<OffloadedStmt>(OffloadedStmt::TaskType::struct_for);
@@ -111,6 +437,12 @@ class Offloader {
     offloaded_struct_for->block_dim = for_stmt->block_dim;
     offloaded_struct_for->snode = for_stmt->snode;
     offloaded_struct_for->num_cpu_threads = for_stmt->parallelize;
+    offloaded_struct_for->vectorize = for_stmt->vectorize;
+    offloaded_struct_for->block_initialization =
+        std::move(for_stmt->block_initialization);
+    offloaded_struct_for->block_finalization =
+        std::move(for_stmt->block_finalization);
+    offloaded_struct_for->scratch_pad_size = for_stmt->scratch_pad_size;
 
     root_block->insert(std::move(offloaded_struct_for));
   }
@@ -137,22 +469,26 @@ class IdentifyLocalVars : public BasicStmtVisitor {
 
   std::size_t allocate_global(VectorType type) {
     TC_ASSERT(type.width == 1);
-    auto ret = global_offset;
-    global_offset += data_type_size(type.data_type);
-    TC_ASSERT(global_offset < taichi_max_num_global_vars);
+    auto size = data_type_size(type.data_type);
+    auto ret = (global_offset + size - 1) / size * size;
+    global_offset = ret + size;
     return ret;
   }
 
-  IdentifyLocalVars() {
+  IdentifyLocalVars(std::size_t global_offset)
+      : global_offset(global_offset) {
     allow_undefined_visitor = true;
     current_offloaded = nullptr;
-    global_offset = 0;
   }
 
   void visit(OffloadedStmt *stmt) override {
     current_offloaded = stmt;
+    if (stmt->block_initialization)
+      stmt->block_initialization->accept(this);
     if (stmt->body)
       stmt->body->accept(this);
+    if (stmt->block_finalization)
+      stmt->block_finalization->accept(this);
     current_offloaded = nullptr;
   }
 
@@ -189,9 +525,12 @@ class IdentifyLocalVars : public BasicStmtVisitor {
     }
   }
 
-  static std::map<Stmt *, std::size_t> run(IRNode *root) {
-    IdentifyLocalVars pass;
+  // Allocates after the first arena_size bytes
+  static std::map<Stmt *, std::size_t> run(IRNode *root,
+                                           std::size_t &arena_size) {
+    IdentifyLocalVars pass(arena_size);
     root->accept(&pass);
+    arena_size = pass.global_offset;
     return pass.local_to_global;
   }
 };
@@ -290,16 +629,18 @@ class PromoteLocals : public BasicStmtVisitor {
   }
 };
 
-void offload(IRNode *root) {
-  Offloader _(root);
+std::size_t offload(IRNode *root) {
+  Offloader offloader(root);
   irpass::typecheck(root);
   irpass::fix_block_parents(root);
+  std::size_t arena_size = offloader.temporaries_size;
   {
-    auto local_to_global = IdentifyLocalVars::run(root);
+    auto local_to_global = IdentifyLocalVars::run(root, arena_size);
     PromoteLocals::run(root, local_to_global);
   }
   irpass::typecheck(root);
   irpass::re_id(root);
+  return arena_size;
 }
 
 }  // namespace irpass
@@ -0,0 +1,390 @@
+// Integer value range analysis of offloaded tasks, and the optimizations it
+// enables: divisions and remainders by powers of two on non-negative values
+// become bit operations, bit extractions that cannot change their input are
+// dropped, and branches and assertions with conditions known at compile time
+// are resolved.
+
+#include "../ir.h"
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
+
+TLANG_NAMESPACE_BEGIN
+
+class ValueRanges {
+ public:
+  // Inclusive bounds
+  struct Range {
+    int64 low, high;
+
+    bool non_negative() const {
+      return low >= 0;
+    }
+
+    bool is(int64 val) const {
+      return low == val && high == val;
+    }
+
+    bool excludes(int64 val) const {
+      return val < low || high < val;
+    }
+  };
+
+  static constexpr int64 int32_min = std::numeric_limits<int32>::min();
+  static constexpr int64 int32_max = std::numeric_limits<int32>::max();
+
+  OffloadedStmt *task;
+  // Loop variables of range-fors, which the loop body never assigns to
+  std::map<Stmt *, RangeForStmt *> loop_vars;
+  std::map<Stmt *, Range> ranges;
+
+  ValueRanges() {
+    task = nullptr;
+  }
+
+  static Range full() {
+    return Range{int32_min, int32_max};
+  }
+
+  // Wrapping i32 arithmetic can yield any value
+  static Range make(int64 low, int64 high) {
+    if (low < int32_min || high > int32_max)
+      return full();
+    return Range{low, high};
+  }
+
+  static bool is_i32(Stmt *stmt) {
+    return stmt->width() == 1 && stmt->ret_type.data_type == DataType::i32;
+  }
+
+  static bool constant(Stmt *stmt, int32 &val) {
+    auto c = stmt->cast<ConstStmt>();
+    if (!c || !is_i32(c))
+      return false;
+    val = c->val[0].val_i32;
+    return true;
+  }
+
+  Range get(Stmt *stmt) {
+    if (!is_i32(stmt))
+      return full();
+    auto it = ranges.find(stmt);
+    if (it != ranges.end())
+      return it->second;
+    auto ret = compute(stmt);
+    ranges[stmt] = ret;
+    return ret;
+  }
+
+  Range compute_binary(BinaryOpStmt *stmt) {
+    auto a = get(stmt->lhs), b = get(stmt->rhs);
+    auto op = stmt->op_type;
+    if (op == BinaryOpType::add) {
+      return make(a.low + b.low, a.high + b.high);
+    } else if (op == BinaryOpType::sub) {
+      return make(a.low - b.high, a.high - b.low);
+    } else if (op == BinaryOpType::mul) {
+      auto p = {a.low * b.low, a.low * b.high, a.high * b.low,
+                a.high * b.high};
+      return make(std::min(p), std::max(p));
+    } else if (op == BinaryOpType::div) {
+      int32 c;
+      if (constant(stmt->rhs, c) && c > 0)
+        return make(a.low / c, a.high / c);
+    } else if (op == BinaryOpType::mod) {
+      int32 c;
+      if (constant(stmt->rhs, c) && c > 0) {
+        if (a.non_negative() && a.high < c)
+          return a;
+        if (a.non_negative())
+          return make(0, c - 1);
+        return make(-(c - 1), c - 1);
+      }
+    } else if (op == BinaryOpType::bit_and) {
+      if (a.non_negative() && b.non_negative())
+        return make(0, std::min(a.high, b.high));
+      if (a.non_negative())
+        return make(0, a.high);
+      if (b.non_negative())
+        return make(0, b.high);
+    } else if (op == BinaryOpType::min) {
+      return make(std::min(a.low, b.low), std::min(a.high, b.high));
+    } else if (op == BinaryOpType::max) {
+      return make(std::max(a.low, b.low), std::max(a.high, b.high));
+    } else if (is_comparison(op)) {
+      // True is -1
+      int decided = compare(op, get(stmt->lhs), get(stmt->rhs));
+      if (decided == 1)
+        return make(-1, -1);
+      if (decided == 0)
+        return make(0, 0);
+      return make(-1, 0);
+    }
+    return full();
+  }
+
+  // Returns 1 or 0 when the comparison always or never holds, -1 otherwise
+  static int compare(BinaryOpType op, const Range &a, const Range &b) {
+    auto decide = [](bool always, bool never) {
+      return always ? 1 : (never ? 0 : -1);
+    };
+    if (op == BinaryOpType::cmp_lt)
+      return decide(a.high < b.low, a.low >= b.high);
+    if (op == BinaryOpType::cmp_le)
+      return decide(a.high <= b.low, a.low > b.high);
+    if (op == BinaryOpType::cmp_gt)
+      return decide(a.low > b.high, a.high <= b.low);
+    if (op == BinaryOpType::cmp_ge)
+      return decide(a.low >= b.high, a.high < b.low);
+    bool disjoint = a.high < b.low || b.high < a.low;
+    bool same = a.low == a.high && b.low == b.high && a.low == b.low;
+    if (op == BinaryOpType::cmp_eq)
+      return decide(same, disjoint);
+    if (op == BinaryOpType::cmp_ne)
+      return decide(disjoint, same);
+    return -1;
+  }
+
+  Range compute(Stmt *stmt) {
+    int32 c;
+    if (constant(stmt, c))
+      return make(c, c);
+    if (auto binary = stmt->cast<BinaryOpStmt>())
+      return compute_binary(binary);
+    if (auto ternary = stmt->cast<TernaryOpStmt>()) {
+      if (ternary->op_type == TernaryOpType::select) {
+        auto a = get(ternary->op2), b = get(ternary->op3);
+        return make(std::min(a.low, b.low), std::max(a.high, b.high));
+      }
+    } else if (auto assumption = stmt->cast<RangeAssumptionStmt>()) {
+      auto base = get(assumption->base);
+      return make(base.low + assumption->low,
+                  base.high + assumption->high - 1);
+    } else if (auto extract = stmt->cast<OffsetAndExtractBitsStmt>()) {
+      return make(0, (1LL << (extract->bit_end - extract->bit_begin)) - 1);
+    } else if (auto offset = stmt->cast<IntegerOffsetStmt>()) {
+      auto input = get(offset->input);
+      return make(input.low + offset->offset, input.high + offset->offset);
+    } else if (auto linearize = stmt->cast<LinearizeStmt>()) {
+      if (linearize->morton) {
+        int64 n = 1;
+        for (int i = 0; i < (int)linearize->inputs.size(); i++) {
+          auto input = get(linearize->inputs[i]);
+          if (input.low < 0 || input.high >= linearize->strides[i])
+            return full();
+          n *= linearize->strides[i];
+        }
+        return make(0, n - 1);
+      }
+      Range ret{0, 0};
+      for (int i = 0; i < (int)linearize->inputs.size(); i++) {
+        auto input = get(linearize->inputs[i]);
+        auto stride = linearize->strides[i];
+        if (ret.low < 0 || input.low < 0)
+          return full();
+        ret = make(ret.low * stride + input.low,
+                   ret.high * stride + input.high);
+      }
+      return ret;
+    } else if (auto load = stmt->cast<LocalLoadStmt>()) {
+      auto it = loop_vars.find(load->ptr[0].var);
+      if (it != loop_vars.end() && load->ptr[0].offset == 0) {
+        auto begin = get(it->second->begin), end = get(it->second->end);
+        return make(begin.low, end.high - 1);
+      }
+    } else if (auto index = stmt->cast<LoopIndexStmt>()) {
+      if (!task)
+        return full();
+      if (index->is_struct_for &&
+          task->task_type == OffloadedStmt::TaskType::struct_for) {
+        // Struct-fors skip coordinates out of non-power-of-two extents, and
+        // in the halo
+        int n = task->snode->extractors[index->index].num_elements -
+                2 * task->snode->halo_width();
+        return make(0, n - 1);
+      }
+      if (!index->is_struct_for &&
+          task->task_type == OffloadedStmt::TaskType::range_for &&
+          task->const_begin && task->const_end && task->begin < task->end)
+        return make(task->begin, task->end - 1);
+    }
+    return full();
+  }
+};
+
+class GatherRangeForLoopVars : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+
+  std::map<Stmt *, RangeForStmt *> loop_vars;
+  std::set<Stmt *> assigned;
+
+  void visit(RangeForStmt *stmt) override {
+    loop_vars[stmt->loop_var] = stmt;
+    stmt->body->accept(this);
+  }
+
+  void visit(LocalStoreStmt *stmt) override {
+    assigned.insert(stmt->ptr);
+  }
+
+  void visit(AtomicOpStmt *stmt) override {
+    assigned.insert(stmt->dest);
+  }
+
+  static std::map<Stmt *, RangeForStmt *> run(IRNode *root) {
+    GatherRangeForLoopVars gather;
+    root->accept(&gather);
+    for (auto var : gather.assigned)
+      gather.loop_vars.erase(var);
+    return gather.loop_vars;
+  }
+};
+
+class ReduceStrength : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+  using Range = ValueRanges::Range;
+
+  IRNode *root;
+  ValueRanges ranges;
+
+  ReduceStrength(IRNode *root) : root(root) {
+    ranges.loop_vars = GatherRangeForLoopVars::run(root);
+  }
+
+  static void replace(Stmt *stmt, Stmt *new_stmt) {
+    stmt->replace_with(new_stmt);
+    stmt->parent->erase(stmt);
+    throw IRModified();
+  }
+
+  static void replace(Stmt *stmt, VecStatement &new_stmts) {
+    for (auto &s : new_stmts.stmts)
+      s->ret_type = VectorType(1, DataType::i32);
+    stmt->parent->replace_with(stmt, new_stmts);
+    throw IRModified();
+  }
+
+  void visit(OffloadedStmt *stmt) override {
+    ranges.task = stmt;
+    BasicStmtVisitor::visit(stmt);
+    ranges.task = nullptr;
+  }
+
+  void visit(BinaryOpStmt *stmt) override {
+    if (!ValueRanges::is_i32(stmt))
+      return;
+    int32 c;
+    if (!ValueRanges::constant(stmt->rhs, c) || c <= 0)
+      return;
+    auto op = stmt->op_type;
+    if (op != BinaryOpType::div && op != BinaryOpType::mod)
+      return;
+    auto lhs = ranges.get(stmt->lhs);
+    if (!lhs.non_negative())
+      return;
+    VecStatement stmts;
+    if (lhs.low / c == lhs.high / c) {
+      // The quotient is known
+      int32 q = (int32)(lhs.low / c);
+      if (op == BinaryOpType::div) {
+        stmts.push_back<ConstStmt>(TypedConstant(q));
+      } else if (q == 0) {
+        replace(stmt, stmt->lhs);
+      } else {
+        auto qc = stmts.push_back<ConstStmt>(TypedConstant(q * c));
+        stmts.push_back<BinaryOpStmt>(BinaryOpType::sub, stmt->lhs, qc);
+      }
+      replace(stmt, stmts);
+    }
+    if (!bit::is_power_of_two(c))
+      return;
+    int k = bit::log2int(c);
+    if (op == BinaryOpType::div) {
+      if (k == 0)
+        replace(stmt, stmt->lhs);
+      stmts.push_back<OffsetAndExtractBitsStmt>(stmt->lhs, k, 31, 0);
+    } else {
+      auto mask = stmts.push_back<ConstStmt>(TypedConstant(c - 1));
+      stmts.push_back<BinaryOpStmt>(BinaryOpType::bit_and, stmt->lhs, mask);
+    }
+    replace(stmt, stmts);
+  }
+
+  void visit(OffsetAndExtractBitsStmt *stmt) override {
+    if (stmt->bit_begin != 0 || stmt->offset != 0 ||
+        !ValueRanges::is_i32(stmt->input))
+      return;
+    auto input = ranges.get(stmt->input);
+    if (input.non_negative() && input.high < (1LL << stmt->bit_end))
+      replace(stmt, stmt->input);
+  }
+
+  // Returns 1 or 0 when cond is always or never true, -1 otherwise
+  int decide(Stmt *cond) {
+    if (!ValueRanges::is_i32(cond))
+      return -1;
+    auto range = ranges.get(cond);
+    if (range.excludes(0))
+      return 1;
+    if (range.is(0))
+      return 0;
+    return -1;
+  }
+
+  void visit(IfStmt *if_stmt) override {
+    int taken = if_stmt->true_mask ? -1 : decide(if_stmt->cond);
+    if (taken == -1) {
+      BasicStmtVisitor::visit(if_stmt);
+      return;
+    }
+    auto &clause =
+        taken ? if_stmt->true_statements : if_stmt->false_statements;
+    VecStatement stmts;
+    if (clause) {
+      for (auto &s : clause->statements)
+        stmts.push_back(std::move(s));
+    }
+    if_stmt->parent->insert_before(if_stmt, std::move(stmts));
+    if_stmt->parent->erase(if_stmt);
+    // Blocks nested in the moved statements still point to the clause
+    irpass::fix_block_parents(root);
+    throw IRModified();
+  }
+
+  void visit(AssertStmt *stmt) override {
+    if (decide(stmt->val) == 1) {
+      stmt->parent->erase(stmt);
+      throw IRModified();
+    }
+  }
+
+  static void run(IRNode *root) {
+    bool modified = false;
+    while (true) {
+      // Statements may have been erased, so start over
+      ReduceStrength pass(root);
+      try {
+        root->accept(&pass);
+      } catch (IRModified) {
+        modified = true;
+        continue;
+      }
+      break;
+    }
+    if (modified)
+      irpass::die(root);
+  }
+};
+
+namespace irpass {
+
+void reduce_strength(IRNode *root) {
+  ReduceStrength::run(root);
+}
+
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
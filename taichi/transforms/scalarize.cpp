@@ -0,0 +1,134 @@
+// Expands the matrix products that the frontend keeps whole as MatmulStmts
+// into multiplications and additions of their entries. Statements are
+// visited in program order, so the operands of a product that are entries of
+// an earlier one are already expanded.
+
+#include "../ir.h"
+#include <unordered_map>
+
+TLANG_NAMESPACE_BEGIN
+
+class Scalarize : public IRVisitor {
+ public:
+  // The expanded entries of the products, and what their results become
+  std::unordered_map<Stmt *, std::vector<Stmt *>> entries;
+  std::unordered_map<Stmt *, Stmt *> replacement;
+  std::vector<Stmt *> expanded;
+
+  Scalarize() {
+    allow_undefined_visitor = true;
+    invoke_default_visitor = true;
+  }
+
+  void replace_operands(Stmt *stmt) {
+    for (int i = 0; i < stmt->num_operands(); i++) {
+      auto it = replacement.find(stmt->operand(i));
+      if (it != replacement.end())
+        stmt->set_operand(i, it->second);
+    }
+  }
+
+  void visit(Stmt *stmt) override {
+    replace_operands(stmt);
+  }
+
+  void visit(MatmulStmt *stmt) override {
+    replace_operands(stmt);
+    if (stmt->tensor_cores)
+      return;
+    int n = stmt->n, k = stmt->k, m = stmt->m;
+    VecStatement scalars;
+    auto &result = entries[stmt];
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < m; j++) {
+        Stmt *sum = nullptr;
+        for (int t = 0; t < k; t++) {
+          auto prod = scalars.push_back<BinaryOpStmt>(
+              BinaryOpType::mul, stmt->a[i * k + t], stmt->b[t * m + j]);
+          prod->ret_type = stmt->ret_type;
+          if (sum) {
+            sum = scalars.push_back<BinaryOpStmt>(BinaryOpType::add, sum,
+                                                  prod);
+            sum->ret_type = stmt->ret_type;
+          } else {
+            sum = prod;
+          }
+        }
+        result.push_back(sum);
+      }
+    }
+    stmt->parent->insert_before(stmt, std::move(scalars));
+    expanded.push_back(stmt);
+  }
+
+  void visit(MatmulResultStmt *stmt) override {
+    replace_operands(stmt);
+    auto it = entries.find(stmt->mm);
+    if (it == entries.end())
+      return;
+    replacement[stmt] = it->second[stmt->index];
+    expanded.push_back(stmt);
+  }
+
+  void visit(Block *stmt_list) override {
+    // A copy, since the expansions are inserted into the block
+    std::vector<Stmt *> stmts;
+    for (auto &stmt : stmt_list->statements)
+      stmts.push_back(stmt.get());
+    for (auto stmt : stmts)
+      stmt->accept(this);
+  }
+
+  void visit(IfStmt *if_stmt) override {
+    replace_operands(if_stmt);
+    if (if_stmt->true_statements)
+      if_stmt->true_statements->accept(this);
+    if (if_stmt->false_statements)
+      if_stmt->false_statements->accept(this);
+  }
+
+  void visit(WhileStmt *stmt) override {
+    replace_operands(stmt);
+    stmt->body->accept(this);
+  }
+
+  void visit(RangeForStmt *stmt) override {
+    replace_operands(stmt);
+    stmt->body->accept(this);
+  }
+
+  void visit(StructForStmt *stmt) override {
+    if (stmt->block_initialization)
+      stmt->block_initialization->accept(this);
+    stmt->body->accept(this);
+    if (stmt->block_finalization)
+      stmt->block_finalization->accept(this);
+  }
+
+  void visit(OffloadedStmt *stmt) override {
+    if (stmt->block_initialization)
+      stmt->block_initialization->accept(this);
+    if (stmt->body)
+      stmt->body->accept(this);
+    if (stmt->block_finalization)
+      stmt->block_finalization->accept(this);
+  }
+
+  static void run(IRNode *node) {
+    Scalarize inst;
+    node->accept(&inst);
+    // Results first, which are the only users of the products left
+    for (auto it = inst.expanded.rbegin(); it != inst.expanded.rend(); it++)
+      (*it)->parent->erase(*it);
+  }
+};
+
+namespace irpass {
+
+void scalarize(IRNode *root) {
+  return Scalarize::run(root);
+}
+
+}  // namespace irpass
+
+TLANG_NAMESPACE_END
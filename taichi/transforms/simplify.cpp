@@ -3,6 +3,10 @@
 
 TLANG_NAMESPACE_BEGIN
 
+// Blocks enclosing the current one, each with the index of the statement
+// containing the next block
+using EnclosingBlocks = std::vector<std::pair<Block *, int>>;
+
 // Common subexpression elimination, store forwarding, useless local store
 // elimination; Simplify if statements into conditional stores.
 class BasicBlockSimplify : public IRVisitor {
@@ -12,17 +16,37 @@ class BasicBlockSimplify : public IRVisitor {
   int current_stmt_id;
   std::set<int> &visited;
   StructForStmt *current_struct_for;
+  const EnclosingBlocks &enclosing_blocks;
 
   BasicBlockSimplify(Block *block,
                      std::set<int> &visited,
-                     StructForStmt *current_struct_for)
-      : block(block), visited(visited), current_struct_for(current_struct_for) {
+                     StructForStmt *current_struct_for,
+                     const EnclosingBlocks &enclosing_blocks)
+      : block(block),
+        visited(visited),
+        current_struct_for(current_struct_for),
+        enclosing_blocks(enclosing_blocks) {
     allow_undefined_visitor = true;
     invoke_default_visitor = false;
     current_struct_for = nullptr;
     run();
   }
 
+  // Statements executed before the current one whenever it is: the earlier
+  // ones in this block and in the enclosing blocks. Pure statements are
+  // deduplicated against all of them, the others only within the block.
+  std::vector<Stmt *> dominating_statements() {
+    std::vector<Stmt *> ret;
+    for (int i = 0; i < current_stmt_id; i++)
+      ret.push_back(block->statements[i].get());
+    for (int k = (int)enclosing_blocks.size() - 1; k >= 0; k--) {
+      auto &enclosing = enclosing_blocks[k];
+      for (int i = 0; i < enclosing.second; i++)
+        ret.push_back(enclosing.first->statements[i].get());
+    }
+    return ret;
+  }
+
   bool is_done(Stmt *stmt) {
     return visited.find(stmt->instance_id) != visited.end();
   }
@@ -49,8 +73,7 @@ class BasicBlockSimplify : public IRVisitor {
   void visit(GlobalPtrStmt *stmt) override {
     if (is_done(stmt))
       return;
-    for (int i = 0; i < current_stmt_id; i++) {
-      auto &bstmt = block->statements[i];
+    for (auto bstmt : dominating_statements()) {
       if (stmt->ret_type == bstmt->ret_type) {
         auto &bstmt_data = *bstmt;
         if (typeid(bstmt_data) == typeid(*stmt)) {
@@ -71,7 +94,7 @@ class BasicBlockSimplify : public IRVisitor {
             }
           }
           if (same) {
-            stmt->replace_with(bstmt.get());
+            stmt->replace_with(bstmt);
             stmt->parent->erase(current_stmt_id);
             throw IRModified();
           }
@@ -84,15 +107,14 @@ class BasicBlockSimplify : public IRVisitor {
   void visit(ArgLoadStmt *stmt) override {
     if (is_done(stmt))
       return;
-    for (int i = 0; i < current_stmt_id; i++) {
-      auto &bstmt = block->statements[i];
+    for (auto bstmt : dominating_statements()) {
       auto &bstmt_data = *bstmt;
       if (typeid(bstmt_data) == typeid(*stmt)) {
         if (stmt->width() == bstmt->width()) {
           auto bstmt_ = bstmt->as<ArgLoadStmt>();
           bool same = stmt->arg_id == bstmt_->arg_id;
           if (same) {
-            stmt->replace_with(bstmt.get());
+            stmt->replace_with(bstmt);
             stmt->parent->erase(current_stmt_id);
             throw IRModified();
           }
@@ -105,8 +127,7 @@ class BasicBlockSimplify : public IRVisitor {
   void visit(ConstStmt *stmt) override {
     if (is_done(stmt))
       return;
-    for (int i = 0; i < current_stmt_id; i++) {
-      auto &bstmt = block->statements[i];
+    for (auto bstmt : dominating_statements()) {
       auto &bstmt_data = *bstmt;
       if (typeid(bstmt_data) == typeid(*stmt)) {
         if (stmt->width() == bstmt->width()) {
@@ -119,7 +140,7 @@ class BasicBlockSimplify : public IRVisitor {
             }
           }
           if (same) {
-            stmt->replace_with(bstmt.get());
+            stmt->replace_with(bstmt);
             stmt->parent->erase(current_stmt_id);
             throw IRModified();
           }
@@ -433,14 +454,13 @@ class BasicBlockSimplify : public IRVisitor {
       throw IRModified();
     }
 
-    for (int i = 0; i < current_stmt_id; i++) {
-      auto &bstmt = block->statements[i];
+    for (auto bstmt : dominating_statements()) {
       if (stmt->ret_type == bstmt->ret_type) {
         auto &bstmt_data = *bstmt;
         if (typeid(bstmt_data) == typeid(*stmt)) {
           auto bstmt_ = bstmt->as<IntegerOffsetStmt>();
           if (bstmt_->input == stmt->input && bstmt_->offset == stmt->offset) {
-            stmt->replace_with(bstmt.get());
+            stmt->replace_with(bstmt);
             stmt->parent->erase(current_stmt_id);
             throw IRModified();
           }
@@ -453,10 +473,10 @@ class BasicBlockSimplify : public IRVisitor {
   void visit(GetRootStmt *stmt) override {
     if (is_done(stmt))
       return;
-    for (int i = 0; i < current_stmt_id; i++) {
-      auto &bstmt = block->statements[i];
-      if (bstmt->is<GetRootStmt>()) {
-        stmt->replace_with(bstmt.get());
+    for (auto bstmt : dominating_statements()) {
+      if (bstmt->is<GetRootStmt>() &&
+          bstmt->as<GetRootStmt>()->root == stmt->root) {
+        stmt->replace_with(bstmt);
         stmt->parent->erase(current_stmt_id);
         throw IRModified();
       }
@@ -475,15 +495,14 @@ class BasicBlockSimplify : public IRVisitor {
         return;
       }
     }
-    for (int i = 0; i < current_stmt_id; i++) {
-      auto &bstmt = block->statements[i];
+    for (auto bstmt : dominating_statements()) {
       if (stmt->ret_type == bstmt->ret_type) {
         auto &bstmt_data = *bstmt;
         if (typeid(bstmt_data) == typeid(*stmt)) {
           auto bstmt_ = bstmt->as<UnaryOpStmt>();
           if (bstmt_->same_operation(stmt) &&
               bstmt_->operand == stmt->operand) {
-            stmt->replace_with(bstmt.get());
+            stmt->replace_with(bstmt);
             stmt->parent->erase(current_stmt_id);
             throw IRModified();
           }
@@ -514,15 +533,14 @@ class BasicBlockSimplify : public IRVisitor {
         }
       }
     }
-    for (int i = 0; i < current_stmt_id; i++) {
-      auto &bstmt = block->statements[i];
+    for (auto bstmt : dominating_statements()) {
       if (stmt->ret_type == bstmt->ret_type) {
         auto &bstmt_data = *bstmt;
         if (typeid(bstmt_data) == typeid(*stmt)) {
           auto bstmt_ = bstmt->as<BinaryOpStmt>();
           if (bstmt_->op_type == stmt->op_type && bstmt_->lhs == stmt->lhs &&
               bstmt_->rhs == stmt->rhs) {
-            stmt->replace_with(bstmt.get());
+            stmt->replace_with(bstmt);
             stmt->parent->erase(current_stmt_id);
             throw IRModified();
           }
@@ -535,15 +553,14 @@ class BasicBlockSimplify : public IRVisitor {
   void visit(TernaryOpStmt *stmt) override {
     if (is_done(stmt))
       return;
-    for (int i = 0; i < current_stmt_id; i++) {
-      auto &bstmt = block->statements[i];
+    for (auto bstmt : dominating_statements()) {
       if (stmt->ret_type == bstmt->ret_type) {
         auto &bstmt_data = *bstmt;
         if (typeid(bstmt_data) == typeid(*stmt)) {
           auto bstmt_ = bstmt->as<TernaryOpStmt>();
           if (bstmt_->op_type == stmt->op_type && bstmt_->op1 == stmt->op1 &&
               bstmt_->op2 == stmt->op2 && bstmt_->op3 == stmt->op3) {
-            stmt->replace_with(bstmt.get());
+            stmt->replace_with(bstmt);
             stmt->parent->erase(current_stmt_id);
             throw IRModified();
           }
@@ -607,8 +624,7 @@ class BasicBlockSimplify : public IRVisitor {
     }
 
     // step 2: eliminate dup
-    for (int i = 0; i < current_stmt_id; i++) {
-      auto &bstmt = block->statements[i];
+    for (auto bstmt : dominating_statements()) {
       if (stmt->ret_type == bstmt->ret_type) {
         auto &bstmt_data = *bstmt;
         if (typeid(bstmt_data) == typeid(*stmt)) {
@@ -617,7 +633,7 @@ class BasicBlockSimplify : public IRVisitor {
               bstmt_->bit_begin == stmt->bit_begin &&
               bstmt_->bit_end == stmt->bit_end &&
               bstmt_->offset == stmt->offset) {
-            stmt->replace_with(bstmt.get());
+            stmt->replace_with(bstmt);
             stmt->parent->erase(current_stmt_id);
             throw IRModified();
           }
@@ -645,7 +661,9 @@ class BasicBlockSimplify : public IRVisitor {
     if (is_done(stmt))
       return;
 
-    if (stmt->inputs.size() && stmt->inputs.back()->is<IntegerOffsetStmt>()) {
+    // Offsets of interleaved bits do not carry over to the linear index
+    if (!stmt->morton && stmt->inputs.size() &&
+        stmt->inputs.back()->is<IntegerOffsetStmt>()) {
       auto previous_offset = stmt->inputs.back()->as<IntegerOffsetStmt>();
       // push forward offset
       auto offset_stmt = stmt->insert_after_me(
@@ -657,15 +675,15 @@ class BasicBlockSimplify : public IRVisitor {
       throw IRModified();
     }
 
-    for (int i = 0; i < current_stmt_id; i++) {
-      auto &bstmt = block->statements[i];
+    for (auto bstmt : dominating_statements()) {
       if (stmt->ret_type == bstmt->ret_type) {
         auto &bstmt_data = *bstmt;
         if (typeid(bstmt_data) == typeid(*stmt)) {
           auto bstmt_ = bstmt->as<LinearizeStmt>();
           if (identical_vectors(bstmt_->inputs, stmt->inputs) &&
-              identical_vectors(bstmt_->strides, stmt->strides)) {
-            stmt->replace_with(bstmt.get());
+              identical_vectors(bstmt_->strides, stmt->strides) &&
+              bstmt_->morton == stmt->morton) {
+            stmt->replace_with(bstmt);
             stmt->parent->erase(current_stmt_id);
             throw IRModified();
           }
@@ -700,8 +718,7 @@ class BasicBlockSimplify : public IRVisitor {
       throw IRModified();
     }
 
-    for (int i = 0; i < current_stmt_id; i++) {
-      auto &bstmt = block->statements[i];
+    for (auto bstmt : dominating_statements()) {
       if (stmt->ret_type == bstmt->ret_type) {
         auto &bstmt_data = *bstmt;
         if (typeid(bstmt_data) == typeid(*stmt)) {
@@ -714,7 +731,7 @@ class BasicBlockSimplify : public IRVisitor {
               // && no need for the above line. As long as input_index are the
               // same global indices comparison can be omitted
               bstmt_->activate == stmt->activate) {
-            stmt->replace_with(bstmt.get());
+            stmt->replace_with(bstmt);
             stmt->parent->erase(current_stmt_id);
             throw IRModified();
           }
@@ -744,8 +761,7 @@ class BasicBlockSimplify : public IRVisitor {
       throw IRModified();
     }
 
-    for (int i = 0; i < current_stmt_id; i++) {
-      auto &bstmt = block->statements[i];
+    for (auto bstmt : dominating_statements()) {
       if (stmt->ret_type == bstmt->ret_type) {
         auto &bstmt_data = *bstmt;
         if (typeid(bstmt_data) == typeid(*stmt)) {
@@ -753,7 +769,7 @@ class BasicBlockSimplify : public IRVisitor {
           if (bstmt_->input_ptr == stmt->input_ptr &&
               bstmt_->input_snode == stmt->input_snode &&
               bstmt_->chid == stmt->chid) {
-            stmt->replace_with(bstmt.get());
+            stmt->replace_with(bstmt);
             stmt->parent->erase(current_stmt_id);
             throw IRModified();
           }
@@ -779,6 +795,14 @@ class BasicBlockSimplify : public IRVisitor {
     return;
   }
 
+  void visit(MatmulStmt *stmt) override {
+    return;
+  }
+
+  void visit(MatmulResultStmt *stmt) override {
+    return;
+  }
+
   static bool is_global_write(Stmt *stmt) {
     return stmt->is<GlobalStoreStmt>() || stmt->is<AtomicOpStmt>();
   }
@@ -887,6 +911,11 @@ class BasicBlockSimplify : public IRVisitor {
   void visit(OffloadedStmt *stmt) override {
     if (stmt->task_type != OffloadedStmt::TaskType::listgen &&
         stmt->task_type != OffloadedStmt::TaskType::clear_list &&
+        stmt->task_type != OffloadedStmt::TaskType::gc &&
+        stmt->task_type != OffloadedStmt::TaskType::zero_fill &&
+        stmt->task_type != OffloadedStmt::TaskType::deactivate_all &&
+        stmt->task_type != OffloadedStmt::TaskType::defragment &&
+        stmt->task_type != OffloadedStmt::TaskType::deactivate_ambient &&
         stmt->body->statements.empty()) {
       stmt->parent->erase(stmt);
       throw IRModified();
@@ -894,13 +923,148 @@ class BasicBlockSimplify : public IRVisitor {
   }
 };
 
+// Hoists pure statements that depend on nothing computed in the loop out of
+// range-for and while loops. Loops in the root block become offloaded tasks
+// and are left alone.
+class LoopInvariantCodeMotion : public IRVisitor {
+ public:
+  bool modified;
+  int depth;
+
+  LoopInvariantCodeMotion(IRNode *node) {
+    modified = false;
+    depth = 0;
+    allow_undefined_visitor = true;
+    invoke_default_visitor = false;
+    node->accept(this);
+  }
+
+  // Accessing these SNodes does not load the structure, which the loop may
+  // change
+  static bool dense_path(SNode *snode) {
+    for (auto p = snode; p; p = p->parent) {
+      if (p->type != SNodeType::dense && p->type != SNodeType::root &&
+          p->type != SNodeType::place)
+        return false;
+    }
+    return true;
+  }
+
+  // Pure, and safe to run even if the loop runs zero times
+  static bool is_hoistable(Stmt *stmt) {
+    if (stmt->is<ConstStmt>() || stmt->is<ArgLoadStmt>() ||
+        stmt->is<UnaryOpStmt>() || stmt->is<TernaryOpStmt>() ||
+        stmt->is<LinearizeStmt>() || stmt->is<OffsetAndExtractBitsStmt>() ||
+        stmt->is<IntegerOffsetStmt>() || stmt->is<GetChStmt>() ||
+        stmt->is<GetRootStmt>() || stmt->is<LoopIndexStmt>() ||
+        stmt->is<BlockCornerIndexStmt>() || stmt->is<ThreadIndexStmt>() ||
+        stmt->is<ScratchPadPtrStmt>())
+      return true;
+    if (auto binary = stmt->cast<BinaryOpStmt>()) {
+      return binary->op_type != BinaryOpType::div &&
+             binary->op_type != BinaryOpType::mod &&
+             binary->op_type != BinaryOpType::floordiv &&
+             binary->op_type != BinaryOpType::truediv;
+    }
+    if (auto lookup = stmt->cast<SNodeLookupStmt>()) {
+      return !lookup->activate &&
+             (lookup->snode->type == SNodeType::dense ||
+              lookup->snode->type == SNodeType::root ||
+              lookup->snode->type == SNodeType::bit_struct);
+    }
+    if (auto ptr = stmt->cast<GlobalPtrStmt>()) {
+      if (ptr->activate)
+        return false;
+      for (int i = 0; i < ptr->width(); i++) {
+        if (!dense_path(ptr->snodes[i]))
+          return false;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  static bool is_invariant(Stmt *stmt, Block *body) {
+    if (!is_hoistable(stmt))
+      return false;
+    for (int i = 0; i < stmt->num_operands(); i++) {
+      if (stmt->operand(i)->parent == body)
+        return false;
+    }
+    return true;
+  }
+
+  void visit(Block *block) override {
+    depth++;
+    for (int i = 0; i < (int)block->statements.size(); i++) {
+      auto stmt = block->statements[i].get();
+      stmt->accept(this);
+      Block *body = nullptr;
+      if (auto loop = stmt->cast<RangeForStmt>())
+        body = loop->body.get();
+      else if (auto loop = stmt->cast<WhileStmt>())
+        body = loop->body.get();
+      if (!body || depth == 1)
+        continue;
+      for (int j = 0; j < (int)body->statements.size(); j++) {
+        if (!is_invariant(body->statements[j].get(), body))
+          continue;
+        auto hoisted = std::move(body->statements[j]);
+        body->statements.erase(body->statements.begin() + j);
+        j--;
+        block->insert(std::move(hoisted), i);
+        i++;
+        modified = true;
+      }
+    }
+    depth--;
+  }
+
+  void visit(IfStmt *if_stmt) override {
+    if (if_stmt->true_statements)
+      if_stmt->true_statements->accept(this);
+    if (if_stmt->false_statements)
+      if_stmt->false_statements->accept(this);
+  }
+
+  void visit(RangeForStmt *for_stmt) override {
+    for_stmt->body->accept(this);
+  }
+
+  void visit(StructForStmt *for_stmt) override {
+    if (for_stmt->block_initialization)
+      for_stmt->block_initialization->accept(this);
+    for_stmt->body->accept(this);
+    if (for_stmt->block_finalization)
+      for_stmt->block_finalization->accept(this);
+  }
+
+  void visit(WhileStmt *stmt) override {
+    stmt->body->accept(this);
+  }
+
+  void visit(OffloadedStmt *stmt) override {
+    if (stmt->block_initialization)
+      stmt->block_initialization->accept(this);
+    if (stmt->body)
+      stmt->body->accept(this);
+    if (stmt->block_finalization)
+      stmt->block_finalization->accept(this);
+  }
+};
+
 class Simplify : public IRVisitor {
  public:
   StructForStmt *current_struct_for;
   bool modified;
+  // The root block is not included: its statements end up in different
+  // offloaded tasks
+  EnclosingBlocks enclosing_blocks;
+  int depth;
 
   Simplify(IRNode *node) {
     modified = false;
+    depth = 0;
     allow_undefined_visitor = true;
     invoke_default_visitor = true;
     current_struct_for = nullptr;
@@ -911,16 +1075,23 @@ class Simplify : public IRVisitor {
     std::set<int> visited;
     while (true) {
       try {
-        BasicBlockSimplify _(block, visited, current_struct_for);
+        BasicBlockSimplify _(block, visited, current_struct_for,
+                             enclosing_blocks);
       } catch (IRModified) {
         modified = true;
         continue;
       }
       break;
     }
-    for (auto &stmt : block->statements) {
-      stmt->accept(this);
+    depth++;
+    for (int i = 0; i < (int)block->statements.size(); i++) {
+      if (depth > 1)
+        enclosing_blocks.emplace_back(block, i);
+      block->statements[i]->accept(this);
+      if (depth > 1)
+        enclosing_blocks.pop_back();
     }
+    depth--;
   }
 
   void visit(IfStmt *if_stmt) override {
@@ -937,7 +1108,11 @@ class Simplify : public IRVisitor {
   void visit(StructForStmt *for_stmt) override {
     TC_ASSERT(current_struct_for == nullptr);
     current_struct_for = for_stmt;
+    if (for_stmt->block_initialization)
+      for_stmt->block_initialization->accept(this);
     for_stmt->body->accept(this);
+    if (for_stmt->block_finalization)
+      for_stmt->block_finalization->accept(this);
     current_struct_for = nullptr;
   }
 
@@ -946,8 +1121,12 @@ class Simplify : public IRVisitor {
   }
 
   void visit(OffloadedStmt *stmt) override {
+    if (stmt->block_initialization)
+      stmt->block_initialization->accept(this);
     if (stmt->body)
       stmt->body->accept(this);
+    if (stmt->block_finalization)
+      stmt->block_finalization->accept(this);
   }
 };
 
@@ -956,7 +1135,8 @@ namespace irpass {
 void simplify(IRNode *root) {
   while (1) {
     Simplify pass(root);
-    if (!pass.modified)
+    LoopInvariantCodeMotion licm(root);
+    if (!pass.modified && !licm.modified)
       break;
   }
 }
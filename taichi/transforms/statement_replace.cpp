@@ -57,7 +57,11 @@ class StatementReplace : public IRVisitor {
 
   void visit(StructForStmt *for_stmt) override {
     replace_if_necessary(for_stmt);
+    if (for_stmt->block_initialization)
+      for_stmt->block_initialization->accept(this);
     for_stmt->body->accept(this);
+    if (for_stmt->block_finalization)
+      for_stmt->block_finalization->accept(this);
   }
 
   void visit(Stmt *stmt) override {
@@ -45,12 +45,20 @@ class StatementUsageReplace : public IRVisitor {
   }
 
   void visit(StructForStmt *stmt) {
+    if (stmt->block_initialization)
+      stmt->block_initialization->accept(this);
     stmt->body->accept(this);
+    if (stmt->block_finalization)
+      stmt->block_finalization->accept(this);
   }
 
   void visit(OffloadedStmt *stmt) {
+    if (stmt->block_initialization)
+      stmt->block_initialization->accept(this);
     if (stmt->body)
       stmt->body->accept(this);
+    if (stmt->block_finalization)
+      stmt->block_finalization->accept(this);
   }
 
   static void run(IRNode *node, Stmt *old_stmt, Stmt *new_stmt) {
@@ -5,12 +5,82 @@
 
 TLANG_NAMESPACE_BEGIN
 
+// The locals that atomic adds and subtracts go to, or that are stored
+// their own value plus or minus another one, as atomics on locals are once
+// demoted
+class GatherAccumulators : public BasicStmtVisitor {
+ public:
+  using BasicStmtVisitor::visit;
+
+  std::set<Stmt *> accumulators;
+
+  void visit(AtomicOpStmt *stmt) override {
+    if (stmt->dest->is<AllocaStmt>() && (stmt->op_type == AtomicOpType::add ||
+                                         stmt->op_type == AtomicOpType::sub))
+      accumulators.insert(stmt->dest);
+  }
+
+  static bool is_load_of(Stmt *stmt, Stmt *alloca) {
+    auto load = stmt->cast<LocalLoadStmt>();
+    return load && load->same_source() && load->ptr[0].var == alloca;
+  }
+
+  void visit(LocalStoreStmt *stmt) override {
+    auto sum = stmt->data->cast<BinaryOpStmt>();
+    if (sum == nullptr || !stmt->ptr->is<AllocaStmt>())
+      return;
+    bool lhs = is_load_of(sum->lhs, stmt->ptr);
+    bool rhs = is_load_of(sum->rhs, stmt->ptr);
+    if ((sum->op_type == BinaryOpType::add && (lhs || rhs)) ||
+        (sum->op_type == BinaryOpType::sub && lhs))
+      accumulators.insert(stmt->ptr);
+  }
+
+  static std::set<Stmt *> run(IRNode *node) {
+    GatherAccumulators pass;
+    node->accept(&pass);
+    return pass.accumulators;
+  }
+};
+
 // "Type" here does not include vector width
 // Var lookup and Type inference
 class TypeCheck : public IRVisitor {
  public:
+  DataType default_fp;
+  // See Kernel::accumulation_fp
+  DataType accumulation_fp;
+  // The locals that real values are added to or subtracted from
+  std::set<Stmt *> accumulators;
+
   TypeCheck() {
     allow_undefined_visitor = true;
+    auto &program = get_current_program();
+    default_fp = program.config.default_fp;
+    accumulation_fp = DataType::unknown;
+    if (auto kernel = program.get_current_kernel_if_any()) {
+      if (kernel->default_fp != DataType::unknown)
+        default_fp = kernel->default_fp;
+      if (is_real(kernel->accumulation_fp))
+        accumulation_fp = kernel->accumulation_fp;
+    }
+  }
+
+  // Is dt a real type the accumulators of which are widened?
+  bool widens(DataType dt) {
+    return accumulation_fp != DataType::unknown && is_real(dt) &&
+           promoted_type(dt, accumulation_fp) != dt;
+  }
+
+  // A load of a (possibly widened) accumulator, narrowed back on purpose
+  bool is_accumulated(Stmt *stmt) {
+    auto load = stmt->cast<LocalLoadStmt>();
+    return load && load->same_source() && accumulators.count(load->ptr[0].var);
+  }
+
+  // Whether a value of type from stored to type to keeps its precision
+  static bool widening(DataType from, DataType to) {
+    return promoted_type(from, to) == to;
   }
 
   static void mark_as_if_const(Stmt *stmt, VectorType t) {
@@ -45,10 +115,25 @@ class TypeCheck : public IRVisitor {
 
   void visit(AtomicOpStmt *stmt) {
     TC_ASSERT(stmt->width() == 1);
+    if (stmt->dest->ret_type.data_type == DataType::f16)
+      TC_ERROR("Atomic operations on f16 tensors are not supported.");
+    if (stmt->op_type == AtomicOpType::bit_and ||
+        stmt->op_type == AtomicOpType::bit_or ||
+        stmt->op_type == AtomicOpType::bit_xor) {
+      TC_ERROR_UNLESS(is_integral(stmt->dest->ret_type.data_type),
+                      "Atomic {} needs an integer destination, not {}.",
+                      atomic_op_type_name(stmt->op_type),
+                      data_type_name(stmt->dest->ret_type.data_type));
+    }
     if (stmt->val->ret_type.data_type != stmt->dest->ret_type.data_type) {
-      TC_WARN("Atomic add ({} to {}) may lose precision.",
-              data_type_name(stmt->val->ret_type.data_type),
-              data_type_name(stmt->dest->ret_type.data_type));
+      if (!widening(stmt->val->ret_type.data_type,
+                    stmt->dest->ret_type.data_type) &&
+          !is_accumulated(stmt->val)) {
+        TC_WARN("Atomic {} ({} to {}) may lose precision.",
+                atomic_op_type_name(stmt->op_type),
+                data_type_name(stmt->val->ret_type.data_type),
+                data_type_name(stmt->dest->ret_type.data_type));
+      }
       stmt->val = insert_type_cast_before(stmt, stmt->val,
                                           stmt->dest->ret_type.data_type);
     }
@@ -64,6 +149,9 @@ class TypeCheck : public IRVisitor {
     if (stmt->ptr->ret_type.data_type == DataType::unknown) {
       // Infer data type for alloca
       stmt->ptr->ret_type = stmt->data->ret_type;
+      if (accumulators.count(stmt->ptr) &&
+          widens(stmt->data->ret_type.data_type))
+        stmt->ptr->ret_type.data_type = accumulation_fp;
     }
     auto ret_type = promoted_type(stmt->ptr->ret_type.data_type,
                                   stmt->data->ret_type.data_type);
@@ -71,7 +159,8 @@ class TypeCheck : public IRVisitor {
       stmt->data = insert_type_cast_before(stmt, stmt->data,
                                            stmt->ptr->ret_type.data_type);
     }
-    if (stmt->ptr->ret_type.data_type != ret_type) {
+    if (stmt->ptr->ret_type.data_type != ret_type &&
+        !is_accumulated(stmt->data)) {
       TC_WARN(
           "Local store may lose precision (target = {}, value = {}, "
           "stmt_id = {}) at",
@@ -84,6 +173,7 @@ class TypeCheck : public IRVisitor {
 
   void visit(GlobalLoadStmt *stmt) {
     stmt->ret_type = stmt->ptr->ret_type;
+    stmt->ret_type.data_type = compute_type(stmt->ret_type.data_type);
   }
 
   void visit(SNodeOpStmt *stmt) {
@@ -116,14 +206,13 @@ class TypeCheck : public IRVisitor {
   }
 
   void visit(GlobalStoreStmt *stmt) {
-    auto promoted = promoted_type(stmt->ptr->ret_type.data_type,
-                                  stmt->data->ret_type.data_type);
+    auto dt = compute_type(stmt->ptr->ret_type.data_type);
+    auto promoted = promoted_type(dt, stmt->data->ret_type.data_type);
     auto input_type = stmt->data->ret_data_type_name();
-    if (stmt->ptr->ret_type.data_type != stmt->data->ret_type.data_type) {
-      stmt->data = insert_type_cast_before(stmt, stmt->data,
-                                           stmt->ptr->ret_type.data_type);
+    if (dt != stmt->data->ret_type.data_type) {
+      stmt->data = insert_type_cast_before(stmt, stmt->data, dt);
     }
-    if (stmt->ptr->ret_type.data_type != promoted) {
+    if (dt != promoted && !is_accumulated(stmt->data)) {
       TC_WARN("Global store may lose precision: {} <- {}, at",
               stmt->ptr->ret_data_type_name(), input_type, stmt->tb);
     }
@@ -145,7 +234,11 @@ class TypeCheck : public IRVisitor {
   }
 
   void visit(StructForStmt *stmt) {
+    if (stmt->block_initialization)
+      stmt->block_initialization->accept(this);
     stmt->body->accept(this);
+    if (stmt->block_finalization)
+      stmt->block_finalization->accept(this);
   }
 
   void visit(WhileStmt *stmt) {
@@ -229,7 +322,6 @@ class TypeCheck : public IRVisitor {
     }
 
     if (stmt->op_type == BinaryOpType::truediv) {
-      auto default_fp = get_current_program().config.default_fp;
       if (!is_real(stmt->lhs->ret_type.data_type)) {
         cast(stmt->lhs, default_fp);
       }
@@ -335,13 +427,39 @@ class TypeCheck : public IRVisitor {
     stmt->ret_type = VectorType(1, stmt->output_snode->dt);
   }
 
+  // Promoted like the chains of multiplications and additions it stands for
+  void visit(MatmulStmt *stmt) {
+    if (stmt->tensor_cores)
+      return;
+    auto dt = stmt->a[0]->ret_type.data_type;
+    for (auto op : stmt->get_operands())
+      dt = promoted_type(dt, op->ret_type.data_type);
+    for (auto operands : {&stmt->a, &stmt->b}) {
+      for (auto &op : *operands) {
+        if (op->ret_type.data_type != dt)
+          op = insert_type_cast_before(stmt, op, dt);
+      }
+    }
+    stmt->ret_type = VectorType(1, dt);
+  }
+
+  void visit(MatmulResultStmt *stmt) {
+    stmt->ret_type = stmt->mm->ret_type;
+  }
+
   void visit(OffloadedStmt *stmt) {
+    if (stmt->block_initialization)
+      stmt->block_initialization->accept(this);
     if (stmt->body)
       stmt->body->accept(this);
+    if (stmt->block_finalization)
+      stmt->block_finalization->accept(this);
   }
 
   static void run(IRNode *node) {
     TypeCheck inst;
+    if (inst.accumulation_fp != DataType::unknown)
+      inst.accumulators = GatherAccumulators::run(node);
     node->accept(&inst);
   }
 };
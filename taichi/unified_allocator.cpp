@@ -24,15 +24,16 @@ taichi::Tlang::UnifiedAllocator::UnifiedAllocator(std::size_t size, bool gpu)
     if (_cuda_data == nullptr) {
       TC_ERROR("GPU memory allocation failed.");
     }
-    check_cuda_errors(cudaMemAdvise(_cuda_data, size + 4096,
-                                    cudaMemAdviseSetPreferredLocation, 0));
+    // The device of the current CUDA context, see CompileConfig::device_id
+    check_cuda_errors(cudaGetDevice(&device));
+    check_cuda_errors(cudaMemAdvise(
+        _cuda_data, size + 4096, cudaMemAdviseSetPreferredLocation, device));
+    // Let the host map the pages instead of migrating them on every host
+    // access (snapshots, debugging)
     // http://on-demand.gputechconf.com/gtc/2017/presentation/s7285-nikolay-sakharnykh-unified-memory-on-pascal-and-volta.pdf
-    /*
-    cudaMemAdvise(_cuda_data, size + 4096, cudaMemAdviseSetReadMostly,
-                  cudaCpuDeviceId);
-    cudaMemAdvise(_cuda_data, size + 4096, cudaMemAdviseSetAccessedBy,
-                  0);
-                  */
+    check_cuda_errors(cudaMemAdvise(_cuda_data, size + 4096,
+                                    cudaMemAdviseSetAccessedBy,
+                                    cudaCpuDeviceId));
     data = _cuda_data;
 #else
     TC_NOT_IMPLEMENTED
@@ -52,6 +53,36 @@ taichi::Tlang::UnifiedAllocator::UnifiedAllocator(std::size_t size, bool gpu)
   data = (char *)data + 4096;
   *head = data;
   *tail = (void *)(((char *)head) + size);
+  generation = ++generation_counter;
+}
+
+std::atomic<uint64> UnifiedAllocator::generation_counter(0);
+
+void *UnifiedAllocator::mark() {
+  return __atomic_load_n(head, __ATOMIC_SEQ_CST);
+}
+
+void UnifiedAllocator::release(void *mark) {
+  auto begin = (char *)mark;
+  auto end = (char *)(*head);
+  TC_ASSERT(data <= begin && begin <= end);
+  // Drop the thread arenas, which may lie above mark
+  generation = ++generation_counter;
+  *head = mark;
+  if (gpu) {
+#if defined(CUDA_FOUND)
+    check_cuda_errors(cudaMemset(begin, 0, end - begin));
+#else
+    TC_NOT_IMPLEMENTED
+#endif
+  } else {
+    // Zero the page containing mark, and give the others back to the OS
+    auto page_begin = align_up(begin, VirtualMemoryAllocator::page_size);
+    auto page_end = align_up(end, VirtualMemoryAllocator::page_size);
+    std::memset(begin, 0, std::min(page_begin, end) - begin);
+    if (page_begin < page_end)
+      cpu_vm->discard(page_begin, page_end - page_begin);
+  }
 }
 
 taichi::Tlang::UnifiedAllocator::~UnifiedAllocator() {
@@ -68,7 +99,20 @@ taichi::Tlang::UnifiedAllocator::~UnifiedAllocator() {
 }
 
 void taichi::Tlang::UnifiedAllocator::create(bool gpu) {
-  TC_ASSERT(allocator() == nullptr);
+  if (allocator() != nullptr) {
+    // Left by UnifiedAllocator::recycle()
+    if (allocator()->gpu == gpu) {
+      if (!gpu)
+        return;
+#if defined(CUDA_FOUND)
+      int device;
+      check_cuda_errors(cudaGetDevice(&device));
+      if (allocator()->device == device)
+        return;
+#endif
+    }
+    free();
+  }
   void *dst;
   if (gpu) {
 #if defined(CUDA_FOUND)
@@ -108,6 +152,38 @@ void taichi::Tlang::UnifiedAllocator::free() {
   allocator() = nullptr;
 }
 
+void UnifiedAllocator::set_huge_pages(bool enable) {
+  if (!gpu)
+    cpu_vm->advise_huge_pages(enable);
+}
+
+void UnifiedAllocator::prefetch_to_device(std::size_t extra) {
+  if (!gpu)
+    return;
+#if defined(CUDA_FOUND)
+  int device;
+  check_cuda_errors(cudaGetDevice(&device));
+  auto begin = (char *)head;
+  auto end = std::min((char *)(*head) + extra, (char *)(*tail));
+  check_cuda_errors(cudaMemPrefetchAsync(begin, end - begin, device));
+  check_cuda_errors(cudaDeviceSynchronize());
+#else
+  TC_NOT_IMPLEMENTED
+#endif
+}
+
+void taichi::Tlang::UnifiedAllocator::recycle() {
+  if (allocator()->gpu) {
+#if defined(CUDA_FOUND)
+    // Kernels of the program may still be running
+    check_cuda_errors(cudaDeviceSynchronize());
+#else
+    TC_NOT_IMPLEMENTED
+#endif
+  }
+  allocator()->reset();
+}
+
 void taichi::Tlang::UnifiedAllocator::memset(unsigned char val) {
   std::memset(data, val, size);
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "common.h"
+#include <atomic>
 #include <mutex>
 #include <vector>
 #include <memory>
@@ -23,6 +24,37 @@ class UnifiedAllocator {
 #endif
   std::size_t size{};
   bool gpu{};
+  // The CUDA device the memory prefers
+  int device{};
+  // Changes whenever the thread arenas must be dropped
+  uint64 generation{};
+
+  static std::atomic<uint64> generation_counter;
+
+  // Small requests are served from a chunk owned by the calling thread
+  struct Arena {
+    uint64 generation = 0;
+    char *head = nullptr;
+    char *tail = nullptr;
+  };
+
+  static constexpr std::size_t arena_size = 64 * 1024;
+  static constexpr std::size_t arena_max_request = 1024;
+
+  static char *align_up(char *p, std::size_t alignment) {
+    return p + (alignment - 1 - ((std::size_t)p + alignment - 1) % alignment);
+  }
+
+  // Bumps *head, which kernels bump as well (see allocate_from_memory_pool)
+  char *alloc_shared(std::size_t size, std::size_t alignment) {
+    auto p = __atomic_load_n((char **)head, __ATOMIC_RELAXED);
+    while (true) {
+      auto ret = align_up(p, alignment);
+      if (__atomic_compare_exchange_n((char **)head, &p, ret + size, true,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return ret;
+    }
+  }
 
   // put these two on the unified memory so that GPU can have access
  public:
@@ -30,7 +62,6 @@ class UnifiedAllocator {
   void **head{};
   void **tail{};
   int gpu_error_code;
-  std::mutex lock;
 
  public:
   UnifiedAllocator();
@@ -39,14 +70,45 @@ class UnifiedAllocator {
 
   ~UnifiedAllocator();
 
+  // Lock-free, thread-safe
   void *alloc(std::size_t size, int alignment) {
-    std::lock_guard<std::mutex> _(lock);
-    auto ret = (char *)(*head) + alignment - 1 -
-               ((std::size_t)(char *)(*head) + alignment - 1) % alignment;
-    *head = (char *)ret + size;
+    if (size > arena_max_request)
+      return alloc_shared(size, alignment);
+    thread_local Arena arena;
+    if (arena.generation != generation) {
+      arena = Arena();
+      arena.generation = generation;
+    }
+    auto ret = arena.head ? align_up(arena.head, alignment) : nullptr;
+    if (!ret || ret + size > arena.tail) {
+      arena.head = alloc_shared(arena_size, 4096);
+      arena.tail = arena.head + arena_size;
+      ret = align_up(arena.head, alignment);
+    }
+    arena.head = ret + size;
     return ret;
   }
 
+  // Everything allocated after mark() is freed by release(mark). Neither may
+  // run concurrently with allocations or kernels.
+  void *mark();
+
+  void release(void *mark);
+
+  // Frees everything. Freed memory reads as zero when allocated again.
+  void reset() {
+    release(data);
+  }
+
+  // Huge pages for the CPU memory pool. Allocations must themselves be
+  // aligned to VirtualMemoryAllocator::huge_page_size to use them.
+  void set_huge_pages(bool enable);
+
+  // Moves everything allocated so far, and the next extra bytes of the
+  // pool, to the GPU so that kernels do not fault on first access. No-op on
+  // CPU.
+  void prefetch_to_device(std::size_t extra = 0);
+
   void memset(unsigned char val);
 
   bool initialized() const {
@@ -55,9 +117,15 @@ class UnifiedAllocator {
 
   UnifiedAllocator operator=(const UnifiedAllocator &) = delete;
 
+  // Reuses the allocator of a finalized program if it is of the same kind
+  // (and on the same device)
   static void create(bool gpu);
 
   static void free();
+
+  // Called when a program is finalized: only resets the allocator, so that
+  // the next program skips mapping the memory again
+  static void recycle();
 };
 
 TC_FORCE_INLINE void *allocate(std::size_t size, int alignment = 1) {
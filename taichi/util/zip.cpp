@@ -109,6 +109,28 @@ std::vector<uint8> read(const std::string fn, bool verbose) {
   return ret;
 }
 
+std::vector<uint8> compress_block(const uint8 *data,
+                                  std::size_t len,
+                                  int level) {
+  mz_ulong compressed_len = mz_compressBound((mz_ulong)len);
+  std::vector<uint8> ret(compressed_len);
+  auto status = mz_compress2(ret.data(), &compressed_len, data, (mz_ulong)len,
+                             level);
+  TC_ERROR_UNLESS(status == MZ_OK, "mz_compress2() failed: {}", status);
+  ret.resize(compressed_len);
+  return ret;
+}
+
+void decompress_block(const uint8 *data,
+                      std::size_t len,
+                      uint8 *out,
+                      std::size_t out_len) {
+  mz_ulong decompressed_len = (mz_ulong)out_len;
+  auto status = mz_uncompress(out, &decompressed_len, data, (mz_ulong)len);
+  TC_ERROR_UNLESS(status == MZ_OK && decompressed_len == out_len,
+                  "mz_uncompress() failed: {}", status);
+}
+
 }  // namespace zip
 
 TC_NAMESPACE_END
@@ -2,8 +2,11 @@
 
 #include <taichi/math.h>
 #include <taichi/system/timer.h>
+#include <condition_variable>
 #include <ctime>
+#include <mutex>
 #include <numeric>
+#include <thread>
 
 #if defined(TC_PLATFORM_LINUX)
 #define TC_GUI_X11
@@ -339,6 +342,26 @@ class Canvas {
     return lines.back();
   }
 
+  // Batched primitives, like circle() and path() with one call each, but
+  // rasterized in parallel over tiles of the image. Primitives are drawn in
+  // the order given, so that overlaps blend the same. Positions are (x, y)
+  // pairs in canvas coordinates, colors hex RGB values and radii in pixels;
+  // null arrays use the single color or radius for all primitives.
+  void draw_circles(int n,
+                    const float32 *centers,
+                    const uint32 *colors,
+                    uint32 color,
+                    const float32 *radii,
+                    real radius);
+
+  void draw_segments(int n,
+                     const float32 *begins,
+                     const float32 *ends,
+                     const uint32 *colors,
+                     uint32 color,
+                     const float32 *radii,
+                     real radius);
+
   void line(Vector2 start, Vector2 end, Vector4 color) {
     // convert to screen space
     start = transform(start);
@@ -485,6 +508,29 @@ class GUI : public GUIBase {
     bool button_status[3];
   };
 
+  // With threaded presentation, a thread of its own owns the window: it
+  // creates it, handles its events and draws the latest submitted frame at
+  // the display rate, so that update() only copies the frame and never
+  // waits for the window. Frames submitted faster than they are presented
+  // are dropped. The frames go through three buffers: the one update()
+  // writes, the latest complete one, and the one being presented.
+  bool threaded;
+  std::thread presentation_thread;
+  // Guards the fields below, cursor_pos and key_pressed, and is held by the
+  // presentation thread while it handles events
+  std::mutex presentation_mutex;
+  std::condition_variable presentation_cv;
+  Array2D<Vector4> frames[3];
+  int written_frame, latest_frame, presented_frame;
+  // Whether latest_frame has been submitted since it was last presented
+  bool fresh_frame;
+  bool stopping;
+  std::string title;
+  // Of the presentation thread, which mouse_event() queues for update()
+  std::vector<MouseEvent> pending_events;
+  // The frame the drawing of the window reads
+  Array2D<Vector4> *presented;
+
   struct Rect {
     Vector2i pos;
     Vector2i size;
@@ -693,6 +739,15 @@ class GUI : public GUIBase {
   void process_event();
 
   void mouse_event(MouseEvent e) {
+    if (threaded) {
+      // Called from process_event() with presentation_mutex held
+      pending_events.push_back(e);
+      return;
+    }
+    dispatch_mouse_event(e);
+  }
+
+  void dispatch_mouse_event(MouseEvent e) {
     if (e.type == MouseEvent::Type::press) {
       button_status[0] = true;
     }
@@ -710,16 +765,40 @@ class GUI : public GUIBase {
   explicit GUI(const std::string &window_name,
                int width = 800,
                int height = 800,
-               bool normalized_coord = true)
+               bool normalized_coord = true,
+               bool threaded = false)
       : window_name(window_name),
         width(width),
         height(height),
-        key_pressed(false) {
+        key_pressed(false),
+        cursor_pos(0),
+        threaded(threaded),
+        written_frame(0),
+        latest_frame(1),
+        presented_frame(2),
+        fresh_frame(false),
+        stopping(false),
+        title(window_name) {
     memset(button_status, 0, sizeof(button_status));
-    create_window();
-    set_title(window_name);
-    start_time = taichi::Time::get_time();
+#if defined(TC_GUI_COCOA)
+    if (threaded) {
+      // AppKit windows can only be used from the main thread
+      TC_WARN("Threaded presentation is not supported on macOS");
+      this->threaded = threaded = false;
+    }
+#endif
     buffer.initialize(Vector2i(width, height));
+    presented = &buffer;
+    if (threaded) {
+      for (auto &frame : frames)
+        frame.initialize(Vector2i(width, height));
+      presented = &frames[presented_frame];
+      presentation_thread = std::thread([this] { present(); });
+    } else {
+      create_window();
+      set_title(window_name);
+    }
+    start_time = taichi::Time::get_time();
     canvas = std::make_unique<Canvas>(buffer);
     last_frame_time = taichi::Time::get_time();
     if (!normalized_coord) {
@@ -730,8 +809,9 @@ class GUI : public GUIBase {
 
   explicit GUI(const std::string &window_name,
                Vector2i res,
-               bool normalized_coord = true)
-      : GUI(window_name, res[0], res[1], normalized_coord) {
+               bool normalized_coord = true,
+               bool threaded = false)
+      : GUI(window_name, res[0], res[1], normalized_coord, threaded) {
   }
 
   void create_window();
@@ -744,7 +824,7 @@ class GUI : public GUIBase {
 
   void set_title(std::string title);
 
-  void redraw_widgets() {
+  void redraw_widgets(Vector2i cursor_pos) {
     auto old_transform_matrix = canvas->transform_matrix;
     canvas->set_idendity_transform_matrix();
     for (auto &w : widgets) {
@@ -756,32 +836,130 @@ class GUI : public GUIBase {
 
   void update() {
     frame_id++;
-    redraw_widgets();
-    while (taichi::Time::get_time() < start_time + frame_id / (real)fps)
-      ;
-    redraw();
-    process_event();
+    if (threaded) {
+      submit();
+    } else {
+      redraw_widgets(cursor_pos);
+      while (taichi::Time::get_time() < start_time + frame_id / (real)fps)
+        ;
+      redraw();
+      process_event();
+    }
     while (last_frame_interval.size() > 30) {
       last_frame_interval.erase(last_frame_interval.begin());
     }
     auto real_fps = last_frame_interval.size() /
                     (std::accumulate(last_frame_interval.begin(),
                                      last_frame_interval.end(), 0.0_f));
-    set_title(fmt::format("{} ({:.02f} FPS)", window_name, real_fps));
+    auto new_title = fmt::format("{} ({:.02f} FPS)", window_name, real_fps);
+    if (threaded) {
+      std::lock_guard<std::mutex> _(presentation_mutex);
+      title = new_title;
+    } else {
+      set_title(new_title);
+    }
     if (last_frame_time != 0) {
       last_frame_interval.push_back(taichi::Time::get_time() - last_frame_time);
     }
     last_frame_time = taichi::Time::get_time();
   }
 
+  // Whether a key has been pressed since the last call
+  bool take_key_press() {
+    std::lock_guard<std::mutex> _(presentation_mutex);
+    bool ret = key_pressed;
+    key_pressed = false;
+    return ret;
+  }
+
   void wait_key() {
+    take_key_press();
     while (true) {
-      key_pressed = false;
       update();
-      if (key_pressed) {
+      if (take_key_press()) {
         break;
       }
+      if (threaded) {
+        // update() does not wait for the display
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000 / fps));
+      }
+    }
+  }
+
+  // Hands the canvas over to the presentation thread, after the events it
+  // has queued. Waits for nothing but the copy.
+  void submit() {
+    std::vector<MouseEvent> events;
+    Vector2i cursor;
+    {
+      std::lock_guard<std::mutex> _(presentation_mutex);
+      std::swap(events, pending_events);
+      cursor = cursor_pos;
+    }
+    for (auto &e : events)
+      dispatch_mouse_event(e);
+    redraw_widgets(cursor);
+    auto &frame = frames[written_frame];
+    std::memcpy((void *)frame.get_data().data(),
+                (void *)buffer.get_data().data(), buffer.get_data_size());
+    {
+      std::lock_guard<std::mutex> _(presentation_mutex);
+      std::swap(written_frame, latest_frame);
+      fresh_frame = true;
+    }
+    presentation_cv.notify_one();
+  }
+
+  // The loop of the presentation thread
+  void present() {
+    create_window();
+    std::string shown_title = window_name;
+    set_title(shown_title);
+    auto next_time = std::chrono::steady_clock::now();
+    while (true) {
+      next_time += std::chrono::microseconds(1000000 / fps);
+      bool draw = false;
+      std::string new_title;
+      {
+        std::unique_lock<std::mutex> lock(presentation_mutex);
+        presentation_cv.wait_until(lock, next_time, [&] { return stopping; });
+        if (stopping)
+          break;
+        if (fresh_frame) {
+          // Older frames were overwritten by latest_frame
+          std::swap(latest_frame, presented_frame);
+          fresh_frame = false;
+          draw = true;
+        }
+        new_title = title;
+      }
+      if (draw) {
+        presented = &frames[presented_frame];
+        redraw();
+      }
+      if (new_title != shown_title) {
+        shown_title = new_title;
+        set_title(shown_title);
+      }
+      {
+        std::lock_guard<std::mutex> _(presentation_mutex);
+        process_event();
+      }
+      // Skip the ticks missed while drawing
+      next_time = std::max(next_time, std::chrono::steady_clock::now());
+    }
+  }
+
+  // Called first by the destructors of the windows
+  void stop_presentation() {
+    if (!presentation_thread.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> _(presentation_mutex);
+      stopping = true;
     }
+    presentation_cv.notify_one();
+    presentation_thread.join();
   }
 
   void draw_log() {
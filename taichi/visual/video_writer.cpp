@@ -0,0 +1,131 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#include "video_writer.h"
+
+#if defined(TC_PLATFORM_WINDOWS)
+#define popen _popen
+#define pclose _pclose
+#else
+#include <csignal>
+#include <pthread.h>
+#endif
+
+TC_NAMESPACE_BEGIN
+
+VideoWriter::VideoWriter(const std::string &filename,
+                         Vector2i res,
+                         int framerate,
+                         const std::string &codec,
+                         int quality,
+                         int queue_depth)
+    : res(res), queue_depth(queue_depth), num_frames(0) {
+  TC_ASSERT(res.x > 0 && res.y > 0);
+  TC_ASSERT(queue_depth >= 1);
+  // yuv420p, which players expect, needs even sizes: pad odd ones by a
+  // pixel rather than fail
+  auto command = fmt::format(
+      "ffmpeg -loglevel error -y -f rawvideo -pix_fmt rgb24 -s {}x{} -r {} "
+      "-i - -vf \"pad=ceil(iw/2)*2:ceil(ih/2)*2\" -c:v {} -crf {} "
+      "-pix_fmt yuv420p \"{}\"",
+      res.x, res.y, framerate, codec, quality, filename);
+#if defined(TC_PLATFORM_WINDOWS)
+  pipe = popen(command.c_str(), "wb");
+#else
+  pipe = popen(command.c_str(), "w");
+#endif
+  TC_ERROR_UNLESS(pipe != nullptr, "Failed to start ffmpeg for {}", filename);
+  closing = false;
+  failed = false;
+  thread = std::thread([this] { run(); });
+}
+
+void VideoWriter::run() {
+#if !defined(TC_PLATFORM_WINDOWS)
+  // Writes to the pipe of an encoder that exited fail with EPIPE on this
+  // thread, instead of a SIGPIPE that terminates the process
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &set, nullptr);
+#endif
+  while (true) {
+    std::vector<uint8> frame;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this] { return closing || !frames.empty(); });
+      if (frames.empty())
+        return;
+      frame = std::move(frames.front());
+      frames.pop_front();
+    }
+    cv.notify_all();
+    if (!failed &&
+        std::fwrite(frame.data(), 1, frame.size(), pipe) != frame.size()) {
+      // The encoder exited, and has printed why
+      TC_WARN("Video encoder stopped reading frames; dropping the rest");
+      failed = true;
+    }
+    std::lock_guard<std::mutex> _(mutex);
+    free_frames.push_back(std::move(frame));
+  }
+}
+
+void VideoWriter::push(std::vector<uint8> &&frame) {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    TC_ASSERT(!closing);
+    cv.wait(lock, [this] { return (int)frames.size() < queue_depth; });
+    frames.push_back(std::move(frame));
+  }
+  cv.notify_all();
+  num_frames++;
+}
+
+void VideoWriter::write(const Array2D<Vector4> &img) {
+  TC_ASSERT(img.get_res() == res);
+  std::vector<uint8> frame;
+  {
+    std::lock_guard<std::mutex> _(mutex);
+    if (!free_frames.empty()) {
+      frame = std::move(free_frames.back());
+      free_frames.pop_back();
+    }
+  }
+  frame.resize(res.x * res.y * 3);
+  for (int r = 0; r < res.y; r++) {
+    auto row = &frame[r * res.x * 3];
+    int j = res.y - 1 - r;
+    for (int i = 0; i < res.x; i++) {
+      auto &pixel = img[i][j];
+      for (int c = 0; c < 3; c++)
+        row[i * 3 + c] = (uint8)(clamp(pixel[c], 0.0_f, 1.0_f) * 255 + 0.5_f);
+    }
+  }
+  push(std::move(frame));
+}
+
+void VideoWriter::write_rgb(const uint8 *data) {
+  push(std::vector<uint8>(data, data + res.x * res.y * 3));
+}
+
+void VideoWriter::close() {
+  if (pipe == nullptr)
+    return;
+  {
+    std::lock_guard<std::mutex> _(mutex);
+    closing = true;
+  }
+  cv.notify_all();
+  thread.join();
+  pclose(pipe);
+  pipe = nullptr;
+}
+
+VideoWriter::~VideoWriter() {
+  close();
+}
+
+TC_NAMESPACE_END
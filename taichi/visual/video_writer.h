@@ -0,0 +1,68 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <taichi/math.h>
+
+TC_NAMESPACE_BEGIN
+
+// Streams frames to a video file through an ffmpeg process reading raw RGB
+// from a pipe, instead of writing an image file per frame. write() converts
+// the frame to 8-bit rows (top to bottom, as ffmpeg expects) and queues
+// them for a thread of its own, which feeds the pipe while the next frame is
+// computed. Up to queue_depth frames wait in the queue; more block write().
+//
+// codec is any ffmpeg video encoder, e.g. "libx264" or "h264_nvenc" for the
+// hardware encoder of NVIDIA GPUs.
+class VideoWriter {
+ public:
+  VideoWriter(const std::string &filename,
+              Vector2i res,
+              int framerate = 24,
+              const std::string &codec = "libx264",
+              int quality = 20,
+              int queue_depth = 4);
+
+  // Frames in the coordinates of the GUI, with (0, 0) at the bottom left and
+  // colors in [0, 1]
+  void write(const Array2D<Vector4> &img);
+
+  // Tightly packed 8-bit rows, top to bottom
+  void write_rgb(const uint8 *data);
+
+  int get_num_frames() const {
+    return num_frames;
+  }
+
+  // Waits for the queued frames and for the encoder to finish the file
+  void close();
+
+  ~VideoWriter();
+
+ private:
+  void run();
+  void push(std::vector<uint8> &&frame);
+
+  Vector2i res;
+  int queue_depth;
+  int num_frames;
+  FILE *pipe;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::vector<uint8>> frames;
+  // Frame buffers that have been written, reused for the next frames
+  std::vector<std::vector<uint8>> free_frames;
+  bool closing;
+  bool failed;
+};
+
+TC_NAMESPACE_END
@@ -4,5 +4,169 @@
 *******************************************************************************/
 
 #include "voxelizer.h"
+#include <taichi/system/threading.h>
+
 TC_NAMESPACE_BEGIN
+
+namespace {
+
+void voxelizer_parallel_for(int n, const std::function<void(int)> &body) {
+  static ThreadPool pool;
+  if (n <= 0)
+    return;
+  pool.run(n, pool.max_num_threads,
+           const_cast<std::function<void(int)> *>(&body),
+           [](void *body, int i) {
+             (*(std::function<void(int)> *)body)(i);
+           });
+}
+
+// A triangle projected on the xy plane, with edge functions in double
+// precision so that the crossings of shared edges are decided consistently
+struct ProjectedTriangle {
+  float64 x[3], y[3], z[3];
+  float64 area;
+  // The columns [lower, upper] whose centers may be covered
+  Vector2i lower, upper;
+
+  void initialize(const float32 *v, Vector2i res) {
+    for (int i = 0; i < 3; i++) {
+      x[i] = v[i * 3];
+      y[i] = v[i * 3 + 1];
+      z[i] = v[i * 3 + 2];
+    }
+    area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    // Column centers are at i + 0.5
+    auto min_x = std::min({x[0], x[1], x[2]});
+    auto max_x = std::max({x[0], x[1], x[2]});
+    auto min_y = std::min({y[0], y[1], y[2]});
+    auto max_y = std::max({y[0], y[1], y[2]});
+    lower = Vector2i(std::max(0, (int)std::ceil(min_x - 0.5)),
+                     std::max(0, (int)std::ceil(min_y - 0.5)));
+    upper = Vector2i(std::min(res.x - 1, (int)std::floor(max_x - 0.5)),
+                     std::min(res.y - 1, (int)std::floor(max_y - 0.5)));
+    if (area == 0) {
+      // Parallel to z: its neighbors account for the columns through it
+      upper = lower - Vector2i(1);
+    }
+  }
+
+  // Whether the column through (px, py) crosses the triangle, with the
+  // top-left rule for the points on edges. Returns the z of the crossing.
+  bool cross(float64 px, float64 py, float64 &pz) const {
+    float64 sign = area > 0 ? 1 : -1;
+    float64 w[3];
+    for (int e = 0; e < 3; e++) {
+      int a = (e + 1) % 3, b = (e + 2) % 3;
+      float64 dx = x[b] - x[a], dy = y[b] - y[a];
+      w[e] = sign * (dx * (py - y[a]) - dy * (px - x[a]));
+      if (w[e] < 0)
+        return false;
+      if (w[e] == 0) {
+        // Each edge is shared by two triangles projected with opposite
+        // orientations: keep the points of edges going down, or going left
+        // when horizontal, in the counter-clockwise orientation
+        float64 odx = sign * dx, ody = sign * dy;
+        if (!(ody < 0 || (ody == 0 && odx < 0)))
+          return false;
+      }
+    }
+    float64 total = w[0] + w[1] + w[2];
+    if (total == 0)
+      return false;
+    pz = (w[0] * z[0] + w[1] * z[1] + w[2] * z[2]) / total;
+    return true;
+  }
+};
+
+}  // namespace
+
+void Voxelizer::voxelize(const float32 *triangles,
+                         int num_triangles,
+                         const RunFunction &fill) const {
+  TC_ASSERT(res.x > 0 && res.y > 0 && res.z > 0);
+  std::vector<ProjectedTriangle> projected(num_triangles);
+  voxelizer_parallel_for((num_triangles + 4095) / 4096, [&](int b) {
+    for (int t = b * 4096; t < std::min(num_triangles, (b + 1) * 4096); t++)
+      projected[t].initialize(triangles + t * 9, Vector2i(res.x, res.y));
+  });
+
+  int tiles_x = (res.x + tile_size - 1) / tile_size;
+  int tiles_y = (res.y + tile_size - 1) / tile_size;
+  auto for_each_tile = [&](int t, const std::function<void(int)> &f) {
+    auto &tri = projected[t];
+    if (tri.lower.x > tri.upper.x || tri.lower.y > tri.upper.y)
+      return;
+    for (int tx = tri.lower.x / tile_size; tx <= tri.upper.x / tile_size;
+         tx++) {
+      for (int ty = tri.lower.y / tile_size; ty <= tri.upper.y / tile_size;
+           ty++) {
+        f(tx * tiles_y + ty);
+      }
+    }
+  };
+  // Counting sort of the (tile, triangle) pairs by tile
+  std::vector<int> offsets(tiles_x * tiles_y + 1, 0);
+  for (int t = 0; t < num_triangles; t++)
+    for_each_tile(t, [&](int tile) { offsets[tile + 1]++; });
+  for (int tile = 0; tile < tiles_x * tiles_y; tile++)
+    offsets[tile + 1] += offsets[tile];
+  std::vector<int> ids(offsets.back());
+  std::vector<int> cursor(offsets.begin(), offsets.end() - 1);
+  for (int t = 0; t < num_triangles; t++)
+    for_each_tile(t, [&](int tile) { ids[cursor[tile]++] = t; });
+
+  constexpr int columns = tile_size * tile_size;
+  voxelizer_parallel_for(tiles_x * tiles_y, [&](int tile) {
+    if (offsets[tile] == offsets[tile + 1])
+      return;
+    auto tile_lower = Vector2i(tile / tiles_y, tile % tiles_y) * tile_size;
+    // Entry z * columns + c toggles the insideness of voxel z and all above
+    // it in column c, and becomes the insideness after the prefix XOR
+    std::vector<uint8> mask((res.z + 1) * columns, 0);
+    for (int k = offsets[tile]; k < offsets[tile + 1]; k++) {
+      auto &tri = projected[ids[k]];
+      int i0 = std::max(tri.lower.x, tile_lower.x);
+      int i1 = std::min(tri.upper.x, tile_lower.x + tile_size - 1);
+      int j0 = std::max(tri.lower.y, tile_lower.y);
+      int j1 = std::min(tri.upper.y, tile_lower.y + tile_size - 1);
+      for (int i = i0; i <= i1; i++) {
+        for (int j = j0; j <= j1; j++) {
+          float64 pz;
+          if (!tri.cross(i + 0.5, j + 0.5, pz))
+            continue;
+          // The first voxel whose center is above the crossing
+          auto first = std::ceil(pz - 0.5);
+          int z = (int)clamp(first, 0.0, (float64)res.z);
+          int c = (i - tile_lower.x) * tile_size + (j - tile_lower.y);
+          mask[z * columns + c] ^= 1;
+        }
+      }
+    }
+    // Prefix XOR along z, vectorized over the columns
+    for (int z = 1; z < res.z; z++) {
+      auto below = &mask[(z - 1) * columns];
+      auto current = &mask[z * columns];
+      for (int c = 0; c < columns; c++)
+        current[c] ^= below[c];
+    }
+    for (int c = 0; c < columns; c++) {
+      int i = tile_lower.x + c / tile_size, j = tile_lower.y + c % tile_size;
+      if (i >= res.x || j >= res.y)
+        continue;
+      int z = 0;
+      while (z < res.z) {
+        if (!mask[z * columns + c]) {
+          z++;
+          continue;
+        }
+        int begin = z;
+        while (z < res.z && mask[z * columns + c])
+          z++;
+        fill(i, j, begin, z);
+      }
+    }
+  });
+}
+
 TC_NAMESPACE_END
@@ -11,9 +11,48 @@
 
 TC_NAMESPACE_BEGIN
 
+// Solid voxelization of closed triangle meshes. In grid coordinates, voxel
+// (i, j, k) spans [i, i + 1) x [j, j + 1) x [k, k + 1), and it is inside
+// when an odd number of triangles cross the z column through the center of
+// (i, j) below its center (k + 0.5). Shared edges and vertices are counted
+// once, so watertight meshes have no leaks.
+//
+// The triangles are binned by tiles of columns, and the tiles voxelized in
+// parallel: the crossings of a tile toggle a [z][column] mask, whose prefix
+// XOR along z, for all columns of the tile at once, gives the inside voxels.
 class Voxelizer {
- protected:
  public:
+  static constexpr int tile_size = 16;
+
+  Vector3i res;
+
+  explicit Voxelizer(Vector3i res) : res(res) {
+  }
+
+  // Voxels [k_begin, k_end) of column (i, j) are inside. Runs are reported
+  // concurrently from several threads, each column from one of them.
+  using RunFunction = std::function<void(int, int, int, int)>;
+
+  // triangles holds the 9 grid coordinates of the 3 vertices of each of
+  // num_triangles triangles
+  void voxelize(const float32 *triangles,
+                int num_triangles,
+                const RunFunction &fill) const;
+
+  // Sets the inside voxels of a res array of T (e.g. a numpy array), with
+  // strides in bytes, to value, leaving the other voxels as they are
+  template <typename T>
+  void voxelize(const float32 *triangles,
+                int num_triangles,
+                T *out,
+                const int64 strides[3],
+                T value) const {
+    voxelize(triangles, num_triangles, [&](int i, int j, int k0, int k1) {
+      auto column = (char *)out + i * strides[0] + j * strides[1];
+      for (int k = k0; k < k1; k++)
+        *(T *)(column + k * strides[2]) = value;
+    });
+  }
 };
 
 TC_NAMESPACE_END
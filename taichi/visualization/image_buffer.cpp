@@ -4,6 +4,7 @@
 *******************************************************************************/
 
 #include <taichi/visualization/image_buffer.h>
+#include <taichi/image/operations.h>
 #include <taichi/math/math.h>
 #include <taichi/math/linalg.h>
 #include <taichi/io/base64.h>
@@ -72,18 +73,17 @@ void Array2D<T>::write_as_image(const std::string &filename) {
 #if defined(TC_IMAGE_IO)
   int comp = 3;
   std::vector<unsigned char> data(this->res[0] * this->res[1] * comp);
-  for (int i = 0; i < this->res[0]; i++) {
-    for (int j = 0; j < this->res[1]; j++) {
+  // By rows of the file, in parallel
+  image_parallel_for(this->res[1], [&](int j) {
+    for (int i = 0; i < this->res[0]; i++) {
+      VectorND<3, real> pixel(
+          this->data[i * this->res[1] + (this->res[1] - j - 1)]);
       for (int k = 0; k < comp; k++) {
         data[j * this->res[0] * comp + i * comp + k] =
-            (unsigned char)(255.0f *
-                            clamp(VectorND<3, real>(
-                                      this->data[i * this->res[1] +
-                                                 (this->res[1] - j - 1)])[k],
-                                  0.0_f, 1.0_f));
+            (unsigned char)(255.0f * clamp(pixel[k], 0.0_f, 1.0_f));
       }
     }
-  }
+  });
   TC_ASSERT(filename.size() >= 5);
   int write_result = 0;
   std::string suffix = filename.substr(filename.size() - 4);
@@ -0,0 +1,65 @@
+#include <taichi/lang.h>
+#include <taichi/testing.h>
+
+TLANG_NAMESPACE_BEGIN
+
+namespace {
+int num_alive = 0;
+
+class CountedNode : public IRNode {
+ public:
+  std::vector<int, IRAllocator<int>> data;
+
+  CountedNode(int n) : data(n, n) {
+    num_alive++;
+  }
+
+  ~CountedNode() override {
+    num_alive--;
+  }
+};
+}  // namespace
+
+TC_TEST("ir_arena") {
+  SECTION("arena_and_heap") {
+    auto arena = std::make_unique<IRArena>();
+    std::vector<std::unique_ptr<IRNode>> nodes;
+    {
+      IRArena::Guard _(arena.get());
+      for (int i = 0; i < 1000; i++)
+        nodes.push_back(std::make_unique<CountedNode>(i % 100));
+      // Larger than a chunk
+      nodes.push_back(std::make_unique<CountedNode>(100000));
+    }
+    auto allocated = arena->get_allocated();
+    TC_CHECK(allocated > 100000 * sizeof(int));
+    // Outside of the guard
+    nodes.push_back(std::make_unique<CountedNode>(10));
+    TC_CHECK(arena->get_allocated() == allocated);
+    TC_CHECK(num_alive == 1002);
+    for (int i = 0; i < 1001; i++) {
+      auto node = (CountedNode *)nodes[i].get();
+      TC_CHECK(node->data.size() == (i < 1000 ? i % 100 : 100000));
+      TC_CHECK((std::size_t)node->data.data() % alignof(std::max_align_t) ==
+               0);
+    }
+    nodes.clear();
+    TC_CHECK(num_alive == 0);
+    arena.reset();
+  }
+
+  SECTION("nested_guards") {
+    IRArena a, b;
+    {
+      IRArena::Guard _(&a);
+      {
+        IRArena::Guard __(&b);
+        TC_CHECK(IRArena::current() == &b);
+      }
+      TC_CHECK(IRArena::current() == &a);
+    }
+    TC_CHECK(IRArena::current() == nullptr);
+  }
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,41 @@
+#include <taichi/list_tracker.h>
+#include <taichi/testing.h>
+
+TLANG_NAMESPACE_BEGIN
+
+TC_TEST("list_tracker") {
+  // The list of SNode 2 below SNodes 1 and 0, generated by its clear_list
+  // and listgen tasks
+  TaskStructure clear, listgen;
+  clear.list_snode = listgen.list_snode = 2;
+  clear.clears_list = true;
+  clear.list_ancestors = listgen.list_ancestors = {1, 0};
+  clear.unknown_writes = listgen.unknown_writes = false;
+  TaskStructure activate;
+  activate.writes = {1};
+  activate.unknown_writes = false;
+  TaskStructure data;
+  data.writes = {3};
+  data.unknown_writes = false;
+  TaskStructure unknown;
+
+  ListTracker tracker;
+  TC_CHECK(!tracker.skip(clear));
+  TC_CHECK(!tracker.skip(listgen));
+  TC_CHECK(!tracker.skip(data));
+  TC_CHECK(tracker.skip(clear));
+  TC_CHECK(tracker.skip(listgen));
+
+  TC_CHECK(!tracker.skip(activate));
+  TC_CHECK(!tracker.skip(clear));
+  TC_CHECK(!tracker.skip(listgen));
+  TC_CHECK(tracker.skip(clear));
+
+  TC_CHECK(!tracker.skip(unknown));
+  TC_CHECK(!tracker.skip(clear));
+  tracker.invalidate();
+  TC_CHECK(!tracker.skip(clear));
+  TC_CHECK(!tracker.skip(listgen));
+}
+
+TLANG_NAMESPACE_END
@@ -0,0 +1,52 @@
+#include <taichi/util.h>
+#include <taichi/testing.h>
+#include <taichi/math/sifakis_svd_batched.h>
+
+TC_NAMESPACE_BEGIN
+
+template <int width>
+void test_svd_batched() {
+  using Matrix = TMatrix<float32, 3>;
+  float32 tolerance = 2e-3_f32;
+  // Not a multiple of the width, for the matrices left over
+  constexpr int n = 1001;
+  std::vector<float32> a[9], u[9], v[9], sigma[3];
+  const float32 *pa[9];
+  float32 *pu[9], *pv[9], *psigma[3];
+  std::vector<Matrix> ms;
+  for (int k = 0; k < n; k++)
+    ms.push_back(Matrix::rand());
+  for (int i = 0; i < 9; i++) {
+    for (int k = 0; k < n; k++)
+      a[i].push_back(ms[k](i / 3, i % 3));
+    u[i].resize(n);
+    v[i].resize(n);
+    pa[i] = a[i].data();
+    pu[i] = u[i].data();
+    pv[i] = v[i].data();
+  }
+  for (int i = 0; i < 3; i++) {
+    sigma[i].resize(n);
+    psigma[i] = sigma[i].data();
+  }
+  SifakisSVD::svd_batched<width>(n, pa, pu, psigma, pv);
+  for (int k = 0; k < n; k++) {
+    Matrix U, V, sig(0);
+    for (int i = 0; i < 9; i++) {
+      U(i / 3, i % 3) = u[i][k];
+      V(i / 3, i % 3) = v[i][k];
+    }
+    for (int i = 0; i < 3; i++)
+      sig(i, i) = sigma[i][k];
+    TC_CHECK_EQUAL(ms[k], U * sig * transposed(V), tolerance);
+    TC_CHECK_EQUAL(Matrix(1), U * transposed(U), tolerance);
+    TC_CHECK_EQUAL(Matrix(1), V * transposed(V), tolerance);
+  }
+}
+
+TC_TEST("svd_batched") {
+  test_svd_batched<1>();
+  test_svd_batched<SifakisSVD::default_svd_width>();
+}
+
+TC_NAMESPACE_END
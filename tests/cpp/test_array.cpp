@@ -17,4 +17,28 @@ TC_TEST("array") {
   TC_CHECK(A.get_size() == B.get_size());
 }
 
+TC_TEST("tiled_array_3d") {
+  Array3D<real> A(Vector3i(11, 17, 9));
+  for (auto &ind : A.get_region())
+    A[ind] = ind.i + 3 * ind.j - 2 * ind.k + 0.25_f * ind.i * ind.k;
+  TiledArray3D<real> B(A);
+  TC_CHECK(B.get_num_tiles() == Vector3i(2, 3, 2));
+  for (auto &ind : A.get_region())
+    TC_CHECK(B[ind] == A[ind]);
+  TC_CHECK(B.to_array().get_data() == A.get_data());
+  // Within bricks and across their boundaries
+  for (real x = 0; x < 11; x += 0.7_f) {
+    for (real y = 0; y < 17; y += 1.3_f) {
+      for (real z = 0; z < 9; z += 0.45_f)
+        TC_CHECK_EQUAL(B.sample(x, y, z), A.sample(x, y, z), 1e-4_f);
+    }
+  }
+  int num_cells = 0;
+  B.for_each([&](const Index3D &ind, real &val) {
+    TC_CHECK(val == A[ind]);
+    num_cells++;
+  });
+  TC_CHECK(num_cells == A.get_size());
+}
+
 TC_NAMESPACE_END
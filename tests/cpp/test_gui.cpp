@@ -0,0 +1,61 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#include <taichi/visual/gui.h>
+#include <taichi/testing.h>
+
+TC_NAMESPACE_BEGIN
+
+TC_TEST("canvas_batched") {
+  int n = 2000;
+  Vector2i res(300, 200);
+  Array2D<Vector4> one_by_one(res, Vector4(0)), batched(res, Vector4(0));
+  Canvas canvas_a(one_by_one), canvas_b(batched);
+  std::vector<float32> points(n * 2), radii(n);
+  std::vector<uint32> colors(n);
+  // Overlapping primitives, the circles also across the borders
+  for (int i = 0; i < n; i++) {
+    points[i * 2] = i % 37 / 30.0_f - 0.1_f;
+    points[i * 2 + 1] = i % 53 / 45.0_f - 0.1_f;
+    radii[i] = i % 7;
+    colors[i] = i * 2654435761u & 0xFFFFFF;
+  }
+
+  SECTION("circles") {
+    for (int i = 0; i < n; i++) {
+      canvas_a.circle(Vector2(points[i * 2], points[i * 2 + 1]))
+          .radius(radii[i])
+          .color(colors[i])
+          .finish();
+    }
+    canvas_b.draw_circles(n, points.data(), colors.data(), 0, radii.data(), 0);
+    for (auto &ind : one_by_one.get_region())
+      CHECK(one_by_one[ind] == batched[ind]);
+  }
+
+  SECTION("segments") {
+    // From the centers of the circles, inside the image (Line does not
+    // clip its right and top borders, nor take segments of length zero)
+    std::vector<float32> ends(n * 2);
+    for (int i = 0; i < n * 2; i++) {
+      points[i] = clamp(points[i], 0.1_f, 0.9_f);
+      ends[i] = points[i] + (i % 2 ? -0.01_f * (i % 5) : 0.03_f);
+    }
+    for (int i = 0; i < n; i++) {
+      canvas_a
+          .path(Vector2(points[i * 2], points[i * 2 + 1]),
+                Vector2(ends[i * 2], ends[i * 2 + 1]))
+          .radius(2)
+          .color(0x123456)
+          .finish();
+    }
+    canvas_b.draw_segments(n, points.data(), ends.data(), nullptr,
+                           0x123456, nullptr, 2);
+    for (auto &ind : one_by_one.get_region())
+      TC_CHECK_EQUAL(one_by_one[ind], batched[ind], 1e-5_f);
+  }
+}
+
+TC_NAMESPACE_END
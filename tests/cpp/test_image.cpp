@@ -0,0 +1,56 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#include <taichi/image/operations.h>
+#include <taichi/testing.h>
+
+TC_NAMESPACE_BEGIN
+
+// A linear ramp, which resampling and blurring keep away from the borders
+Array2D<Vector4> ramp(Vector2i res) {
+  Array2D<Vector4> image(res);
+  for (auto &ind : image.get_region())
+    image[ind] = Vector4(ind.i, ind.j, ind.i + 2 * ind.j, 1);
+  return image;
+}
+
+TC_TEST("image_operations") {
+  auto image = ramp(Vector2i(37, 23));
+
+  auto half = downsample(image, 2);
+  CHECK(half.get_res() == Vector2i(18, 11));
+  TC_CHECK_EQUAL(half[3][4], Vector4(6.5_f, 8.5_f, 23.5_f, 1), 1e-5_f);
+
+  auto same = resize(image, image.get_res());
+  for (auto &ind : image.get_region())
+    TC_CHECK_EQUAL(same[ind], image[ind], 1e-5_f);
+
+  auto blurred = gaussian_blur(image, 1.5_f);
+  TC_CHECK_EQUAL(blurred[10][10], image[10][10], 1e-4_f);
+
+  auto planar = to_planar<4>(image);
+  // Rows from the top
+  CHECK(planar.row(1, 0)[0] == 22);
+  auto back = from_planar<4>(planar);
+  for (auto &ind : image.get_region())
+    CHECK(back[ind] == image[ind]);
+
+  auto mapped = tone_map(image, 1);
+  TC_CHECK_EQUAL(mapped[1][1], Vector4(0.5_f, 0.5_f, 0.75_f, 1), 1e-6_f);
+
+  std::vector<float32> values(8);
+  for (int i = 0; i < 8; i++)
+    values[i] = (i - 1) / 5.0f;
+  PlanarImage gray(Vector2i(8, 1), 1);
+  gray.data = values;
+  auto pixels = to_8bit(gray);
+  CHECK(pixels[0] == 0);
+  CHECK(pixels[1] == 0);
+  CHECK(pixels[2] == 51);
+  CHECK(pixels[6] == 255);
+  CHECK(pixels[7] == 255);
+}
+
+TC_NAMESPACE_END
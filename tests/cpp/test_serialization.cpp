@@ -0,0 +1,69 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#include <taichi/io/binary_stream.h>
+#include <taichi/math.h>
+#include <taichi/testing.h>
+
+TC_NAMESPACE_BEGIN
+
+struct SerializedScene {
+  std::vector<float32> values;
+  std::vector<Vector3> positions;
+  std::vector<bool> flags;
+  std::vector<std::string> names;
+  int32 counts[3];
+  TC_IO_DEF(values, positions, flags, names, counts);
+};
+
+TC_TEST("binary_serializer") {
+  static_assert(is_bulk_serializable<float32>::value, "");
+  static_assert(is_bulk_serializable<Vector3>::value, "");
+  static_assert(!is_bulk_serializable<std::string>::value, "");
+
+  SerializedScene scene;
+  for (int i = 0; i < 1000; i++) {
+    scene.values.push_back(i * 0.5f);
+    scene.positions.push_back(Vector3(i, -i, 2 * i));
+  }
+  scene.flags = {true, false, true};
+  scene.names = {"water", "sand"};
+  for (int i = 0; i < 3; i++)
+    scene.counts[i] = i * 7;
+
+  auto fn = "/tmp/binary_serializer.tcb";
+  write_to_binary_file(scene, fn);
+  for (int mapped = 0; mapped < 2; mapped++) {
+    SerializedScene loaded;
+    if (mapped)
+      read_from_mapped_binary_file(loaded, fn);
+    else
+      read_from_binary_file(loaded, fn);
+    CHECK(loaded.values == scene.values);
+    CHECK(loaded.positions.size() == scene.positions.size());
+    CHECK(loaded.positions[999] == scene.positions[999]);
+    CHECK(loaded.flags == scene.flags);
+    CHECK(loaded.names == scene.names);
+    CHECK(loaded.counts[2] == 14);
+  }
+
+  {
+    BinaryFileStreamOutput out(fn);
+    out.begin_checksum();
+    out.serialize(scene);
+    out << out.checksum();
+  }
+  BinaryFileStreamInput in(fn);
+  SerializedScene loaded;
+  uint64 checksum;
+  in.begin_checksum();
+  in.deserialize(loaded);
+  auto actual = in.checksum();
+  in >> checksum;
+  CHECK(actual == checksum);
+  CHECK(loaded.values == scene.values);
+}
+
+TC_NAMESPACE_END
@@ -0,0 +1,84 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_field_accesses_keep_their_order():
+  n = 32
+  x = ti.var(ti.f32, shape=n)
+  y = ti.var(ti.f32, shape=n)
+  s = ti.var(ti.f32, shape=())
+
+  @ti.kernel
+  def swap_and_accumulate(a: ti.ext_arr()):
+    for i in x:
+      t = x[i]
+      x[i] = y[i] + a[i]
+      y[i] = t
+      # Read after the write to the same field
+      a[i] = x[i] * 2
+    for i in y:
+      # x is only read by this loop
+      s[None] += x[i] - y[i]
+
+  for i in range(n):
+    x[i] = i
+    y[i] = 2 * i
+  a = np.ones(n, dtype=np.float32)
+  swap_and_accumulate(a)
+  for i in range(n):
+    assert x[i] == 2 * i + 1
+    assert y[i] == i
+    assert a[i] == (2 * i + 1) * 2
+  assert s[None] == sum(i + 1 for i in range(n))
+
+
+def run_gather(read_only_cache, persistent_threads):
+  n = 64
+  grid = ti.var(ti.f32)
+  weights = ti.var(ti.f32, shape=4)
+  particles = ti.var(ti.f32)
+  ti.cfg.gpu_read_only_cache = read_only_cache
+  ti.cfg.gpu_persistent_threads = persistent_threads
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).place(grid)
+    ti.root.dense(ti.i, n // 8).pointer().dense(ti.i, 8).place(particles)
+
+  @ti.kernel
+  def init():
+    for i in range(n):
+      grid[i] = i * 0.5
+    for i in range(n // 2):
+      particles[i] = 0
+
+  # grid and weights are only read
+  @ti.kernel
+  def gather():
+    for p in particles:
+      s = 0.0
+      for k in ti.static(range(4)):
+        s += grid[(p + k) % n] * weights[k]
+      particles[p] = s
+
+  for k in range(4):
+    weights[k] = k + 1
+  init()
+  gather()
+  return [particles[p] for p in range(n // 2)]
+
+
+@ti.all_archs
+def test_read_only_cache():
+  arch = ti.cfg.arch
+  results = []
+  for read_only_cache, persistent_threads in [(False, False), (True, False),
+                                              (True, True)]:
+    ti.reset()
+    ti.cfg.arch = arch
+    results.append(run_gather(read_only_cache, persistent_threads))
+  assert results[0] == results[1] == results[2]
+  for p in range(32):
+    assert results[0][p] == sum(
+        (p + k) % 64 * 0.5 * (k + 1) for k in range(4))
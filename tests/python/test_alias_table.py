@@ -0,0 +1,36 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_alias_table():
+  n = 37
+  num = 100000
+  table = ti.AliasTable(n)
+  choices = ti.var(ti.i32, shape=num)
+  pdfs = ti.var(ti.f32, shape=num)
+
+  @ti.kernel
+  def run():
+    # Evenly spaced numbers, which the table maps to each choice in
+    # proportion to its weight
+    for i in range(num):
+      c = table.sample((i + 0.5) / num)
+      choices[i] = c
+      pdfs[i] = table.pdf(c)
+
+  rng = np.random.RandomState(0)
+  weights = rng.uniform(0, 1, n)
+  weights[[3, 10, 11]] = 0
+  table.build(weights)
+  run()
+  c = choices.to_numpy()
+  expected = weights / weights.sum()
+  counts = np.bincount(c, minlength=n) / num
+  assert np.max(np.abs(counts - expected)) < 1e-3
+  assert counts[3] == 0 and counts[10] == 0 and counts[11] == 0
+  np.testing.assert_allclose(pdfs.to_numpy(), expected[c], rtol=1e-5)
+
+  table.sample_batch(choices)
+  counts = np.bincount(choices.to_numpy(), minlength=n) / num
+  assert np.max(np.abs(counts - expected)) < 1e-2
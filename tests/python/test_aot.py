@@ -0,0 +1,39 @@
+import taichi as ti
+import numpy as np
+import os
+import tempfile
+
+
+@ti.all_archs
+def test_aot_module():
+  arch = ti.cfg.arch
+  ti.cfg.use_offline_cache = True
+  n = 16
+  x = ti.var(ti.f32, shape=n)
+
+  @ti.kernel
+  def fill(k: ti.i32):
+    for i in x:
+      x[i] = i * k
+
+  @ti.kernel
+  def read(a: ti.ext_arr()):
+    for i in x:
+      a[i] = x[i] + 0.5
+
+  a = np.zeros(n, dtype=np.float32)
+  read(a)
+  fd, fn = tempfile.mkstemp(suffix='.tla')
+  os.close(fd)
+  ti.save_aot_module(fn, {'fill': fill, 'read': read})
+
+  # Nothing is defined in Python this time
+  ti.reset()
+  ti.cfg.arch = arch
+  module = ti.load_aot_module(fn)
+  module.get_kernel('fill').launch(3)
+  module.get_kernel('read').set_arg_nparray(0, int(a.ctypes.data), a.nbytes)
+  module.get_kernel('read')()
+  os.remove(fn)
+  for i in range(n):
+    assert a[i] == i * 3 + 0.5
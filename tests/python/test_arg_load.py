@@ -64,3 +64,62 @@ def test_ext_arr():
   set_f32(v)
   for i in range(N):
     assert x[i] == 10 + i
+
+
+@ti.all_archs
+def test_repeated_scalar_arg_launches():
+  x = ti.var(ti.f32, shape=())
+
+  @ti.kernel
+  def add(a: ti.i32, b: ti.f32):
+    x[None] += a * b
+
+  for i in range(100):
+    add(i, 0.5)
+  # Ints are accepted for float arguments, on the checked path as well
+  add(2, 3)
+  assert x[None] == 99 * 100 / 2 * 0.5 + 6
+
+  try:
+    add(0.5, 1)
+  except ti.KernelArgError:
+    pass
+  else:
+    assert False
+
+
+@ti.all_archs
+def test_many_args():
+  x = ti.var(ti.i32, shape=())
+  y = ti.var(ti.f32, shape=4)
+
+  @ti.kernel
+  def sum(a0: ti.i32, a1: ti.i32, a2: ti.i32, a3: ti.i32, a4: ti.i32,
+          a5: ti.i32, a6: ti.i32, a7: ti.i32, a8: ti.i32, a9: ti.i32,
+          a10: ti.i32, a11: ti.i32, v: ti.ext_arr(), w: ti.ext_arr()):
+    x[None] = a0 + a1 + a2 + a3 + a4 + a5 + a6 + a7 + a8 + a9 + a10 + a11
+    for i in range(4):
+      y[i] = v[i] * w[i]
+
+  import numpy as np
+  v = np.arange(4, dtype=np.float32)
+  w = np.ones(4, dtype=np.float32) * 2
+  sum(*range(12), v, w)
+  assert x[None] == 66
+  for i in range(4):
+    assert y[i] == i * 2
+
+
+@ti.all_archs
+def test_numpy_scalar_args():
+  import numpy as np
+  x = ti.var(ti.f32, shape=())
+
+  @ti.kernel
+  def add(a: ti.f32, b: ti.i32):
+    x[None] += a * b
+
+  # The second launch takes the native path, which must not truncate
+  add(np.float32(0.5), np.int32(2))
+  add(np.float32(0.5), np.int32(2))
+  assert x[None] == 2
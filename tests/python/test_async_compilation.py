@@ -0,0 +1,60 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_async_compilation():
+  ti.cfg.async_compilation = True
+  n = 16
+  x = ti.var(ti.i32, shape=n)
+  y = ti.var(ti.i32, shape=n)
+
+  @ti.kernel
+  def fill():
+    for i in x:
+      x[i] = i
+
+  @ti.kernel
+  def double():
+    for i in x:
+      y[i] = x[i] * 2
+
+  for k in range(3):
+    fill()
+    double()
+  for i in range(n):
+    assert y[i] == i * 2
+
+
+@ti.all_archs
+def test_tiered_compilation():
+  import time
+  ti.cfg.tiered_compilation = True
+  ti.cfg.tiered_compilation_threshold = 2
+  # Cached kernels are compiled once, at the full optimization level
+  ti.cfg.use_offline_cache = False
+  n = 16
+  x = ti.var(ti.i32, shape=n)
+
+  @ti.kernel
+  def inc():
+    for i in x:
+      x[i] += i
+
+  # Launches before and after the optimized version takes over. Only the
+  # LLVM CPU backend compiles in tiers.
+  tiered = ti.cfg.arch == ti.x86_64 and ti.cfg.use_llvm
+  launches = 0
+  for k in range(1000):
+    inc()
+    launches += 1
+    if launches >= 20 and (not tiered or
+                           inc.get_taichi_kernel().runs_optimized):
+      break
+    if launches >= 20:
+      # The background compilation is not done yet
+      time.sleep(0.01)
+  if tiered:
+    assert inc.get_taichi_kernel().runs_optimized
+  ti.sync()
+  for i in range(n):
+    assert x[i] == i * launches
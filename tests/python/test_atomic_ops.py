@@ -0,0 +1,86 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_atomic_min_max_int():
+  n = 1000
+  lo = ti.var(ti.i32, shape=())
+  hi = ti.var(ti.i32, shape=())
+
+  @ti.kernel
+  def func():
+    for i in range(n):
+      v = (i * 7919) % n - 500
+      ti.atomic_min(lo[None], v)
+      ti.atomic_max(hi[None], v)
+
+  lo[None] = 1000000
+  hi[None] = -1000000
+  func()
+  assert lo[None] == -500
+  assert hi[None] == 499
+
+
+@ti.all_archs
+def test_atomic_min_max_float():
+  n = 1000
+  lo = ti.var(ti.f32, shape=())
+  hi = ti.var(ti.f64, shape=())
+
+  @ti.kernel
+  def func():
+    for i in range(n):
+      v = ti.sin(i * 0.37) * 3.0
+      ti.atomic_min(lo[None], v)
+      ti.atomic_max(hi[None], v)
+
+  lo[None] = 100
+  hi[None] = -100
+  func()
+  import math
+  values = [math.sin(i * 0.37) * 3.0 for i in range(n)]
+  assert abs(lo[None] - min(values)) < 1e-5
+  assert abs(hi[None] - max(values)) < 1e-5
+
+
+@ti.all_archs
+def test_atomic_bitwise():
+  n = 32
+  mask_or = ti.var(ti.i32, shape=())
+  mask_and = ti.var(ti.i32, shape=())
+  parity = ti.var(ti.i32, shape=())
+
+  @ti.kernel
+  def func():
+    for i in range(n):
+      ti.atomic_or(mask_or[None], 1 << (i % 31))
+      ti.atomic_and(mask_and[None], ~(1 << (i % 8)))
+      ti.atomic_xor(parity[None], i)
+
+  mask_and[None] = -1
+  func()
+  assert mask_or[None] == (1 << 31) - 1
+  assert mask_and[None] == ~255
+  xor = 0
+  for i in range(n):
+    xor ^= i
+  assert parity[None] == xor
+
+
+@ti.all_archs
+def test_local_atomic_min_max():
+  A = ti.var(ti.i32, shape=2)
+
+  @ti.kernel
+  def func():
+    a = 100
+    b = -100
+    for i in range(10):
+      ti.atomic_min(a, i * 3 - 7)
+      ti.atomic_max(b, i * 3 - 7)
+    A[0] = a
+    A[1] = b
+
+  func()
+  assert A[0] == -7
+  assert A[1] == 20
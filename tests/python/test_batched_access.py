@@ -0,0 +1,48 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_gather_scatter():
+  x = ti.var(ti.i32, shape=(8, 16))
+  y = ti.var(ti.f32, shape=32)
+
+  indices = np.array([[0, 1], [3, 5], [7, 15]])
+  x.scatter(indices, [10, 20, 30])
+  assert x[0, 1] == 10
+  assert x[3, 5] == 20
+  assert x[7, 15] == 30
+  assert (x.gather(indices) == [10, 20, 30]).all()
+
+  y.scatter(np.arange(32), 0.5)
+  y[3] = 2.5
+  values = y.gather([1, 3, 31])
+  assert values.dtype == np.float32
+  assert (values == [0.5, 2.5, 0.5]).all()
+
+
+@ti.all_archs
+def test_slices():
+  x = ti.var(ti.i32, shape=(8, 16))
+
+  x[:, :] = np.arange(8 * 16).reshape(8, 16)
+  assert x[2, 3] == 2 * 16 + 3
+  block = x[1:3, 4:10:2]
+  assert block.shape == (2, 3)
+  assert (block == np.arange(8 * 16).reshape(8, 16)[1:3, 4:10:2]).all()
+
+  x[5, :] = 7
+  assert (x[5, :] == 7).all()
+  assert x[4, 0] == 4 * 16
+
+
+@ti.all_archs
+def test_gather_sparse():
+  x = ti.var(ti.i32)
+
+  @ti.layout
+  def place():
+    ti.root.pointer(ti.i, 4).dense(ti.i, 4).place(x)
+
+  x.scatter([[1], [9]], [3, 4])
+  assert (x[:] == [0, 3, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0]).all()
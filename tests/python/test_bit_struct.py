@@ -0,0 +1,60 @@
+import taichi as ti
+import math
+
+
+@ti.all_archs
+def test_quantized_int():
+  n = 32
+  a = ti.var(ti.quant.integer(5))
+  b = ti.var(ti.quant.integer(3, signed=False))
+  c = ti.var(ti.quant.integer(20))
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).bit_struct(num_bits=32).place(a, b, c)
+
+  @ti.kernel
+  def fill():
+    for i in a:
+      a[i] = i - 16
+      b[i] = i
+      c[i] = i * 1000 - 20000
+
+  fill()
+  for i in range(n):
+    assert a[i] == i - 16
+    assert b[i] == i % 8
+    assert c[i] == i * 1000 - 20000
+
+
+@ti.all_archs
+def test_quantized_fixed():
+  n = 16
+  x = ti.Vector(3, dt=ti.quant.fixed(10, range=2.0))
+  total = ti.var(ti.quant.fixed(16, range=1024.0))
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).bit_struct(num_bits=32).place(x)
+    ti.root.bit_struct(num_bits=32).place(total)
+
+  @ti.kernel
+  def fill():
+    for i in x:
+      x[i] = ti.Vector([i * 0.1, -i * 0.1, 0.3])
+
+  @ti.kernel
+  def accumulate():
+    for i in x:
+      total[None] += x[i][0]
+
+  fill()
+  accumulate()
+  step = 2.0 / 2**9
+  for i in range(n):
+    assert abs(x[i][0] - i * 0.1) <= step / 2
+    assert abs(x[i][1] + i * 0.1) <= step / 2
+    assert abs(x[i][2] - 0.3) <= step / 2
+  # Each addition is rounded to a multiple of the step of total
+  expected = sum(math.floor(x[i][0] * 32 + 0.5) / 32 for i in range(n))
+  assert total[None] == expected
@@ -0,0 +1,19 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_block_dim_autotuning():
+  ti.cfg.gpu_block_dim_autotuning = True
+  n = 1000
+  x = ti.var(ti.i32, shape=n)
+
+  @ti.kernel
+  def inc():
+    for i in range(n):
+      x[i] += i
+
+  # Every invocation during tuning must still run exactly once
+  for k in range(10):
+    inc()
+  for i in range(n):
+    assert x[i] == i * 10
@@ -0,0 +1,35 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_stencil_across_blocks():
+  x = ti.var(ti.i32)
+  y = ti.var(ti.i32)
+  n = 16
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.ij, n // 4).pointer().dense(ti.ij, 4).place(x, y)
+
+  @ti.kernel
+  def laplace():
+    for i, j in x:
+      y[i, j] = x[i - 1, j] + x[i + 1, j] + x[i, j - 1] + x[i, j + 1] - \
+                4 * x[i, j]
+
+  # Two by two active blocks, surrounded by inactive ones
+  for i in range(4, 12):
+    for j in range(4, 12):
+      x[i, j] = i * n + j * j
+
+  laplace()
+
+  def value(i, j):
+    if 4 <= i < 12 and 4 <= j < 12:
+      return i * n + j * j
+    return 0
+
+  for i in range(4, 12):
+    for j in range(4, 12):
+      assert y[i, j] == value(i - 1, j) + value(i + 1, j) + value(
+          i, j - 1) + value(i, j + 1) - 4 * value(i, j)
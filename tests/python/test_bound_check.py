@@ -0,0 +1,34 @@
+import taichi as ti
+
+
+# Out of bound accesses abort the program, so only accesses in bound are
+# tested here
+@ti.all_archs
+def test_bound_check_in_bound():
+  ti.cfg.check_out_of_bound = True
+  n = 12
+  x = ti.var(ti.i32, shape=(n, n), halo=1)
+  y = ti.var(ti.i32, shape=n)
+  z = ti.var(ti.i32, shape=(n, n))
+  m = ti.var(ti.i32, shape=())
+
+  @ti.kernel
+  def fill():
+    for i, j in x:
+      x[i, j] = i + j
+    # Bounded by a field
+    for i in range(m[None]):
+      y[i] = x[i - 1, n] + 1
+
+  @ti.kernel
+  def stencil():
+    for i, j in x:
+      z[i, j] = x[i - 1, j] + x[i + 1, j]
+
+  m[None] = n
+  fill()
+  stencil()
+  for i in range(n):
+    assert y[i] == 1
+  assert z[0, 0] == 1
+  assert z[n - 1, 0] == n - 2
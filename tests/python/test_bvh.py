@@ -0,0 +1,114 @@
+import taichi as ti
+import numpy as np
+
+
+# The square [0, 1]^2 at z = 0, in 2 * m * m triangles
+def square_mesh(m):
+  vertices = []
+  for i in range(m + 1):
+    for j in range(m + 1):
+      vertices.append([i / m, j / m, 0])
+  faces = []
+  for i in range(m):
+    for j in range(m):
+      a = i * (m + 1) + j
+      b = a + m + 1
+      faces.append([a, b, b + 1])
+      faces.append([a, b + 1, a + 1])
+  return np.array(vertices), np.array(faces)
+
+
+@ti.all_archs
+def test_bvh_square():
+  m = 8
+  num_queries = 64
+  bvh = ti.BVH(2 * m * m)
+  o = ti.Vector(3, dt=ti.f32, shape=num_queries)
+  d = ti.Vector(3, dt=ti.f32, shape=num_queries)
+  hit_t = ti.var(ti.f32, shape=num_queries)
+  hit = ti.var(ti.i32, shape=num_queries)
+  dist = ti.var(ti.f32, shape=num_queries)
+  closest = ti.Vector(3, dt=ti.f32, shape=num_queries)
+
+  @ti.kernel
+  def query():
+    for i in range(num_queries):
+      hit_t[i], hit[i] = bvh.ray_cast(o[i], d[i], 10.0)
+      dist[i], _, closest[i] = bvh.closest_point(o[i], 10.0)
+
+  vertices, faces = square_mesh(m)
+  bvh.build(vertices, faces)
+
+  np.random.seed(0)
+  points = np.random.rand(num_queries, 3) * 1.4 - 0.2
+  points[:, 2] += 0.3
+  dirs = np.random.rand(num_queries, 3) * 0.2 - 0.1
+  dirs[:, 2] = -1
+  o.from_numpy(points.astype(np.float32))
+  d.from_numpy(dirs.astype(np.float32))
+  query()
+
+  for i in range(num_queries):
+    p = points[i]
+    t = p[2] / -dirs[i][2]
+    x = p + t * dirs[i]
+    inside = 0 <= x[0] <= 1 and 0 <= x[1] <= 1
+    if t > 0 and inside and min(x[0], x[1], 1 - x[0], 1 - x[1]) > 1e-3:
+      assert hit[i] >= 0
+      assert abs(hit_t[i] - t) < 1e-4
+    elif t < 0 or min(x[0], x[1], 1 - x[0], 1 - x[1]) < -1e-3:
+      assert hit[i] == -1
+      assert hit_t[i] == 10
+    q = np.array([np.clip(p[0], 0, 1), np.clip(p[1], 0, 1), 0])
+    assert abs(dist[i] - np.linalg.norm(p - q)) < 1e-4
+    assert np.allclose(closest[i], q, atol=1e-4)
+
+
+@ti.all_archs
+def test_bvh_soup():
+  num_triangles = 200
+  num_rays = 100
+  bvh = ti.BVH(num_triangles, num_chunks=16)
+  o = ti.Vector(3, dt=ti.f32, shape=num_rays)
+  d = ti.Vector(3, dt=ti.f32, shape=num_rays)
+  hit_t = ti.var(ti.f32, shape=num_rays)
+  hit = ti.var(ti.i32, shape=num_rays)
+
+  @ti.kernel
+  def cast():
+    for i in range(num_rays):
+      hit_t[i], hit[i] = bvh.ray_cast(o[i], d[i], 100.0)
+
+  np.random.seed(1)
+  centers = np.random.rand(num_triangles, 3)
+  vertices = (centers[:, None, :] +
+              (np.random.rand(num_triangles, 3, 3) - 0.5) * 0.2).reshape(-1, 3)
+  faces = np.arange(3 * num_triangles).reshape(-1, 3)
+  bvh.build(vertices, faces)
+
+  origins = np.random.rand(num_rays, 3) * 2 - 0.5
+  dirs = np.random.rand(num_rays, 3) - 0.5
+  o.from_numpy(origins.astype(np.float32))
+  d.from_numpy(dirs.astype(np.float32))
+  cast()
+
+  # Moller-Trumbore against every triangle
+  v0, v1, v2 = [vertices[faces[:, k]] for k in range(3)]
+  e1 = v1 - v0
+  e2 = v2 - v0
+  for i in range(num_rays):
+    p = np.cross(dirs[i], e2)
+    det = (e1 * p).sum(axis=1)
+    s = origins[i] - v0
+    u = (s * p).sum(axis=1) / det
+    q = np.cross(s, e1)
+    v = (dirs[i] * q).sum(axis=1) / det
+    t = (e2 * q).sum(axis=1) / det
+    # Hits on the edges up to rounding may go either way
+    margin = np.minimum(np.minimum(u, v), 1 - u - v)
+    loose = np.where((margin >= -1e-4) & (t > 0), t, np.inf).min()
+    strict = np.where((margin > 1e-4) & (t > 0), t, np.inf).min()
+    if loose == np.inf:
+      assert hit[i] == -1
+    else:
+      assert loose - 1e-3 <= hit_t[i] <= min(strict, 100) + 1e-3
@@ -0,0 +1,105 @@
+import taichi as ti
+from pytest import approx
+
+
+def run_recurrence(num_steps, segment_size):
+  x = ti.var(ti.f32)
+  w = ti.var(ti.f32)
+  loss = ti.var(ti.f32)
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, segment_size + 1).place(x, x.grad)
+    ti.root.place(w, w.grad, loss, loss.grad)
+
+  @ti.kernel
+  def advance(t: ti.i32, i: ti.i32):
+    x[i + 1] = x[i] * w + 1
+
+  @ti.kernel
+  def compute_loss():
+    loss[None] = x[segment_size]
+
+  x[0] = 1
+  w[None] = 0.5
+  with ti.Tape(loss):
+    ti.checkpointed_steps(num_steps, advance, [x], segment_size=segment_size)
+    compute_loss()
+  return loss[None], x.grad[0], w.grad[None]
+
+
+@ti.all_archs
+def test_checkpointed_recurrence():
+  num_steps = 12
+  y = 1.0
+  dy_dx0 = 1.0
+  dy_dw = 0.0
+  for t in range(num_steps):
+    dy_dw = dy_dw * 0.5 + y
+    dy_dx0 *= 0.5
+    y = y * 0.5 + 1
+  arch = ti.cfg.arch
+  for segment_size in [1, 3, 12]:
+    ti.reset()
+    ti.cfg.arch = arch
+    loss, x_grad, w_grad = run_recurrence(num_steps, segment_size)
+    assert loss == approx(y)
+    assert x_grad == approx(dy_dx0)
+    assert w_grad == approx(dy_dw)
+
+
+@ti.all_archs
+def test_checkpointed_steps_without_tape():
+  x = ti.var(ti.i32)
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, 3).place(x)
+
+  @ti.kernel
+  def advance(t: ti.i32, i: ti.i32):
+    x[i + 1] += x[i] + t
+
+  ti.checkpointed_steps(8, advance, [x])
+  # Slot 2 holds the final state, since the default segment size is 2
+  assert x[2] == sum(range(8))
+
+
+@ti.all_archs
+def test_pipelined_checkpointed_recurrence():
+  num_steps = 12
+  segment_size = 3
+  x = ti.var(ti.f32)
+  y = ti.var(ti.f32)
+  w = ti.var(ti.f32)
+  loss = ti.var(ti.f32)
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, segment_size + 1).place(x, x.grad)
+    ti.root.dense(ti.i, segment_size + 1).place(y, y.grad)
+    ti.root.place(w, w.grad, loss, loss.grad)
+
+  @ti.kernel
+  def advance(t: ti.i32, i: ti.i32, s: ti.template()):
+    s[i + 1] = s[i] * w + 1
+
+  # The last of the four segments runs on y
+  @ti.kernel
+  def compute_loss():
+    loss[None] = y[segment_size]
+
+  x[0] = 1
+  w[None] = 0.5
+  with ti.Tape(loss):
+    ti.checkpointed_steps(
+        num_steps, advance, [x], segment_size=segment_size,
+        alternate_state=[y])
+    compute_loss()
+  results = loss[None], x.grad[0], w.grad[None]
+  arch = ti.cfg.arch
+  ti.reset()
+  ti.cfg.arch = arch
+  expected = run_recurrence(num_steps, segment_size)
+  for r, e in zip(results, expected):
+    assert r == approx(e)
@@ -36,3 +36,39 @@ def test_clear_all_gradients():
   ti.clear_all_gradients()
   # No more kernel compilation
   assert ti.get_runtime().get_num_compiled_functions() == 3
+
+
+@ti.all_archs
+def test_clear_sparse_gradients():
+  x = ti.var(ti.f32)
+  count = ti.var(ti.i32)
+  n = 16
+  bs = 8
+
+  @ti.layout
+  def layout():
+    # The gradients share the sparsity of the primal, in their own leaf
+    # blocks
+    block = ti.root.dense(ti.i, n // bs).pointer()
+    block.dense(ti.i, bs).place(x)
+    block.dense(ti.i, bs).place(x.grad)
+    ti.root.place(count)
+
+  x[1] = 1
+  x.grad[1] = 2
+  x.grad[2] = 3
+
+  ti.clear_all_gradients()
+
+  assert x[1] == 1
+  assert x.grad[1] == 0
+  assert x.grad[2] == 0
+
+  @ti.kernel
+  def count_active():
+    for i in x.grad:
+      count[None] += 1
+
+  # Clearing activates nothing
+  count_active()
+  assert count[None] == bs
@@ -0,0 +1,65 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_compile_kernels():
+  x = ti.var(ti.i32)
+  n = 16
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).place(x)
+
+  @ti.kernel
+  def fill(k: ti.i32):
+    for i in x:
+      x[i] = i * k
+
+  @ti.kernel
+  def add():
+    for i in x:
+      x[i] += 1
+
+  ti.compile_kernels(fill, add)
+  # Compiled kernels are not compiled again
+  ti.compile_kernels(fill)
+  fill(3)
+  add()
+  for i in range(n):
+    assert x[i] == i * 3 + 1
+
+
+@ti.all_archs
+def test_precompile():
+  import numpy as np
+  import os
+  import tempfile
+  n = 16
+  x = ti.var(ti.i32, shape=n)
+
+  @ti.kernel
+  def scale(k: ti.constexpr(ti.i32), a: ti.ext_arr()):
+    for i in x:
+      x[i] = a[i] * k
+
+  a = np.arange(n, dtype=np.int32)
+  ti.precompile((scale, (2, a)), (scale, (3, a)))
+  assert len(scale.taichi_kernels) == 2
+  scale(3, a)
+  # Launches use the precompiled instances
+  assert len(scale.taichi_kernels) == 2
+  for i in range(n):
+    assert x[i] == i * 3
+
+  fn = os.path.join(tempfile.mkdtemp(), 'instances.json')
+  ti.save_kernel_instances(fn)
+  arch = ti.cfg.arch
+  ti.reset()
+  ti.cfg.arch = arch
+  x = ti.var(ti.i32, shape=n)
+  ti.precompile(replay=fn)
+  assert len(scale.taichi_kernels) == 2
+  scale(2, a)
+  assert len(scale.taichi_kernels) == 2
+  for i in range(n):
+    assert x[i] == i * 2
@@ -0,0 +1,23 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_compile_report():
+  ti.cfg.profile_compilation = True
+  x = ti.var(ti.i32, shape=8)
+
+  @ti.kernel
+  def fill():
+    for i in x:
+      x[i] = i * 2
+
+  fill()
+  report = ti.compile_report(clear=True)
+  passes = [r for r in report if r['kernel'].startswith('fill')]
+  assert any(r['pass'] == 'Total' for r in passes)
+  assert any(r['pass'] == 'Offloaded' for r in passes)
+  for r in passes:
+    assert r['time'] >= 0
+    if r['pass'] == 'Lowered':
+      assert r['statements_after'] > 0
+  assert ti.compile_report() == []
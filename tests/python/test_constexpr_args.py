@@ -0,0 +1,35 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_constexpr_args():
+  x = ti.var(ti.f32, shape=16)
+
+  @ti.kernel
+  def fill(n: ti.constexpr(ti.i32), scale: ti.constexpr(ti.f32)):
+    for i in range(n):
+      x[i] = i / n * scale
+
+  for n in [4, 8, 16]:
+    fill(n, 2)
+    for i in range(n):
+      assert abs(x[i] - i / n * 2) < 1e-6
+
+  assert len(fill.mapper.mapping) == 3
+
+
+@ti.all_archs
+def test_constexpr_args_lru():
+  x = ti.var(ti.i32, shape=())
+
+  @ti.kernel
+  def set_value(v: ti.constexpr(ti.i32, max_variants=2), c: ti.i32):
+    x[None] = v + c
+
+  for v in [1, 2, 1, 3, 1, 2]:
+    set_value(v, 10)
+    assert x[None] == v + 10
+    assert len(set_value.mapper.mapping) <= 2
+
+  # 2 was evicted by 3 and compiled again
+  assert set_value.mapper.num_instances == 4
@@ -0,0 +1,30 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_cpu_gpu_split():
+  ti.cfg.cpu_gpu_split = True
+  x = ti.var(ti.f32)
+  y = ti.var(ti.f32)
+  n = 100000
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).place(x, y)
+
+  @ti.kernel
+  def fill(scale: ti.f32):
+    for i in range(n):
+      x[i] = i * scale
+
+  @ti.kernel
+  def saxpy(a: ti.f32):
+    for i in range(n):
+      y[i] = a * x[i] + y[i]
+
+  # The share of either device changes from launch to launch
+  for k in range(5):
+    fill(2)
+    saxpy(3)
+  for i in range(0, n, 997):
+    assert y[i] == i * 2 * 3 * 5
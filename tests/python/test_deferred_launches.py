@@ -0,0 +1,25 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_deferred_launches():
+  x = ti.var(ti.i32, shape=(4,))
+
+  @ti.kernel
+  def add(i: ti.i32, v: ti.i32):
+    x[i] = x[i] * 10 + v
+
+  @ti.kernel
+  def double(t: ti.template()):
+    for i in t:
+      t[i] *= 2
+
+  with ti.deferred_launches():
+    for k in range(4):
+      add(k % 2, k)
+      double(x)
+    # Reading runs the recorded launches first
+    assert x[1] == ((1 * 2 * 2) * 10 + 3) * 2
+    add(3, 7)
+  assert x[0] == 2 * 2 * 2
+  assert x[3] == 7
@@ -0,0 +1,64 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def _test_dense_solve(n, method, pivoting=True):
+  ti.get_runtime().set_default_fp(ti.f64)
+  ti.cfg.fast_math = False
+  num = 8
+  A = ti.Matrix(n, n, dt=ti.f64, shape=num)
+  b = ti.Matrix(n, 2, dt=ti.f64, shape=num)
+  x = ti.Matrix(n, 2, dt=ti.f64, shape=num)
+
+  @ti.kernel
+  def run():
+    for i in A:
+      x[i] = ti.solve(A[i], b[i], ti.f64, method=method, pivoting=pivoting)
+
+  rng = np.random.RandomState(n)
+  a = rng.uniform(-1, 1, (num, n, n))
+  if method == 'cholesky' or not pivoting:
+    a = a @ np.transpose(a, (0, 2, 1)) + np.eye(n)
+  else:
+    # Zeros on the diagonal need pivoting
+    for i in range(n):
+      a[:, i, i] = 0
+  rhs = rng.uniform(-1, 1, (num, n, 2))
+  A.from_numpy(a)
+  b.from_numpy(rhs)
+  run()
+  assert np.max(np.abs(a @ x.to_numpy() - rhs)) < 1e-9
+
+
+def test_dense_solve():
+  for n in [1, 3, 6, 12]:
+    _test_dense_solve(n, 'lu')
+    _test_dense_solve(n, 'lu', pivoting=False)
+    _test_dense_solve(n, 'cholesky')
+
+
+@ti.all_archs
+def test_cholesky_factor():
+  n = 6
+  A = ti.Matrix(n, n, dt=ti.f32, shape=())
+  L = ti.Matrix(n, n, dt=ti.f32, shape=())
+  b = ti.Vector(n, dt=ti.f32, shape=())
+  x = ti.Vector(n, dt=ti.f32, shape=())
+
+  @ti.kernel
+  def run():
+    for i in range(1):
+      L[None] = ti.cholesky(A[None], ti.f32)
+      x[None] = ti.cholesky_solve(L[None], b[None], ti.f32)
+
+  rng = np.random.RandomState(0)
+  a = rng.uniform(-1, 1, (n, n))
+  a = a @ a.T + np.eye(n)
+  A.from_numpy(a.astype(np.float32))
+  b.from_numpy(np.arange(n, dtype=np.float32))
+  run()
+  l = L.to_numpy()
+  assert np.max(np.abs(np.triu(l, 1))) == 0
+  assert np.max(np.abs(l @ l.T - a)) < 1e-4
+  assert np.max(np.abs(a @ x.to_numpy() - np.arange(n))) < 1e-3
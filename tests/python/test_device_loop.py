@@ -0,0 +1,41 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_device_loop():
+  x = ti.var(ti.i32)
+  total = ti.var(ti.i32)
+  done = ti.var(ti.i32)
+  n = 32
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).place(x)
+    ti.root.place(total, done)
+
+  @ti.kernel
+  def step():
+    for i in x:
+      x[i] += 1
+
+  @ti.kernel
+  def check():
+    total[None] = 0
+    for i in x:
+      total[None] += x[i]
+    if total[None] >= n * 10:
+      done[None] = 1
+
+  # Stops in the middle of a batch of check_interval iterations
+  assert ti.device_loop([step, check], done, 100, check_interval=4) == 10
+  for i in range(n):
+    assert x[i] == 10
+
+  # Done from the start
+  assert ti.device_loop([step, check], done, 100) == 0
+  assert x[0] == 10
+
+  done[None] = 0
+  total[None] = 0
+  assert ti.device_loop([step], done, 7) == 7
+  assert x[0] == 17
@@ -0,0 +1,40 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_direct_access():
+  x = ti.var(ti.f32)
+  y = ti.var(ti.i32)
+  loss = ti.var(ti.f64)
+  p = ti.var(ti.i32)
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.ij, (3, 5)).place(x, y)
+    ti.root.place(loss)
+    ti.root.pointer().dense(ti.i, 4).place(p)
+
+  @ti.kernel
+  def increment():
+    for i, j in y:
+      y[i, j] += 1
+
+  before = ti.runtime_counters()['kernel_launches']
+  for i in range(3):
+    for j in range(5):
+      x[i, j] = i + j * 0.5
+      y[i, j] = i * 5 + j
+  loss[None] = 0.25
+  for i in range(3):
+    for j in range(5):
+      assert x[i, j] == i + j * 0.5
+      assert y[i, j] == i * 5 + j
+  assert loss[None] == 0.25
+  # Dense cells are accessed without kernels
+  assert ti.runtime_counters()['kernel_launches'] == before
+  increment()
+  assert y[2, 4] == 15
+  # Sparse ones still go through accessor kernels
+  p[2] = 3
+  assert p[2] == 3
+  assert ti.runtime_counters()['kernel_launches'] > before + 1
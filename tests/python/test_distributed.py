@@ -0,0 +1,53 @@
+import taichi as ti
+import numpy as np
+
+
+class FakeCommunicator:
+
+  def __init__(self, rank, size):
+    self.rank = rank
+    self.size = size
+
+
+def test_partition():
+  ranges = [
+      ti.DomainDecomposition((10, 4), comm=FakeCommunicator(r, 3))
+      for r in range(3)
+  ]
+  assert [(d.begin, d.end) for d in ranges] == [(0, 3), (3, 6), (6, 10)]
+  assert ranges[2].local_shape == (4, 4)
+  assert ranges[0].neighbors() == (None, 1)
+  periodic = ti.DomainDecomposition(10, comm=FakeCommunicator(0, 3),
+                                    periodic=True)
+  assert periodic.neighbors() == (2, 1)
+
+
+@ti.all_archs
+def test_exchange_single_rank_periodic():
+  n = 8
+  dd = ti.DomainDecomposition((n, n), periodic=True)
+  x = dd.var(ti.i32)
+  y = dd.var(ti.i32)
+  loss = ti.var(ti.i32, shape=())
+
+  @ti.kernel
+  def init():
+    for i, j in x:
+      x[i, j] = (i + dd.begin) * n + j
+
+  @ti.kernel
+  def stencil():
+    for i, j in x:
+      y[i, j] = x[i - 1, j] + x[i + 1, j] - 2 * x[i, j]
+      loss[None] += x[i, j]
+
+  init()
+  dd.exchange(x)
+  stencil()
+  a = np.arange(n * n, dtype=np.int32).reshape(n, n)
+  expected = np.roll(a, 1, 0) + np.roll(a, -1, 0) - 2 * a
+  assert np.array_equal(y.to_numpy(), expected)
+  # Clamped along the other axis
+  assert x[-1, -1] == a[n - 1, 0]
+  assert dd.all_reduce(loss) == a.sum()
+  assert loss[None] == a.sum()
@@ -51,3 +51,22 @@ def test_div_default_ip():
   func()
   assert z[None] == 100000
 
+
+
+@ti.all_archs
+def test_index_div_mod():
+  n = 100
+  x = ti.var(ti.i32, shape=n)
+  y = ti.var(ti.i32, shape=n)
+
+  @ti.kernel
+  def func():
+    for i in x:
+      x[i] = i // 8 * 100 + i % 16 + (i + n) % n
+      if i < n:
+        y[i] = (i + 1) % n - i // 3
+
+  func()
+  for i in range(n):
+    assert x[i] == i // 8 * 100 + i % 16 + i
+    assert y[i] == (i + 1) % n - i // 3
@@ -190,3 +190,78 @@ def test_dense_dynamic_len():
   for i in range(n):
     assert l[i] == 0
 
+
+@ti.all_archs
+def test_append_hot_cells():
+  if ti.get_os_name() == 'win':
+    return
+  n = 4
+  m = 1024
+  x = ti.var(ti.i32)
+  l = ti.var(ti.i32, shape=n)
+  s = ti.var(ti.i32, shape=n)
+  
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).dynamic(ti.j, m, 8).place(x)
+  
+  @ti.kernel
+  def func():
+    # Parallel appends to a few lists, spanning many chunks
+    for i in range(n * m):
+      ti.append(x, i % n, i)
+  
+  @ti.kernel
+  def reduce():
+    for i, j in x:
+      s[i] += x[i, j]
+    for i in range(n):
+      l[i] = ti.length(x, i)
+  
+  func()
+  reduce()
+  
+  for i in range(n):
+    assert l[i] == m
+    assert s[i] == sum(range(i, n * m, n))
+
+@ti.all_archs
+def test_append_geometric():
+  if ti.get_os_name() == 'win':
+    return
+  n = 4
+  m = 1000
+  x = ti.var(ti.i32)
+  l = ti.var(ti.i32, shape=n)
+  s = ti.var(ti.i32, shape=n)
+  
+  @ti.layout
+  def place():
+    # Chunks of 8, 16, 32, ... elements: 7 of them per list
+    ti.root.dense(ti.i, n).dynamic(ti.j, m, 8, geometric=True).place(x)
+  
+  @ti.kernel
+  def func():
+    for i in range(n * m):
+      ti.append(x, i % n, i)
+  
+  @ti.kernel
+  def reduce():
+    for i, j in x:
+      s[i] += x[i, j]
+    for i in range(n):
+      l[i] = ti.length(x, i)
+  
+  @ti.kernel
+  def clear():
+    for i in range(n):
+      ti.deactivate(x, i)
+  
+  for k in range(2):
+    func()
+    reduce()
+    for i in range(n):
+      assert l[i] == m
+      assert s[i] == sum(range(i, n * m, n))
+      s[i] = 0
+    clear()
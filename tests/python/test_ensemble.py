@@ -0,0 +1,41 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_ensemble():
+  b = 8
+  n = 16
+  ens = ti.Ensemble(b)
+  x = ens.var(ti.f32, shape=n)
+  v = ens.Vector(2, dt=ti.f32, shape=n)
+  g = ens.var(ti.f32)
+  total = ens.var(ti.f32)
+
+  @ti.func
+  def accelerate(i, dt):
+    v[i][1] -= g[None] * dt
+
+  @ens.kernel
+  def init():
+    for i in range(n):
+      x[i] = i
+      v[i] = ti.Vector([1.0, 0.0])
+
+  @ens.kernel
+  def step(dt: ti.f32):
+    for i in x:
+      accelerate(i, dt)
+      x[i] += v[i][1] * dt
+    for i in range(2, n):
+      total[None] += x[i]
+
+  gravity = np.arange(b, dtype=np.float32)
+  g.from_numpy(gravity)
+  init()
+  step(0.5)
+  for k in range(b):
+    for i in range(n):
+      assert x[k, i] == i - gravity[k] * 0.25
+      assert v[k, i][0] == 1
+    assert total[k] == sum(i - gravity[k] * 0.25 for i in range(2, n))
@@ -0,0 +1,39 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_f16_storage():
+  n = 16
+  x = ti.var(ti.f16, shape=n)
+  y = ti.var(ti.f32, shape=n)
+
+  @ti.kernel
+  def func():
+    for i in x:
+      x[i] = i / 3
+    for i in x:
+      y[i] = x[i] * 3
+
+  func()
+  for i in range(n):
+    assert x[i] == float(np.float16(i / 3))
+    assert y[i] == float(np.float32(np.float16(i / 3)) * 3)
+
+
+@ti.all_archs
+def test_f16_numpy():
+  n = 8
+  x = ti.var(ti.f16, shape=n)
+
+  @ti.kernel
+  def double():
+    for i in x:
+      x[i] = x[i] * 2
+
+  arr = np.arange(n, dtype=np.float16) * 0.25 + 1
+  x.from_numpy(arr)
+  double()
+  ret = x.to_numpy()
+  assert ret.dtype == np.float16
+  assert (ret == arr * 2).all()
@@ -0,0 +1,31 @@
+import taichi as ti
+import math
+
+
+@ti.all_archs
+def test_transcendentals():
+  n = 1024
+  x = ti.var(ti.f32, shape=n)
+  y = ti.var(ti.f32, shape=(4, n))
+
+  @ti.kernel
+  def func():
+    for i in x:
+      y[0, i] = ti.exp(x[i])
+      y[1, i] = ti.log(ti.abs(x[i]) + 0.01)
+      y[2, i] = ti.tan(x[i])
+      y[3, i] = ti.tanh(x[i])
+
+  for i in range(n):
+    x[i] = (i - n // 2) * 0.05
+  func()
+
+  def close(a, b):
+    return abs(a - b) <= 1e-5 * max(1, abs(b))
+
+  for i in range(n):
+    v = x[i]
+    assert close(y[0, i], math.exp(v))
+    assert close(y[1, i], math.log(abs(v) + 0.01))
+    assert close(y[2, i], math.tan(v))
+    assert close(y[3, i], math.tanh(v))
@@ -0,0 +1,34 @@
+import taichi as ti
+import numpy as np
+import os
+import tempfile
+
+
+@ti.host_arch
+def test_file_backed_root():
+  fd, fn = tempfile.mkstemp(suffix='.bin')
+  os.close(fd)
+  n = 64
+  try:
+    for r in range(2):
+      ti.reset()
+      ti.cfg.root_file = fn
+      x = ti.var(ti.f32)
+      blocks = ti.root.dense(ti.i, n // 8)
+      blocks.dense(ti.i, 8).place(x)
+
+      @ti.kernel
+      def fill():
+        for i in x:
+          x[i] = i * 0.5
+
+      if r == 0:
+        fill()
+        blocks.evict()
+        blocks.prefetch(0, 4)
+      # The second program reads the values back from the file
+      assert np.array_equal(x.to_numpy(), np.arange(n) * 0.5)
+  finally:
+    ti.cfg.root_file = ''
+    ti.reset()
+    os.remove(fn)
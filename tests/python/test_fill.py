@@ -75,3 +75,36 @@ def test_fill_matrix_matrix():
       for p in range(2):
         for q in range(3):
           assert val[i, j][p, q] == mat.get_entry(p, q)
+
+
+@ti.all_archs
+def test_fill_zero_contiguous():
+  x = ti.var(ti.i32)
+  y = ti.var(ti.i32)
+  z = ti.var(ti.i32)
+
+  n = 4
+  m = 7
+
+  # x and z are each stored in one range of the root buffer, which is
+  # cleared with a memset, around the range of y
+  @ti.layout
+  def values():
+    ti.root.dense(ti.i, n).dense(ti.j, m).place(x)
+    ti.root.dense(ti.ij, (n, m)).place(y)
+    ti.root.dense(ti.i, n).dense(ti.j, m).place(z)
+
+  for i in range(n):
+    for j in range(m):
+      x[i, j] = i + j
+      y[i, j] = i * j + 1
+      z[i, j] = i - j
+
+  x.fill(0)
+  z.fill(0)
+
+  for i in range(n):
+    for j in range(m):
+      assert x[i, j] == 0
+      assert y[i, j] == i * j + 1
+      assert z[i, j] == 0
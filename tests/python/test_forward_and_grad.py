@@ -0,0 +1,71 @@
+import taichi as ti
+from pytest import approx
+
+
+def gradients(fused):
+  x = ti.var(ti.f32)
+  y = ti.var(ti.f32)
+  loss = ti.var(ti.f32)
+  n = 16
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).place(x, x.grad, y, y.grad)
+    ti.root.place(loss, loss.grad)
+
+  @ti.kernel
+  def square():
+    for i in x:
+      y[i] = x[i] * x[i]
+
+  @ti.kernel
+  def compute_loss():
+    for i in y:
+      loss[None] += ti.sin(y[i])
+
+  for i in range(n):
+    x[i] = i * 0.1
+
+  with ti.Tape(loss):
+    square()
+    if fused:
+      compute_loss.forward_and_grad()
+    else:
+      compute_loss()
+  return loss[None], [x.grad[i] for i in range(n)]
+
+
+@ti.all_archs
+def test_forward_and_grad():
+  fused_loss, fused_grad = gradients(True)
+  arch = ti.cfg.arch
+  ti.reset()
+  ti.cfg.arch = arch
+  loss, grad = gradients(False)
+  assert fused_loss == approx(loss)
+  assert fused_grad == approx(grad)
+
+
+@ti.all_archs
+def test_forward_and_grad_must_be_last():
+  x = ti.var(ti.f32)
+  loss = ti.var(ti.f32)
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, 4).place(x, x.grad)
+    ti.root.place(loss, loss.grad)
+
+  @ti.kernel
+  def compute_loss():
+    for i in x:
+      loss[None] += x[i]
+
+  try:
+    with ti.Tape(loss):
+      compute_loss.forward_and_grad()
+      compute_loss()
+  except AssertionError:
+    pass
+  else:
+    assert False
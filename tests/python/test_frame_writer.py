@@ -0,0 +1,63 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_frame_writer():
+  import tempfile
+  import os
+  n = 64
+  directory = tempfile.mkdtemp()
+  x = ti.Vector(3, dt=ti.f32, shape=n)
+  t = ti.var(ti.i32, shape=())
+
+  @ti.kernel
+  def step():
+    for i in x:
+      x[i] += ti.Vector([1, 2, 3])
+    t[None] += 1
+
+  with ti.FrameWriter([x, t], queue_depth=2) as writer:
+    for frame in range(5):
+      step()
+      writer.write(os.path.join(directory, '{}.bin'.format(frame)))
+
+  for frame in range(5):
+    x.fill(0)
+    ti.load_tensors(os.path.join(directory, '{}.bin'.format(frame)), [x, t])
+    assert t[None] == frame + 1
+    assert (x.to_numpy() == (frame + 1) * np.array([1, 2, 3])).all()
+
+
+@ti.all_archs
+def test_frame_writer_ply():
+  import tempfile
+  import os
+  import gzip
+  n = 10
+  filename = os.path.join(tempfile.mkdtemp(), 'particles.ply.gz')
+  x = ti.Vector(3, dt=ti.f32, shape=n)
+  color = ti.Vector(3, dt=ti.f32, shape=n)
+
+  @ti.kernel
+  def init():
+    for i in x:
+      x[i] = ti.Vector([i, 2 * i, 0.5])
+      color[i] = ti.Vector([1, 0, 0.5])
+
+  init()
+  writer = ti.FrameWriter([x, color], encoder='ply')
+  writer.write(filename)
+  writer.close()
+
+  with gzip.open(filename, 'rb') as f:
+    data = f.read()
+  header_end = data.index(b'end_header\n') + len(b'end_header\n')
+  assert b'element vertex 10\n' in data[:header_end]
+  vertices = np.frombuffer(
+      data[header_end:],
+      dtype=[('x', '<f4'), ('y', '<f4'), ('z', '<f4'), ('r', 'u1'),
+             ('g', 'u1'), ('b', 'u1')])
+  assert len(vertices) == n
+  assert vertices['y'][3] == 6
+  assert vertices['r'][3] == 255 and vertices['b'][3] == 128
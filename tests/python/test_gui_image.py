@@ -0,0 +1,42 @@
+import taichi as ti
+from taichi.lang.meta import tensor_to_image, vector_to_image
+import numpy as np
+
+
+@ti.all_archs
+def test_tensor_to_image():
+  n, m = 8, 6
+  x = ti.var(ti.i32, shape=(n, m))
+
+  @ti.kernel
+  def fill():
+    for i, j in x:
+      x[i, j] = i * m + j
+
+  fill()
+  img = np.zeros((n, m, 4), dtype=np.float32)
+  tensor_to_image(x, img)
+  expected = np.arange(n * m, dtype=np.float32).reshape(n, m)
+  for c in range(4):
+    assert np.array_equal(img[..., c], expected)
+
+
+@ti.all_archs
+def test_vector_to_image():
+  n, m = 8, 6
+  x = ti.Vector(3, dt=ti.f32, shape=(n, m))
+
+  @ti.kernel
+  def fill():
+    for i, j in x:
+      for k in ti.static(range(3)):
+        x[i, j][k] = i + j * 0.5 + k * 0.25
+
+  fill()
+  img = np.ones((n, m, 4), dtype=np.float32)
+  vector_to_image(x, img)
+  for i in range(n):
+    for j in range(m):
+      for k in range(3):
+        assert img[i, j, k] == i + j * 0.5 + k * 0.25
+      assert img[i, j, 3] == 0
@@ -0,0 +1,75 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_halo_periodic_stencil():
+  n = 14
+  x = ti.var(ti.i32, shape=(n, n), halo=1)
+  y = ti.var(ti.i32, shape=(n, n))
+  visited = ti.var(ti.i32, shape=())
+
+  @ti.kernel
+  def init():
+    for i, j in x:
+      x[i, j] = i * n + j
+      visited[None] += 1
+
+  @ti.kernel
+  def laplace():
+    for i, j in x:
+      y[i, j] = x[i - 1, j] + x[i + 1, j] + x[i, j - 1] + x[i, j + 1] - \
+          4 * x[i, j]
+
+  init()
+  assert visited[None] == n * n
+  assert x.shape() == (n, n)
+  x.update_halo('periodic')
+  laplace()
+  a = np.arange(n * n, dtype=np.int32).reshape(n, n)
+  expected = np.roll(a, 1, 0) + np.roll(a, -1, 0) + np.roll(a, 1, 1) + \
+      np.roll(a, -1, 1) - 4 * a
+  assert np.array_equal(x.to_numpy(), a)
+  assert np.array_equal(y.to_numpy(), expected)
+  assert x[-1, -1] == a[n - 1, n - 1]
+
+
+@ti.all_archs
+def test_halo_clamp_and_constant():
+  n = 5
+  h = 2
+  x = ti.var(ti.f32, shape=n, halo=h)
+
+  @ti.kernel
+  def init():
+    for i in x:
+      x[i] = i + 1
+
+  init()
+  assert x.halo_width() == h
+  x.update_halo('clamp')
+  for i in range(-h, 0):
+    assert x[i] == 1
+  for i in range(n, n + h):
+    assert x[i] == n
+  x.update_halo('constant', 0.5)
+  assert x[-h] == 0.5 and x[n + h - 1] == 0.5
+  assert x[0] == 1 and x[n - 1] == n
+
+
+@ti.all_archs
+def test_halo_3d_corners():
+  n = 6
+  x = ti.var(ti.i32, shape=(n, n, n), halo=1)
+
+  @ti.kernel
+  def init():
+    for i, j, k in x:
+      x[i, j, k] = i * 100 + j * 10 + k
+
+  init()
+  x.update_halo('clamp')
+  assert x[-1, -1, -1] == 0
+  assert x[n, -1, n] == (n - 1) * 100 + n - 1
+  x.update_halo('periodic')
+  assert x[n, -1, n] == (n - 1) * 10
@@ -0,0 +1,52 @@
+import taichi as ti
+import numpy as np
+
+
+# Writes n PNG images of w x h pixels, and returns their bytes in file order
+def write_images(n, w, h):
+  import tempfile
+  import os
+  from taichi.misc.util import ndarray_to_array2d
+  directory = tempfile.mkdtemp()
+  filenames, images = [], []
+  for i in range(n):
+    pixels = (np.arange(h * w * 3).reshape(h, w, 3) * 7 + i) % 256
+    filename = os.path.join(directory, '{}.png'.format(i))
+    # Array2D images are indexed (x, y) from the bottom left
+    xy = np.ascontiguousarray(pixels[::-1].transpose(1, 0, 2))
+    ndarray_to_array2d(((xy + 0.5) / 255).astype(np.float32)).write(filename)
+    filenames.append(filename)
+    images.append(pixels.astype(np.uint8))
+  return filenames, images
+
+
+def test_image_loader_cache():
+  filenames, images = write_images(6, 5, 4)
+  loader = ti.ImageLoader(cache_size=4 * 5 * 3 * 4)
+  loader.prefetch(filenames)
+  assert loader.cache_bytes() == 4 * 5 * 3 * 4
+  for f, img in zip(filenames, images):
+    assert np.array_equal(loader.load(f), img)
+  gray = loader.load(filenames[0], channels=1)
+  assert gray.shape == (4, 5, 1)
+
+
+def test_image_loader_batch():
+  filenames, images = write_images(8, 6, 3)
+  loader = ti.ImageLoader()
+  out = np.zeros((8, 3, 6, 3), dtype=np.uint8)
+  loader.load_batch(filenames, out, cache=False)
+  assert np.array_equal(out, np.stack(images))
+  assert loader.cache_bytes() == 0
+  floats = np.zeros((8, 3, 6, 4), dtype=np.float32)
+  loader.load_batch(filenames, floats)
+  assert np.allclose(floats[..., :3], np.stack(images) / 255)
+  assert np.all(floats[..., 3] == 1)
+
+
+@ti.all_archs
+def test_image_loader_tensor():
+  filenames, images = write_images(4, 6, 5)
+  x = ti.var(ti.f32, shape=(4, 5, 6, 3))
+  ti.ImageLoader().load_batch(filenames, x)
+  assert np.allclose(x.to_numpy(), np.stack(images) / 255)
@@ -0,0 +1,29 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_input_channel():
+  n = 16
+  steps = 5
+  total = ti.var(ti.f32, shape=n)
+  channel = ti.InputChannel(n, ti.f32)
+  inputs = [np.arange(n, dtype=np.float32) * (t + 1) for t in range(steps)]
+
+  @ti.kernel
+  def step(a: ti.ext_arr()):
+    for i in range(n):
+      total[i] = total[i] * 2 + a[i]
+
+  channel.push(inputs[0])
+  channel.advance()
+  for t in range(steps):
+    step(channel)
+    if t + 1 < steps:
+      channel.push(inputs[t + 1])
+      channel.advance()
+
+  expected = np.zeros(n, dtype=np.float32)
+  for t in range(steps):
+    expected = expected * 2 + inputs[t]
+  np.testing.assert_allclose(total.to_numpy(), expected)
@@ -0,0 +1,40 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_identical_kernels():
+  x = ti.var(ti.f32, shape=4)
+
+  @ti.kernel
+  def inc_a():
+    for i in x:
+      x[i] += 1
+
+  @ti.kernel
+  def inc_b():
+    for i in x:
+      x[i] += 1
+
+  inc_a()
+  inc_b()
+  for i in range(4):
+    assert x[i] == 2
+
+
+@ti.all_archs
+def test_kernels_differing_in_constants():
+  x = ti.var(ti.f32, shape=())
+
+  @ti.kernel
+  def set_a():
+    x[None] = 1.00000001
+
+  @ti.kernel
+  def set_b():
+    x[None] = 1.0000001
+
+  set_a()
+  a = x[None]
+  set_b()
+  b = x[None]
+  assert a != b
@@ -2,7 +2,6 @@ import taichi as ti
 
 
 def test_clear():
-  return
   ti.reset()
   x = ti.var(ti.i32)
 
@@ -0,0 +1,28 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_launch_breakdown():
+  ti.cfg.launch_breakdown = True
+  x = ti.var(ti.i32, shape=1024)
+
+  @ti.kernel
+  def fill(c: ti.i32):
+    for i in x:
+      x[i] = c
+
+  fill(0)
+  ti.sync()
+  ti.launch_breakdown(clear=True)
+  for c in range(10):
+    fill(c)
+  ti.sync()
+  breakdown = ti.launch_breakdown(clear=True)
+  ti.cfg.launch_breakdown = False
+  assert set(breakdown.keys()) == {
+      'marshal', 'prepare', 'context', 'upload', 'launch', 'run', 'sync'
+  }
+  assert breakdown['marshal'] > 0 and breakdown['run'] > 0
+  for cycles in breakdown.values():
+    assert cycles >= 0
+  assert x[0] == 9
@@ -0,0 +1,46 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_extend_layout():
+  n = 16
+  x = ti.var(ti.i32, shape=n)
+
+  @ti.kernel
+  def fill():
+    for i in x:
+      x[i] += i
+
+  fill()
+  # A tensor declared after the layout is materialized gets a tree of its own
+  y = ti.var(ti.i32, shape=n)
+  z = ti.var(ti.i32)
+  num_cells = ti.var(ti.i32, shape=())
+
+  @ti.layout
+  def sparse():
+    ti.root.dense(ti.i, n // 4).pointer().dense(ti.i, 4).place(z)
+
+  @ti.kernel
+  def copy():
+    for i in y:
+      y[i] = x[i] * 2
+    for i in range(n):
+      if i % 8 == 0:
+        z[i] = x[i] + 1
+
+  @ti.kernel
+  def count():
+    for i in z:
+      num_cells[None] += 1
+
+  # The kernels compiled before stay valid
+  fill()
+  copy()
+  for i in range(n):
+    assert x[i] == i * 2
+    assert y[i] == i * 4
+  # Only the blocks of z that hold 0 and 8 are active
+  count()
+  assert num_cells[None] == 8
+  assert z[8] == 17
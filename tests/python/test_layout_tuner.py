@@ -0,0 +1,139 @@
+import taichi as ti
+import os
+import tempfile
+
+
+@ti.all_archs
+def test_layouts():
+  n = 20
+  for layout in [ti.AOS, ti.SOA, ti.AOSOA(8)]:
+    ti.reset()
+    x, y = ti.var(ti.i32), ti.var(ti.i32)
+    m = ti.Vector(2, dt=ti.f32, shape=n, layout=layout)
+
+    @ti.layout
+    def place():
+      layout.place((n,), x, y)
+
+    @ti.kernel
+    def fill():
+      for i in range(n):
+        x[i] = i
+        y[i] = i * 2
+        m[i][1] = i * 3
+
+    fill()
+    for i in range(n):
+      assert x[i] == i
+      assert y[i] == i * 2
+      assert m[i][1] == i * 3
+
+
+def make_build(together, builds):
+
+  def build(layout):
+    builds.append(layout.name)
+    n = 64
+    x, y = ti.var(ti.f32), ti.var(ti.f32)
+
+    @ti.layout
+    def place():
+      layout.place((n,), x, y)
+
+    @ti.kernel
+    def both():
+      for i in x:
+        x[i] += y[i] + 1
+
+    @ti.kernel
+    def one():
+      for i in x:
+        x[i] += 1
+
+    def step():
+      if together:
+        both()
+      else:
+        one()
+      return x
+
+    return step
+
+  return build
+
+
+def test_tune_layout():
+  cache_file = os.path.join(tempfile.mkdtemp(), 'layouts.json')
+  builds = []
+  layout, step = ti.tune_layout(
+      make_build(True, builds), num_steps=2, cache_file=cache_file)
+  assert layout.name in ['soa', 'aos', 'aosoa8']
+  assert builds[:3] == ['soa', 'aos', 'aosoa8']
+  assert step()[0] > 0
+  builds.clear()
+  cached, step = ti.tune_layout(
+      make_build(True, builds), num_steps=2, cache_file=cache_file)
+  assert cached.name == layout.name
+  assert builds == [layout.name]
+
+
+def test_tune_layout_separate_fields():
+  builds = []
+  layout, step = ti.tune_layout(
+      make_build(False, builds), num_steps=2, cache=False)
+  assert layout.soa
+  assert builds == ['soa']
+
+
+def build_sparse_grid(builds):
+
+  def build(block):
+    builds.append(block)
+    n = 64
+    x = ti.var(ti.f32)
+
+    @ti.layout
+    def place():
+      ti.root.pointer().dense(ti.ij, n // block).pointer().dense(
+          ti.ij, block).place(x)
+
+    @ti.kernel
+    def activate():
+      for i in range(4):
+        x[i * 16, i * 16] = 1
+
+    @ti.kernel
+    def smooth():
+      for i, j in x:
+        x[i, j] *= 0.5
+
+    def step():
+      activate()
+      smooth()
+
+    return step
+
+  return build
+
+
+def test_tune_block_size():
+  cache_file = os.path.join(tempfile.mkdtemp(), 'layouts.json')
+  builds = []
+  config, step, report = ti.tune_parameters(
+      build_sparse_grid(builds), {'block': [4, 8, 16]},
+      num_steps=2,
+      cache_file=cache_file)
+  assert config['block'] in [4, 8, 16]
+  assert [r['config']['block'] for r in report] == [4, 8, 16]
+  # 4 blocks are active whatever their size
+  for r in report:
+    block = r['config']['block']
+    assert r['cells_allocated'] == 4 * block * block
+    assert r['cells_listed'] <= r['cells_allocated']
+  builds.clear()
+  cached, step, report = ti.tune_parameters(
+      build_sparse_grid(builds), {'block': [4, 8, 16]},
+      num_steps=2,
+      cache_file=cache_file)
+  assert cached == config and report is None
+  assert builds == [config['block']]
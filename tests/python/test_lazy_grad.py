@@ -0,0 +1,77 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_separate_dense_grads():
+  x = ti.var(ti.f32)
+  y = ti.var(ti.f32)
+  n = 16
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).place(x, y)
+    ti.root.lazy_grad(separate=True)
+
+  @ti.kernel
+  def square():
+    for i in x:
+      y[i] = x[i] * x[i]
+
+  # The gradients are not interleaved with the primals
+  assert x.grad.ptr.snode().parent.id != x.ptr.snode().parent.id
+  assert x.grad.ptr.snode().parent.id == y.grad.ptr.snode().parent.id
+
+  for i in range(n):
+    x[i] = i
+    y.grad[i] = 1
+  square()
+  square.grad()
+  for i in range(n):
+    assert y[i] == i * i
+    assert x.grad[i] == 2 * i
+
+  ti.clear_all_gradients()
+  for i in range(n):
+    assert x.grad[i] == 0
+
+
+@ti.all_archs
+def test_separate_sparse_grads():
+  x = ti.var(ti.f32)
+  y = ti.var(ti.f32)
+  count = ti.var(ti.i32)
+  n = 16
+  bs = 4
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n // bs).pointer().dense(ti.i, bs).place(x, y)
+    ti.root.place(count)
+    ti.root.lazy_grad(separate=True)
+
+  @ti.kernel
+  def double():
+    for i in x:
+      y[i] = x[i] * 2
+
+  @ti.kernel
+  def count_grads():
+    for i in x.grad:
+      count[None] += 1
+
+  x[1] = 1
+  x[9] = 2
+  double()
+  # No gradient blocks until gradients are written
+  count_grads()
+  assert count[None] == 0
+
+  for i in [1, 9]:
+    y.grad[i] = 1
+  double.grad()
+  for i in range(n):
+    assert x.grad[i] == (2 if i in [1, 9] else 0)
+  # Only the blocks of the active primals
+  count[None] = 0
+  count_grads()
+  assert count[None] == 2 * bs
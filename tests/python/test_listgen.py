@@ -22,3 +22,46 @@ def test_listgen():
       for j in range(n):
         assert x[i, j] == i * 10 + j + c
       
+
+
+@ti.all_archs
+def test_listgen_mixed_node_types():
+  x = ti.var(ti.i32)
+  y = ti.var(ti.i32)
+  n = 128
+
+  @ti.layout
+  def layout():
+    ti.root.dense(ti.i, 4).pointer(ti.i, 4).dense(ti.i, 8).place(x)
+    ti.root.pointer(ti.i, 8).dynamic(ti.j, 16).place(y)
+
+  @ti.kernel
+  def activate():
+    for i in range(n):
+      if i % 24 < 8:
+        x[i] = 1
+    for i in range(8):
+      if i % 3 == 0:
+        for j in range(i + 1):
+          ti.append(y, i, j)
+
+  @ti.kernel
+  def fill():
+    for i in x:
+      x[i] += i
+    for i, j in y:
+      y[i, j] = i * 100 + j
+
+  activate()
+  fill()
+  for i in range(n):
+    if (i // 8) % 3 == 0:
+      assert x[i] == i + 1
+    else:
+      assert x[i] == 0
+  for i in range(8):
+    for j in range(16):
+      if i % 3 == 0 and j <= i:
+        assert y[i, j] == i * 100 + j
+      else:
+        assert y[i, j] == 0
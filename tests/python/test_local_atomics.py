@@ -29,3 +29,44 @@ def test_implicit_local_atomics():
 
   func()
   assert A[None] == 45
+
+
+@ti.all_archs
+def test_accumulated_global_atomics():
+  x = ti.var(ti.i32, shape=8)
+  total = ti.var(ti.i32, shape=())
+
+  @ti.kernel
+  def func():
+    for i in range(64):
+      # Summed locally, then added once per iteration
+      for j in range(4):
+        x[i & 7] += j
+      x[i & 7] += 1
+      total[None] += 1
+
+  func()
+  for i in range(8):
+    assert x[i] == 8 * 7
+  assert total[None] == 64
+
+
+@ti.all_archs
+def test_reductions():
+  x = ti.var(ti.f32, shape=1000)
+  total = ti.var(ti.f32, shape=())
+  count = ti.var(ti.i32, shape=())
+
+  @ti.kernel
+  def func():
+    for i in x:
+      total[None] += x[i]
+      # Only part of each warp takes this branch
+      if i % 3 == 0:
+        count[None] += 1
+
+  for i in range(1000):
+    x[i] = i % 7
+  func()
+  assert total[None] == sum(i % 7 for i in range(1000))
+  assert count[None] == 334
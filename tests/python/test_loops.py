@@ -110,3 +110,109 @@ def test_zero_inner_loop():
   test()
   
   assert x[None] == 0
+
+@ti.all_archs
+def test_loop_invariants():
+  x = ti.var(ti.i32, shape=(16, 8))
+  y = ti.var(ti.i32, shape=16)
+  
+  @ti.kernel
+  def test(k: ti.i32):
+    for i in range(16):
+      for j in range(8):
+        # y[i] and i * k do not change in the inner loop
+        x[i, j] = y[i] + i * k + j
+        y[i] += 1
+      for j in range(0):
+        x[i, j] = 1 // k
+  
+  for i in range(16):
+    y[i] = i
+  test(3)
+  
+  for i in range(16):
+    assert y[i] == i + 8
+    for j in range(8):
+      assert x[i, j] == i + j + i * 3 + j
+
+@ti.all_archs
+def test_repeated_global_accesses():
+  x = ti.var(ti.i32, shape=18)
+  y = ti.var(ti.i32, shape=18)
+  
+  @ti.kernel
+  def test():
+    for i in range(1, 17):
+      # The first store to y[i] is overwritten, x[i] is only loaded once
+      y[i] = x[i]
+      y[i] = x[i] + x[i - 1] + x[i + 1]
+      x[i - 1] += 0
+      y[i] += x[i]
+  
+  for i in range(18):
+    x[i] = i
+  test()
+  
+  for i in range(1, 17):
+    assert y[i] == 4 * i
+
+@ti.all_archs
+def test_unrolled_inner_loops():
+  n = 16
+  x = ti.var(ti.f32, shape=n)
+  y = ti.var(ti.f32, shape=n)
+  z = ti.var(ti.i32, shape=n)
+
+  @ti.kernel
+  def stencil(m: ti.i32):
+    for i in range(2, n - 2):
+      s = 0.0
+      # Unrolled
+      for j in range(-2, 3):
+        for k in range(2):
+          s += x[i + j] * (j + k)
+      y[i] = s
+      # Too many iterations, and unknown at compile time
+      c = 0
+      for j in range(100):
+        c += 1
+      for j in range(m):
+        c += j
+      z[i] = c
+
+  for i in range(n):
+    x[i] = i
+  stencil(4)
+
+  for i in range(2, n - 2):
+    s = 0
+    for j in range(-2, 3):
+      for k in range(2):
+        s += (i + j) * (j + k)
+    assert y[i] == s
+    assert z[i] == 106
+
+@ti.all_archs
+def test_run_time_range_bounds():
+  n = 1000
+  x = ti.var(ti.i32, shape=n)
+  count = ti.var(ti.i32, shape=())
+
+  # Both loops are parallel, with bounds read at launch
+  @ti.kernel
+  def fill(begin: ti.i32, end: ti.i32):
+    for i in range(begin, end):
+      x[i] += 1
+    for i in range(count[None] + begin):
+      x[i] += 10
+
+  for num_particles in [0, 1, 37, 999]:
+    count[None] = num_particles
+    for i in range(n):
+      x[i] = 0
+    fill(1, num_particles + 1)
+    for i in range(n):
+      expected = 1 if 1 <= i <= num_particles else 0
+      if i < num_particles + 1:
+        expected += 10
+      assert x[i] == expected
@@ -0,0 +1,77 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_matmul():
+  n = 16
+  A = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+  B = ti.Matrix(3, 2, dt=ti.f32, shape=n)
+  C = ti.Matrix(2, 3, dt=ti.f32, shape=n)
+  D = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+
+  @ti.kernel
+  def run():
+    for i in A:
+      # Chained, and by constants
+      D[i] = A[i] @ B[i] @ C[i] + ti.Matrix([[1, 2, 3]]).T() @ \
+          ti.Matrix([[1, 0, 1]])
+
+  rng = np.random.RandomState(0)
+  a = rng.uniform(-1, 1, (n, 3, 3)).astype(np.float32)
+  b = rng.uniform(-1, 1, (n, 3, 2)).astype(np.float32)
+  c = rng.uniform(-1, 1, (n, 2, 3)).astype(np.float32)
+  A.from_numpy(a)
+  B.from_numpy(b)
+  C.from_numpy(c)
+  run()
+  expected = a @ b @ c + np.array([[1], [2], [3]]) @ np.array([[1, 0, 1]])
+  assert np.max(np.abs(D.to_numpy() - expected)) < 1e-5
+
+
+@ti.all_archs
+def test_matmul_types():
+  A = ti.Matrix(2, 2, dt=ti.i32, shape=())
+  x = ti.Vector(2, dt=ti.f32, shape=())
+  y = ti.Vector(2, dt=ti.i32, shape=())
+  z = ti.Vector(2, dt=ti.f32, shape=())
+
+  @ti.kernel
+  def run():
+    for _ in range(1):
+      y[None] = A[None] @ A[None] @ ti.Vector([1, -1])
+      # Promoted to f32
+      z[None] = A[None] @ x[None]
+
+  A.from_numpy(np.array([[1, 2], [3, 4]], dtype=np.int32))
+  x.from_numpy(np.array([0.5, 0.25], dtype=np.float32))
+  run()
+  a = np.array([[1, 2], [3, 4]])
+  assert (y.to_numpy() == a @ a @ np.array([1, -1])).all()
+  assert (z.to_numpy() == a @ np.array([0.5, 0.25])).all()
+
+
+@ti.all_archs
+def test_matmul_grad():
+  A = ti.Matrix(3, 3, dt=ti.f32, shape=(), needs_grad=True)
+  x = ti.Vector(3, dt=ti.f32, shape=(), needs_grad=True)
+  loss = ti.var(ti.f32, shape=(), needs_grad=True)
+
+  @ti.kernel
+  def run():
+    for _ in range(1):
+      y = A[None] @ x[None]
+      loss[None] = y.dot(y)
+
+  a = np.arange(9, dtype=np.float32).reshape(3, 3) / 4
+  v = np.array([1, -2, 3], dtype=np.float32)
+  A.from_numpy(a)
+  x.from_numpy(v)
+  with ti.Tape(loss):
+    run()
+  # d|A x|^2 / dx = 2 A^T A x, and / dA = 2 A x x^T
+  y = a @ v
+  for i in range(3):
+    assert abs(x.grad[None][i] - 2 * (a.T @ y)[i]) < 1e-4
+    for j in range(3):
+      assert abs(A.grad[None][i, j] - 2 * y[i] * v[j]) < 1e-4
@@ -0,0 +1,54 @@
+import taichi as ti
+import numpy as np
+
+
+def mgpcg_residual(solver, b):
+  x = solver.x.to_numpy()
+  dim = solver.dim
+  p = np.pad(x, 1)
+  inner = tuple(slice(1, -1) for _ in range(dim))
+  ax = 2 * dim * x
+  for d in range(dim):
+    for o in (-1, 1):
+      s = list(inner)
+      s[d] = slice(1 + o, p.shape[d] - 1 + o)
+      ax -= p[tuple(s)]
+  return np.max(np.abs(ax - b)) / np.max(np.abs(b))
+
+
+@ti.all_archs
+def _test_mgpcg(dim, n, smoother):
+  ti.get_runtime().set_default_fp(ti.f64)
+  solver = ti.MGPCG(dim, n, dt=ti.f64, smoother=smoother)
+  b = np.random.RandomState(0).uniform(-1, 1, (n,) * dim)
+  solver.b.from_numpy(b)
+  iters = solver.solve(max_iters=50, tol=1e-8)
+  assert iters < 50
+  assert solver.residual <= 1e-8
+  assert mgpcg_residual(solver, b) < 1e-6
+
+
+def test_mgpcg_dense():
+  _test_mgpcg(2, 32, 'rbgs')
+  _test_mgpcg(2, 32, 'jacobi')
+  _test_mgpcg(3, 16, 'rbgs')
+
+
+@ti.all_archs
+def test_mgpcg_sparse():
+  n = 32
+  solver = ti.MGPCG(2, n, sparse=True, block_size=4)
+
+  # A disk of blocks
+  @ti.kernel
+  def init():
+    for i, j in ti.ndrange(n, n):
+      if (i // 4 * 4 - 14)**2 + (j // 4 * 4 - 14)**2 < 100:
+        solver.b[i, j] = ti.sin(i * 0.3) + ti.cos(j * 0.2)
+
+  init()
+  iters = solver.solve(max_iters=50, tol=1e-5)
+  assert iters < 50
+  x = solver.x.to_numpy()
+  assert x[0, 0] == 0 and x[n - 1, n - 1] == 0
+  assert np.max(np.abs(x)) > 0
@@ -0,0 +1,75 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_morton_3d():
+  x = ti.var(ti.i32)
+  errors = ti.var(ti.i32, shape=())
+  n = 8
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.ijk, 2).dense(ti.ijk, n).morton().place(x)
+
+  @ti.kernel
+  def fill():
+    for i, j, k in ti.ndrange(2 * n, 2 * n, 2 * n):
+      x[i, j, k] = i * 10000 + j * 100 + k
+
+  @ti.kernel
+  def check():
+    for i, j, k in x:
+      if x[i, j, k] != i * 10000 + j * 100 + k:
+        errors[None] += 1
+
+  fill()
+  check()
+  assert errors[None] == 0
+  for i, j, k in [(0, 0, 1), (3, 7, 5), (15, 15, 15), (9, 2, 12)]:
+    assert x[i, j, k] == i * 10000 + j * 100 + k
+
+
+@ti.all_archs
+def test_morton_uneven():
+  x = ti.var(ti.i32)
+  y = ti.var(ti.i32)
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.ij, (3, 20)).morton().place(x, y)
+
+  @ti.kernel
+  def fill():
+    for i, j in x:
+      x[i, j] = i * 100 + j
+      y[i, j] = -1
+
+  fill()
+  for i in range(3):
+    for j in range(20):
+      assert x[i, j] == i * 100 + j
+      assert y[i, j] == -1
+
+
+@ti.all_archs
+def test_morton_pointer_leaf():
+  x = ti.var(ti.f32)
+  s = ti.var(ti.f32, shape=())
+
+  @ti.layout
+  def place():
+    ti.root.pointer().dense(ti.ij, 4).morton().place(x)
+
+  @ti.kernel
+  def fill():
+    for i in range(4):
+      x[i, 3 - i] = i + 0.5
+
+  @ti.kernel
+  def total():
+    for i, j in x:
+      s[None] += x[i, j] * (i * 4 + j)
+
+  fill()
+  total()
+  assert s[None] == sum((i + 0.5) * (i * 4 + 3 - i) for i in range(4))
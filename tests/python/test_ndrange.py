@@ -90,3 +90,46 @@ def test_static_grouped_static():
       for k in range(2):
         for l in range(3):
           assert x[i, j][k, l] == k + l * 10 + i + j * 4
+
+@ti.all_archs
+def test_tiled_ndrange():
+  x = ti.var(ti.i32, shape=(13, 20))
+  y = ti.var(ti.i32, shape=(13, 20))
+  
+  @ti.kernel
+  def func():
+    # The tile sizes do not divide the extents
+    for i, j in ti.ndrange((1, 13), 20, tile=(4, 8)):
+      x[i, j] += i + j * 100
+    for i, j in ti.ndrange(13, 20, tile=y):
+      y[i, j] = x[i, j] + 1
+  
+  func()
+  for i in range(13):
+    for j in range(20):
+      if i >= 1:
+        assert x[i, j] == i + j * 100
+      else:
+        assert x[i, j] == 0
+      assert y[i, j] == x[i, j] + 1
+
+
+@ti.all_archs
+def test_padded_ndrange():
+  x = ti.var(ti.i32, shape=(3, 31, 60))
+  count = ti.var(ti.i32, shape=())
+  # Iterated with the last two extents padded to 32 and 64
+  assert ti.ndrange((1, 4), 31, 60).tile == [3, 32, 64]
+
+  @ti.kernel
+  def func():
+    for i, j, k in ti.ndrange((1, 4), 31, 60):
+      x[i - 1, j, k] = i + j * 10 + k * 1000
+      count[None] += 1
+
+  func()
+  assert count[None] == 3 * 31 * 60
+  for i in range(3):
+    for j in range(31):
+      for k in range(60):
+        assert x[i, j, k] == i + 1 + j * 10 + k * 1000
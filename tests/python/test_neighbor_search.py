@@ -0,0 +1,45 @@
+import taichi as ti
+import random
+
+
+@ti.all_archs
+def test_neighbor_search():
+  n = 300
+  radius = 0.1
+  x = ti.Vector(2, dt=ti.f32, shape=n)
+  count = ti.var(ti.i32, shape=n)
+  total = ti.var(ti.i32, shape=n)
+  search = ti.NeighborSearch(x, n, radius, lower=0, res=10, num_chunks=16)
+
+  @ti.func
+  def visit(i, j):
+    count[i] += 1
+    total[i] += j
+
+  random.seed(0)
+  points = []
+  for i in range(n):
+    # Some outside the grid
+    p = [random.random() * 1.2 - 0.1, random.random() * 1.2 - 0.1]
+    points.append(p)
+    x[i] = p
+
+  search.build()
+  search.for_each_neighbor(visit)
+
+  for i in range(n):
+    neighbors = [
+        j for j in range(n) if j != i and
+        (points[i][0] - points[j][0])**2 +
+        (points[i][1] - points[j][1])**2 < radius**2 * 0.999
+    ]
+    # Pairs at the radius up to rounding may go either way
+    assert count[i] >= len(neighbors)
+    close = [
+        j for j in range(n) if j != i and
+        (points[i][0] - points[j][0])**2 +
+        (points[i][1] - points[j][1])**2 < radius**2 * 1.001
+    ]
+    assert count[i] <= len(close)
+    if len(neighbors) == len(close):
+      assert total[i] == sum(neighbors)
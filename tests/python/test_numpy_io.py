@@ -146,3 +146,37 @@ def test_numpy_io_example():
   assert arr.shape == (n, m, 3, 4)
 
   # For PyTorch tensors, use to_torch/from_torch instead
+
+
+@ti.all_archs
+def test_numpy_io_interleaved_padded():
+  x = ti.var(ti.i32)
+  y = ti.var(ti.f32)
+  z = ti.var(ti.i32)
+
+  n = 5
+  m = 6
+
+  @ti.layout
+  def values():
+    ti.root.dense(ti.ij, (n, m)).place(x, y)
+    ti.root.dense(ti.i, 4).dense(ti.j, 4).place(z)
+
+  a = np.arange(n * m, dtype=np.int32).reshape(n, m)
+  b = np.arange(n * m, dtype=np.float32).reshape(n, m) * 0.5
+  c = np.arange(16, dtype=np.int32).reshape(4, 4)
+  x.from_numpy(a)
+  y.from_numpy(b)
+  z.from_numpy(c)
+  for i in range(n):
+    for j in range(m):
+      assert x[i, j] == a[i, j]
+      assert y[i, j] == b[i, j]
+  assert (x.to_numpy() == a).all()
+  assert (y.to_numpy() == b).all()
+  assert (z.to_numpy() == c).all()
+  # Non-contiguous arrays, and arrays of other types, are converted
+  x.from_numpy(a.T.copy().T)
+  assert (x.to_numpy() == a).all()
+  y.from_numpy(b.astype(np.float64))
+  assert (y.to_numpy() == b).all()
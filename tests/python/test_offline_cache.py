@@ -0,0 +1,61 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_offline_cache():
+  arch = ti.cfg.arch
+  results = []
+  hits = []
+  # The second round loads the kernel compiled in the first one from disk
+  for i in range(2):
+    ti.reset()
+    ti.cfg.arch = arch
+    ti.cfg.use_offline_cache = True
+    x = ti.var(ti.f32, shape=16)
+
+    @ti.kernel
+    def fill():
+      for j in x:
+        x[j] = j * 0.1234567 + 1
+
+    ti.get_runtime().materialize()
+    hits_before = ti.runtime_counters()['offline_cache_hits']
+    fill()
+    hits.append(ti.runtime_counters()['offline_cache_hits'] - hits_before)
+    results.append([x[j] for j in range(16)])
+  assert results[0] == results[1]
+  # Whether or not an earlier run has cached the kernel already
+  assert hits[1] == 1
+
+
+@ti.all_archs
+def test_frontend_cache():
+  import numpy as np
+  from taichi.lang import kernel as kernel_module
+  arch = ti.cfg.arch
+  transformer = kernel_module.ASTTransformer
+
+  class NotCalled:
+
+    def __init__(self, *args, **kwargs):
+      assert False, 'The preprocessed kernel should come from the cache'
+
+  try:
+    for i in range(2):
+      ti.reset()
+      ti.cfg.arch = arch
+      ti.cfg.use_offline_cache = True
+      x = ti.var(ti.i32, shape=8)
+
+      @ti.kernel
+      def scale(t: ti.template(), a: ti.ext_arr(), k: ti.i32):
+        for j in t:
+          t[j] = a[j] * k
+
+      scale(x, np.arange(8, dtype=np.int32), 3)
+      for j in range(8):
+        assert x[j] == j * 3
+      # The second round skips the Python frontend
+      kernel_module.ASTTransformer = NotCalled
+  finally:
+    kernel_module.ASTTransformer = transformer
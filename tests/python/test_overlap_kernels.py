@@ -0,0 +1,37 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_overlap_kernels():
+  ti.cfg.overlap_kernels = True
+  x = ti.var(ti.i32)
+  y = ti.var(ti.i32)
+  z = ti.var(ti.i32)
+  n = 1024
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).place(x, y, z)
+
+  @ti.kernel
+  def fill_x():
+    for i in range(n):
+      x[i] = i
+
+  @ti.kernel
+  def fill_y():
+    for i in range(n):
+      y[i] = i * 2
+
+  # Depends on both kernels above
+  @ti.kernel
+  def add():
+    for i in range(n):
+      z[i] = x[i] + y[i]
+
+  for k in range(3):
+    fill_x()
+    fill_y()
+    add()
+  for i in range(n):
+    assert z[i] == i * 3
@@ -0,0 +1,54 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_scan():
+  n = 1000
+  x = ti.var(ti.i32, shape=n)
+  y = ti.var(ti.f32, shape=n)
+  z = ti.var(ti.f32, shape=n)
+  prims = ti.ParallelPrimitives(num_chunks=7)
+
+  values = np.random.randint(0, 10, size=n).astype(np.int32)
+  x.from_numpy(values)
+  for i in range(n):
+    y[i] = values[i] * 0.5
+
+  total = prims.exclusive_scan(x, x)
+  assert total[None] == values.sum()
+  np.testing.assert_array_equal(x.to_numpy(), np.cumsum(values) - values)
+
+  prims.inclusive_scan(y, z, n=500)
+  expected = np.cumsum(values[:500] * 0.5)
+  np.testing.assert_allclose(z.to_numpy()[:500], expected, rtol=1e-5)
+  assert z[500] == 0
+
+
+@ti.all_archs
+def test_compact_and_histogram():
+  n = 777
+  flags = ti.var(ti.i32, shape=n)
+  indices = ti.var(ti.i32, shape=n)
+  bins = ti.var(ti.i32, shape=5)
+  prims = ti.ParallelPrimitives()
+
+  values = np.random.randint(-1, 6, size=n).astype(np.int32)
+  flags.from_numpy(values)
+  count = prims.compact(flags, indices)
+  kept = np.nonzero(values)[0]
+  assert count[None] == len(kept)
+  np.testing.assert_array_equal(indices.to_numpy()[:len(kept)], kept)
+
+  prims.histogram(flags, bins)
+  for b in range(5):
+    assert bins[b] == (values == b).sum()
+
+
+@ti.all_archs
+def test_scan_ext_arr():
+  prims = ti.ParallelPrimitives(num_chunks=4)
+  src = np.arange(100, dtype=np.int32)
+  dst = np.zeros(100, dtype=np.int32)
+  prims.inclusive_scan(src, dst)
+  np.testing.assert_array_equal(dst, np.cumsum(src))
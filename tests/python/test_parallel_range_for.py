@@ -17,3 +17,80 @@ def test_parallel_range_for():
 
   for i in range(n):
     assert val[i] == i
+
+
+@ti.all_archs
+def test_range_for_schedules():
+  n = 1000
+  val = ti.var(ti.i32, shape=(n))
+
+  for schedule in ['dynamic', 'static', 'guided']:
+
+    @ti.kernel
+    def fill():
+      ti.schedule(schedule)
+      ti.block_dim(8)
+      for i in range(n):
+        val[i] += i + 1
+
+    fill()
+
+  for i in range(n):
+    assert val[i] == 3 * (i + 1)
+
+
+@ti.all_archs
+def test_serial_and_range_for():
+  n = 1000
+  a = ti.var(ti.i32, shape=())
+  b = ti.var(ti.i32, shape=(n))
+  s = ti.var(ti.i32, shape=())
+
+  @ti.kernel
+  def func():
+    # Independent of the loop below, may run at the same time on CPUs
+    a[None] = 42
+    for i in range(n):
+      b[i] = i
+    # The loop below depends on this one
+    s[None] = 1
+    for i in range(n):
+      s[None] += b[i]
+
+  func()
+
+  assert a[None] == 42
+  assert s[None] == 1 + n * (n - 1) // 2
+  for i in range(n):
+    assert b[i] == i
+
+
+@ti.all_archs
+def test_vectorized_loops():
+  n = 1024
+  x = ti.var(ti.f32)
+  y = ti.var(ti.f32)
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).place(x)
+    ti.root.dense(ti.i, n // 8).dense(ti.i, 8).place(y)
+
+  @ti.kernel
+  def fill():
+    ti.vectorize(8)
+    for i in range(n):
+      x[i] = i * 0.5
+
+  @ti.kernel
+  def axpy():
+    ti.vectorize(8)
+    for i in y:
+      y[i] = x[i] * 2.0 + 1.0
+
+  fill()
+  axpy()
+
+  for i in range(n):
+    assert x[i] == i * 0.5
+    assert y[i] == i + 1.0
@@ -0,0 +1,81 @@
+import taichi as ti
+import random
+
+
+@ti.all_archs
+def test_particle_grid_transfer():
+  n_particles = 512
+  n_grid = 32
+  dx = 1 / n_grid
+  inv_dx = n_grid
+  x = ti.Vector(2, dt=ti.f32)
+  m = ti.var(ti.f32)
+  m_ref = ti.var(ti.f32)
+  s = ti.var(ti.f32)
+  s_ref = ti.var(ti.f32)
+  transfer = ti.ParticleGridTransfer(x, dx, block_size=4,
+                                     max_particles_per_block=n_particles)
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n_particles).place(x, s, s_ref)
+    block = ti.root.pointer(ti.ij, n_grid // 4)
+    block.dense(ti.ij, 4).place(m)
+    transfer.place(block)
+    ti.root.dense(ti.ij, n_grid).place(m_ref)
+
+  @ti.func
+  def p2g(p, base):
+    fx = x[p] * inv_dx - base.cast(float)
+    w = [0.5 * ti.sqr(1.5 - fx), 0.75 - ti.sqr(fx - 1), 0.5 * ti.sqr(fx - 0.5)]
+    for i in ti.static(range(3)):
+      for j in ti.static(range(3)):
+        m[base + ti.Vector([i, j])] += w[i][0] * w[j][1] * (p % 7 + 1)
+
+  @ti.func
+  def g2p(p, base):
+    fx = x[p] * inv_dx - base.cast(float)
+    w = [0.5 * ti.sqr(1.5 - fx), 0.75 - ti.sqr(fx - 1), 0.5 * ti.sqr(fx - 0.5)]
+    total = 0.0
+    for i in ti.static(range(3)):
+      for j in ti.static(range(3)):
+        total += w[i][0] * w[j][1] * m[base + ti.Vector([i, j])]
+    s[p] = total
+
+  @ti.kernel
+  def reference():
+    for p in x:
+      base = (x[p] * inv_dx - 0.5).cast(int)
+      fx = x[p] * inv_dx - base.cast(float)
+      w = [
+          0.5 * ti.sqr(1.5 - fx), 0.75 - ti.sqr(fx - 1), 0.5 * ti.sqr(fx - 0.5)
+      ]
+      for i in ti.static(range(3)):
+        for j in ti.static(range(3)):
+          m_ref[base + ti.Vector([i, j])] += w[i][0] * w[j][1] * (p % 7 + 1)
+    for p in x:
+      base = (x[p] * inv_dx - 0.5).cast(int)
+      fx = x[p] * inv_dx - base.cast(float)
+      w = [
+          0.5 * ti.sqr(1.5 - fx), 0.75 - ti.sqr(fx - 1), 0.5 * ti.sqr(fx - 0.5)
+      ]
+      total = 0.0
+      for i in ti.static(range(3)):
+        for j in ti.static(range(3)):
+          total += w[i][0] * w[j][1] * m_ref[base + ti.Vector([i, j])]
+      s_ref[p] = total
+
+  random.seed(0)
+  for p in range(n_particles):
+    x[p] = [random.random() * 0.6 + 0.2, random.random() * 0.6 + 0.2]
+
+  transfer.bin()
+  transfer.for_each_particle(p2g, cached=[m])
+  transfer.for_each_particle(g2p, cached=[m])
+  reference()
+
+  for i in range(n_grid):
+    for j in range(n_grid):
+      assert abs(m[i, j] - m_ref[i, j]) < 1e-4
+  for p in range(n_particles):
+    assert abs(s[p] - s_ref[p]) < 1e-3
@@ -0,0 +1,51 @@
+import taichi as ti
+import random
+
+
+@ti.all_archs
+def test_particle_sort():
+  n = 1000
+  num_cells = 3000
+  x = ti.var(ti.i32, shape=n)
+  m = ti.Vector(2, dt=ti.f32, shape=n)
+
+  @ti.func
+  def cell(i):
+    return x[i]
+
+  sorter = ti.ParticleSorter([x, m], n, cell, num_cells, num_chunks=16)
+
+  keys = [random.randrange(num_cells) for _ in range(n)]
+  for i in range(n):
+    x[i] = keys[i]
+    m[i][0] = i
+    m[i][1] = keys[i] * 0.5
+
+  sorter.sort()
+  order = sorted(range(n), key=lambda i: keys[i])
+  for i in range(n):
+    assert x[i] == keys[order[i]]
+    # Stable
+    assert m[i][0] == order[i]
+    assert m[i][1] == keys[order[i]] * 0.5
+  assert sorter.sorted_keys()[n - 1] == max(keys)
+
+
+@ti.all_archs
+def test_particle_sort_prefix():
+  n = 64
+  x = ti.var(ti.i32, shape=n)
+
+  @ti.func
+  def cell(i):
+    return x[i]
+
+  sorter = ti.ParticleSorter([x], n, cell, 100)
+
+  for i in range(n):
+    x[i] = 99 - i
+  sorter.sort(10)
+  for i in range(10):
+    assert x[i] == 90 + i
+  for i in range(10, n):
+    assert x[i] == 99 - i
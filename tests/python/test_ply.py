@@ -0,0 +1,37 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_write_ply():
+  import tempfile
+  import os
+  n = 100
+  filename = os.path.join(tempfile.mkdtemp(), 'particles.ply')
+  x = ti.Vector(3, dt=ti.f32, shape=n)
+  v = ti.Vector(3, dt=ti.f32, shape=n)
+  mass = ti.var(ti.f32, shape=n)
+
+  @ti.kernel
+  def init():
+    for i in x:
+      x[i] = ti.Vector([i, i * 2, i * 3])
+      v[i] = ti.Vector([-i, 0, 1])
+      mass[i] = i * 0.5
+
+  init()
+  ti.write_ply(filename, x, v=v, mass=mass, id=np.arange(n))
+
+  with open(filename, 'rb') as f:
+    data = f.read()
+  header_end = data.index(b'end_header\n') + len(b'end_header\n')
+  header = data[:header_end].decode().split('\n')
+  assert header[1] == 'format binary_little_endian 1.0'
+  assert header[2] == 'element vertex {}'.format(n)
+  names = [line.split()[2] for line in header if line.startswith('property')]
+  assert names == ['x', 'y', 'z', 'vx', 'vy', 'vz', 'mass', 'id']
+  vertices = np.frombuffer(data[header_end:], dtype='<f4').reshape(n, 8)
+  assert (vertices[:, 0:3] == x.to_numpy()).all()
+  assert (vertices[:, 3:6] == v.to_numpy()).all()
+  assert (vertices[:, 6] == mass.to_numpy()).all()
+  assert (vertices[:, 7] == np.arange(n)).all()
@@ -0,0 +1,59 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_kernel_precision():
+  ti.get_runtime().set_default_fp(ti.f64)
+  x = ti.var(ti.f64, shape=2)
+  y = ti.var(ti.f64, shape=2)
+
+  @ti.kernel
+  def full():
+    a = 1
+    x[0] = 1.0 / 3.0
+    x[1] = a / 3
+
+  @ti.precision(ti.f32)
+  @ti.kernel
+  def single():
+    a = 1
+    y[0] = 1.0 / 3.0
+    y[1] = a / 3
+
+  full()
+  single()
+  for i in range(2):
+    assert x[i] == 1 / 3
+    assert y[i] == np.float32(1 / 3)
+
+
+@ti.all_archs
+def test_accumulation_precision():
+  # The sums must not be reassociated
+  ti.cfg.fast_math = False
+  n = 100000
+  total = ti.var(ti.f64, shape=2)
+
+  @ti.kernel
+  def single():
+    for i in range(1):
+      s = 0.0
+      for j in range(n):
+        s += 0.1
+      total[0] = s
+
+  @ti.precision(ti.f32, accumulation_fp=ti.f64)
+  @ti.kernel
+  def mixed():
+    for i in range(1):
+      s = 0.0
+      for j in range(n):
+        s += 0.1
+      total[1] = s
+
+  single()
+  mixed()
+  expected = n * np.float64(np.float32(0.1))
+  assert abs(total[0] - expected) > 1e-2
+  assert abs(total[1] - expected) < 1e-6
@@ -13,3 +13,26 @@ def print_dt(dt):
 def test_print():
   for dt in [ti.i32, ti.f32, ti.i64, ti.f64]:
     print_dt(dt)
+
+
+# Values are printed by the host, in the order the kernels printed them
+@ti.all_archs
+def print_in_order():
+  x = ti.var(ti.i32, shape=())
+
+  @ti.kernel
+  def func():
+    for i in ti.static(range(3)):
+      x[None] += 1
+      print(x[None])
+
+  func()
+  ti.sync()
+
+
+def test_print_in_order(capfd):
+  print_in_order()
+  out = [l for l in capfd.readouterr().out.splitlines() if '[debug]' in l]
+  assert len(out) > 0 and len(out) % 3 == 0
+  for i, l in enumerate(out):
+    assert l == '[debug] x[None] = {}'.format(i % 3 + 1)
@@ -0,0 +1,110 @@
+import taichi as ti
+
+
+# Not ti.all_archs, which would hide the capfd fixture from pytest
+def test_task_bandwidth(capfd):
+  ti.reset()
+  ti.cfg.enable_profiler = True
+  n = 1024 * 1024
+  x = ti.var(ti.f32, shape=n)
+  y = ti.var(ti.f32, shape=n)
+
+  @ti.kernel
+  def copy():
+    for i in x:
+      y[i] = x[i]
+
+  for i in range(3):
+    copy()
+  ti.sync()
+  capfd.readouterr()
+  ti.profiler_print()
+  out = capfd.readouterr().out
+  # 4 MB read and written per run by the struct-for task
+  lines = [l for l in out.splitlines() if 'GB/s' in l]
+  assert len(lines) == 1
+  assert '[      3x]' in lines[0]
+  assert 'R     4.19 MB  W     4.19 MB' in lines[0]
+
+
+def test_hardware_counters(capfd):
+  ti.reset()
+  ti.cfg.enable_profiler = True
+  ti.cfg.profile_hardware_counters = True
+  n = 1024 * 1024
+  x = ti.var(ti.i32, shape=n)
+
+  @ti.kernel
+  def fill():
+    for i in x:
+      x[i] = i
+
+  fill()
+  ti.sync()
+  out, err = capfd.readouterr()
+  ti.profiler_print()
+  out = capfd.readouterr().out
+  # Perf events are often not available in containers and VMs
+  if 'not available' in err + out:
+    return
+  lines = [l for l in out.splitlines() if 'GB/s' in l]
+  assert len(lines) == 1
+  assert 'instructions' in lines[0] and 'cache_misses' in lines[0]
+
+
+def test_roofline(capfd):
+  ti.reset()
+  ti.cfg.enable_profiler = True
+  ti.cfg.peak_gflops = 1000
+  ti.cfg.peak_bandwidth = 100
+  n = 1024 * 1024
+  x = ti.var(ti.f32, shape=n)
+  y = ti.var(ti.f32, shape=n)
+
+  @ti.kernel
+  def axpb():
+    for i in x:
+      y[i] = x[i] * 2.0 + 1.0
+
+  axpb()
+  ti.sync()
+  capfd.readouterr()
+  ti.profiler_print()
+  out = capfd.readouterr().out
+  ti.cfg.peak_gflops = 0
+  ti.cfg.peak_bandwidth = 0
+  # 2 flops per 8 bytes, far below the ridge point of 10 flop/B
+  lines = [l for l in out.splitlines() if 'GFLOP/s' in l]
+  assert len(lines) == 1
+  assert '0.25 flop/B' in lines[0]
+  assert 'memory-bound' in lines[0]
+
+
+def test_register_usage(capfd):
+  if not ti.core.with_cuda():
+    return
+  ti.reset()
+  ti.cfg.arch = ti.cuda
+  ti.cfg.enable_profiler = True
+  n = 1024
+  x = ti.var(ti.f32, shape=n)
+
+  @ti.kernel
+  def poly():
+    for i in x:
+      v = ti.cast(i, ti.f32)
+      for k in ti.static(range(16)):
+        x[i] += v * k
+
+  poly.max_registers = 32
+  poly()
+  ti.sync()
+  capfd.readouterr()
+  ti.profiler_print()
+  out = capfd.readouterr().out
+  lines = [l for l in out.splitlines() if ' regs ' in l]
+  assert len(lines) >= 1
+  for l in lines:
+    assert int(l.split(' regs ')[0].split()[-1]) <= 32
+  for i in range(0, n, 97):
+    assert abs(x[i] - i * 120) < 1e-3 * i * 120 + 1e-3
@@ -42,3 +42,27 @@ def test_random_int():
     X = x.to_numpy()
     for i in range(4):
       assert (X**i).mean() == approx(1 / (i + 1), rel=1e-2)
+
+@ti.all_archs
+def test_random_reproducible():
+  n = 256
+
+  def sample(seed):
+    ti.reset()
+    ti.cfg.random_seed = seed
+    x = ti.var(ti.f32, shape=n)
+
+    @ti.kernel
+    def fill():
+      for i in range(n):
+        x[i] = ti.random() + ti.random()
+
+    fill()
+    return x.to_numpy()
+
+  a = sample(0)
+  b = sample(0)
+  c = sample(1)
+  assert (a == b).all()
+  assert not (a == c).all()
+  ti.cfg.random_seed = 0
@@ -0,0 +1,43 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_read_async():
+  x = ti.var(ti.f32)
+  loss = ti.var(ti.f32)
+  steps = ti.var(ti.i32)
+  n, m = 4, 6
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.ij, (n, m)).place(x)
+    ti.root.place(loss, steps)
+
+  @ti.kernel
+  def step():
+    for i, j in x:
+      x[i, j] += i * m + j
+    loss[None] = 0
+    for i, j in x:
+      loss[None] += x[i, j]
+    steps[None] += 1
+
+  readbacks = []
+  for k in range(3):
+    step()
+    readbacks.append(ti.read_async(loss, steps))
+  # Launched after the readbacks, so not in them
+  step()
+  total = n * m * (n * m - 1) / 2
+  for k, readback in enumerate(readbacks):
+    l, s = readback.result()
+    assert readback.done()
+    assert l == total * (k + 1)
+    assert s == k + 1
+
+  values = ti.read_async(x).result()
+  assert values.shape == (n, m)
+  for i in range(n):
+    for j in range(m):
+      assert values[i, j] == (i * m + j) * 4
@@ -0,0 +1,24 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_reset_and_rematerialize():
+  arch = ti.cfg.arch
+  for r in range(5):
+    ti.reset()
+    ti.cfg.arch = arch
+    n = 16 + r
+    x = ti.var(ti.i32, shape=n)
+    s = ti.var(ti.i32, shape=())
+
+    @ti.kernel
+    def fill():
+      for i in x:
+        x[i] = i * (r + 1)
+        s[None] += i
+
+    fill()
+    # Memory kept from the last program reads as zero
+    assert s[None] == n * (n - 1) // 2
+    for i in range(n):
+      assert x[i] == i * (r + 1)
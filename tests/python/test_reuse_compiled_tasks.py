@@ -0,0 +1,37 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_reuse_compiled_tasks():
+  x = ti.var(ti.i32)
+  y = ti.var(ti.i32)
+  n = 64
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n // 8).pointer().dense(ti.i, 8).place(x)
+    ti.root.dense(ti.i, n).place(y)
+
+  @ti.kernel
+  def first():
+    for i in range(n):
+      x[i] = i
+    for i in x:
+      y[i] = x[i] * 2
+
+  # Edited in its last loop: the range-for and the list generation of the
+  # struct-for are the same as above
+  @ti.kernel
+  def second():
+    for i in range(n):
+      x[i] = i
+    for i in x:
+      y[i] = x[i] * 3
+
+  first()
+  before = ti.runtime_counters()['reused_tasks']
+  second()
+  assert ti.runtime_counters()['reused_tasks'] > before
+  for i in range(n):
+    assert y[i] == i * 3
+
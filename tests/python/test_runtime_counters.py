@@ -0,0 +1,60 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_runtime_counters():
+  x = ti.var(ti.i32)
+  s = ti.var(ti.i32, shape=())
+  n = 128
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n // 8).pointer().dense(ti.i, 8).place(x)
+
+  @ti.kernel
+  def activate():
+    for i in range(n // 2):
+      x[i] = i
+
+  @ti.kernel
+  def total():
+    for i in x:
+      ti.atomic_add(s[None], x[i])
+
+  activate()
+  before = ti.runtime_counters()
+  total()
+  total()
+  after = ti.runtime_counters()
+  assert after['kernel_launches'] == before['kernel_launches'] + 2
+  block = x.parent()
+  key = 'list_elements:%d' % block.ptr.id
+  assert after[key] > before[key]
+  assert (after[key] - before[key]) % 2 == 0
+  pointer = block.ptr.parent
+  assert after['allocated_nodes:%d' % pointer.id] == n // 2 // 8
+  if ti.cfg.arch == ti.x86_64:
+    assert after['atomic_ops'] - before['atomic_ops'] == n
+  assert after['compile_cache_misses'] >= 2
+
+
+@ti.all_archs
+def test_prometheus_metrics():
+  x = ti.var(ti.f32, shape=8)
+
+  @ti.kernel
+  def fill():
+    for i in x:
+      x[i] = 1
+
+  fill()
+  text = ti.prometheus_metrics()
+  assert text.endswith('\n')
+  assert '# TYPE taichi_kernel_launches_total counter' in text
+  lines = text.splitlines()
+  assert any(l.startswith('taichi_list_elements_total{snode="') for l in lines)
+  for l in lines:
+    if not l.startswith('#'):
+      name, value = l.rsplit(' ', 1)
+      assert name.startswith('taichi_')
+      int(value)
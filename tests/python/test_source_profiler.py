@@ -0,0 +1,36 @@
+import taichi as ti
+import inspect
+import time
+
+
+def test_source_profiler():
+  ti.reset()
+  ti.cfg.arch = ti.x86_64
+  ti.cfg.profile_source_lines = True
+  x = ti.var(ti.f32, shape=1024)
+
+  @ti.kernel
+  def heavy():
+    for i in x:
+      s = 0.0
+      for j in range(200):
+        s = ti.sin(s + j * 0.5)  # hot
+      x[i] = s
+
+  heavy()
+  ti.sync()
+  t = time.time()
+  while time.time() - t < 0.5:
+    heavy()
+  ti.sync()
+  profile = ti.source_profile(clear=True)
+  ti.cfg.profile_source_lines = False
+  if profile['total'] == 0:
+    # Sampling is not supported on this platform
+    return
+  filename = inspect.getsourcefile(test_source_profiler)
+  lines = inspect.getsourcelines(test_source_profiler)
+  hot = lines[1] + next(
+      i for i, l in enumerate(lines[0]) if l.endswith('# hot\n'))
+  assert profile.get(f'{filename}:{hot}', 0) > 0
+  assert ti.source_profile()['total'] < profile['total']
@@ -92,3 +92,317 @@ def test_pointer2():
   assert s[None] == 5 * n
   print(x[257 + n * n * 7])
   assert s[None] == 5 * n
+
+
+@ti.all_archs
+def test_bitmasked_leaf():
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  x = ti.var(ti.i32)
+  s = ti.var(ti.i32)
+
+  n = 200
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).bitmasked().place(x)
+    ti.root.place(s)
+
+  @ti.kernel
+  def func():
+    for i in x:
+      s[None] += x[i]
+
+  # Cells in the first, an inner and the last (partial) mask word
+  x[0] = 1
+  x[63] = 2
+  x[64] = 4
+  x[130] = 8
+  x[199] = 16
+
+  func()
+  assert s[None] == 31
+
+
+@ti.all_archs
+def test_hash():
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  x = ti.var(ti.i32)
+  s = ti.var(ti.i32)
+
+  n = 16
+
+  @ti.layout
+  def place():
+    ti.root.hash(ti.i, 1 << 20, capacity=64).dense(ti.i, n).place(x)
+    ti.root.place(s)
+
+  @ti.kernel
+  def func():
+    for i in x:
+      s[None] += 1
+
+  # Keys far apart in the index space, two of them sharing a block
+  x[0] = 1
+  x[1] = 2
+  x[12345 * n] = 3
+  x[((1 << 20) - 1) * n] = 4
+
+  func()
+  assert s[None] == 3 * n
+  assert x[1] == 2
+  assert x[12345 * n] == 3
+  assert x[12345 * n + 1] == 0
+
+
+@ti.all_archs
+def test_hash_full_capacity():
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  x = ti.var(ti.i32)
+  s = ti.var(ti.i32)
+
+  capacity = 64
+  n = 4
+
+  @ti.layout
+  def place():
+    ti.root.hash(ti.i, 1 << 20, capacity=capacity).dense(ti.i, n).place(x)
+    ti.root.place(s)
+
+  # Consecutive keys fill every slot
+  @ti.kernel
+  def fill():
+    for i in range(capacity):
+      x[(i + 1000) * n] = i + 1
+
+  @ti.kernel
+  def func():
+    for i in x:
+      s[None] += x[i]
+
+  fill()
+  func()
+  assert s[None] == capacity * (capacity + 1) // 2
+  for i in range(capacity):
+    assert x[(i + 1000) * n] == i + 1
+
+
+def test_hash_overflow():
+  import subprocess
+  import sys
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  # The error stops the process, so it runs in another one
+  script = """
+import taichi as ti
+x = ti.var(ti.i32)
+
+@ti.layout
+def place():
+  ti.root.hash(ti.i, 1 << 20, capacity=8).dense(ti.i, 4).place(x)
+
+@ti.kernel
+def fill():
+  for i in range(9):
+    x[i * 12] = 1
+
+fill()
+ti.sync()
+print('no error')
+"""
+  result = subprocess.run([sys.executable, '-c', script],
+                          stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT)
+  output = result.stdout.decode()
+  assert result.returncode != 0
+  assert 'is full' in output
+  assert 'no error' not in output
+
+
+@ti.all_archs
+def test_pointer_list_reuse():
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  x = ti.var(ti.i32)
+  s = ti.var(ti.i32)
+
+  n = 16
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).pointer().dense(ti.i, n).place(x)
+    ti.root.place(s)
+
+  @ti.kernel
+  def func():
+    for i in x:
+      s[None] += x[i]
+
+  x[0] = 1
+  func()
+  func()
+  assert s[None] == 2
+
+  # Element lists are regenerated once the structure changes
+  x[n * 5] = 2
+  s[None] = 0
+  func()
+  assert s[None] == 3
+
+
+@ti.all_archs
+def test_snapshot():
+  import tempfile
+  import os
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  n, m = 256, 8
+  filename = os.path.join(tempfile.mkdtemp(), 'blocks.bin')
+
+  def build():
+    x = ti.var(ti.f32)
+    s = ti.var(ti.i32)
+    blk = ti.root.pointer(ti.i, n).dense(ti.i, m)
+
+    @ti.layout
+    def place():
+      blk.place(x)
+      ti.root.place(s)
+
+    @ti.kernel
+    def count():
+      for i in x:
+        s[None] += 1
+
+    return x, s, blk, count
+
+  x, s, blk, count = build()
+  x[3] = 1.5
+  x[100 * m + 7] = 2
+  x[255 * m] = 3
+  blk.snapshot(filename)
+
+  arch = ti.cfg.arch
+  ti.reset()
+  ti.cfg.arch = arch
+  x, s, blk, count = build()
+  blk.restore(filename)
+
+  count()
+  assert s[None] == 3 * m
+  assert x[3] == 1.5
+  assert x[100 * m + 7] == 2
+  assert x[255 * m] == 3
+  assert x[4] == 0
+  os.remove(filename)
+
+
+@ti.all_archs
+def test_memory_stats():
+  x = ti.var(ti.f32)
+  n, m = 64, 16
+  ptr = ti.root.pointer(ti.i, n)
+
+  @ti.layout
+  def place():
+    ptr.dense(ti.i, m).place(x)
+
+  @ti.kernel
+  def activate():
+    for i in range(10):
+      x[i * m] = 1
+
+  activate()
+  stats = ptr.memory_stats()
+  assert stats['active_nodes'] == 10
+  assert stats['allocated_bytes'] >= 10 * m * 4
+  assert stats['committed_bytes'] >= stats['allocated_bytes']
+  assert stats['peak_bytes'] >= stats['allocated_bytes']
+  assert ti.memory_stats()[ptr.ptr.stat().snode_id] == stats
+
+
+@ti.all_archs
+def test_snapshot_compressed():
+  import tempfile
+  import os
+  if ti.get_os_name() == 'win':
+    return
+  n, m = 64, 16
+  directory = tempfile.mkdtemp()
+
+  def build():
+    x = ti.var(ti.f32)
+    blk = ti.root.pointer(ti.ij, n).dense(ti.ij, m)
+
+    @ti.layout
+    def place():
+      blk.place(x)
+
+    @ti.kernel
+    def fill():
+      for i, j in ti.ndrange(n * m // 2, n * m // 4):
+        x[i, j] = ti.sin(i * 0.01) + j * 0.5
+
+    return x, blk, fill
+
+  x, blk, fill = build()
+  fill()
+  expected = x.to_numpy()
+  raw = os.path.join(directory, 'raw.bin')
+  compressed = os.path.join(directory, 'compressed.bin')
+  blk.snapshot(raw)
+  blk.snapshot(compressed, compress=True)
+  assert os.path.getsize(compressed) < os.path.getsize(raw) // 2
+
+  arch = ti.cfg.arch
+  ti.reset()
+  ti.cfg.arch = arch
+  x, blk, fill = build()
+  blk.restore(compressed)
+  assert (x.to_numpy() == expected).all()
+
+
+@ti.all_archs
+def test_skip_unchanged_lists():
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  x = ti.var(ti.i32)
+  s = ti.var(ti.i32)
+
+  n = 16
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).pointer().dense(ti.i, n).place(x)
+    ti.root.place(s)
+
+  @ti.kernel
+  def func():
+    for i in x:
+      s[None] += x[i]
+
+  @ti.kernel
+  def activate(i: ti.i32):
+    x[i] = i
+
+  x[0] = 1
+  func()
+  before = ti.runtime_counters()['skipped_list_tasks']
+  # Writes to s do not change the structure
+  func()
+  assert ti.runtime_counters()['skipped_list_tasks'] > before
+  assert s[None] == 2
+
+  activate(n * 5)
+  s[None] = 0
+  func()
+  assert s[None] == n * 5 + 1
@@ -0,0 +1,53 @@
+import taichi as ti
+import numpy as np
+import itertools
+
+
+@ti.all_archs
+def test_sparse_conv():
+  res = 8
+  max_sites = 32
+  n = 24
+  c_in, c_out = 2, 3
+  rules = ti.SparseConvRules(max_sites, res, dim=2, num_chunks=8)
+  conv = ti.SparseConv(rules, c_in, c_out)
+  x = ti.var(ti.f32, shape=(max_sites, c_in), needs_grad=True)
+  y = ti.var(ti.f32, shape=(max_sites, c_out), needs_grad=True)
+
+  np.random.seed(0)
+  cells = np.random.permutation(res * res)[:n]
+  coords = np.stack([cells // res, cells % res], axis=1)
+  features = np.random.rand(max_sites, c_in).astype(np.float32)
+  weights = np.random.rand(9, c_in, c_out).astype(np.float32)
+  bias = np.random.rand(c_out).astype(np.float32)
+  grad_y = np.random.rand(max_sites, c_out).astype(np.float32)
+  x.from_numpy(features)
+  conv.weights.from_numpy(weights)
+  conv.bias.from_numpy(bias)
+
+  rules.build(coords)
+  site = {tuple(c): i for i, c in enumerate(coords)}
+  expected = np.zeros((n, c_out), dtype=np.float32) + bias
+  grad_x = np.zeros((n, c_in), dtype=np.float32)
+  grad_w = np.zeros_like(weights)
+  num_rules = 0
+  for j in range(n):
+    for k, o in enumerate(itertools.product(range(-1, 2), repeat=2)):
+      i = site.get((coords[j][0] + o[0], coords[j][1] + o[1]))
+      if i is not None:
+        num_rules += 1
+        expected[j] += features[i] @ weights[k]
+        grad_x[i] += weights[k] @ grad_y[j]
+        grad_w[k] += np.outer(features[i], grad_y[j])
+  assert rules.num_rules == num_rules
+
+  conv.forward(x, y)
+  np.testing.assert_allclose(y.to_numpy()[:n], expected, rtol=1e-5)
+
+  y.grad.from_numpy(grad_y)
+  conv.backward(x, y)
+  np.testing.assert_allclose(x.grad.to_numpy()[:n], grad_x, rtol=1e-5)
+  np.testing.assert_allclose(conv.weights.grad.to_numpy(), grad_w, rtol=1e-5)
+  np.testing.assert_allclose(conv.bias.grad.to_numpy(),
+                             grad_y[:n].sum(axis=0),
+                             rtol=1e-5)
@@ -0,0 +1,322 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_pointer_deactivate():
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  x = ti.var(ti.f32)
+  s = ti.var(ti.i32)
+
+  n = 128
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).pointer().dense(ti.i, n).place(x)
+    ti.root.place(s)
+
+  @ti.kernel
+  def func():
+    for i in x:
+      ti.atomic_add(s[None], 1)
+
+  @ti.kernel
+  def deactivate():
+    ti.deactivate(x, 0)
+
+  x[0] = 1
+  x[127] = 1
+  x[256] = 1
+
+  deactivate()
+  func()
+  assert s[None] == 128
+
+  # The recycled block must come back cleared
+  x[1] = 2
+  assert x[0] == 0
+  assert x[1] == 2
+
+
+@ti.all_archs
+def test_dynamic_deactivate():
+  x = ti.var(ti.i32)
+  n = 128
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, 4).dynamic(ti.j, n, 8).place(x)
+
+  @ti.kernel
+  def fill():
+    for i in range(4):
+      for j in range(i * 10):
+        ti.append(x, i, j)
+
+  @ti.kernel
+  def deactivate():
+    for i in range(4):
+      ti.deactivate(x, i)
+
+  fill()
+  deactivate()
+  fill()
+  for i in range(4):
+    for j in range(i * 10):
+      assert x[i, j] == j
+
+
+@ti.all_archs
+def test_pointer_stat():
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  x = ti.var(ti.f32)
+  n = 128
+  blocks = []
+
+  @ti.layout
+  def place():
+    blocks.append(ti.root.dense(ti.i, n).pointer())
+    blocks[0].dense(ti.i, n).place(x)
+
+  @ti.kernel
+  def deactivate():
+    ti.deactivate(x, 0)
+
+  x[0] = 1
+  x[256] = 1
+  stat = blocks[0].stat()
+  # Two activated blocks and the ambient one
+  assert stat.num_resident_blocks == 3
+  assert stat.pool_size > 0
+
+  deactivate()
+  stat = blocks[0].stat()
+  assert stat.num_resident_blocks == 2
+  assert stat.num_recycled_blocks == 1
+
+
+@ti.all_archs
+def test_pointer_deactivate_all():
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  x = ti.var(ti.f32)
+  s = ti.var(ti.i32)
+  n = 16
+  blocks = []
+
+  @ti.layout
+  def place():
+    blocks.append(ti.root.dense(ti.i, n).pointer())
+    blocks[0].dense(ti.i, n).place(x)
+    ti.root.place(s)
+
+  @ti.kernel
+  def count():
+    for i in x:
+      ti.atomic_add(s[None], 1)
+
+  for frame in range(3):
+    for i in range(frame, n * n, 37):
+      x[i] = i + 1
+    blocks[0].deactivate_all()
+    # Only the ambient node is left
+    assert blocks[0].memory_stats()['active_nodes'] == 1
+    s[None] = 0
+    count()
+    assert s[None] == 0
+
+  # The reused nodes must come back cleared
+  x[3] = 2
+  for i in range(n):
+    assert x[i] == (2 if i == 3 else 0)
+  s[None] = 0
+  count()
+  assert s[None] == n
+
+
+@ti.all_archs
+def test_dynamic_deactivate_all():
+  x = ti.var(ti.i32)
+  n = 128
+  lists = []
+
+  @ti.layout
+  def place():
+    lists.append(ti.root.dense(ti.i, 4).dynamic(ti.j, n, 8))
+    lists[0].place(x)
+
+  @ti.kernel
+  def fill(k: ti.i32):
+    for i in range(4):
+      for j in range(i * 10 + k):
+        ti.append(x, i, j * k)
+
+  fill(3)
+  lists[0].deactivate_all()
+  fill(2)
+  for i in range(4):
+    for j in range(i * 10 + 2):
+      assert x[i, j] == j * 2
+    assert x[i, i * 10 + 2] == 0
+
+
+@ti.all_archs
+def test_pointer_defragment():
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  x = ti.var(ti.i32)
+  s = ti.var(ti.i32)
+  n = 16
+  blocks = []
+
+  @ti.layout
+  def place():
+    blocks.append(ti.root.dense(ti.i, n).pointer())
+    blocks[0].dense(ti.i, n).place(x)
+    ti.root.place(s)
+
+  @ti.kernel
+  def count():
+    for i in x:
+      ti.atomic_add(s[None], 1)
+
+  @ti.kernel
+  def deactivate(i: ti.i32):
+    ti.deactivate(x, i)
+
+  def check(new_blocks):
+    for b in range(n):
+      assert x[b * n + 1] == (b + 1 if b % 2 else 0)
+      assert x[b * n] == (100 + b if b % 2 == 0 and new_blocks else 0)
+
+  # The nodes are taken in reverse order, and every other one is freed
+  for b in reversed(range(n)):
+    x[b * n + 1] = b + 1
+  for b in range(0, n, 2):
+    deactivate(b * n)
+  active_nodes = blocks[0].memory_stats()['active_nodes']
+  blocks[0].defragment()
+  assert blocks[0].memory_stats()['active_nodes'] == active_nodes
+  s[None] = 0
+  count()
+  assert s[None] == n // 2 * n
+  check(False)
+
+  # New nodes do not overlap the moved ones
+  for b in range(0, n, 2):
+    x[b * n] = 100 + b
+  check(True)
+  blocks[0].defragment()
+  check(True)
+  s[None] = 0
+  count()
+  assert s[None] == n * n
+
+
+@ti.all_archs
+def test_deactivate_ambient():
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  x = ti.var(ti.f32)
+  s = ti.var(ti.i32)
+  n = 16
+  blocks = []
+
+  @ti.layout
+  def place():
+    blocks.append(ti.root.dense(ti.i, n).pointer())
+    blocks[0].dense(ti.i, n).place(x)
+    ti.root.place(s)
+
+  @ti.kernel
+  def count():
+    for i in x:
+      ti.atomic_add(s[None], 1)
+
+  @ti.kernel
+  def fill():
+    for b in range(n):
+      x[b * n + 3] = b + 1
+
+  # Blocks 0 to 3 go back to zero, blocks 4 to 7 almost
+  @ti.kernel
+  def drain():
+    for b in range(8):
+      x[b * n + 3] = 0
+      if b >= 4:
+        x[b * n + 5] = 1e-6
+
+  def num_active():
+    s[None] = 0
+    count()
+    return s[None] // n
+
+  fill()
+  drain()
+  assert num_active() == n
+  blocks[0].deactivate_ambient()
+  assert num_active() == n - 4
+  assert blocks[0].memory_stats()['active_nodes'] == n - 4 + 1
+  blocks[0].deactivate_ambient(threshold=1e-5)
+  assert num_active() == n - 8
+  for b in range(n):
+    assert x[b * n + 3] == (b + 1 if b >= 8 else 0)
+    assert x[b * n + 5] == 0
+
+  # The freed nodes are reused, cleared
+  fill()
+  assert num_active() == n
+  for b in range(n):
+    assert x[b * n + 5] == 0
+
+
+@ti.all_archs
+def test_compressed_pointer():
+  if ti.get_os_name() == 'win':
+    # This test not supported on Windows due to the VirtualAlloc issue #251
+    return
+  x = ti.var(ti.i32)
+  s = ti.var(ti.i32)
+  n = 64
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).pointer(compressed=True).dense(ti.i, 8).place(x)
+    ti.root.place(s)
+
+  @ti.kernel
+  def fill():
+    for i in range(n * 8):
+      if i // 8 % 3 == 0:
+        x[i] = i
+
+  @ti.kernel
+  def count():
+    for i in x:
+      ti.atomic_add(s[None], 1)
+
+  @ti.kernel
+  def deactivate(i: ti.i32):
+    ti.deactivate(x, i)
+
+  fill()
+  count()
+  num_blocks = (n + 2) // 3
+  assert s[None] == num_blocks * 8
+  for i in range(n * 8):
+    assert x[i] == (i if i // 8 % 3 == 0 else 0)
+
+  deactivate(0)
+  s[None] = 0
+  count()
+  assert s[None] == (num_blocks - 1) * 8
+  # The recycled node must come back cleared
+  x[1] = 2
+  assert x[0] == 0 and x[1] == 2
+  assert x[3 * 8] == 3 * 8
@@ -0,0 +1,71 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_sparse_grid_marcher():
+  n = 32
+  density = ti.var(ti.f32)
+  total = ti.var(ti.f32, shape=2)
+  visited = ti.var(ti.i32, shape=2)
+  hit = ti.var(ti.f32, shape=2)
+  num_active = ti.var(ti.i32, shape=())
+  blocks = ti.root.dense(ti.ij, n // 8).pointer()
+  marcher = ti.SparseGridMarcher(blocks, n)
+
+  @ti.layout
+  def place():
+    blocks.dense(ti.ij, 8).place(density)
+
+  @ti.func
+  def accumulate(I, t0, t1):
+    total[0] += density[I] * (t1 - t0)
+    visited[0] += 1
+    return 0
+
+  @ti.func
+  def first_dense(I, t0, t1):
+    visited[1] += 1
+    return density[I] > 0
+
+  march_all = marcher.make(accumulate)
+  march_to_hit = marcher.make(first_dense)
+
+  @ti.kernel
+  def fill():
+    for i, j in ti.ndrange((8, 16), (16, 24)):
+      density[i, j] = 1
+    density[12, 20] = 0
+
+  @ti.kernel
+  def render(y: ti.f32):
+    o = ti.Vector([-1.0, y])
+    d = ti.Vector([2.0, 0.0])
+    hit[0] = march_all(o, d, 100.0)
+    hit[1] = march_to_hit(o, d, 100.0)
+
+  @ti.kernel
+  def count_active():
+    num_active[None] = 0
+    for i, j in ti.ndrange(n // 8, n // 8):
+      if ti.is_active(blocks, [i * 8, j * 8]):
+        num_active[None] += 1
+
+  fill()
+  render(20.5)
+  # Only the cells of the active block, one of them empty
+  assert visited[0] == 8
+  assert abs(total[0] - 3.5) < 1e-4
+  assert hit[0] == 100
+  assert visited[1] == 1
+  assert abs(hit[1] - 4.5) < 1e-4
+
+  for k in range(2):
+    visited[k] = 0
+    total[k] = 0
+  render(5.5)
+  assert visited[0] == 0 and visited[1] == 0
+  assert hit[1] == 100
+
+  # The queries activate nothing
+  count_active()
+  assert num_active[None] == 1
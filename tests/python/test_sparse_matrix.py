@@ -0,0 +1,84 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_sparse_matrix_laplacian():
+  n = 64
+  A = ti.SparseMatrix(n, max_triplets=4 * n, num_chunks=8)
+  x = ti.var(ti.f32, shape=n)
+  y = ti.var(ti.f32, shape=n)
+
+  # Each edge adds its 2x2 stiffness, so that the entries have duplicates
+  @ti.kernel
+  def assemble():
+    for e in range(n - 1):
+      A.add(e, e, 1.0)
+      A.add(e + 1, e + 1, 1.0)
+      A.add(e, e + 1, -1.0)
+      A.add(e + 1, e, -1.0)
+
+  dense = np.zeros((n, n), dtype=np.float32)
+  for e in range(n - 1):
+    dense[e:e + 2, e:e + 2] += [[1, -1], [-1, 1]]
+
+  assemble()
+  A.build()
+  assert A.nnz_blocks() == 3 * n - 2
+
+  values = np.random.rand(n).astype(np.float32)
+  x.from_numpy(values)
+  A.spmv(x, y)
+  np.testing.assert_allclose(y.to_numpy(), dense @ values, atol=1e-5)
+  A.spmv_transpose(x, y)
+  np.testing.assert_allclose(y.to_numpy(), dense.T @ values, atol=1e-5)
+
+  # Rebuilding starts from no triplets
+  assemble()
+  A.build()
+  A.spmv(x, y)
+  np.testing.assert_allclose(y.to_numpy(), dense @ values, atol=1e-5)
+
+
+@ti.all_archs
+def test_sparse_matrix_blocks():
+  b = 2
+  n, m = 8, 12
+  num_triplets = 40
+  A = ti.SparseMatrix(n, m, max_triplets=num_triplets, block_size=b)
+  x = ti.var(ti.f32, shape=m)
+  y = ti.var(ti.f32, shape=n)
+  xt = ti.var(ti.f32, shape=n)
+  yt = ti.var(ti.f32, shape=m)
+  rows = ti.var(ti.i32, shape=num_triplets)
+  cols = ti.var(ti.i32, shape=num_triplets)
+  vals = ti.var(ti.f32, shape=num_triplets)
+
+  @ti.kernel
+  def assemble():
+    for k in range(num_triplets):
+      A.set_triplet(k, rows[k], cols[k], vals[k])
+
+  r = np.random.randint(0, n, size=num_triplets).astype(np.int32)
+  c = np.random.randint(0, m, size=num_triplets).astype(np.int32)
+  v = np.random.rand(num_triplets).astype(np.float32)
+  rows.from_numpy(r)
+  cols.from_numpy(c)
+  vals.from_numpy(v)
+  dense = np.zeros((n, m), dtype=np.float32)
+  for k in range(num_triplets):
+    dense[r[k], c[k]] += v[k]
+
+  assemble()
+  A.build(num_triplets)
+  blocks = set((r[k] // b, c[k] // b) for k in range(num_triplets))
+  assert A.nnz_blocks() == len(blocks)
+
+  values = np.random.rand(m).astype(np.float32)
+  x.from_numpy(values)
+  A.spmv(x, y)
+  np.testing.assert_allclose(y.to_numpy(), dense @ values, atol=1e-5)
+  values_t = np.random.rand(n).astype(np.float32)
+  xt.from_numpy(values_t)
+  A.spmv_transpose(xt, yt)
+  np.testing.assert_allclose(yt.to_numpy(), dense.T @ values_t, atol=1e-5)
@@ -57,3 +57,53 @@ def test_pointer2():
   func()
   N = n * n
   assert s[None] == N * (N - 1) / 2
+
+
+@ti.all_archs
+def test_pointer_contention():
+  x = ti.var(ti.i32)
+
+  n = 128
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).pointer().dense(ti.i, n).place(x)
+
+  # Neighboring threads activate different pointers, and every pointer is
+  # activated by many threads at once
+  @ti.kernel
+  def activate():
+    for i in range(n * n):
+      x[i % 8 * n + i // n % n] += 1
+
+  activate()
+  for i in range(8):
+    for j in range(n):
+      assert x[i * n + j] == n // 8
+
+
+@ti.all_archs
+def test_pointer_concurrent_activation():
+  x = ti.var(ti.i32)
+  n = 256
+  block_size = 16
+  block = None
+
+  @ti.layout
+  def place():
+    nonlocal block
+    block = ti.root.dense(ti.i, n).pointer()
+    block.dense(ti.i, block_size).place(x)
+
+  # Neighboring threads activate the same nodes at the same time
+  @ti.kernel
+  def activate():
+    for i in range(n * block_size):
+      if i // block_size % 2 == 0:
+        x[i] = i
+
+  activate()
+  key = 'allocated_nodes:{}'.format(block.ptr.id)
+  assert ti.runtime_counters()[key] == n // 2
+  for i in range(n * block_size):
+    assert x[i] == (i if i // block_size % 2 == 0 else 0)
@@ -24,3 +24,86 @@ def test_simple():
   for i in range(n - 1):
     assert x[i] == 1
     assert y[i + 1] == 2
+
+
+@ti.all_archs
+def test_cache_shared():
+  x = ti.var(ti.i32)
+  y = ti.var(ti.i32)
+  s = ti.var(ti.i32)
+
+  n = 256
+  bs = 32
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n // bs).dense(ti.i, bs).place(x, y, s)
+
+  @ti.kernel
+  def stencil():
+    ti.cache_shared(x)
+    for i in y:
+      if i > 0 and i < n - 1:
+        y[i] = x[i - 1] + x[i] * 2 + x[i + 1]
+
+  @ti.kernel
+  def scatter():
+    ti.cache_shared(s)
+    for i in y:
+      if i > 0 and i < n - 1:
+        s[i - 1] += x[i]
+        s[i + 1] += x[i]
+
+  for i in range(n):
+    x[i] = i
+
+  stencil()
+  scatter()
+
+  for i in range(1, n - 1):
+    assert y[i] == i * 4
+  for i in range(n):
+    expected = 0
+    if 0 < i + 1 < n - 1:
+      expected += i + 1
+    if 0 < i - 1 < n - 1:
+      expected += i - 1
+    assert s[i] == expected
+
+
+@ti.all_archs
+def test_cache_shared_grad():
+  x = ti.var(ti.f32)
+  y = ti.var(ti.f32)
+  loss = ti.var(ti.f32)
+
+  n = 256
+  bs = 32
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n // bs).dense(ti.i, bs).place(x, x.grad, y, y.grad)
+    ti.root.place(loss, loss.grad)
+
+  @ti.kernel
+  def stencil():
+    ti.cache_shared(x)
+    for i in y:
+      if i > 0 and i < n - 1:
+        y[i] = x[i - 1] + x[i] * 2 + x[i + 1]
+
+  @ti.kernel
+  def compute_loss():
+    for i in y:
+      loss[None] += y[i]
+
+  with ti.Tape(loss):
+    stencil()
+    compute_loss()
+
+  for i in range(n):
+    expected = 0
+    for j in [i - 1, i, i + 1]:
+      if 0 < j < n - 1:
+        expected += 2 if j == i else 1
+    assert x.grad[i] == expected
@@ -0,0 +1,50 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_streaming_stores():
+  ti.cfg.cpu_streaming_stores = True
+  n = 128
+  x = ti.var(ti.f32, shape=(n, n))
+  y = ti.var(ti.f32, shape=(n, n))
+
+  @ti.kernel
+  def fill():
+    for i, j in x:
+      # Streamed: y is only written
+      y[i, j] = i + j
+      # Not streamed: read back in the same loop
+      x[i, j] = i - j
+      x[i, j] = x[i, j] * 2
+
+  fill()
+  for i in range(0, n, 7):
+    for j in range(0, n, 5):
+      assert y[i, j] == i + j
+      assert x[i, j] == (i - j) * 2
+
+
+@ti.all_archs
+def test_block_prefetch():
+  ti.cfg.cpu_block_prefetch = True
+  x = ti.var(ti.i32)
+  s = ti.var(ti.i32, shape=())
+  n = 1024
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n // 16).pointer().dense(ti.i, 16).place(x)
+
+  @ti.kernel
+  def activate():
+    for i in range(n // 32):
+      x[i * 32] = i
+
+  @ti.kernel
+  def total():
+    for i in x:
+      s[None] += x[i]
+
+  activate()
+  total()
+  assert s[None] == sum(range(n // 32))
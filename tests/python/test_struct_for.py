@@ -174,3 +174,194 @@ def test_linear_k():
   for i in range(n):
     assert x[i] == i
 
+
+
+@ti.all_archs
+def test_fused_struct_fors():
+  arch = ti.cfg.arch
+  n = 128
+  num_tasks = []
+  for fusion in [True, False]:
+    ti.reset()
+    ti.cfg.arch = arch
+    ti.cfg.struct_for_fusion = fusion
+    x = ti.var(ti.i32)
+    y = ti.var(ti.i32)
+    z = ti.var(ti.i32)
+
+    @ti.layout
+    def place():
+      ti.root.pointer(ti.i, n // 16).dense(ti.i, 16).place(x, y, z)
+
+    @ti.kernel
+    def fill():
+      for i in range(n):
+        x[i] = i
+
+    @ti.kernel
+    def run():
+      # Fusible: both loops only touch the element of the current iteration
+      for i in x:
+        y[i] = x[i] * 2
+      for i in y:
+        y[i] += 1
+      # Not fusible: reads the neighbor written by the previous loop
+      for i in y:
+        z[i] = y[(i + 1) % n]
+
+    fill()
+    run()
+    num_tasks.append(run.get_taichi_kernel().num_offloaded_tasks)
+
+    for i in range(n):
+      assert y[i] == i * 2 + 1
+      assert z[i] == ((i + 1) % n) * 2 + 1
+  # The fused loops generate and traverse the block list once
+  assert 0 < num_tasks[0] < num_tasks[1]
+
+
+@ti.all_archs
+def test_dense_struct_for_coordinates():
+  x = ti.var(ti.i32)
+  y = ti.var(ti.i32)
+  count = ti.var(ti.i32, shape=())
+
+  @ti.layout
+  def place():
+    # Padded along i, which the range-for skips
+    ti.root.dense(ti.ij, (5, 2)).dense(ti.ij, (4, 2)).place(x)
+    ti.root.dense(ti.ijk, (3, 2, 4)).dense(ti.j, 8).place(y)
+
+  @ti.kernel
+  def fill():
+    for i, j in x:
+      x[i, j] = i * 100 + j
+      ti.atomic_add(count[None], 1)
+    for i, j, k in y:
+      y[i, j, k] = i * 10000 + j * 100 + k
+      ti.atomic_add(count[None], 1)
+
+  fill()
+  assert count[None] == 20 * 4 + 3 * 16 * 4
+  for i in range(20):
+    for j in range(4):
+      assert x[i, j] == i * 100 + j
+  for i in range(3):
+    for j in range(16):
+      for k in range(4):
+        assert y[i, j, k] == i * 10000 + j * 100 + k
+
+
+@ti.all_archs
+def test_persistent_struct_for():
+  ti.cfg.gpu_persistent_threads = True
+  x = ti.var(ti.i32)
+  count = ti.var(ti.i32, shape=())
+  n = 1024
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n // 64).pointer().dense(ti.i, 8).pointer().dense(
+        ti.i, 8).place(x)
+
+  @ti.kernel
+  def activate():
+    for i in range(n):
+      if i % 24 == 0:
+        x[i] = i
+
+  @ti.kernel
+  def inc():
+    for i in x:
+      x[i] += 1
+      ti.atomic_add(count[None], 1)
+
+  activate()
+  for _ in range(3):
+    inc()
+  # Every third leaf block is active
+  num_active = (n // 8 + 2) // 3 * 8
+  assert count[None] == num_active * 3
+  for i in range(n):
+    if i // 8 % 3 == 0:
+      assert x[i] == (i if i % 24 == 0 else 0) + 3
+    else:
+      assert x[i] == 0
+
+
+@ti.all_archs
+def test_small_leaf_blocks():
+  x = ti.var(ti.i32)
+  count = ti.var(ti.i32, shape=())
+  n = 1024
+
+  # With 4 cells each, many leaf blocks share a GPU block
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n // 4).pointer().dense(ti.i, 4).place(x)
+
+  @ti.kernel
+  def activate():
+    for i in range(n):
+      if i % 12 < 4:
+        x[i] = i
+
+  @ti.kernel
+  def inc():
+    for i in x:
+      x[i] += 1
+      ti.atomic_add(count[None], 1)
+
+  activate()
+  inc()
+  assert count[None] == (n // 4 + 2) // 3 * 4
+  for i in range(n):
+    assert x[i] == (i + 1 if i % 12 < 4 else 0)
+
+
+@ti.all_archs
+def test_struct_for_fission():
+  arch = ti.cfg.arch
+  n = 128
+  num_tasks = []
+  for live_values in [1, 0]:
+    ti.reset()
+    ti.cfg.arch = arch
+    ti.cfg.gpu_fission_live_values = live_values
+    x = ti.var(ti.f32)
+    y = ti.var(ti.f32)
+    z = ti.var(ti.f32)
+    s = ti.var(ti.f32, shape=())
+
+    @ti.layout
+    def place():
+      ti.root.pointer(ti.i, n // 16).dense(ti.i, 16).place(x, y, z)
+
+    @ti.kernel
+    def fill():
+      for i in range(n):
+        x[i] = i
+
+    @ti.kernel
+    def run(a: ti.f32):
+      for i in x:
+        # Three phases with nothing but the index and a live between them
+        y[i] = x[i] * a + 1
+        z[i] = ti.sqrt(x[i]) + a * i
+        v = x[i]
+        x[i] = v * v
+        s[None] += v
+
+    fill()
+    run(2)
+    num_tasks.append(run.get_taichi_kernel(2).num_offloaded_tasks)
+    for i in range(n):
+      assert x[i] == i * i
+      assert y[i] == i * 2 + 1
+      assert abs(z[i] - (i**0.5 + 2 * i)) < 1e-4
+    assert s[None] == n * (n - 1) / 2
+  # Only GPU struct-fors are split, each phase into a task of its own
+  if arch == ti.cuda:
+    assert num_tasks[0] > num_tasks[1] > 0
+  else:
+    assert num_tasks[0] == num_tasks[1]
@@ -46,3 +46,35 @@ def test_dense_dynamic():
       assert x[i, j] == j * 2
 
 test_dense_dynamic()
+
+
+@ti.all_archs
+def test_uneven_dynamic():
+  n = 64
+  m = 1024
+
+  x = ti.var(ti.i32)
+  s = ti.var(ti.i32, shape=())
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n).dynamic(ti.j, m, 32).place(x)
+
+  # Only a few long lists, which the CPU threads share by their cells
+  @ti.kernel
+  def append():
+    for i in range(n):
+      if i % 16 == 0:
+        for j in range(m - i):
+          ti.append(x, i, 1)
+      else:
+        ti.append(x, i, 1)
+
+  @ti.kernel
+  def count():
+    for i, j in x:
+      s[None] += x[i, j]
+
+  append()
+  count()
+  assert s[None] == sum(m - i if i % 16 == 0 else 1 for i in range(n))
@@ -80,3 +80,92 @@ def test_transpose_no_loop():
   run()
   # As long as it passes compilation we are good
   
+
+
+@ti.all_archs
+def test_svd_vectorized():
+  n = 64
+  A = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+  R = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+  UtU = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+
+  @ti.kernel
+  def run():
+    ti.vectorize(8)
+    for i in range(n):
+      U, sigma, V = ti.svd(A[i], ti.f32)
+      R[i] = U @ sigma @ ti.transposed(V)
+      UtU[i] = ti.transposed(U) @ U
+
+  a = np.random.rand(n, 3, 3).astype(np.float32) * 2 - 1
+  A.from_numpy(a)
+  run()
+  assert mat_equal(R.to_numpy(), a, tol=1e-4)
+  assert mat_equal(UtU.to_numpy(), np.broadcast_to(np.eye(3), (n, 3, 3)),
+                   tol=1e-4)
+
+
+@ti.all_archs
+def test_sym_eig():
+  mats = [np.eye(3), np.diag([1.0, 1.0, 2.0]), np.zeros((3, 3))]
+  for i in range(13):
+    a = np.random.rand(3, 3) * 2 - 1
+    mats.append(a + a.T)
+  mats = np.array(mats, dtype=np.float32)
+  n = len(mats)
+  A = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+  Q = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+  eig = ti.Vector(3, dt=ti.f32, shape=n)
+
+  @ti.kernel
+  def run():
+    for i in range(n):
+      eig[i], Q[i] = ti.sym_eig(A[i], ti.f32)
+
+  A.from_numpy(mats)
+  run()
+  q = Q.to_numpy()
+  e = eig.to_numpy(as_vector=True)
+  for i in range(n):
+    assert mat_equal(q[i] @ np.diag(e[i]) @ q[i].T, mats[i], tol=1e-4)
+    assert mat_equal(q[i].T @ q[i], np.eye(3), tol=1e-4)
+    assert np.linalg.det(q[i]) == approx(1, abs=1e-4)
+    assert e[i][0] >= e[i][1] >= e[i][2]
+
+
+@ti.all_archs
+def test_svd_eig_and_polar_newton():
+  n = 16
+  A = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+  R_svd = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+  U = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+  sigma = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+  V = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+  R = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+  S = ti.Matrix(3, 3, dt=ti.f32, shape=n)
+
+  @ti.kernel
+  def run():
+    for i in range(n):
+      U[i], sigma[i], V[i] = ti.svd(A[i], ti.f32, method='eig')
+      R[i], S[i] = ti.polar_decompose(A[i], ti.f32, method='newton')
+      R_svd[i], _ = ti.polar_decompose(A[i], ti.f32)
+
+  # Deformation gradients, with some det(A) < 0 among them for the SVD
+  a = np.eye(3) + (np.random.rand(n, 3, 3) - 0.5) * 0.8
+  a[:4, 0] *= -1
+  a = a.astype(np.float32)
+  A.from_numpy(a)
+  run()
+  u, s, v = U.to_numpy(), sigma.to_numpy(), V.to_numpy()
+  r, sym = R.to_numpy(), S.to_numpy()
+  for i in range(n):
+    assert mat_equal(u[i] @ s[i] @ v[i].T, a[i], tol=1e-4)
+    assert np.linalg.det(u[i]) == approx(1, abs=1e-4)
+    assert np.linalg.det(v[i]) == approx(1, abs=1e-4)
+    assert s[i][0, 0] >= s[i][1, 1] >= abs(s[i][2, 2])
+    assert mat_equal(r[i] @ sym[i], a[i], tol=1e-4)
+    assert mat_equal(r[i].T @ r[i], np.eye(3), tol=1e-4)
+    assert mat_equal(sym[i], sym[i].T, tol=1e-5)
+  # Rotations only where det(A) > 0, where both methods agree
+  assert mat_equal(r[4:], R_svd.to_numpy()[4:], tol=1e-4)
@@ -0,0 +1,38 @@
+import taichi as ti
+import numpy as np
+
+
+# The entries are multiples of 1 / 8 below 2, which f16 keeps exactly, so
+# that the products on the tensor cores are exact too
+def random_matrices(rng, *shape):
+  return (rng.randint(-16, 16, shape) / 8).astype(np.float32)
+
+
+@ti.all_archs
+def test_warp_matmul():
+  ti.cfg.use_tensor_cores = True
+  n, k, m = 16, 32, 4
+  num = 256
+  W = ti.Matrix(n, k, dt=ti.f32, shape=())
+  A = ti.Matrix(n, k, dt=ti.f32, shape=num)
+  X = ti.Matrix(k, m, dt=ti.f32, shape=num)
+  Y = ti.Matrix(n, m, dt=ti.f32, shape=num)
+  Z = ti.Matrix(n, m, dt=ti.f32, shape=num)
+
+  @ti.kernel
+  def run():
+    for i in X:
+      Y[i] = W[None] @ X[i]
+      # Not the same in all threads, which take the FMAs
+      Z[i] = A[i] @ X[i]
+
+  rng = np.random.RandomState(0)
+  w = random_matrices(rng, n, k)
+  a = random_matrices(rng, num, n, k)
+  x = random_matrices(rng, num, k, m)
+  W.from_numpy(w)
+  A.from_numpy(a)
+  X.from_numpy(x)
+  run()
+  assert np.max(np.abs(Y.to_numpy() - w @ x)) < 1e-5
+  assert np.max(np.abs(Z.to_numpy() - a @ x)) < 1e-5
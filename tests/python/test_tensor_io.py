@@ -0,0 +1,48 @@
+import taichi as ti
+import numpy as np
+
+
+@ti.all_archs
+def test_save_load_tensors():
+  import tempfile
+  import os
+  n = 128
+  filename = os.path.join(tempfile.mkdtemp(), 'frame.bin')
+
+  def build():
+    x = ti.Vector(3, dt=ti.f32)
+    m = ti.var(ti.i32)
+    # Sparse, so written through to_numpy
+    s = ti.var(ti.f32)
+
+    @ti.layout
+    def place():
+      ti.root.dense(ti.ij, (n, 5)).place(x, m)
+      ti.root.pointer(ti.i, 4).dense(ti.i, 8).place(s)
+
+    return x, m, s
+
+  x, m, s = build()
+  rng = np.random.RandomState(0)
+  a = rng.uniform(-1, 1, (n, 5, 3)).astype(np.float32)
+  b = rng.randint(0, 100, (n, 5)).astype(np.int32)
+  c = rng.uniform(-1, 1, 32).astype(np.float32)
+  x.from_numpy(a)
+  m.from_numpy(b)
+  s.from_numpy(c)
+  ti.save_tensors(filename, [x, m, s])
+
+  arch = ti.cfg.arch
+  ti.reset()
+  ti.cfg.arch = arch
+  x, m, s = build()
+  ti.load_tensors(filename, [x, m, s])
+  assert (x.to_numpy() == a).all()
+  assert (m.to_numpy() == b).all()
+  assert (s.to_numpy() == c).all()
+
+  # The cells of m, after the header and the three entries of x
+  with open(filename, 'rb') as f:
+    f.seek(8 + 3 * (8 + n * 5 * 4) + 8)
+    assert (np.fromfile(f, dtype=np.int32, count=n * 5) == b.ravel()).all()
+  os.remove(filename)
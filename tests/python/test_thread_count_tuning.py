@@ -0,0 +1,30 @@
+import taichi as ti
+
+
+@ti.all_archs
+def test_thread_count_tuning():
+  ti.cfg.cpu_thread_count_tuning = True
+  n = 1000
+  x = ti.var(ti.i32, shape=n)
+  y = ti.var(ti.i32)
+
+  @ti.layout
+  def place():
+    ti.root.dense(ti.i, n // 8).pointer().dense(ti.i, 8).place(y)
+
+  @ti.kernel
+  def inc():
+    for i in range(n):
+      x[i] += i
+    for i in y:
+      y[i] += 1
+
+  # Activates every leaf block
+  for i in range(0, n, 8):
+    y[i] = 0
+  # Every invocation during tuning must still run exactly once
+  for k in range(10):
+    inc()
+  for i in range(n):
+    assert x[i] == i * 10
+    assert y[i] == 10
@@ -0,0 +1,36 @@
+import taichi as ti
+import json
+import os
+import tempfile
+
+
+@ti.all_archs
+def test_timeline():
+  ti.cfg.timeline = True
+  ti.clear_timeline()
+  x = ti.var(ti.i32, shape=16)
+
+  @ti.kernel
+  def fill():
+    for i in x:
+      x[i] = i
+
+  fill()
+  fill()
+  ti.sync()
+  fd, fn = tempfile.mkstemp(suffix='.json')
+  os.close(fd)
+  ti.save_timeline(fn)
+  with open(fn) as f:
+    events = json.load(f)['traceEvents']
+  os.remove(fn)
+  ti.clear_timeline()
+
+  def find(cat):
+    return [e for e in events if e['cat'] == cat and 'fill' in e['name']]
+
+  assert len(find('kernel')) == 2
+  assert len(find('compile')) == 1
+  assert len(find('task')) + len(find('launch')) >= 2
+  for e in events:
+    assert e['ph'] == 'X' and e['dur'] >= 0
@@ -0,0 +1,47 @@
+import taichi as ti
+import numpy as np
+
+
+# The 12 triangles of the box [lower, upper], facing outwards
+def box_mesh(lower, upper):
+  vertices = np.array([[upper[d] if i >> d & 1 else lower[d] for d in range(3)]
+                       for i in range(8)])
+  quads = [[0, 2, 3, 1], [4, 5, 7, 6], [0, 1, 5, 4], [2, 6, 7, 3],
+           [0, 4, 6, 2], [1, 3, 7, 5]]
+  faces = []
+  for a, b, c, d in quads:
+    faces += [[a, b, c], [a, c, d]]
+  return vertices, np.array(faces)
+
+
+def test_voxelize_numpy():
+  vertices, faces = box_mesh((0.2, 0.3, 0.1), (0.6, 0.5, 0.77))
+  grid = np.zeros((10, 10, 10), dtype=np.uint8)
+  ti.voxelize(vertices, faces, grid, dx=0.1, value=3)
+  centers = (np.arange(10) + 0.5) * 0.1
+  inside = lambda c, lo, hi: (lo < c) & (c < hi)
+  expected = (inside(centers, 0.2, 0.6)[:, None, None] &
+              inside(centers, 0.3, 0.5)[None, :, None] &
+              inside(centers, 0.1, 0.77)[None, None, :])
+  assert np.array_equal(grid, expected * 3)
+
+
+def test_voxelize_shared_edges():
+  # Edges and vertices on the centers of the columns: each voxel is inside
+  # exactly once, with no column leaking through the top
+  vertices, faces = box_mesh((2.5, 2.5, 2.5), (10.5, 10.5, 10.5))
+  grid = np.zeros((16, 16, 16), dtype=np.int32)
+  ti.voxelize(vertices, faces, grid)
+  assert grid.sum() == 8**3
+  assert grid[..., -1].sum() == 0
+
+
+@ti.all_archs
+def test_voxelize_tensor():
+  n = 16
+  x = ti.var(ti.f32, shape=(n, n, n))
+  vertices, faces = box_mesh((-1, 4.2, 3), (8.2, 12, 20))
+  ti.voxelize(vertices, faces, x, value=2.5)
+  grid = x.to_numpy()
+  assert np.all(grid[:8, 4:12, 3:] == 2.5)
+  assert grid.sum() == 8 * 8 * 13 * 2.5